@@ -46,6 +46,7 @@
 	#include <circle/machineinfo.h>
 	#include <circle/memio.h>
 	#include <circle/sched/scheduler.h>
+	#include <circle/new.h>
 #else
 	#include "mmc.h"
 	#include "mmcerror.h"
@@ -86,6 +87,11 @@
 // Requires 150 mA power so disabled on the RPi for now
 #define SDXC_MAXIMUM_PERFORMANCE
 
+// Timeout of read/write commands, which grows with the number of transferred blocks,
+// so that large (DMA) transfers do not time out on slow cards
+#define EMMC_DATA_TIMEOUT_BASE		5000000		// us
+#define EMMC_DATA_TIMEOUT_PER_BLOCK	2000		// us
+
 #ifndef USE_SDHOST
 
 // Enable card interrupts
@@ -95,6 +101,23 @@
 // Required for QEMU
 #define EMMC_ALLOW_OLD_SDHCI
 
+// Use DMA for data block transfers instead of programmed I/O.
+// The Raspberry Pi 4 uses the ADMA2 engine of the EMMC2 controller (falls back
+// to programmed I/O, if ADMA2 is not announced in the capabilities register).
+// The Raspberry Pi 1-3 use the platform DMA controller, paced by the EMMC DREQ.
+// This is not supported by QEMU and is therefore disabled by default.
+#if RASPPI == 4
+#define EMMC_USE_DMA
+#elif RASPPI <= 3
+//#define EMMC_USE_DMA
+#endif
+
+// Maximum number of blocks transferred with one DMA request
+#define EMMC_DMA_MAX_BLOCKS	1024
+
+// Maximum number of bytes per ADMA2 descriptor
+#define EMMC_ADMA_MAX_LENGTH	0x8000
+
 #if RASPPI != 4
 	#define EMMC_BASE	ARM_EMMC_BASE
 #else
@@ -120,6 +143,8 @@
 #define EMMC_CAPABILITIES_0	(EMMC_BASE + 0x40)
 #define EMMC_CAPABILITIES_1	(EMMC_BASE + 0x44)
 #define EMMC_FORCE_IRPT		(EMMC_BASE + 0x50)
+#define EMMC_ADMA_ERR_STAT	(EMMC_BASE + 0x54)
+#define EMMC_ADMA_SYS_ADDR	(EMMC_BASE + 0x58)
 #define EMMC_BOOT_TIMEOUT	(EMMC_BASE + 0x70)
 #define EMMC_DBG_SEL		(EMMC_BASE + 0x74)
 #define EMMC_EXRDFIFO_CFG	(EMMC_BASE + 0x80)
@@ -466,6 +491,16 @@ const u32 CEMMCDevice::sd_acommands[] =
 
 #ifndef USE_SDHOST
 
+#define SD_CAPS0_ADMA2		(1 << 19)
+
+#define SD_CONTROL0_DMA_SEL_MASK	(3 << 3)
+#define SD_CONTROL0_DMA_SEL_ADMA2_32	(2 << 3)
+
+#define ADMA2_ATTR_VALID	(1 << 0)
+#define ADMA2_ATTR_END		(1 << 1)
+#define ADMA2_ATTR_INT		(1 << 2)
+#define ADMA2_ATTR_ACT_TRAN	(2 << 4)
+
 #define SD_RESET_CMD            (1 << 25)
 #define SD_RESET_DAT            (1 << 26)
 #define SD_RESET_ALL            (1 << 24)
@@ -476,6 +511,8 @@ const u32 CEMMCDevice::sd_acommands[] =
 
 #define SD_BLOCK_SIZE		512
 
+#define EMMC_ADMA_DESCRIPTORS	(EMMC_DMA_MAX_BLOCKS * SD_BLOCK_SIZE / EMMC_ADMA_MAX_LENGTH)
+
 CEMMCDevice::CEMMCDevice (CInterruptSystem *pInterruptSystem, CTimer *pTimer, CActLED *pActLED)
 :	m_pInterruptSystem (pInterruptSystem),
 	m_pTimer (pTimer),
@@ -489,6 +526,16 @@ CEMMCDevice::CEMMCDevice (CInterruptSystem *pInterruptSystem, CTimer *pTimer, CA
 #endif
 	m_capacity ((u64) -1),
 	m_pSCR (0)
+#ifndef USE_SDHOST
+	, m_use_dma (FALSE),
+	m_dma_buf (0),
+	m_dma_data (0)
+#if RASPPI == 4
+	, m_adma_table (0)
+#elif RASPPI <= 3
+	, m_dma_channel (0)
+#endif
+#endif
 {
 	assert (m_pInterruptSystem != 0);
 	assert (m_pTimer != 0);
@@ -522,6 +569,17 @@ CEMMCDevice::~CEMMCDevice (void)
 {
 #ifdef USE_SDHOST
 	m_Host.Reset ();
+#else
+#if RASPPI == 4
+	delete [] m_adma_table;
+	m_adma_table = 0;
+#elif RASPPI <= 3
+	delete m_dma_channel;
+	m_dma_channel = 0;
+#endif
+
+	delete [] m_dma_buf;
+	m_dma_buf = 0;
 #endif
 
 	delete m_pSCR;
@@ -923,6 +981,22 @@ void CEMMCDevice::IssueCommandInt (u32 cmd_reg, u32 argument, int timeout)
 	u32 blksizecnt = m_block_size | (m_blocks_to_transfer << 16);
 	write32 (EMMC_BLKSIZECNT, blksizecnt);
 
+#ifdef EMMC_USE_DMA
+	// Data blocks are transferred using DMA, other data (e.g. SCR) using PIO
+	boolean use_dma =    m_use_dma
+			  && (cmd_reg & SD_CMD_ISDATA)
+			  && m_block_size == SD_BLOCK_SIZE;
+	boolean dma_write = !(cmd_reg & SD_CMD_DAT_DIR_CH);
+	if (use_dma)
+	{
+		StartDMA (dma_write);
+
+#if RASPPI == 4
+		cmd_reg |= SD_CMD_DMA;
+#endif
+	}
+#endif
+
 	// Set argument 1 reg
 	write32 (EMMC_ARG1, argument);
 
@@ -947,6 +1021,13 @@ void CEMMCDevice::IssueCommandInt (u32 cmd_reg, u32 argument, int timeout)
 		m_last_error = irpts & 0xffff0000;
 		m_last_interrupt = irpts;
 
+#ifdef EMMC_USE_DMA
+		if (use_dma)
+		{
+			FinishDMA (dma_write, FALSE);
+		}
+#endif
+
 		return;
 	}
 
@@ -969,6 +1050,13 @@ void CEMMCDevice::IssueCommandInt (u32 cmd_reg, u32 argument, int timeout)
 	}
 
 	// If with data, wait for the appropriate interrupt
+#ifdef EMMC_USE_DMA
+	if (use_dma)
+	{
+		// Data is moved by DMA, only wait for transfer complete below
+	}
+	else
+#endif
 	if (cmd_reg & SD_CMD_ISDATA)
 	{
 		u32 wr_irpt;
@@ -1064,6 +1152,13 @@ void CEMMCDevice::IssueCommandInt (u32 cmd_reg, u32 argument, int timeout)
 				m_last_error = irpts & 0xffff0000;
 				m_last_interrupt = irpts;
 
+#ifdef EMMC_USE_DMA
+				if (use_dma)
+				{
+					FinishDMA (dma_write, FALSE);
+				}
+#endif
+
 				return;
 			}
 
@@ -1071,6 +1166,18 @@ void CEMMCDevice::IssueCommandInt (u32 cmd_reg, u32 argument, int timeout)
 		}
 	}
 
+#ifdef EMMC_USE_DMA
+	if (   use_dma
+	    && !FinishDMA (dma_write, TRUE))
+	{
+		LogWrite (LogWarning, "DMA transfer failed");
+
+		m_last_error = 1 << (16 + SD_ERR_ADMA);
+
+		return;
+	}
+#endif
+
 	// Return success
 	m_last_cmd_success = 1;
 }
@@ -2269,6 +2376,10 @@ int CEMMCDevice::CardInit (void)
 #endif
 	}
 
+#ifdef EMMC_USE_DMA
+	m_use_dma = SetupDMA ();
+#endif
+
 #endif	// #ifndef USE_SDHOST
 
 	// The SEND_SCR command may fail with a DATA_TIMEOUT on the Raspberry Pi 4
@@ -2386,6 +2497,30 @@ int CEMMCDevice::EnsureDataMode (void)
 }
 
 int CEMMCDevice::DoDataCommand (int is_write, u8 *buf, size_t buf_size, u32 block_no)
+{
+#if !defined (USE_SDHOST) && defined (EMMC_USE_DMA)
+	// Split requests, which do not fit into the DMA bounce buffer
+	if (m_use_dma)
+	{
+		const size_t max_size = EMMC_DMA_MAX_BLOCKS * SD_BLOCK_SIZE;
+		while (buf_size > max_size)
+		{
+			if (DoDataCommandInt (is_write, buf, max_size, block_no) < 0)
+			{
+				return -1;
+			}
+
+			buf += max_size;
+			buf_size -= max_size;
+			block_no += EMMC_DMA_MAX_BLOCKS;
+		}
+	}
+#endif
+
+	return DoDataCommandInt (is_write, buf, buf_size, block_no);
+}
+
+int CEMMCDevice::DoDataCommandInt (int is_write, u8 *buf, size_t buf_size, u32 block_no)
 {
 	// PLSS table 4.20 - SDSC cards use byte addresses rather than block addresses
 	if (!m_card_supports_sdhc)
@@ -2435,11 +2570,14 @@ int CEMMCDevice::DoDataCommand (int is_write, u8 *buf, size_t buf_size, u32 bloc
 		}
 	}
 
+	int timeout =   EMMC_DATA_TIMEOUT_BASE
+		      + m_blocks_to_transfer * EMMC_DATA_TIMEOUT_PER_BLOCK;
+
 	int retry_count = 0;
 	int max_retries = 3;
 	while (retry_count < max_retries)
 	{
-		if (IssueCommand (command, block_no, 5000000))
+		if (IssueCommand (command, block_no, timeout))
 		{
 			break;
 		}
@@ -2540,6 +2678,157 @@ int CEMMCDevice::TimeoutWait (unsigned long reg, unsigned mask, int value, unsig
 	return 0;
 }
 
+#ifdef EMMC_USE_DMA
+
+boolean CEMMCDevice::SetupDMA (void)
+{
+#if RASPPI == 4
+	if (!(read32 (EMMC_CAPABILITIES_0) & SD_CAPS0_ADMA2))
+	{
+		LogWrite (LogWarning, "ADMA2 is not supported, using PIO");
+
+		return FALSE;
+	}
+
+	assert (m_adma_table == 0);
+	m_adma_table = new (HEAP_DMA30) TADMA2Descriptor[EMMC_ADMA_DESCRIPTORS];
+	assert (m_adma_table != 0);
+#else
+	assert (m_dma_channel == 0);
+	m_dma_channel = new CDMAChannel (DMA_CHANNEL_NORMAL);
+	assert (m_dma_channel != 0);
+#endif
+
+	assert (m_dma_buf == 0);
+	m_dma_buf = new (HEAP_DMA30) u8[EMMC_DMA_MAX_BLOCKS * SD_BLOCK_SIZE];
+	assert (m_dma_buf != 0);
+
+#ifdef EMMC_DEBUG2
+	LogWrite (LogDebug, "Using DMA for data transfers");
+#endif
+
+	return TRUE;
+}
+
+void CEMMCDevice::StartDMA (boolean is_write)
+{
+	size_t length = m_block_size * m_blocks_to_transfer;
+	assert (length > 0);
+	assert (length <= EMMC_DMA_MAX_BLOCKS * SD_BLOCK_SIZE);
+
+	// The caller's buffer is used directly, if it is cache-aligned
+	// (and reachable by the EMMC2 DMA, which can access the first GB only)
+	m_dma_data = (u8 *) m_buf;
+	if (   !IS_CACHE_ALIGNED (m_buf, length)
+#if RASPPI == 4
+	    || (uintptr) m_buf + length > MEM_HIGHMEM_START
+#endif
+	   )
+	{
+		assert (m_dma_buf != 0);
+		m_dma_data = m_dma_buf;
+
+		if (is_write)
+		{
+			memcpy (m_dma_data, m_buf, length);
+		}
+	}
+
+	CleanAndInvalidateDataCacheRange ((uintptr) m_dma_data, length);
+
+#if RASPPI == 4
+	assert (m_adma_table != 0);
+	TADMA2Descriptor *desc = m_adma_table;
+	uintptr address = BUS_ADDRESS ((uintptr) m_dma_data);
+	while (length > 0)
+	{
+		size_t desc_length = length;
+		if (desc_length > EMMC_ADMA_MAX_LENGTH)
+		{
+			desc_length = EMMC_ADMA_MAX_LENGTH;
+		}
+		length -= desc_length;
+
+		assert (desc < &m_adma_table[EMMC_ADMA_DESCRIPTORS]);
+		desc->attr = ADMA2_ATTR_VALID | ADMA2_ATTR_ACT_TRAN;
+		if (length == 0)
+		{
+			desc->attr |= ADMA2_ATTR_END;
+		}
+		desc->length = (u16) desc_length;
+		desc->address = (u32) address;
+
+		address += desc_length;
+		desc++;
+	}
+
+	CleanAndInvalidateDataCacheRange ((uintptr) m_adma_table,
+					  sizeof (TADMA2Descriptor) * EMMC_ADMA_DESCRIPTORS);
+
+	// Select ADMA2 (the selection is cleared on controller reset)
+	u32 control0 = read32 (EMMC_CONTROL0);
+	control0 &= ~SD_CONTROL0_DMA_SEL_MASK;
+	control0 |= SD_CONTROL0_DMA_SEL_ADMA2_32;
+	write32 (EMMC_CONTROL0, control0);
+
+	write32 (EMMC_ADMA_SYS_ADDR, BUS_ADDRESS ((uintptr) m_adma_table));
+#else
+	assert (m_dma_channel != 0);
+	if (is_write)
+	{
+		m_dma_channel->SetupIOWrite (EMMC_DATA, m_dma_data, length, DREQSourceEMMC);
+	}
+	else
+	{
+		m_dma_channel->SetupIORead (m_dma_data, EMMC_DATA, length, DREQSourceEMMC);
+	}
+
+	m_dma_channel->Start ();
+#endif
+}
+
+boolean CEMMCDevice::FinishDMA (boolean is_write, boolean success)
+{
+#if RASPPI <= 3
+	assert (m_dma_channel != 0);
+	if (success)
+	{
+		// The DMA may still be draining the FIFO after transfer complete
+		success = m_dma_channel->Wait ();
+	}
+	else
+	{
+		m_dma_channel->Cancel ();
+	}
+
+	// The buffer ready status is set, even if the FIFO is served by DMA
+	write32 (EMMC_INTERRUPT, SD_BUFFER_WRITE_READY | SD_BUFFER_READ_READY);
+#endif
+
+	if (!success)
+	{
+		ResetDat ();
+
+		return FALSE;
+	}
+
+	if (!is_write)
+	{
+		size_t length = m_block_size * m_blocks_to_transfer;
+
+		CleanAndInvalidateDataCacheRange ((uintptr) m_dma_data, length);
+
+		if (m_dma_data != m_buf)
+		{
+			memcpy (m_buf, m_dma_data, length);
+		}
+	}
+
+	return TRUE;
+}
+
+#endif
+
 #endif
 
 void CEMMCDevice::usDelay (unsigned usec)
@@ -36,10 +36,13 @@
 #include <circle/gpiopin.h>
 #include <circle/fs/partitionmanager.h>
 #include <circle/logger.h>
+#include <circle/macros.h>
 #include <circle/types.h>
 #include <circle/sysconfig.h>
 #ifdef USE_SDHOST
 	#include <SDCard/sdhost.h>
+#elif RASPPI <= 3
+	#include <circle/dmachannel.h>
 #endif
 
 struct TSCR			// SD configuration register
@@ -49,6 +52,14 @@ struct TSCR			// SD configuration register
 	int	sd_version;
 };
 
+struct TADMA2Descriptor		// ADMA2 descriptor (32-bit addressing)
+{
+	u16	attr;
+	u16	length;
+	u32	address;
+}
+PACKED;
+
 class CEMMCDevice : public CDevice
 {
 public:
@@ -97,11 +108,16 @@ private:
 
 	int EnsureDataMode (void);
 	int DoDataCommand (int is_write, u8 *buf, size_t buf_size, u32 block_no);
+	int DoDataCommandInt (int is_write, u8 *buf, size_t buf_size, u32 block_no);
 	int DoRead (u8 *buf, size_t buf_size, u32 block_no);
 	int DoWrite (u8 *buf, size_t buf_size, u32 block_no);
 
 #ifndef USE_SDHOST
 	int TimeoutWait (unsigned long reg, unsigned mask, int value, unsigned usec);
+
+	boolean SetupDMA (void);
+	void StartDMA (boolean is_write);
+	boolean FinishDMA (boolean is_write, boolean success);
 #endif
 
 	void usDelay (unsigned usec);
@@ -165,6 +181,15 @@ private:
 #ifndef USE_SDHOST
 	int m_card_removal;
 	u32 m_base_clock;
+
+	boolean m_use_dma;
+	u8 *m_dma_buf;			// bounce buffer for unsuitable caller buffers
+	u8 *m_dma_data;			// buffer of the running DMA transfer
+#if RASPPI == 4
+	TADMA2Descriptor *m_adma_table;
+#elif RASPPI <= 3
+	CDMAChannel *m_dma_channel;
+#endif
 #endif
 
 	static const char *sd_versions[];
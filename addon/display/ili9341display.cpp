@@ -5,7 +5,7 @@
 //	https://github.com/u77345/circle/blob/master/addon/display/ili9341.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2024-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -135,6 +135,7 @@ CILI9341Display::CILI9341Display (CSPIMaster *pSPIMaster,
 	m_nChipSelect (nChipSelect),
 	m_bSwapColorBytes (bSwapColorBytes),
 	m_pBuffer (nullptr),
+	m_pPipeline (nullptr),
 	m_nRotation (0),
 	m_DCPin (nDCPin, GPIOModeOutput)
 {
@@ -153,8 +154,23 @@ CILI9341Display::CILI9341Display (CSPIMaster *pSPIMaster,
 	}
 }
 
+CILI9341Display::CILI9341Display (CSPIMasterDMA *pSPIMaster,
+				  unsigned nDCPin, unsigned nResetPin, unsigned nBackLightPin,
+				  unsigned nWidth, unsigned nHeight,
+				  unsigned nCPOL, unsigned nCPHA, unsigned nClockSpeed,
+				  unsigned nChipSelect, boolean bSwapColorBytes)
+:	CILI9341Display ((CSPIMaster *) nullptr, nDCPin, nResetPin, nBackLightPin,
+			 nWidth, nHeight, nCPOL, nCPHA, nClockSpeed, nChipSelect, bSwapColorBytes)
+{
+	assert (pSPIMaster != 0);
+	m_pPipeline = new CSPIDisplayPipeline (pSPIMaster, &m_DCPin, nClockSpeed, nCPOL, nCPHA,
+					       nChipSelect);
+	assert (m_pPipeline != 0);
+}
+
 CILI9341Display::~CILI9341Display (void)
 {
+	delete m_pPipeline;
 	delete [] m_pBuffer;
 };
 
@@ -167,13 +183,23 @@ void CILI9341Display::SetRotation (unsigned nDegrees)
 
 boolean CILI9341Display::Initialize (void)
 {
-	assert (m_pSPIMaster != 0);
-
-	if (!m_bSwapColorBytes)
+	if (m_pPipeline != 0)
+	{
+		if (!m_pPipeline->Initialize (m_nWidth * m_nHeight))
+		{
+			return FALSE;
+		}
+	}
+	else
 	{
-		assert (!m_pBuffer);
-		m_pBuffer = new u16[m_nWidth * m_nHeight];
-		assert (m_pBuffer);
+		assert (m_pSPIMaster != 0);
+
+		if (!m_bSwapColorBytes)
+		{
+			assert (!m_pBuffer);
+			m_pBuffer = new u16[m_nWidth * m_nHeight];
+			assert (m_pBuffer);
+		}
 	}
 
 	if (m_nBackLightPin != None)
@@ -297,6 +323,20 @@ void CILI9341Display::Clear (TRawColor nColor)
 
 	SetWindow (0, 0, m_nWidth-1, m_nHeight-1);
 
+	if (m_pPipeline != 0)
+	{
+		unsigned nPixels = m_nWidth * m_nHeight;
+		u16 *pBuffer = m_pPipeline->GetStagingBuffer ();
+		for (unsigned i = 0; i < nPixels; i++)
+		{
+			pBuffer[i] = (u16) nColor;
+		}
+
+		m_pPipeline->Send (nPixels);
+
+		return;
+	}
+
 	u16 Buffer[m_nWidth];
 	for (unsigned x = 0; x < m_nWidth; x++)
 	{
@@ -325,22 +365,34 @@ void CILI9341Display::SetArea (const TArea &rArea, const void *pPixels,
 			       TAreaCompletionRoutine *pRoutine,
 			       void *pParam)
 {
+	unsigned nWidth = rArea.x2 - rArea.x1 + 1;
+	unsigned nHeight = rArea.y2 - rArea.y1 + 1;
+
+	// We swap bytes here, because there are swapped by default by the hardware.
+	if (m_pPipeline != 0)
+	{
+		// convert, while the previous area may still be sent
+		u16 *pBuffer = m_pPipeline->GetStagingBuffer ();
+		CSPIDisplayPipeline::ConvertPixels (pBuffer, (const u16 *) pPixels,
+						    nWidth, nHeight, 0, !m_bSwapColorBytes);
+
+		SetWindow (rArea.x1, rArea.y1, rArea.x2, rArea.y2);
+
+		m_pPipeline->Send (nWidth * nHeight, pRoutine, pParam);
+
+		return;
+	}
+
 	SetWindow (rArea.x1, rArea.y1, rArea.x2, rArea.y2);
 
-	size_t ulSize = (rArea.y2 - rArea.y1 + 1) * (rArea.x2 - rArea.x1 + 1) * sizeof (u16);
+	size_t ulSize = nWidth * nHeight * sizeof (u16);
 
 	if (!m_bSwapColorBytes)
 	{
-		// We swap bytes here, because there are swapped by default by the hardware.
-		unsigned nPixels = ulSize / sizeof (u16);
-		assert (nPixels < m_nWidth * m_nHeight);
-
-		const u16 *p = (const u16 *) pPixels;
-		u16 *q = m_pBuffer;
-		while (nPixels--)
-		{
-			*q++ = bswap16 (*p++);
-		}
+		assert (nWidth * nHeight <= m_nWidth * m_nHeight);
+		assert (m_pBuffer != 0);
+		CSPIDisplayPipeline::ConvertPixels (m_pBuffer, (const u16 *) pPixels,
+						    nWidth, nHeight, 0, TRUE);
 
 		pPixels = m_pBuffer;
 	}
@@ -388,6 +440,13 @@ void CILI9341Display::SetWindow (unsigned x0, unsigned y0, unsigned x1, unsigned
 
 void CILI9341Display::SendByte (u8 uchByte, boolean bIsData)
 {
+	if (m_pPipeline != 0)
+	{
+		m_pPipeline->Write (&uchByte, sizeof uchByte, bIsData);
+
+		return;
+	}
+
 	assert (m_pSPIMaster != 0);
 
 	m_DCPin.Write (bIsData ? HIGH : LOW);
@@ -406,6 +465,14 @@ void CILI9341Display::SendData (const void *pData, size_t nLength)
 {
 	assert (pData != 0);
 	assert (nLength > 0);
+
+	if (m_pPipeline != 0)
+	{
+		m_pPipeline->Write (pData, nLength, TRUE);
+
+		return;
+	}
+
 	assert (m_pSPIMaster != 0);
 
 	m_DCPin.Write (HIGH);
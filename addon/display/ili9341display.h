@@ -2,7 +2,7 @@
 // ili9341display.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2024-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -22,7 +22,9 @@
 
 #include <circle/display.h>
 #include <circle/spimaster.h>
+#include <circle/spimasterdma.h>
 #include <circle/gpiopin.h>
+#include <display/spidisplaypipeline.h>
 #include <circle/types.h>
 
 class CILI9341Display : public CDisplay /// Driver for ILI9341-based dot-matrix displays
@@ -51,6 +53,18 @@ public:
 			 unsigned nCPOL = 0, unsigned nCPHA = 0, unsigned nClockSpeed = 15000000,
 			 unsigned nChipSelect = 0, boolean bSwapColorBytes = TRUE);
 
+	/// \param pSPIMaster Pointer to SPI master object with DMA support
+	/// \note The other parameters are the same as above.
+	/// \note SetArea() sends the pixels by DMA and returns immediately, if a completion
+	///	  routine is given. The next area can be prepared in the meantime. Without a
+	///	  completion routine (e.g. from C2DGraphics) SetArea() waits for the transfer,
+	///	  so that the conversion of the next area does not overlap with it.
+	CILI9341Display (CSPIMasterDMA *pSPIMaster,
+			 unsigned nDCPin, unsigned nResetPin = None, unsigned nBackLightPin = None,
+			 unsigned nWidth = 240, unsigned nHeight = 320,
+			 unsigned nCPOL = 0, unsigned nCPHA = 0, unsigned nClockSpeed = 15000000,
+			 unsigned nChipSelect = 0, boolean bSwapColorBytes = TRUE);
+
 	~CILI9341Display (void);
 
 	/// \brief Set the global rotation of the display
@@ -88,8 +102,9 @@ public:
 	/// \brief Set area (rectangle) on the display to the raw colors in pPixels
 	/// \param rArea Coordinates of the area (zero-based)
 	/// \param pPixels Pointer to array with raw color values (RGB565 or RGB565_BE)
-	/// \param pRoutine Routine to be called on completion
+	/// \param pRoutine Routine to be called on completion (in interrupt context with DMA)
 	/// \param pParam User parameter to be handed over to completion routine
+	/// \note With DMA the buffer pPixels can be re-used, when this method returns.
 	void SetArea (const TArea &rArea, const void *pPixels,
 		      TAreaCompletionRoutine *pRoutine = nullptr,
 		      void *pParam = nullptr);
@@ -120,6 +135,8 @@ private:
 
 	u16 *m_pBuffer;
 
+	CSPIDisplayPipeline *m_pPipeline;	// with DMA only
+
 	unsigned m_nRotation;
 
 	CGPIOPin m_DCPin;
@@ -0,0 +1,430 @@
+//
+// spidisplaypipeline.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <display/spidisplaypipeline.h>
+#include <circle/new.h>
+#include <circle/util.h>
+#include <assert.h>
+
+#if (defined (__ARM_NEON) || defined (__ARM_NEON__)) && STDLIB_SUPPORT >= 1
+	#define DISPLAY_NEON
+	#include <arm_neon.h>
+#endif
+
+// The BCM2835 SPI master has a transfer size limit.
+#define MAX_TRANSFER_SIZE	0xFFFC
+
+#define TILE_SIZE		8		// pixels, rotated at once
+#define BLOCK_SIZE		32		// pixels, source and destination block fit into L1
+
+CSPIDisplayPipeline::CSPIDisplayPipeline (CSPIMasterDMA *pSPIMaster, CGPIOPin *pDCPin,
+					  unsigned nClockSpeed, unsigned CPOL, unsigned CPHA,
+					  unsigned nChipSelect)
+:	m_pSPIMaster (pSPIMaster),
+	m_pDCPin (pDCPin),
+	m_nClockSpeed (nClockSpeed),
+	m_CPOL (CPOL),
+	m_CPHA (CPHA),
+	m_nChipSelect (nChipSelect),
+	m_nMaxPixels (0),
+	m_nStagingBuffer (0),
+	m_pDummyBuffer (nullptr),
+	m_bBusy (FALSE),
+	m_pSendPtr (nullptr),
+	m_nSendRemaining (0),
+	m_pCompletionRoutine (nullptr),
+	m_pCompletionParam (nullptr)
+{
+	m_pStagingBuffer[0] = nullptr;
+	m_pStagingBuffer[1] = nullptr;
+}
+
+CSPIDisplayPipeline::~CSPIDisplayPipeline (void)
+{
+	Wait ();
+
+	delete [] m_pDummyBuffer;
+	delete [] m_pStagingBuffer[1];
+	delete [] m_pStagingBuffer[0];
+}
+
+boolean CSPIDisplayPipeline::Initialize (unsigned nMaxPixels)
+{
+	assert (m_pSPIMaster != 0);
+	assert (m_pDCPin != 0);
+
+	assert (nMaxPixels > 0);
+	m_nMaxPixels = nMaxPixels;
+
+	// buffers must be DMA-able and 4-byte aligned
+	for (unsigned i = 0; i < 2; i++)
+	{
+		assert (m_pStagingBuffer[i] == 0);
+		m_pStagingBuffer[i] = new (HEAP_DMA30) u16[m_nMaxPixels];
+		if (m_pStagingBuffer[i] == 0)
+		{
+			return FALSE;
+		}
+	}
+
+	size_t nDummySize = m_nMaxPixels * sizeof (u16);
+	if (nDummySize > MAX_TRANSFER_SIZE)
+	{
+		nDummySize = MAX_TRANSFER_SIZE;
+	}
+
+	m_pDummyBuffer = new (HEAP_DMA30) u8[nDummySize];
+
+	return m_pDummyBuffer != 0;
+}
+
+void CSPIDisplayPipeline::Write (const void *pData, size_t nLength, boolean bIsData)
+{
+	assert (pData != 0);
+	assert (nLength > 0);
+	assert (m_pSPIMaster != 0);
+	assert (m_pDCPin != 0);
+
+	Wait ();
+
+	m_pDCPin->Write (bIsData ? HIGH : LOW);
+
+	m_pSPIMaster->SetClock (m_nClockSpeed);
+	m_pSPIMaster->SetMode (m_CPOL, m_CPHA);
+
+#ifndef NDEBUG
+	int nResult =
+#endif
+		m_pSPIMaster->WriteReadSync (m_nChipSelect, pData, nullptr, nLength);
+	assert (nResult == (int) nLength);
+}
+
+u16 *CSPIDisplayPipeline::GetStagingBuffer (void)
+{
+	// Only one transfer can be active, which always uses the other buffer.
+	assert (m_pStagingBuffer[m_nStagingBuffer] != 0);
+	return m_pStagingBuffer[m_nStagingBuffer];
+}
+
+void CSPIDisplayPipeline::Send (unsigned nPixels, CDisplay::TAreaCompletionRoutine *pRoutine,
+				void *pParam)
+{
+	assert (0 < nPixels && nPixels <= m_nMaxPixels);
+	assert (m_pSPIMaster != 0);
+	assert (m_pDCPin != 0);
+
+	Wait ();
+
+	m_pSendPtr = (const u8 *) m_pStagingBuffer[m_nStagingBuffer];
+	m_nSendRemaining = nPixels * sizeof (u16);
+	m_nStagingBuffer ^= 1;
+
+	m_pCompletionRoutine = pRoutine;
+	m_pCompletionParam = pParam;
+
+	m_pDCPin->Write (HIGH);
+
+	m_pSPIMaster->SetClock (m_nClockSpeed);
+	m_pSPIMaster->SetMode (m_CPOL, m_CPHA);
+
+	m_bBusy = TRUE;
+
+	StartBlock ();
+
+	if (pRoutine == nullptr)
+	{
+		Wait ();
+	}
+}
+
+void CSPIDisplayPipeline::Wait (void)
+{
+	while (m_bBusy)
+	{
+		// just wait
+	}
+}
+
+void CSPIDisplayPipeline::StartBlock (void)
+{
+	assert (m_nSendRemaining > 0);
+	size_t nBlockSize =   m_nSendRemaining >= MAX_TRANSFER_SIZE
+			    ? MAX_TRANSFER_SIZE : m_nSendRemaining;
+
+	assert (m_pSPIMaster != 0);
+	m_pSPIMaster->SetCompletionRoutine (CompletionStub, this);
+	m_pSPIMaster->StartWriteRead (m_nChipSelect, m_pSendPtr, m_pDummyBuffer, nBlockSize);
+
+	m_pSendPtr += nBlockSize;
+	m_nSendRemaining -= nBlockSize;
+}
+
+void CSPIDisplayPipeline::CompletionRoutine (boolean bStatus)
+{
+	if (   bStatus
+	    && m_nSendRemaining > 0)
+	{
+		StartBlock ();
+
+		return;
+	}
+
+	// the rest of the area is dropped on error
+
+	CDisplay::TAreaCompletionRoutine *pRoutine = m_pCompletionRoutine;
+	m_pCompletionRoutine = nullptr;
+
+	m_bBusy = FALSE;
+
+	if (pRoutine != nullptr)
+	{
+		(*pRoutine) (m_pCompletionParam);
+	}
+}
+
+void CSPIDisplayPipeline::CompletionStub (boolean bStatus, void *pParam)
+{
+	CSPIDisplayPipeline *pThis = (CSPIDisplayPipeline *) pParam;
+	assert (pThis != 0);
+
+	pThis->CompletionRoutine (bStatus);
+}
+
+// Pixel conversion
+
+static inline u16 SwapPixel (u16 nPixel, boolean bSwapBytes)
+{
+	return bSwapBytes ? bswap16 (nPixel) : nPixel;
+}
+
+// Rotate one tile of TILE_SIZE x TILE_SIZE pixels. Source column k is written to
+// pTo + k*nToStep, from top to bottom, or from bottom to top with bReverse.
+static void RotateTile (u16 *pTo, int nToStep, const u16 *pFrom, unsigned nFromPitch,
+			boolean bReverse, boolean bSwapBytes)
+{
+#ifdef DISPLAY_NEON
+	uint16x8_t r0 = vld1q_u16 (pFrom);
+	uint16x8_t r1 = vld1q_u16 (pFrom + nFromPitch);
+	uint16x8_t r2 = vld1q_u16 (pFrom + 2*nFromPitch);
+	uint16x8_t r3 = vld1q_u16 (pFrom + 3*nFromPitch);
+	uint16x8_t r4 = vld1q_u16 (pFrom + 4*nFromPitch);
+	uint16x8_t r5 = vld1q_u16 (pFrom + 5*nFromPitch);
+	uint16x8_t r6 = vld1q_u16 (pFrom + 6*nFromPitch);
+	uint16x8_t r7 = vld1q_u16 (pFrom + 7*nFromPitch);
+
+	// transpose 8x8 in three steps (16, 32 and 64 bit elements)
+	uint16x8x2_t t01 = vtrnq_u16 (r0, r1);
+	uint16x8x2_t t23 = vtrnq_u16 (r2, r3);
+	uint16x8x2_t t45 = vtrnq_u16 (r4, r5);
+	uint16x8x2_t t67 = vtrnq_u16 (r6, r7);
+
+	uint32x4x2_t u02 = vtrnq_u32 (vreinterpretq_u32_u16 (t01.val[0]),
+				      vreinterpretq_u32_u16 (t23.val[0]));
+	uint32x4x2_t u13 = vtrnq_u32 (vreinterpretq_u32_u16 (t01.val[1]),
+				      vreinterpretq_u32_u16 (t23.val[1]));
+	uint32x4x2_t u46 = vtrnq_u32 (vreinterpretq_u32_u16 (t45.val[0]),
+				      vreinterpretq_u32_u16 (t67.val[0]));
+	uint32x4x2_t u57 = vtrnq_u32 (vreinterpretq_u32_u16 (t45.val[1]),
+				      vreinterpretq_u32_u16 (t67.val[1]));
+
+	uint16x8_t c[TILE_SIZE];
+	c[0] = vreinterpretq_u16_u32 (vcombine_u32 (vget_low_u32 (u02.val[0]),
+						    vget_low_u32 (u46.val[0])));
+	c[1] = vreinterpretq_u16_u32 (vcombine_u32 (vget_low_u32 (u13.val[0]),
+						    vget_low_u32 (u57.val[0])));
+	c[2] = vreinterpretq_u16_u32 (vcombine_u32 (vget_low_u32 (u02.val[1]),
+						    vget_low_u32 (u46.val[1])));
+	c[3] = vreinterpretq_u16_u32 (vcombine_u32 (vget_low_u32 (u13.val[1]),
+						    vget_low_u32 (u57.val[1])));
+	c[4] = vreinterpretq_u16_u32 (vcombine_u32 (vget_high_u32 (u02.val[0]),
+						    vget_high_u32 (u46.val[0])));
+	c[5] = vreinterpretq_u16_u32 (vcombine_u32 (vget_high_u32 (u13.val[0]),
+						    vget_high_u32 (u57.val[0])));
+	c[6] = vreinterpretq_u16_u32 (vcombine_u32 (vget_high_u32 (u02.val[1]),
+						    vget_high_u32 (u46.val[1])));
+	c[7] = vreinterpretq_u16_u32 (vcombine_u32 (vget_high_u32 (u13.val[1]),
+						    vget_high_u32 (u57.val[1])));
+
+	for (unsigned k = 0; k < TILE_SIZE; k++)
+	{
+		uint16x8_t v = c[k];
+
+		if (bReverse)
+		{
+			v = vrev64q_u16 (v);
+			v = vcombine_u16 (vget_high_u16 (v), vget_low_u16 (v));
+		}
+
+		if (bSwapBytes)
+		{
+			v = vreinterpretq_u16_u8 (vrev16q_u8 (vreinterpretq_u8_u16 (v)));
+		}
+
+		vst1q_u16 (pTo + (int) k*nToStep, v);
+	}
+#else
+	for (unsigned k = 0; k < TILE_SIZE; k++)
+	{
+		u16 *pToColumn = pTo + (int) k*nToStep;
+
+		for (unsigned j = 0; j < TILE_SIZE; j++)
+		{
+			pToColumn[bReverse ? TILE_SIZE-1-j : j] =
+				SwapPixel (pFrom[j*nFromPitch + k], bSwapBytes);
+		}
+	}
+#endif
+}
+
+// Rotate the pixels of a part of the area [x1, x2) x [y1, y2) by 90 or 270 degrees.
+static void RotatePixels (u16 *pTo, const u16 *pFrom, unsigned nWidth, unsigned nHeight,
+			  unsigned x1, unsigned x2, unsigned y1, unsigned y2,
+			  boolean b90, boolean bSwapBytes)
+{
+	for (unsigned y = y1; y < y2; y++)
+	{
+		for (unsigned x = x1; x < x2; x++)
+		{
+			unsigned nTo =   b90
+				       ? x * nHeight + (nHeight-1-y)
+				       : (nWidth-1-x) * nHeight + y;
+
+			pTo[nTo] = SwapPixel (pFrom[y * nWidth + x], bSwapBytes);
+		}
+	}
+}
+
+void CSPIDisplayPipeline::ConvertPixels (u16 *pTo, const u16 *pFrom,
+					 unsigned nWidth, unsigned nHeight,
+					 unsigned nRotation, boolean bSwapBytes)
+{
+	assert (pTo != 0);
+	assert (pFrom != 0);
+	assert (pTo != pFrom);
+
+	unsigned nPixels = nWidth * nHeight;
+
+	switch (nRotation)
+	{
+	case 0:
+		if (!bSwapBytes)
+		{
+			memcpy (pTo, pFrom, nPixels * sizeof (u16));
+		}
+		else
+		{
+#ifdef DISPLAY_NEON
+			for (; nPixels >= 8; nPixels -= 8, pFrom += 8, pTo += 8)
+			{
+				uint8x16_t v = vld1q_u8 ((const u8 *) pFrom);
+				vst1q_u8 ((u8 *) pTo, vrev16q_u8 (v));
+			}
+#endif
+			while (nPixels--)
+			{
+				*pTo++ = bswap16 (*pFrom++);
+			}
+		}
+		break;
+
+	case 180:
+		// the rotated area is the reversed pixel array
+		pFrom += nPixels;
+#ifdef DISPLAY_NEON
+		for (; nPixels >= 8; nPixels -= 8, pTo += 8)
+		{
+			pFrom -= 8;
+			uint16x8_t v = vrev64q_u16 (vld1q_u16 (pFrom));
+			v = vcombine_u16 (vget_high_u16 (v), vget_low_u16 (v));
+
+			if (bSwapBytes)
+			{
+				v = vreinterpretq_u16_u8 (vrev16q_u8 (vreinterpretq_u8_u16 (v)));
+			}
+
+			vst1q_u16 (pTo, v);
+		}
+#endif
+		while (nPixels--)
+		{
+			*pTo++ = SwapPixel (*--pFrom, bSwapBytes);
+		}
+		break;
+
+	case 90:
+	case 270: {
+		boolean b90 = nRotation == 90;
+
+		// Full tiles are rotated in blocks, which fit into the L1 cache with their
+		// destination, so that the cache lines are completely written, before they
+		// are evicted. The remaining right and bottom edges are rotated by pixel.
+		unsigned nTilesWidth = nWidth & ~(TILE_SIZE-1);
+		unsigned nTilesHeight = nHeight & ~(TILE_SIZE-1);
+
+		for (unsigned by = 0; by < nTilesHeight; by += BLOCK_SIZE)
+		{
+			unsigned by2 = by + BLOCK_SIZE;
+			if (by2 > nTilesHeight)
+			{
+				by2 = nTilesHeight;
+			}
+
+			for (unsigned bx = 0; bx < nTilesWidth; bx += BLOCK_SIZE)
+			{
+				unsigned bx2 = bx + BLOCK_SIZE;
+				if (bx2 > nTilesWidth)
+				{
+					bx2 = nTilesWidth;
+				}
+
+				for (unsigned y = by; y < by2; y += TILE_SIZE)
+				{
+					for (unsigned x = bx; x < bx2; x += TILE_SIZE)
+					{
+						const u16 *pTile = pFrom + y * nWidth + x;
+
+						if (b90)
+						{
+							RotateTile (pTo + x * nHeight
+									+ (nHeight-TILE_SIZE-y),
+								    nHeight, pTile, nWidth,
+								    TRUE, bSwapBytes);
+						}
+						else
+						{
+							RotateTile (pTo + (nWidth-1-x) * nHeight + y,
+								    -(int) nHeight, pTile, nWidth,
+								    FALSE, bSwapBytes);
+						}
+					}
+				}
+			}
+		}
+
+		RotatePixels (pTo, pFrom, nWidth, nHeight, nTilesWidth, nWidth, 0, nHeight,
+			      b90, bSwapBytes);
+		RotatePixels (pTo, pFrom, nWidth, nHeight, 0, nTilesWidth, nTilesHeight, nHeight,
+			      b90, bSwapBytes);
+		} break;
+
+	default:
+		assert (0);
+		break;
+	}
+}
@@ -0,0 +1,118 @@
+//
+// spidisplaypipeline.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _display_spidisplaypipeline_h
+#define _display_spidisplaypipeline_h
+
+#include <circle/display.h>
+#include <circle/spimasterdma.h>
+#include <circle/gpiopin.h>
+#include <circle/types.h>
+
+/// \note Used by the SPI display drivers, when they are constructed with a CSPIMasterDMA.\n
+///	  Pixels are converted (rotated, byte swapped) into one of two staging buffers, while
+///	  the other buffer may still be sent by DMA. SetArea() returns after the conversion
+///	  then and the pixel buffer of the caller can be re-used immediately. This overlap
+///	  applies to callers only, which pass a completion routine to SetArea().
+
+class CSPIDisplayPipeline	/// Double-buffered asynchronous pixel transfer to SPI displays
+{
+public:
+	/// \param pSPIMaster Pointer to SPI master object (with DMA)
+	/// \param pDCPin Pointer to the DC pin of the display (HIGH for data)
+	/// \param nClockSpeed SPI clock frequency in Hz
+	/// \param CPOL SPI clock polarity
+	/// \param CPHA SPI clock phase
+	/// \param nChipSelect SPI chip select
+	CSPIDisplayPipeline (CSPIMasterDMA *pSPIMaster, CGPIOPin *pDCPin,
+			     unsigned nClockSpeed, unsigned CPOL, unsigned CPHA,
+			     unsigned nChipSelect);
+
+	~CSPIDisplayPipeline (void);
+
+	/// \param nMaxPixels Maximum number of pixels in one area (normally the display size)
+	/// \return Operation successful?
+	boolean Initialize (unsigned nMaxPixels);
+
+	/// \brief Send command or data bytes synchronously
+	/// \param pData Pointer to the bytes
+	/// \param nLength Number of bytes (max. 0xFFFF)
+	/// \param bIsData Set DC pin for data (or command)
+	/// \note Waits for the completion of a running pixel transfer before.
+	void Write (const void *pData, size_t nLength, boolean bIsData);
+
+	/// \return Staging buffer, which is currently not sent (for nMaxPixels pixels)
+	u16 *GetStagingBuffer (void);
+
+	/// \brief Send pixels from the staging buffer, returned by GetStagingBuffer()
+	/// \param nPixels Number of pixels to be sent
+	/// \param pRoutine Routine to be called on completion (or nullptr for synchronous call)
+	/// \param pParam User parameter to be handed over to completion routine
+	/// \note The completion routine is called in interrupt context.
+	void Send (unsigned nPixels, CDisplay::TAreaCompletionRoutine *pRoutine = nullptr,
+		   void *pParam = nullptr);
+
+	/// \return Is a pixel transfer running?
+	boolean IsBusy (void) const		{ return m_bBusy; }
+
+	/// \brief Wait for the completion of a running pixel transfer
+	void Wait (void);
+
+	/// \brief Copy an area of RGB565 pixels, while rotating and byte swapping them
+	/// \param pTo Destination buffer (nWidth * nHeight pixels)
+	/// \param pFrom Source area (nWidth * nHeight pixels)
+	/// \param nWidth Width of the source area in pixels
+	/// \param nHeight Height of the source area in pixels
+	/// \param nRotation Rotation in degrees (0, 90, 180, 270)
+	/// \param bSwapBytes Swap the bytes of each pixel?
+	/// \note Rotation by 90 degrees stores the source columns from bottom to top,
+	///	  270 degrees from top to bottom, beginning with the right-most column.
+	static void ConvertPixels (u16 *pTo, const u16 *pFrom,
+				   unsigned nWidth, unsigned nHeight,
+				   unsigned nRotation, boolean bSwapBytes);
+
+private:
+	void StartBlock (void);
+
+	void CompletionRoutine (boolean bStatus);
+	static void CompletionStub (boolean bStatus, void *pParam);
+
+private:
+	CSPIMasterDMA *m_pSPIMaster;
+	CGPIOPin *m_pDCPin;
+	unsigned m_nClockSpeed;
+	unsigned m_CPOL;
+	unsigned m_CPHA;
+	unsigned m_nChipSelect;
+
+	unsigned m_nMaxPixels;
+
+	u16 *m_pStagingBuffer[2];
+	unsigned m_nStagingBuffer;		// index of buffer returned by GetStagingBuffer()
+	u8 *m_pDummyBuffer;			// receives the (ignored) MISO data
+
+	volatile boolean m_bBusy;
+	const u8 *m_pSendPtr;			// next block to be sent
+	size_t m_nSendRemaining;		// bytes not yet sent
+
+	CDisplay::TAreaCompletionRoutine *m_pCompletionRoutine;
+	void *m_pCompletionParam;
+};
+
+#endif
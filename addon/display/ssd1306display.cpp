@@ -6,7 +6,7 @@
 //	Copyright (C) 2020-2022 Dale Whinham <daleyo@gmail.com>
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2018-2024  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2018-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -49,6 +49,17 @@ enum TSSD1306Command : u8
 	SetVCOMHDeselectLevel      = 0xDB
 };
 
+// Transpose a matrix of 8x8 bits, where byte n is row n and bit n is column n
+static inline u64 TransposeBits (u64 x)
+{
+	u64 t;
+	t = (x ^ (x >>  7)) & 0x00AA00AA00AA00AAULL;	x ^= t ^ (t <<  7);
+	t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;	x ^= t ^ (t << 14);
+	t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;	x ^= t ^ (t << 28);
+
+	return x;
+}
+
 CSSD1306Display::CSSD1306Display (CI2CMaster *pI2CMaster,
 				  unsigned nWidth, unsigned nHeight,
 				  u8 uchI2CAddress, unsigned nClockSpeed)
@@ -166,31 +177,57 @@ void CSSD1306Display::SetArea (const TArea &rArea, const void *pPixels,
 	unsigned nWidth = rArea.x2 - rArea.x1 + 1;
 	unsigned nBytesWidth = (nWidth + 7) / 8;
 
-	// First transfer the pixel data into the framebuffer
+	// First transfer the pixel data into the framebuffer. Eight rows of one page and
+	// eight columns (one byte of each source row) are converted at once.
 	assert (pPixels);
 	const u8 *pFrom = (const u8 *) pPixels;
-	for (unsigned y = rArea.y1; y <= rArea.y2; y++)
+	for (unsigned nPage = rArea.y1 / 8; nPage <= rArea.y2 / 8; nPage++)
 	{
-		unsigned y0 = y - rArea.y1;
+		unsigned y1 = nPage * 8;
 
-		for (unsigned x = rArea.x1; x <= rArea.x2; x++)
+		u8 uchRowMask = 0;			// rows of this page inside the area
+		for (unsigned j = 0; j < 8; j++)
 		{
-			unsigned x0 = x - rArea.x1;
+			if (rArea.y1 <= y1 + j && y1 + j <= rArea.y2)
+			{
+				uchRowMask |= 1 << j;
+			}
+		}
 
-			if (pFrom[x0/8 + y0 * nBytesWidth] & (0x80 >> (x0 & 7)))
+		for (unsigned nByte = 0; nByte < nBytesWidth; nByte++)
+		{
+			u64 ullRows = 0;		// byte j is the source byte of row j
+			for (unsigned j = 0; j < 8; j++)
 			{
-				m_Framebuffer[y/8][x] |= 1 << (y & 7);
+				if (uchRowMask & (1 << j))
+				{
+					ullRows |= (u64) pFrom[nByte + (y1 + j - rArea.y1) * nBytesWidth]
+						   << (8*j);
+				}
 			}
-			else
+
+			u64 ullColumns = TransposeBits (ullRows);
+
+			for (unsigned k = 0; k < 8; k++)
 			{
-				m_Framebuffer[y/8][x] &= ~(1 << (y & 7));
+				unsigned x = rArea.x1 + nByte*8 + k;
+				if (x > rArea.x2)
+				{
+					break;
+				}
+
+				// source bit 7 is the left-most pixel
+				u8 uchColumn = (u8) (ullColumns >> (8*(7-k)));
+
+				u8 *pTo = &m_Framebuffer[nPage][x];
+				*pTo = (*pTo & ~uchRowMask) | (uchColumn & uchRowMask);
 			}
 		}
 	}
 
 	// Now transfer the updated area to the display
 	unsigned y1floor = rArea.y1 / 8 * 8;
-	unsigned y2ceil = (rArea.y2 + 7) / 8 * 8 - 1;
+	unsigned y2ceil = rArea.y2 / 8 * 8 + 7;
 	unsigned nHeight = y2ceil - y1floor + 1;
 
 	u8 Buffer[nWidth * nHeight/8];
@@ -198,12 +235,7 @@ void CSSD1306Display::SetArea (const TArea &rArea, const void *pPixels,
 	{
 		unsigned y0 = y - y1floor;
 
-		for (unsigned x = rArea.x1; x <= rArea.x2; x++)
-		{
-			unsigned x0 = x - rArea.x1;
-
-			Buffer[x0 + y0/8 * nWidth] = m_Framebuffer[y/8][x];
-		}
+		memcpy (&Buffer[y0/8 * nWidth], &m_Framebuffer[y/8][rArea.x1], nWidth);
 	}
 
 	WriteMemory (rArea.x1, rArea.x2, rArea.y1/8, rArea.y2/8, Buffer, sizeof Buffer);
@@ -100,6 +100,8 @@ CST7789Display::CST7789Display (CSPIMaster *pSPIMaster,
 	m_nClockSpeed (nClockSpeed),
 	m_nChipSelect (nChipSelect),
 	m_bSwapColorBytes (bSwapColorBytes),
+	m_pBuffer (nullptr),
+	m_pPipeline (nullptr),
 	m_DCPin (nDCPin, GPIOModeOutput)
 {
 	assert (nDCPin != None);
@@ -117,19 +119,45 @@ CST7789Display::CST7789Display (CSPIMaster *pSPIMaster,
 	}
 		
 	m_nRotation = 0;
+}
 
-	m_pBuffer = new u16[m_nWidth * m_nHeight];
-	assert (m_pBuffer != 0);
+CST7789Display::CST7789Display (CSPIMasterDMA *pSPIMaster,
+				unsigned nDCPin, unsigned nResetPin, unsigned nBackLightPin,
+				unsigned nWidth, unsigned nHeight,
+				unsigned CPOL, unsigned CPHA, unsigned nClockSpeed,
+				unsigned nChipSelect, boolean bSwapColorBytes)
+:	CST7789Display ((CSPIMaster *) nullptr, nDCPin, nResetPin, nBackLightPin,
+			nWidth, nHeight, CPOL, CPHA, nClockSpeed, nChipSelect, bSwapColorBytes)
+{
+	assert (pSPIMaster != 0);
+	m_pPipeline = new CSPIDisplayPipeline (pSPIMaster, &m_DCPin, nClockSpeed, CPOL, CPHA,
+					       nChipSelect);
+	assert (m_pPipeline != 0);
 }
 
 CST7789Display::~CST7789Display (void)
 {
+	delete m_pPipeline;
 	delete [] m_pBuffer;
 }
 
 boolean CST7789Display::Initialize (void)
 {
-	assert (m_pSPIMaster != 0);
+	if (m_pPipeline != 0)
+	{
+		if (!m_pPipeline->Initialize (m_nWidth * m_nHeight))
+		{
+			return FALSE;
+		}
+	}
+	else
+	{
+		assert (m_pSPIMaster != 0);
+
+		assert (m_pBuffer == 0);
+		m_pBuffer = new u16[m_nWidth * m_nHeight];
+		assert (m_pBuffer != 0);
+	}
 
 	if (m_nBackLightPin != None)
 	{
@@ -262,6 +290,20 @@ void CST7789Display::Clear (TST7789Color Color)
 
 	SetWindow (0, 0, m_nWidth-1, m_nHeight-1);
 
+	if (m_pPipeline != 0)
+	{
+		unsigned nPixels = m_nWidth * m_nHeight;
+		u16 *pBuffer = m_pPipeline->GetStagingBuffer ();
+		for (unsigned i = 0; i < nPixels; i++)
+		{
+			pBuffer[i] = Color;
+		}
+
+		m_pPipeline->Send (nPixels);
+
+		return;
+	}
+
 	TST7789Color Buffer[m_nWidth];
 	for (unsigned x = 0; x < m_nWidth; x++)
 	{
@@ -416,57 +458,27 @@ void CST7789Display::SetArea (const TArea &rArea, const void *pPixels,
 	int nWidth = rArea.x2 - rArea.x1 + 1;
 	int nHeight = rArea.y2 - rArea.y1 + 1;
 
-	if (m_nRotation == 0)
-	{
-		SetWindow (rArea.x1, rArea.y1, rArea.x2, rArea.y2);
-	}
-	else
+	if (m_pPipeline != 0)
 	{
-		const u16 *pFrom = (const u16 *) pPixels;
-		u16 *pTo = m_pBuffer;
+		// convert, while the previous area may still be sent
+		u16 *pBuffer = m_pPipeline->GetStagingBuffer ();
+		CSPIDisplayPipeline::ConvertPixels (pBuffer, (const u16 *) pPixels,
+						    nWidth, nHeight, m_nRotation, FALSE);
 
-		switch (m_nRotation)
-		{
-		case 90:
-			SetWindow (m_nWidth-rArea.y2-1, rArea.x1,
-				   m_nWidth-rArea.y1-1, rArea.x2);
-			for (int x = 0; x < nWidth; x++)
-			{
-				for (int y = nHeight-1; y >= 0; y--)
-				{
-					*pTo++ = pFrom[x + y * nWidth];
-				}
-			}
-			break;
+		SetAreaWindow (rArea);
 
-		case 180:
-			SetWindow (m_nWidth-rArea.x2-1, m_nHeight-rArea.y2-1,
-				   m_nWidth-rArea.x1-1, m_nHeight-rArea.y1-1);
-			for (int y = nHeight-1; y >= 0; y--)
-			{
-				for (int x = nWidth-1; x >= 0; x--)
-				{
-					*pTo++ = pFrom[x + y * nWidth];
-				}
-			}
-			break;
+		m_pPipeline->Send (nWidth * nHeight, pRoutine, pParam);
 
-		case 270:
-			SetWindow (rArea.y1, m_nHeight-rArea.x2-1,
-				   rArea.y2, m_nHeight-rArea.x1-1);
-			for (int x = nWidth-1; x >= 0; x--)
-			{
-				for (int y = 0; y < nHeight; y++)
-				{
-					*pTo++ = pFrom[x + y * nWidth];
-				}
-			}
-			break;
+		return;
+	}
 
-		default:
-			assert (0);
-			break;
-		}
+	SetAreaWindow (rArea);
+
+	if (m_nRotation != 0)
+	{
+		assert (m_pBuffer != 0);
+		CSPIDisplayPipeline::ConvertPixels (m_pBuffer, (const u16 *) pPixels,
+						    nWidth, nHeight, m_nRotation, FALSE);
 
 		pPixels = m_pBuffer;
 	}
@@ -493,6 +505,35 @@ void CST7789Display::SetArea (const TArea &rArea, const void *pPixels,
 	}
 }
 
+void CST7789Display::SetAreaWindow (const TArea &rArea)
+{
+	switch (m_nRotation)
+	{
+	case 0:
+		SetWindow (rArea.x1, rArea.y1, rArea.x2, rArea.y2);
+		break;
+
+	case 90:
+		SetWindow (m_nWidth-rArea.y2-1, rArea.x1,
+			   m_nWidth-rArea.y1-1, rArea.x2);
+		break;
+
+	case 180:
+		SetWindow (m_nWidth-rArea.x2-1, m_nHeight-rArea.y2-1,
+			   m_nWidth-rArea.x1-1, m_nHeight-rArea.y1-1);
+		break;
+
+	case 270:
+		SetWindow (rArea.y1, m_nHeight-rArea.x2-1,
+			   rArea.y2, m_nHeight-rArea.x1-1);
+		break;
+
+	default:
+		assert (0);
+		break;
+	}
+}
+
 void CST7789Display::SetWindow (unsigned x0, unsigned y0, unsigned x1, unsigned y1)
 {
 	assert (x0 <= x1);
@@ -517,6 +558,13 @@ void CST7789Display::SetWindow (unsigned x0, unsigned y0, unsigned x1, unsigned
 
 void CST7789Display::SendByte (u8 uchByte, boolean bIsData)
 {
+	if (m_pPipeline != 0)
+	{
+		m_pPipeline->Write (&uchByte, sizeof uchByte, bIsData);
+
+		return;
+	}
+
 	assert (m_pSPIMaster != 0);
 
 	m_DCPin.Write (bIsData ? HIGH : LOW);
@@ -535,6 +583,14 @@ void CST7789Display::SendData (const void *pData, size_t nLength)
 {
 	assert (pData != 0);
 	assert (nLength > 0);
+
+	if (m_pPipeline != 0)
+	{
+		m_pPipeline->Write (pData, nLength, TRUE);
+
+		return;
+	}
+
 	assert (m_pSPIMaster != 0);
 
 	m_DCPin.Write (HIGH);
@@ -2,7 +2,7 @@
 /// \file st7789display.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2021-2024  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2021-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -22,7 +22,9 @@
 
 #include <circle/display.h>
 #include <circle/spimaster.h>
+#include <circle/spimasterdma.h>
 #include <circle/gpiopin.h>
+#include <display/spidisplaypipeline.h>
 #include <circle/chargenerator.h>
 #include <circle/util.h>
 #include <circle/types.h>
@@ -64,6 +66,18 @@ public:
 			unsigned CPOL = 0, unsigned CPHA = 0, unsigned nClockSpeed = 15000000,
 			unsigned nChipSelect = 0, boolean bSwapColorBytes = TRUE);
 
+	/// \param pSPIMaster Pointer to SPI master object with DMA support
+	/// \note The other parameters are the same as above.
+	/// \note SetArea() sends the pixels by DMA and returns immediately, if a completion
+	///	  routine is given. The next area can be prepared in the meantime. Without a
+	///	  completion routine (e.g. from C2DGraphics) SetArea() waits for the transfer,
+	///	  so that the conversion of the next area does not overlap with it.
+	CST7789Display (CSPIMasterDMA *pSPIMaster,
+			unsigned nDCPin, unsigned nResetPin = None, unsigned nBackLightPin = None,
+			unsigned nWidth = 240, unsigned nHeight = 240,
+			unsigned CPOL = 0, unsigned CPHA = 0, unsigned nClockSpeed = 15000000,
+			unsigned nChipSelect = 0, boolean bSwapColorBytes = TRUE);
+
 	~CST7789Display (void);
 
 	/// \return Display width in number of pixels
@@ -120,14 +134,16 @@ public:
 	/// \brief Set area (rectangle) on the display to the raw colors in pPixels
 	/// \param rArea Coordinates of the area (zero-based)
 	/// \param pPixels Pointer to array with raw color values (RGB565 or RGB565_BE)
-	/// \param pRoutine Routine to be called on completion
+	/// \param pRoutine Routine to be called on completion (in interrupt context with DMA)
 	/// \param pParam User parameter to be handed over to completion routine
+	/// \note With DMA the buffer pPixels can be re-used, when this method returns.
 	void SetArea (const TArea &rArea, const void *pPixels,
 		      TAreaCompletionRoutine *pRoutine = nullptr,
 		      void *pParam = nullptr);
 
 private:
 	void SetWindow (unsigned x0, unsigned y0, unsigned x1, unsigned y1);
+	void SetAreaWindow (const TArea &rArea);
 
 	void SendByte (u8 uchByte, boolean bIsData);
 
@@ -154,6 +170,8 @@ private:
 	unsigned m_nRotation;
 	u16 *m_pBuffer;
 
+	CSPIDisplayPipeline *m_pPipeline;	// with DMA only
+
 	CGPIOPin m_DCPin;
 	CGPIOPin m_ResetPin;
 	CGPIOPin m_BackLightPin;
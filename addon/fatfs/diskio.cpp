@@ -21,6 +21,8 @@
 #endif
 #define SECTOR_SIZE		FF_MIN_SS
 
+#define BOUNCE_SECTORS		128	/* unaligned transfers are split into chunks of this size */
+
 /*-----------------------------------------------------------------------*/
 /* Static Data                                                           */
 /*-----------------------------------------------------------------------*/
@@ -36,8 +38,7 @@ static const char *s_pVolumeName[FF_VOLUMES] =
 
 static CDevice *s_pVolume[FF_VOLUMES] = {0};
 
-static u8 *s_pBuffer = 0;
-static unsigned s_nBufferSize = 0;
+static u8 *s_pBuffer[FF_VOLUMES] = {0};	/* volumes are locked separately */
 
 
 
@@ -54,6 +55,24 @@ static void disk_removed (
 }
 
 
+/*-----------------------------------------------------------------------*/
+/* Helpers                                                               */
+/*-----------------------------------------------------------------------*/
+
+static u8 *get_bounce_buffer (
+	BYTE pdrv		/* Physical drive nmuber to identify the drive */
+)
+{
+	if (s_pBuffer[pdrv] == 0)
+	{
+		s_pBuffer[pdrv] = new u8[BOUNCE_SECTORS * SECTOR_SIZE];
+		assert (s_pBuffer[pdrv] != 0);
+	}
+
+	return s_pBuffer[pdrv];
+}
+
+
 
 /*-----------------------------------------------------------------------*/
 /* Get Drive Status                                                      */
@@ -122,36 +141,39 @@ DRESULT disk_read (
 		return RES_NOTRDY;
 	}
 
-	/* Ensure that the transfer buffer is word aligned */
-	BYTE *pBuffer = buff;
-	unsigned nSize = count * SECTOR_SIZE;
-	if (((uintptr) pBuffer & 3) != 0)
+	QWORD offset = sector;
+	offset *= SECTOR_SIZE;
+
+	/* Word aligned buffers are transferred directly with all sectors at once */
+	if (((uintptr) buff & 3) == 0)
 	{
-		if (s_nBufferSize < nSize)
+		pDevice->Seek (offset);
+		if (pDevice->Read (buff, count * SECTOR_SIZE) < 0)
 		{
-			delete [] s_pBuffer;
-
-			s_nBufferSize = nSize;
-
-			s_pBuffer = new u8[s_nBufferSize];
-			assert (s_pBuffer != 0);
+			return RES_ERROR;
 		}
 
-		pBuffer = s_pBuffer;
+		return RES_OK;
 	}
 
-	QWORD offset = sector;
-	offset *= SECTOR_SIZE;
-	pDevice->Seek (offset);
-
-	if (pDevice->Read (pBuffer, nSize) < 0)
+	/* Otherwise use the bounce buffer, multiple sectors at once */
+	u8 *pBuffer = get_bounce_buffer (pdrv);
+	while (count > 0)
 	{
-		return RES_ERROR;
-	}
+		UINT nSectors = count < BOUNCE_SECTORS ? count : BOUNCE_SECTORS;
+		unsigned nSize = nSectors * SECTOR_SIZE;
+
+		pDevice->Seek (offset);
+		if (pDevice->Read (pBuffer, nSize) < 0)
+		{
+			return RES_ERROR;
+		}
 
-	if (pBuffer != buff)
-	{
 		memcpy (buff, pBuffer, nSize);
+
+		buff += nSize;
+		offset += nSize;
+		count -= nSectors;
 	}
 
 	return RES_OK;
@@ -183,33 +205,39 @@ DRESULT disk_write (
 		return RES_NOTRDY;
 	}
 
-	/* Ensure that the transfer buffer is word aligned */
-	const BYTE *pBuffer = buff;
-	unsigned nSize = count * SECTOR_SIZE;
-	if (((uintptr) pBuffer & 3) != 0)
+	QWORD offset = sector;
+	offset *= SECTOR_SIZE;
+
+	/* Word aligned buffers are transferred directly with all sectors at once */
+	if (((uintptr) buff & 3) == 0)
 	{
-		if (s_nBufferSize < nSize)
+		pDevice->Seek (offset);
+		if (pDevice->Write (buff, count * SECTOR_SIZE) < 0)
 		{
-			delete [] s_pBuffer;
-
-			s_nBufferSize = nSize;
-
-			s_pBuffer = new u8[s_nBufferSize];
-			assert (s_pBuffer != 0);
+			return RES_ERROR;
 		}
 
-		memcpy (s_pBuffer, buff, nSize);
-
-		pBuffer = s_pBuffer;
+		return RES_OK;
 	}
 
-	QWORD offset = sector;
-	offset *= SECTOR_SIZE;
-	pDevice->Seek (offset);
-
-	if (pDevice->Write (pBuffer, nSize) < 0)
+	/* Otherwise use the bounce buffer, multiple sectors at once */
+	u8 *pBuffer = get_bounce_buffer (pdrv);
+	while (count > 0)
 	{
-		return RES_ERROR;
+		UINT nSectors = count < BOUNCE_SECTORS ? count : BOUNCE_SECTORS;
+		unsigned nSize = nSectors * SECTOR_SIZE;
+
+		memcpy (pBuffer, buff, nSize);
+
+		pDevice->Seek (offset);
+		if (pDevice->Write (pBuffer, nSize) < 0)
+		{
+			return RES_ERROR;
+		}
+
+		buff += nSize;
+		offset += nSize;
+		count -= nSectors;
 	}
 
 	return RES_OK;
@@ -264,6 +292,11 @@ DRESULT disk_ioctl (
 		*(WORD *) buff = SECTOR_SIZE;
 		return RES_OK;
 
+	case GET_BLOCK_SIZE:
+		assert (buff != 0);
+		*(DWORD *) buff = 1;	/* erase block size is unknown */
+		return RES_OK;
+
 	case CTRL_EJECT:
 		if (pdrv >= FF_VOLUMES)
 		{
@@ -38,6 +38,10 @@
 #error Wrong include file (ff.h).
 #endif
 
+#if FF_USE_FASTSEEK && FF_FASTSEEK_AUTO && FF_USE_LFN != 3
+#error FF_FASTSEEK_AUTO requires FF_USE_LFN == 3 (heap working buffer)
+#endif
+
 
 /* Limits and boundaries */
 #define MAX_DIR		0x200000		/* Max size of FAT directory (byte) */
@@ -1667,6 +1671,57 @@ static DWORD clmt_clust (	/* <2:Error, >=2:Cluster number */
 	return cl + *tbl;	/* Return the cluster number */
 }
 
+
+#if FF_FASTSEEK_AUTO
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Create a link map table on the heap (Circle)           */
+/*-----------------------------------------------------------------------*/
+
+static DWORD* create_clmt (	/* 0:Failed, else:Pointer to the CLMT */
+	FIL* fp			/* Pointer to the file object */
+)
+{
+	DWORD cl, pcl, ncl, tcl, tlen, ulen;
+	DWORD *tbl, *ntbl;
+	FATFS *fs = fp->obj.fs;
+
+
+	cl = fp->obj.sclust;		/* Origin of the chain */
+	if (cl == 0) return 0;
+	tlen = 64;					/* Initial table size (grown as needed) */
+	tbl = (DWORD*)ff_memalloc(tlen * sizeof (DWORD));
+	if (!tbl) return 0;
+	ulen = 1;					/* Item 0 is the number of items used */
+	do {
+		/* Get a fragment */
+		tcl = cl; ncl = 0;
+		do {
+			pcl = cl; ncl++;
+			cl = get_fat(&fp->obj, cl);
+			if (cl <= 1 || cl == 0xFFFFFFFF) {	/* Let the normal seek report the error */
+				ff_memfree(tbl);
+				return 0;
+			}
+		} while (cl == pcl + 1);
+		if (ulen + 3 > tlen) {	/* No room for this fragment and the terminator? */
+			ntbl = (DWORD*)ff_memalloc(tlen * 2 * sizeof (DWORD));
+			if (!ntbl) {
+				ff_memfree(tbl);
+				return 0;
+			}
+			memcpy(ntbl, tbl, ulen * sizeof (DWORD));
+			ff_memfree(tbl);
+			tbl = ntbl; tlen *= 2;
+		}
+		tbl[ulen++] = ncl; tbl[ulen++] = tcl;	/* Store the length and top of the fragment */
+	} while (cl < fs->n_fatent);	/* Repeat until end of chain */
+	tbl[ulen++] = 0;			/* Terminate table */
+	tbl[0] = ulen;
+
+	return tbl;
+}
+#endif	/* FF_FASTSEEK_AUTO */
+
 #endif	/* FF_USE_FASTSEEK */
 
 
@@ -3876,6 +3931,9 @@ FRESULT f_open (
 			}
 #if FF_USE_FASTSEEK
 			fp->cltbl = 0;		/* Disable fast seek mode */
+#if FF_FASTSEEK_AUTO
+			fp->cltbl_auto = 0;
+#endif
 #endif
 			fp->obj.fs = fs;	/* Validate the file object */
 			fp->obj.id = fs->id;
@@ -4246,6 +4304,13 @@ FRESULT f_close (
 	{
 		res = validate(&fp->obj, &fs);	/* Lock volume */
 		if (res == FR_OK) {
+#if FF_USE_FASTSEEK && FF_FASTSEEK_AUTO
+			if (fp->cltbl_auto) {		/* Free the automatically created CLMT */
+				if (fp->cltbl == fp->cltbl_auto) fp->cltbl = 0;
+				ff_memfree(fp->cltbl_auto);
+				fp->cltbl_auto = 0;
+			}
+#endif
 #if FF_FS_LOCK
 			res = dec_share(fp->obj.lockid);		/* Decrement file open counter */
 			if (res == FR_OK) fp->obj.fs = 0;	/* Invalidate file object */
@@ -4475,6 +4540,13 @@ FRESULT f_lseek (
 	if (res != FR_OK) LEAVE_FF(fs, res);
 
 #if FF_USE_FASTSEEK
+#if FF_FASTSEEK_AUTO
+	if (!fp->cltbl && !fp->cltbl_auto && ofs != CREATE_LINKMAP	/* Create CLMT automatically? */
+	    && !(fp->flag & FA_WRITE) && fp->obj.objsize >= FF_FASTSEEK_AUTO
+	    && (!FF_FS_EXFAT || fs->fs_type != FS_EXFAT || fp->obj.stat != 2)) {	/* Not needed for contiguous file */
+		fp->cltbl = fp->cltbl_auto = create_clmt(fp);	/* Normal seek on failure */
+	}
+#endif
 	if (fp->cltbl) {	/* Fast seek */
 		if (ofs == CREATE_LINKMAP) {	/* Create CLMT */
 			tbl = fp->cltbl;
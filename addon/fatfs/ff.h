@@ -214,6 +214,9 @@ typedef struct {
 #endif
 #if FF_USE_FASTSEEK
 	DWORD*	cltbl;			/* Pointer to the cluster link map table (nulled on open, set by application) */
+#if FF_FASTSEEK_AUTO
+	DWORD*	cltbl_auto;		/* Pointer to the automatically created CLMT on the heap (Circle) */
+#endif
 #endif
 #if !FF_FS_TINY
 	BYTE	buf[FF_MAX_SS];	/* File private data read/write window */
@@ -381,6 +384,7 @@ int ff_mutex_create (int vol);		/* Create a sync object */
 void ff_mutex_delete (int vol);		/* Delete a sync object */
 int ff_mutex_take (int vol);		/* Lock sync object */
 void ff_mutex_give (int vol);		/* Unlock sync object */
+int ff_mutex_owned (void);			/* Sync object held by current context? (Circle specific) */
 #endif
 
 
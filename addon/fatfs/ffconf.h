@@ -34,8 +34,19 @@
 /* This option switches f_mkfs(). (0:Disable or 1:Enable) */
 
 
+#ifndef FF_USE_FASTSEEK
 #define FF_USE_FASTSEEK	0
-/* This option switches fast seek feature. (0:Disable or 1:Enable) */
+#endif
+/* This option switches fast seek feature. (0:Disable or 1:Enable)
+/  It can be overridden with "DEFINE += -DFF_USE_FASTSEEK=1" in Config.mk. */
+
+
+#define FF_FASTSEEK_AUTO	0x100000
+/* This option (Circle specific) defines the minimum file size in bytes, for which
+/  a cluster link map table is automatically created on the heap on the first
+/  f_lseek() of a file, which has been opened without FA_WRITE. The table is freed
+/  in f_close(). 0 disables this feature. This option has no effect when
+/  FF_USE_FASTSEEK == 0. */
 
 
 #define FF_USE_EXPAND	0
@@ -231,10 +242,13 @@
 /  buffer in the filesystem object (FATFS) is used for the file data transfer. */
 
 
+#ifndef FF_FS_EXFAT
 #define FF_FS_EXFAT		0
+#endif
 /* This option switches support for exFAT filesystem. (0:Disable or 1:Enable)
 /  To enable exFAT, also LFN needs to be enabled. (FF_USE_LFN >= 1)
-/  Note that enabling exFAT discards ANSI C (C89) compatibility. */
+/  Note that enabling exFAT discards ANSI C (C89) compatibility.
+/  It can be overridden with "DEFINE += -DFF_FS_EXFAT=1" in Config.mk. */
 
 
 #define FF_FS_NORTC		0
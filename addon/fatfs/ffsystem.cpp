@@ -7,6 +7,11 @@
 
 #include "ff.h"
 #include <circle/genericlock.h>
+#include <circle/sysconfig.h>
+#include <circle/multicore.h>
+#ifdef NO_BUSY_WAIT
+	#include <circle/sched/scheduler.h>
+#endif
 #include <circle/alloc.h>
 #include <circle/timer.h>
 #include <assert.h>
@@ -18,6 +23,25 @@
 /*------------------------------------------------------------------------*/
 
 static CGenericLock *s_pMutex[FF_VOLUMES + 1] = {0};
+static volatile uintptr s_nMutexOwner[FF_VOLUMES + 1] = {0};	/* 0 if not taken */
+
+
+/* Returns an ID of the current execution context (task or core) */
+static uintptr GetContext (void)
+{
+#ifdef NO_BUSY_WAIT
+	if (CScheduler::IsActive ())
+	{
+		return (uintptr) CScheduler::Get ()->GetCurrentTask ();
+	}
+#endif
+
+#ifdef ARM_ALLOW_MULTI_CORE
+	return CMultiCoreSupport::ThisCore () + 1;
+#else
+	return 1;
+#endif
+}
 
 
 /*------------------------------------------------------------------------*/
@@ -77,6 +101,8 @@ int ff_mutex_take (	/* Returns 1:Succeeded or 0:Timeout */
 
 	s_pMutex[vol]->Acquire ();
 
+	s_nMutexOwner[vol] = GetContext ();
+
 	return 1;
 }
 
@@ -94,9 +120,34 @@ void ff_mutex_give (
 	assert (vol <= FF_VOLUMES);
 	assert (s_pMutex[vol] != 0);
 
+	s_nMutexOwner[vol] = 0;
+
 	s_pMutex[vol]->Release ();
 }
 
+
+/*------------------------------------------------------------------------*/
+/* Check, if the Current Context Holds a Mutex (Circle specific)          */
+/*------------------------------------------------------------------------*/
+/* This function can be used to detect a re-entry into FatFs (e.g. from a
+/  page fault handler), which would dead-lock.
+*/
+
+int ff_mutex_owned (void)	/* Returns 1:A mutex is held by the current context or 0:Not */
+{
+	uintptr nContext = GetContext ();
+
+	for (int vol = 0; vol <= FF_VOLUMES; vol++)
+	{
+		if (s_nMutexOwner[vol] == nContext)
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
 #endif	/* FF_FS_REENTRANT */
 
 
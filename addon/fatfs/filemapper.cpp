@@ -0,0 +1,422 @@
+//
+// filemapper.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#if AARCH == 64
+
+#include <fatfs/filemapper.h>
+#include <circle/exceptionhandler.h>
+#include <circle/memory.h>
+#include <circle/memorymap.h>
+#include <circle/logger.h>
+#include <circle/util.h>
+#include <assert.h>
+
+LOGMODULE ("filemap");
+
+CFileMapper::CFileMapper (size_t nCacheSize)
+:	m_nCacheSize (nCacheSize),
+	m_pTranslationTable (0),
+	m_pCache (0),
+	m_pFrame (0),
+	m_nFrames (0),
+	m_nClockHand (0),
+	m_nPageFaults (0),
+	m_nEvictions (0)
+{
+	for (unsigned i = 0; i < MaxMappings; i++)
+	{
+		m_pMapping[i] = 0;
+	}
+}
+
+CFileMapper::~CFileMapper (void)
+{
+	for (unsigned i = 0; i < MaxMappings; i++)
+	{
+		if (m_pMapping[i] != 0)
+		{
+			Unmap ((const void *) m_pMapping[i]->nStart);
+		}
+	}
+
+	if (m_pTranslationTable != 0)
+	{
+		CExceptionHandler::Get ()->UnregisterPageFaultHandler ();
+	}
+
+	delete [] m_pFrame;
+	m_pFrame = 0;
+
+	delete [] m_pCache;
+	m_pCache = 0;
+}
+
+boolean CFileMapper::Initialize (void)
+{
+	m_pTranslationTable = CMemorySystem::Get ()->GetTranslationTable ();
+	if (m_pTranslationTable == 0)
+	{
+		LOGERR ("MMU is not enabled");
+
+		return FALSE;
+	}
+
+	if (!m_pTranslationTable->EnablePagedRegion ())
+	{
+		LOGERR ("Cannot enable paged region");
+
+		return FALSE;
+	}
+
+	m_nFrames = m_nCacheSize / PAGE_SIZE;
+	if (m_nFrames == 0)
+	{
+		return FALSE;
+	}
+
+	// pages must be aligned to the page size
+	m_pCache = new u8[m_nFrames * PAGE_SIZE + PAGE_SIZE-1];
+	m_pFrame = new TFrame[m_nFrames];
+	if (   m_pCache == 0
+	    || m_pFrame == 0)
+	{
+		return FALSE;
+	}
+
+	u8 *pPage = (u8 *) (((uintptr) m_pCache + PAGE_SIZE-1) & ~(uintptr) (PAGE_SIZE-1));
+	for (unsigned i = 0; i < m_nFrames; i++)
+	{
+		m_pFrame[i].nAddress = 0;
+		m_pFrame[i].pPage = pPage;
+
+		pPage += PAGE_SIZE;
+	}
+
+	CExceptionHandler::Get ()->RegisterPageFaultHandler (PageFaultStub, this);
+
+	return TRUE;
+}
+
+const void *CFileMapper::Map (const TCHAR *pFileName, size_t *pSize)
+{
+	assert (m_pTranslationTable != 0);
+	assert (pFileName != 0);
+
+	TMapping *pMapping = new TMapping;
+	if (pMapping == 0)
+	{
+		return 0;
+	}
+
+	// FA_WRITE is not set, so that a cluster link map table can be used for seeking
+	FRESULT Result = f_open (&pMapping->File, pFileName, FA_READ | FA_OPEN_EXISTING);
+	if (Result != FR_OK)
+	{
+		LOGWARN ("Cannot open %s (%d)", pFileName, (int) Result);
+
+		delete pMapping;
+
+		return 0;
+	}
+
+	FSIZE_t FileSize = f_size (&pMapping->File);
+	if (   FileSize == 0
+	    || FileSize > MEM_PAGED_SIZE)
+	{
+		LOGWARN ("%s: Invalid file size", pFileName);
+
+		f_close (&pMapping->File);
+		delete pMapping;
+
+		return 0;
+	}
+
+	pMapping->nSize = (size_t) FileSize;
+	pMapping->nRangeSize = (pMapping->nSize + PAGE_SIZE-1) & ~(size_t) (PAGE_SIZE-1);
+
+	m_Lock.Acquire ();
+
+	unsigned nSlot;
+	for (nSlot = 0; nSlot < MaxMappings; nSlot++)
+	{
+		if (m_pMapping[nSlot] == 0)
+		{
+			break;
+		}
+	}
+
+	pMapping->nStart = AllocateRange (pMapping->nRangeSize);
+	if (   nSlot >= MaxMappings
+	    || pMapping->nStart == 0)
+	{
+		m_Lock.Release ();
+
+		LOGWARN ("%s: No free address range", pFileName);
+
+		f_close (&pMapping->File);
+		delete pMapping;
+
+		return 0;
+	}
+
+	m_pMapping[nSlot] = pMapping;
+
+	m_Lock.Release ();
+
+	if (pSize != 0)
+	{
+		*pSize = pMapping->nSize;
+	}
+
+	return (const void *) pMapping->nStart;
+}
+
+void CFileMapper::Unmap (const void *pAddress)
+{
+	assert (m_pTranslationTable != 0);
+
+	m_Lock.Acquire ();
+
+	TMapping *pMapping = 0;
+	for (unsigned i = 0; i < MaxMappings; i++)
+	{
+		if (   m_pMapping[i] != 0
+		    && m_pMapping[i]->nStart == (uintptr) pAddress)
+		{
+			pMapping = m_pMapping[i];
+			m_pMapping[i] = 0;
+
+			break;
+		}
+	}
+
+	if (pMapping == 0)
+	{
+		m_Lock.Release ();
+
+		LOGWARN ("Trying to unmap invalid address (0x%lX)", (uintptr) pAddress);
+
+		return;
+	}
+
+	// release the pages of this mapping
+	for (unsigned i = 0; i < m_nFrames; i++)
+	{
+		uintptr nAddress = m_pFrame[i].nAddress;
+		if (   nAddress != 0
+		    && pMapping->nStart <= nAddress
+		    && nAddress < pMapping->nStart + pMapping->nRangeSize)
+		{
+			m_pTranslationTable->ClearPage (nAddress);
+
+			m_pFrame[i].nAddress = 0;
+		}
+	}
+
+	m_Lock.Release ();
+
+	f_close (&pMapping->File);
+	delete pMapping;
+}
+
+boolean CFileMapper::PageFault (uintptr nAddress, boolean bAccessFlag)
+{
+	assert (m_pTranslationTable != 0);
+
+	nAddress &= ~(uintptr) (PAGE_SIZE-1);
+
+	// A fault inside of FatFs (e.g. mapped memory has been passed to it) cannot be
+	// resolved, because loading the page would wait for the lock held by ourself.
+	if (ff_mutex_owned ())
+	{
+		LOGERR ("Page fault at 0x%lX inside of FatFs", nAddress);
+
+		return FALSE;
+	}
+
+	m_Lock.Acquire ();
+
+	TMapping *pMapping = FindMapping (nAddress);
+	if (pMapping == 0)
+	{
+		m_Lock.Release ();
+
+		return FALSE;
+	}
+
+	TFrame *pFrame = FindFrame (nAddress);
+	if (pFrame != 0)
+	{
+		// access flag fault, or page has been loaded on another core in the meantime
+		m_pTranslationTable->SetAccessFlag (nAddress);
+
+		m_Lock.Release ();
+
+		return TRUE;
+	}
+
+	if (bAccessFlag)		// page has been evicted in the meantime
+	{
+		m_Lock.Release ();
+
+		return TRUE;		// will fault again with translation fault
+	}
+
+	pFrame = GetFreeFrame ();
+	assert (pFrame != 0);
+
+	size_t nOffset = nAddress - pMapping->nStart;
+	size_t nCount = pMapping->nSize - nOffset;
+	if (nCount > PAGE_SIZE)
+	{
+		nCount = PAGE_SIZE;
+	}
+
+	UINT nBytesRead;
+	if (   f_lseek (&pMapping->File, nOffset) != FR_OK
+	    || f_read (&pMapping->File, pFrame->pPage, nCount, &nBytesRead) != FR_OK
+	    || nBytesRead != nCount)
+	{
+		m_Lock.Release ();
+
+		LOGERR ("Cannot load page at 0x%lX", nAddress);
+
+		return FALSE;
+	}
+
+	if (nCount < PAGE_SIZE)
+	{
+		memset (pFrame->pPage + nCount, 0, PAGE_SIZE - nCount);
+	}
+
+	pFrame->nAddress = nAddress;
+
+	m_pTranslationTable->SetPage (nAddress, (uintptr) pFrame->pPage);
+
+	m_nPageFaults++;
+
+	m_Lock.Release ();
+
+	return TRUE;
+}
+
+boolean CFileMapper::PageFaultStub (uintptr nAddress, boolean bAccessFlag, void *pParam)
+{
+	CFileMapper *pThis = (CFileMapper *) pParam;
+	assert (pThis != 0);
+
+	return pThis->PageFault (nAddress, bAccessFlag);
+}
+
+CFileMapper::TMapping *CFileMapper::FindMapping (uintptr nAddress)
+{
+	for (unsigned i = 0; i < MaxMappings; i++)
+	{
+		TMapping *pMapping = m_pMapping[i];
+		if (   pMapping != 0
+		    && pMapping->nStart <= nAddress
+		    && nAddress < pMapping->nStart + pMapping->nRangeSize)
+		{
+			return pMapping;
+		}
+	}
+
+	return 0;
+}
+
+CFileMapper::TFrame *CFileMapper::FindFrame (uintptr nAddress)
+{
+	for (unsigned i = 0; i < m_nFrames; i++)
+	{
+		if (m_pFrame[i].nAddress == nAddress)
+		{
+			return &m_pFrame[i];
+		}
+	}
+
+	return 0;
+}
+
+// Second chance (clock) algorithm: Pages, which have been accessed since the
+// clock hand passed them last, get their access flag cleared and are skipped.
+// An access to such a page causes an access flag fault, which sets it again.
+CFileMapper::TFrame *CFileMapper::GetFreeFrame (void)
+{
+	for (unsigned i = 0; i < m_nFrames; i++)
+	{
+		if (m_pFrame[i].nAddress == 0)
+		{
+			return &m_pFrame[i];
+		}
+	}
+
+	while (1)		// terminates after two rounds at most
+	{
+		TFrame *pFrame = &m_pFrame[m_nClockHand];
+
+		if (++m_nClockHand >= m_nFrames)
+		{
+			m_nClockHand = 0;
+		}
+
+		if (!m_pTranslationTable->ClearAccessFlag (pFrame->nAddress))
+		{
+			m_pTranslationTable->ClearPage (pFrame->nAddress);
+			pFrame->nAddress = 0;
+
+			m_nEvictions++;
+
+			return pFrame;
+		}
+	}
+}
+
+// first fit
+uintptr CFileMapper::AllocateRange (size_t nSize)
+{
+	uintptr nStart = MEM_PAGED_START;
+
+	boolean bOverlap;
+	do
+	{
+		bOverlap = FALSE;
+
+		for (unsigned i = 0; i < MaxMappings; i++)
+		{
+			TMapping *pMapping = m_pMapping[i];
+			if (   pMapping != 0
+			    && nStart < pMapping->nStart + pMapping->nRangeSize
+			    && pMapping->nStart < nStart + nSize)
+			{
+				nStart = pMapping->nStart + pMapping->nRangeSize;
+				bOverlap = TRUE;
+			}
+		}
+	}
+	while (bOverlap);
+
+	if (nStart + nSize > MEM_PAGED_START + MEM_PAGED_SIZE)
+	{
+		return 0;
+	}
+
+	return nStart;
+}
+
+#endif
@@ -0,0 +1,110 @@
+//
+// filemapper.h
+//
+// Maps files from FAT volumes read-only into the demand paged region
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _fatfs_filemapper_h
+#define _fatfs_filemapper_h
+
+#if AARCH == 32
+	#error CFileMapper is supported with AARCH = 64 only
+#endif
+
+#include <fatfs/ff.h>
+#include <circle/translationtable64.h>
+#include <circle/genericlock.h>
+#include <circle/sysconfig.h>
+#include <circle/types.h>
+
+class CFileMapper	/// Maps files read-only into memory, pages are loaded on demand
+{
+public:
+	/// \param nCacheSize Size of physical memory used to hold the pages of mapped files
+	/// \note Least recently used pages are evicted, when this memory is exhausted.
+	CFileMapper (size_t nCacheSize = 8 * MEGABYTE);
+
+	~CFileMapper (void);
+
+	/// \return Operation successful?
+	boolean Initialize (void);
+
+	/// \param pFileName Path of the file (with drive prefix, if required)
+	/// \param pSize Size of the file is returned here (if not 0)
+	/// \return Start address of the mapped file (0 on error)
+	/// \note The file is kept open, until it is unmapped.
+	/// \note Mapped memory must be accessed with IRQs enabled from task level (not from
+	///	  an interrupt handler) and must not be passed to FatFs functions directly.
+	///	  A page fault inside of FatFs is not resolved and causes an abort exception.
+	const void *Map (const TCHAR *pFileName, size_t *pSize = 0);
+
+	/// \param pAddress Start address of the mapped file, as returned from Map()
+	void Unmap (const void *pAddress);
+
+	/// \return Number of pages, which have been loaded from disk
+	unsigned GetPageFaults (void) const	{ return m_nPageFaults; }
+	/// \return Number of pages, which have been evicted
+	unsigned GetEvictions (void) const	{ return m_nEvictions; }
+
+private:
+	struct TMapping;
+	struct TFrame;
+
+	boolean PageFault (uintptr nAddress, boolean bAccessFlag);
+	static boolean PageFaultStub (uintptr nAddress, boolean bAccessFlag, void *pParam);
+
+	TMapping *FindMapping (uintptr nAddress);
+	TFrame *FindFrame (uintptr nAddress);
+	TFrame *GetFreeFrame (void);
+	uintptr AllocateRange (size_t nSize);
+
+private:
+	struct TMapping
+	{
+		uintptr	nStart;		// 0 if unused
+		size_t	nSize;		// file size
+		size_t	nRangeSize;	// multiple of PAGE_SIZE
+		FIL	File;
+	};
+
+	struct TFrame
+	{
+		uintptr	nAddress;	// virtual address of the page (0 if free)
+		u8	*pPage;		// physical memory of the page
+	};
+
+	static const unsigned MaxMappings = 32;
+
+	size_t m_nCacheSize;
+
+	CTranslationTable *m_pTranslationTable;
+
+	TMapping *m_pMapping[MaxMappings];
+
+	u8 *m_pCache;
+	TFrame *m_pFrame;
+	unsigned m_nFrames;
+	unsigned m_nClockHand;		// for second chance page replacement
+
+	CGenericLock m_Lock;
+
+	unsigned m_nPageFaults;
+	unsigned m_nEvictions;
+};
+
+#endif
@@ -0,0 +1,264 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <circle/util.h>
+#include <assert.h>
+
+#define DRIVE		"SD:"
+//#define DRIVE		"USB:"
+
+#define FILENAME	"/seekbench.bin"
+#define FILLNAME	"/seekfill.tmp"		// interleaved with FILENAME to fragment it
+
+#define FILE_SIZE_MB	256			// size of test file (if created)
+#define CHUNK_SIZE	(64*1024)		// test file is written in chunks of this size
+#define FRAGMENT	1			// create a fragmented test file?
+
+#define SEEK_COUNT	1000
+#define READ_SIZE	4096
+
+static const char FromKernel[] = "kernel";
+
+static u8 Buffer[CHUNK_SIZE] ALIGN (64);
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer),
+	m_USBHCI (&m_Interrupt, &m_Timer),
+	m_EMMC (&m_Interrupt, &m_Timer, &m_ActLED)
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_USBHCI.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_EMMC.Initialize ();
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+	if (f_mount (&m_FileSystem, DRIVE, 1) != FR_OK)
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Cannot mount drive: %s", DRIVE);
+	}
+
+	static const char *FSType[] = {"?", "FAT12", "FAT16", "FAT32", "exFAT"};
+	m_Logger.Write (FromKernel, LogNotice, "%s, cluster size %u bytes",
+			m_FileSystem.fs_type <= 4 ? FSType[m_FileSystem.fs_type] : "?",
+			(unsigned) m_FileSystem.csize * FF_MIN_SS);
+
+	FILINFO FileInfo;
+	if (f_stat (DRIVE FILENAME, &FileInfo) != FR_OK)
+	{
+		if (!CreateTestFile ())
+		{
+			m_Logger.Write (FromKernel, LogPanic, "Cannot create test file");
+		}
+	}
+
+	// Opened with FA_WRITE the cluster chain is followed on each seek
+	RunBenchmark ("Cluster chain", FA_READ | FA_WRITE | FA_OPEN_EXISTING);
+
+	// Opened read-only a cluster link map table is created on the first seek
+	RunBenchmark ("Fast seek", FA_READ | FA_OPEN_EXISTING);
+
+	if (f_mount (0, DRIVE, 0) != FR_OK)
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Cannot unmount drive: %s", DRIVE);
+	}
+
+	return ShutdownHalt;
+}
+
+boolean CKernel::CreateTestFile (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Creating %u MB test file", FILE_SIZE_MB);
+
+	FIL File;
+	if (f_open (&File, DRIVE FILENAME, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+	{
+		return FALSE;
+	}
+
+#if FRAGMENT
+	FIL FillFile;
+	if (f_open (&FillFile, DRIVE FILLNAME, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+	{
+		f_close (&File);
+
+		return FALSE;
+	}
+#endif
+
+	boolean bOK = TRUE;
+	for (unsigned nChunk = 0; bOK && nChunk < FILE_SIZE_MB * MEGABYTE / CHUNK_SIZE; nChunk++)
+	{
+		// each word contains its own offset in the file
+		u32 *pWord = (u32 *) Buffer;
+		for (unsigned i = 0; i < CHUNK_SIZE / sizeof (u32); i++)
+		{
+			*pWord++ = nChunk * CHUNK_SIZE + i * sizeof (u32);
+		}
+
+		unsigned nBytesWritten;
+		if (   f_write (&File, Buffer, CHUNK_SIZE, &nBytesWritten) != FR_OK
+		    || nBytesWritten != CHUNK_SIZE)
+		{
+			bOK = FALSE;
+		}
+
+#if FRAGMENT
+		if (   f_write (&FillFile, Buffer, CHUNK_SIZE, &nBytesWritten) != FR_OK
+		    || nBytesWritten != CHUNK_SIZE)
+		{
+			bOK = FALSE;
+		}
+#endif
+	}
+
+	if (f_close (&File) != FR_OK)
+	{
+		bOK = FALSE;
+	}
+
+#if FRAGMENT
+	if (   f_close (&FillFile) != FR_OK
+	    || f_unlink (DRIVE FILLNAME) != FR_OK)
+	{
+		bOK = FALSE;
+	}
+#endif
+
+	return bOK;
+}
+
+void CKernel::RunBenchmark (const char *pTitle, BYTE ucMode)
+{
+	FIL File;
+	if (f_open (&File, DRIVE FILENAME, ucMode) != FR_OK)
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Cannot open file: %s", FILENAME);
+	}
+
+	u64 ullFileSize = f_size (&File);
+	assert (ullFileSize > READ_SIZE);
+
+	unsigned nRandom = 1;			// same sequence in each run
+	unsigned nMaxSeek = 0;
+	u64 ullSumSeek = 0;
+	u64 ullSumRead = 0;
+	unsigned nErrors = 0;
+
+	for (unsigned i = 0; i < SEEK_COUNT; i++)
+	{
+		nRandom = nRandom * 1103515245 + 12345;
+		u64 ullOffset = ((u64) nRandom << 8) % (ullFileSize - READ_SIZE);
+		ullOffset &= ~(u64) (sizeof (u32)-1);
+
+		unsigned nStartTicks = CTimer::GetClockTicks ();
+
+		if (f_lseek (&File, ullOffset) != FR_OK)
+		{
+			m_Logger.Write (FromKernel, LogPanic, "Seek error");
+		}
+
+		unsigned nSeekTicks = CTimer::GetClockTicks () - nStartTicks;
+
+		unsigned nBytesRead;
+		if (   f_read (&File, Buffer, READ_SIZE, &nBytesRead) != FR_OK
+		    || nBytesRead != READ_SIZE)
+		{
+			m_Logger.Write (FromKernel, LogPanic, "Read error");
+		}
+
+		unsigned nReadTicks = CTimer::GetClockTicks () - nStartTicks;
+
+		if (*(u32 *) Buffer != (u32) ullOffset)
+		{
+			nErrors++;
+		}
+
+		// the first seek includes creating the link map table
+		if (i > 0 && nSeekTicks > nMaxSeek)
+		{
+			nMaxSeek = nSeekTicks;
+		}
+
+		ullSumSeek += nSeekTicks;
+		ullSumRead += nReadTicks;
+	}
+
+	f_close (&File);
+
+	m_Logger.Write (FromKernel, LogNotice,
+			"%s: seek avg %u us max %u us, seek+read avg %u us, %u errors", pTitle,
+			(unsigned) (ullSumSeek / SEEK_COUNT), nMaxSeek,
+			(unsigned) (ullSumRead / SEEK_COUNT), nErrors);
+}
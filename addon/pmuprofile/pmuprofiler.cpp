@@ -0,0 +1,316 @@
+//
+// pmuprofiler.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <pmuprofile/pmuprofiler.h>
+#include <circle/interrupt.h>
+#include <circle/exceptionstub.h>
+#include <circle/multicore.h>
+#include <circle/synchronize.h>
+#include <circle/string.h>
+#include <assert.h>
+
+#if AARCH == 32
+	#error The PMU profiler is supported in AArch64 mode only!
+#endif
+
+// PMU registers
+#define PMCR_E				(1 << 0)	// enable all counters
+#define PMCNTEN_EVENT0			(1 << 0)	// also used for PMOVSCLR, PMINTENSET
+#define PMCNTEN_EVENT1			(1 << 1)
+#define PMCNTEN_CYCLES			(1U << 31)
+#define PMCNTEN_ALL			(PMCNTEN_CYCLES | PMCNTEN_EVENT1 | PMCNTEN_EVENT0)
+
+// common architectural and micro-architectural events
+#define PMU_EVENT_L1D_CACHE_REFILL	0x03
+#define PMU_EVENT_BR_MIS_PRED		0x10
+
+// the call stack is only unwound in this window above the interrupted SP
+#define STACK_WINDOW			0x40000
+
+#define FRAME_RECORD_SIZE		16		// saved x29 (fp) and x30 (lr)
+
+CPMUProfiler::CPMUProfiler (unsigned nPeriod, unsigned nMaxSamples)
+:	m_nPeriod (nPeriod),
+	m_nMaxSamples (nMaxSamples),
+	m_bIRQConnected (FALSE),
+	m_bActive (FALSE)
+{
+	assert (m_nPeriod > 0);
+	assert (m_nMaxSamples > 0);
+
+	for (unsigned i = 0; i < PMU_PROFILE_CORES; i++)
+	{
+		m_Core[i].pSample = 0;
+		m_Core[i].nSamples = 0;
+		m_Core[i].nDropped = 0;
+	}
+}
+
+CPMUProfiler::~CPMUProfiler (void)
+{
+	m_bActive = FALSE;
+
+	Stop ();
+
+	if (m_bIRQConnected)
+	{
+		CInterruptSystem *pInterrupt = CInterruptSystem::Get ();
+#if RASPPI == 4
+		for (unsigned nCore = 0; nCore < PMU_PROFILE_CORES; nCore++)
+		{
+			pInterrupt->DisconnectIRQ (ARM_IRQ_PMU0 + nCore);
+		}
+#else
+		pInterrupt->DisconnectIRQ (ARM_IRQLOCAL0_PMU);
+#endif
+
+		m_bIRQConnected = FALSE;
+	}
+
+	for (unsigned i = 0; i < PMU_PROFILE_CORES; i++)
+	{
+		delete [] m_Core[i].pSample;
+		m_Core[i].pSample = 0;
+	}
+}
+
+boolean CPMUProfiler::Initialize (void)
+{
+	assert (ThisCore () == 0);
+	assert (!m_bIRQConnected);
+
+	for (unsigned i = 0; i < PMU_PROFILE_CORES; i++)
+	{
+		assert (m_Core[i].pSample == 0);
+		m_Core[i].pSample = new TPMUSample[m_nMaxSamples];
+		if (m_Core[i].pSample == 0)
+		{
+			return FALSE;
+		}
+	}
+
+	CInterruptSystem *pInterrupt = CInterruptSystem::Get ();
+#if RASPPI == 4
+	for (unsigned nCore = 0; nCore < PMU_PROFILE_CORES; nCore++)
+	{
+		pInterrupt->ConnectIRQ (ARM_IRQ_PMU0 + nCore, InterruptStub, this);
+	}
+#else
+	pInterrupt->ConnectIRQ (ARM_IRQLOCAL0_PMU, InterruptStub, this);
+#endif
+
+	m_bIRQConnected = TRUE;
+	m_bActive = TRUE;
+
+	return TRUE;
+}
+
+void CPMUProfiler::Start (void)
+{
+	assert (m_bIRQConnected);
+
+#if RASPPI >= 5
+	CInterruptSystem::EnableIRQ (ARM_IRQLOCAL0_PMU);	// private interrupt of this core
+#endif
+
+	asm volatile ("msr pmcntenclr_el0, %0" : : "r" ((u64) PMCNTEN_ALL));
+
+	// count at EL0 and EL1
+	asm volatile ("msr pmccfiltr_el0, xzr");
+	asm volatile ("msr pmevtyper0_el0, %0" : : "r" ((u64) PMU_EVENT_L1D_CACHE_REFILL));
+	asm volatile ("msr pmevtyper1_el0, %0" : : "r" ((u64) PMU_EVENT_BR_MIS_PRED));
+
+	// the cycle counter overflows from bit 31 (PMCR_EL0.LC is 0)
+	asm volatile ("msr pmccntr_el0, %0" : : "r" (0x100000000ULL - m_nPeriod));
+	asm volatile ("msr pmevcntr0_el0, xzr");
+	asm volatile ("msr pmevcntr1_el0, xzr");
+
+	asm volatile ("msr pmovsclr_el0, %0" : : "r" ((u64) PMCNTEN_ALL));
+	asm volatile ("msr pmintenset_el1, %0" : : "r" ((u64) PMCNTEN_CYCLES));
+
+	asm volatile ("msr pmcr_el0, %0" : : "r" ((u64) PMCR_E));
+	asm volatile ("msr pmcntenset_el0, %0" : : "r" ((u64) PMCNTEN_ALL));
+	InstructionSyncBarrier ();
+}
+
+void CPMUProfiler::Stop (void)
+{
+	asm volatile ("msr pmintenclr_el1, %0" : : "r" ((u64) PMCNTEN_CYCLES));
+	asm volatile ("msr pmcntenclr_el0, %0" : : "r" ((u64) PMCNTEN_ALL));
+	asm volatile ("msr pmovsclr_el0, %0" : : "r" ((u64) PMCNTEN_ALL));
+	InstructionSyncBarrier ();
+}
+
+boolean CPMUProfiler::Export (TPMUProfileWriteHandler *pHandler, void *pParam)
+{
+	assert (pHandler != 0);
+
+	m_bActive = FALSE;
+	DataMemBarrier ();
+
+	CString Chunk;
+	Chunk.Format ("# Circle PMU profile\n"
+		      "# period %u cycles\n"
+		      "# core lr pc;return-address... l1d-refills branch-mispredicts\n",
+		      m_nPeriod);
+	if (!(*pHandler) ((const char *) Chunk, Chunk.GetLength (), pParam))
+	{
+		return FALSE;
+	}
+
+	for (unsigned nCore = 0; nCore < PMU_PROFILE_CORES; nCore++)
+	{
+		const TPMUSample *pSample = m_Core[nCore].pSample;
+		unsigned nSamples = m_Core[nCore].nSamples;
+
+		for (unsigned i = 0; i < nSamples; i++, pSample++)
+		{
+			assert (pSample != 0);
+			assert (1 <= pSample->nFrames && pSample->nFrames <= PMU_PROFILE_MAX_FRAMES);
+
+			Chunk.Format ("%u %lX ", nCore, (unsigned long) pSample->nLR);
+
+			for (unsigned j = 0; j < pSample->nFrames; j++)
+			{
+				CString Address;
+				Address.Format (j == 0 ? "%lX" : ";%lX",
+						(unsigned long) pSample->nAddress[j]);
+				Chunk.Append (Address);
+			}
+
+			CString Counters;
+			Counters.Format (" %u %u\n", pSample->nCacheMisses, pSample->nBranchMisses);
+			Chunk.Append (Counters);
+
+			if (!(*pHandler) ((const char *) Chunk, Chunk.GetLength (), pParam))
+			{
+				return FALSE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+unsigned CPMUProfiler::GetSamples (void) const
+{
+	unsigned nResult = 0;
+	for (unsigned i = 0; i < PMU_PROFILE_CORES; i++)
+	{
+		nResult += m_Core[i].nSamples;
+	}
+
+	return nResult;
+}
+
+unsigned CPMUProfiler::GetDroppedSamples (void) const
+{
+	unsigned nResult = 0;
+	for (unsigned i = 0; i < PMU_PROFILE_CORES; i++)
+	{
+		nResult += m_Core[i].nDropped;
+	}
+
+	return nResult;
+}
+
+void CPMUProfiler::InterruptHandler (void)
+{
+	u64 nOverflow;
+	asm volatile ("mrs %0, pmovsclr_el0" : "=r" (nOverflow));
+	asm volatile ("msr pmovsclr_el0, %0" : : "r" (nOverflow));
+	if (!(nOverflow & PMCNTEN_CYCLES))
+	{
+		return;
+	}
+
+	asm volatile ("msr pmccntr_el0, %0" : : "r" (0x100000000ULL - m_nPeriod));
+
+	u64 nCacheMisses, nBranchMisses;
+	asm volatile ("mrs %0, pmevcntr0_el0" : "=r" (nCacheMisses));
+	asm volatile ("mrs %0, pmevcntr1_el0" : "=r" (nBranchMisses));
+	asm volatile ("msr pmevcntr0_el0, xzr");
+	asm volatile ("msr pmevcntr1_el0, xzr");
+
+	if (!m_bActive)
+	{
+		return;
+	}
+
+	unsigned nCore = ThisCore ();
+	assert (nCore < PMU_PROFILE_CORES);
+	if (m_Core[nCore].nSamples >= m_nMaxSamples)
+	{
+		m_Core[nCore].nDropped++;
+
+		return;
+	}
+
+	TPMUSample *pSample = &m_Core[nCore].pSample[m_Core[nCore].nSamples];
+
+	const TIRQReturnContext *pContext = &IRQReturnContext[nCore];
+	pSample->nCacheMisses = (u32) nCacheMisses;
+	pSample->nBranchMisses = (u32) nBranchMisses;
+	pSample->nLR = pContext->lr;
+	pSample->nAddress[0] = pContext->pc;
+
+	// follow the chain of frame records, which must be located at increasing addresses
+	unsigned nFrames = 1;
+	uintptr nFP = pContext->fp;
+	uintptr nLowest = pContext->sp;
+	uintptr nHighest = pContext->sp + STACK_WINDOW - FRAME_RECORD_SIZE;
+	while (   nFrames < PMU_PROFILE_MAX_FRAMES
+	       && nLowest <= nFP && nFP <= nHighest
+	       && !(nFP & 7))
+	{
+		const uintptr *pFrameRecord = (const uintptr *) nFP;
+		uintptr nReturnAddress = pFrameRecord[1];
+		if (nReturnAddress == 0)
+		{
+			break;
+		}
+
+		pSample->nAddress[nFrames++] = nReturnAddress;
+
+		nLowest = nFP + FRAME_RECORD_SIZE;
+		nFP = pFrameRecord[0];
+	}
+
+	pSample->nFrames = nFrames;
+
+	DataMemBarrier ();
+	m_Core[nCore].nSamples++;
+}
+
+void CPMUProfiler::InterruptStub (void *pParam)
+{
+	CPMUProfiler *pThis = (CPMUProfiler *) pParam;
+	assert (pThis != 0);
+
+	pThis->InterruptHandler ();
+}
+
+unsigned CPMUProfiler::ThisCore (void)
+{
+#ifdef ARM_ALLOW_MULTI_CORE
+	return CMultiCoreSupport::ThisCore ();
+#else
+	return 0;
+#endif
+}
@@ -0,0 +1,113 @@
+//
+// pmuprofiler.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _pmuprofile_pmuprofiler_h
+#define _pmuprofile_pmuprofiler_h
+
+#include <circle/memorymap.h>
+#include <circle/sysconfig.h>
+#include <circle/types.h>
+
+#define PMU_PROFILE_MAX_FRAMES	16		// max. call stack depth of a sample
+
+#ifdef ARM_ALLOW_MULTI_CORE
+	#define PMU_PROFILE_CORES	CORES
+#else
+	#define PMU_PROFILE_CORES	1
+#endif
+
+struct TPMUSample
+{
+	u32	nCacheMisses;		// L1 data cache refills since the previous sample
+	u32	nBranchMisses;		// mispredicted branches since the previous sample
+	uintptr	nLR;			// link register, when the sample was taken
+	unsigned nFrames;		// number of valid entries in nAddress[]
+	uintptr	nAddress[PMU_PROFILE_MAX_FRAMES];	// [0] is the PC, followed by return addresses
+};
+
+/// \brief Handler, which writes a chunk of exported profile data (e.g. to a file)
+/// \param pData Pointer to the data
+/// \param nLength Length of the data in bytes
+/// \param pParam User parameter
+/// \return Operation successful?
+typedef boolean TPMUProfileWriteHandler (const void *pData, size_t nLength, void *pParam);
+
+/// \note The cycle counter of the ARM performance monitor unit (PMU) of each profiled core
+///	  triggers an interrupt every nPeriod CPU cycles. The interrupt handler records the
+///	  interrupted PC and the call stack, which is unwound using the frame pointer chain.
+///	  Therefore the profiled code must be compiled with -fno-omit-frame-pointer.
+/// \note Two PMU event counters count the L1 data cache refills and the mispredicted
+///	  branches, which are assigned to each sample.
+/// \note Export() writes the samples as text with raw addresses, which are converted into
+///	  folded stacks (for flame graphs) or the pprof format by tools/pmuprofile.py.
+/// \note Only available in AArch64 mode.
+
+class CPMUProfiler	/// Statistical sampling profiler using the ARM PMU cycle counter
+{
+public:
+	/// \param nPeriod Number of CPU cycles between two samples
+	/// \param nMaxSamples Number of samples, which can be recorded per core
+	CPMUProfiler (unsigned nPeriod = 1000000, unsigned nMaxSamples = 20000);
+	~CPMUProfiler (void);
+
+	/// \brief Connect the PMU interrupt(s)
+	/// \return Operation successful?
+	/// \note Must be called on core 0, before Start() is called on any core.
+	boolean Initialize (void);
+
+	/// \brief Start sampling on the calling core
+	/// \note Must be called on each core, which should be profiled.
+	void Start (void);
+	/// \brief Stop sampling on the calling core
+	void Stop (void);
+
+	/// \brief Stop recording on all cores and export the samples
+	/// \param pHandler Handler, which writes the exported data in chunks
+	/// \param pParam User parameter, handed over to the handler
+	/// \return Operation successful? (FALSE if the handler returned FALSE)
+	boolean Export (TPMUProfileWriteHandler *pHandler, void *pParam = 0);
+
+	/// \return Number of recorded samples on all cores
+	unsigned GetSamples (void) const;
+	/// \return Number of samples, which could not be recorded, because a buffer was full
+	unsigned GetDroppedSamples (void) const;
+
+private:
+	void InterruptHandler (void);
+	static void InterruptStub (void *pParam);
+
+	static unsigned ThisCore (void);
+
+private:
+	unsigned m_nPeriod;
+	unsigned m_nMaxSamples;
+
+	boolean m_bIRQConnected;
+	volatile boolean m_bActive;
+
+	struct
+	{
+		TPMUSample	 *pSample;
+		volatile unsigned nSamples;
+		unsigned	  nDropped;
+	}
+	m_Core[PMU_PROFILE_CORES];
+};
+
+#endif
@@ -0,0 +1,151 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <circle/memory.h>
+
+#define DRIVE		"SD:"
+#define FILENAME	"/profile.txt"
+
+#define SAMPLE_PERIOD	1000000		// CPU cycles
+#define MAX_SAMPLES	10000		// per core
+
+static const char FromKernel[] = "kernel";
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer),
+	m_EMMC (&m_Interrupt, &m_Timer, &m_ActLED),
+	m_Profiler (SAMPLE_PERIOD, MAX_SAMPLES),
+	m_Workload (&m_Profiler, CMemorySystem::Get ())
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_EMMC.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Profiler.Initialize ();
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+	FRESULT Result = f_mount (&m_FileSystem, DRIVE, 1);
+	if (Result != FR_OK)
+	{
+		m_Logger.Write (FromKernel, LogError, "Cannot mount drive " DRIVE " (%d)", Result);
+
+		return ShutdownHalt;
+	}
+
+	m_Logger.Write (FromKernel, LogNotice, "Profiling on %u core(s)", PMU_PROFILE_CORES);
+
+	if (!m_Workload.Initialize ())		// starts the secondary cores
+	{
+		m_Logger.Write (FromKernel, LogError, "Cannot start secondary cores");
+
+		return ShutdownHalt;
+	}
+
+	m_Workload.Run (0);
+
+	m_Logger.Write (FromKernel, LogNotice, "%u samples recorded, %u dropped",
+			m_Profiler.GetSamples (), m_Profiler.GetDroppedSamples ());
+
+	FIL File;
+	Result = f_open (&File, DRIVE FILENAME, FA_WRITE | FA_CREATE_ALWAYS);
+	if (Result != FR_OK)
+	{
+		m_Logger.Write (FromKernel, LogError, "Cannot create file " FILENAME " (%d)", Result);
+
+		return ShutdownHalt;
+	}
+
+	boolean bOK = m_Profiler.Export (WriteHandler, &File);
+
+	if (   f_close (&File) != FR_OK
+	    || !bOK)
+	{
+		m_Logger.Write (FromKernel, LogError, "Cannot write file " FILENAME);
+
+		return ShutdownHalt;
+	}
+
+	m_Logger.Write (FromKernel, LogNotice, "Profile written to " DRIVE FILENAME);
+
+	return ShutdownHalt;
+}
+
+boolean CKernel::WriteHandler (const void *pData, size_t nLength, void *pParam)
+{
+	FIL *pFile = (FIL *) pParam;
+
+	unsigned nBytesWritten;
+	return    f_write (pFile, pData, nLength, &nBytesWritten) == FR_OK
+	       && nBytesWritten == nLength;
+}
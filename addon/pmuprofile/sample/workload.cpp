@@ -0,0 +1,186 @@
+//
+// workload.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "workload.h"
+#include <circle/timer.h>
+#include <assert.h>
+
+#define WORKLOAD_SECS	5
+
+#define ARRAY_SIZE	2000
+#define LIST_SIZE	(256*1024)	// larger than the L2 cache
+
+CWorkload::CWorkload (CPMUProfiler *pProfiler, CMemorySystem *pMemorySystem)
+:
+#ifdef ARM_ALLOW_MULTI_CORE
+	CMultiCoreSupport (pMemorySystem),
+#endif
+	m_pProfiler (pProfiler)
+{
+	for (unsigned nCore = 0; nCore < PMU_PROFILE_CORES; nCore++)
+	{
+		m_Core[nCore].bDone = FALSE;
+		m_Core[nCore].nSeed = nCore + 1;
+		m_Core[nCore].nResult = 0;
+
+		m_Core[nCore].pArray = new unsigned[ARRAY_SIZE];
+		assert (m_Core[nCore].pArray != 0);
+
+		// link the list entries in random order
+		unsigned *pOrder = new unsigned[LIST_SIZE];
+		assert (pOrder != 0);
+
+		for (unsigned i = 0; i < LIST_SIZE; i++)
+		{
+			pOrder[i] = i;
+		}
+
+		for (unsigned i = LIST_SIZE-1; i > 0; i--)
+		{
+			unsigned j = Random (&m_Core[nCore].nSeed) % (i+1);
+
+			unsigned nTemp = pOrder[i];
+			pOrder[i] = pOrder[j];
+			pOrder[j] = nTemp;
+		}
+
+		TListEntry *pList = new TListEntry[LIST_SIZE];
+		assert (pList != 0);
+
+		for (unsigned i = 0; i < LIST_SIZE; i++)
+		{
+			pList[pOrder[i]].pNext = &pList[pOrder[(i+1) % LIST_SIZE]];
+			pList[pOrder[i]].nValue = i;
+		}
+
+		delete [] pOrder;
+
+		m_Core[nCore].pList = pList;
+	}
+}
+
+CWorkload::~CWorkload (void)
+{
+	for (unsigned nCore = 0; nCore < PMU_PROFILE_CORES; nCore++)
+	{
+		delete [] m_Core[nCore].pArray;
+		delete [] m_Core[nCore].pList;
+	}
+
+	m_pProfiler = 0;
+}
+
+void CWorkload::Run (unsigned nCore)
+{
+	assert (nCore < PMU_PROFILE_CORES);
+	assert (m_pProfiler != 0);
+
+	m_pProfiler->Start ();
+
+	CTimer *pTimer = CTimer::Get ();
+	unsigned nStartTicks = pTimer->GetTicks ();
+	while (pTimer->GetTicks () - nStartTicks < WORKLOAD_SECS * HZ)
+	{
+		SortArray (nCore);
+		WalkList (nCore);
+		Calculate (nCore);
+	}
+
+	m_pProfiler->Stop ();
+
+	m_Core[nCore].bDone = TRUE;
+
+	if (nCore == 0)
+	{
+		for (unsigned i = 1; i < PMU_PROFILE_CORES; i++)
+		{
+			while (!m_Core[i].bDone)
+			{
+				// just wait
+			}
+		}
+	}
+}
+
+void CWorkload::SortArray (unsigned nCore)
+{
+	unsigned *pArray = m_Core[nCore].pArray;
+	for (unsigned i = 0; i < ARRAY_SIZE; i++)
+	{
+		pArray[i] = Random (&m_Core[nCore].nSeed);
+	}
+
+	// insertion sort of random values
+	for (unsigned i = 1; i < ARRAY_SIZE; i++)
+	{
+		unsigned nValue = pArray[i];
+
+		unsigned j = i;
+		for (; j > 0 && pArray[j-1] > nValue; j--)
+		{
+			pArray[j] = pArray[j-1];
+		}
+
+		pArray[j] = nValue;
+	}
+
+	m_Core[nCore].nResult += pArray[ARRAY_SIZE / 2];
+}
+
+void CWorkload::WalkList (unsigned nCore)
+{
+	unsigned nSum = 0;
+
+	const TListEntry *pEntry = m_Core[nCore].pList;
+	for (unsigned i = 0; i < LIST_SIZE; i++)
+	{
+		nSum += pEntry->nValue;
+		pEntry = pEntry->pNext;
+	}
+
+	m_Core[nCore].nResult += nSum;
+}
+
+void CWorkload::Calculate (unsigned nCore)
+{
+	unsigned nValue = m_Core[nCore].nResult;
+	for (unsigned i = 0; i < 1000000; i++)
+	{
+		nValue = Mix (nValue + i);
+	}
+
+	m_Core[nCore].nResult = nValue;
+}
+
+unsigned CWorkload::Mix (unsigned nValue)
+{
+	nValue ^= nValue >> 16;
+	nValue *= 0x7FEB352D;
+	nValue ^= nValue >> 15;
+	nValue *= 0x846CA68B;
+
+	return nValue ^ (nValue >> 16);
+}
+
+unsigned CWorkload::Random (unsigned *pSeed)
+{
+	*pSeed = *pSeed * 1103515245 + 12345;
+
+	return *pSeed >> 8;
+}
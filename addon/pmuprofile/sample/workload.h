@@ -0,0 +1,74 @@
+//
+// workload.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _workload_h
+#define _workload_h
+
+#include <circle/multicore.h>
+#include <circle/memory.h>
+#include <circle/types.h>
+#include <pmuprofile/pmuprofiler.h>
+
+class CWorkload
+#ifdef ARM_ALLOW_MULTI_CORE
+	: public CMultiCoreSupport
+#endif
+{
+public:
+	CWorkload (CPMUProfiler *pProfiler, CMemorySystem *pMemorySystem);
+	~CWorkload (void);
+
+#ifndef ARM_ALLOW_MULTI_CORE
+	boolean Initialize (void)	{ return TRUE; }
+#endif
+
+	/// \brief Run the profiled workload on this core for some seconds
+	/// \note Returns on core 0, when all cores have finished.
+	void Run (unsigned nCore);
+
+private:
+	// different kinds of work to be seen in the profile
+	void SortArray (unsigned nCore);	// many mispredicted branches
+	void WalkList (unsigned nCore);		// many cache misses
+	void Calculate (unsigned nCore);	// busy ALU
+	static unsigned Mix (unsigned nValue);
+
+	static unsigned Random (unsigned *pSeed);
+
+private:
+	CPMUProfiler *m_pProfiler;
+
+	struct TListEntry
+	{
+		TListEntry *pNext;
+		unsigned nValue;
+	};
+
+	struct
+	{
+		unsigned	*pArray;
+		TListEntry	*pList;
+		unsigned	 nSeed;
+		volatile unsigned nResult;	// prevents optimizing the work away
+		volatile boolean bDone;
+	}
+	m_Core[PMU_PROFILE_CORES];
+};
+
+#endif
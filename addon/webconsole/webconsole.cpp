@@ -2,7 +2,7 @@
 // webconsole.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2016  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2016-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -19,6 +19,8 @@
 //
 #include <webconsole/webconsole.h>
 #include <circle/logger.h>
+#include <circle/latencyhistogram.h>
+#include <circle/string.h>
 #include <circle/util.h>
 #include <assert.h>
 
@@ -65,6 +67,11 @@ THTTPStatus CWebConsole::GetContent (const char  *pPath,
 	assert (m_pLog != 0);
 
 	assert (pPath != 0);
+	if (strcmp (pPath, "/latency") == 0)
+	{
+		return GetLatency (pBuffer, pLength, ppContentType);
+	}
+
 	if (   strcmp (pPath, "/") != 0
 	    && strcmp (pPath, "/index.html") != 0)
 	{
@@ -93,3 +100,26 @@ THTTPStatus CWebConsole::GetContent (const char  *pPath,
 
 	return HTTPOK;
 }
+
+THTTPStatus CWebConsole::GetLatency (u8 *pBuffer, unsigned *pLength, const char **ppContentType)
+{
+	CString Table;
+	CLatencyHistogram::FormatAll (&Table);
+
+	unsigned nLength = Table.GetLength ();
+
+	assert (pLength != 0);
+	if (*pLength < nLength)
+	{
+		return HTTPInternalServerError;
+	}
+
+	assert (pBuffer != 0);
+	memcpy (pBuffer, (const char *) Table, nLength);
+	*pLength = nLength;
+
+	assert (ppContentType != 0);
+	*ppContentType = "text/plain; charset=iso-8859-1";
+
+	return HTTPOK;
+}
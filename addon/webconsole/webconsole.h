@@ -2,7 +2,7 @@
 // webconsole.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2016  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2016-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -44,6 +44,10 @@ public:
 			        unsigned    *pLength,		// in: buffer size, out: content length
 			        const char **ppContentType);	// set this if not "text/html"
 
+private:
+	// provides the percentiles of all latency histograms (path /latency)
+	THTTPStatus GetLatency (u8 *pBuffer, unsigned *pLength, const char **ppContentType);
+
 private:
 	u16 m_nPort;
 	CLogBuffer *m_pLog;
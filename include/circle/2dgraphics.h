@@ -5,7 +5,7 @@
 //	Copyright (C) 2021  Stephane Damo
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -32,6 +32,18 @@
 
 typedef CDisplay::TColor T2DColor;
 
+#define C2DGRAPHICS_MAX_DIRTY_AREAS	8	// more dirty areas are merged
+
+struct T2DGraphicsStats		/// Statistics of UpdateDisplay()
+{
+	unsigned nUpdates;		// calls of UpdateDisplay()
+	unsigned nAreas;		// areas sent to the display
+	u64	 ullPixels;		// pixels sent to the display
+	unsigned nUpdateUsecsLast;	// duration of the display update (without VSync wait)
+	unsigned nUpdateUsecsAvg;
+	unsigned nUpdateUsecsMax;
+};
+
 class C2DGraphics;
 
 class C2DImage	/// A sprite image to be displayed on a C2DGraphics instance
@@ -65,6 +77,9 @@ private:
 	u8 *m_pData;
 };
 
+/// \note Coordinates of the drawing methods may be negative (casted to unsigned).\n
+///	  All primitives are clipped to the screen.
+
 class C2DGraphics /// Software graphics library with VSync and hardware-accelerated double buffering
 {
 public:
@@ -117,6 +132,16 @@ public:
 	/// \param nHeight Rectangle height
 	/// \param Color Rectangle color
 	void DrawRect (unsigned nX, unsigned nY, unsigned nWidth, unsigned nHeight, T2DColor Color);
+
+	/// \brief Draws a filled, translucent rectangle
+	/// \param nX Start X coordinate
+	/// \param nY Start Y coordinate
+	/// \param nWidth Rectangle width
+	/// \param nHeight Rectangle height
+	/// \param Color Rectangle color
+	/// \param uchAlpha Opacity (0: transparent, 255: opaque)
+	/// \note With 1 and 8 bits depth the rectangle is drawn opaque, if uchAlpha >= 128.
+	void DrawRectAlpha (unsigned nX, unsigned nY, unsigned nWidth, unsigned nHeight, T2DColor Color, u8 uchAlpha);
 	
 	/// \brief Draws an unfilled rectangle (inner outline)
 	/// \param nX Start X coordinate
@@ -154,6 +179,8 @@ public:
 	/// \param nWidth Image width
 	/// \param nHeight Image height
 	/// \param PixelBuffer Pointer to the pixels
+	/// \note With 1 bit depth each line of PixelBuffer starts at a byte boundary\n
+	///	  (padded to full bytes, MSB is the left pixel, like in C2DImage).
 	void DrawImage (unsigned nX, unsigned nY, unsigned nWidth, unsigned nHeight, const void *PixelBuffer);
 	
 	/// \brief Draws an image from a pixel buffer with transparent color
@@ -163,6 +190,7 @@ public:
 	/// \param nHeight Image height
 	/// \param PixelBuffer Pointer to the pixels
 	/// \param TransparentColor Color to use for transparency
+	/// \note See DrawImage() for the format of PixelBuffer with 1 bit depth.
 	void DrawImageTransparent (unsigned nX, unsigned nY, unsigned nWidth, unsigned nHeight, const void *PixelBuffer, T2DColor TransparentColor);
 	
 	/// \brief Draws an area of an image from a pixel buffer
@@ -173,6 +201,7 @@ public:
 	/// \param nSourceX Source X coordinate in the pixel buffer
 	/// \param nSourceY Source Y coordinate in the pixel buffer
 	/// \param PixelBuffer Pointer to the pixels
+	/// \note See DrawImage() for the format of PixelBuffer with 1 bit depth.
 	void DrawImageRect (unsigned nX, unsigned nY, unsigned nWidth, unsigned nHeight, unsigned nSourceX, unsigned nSourceY, const void *PixelBuffer);
 	
 	/// \brief Draws an area of an image from a pixel buffer with transparent color
@@ -186,6 +215,7 @@ public:
 	/// \param nSourceHeight Source image height
 	/// \param PixelBuffer Pointer to the pixels
 	/// \param TransparentColor Color to use for transparency
+	/// \note See DrawImage() for the format of PixelBuffer with 1 bit depth.
 	void DrawImageRectTransparent (unsigned nX, unsigned nY, unsigned nWidth, unsigned nHeight, unsigned nSourceX, unsigned nSourceY, unsigned nSourceWidth, unsigned nSourceHeight, const void *PixelBuffer, T2DColor TransparentColor);
 	
 	/// \brief Draws a single pixel. If you need to draw a lot of pixels, consider using GetBuffer() for better speed
@@ -209,15 +239,35 @@ public:
 
 	/// \brief Gets raw access to the drawing buffer
 	/// \return Pointer to the buffer
+	/// \note The whole screen is marked dirty. If the buffer is modified later without\n
+	///	  calling GetBuffer() again, use MarkDirty() or disable the dirty tracking.
 	void *GetBuffer (void);
 
+	/// \brief Marks an area as modified, which has been written directly into the buffer
+	/// \param nX Start X coordinate
+	/// \param nY Start Y coordinate
+	/// \param nWidth Area width
+	/// \param nHeight Area height
+	void MarkDirty (unsigned nX, unsigned nY, unsigned nWidth, unsigned nHeight);
+
+	/// \param bEnable FALSE to update the whole screen with each UpdateDisplay() (default TRUE)
+	/// \note Drawing methods mark the areas, they have modified, as dirty. UpdateDisplay()\n
+	///	  sends only the dirty areas to the display, which speeds up slow (e.g. SPI) displays.
+	void EnableDirtyTracking (boolean bEnable = TRUE);
+
 	/// \return Pointer to display, we are working on
 	CDisplay *GetDisplay (void);
 	
 	/// \brief Once everything has been drawn, updates the display to show the contents on screen
 	/// \brief If VSync is enabled, this method is blocking until the screen refresh signal is received (every 16ms for 60FPS refresh rate)
+	/// \note The dirty areas are sent with synchronous calls of CDisplay::SetArea(). With SPI
+	///	  displays using DMA, this method returns, when the last area has been sent.
 	void UpdateDisplay (void);
 
+	/// \param pStats Receives the statistics since Initialize() or ResetStats()
+	void GetStats (T2DGraphicsStats *pStats) const;
+	void ResetStats (void);
+
 private:
 	void SetPixel (unsigned nX, unsigned nY, CDisplay::TRawColor nColor)
 	{
@@ -243,38 +293,34 @@ private:
 		}
 	}
 
-	CDisplay::TRawColor GetPixel (const void **ppPixelBuffer, unsigned nOffsetX)
+	void PutPixel (int nX, int nY, CDisplay::TRawColor nColor)
 	{
-		switch (m_nDepth)
+		if (   (unsigned) nX < m_nWidth
+		    && (unsigned) nY < m_nHeight)
 		{
-		case 1: {
-				const u8 **pp = reinterpret_cast<const u8 **> (ppPixelBuffer);
-				CDisplay::TRawColor nColor = !!(**pp & (0x80 >> (nOffsetX & 7)));
-				if ((nOffsetX & 7) == 7)
-				{
-					(*pp)++;
-				}
-				return nColor;
-			}
+			SetPixel (nX, nY, nColor);
+		}
+	}
 
-		case 8: {
-				const u8 **pp = reinterpret_cast<const u8 **> (ppPixelBuffer);
-				return *(*pp)++;
-			}
+	/// \brief Clips a rectangle to the screen
+	/// \param pSkipX Receives the number of pixels clipped on the left (may be nullptr)
+	/// \param pSkipY Receives the number of pixels clipped on the top (may be nullptr)
+	/// \return FALSE, if the rectangle is not visible
+	boolean ClipRect (int *pX, int *pY, int *pWidth, int *pHeight,
+			  unsigned *pSkipX = nullptr, unsigned *pSkipY = nullptr) const;
 
-		case 16: {
-				const u16 **pp = reinterpret_cast<const u16 **> (ppPixelBuffer);
-				return *(*pp)++;
-			}
+	// clips the area and merges it into the list of dirty areas
+	void AddDirtyArea (int nX, int nY, int nWidth, int nHeight);
+	void AddDirtyArea (const CDisplay::TArea &rArea);
 
-		case 32: {
-				const u32 **pp = reinterpret_cast<const u32 **> (ppPixelBuffer);
-				return *(*pp)++;
-			}
-		}
+	// sends an area of the buffer to the display, nBaseY is added to the display coordinates
+	void SendArea (const CDisplay::TArea &rArea, unsigned nBaseY);
 
-		return 0;
-	}
+	// clipped raster operations, dispatched once per primitive on the depth
+	void FillRect (int nX, int nY, int nWidth, int nHeight, CDisplay::TRawColor nColor);
+	void CopyRect (int nX, int nY, int nWidth, int nHeight,
+		       const void *pPixels, unsigned nSourceX, unsigned nSourceY, unsigned nSourcePitch,
+		       boolean bTransparent, CDisplay::TRawColor nTransparentColor);
 
 private:
 	unsigned m_nWidth;
@@ -294,6 +340,22 @@ private:
 
 	boolean m_bVSync;
 	boolean m_bBufferSwapped;
+
+	boolean m_bDirtyTracking;
+	CDisplay::TArea m_DirtyArea[C2DGRAPHICS_MAX_DIRTY_AREAS];
+	unsigned m_nDirtyAreas;
+	CDisplay::TArea m_PreviousDirtyArea[C2DGRAPHICS_MAX_DIRTY_AREAS]; // for double buffering
+	unsigned m_nPreviousDirtyAreas;
+
+	u8 *m_pAreaBuffer;			// for areas, which are not contiguous in the buffer
+	size_t m_nAreaBufferSize;
+
+	unsigned m_nStatUpdates;
+	unsigned m_nStatAreas;
+	u64 m_ullStatPixels;
+	unsigned m_nStatUsecsLast;
+	unsigned m_nStatUsecsMax;
+	u64 m_ullStatUsecsSum;
 };
 
 #endif
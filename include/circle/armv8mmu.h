@@ -2,7 +2,7 @@
 // armv8mmu.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2016-2023  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2016-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -122,6 +122,7 @@ struct TARMV8MMU_LEVEL3_PAGE_DESCRIPTOR
 PACKED;
 
 #define ARMV8MMU_LEVEL3_PAGE_SIZE	0x10000
+#define ARMV8MMU_LEVEL3_AF		(1UL << 10)	// access flag in page descriptor
 #define ARMV8MMUL3PAGEADDR(addr)	(((addr) >> 16) & 0xFFFFFFFF)
 #define ARMV8MMUL3PAGEPTR(page)		((void *) ((page) << 16))
 
@@ -64,6 +64,11 @@
 #define ARM_IRQ_BCM54213_1	GIC_SPI (158)
 #define ARM_IRQ_XHCI_INTERNAL	GIC_SPI (176)
 
+#define ARM_IRQ_PMU0		GIC_SPI (16)	// performance monitor of core 0
+#define ARM_IRQ_PMU1		GIC_SPI (17)
+#define ARM_IRQ_PMU2		GIC_SPI (18)
+#define ARM_IRQ_PMU3		GIC_SPI (19)
+
 #define IRQ_LINES		256
 
 #else
@@ -87,6 +92,8 @@
 #define ARM_IRQ_PCIE_HOST_MSI	GIC_SPI (234)
 #define ARM_IRQ_SDIO2		GIC_SPI (274)
 
+#define ARM_IRQLOCAL0_PMU	GIC_PPI (7)	// must be enabled on each core
+
 #define IRQ_LINES		512
 
 #endif
@@ -2,7 +2,7 @@
 // bcmframebuffer.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -61,6 +61,7 @@ public:
 	u32 GetHeight (void) const;
 	u32 GetVirtWidth(void) const;
 	u32 GetVirtHeight(void) const;
+	unsigned GetVirtualHeight (void) const	{ return GetVirtHeight (); }	// for CDisplay
 	u32 GetPitch (void) const;
 	u32 GetDepth (void) const;
 	u32 GetBuffer (void) const;
@@ -2,7 +2,7 @@
 /// \file display.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2024-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -124,6 +124,16 @@ public:
 	/// \return Y-offset in pixels of this window display in the parent display
 	virtual unsigned GetOffsetY (void) const;
 
+	/// \return Number of vertical pixels in display memory (>= GetHeight())
+	virtual unsigned GetVirtualHeight (void) const;
+	/// \brief Select the pixel in display memory, which is displayed top left
+	/// \param nOffsetX X-offset of the visible window in display memory
+	/// \param nOffsetY Y-offset of the visible window in display memory
+	/// \return Operation successful? (FALSE, if not supported)
+	/// \note Areas outside the visible window can be set with SetArea(),
+	///	  using y-coordinates up to GetVirtualHeight()-1.
+	virtual boolean SetVirtualOffset (unsigned nOffsetX, unsigned nOffsetY);
+
 private:
 	TColorModel m_ColorModel;
 };
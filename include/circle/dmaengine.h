@@ -0,0 +1,265 @@
+//
+// dmaengine.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_dmaengine_h
+#define _circle_dmaengine_h
+
+#include <circle/dmachannel.h>
+#include <circle/dmacommon.h>
+#include <circle/interrupt.h>
+#include <circle/spinlock.h>
+#include <circle/types.h>
+
+#if RASPPI >= 5
+	#error CDMAEngine is not supported on Raspberry Pi 5 yet
+#endif
+
+#define DMA_ENGINE_MAX_CHANNELS		4
+#define DMA_ENGINE_ASYNC_REQUESTS	8	// for MemCopyAsync() and MemSetAsync()
+
+class CDMARequest;
+
+/// \param pRequest Pointer to the completed request
+/// \param pParam   User parameter
+/// \note Called in interrupt context. GetStatus() returns the result.
+typedef void TDMARequestCompletionRoutine (CDMARequest *pRequest, void *pParam);
+
+/// \param bStatus TRUE for a successful transfer
+/// \param pParam  User parameter
+/// \note Called in interrupt context.
+typedef void TDMAEngineCompletionRoutine (boolean bStatus, void *pParam);
+
+struct TDMAEngineStats
+{
+	unsigned nSubmitted;		// requests
+	unsigned nCompleted;
+	unsigned nErrors;		// requests failed
+	unsigned nSegments;		// control blocks executed
+	u64	 ullBytes;		// bytes transferred
+	unsigned nQueuedMax;		// max. number of requests waiting for a channel
+};
+
+class CDMARequest	/// A chain of DMA transfers (scatter-gather list), executed in order
+{
+public:
+	/// \param nMaxSegments Maximum number of transfers in this request
+	CDMARequest (unsigned nMaxSegments = 16);
+
+	~CDMARequest (void);
+
+	/// \brief Remove all segments to re-use the request after completion
+	void Reset (void);
+
+	/// \brief Append a memory copy transfer
+	/// \param pDestination Pointer to the destination buffer
+	/// \param pSource	Pointer to the source buffer
+	/// \param nLength	Number of bytes to be transferred
+	/// \param bCached	Are the buffers in cached memory regions?
+	/// \return FALSE, if the maximum number of segments has been reached
+	boolean AddMemCopy (void *pDestination, const void *pSource, size_t nLength,
+			    boolean bCached = TRUE);
+
+	/// \brief Append a memory fill transfer
+	/// \param pDestination Pointer to the destination buffer
+	/// \param uchValue	Byte value to be written
+	/// \param nLength	Number of bytes to be written
+	/// \param bCached	Is the buffer in a cached memory region?
+	/// \return FALSE, if the maximum number of segments has been reached
+	boolean AddMemSet (void *pDestination, u8 uchValue, size_t nLength,
+			   boolean bCached = TRUE);
+
+	/// \brief Append a 2D memory copy transfer (e.g. a rectangle in a frame buffer)
+	/// \param pDestination Pointer to the destination buffer
+	/// \param pSource	Pointer to the source buffer
+	/// \param nBlockLength	Length of the blocks (lines) to be transferred
+	/// \param nBlockCount	Number of blocks to be transferred
+	/// \param nDestStride	Number of bytes to be skipped after each block in destination
+	/// \param nSourceStride Number of bytes to be skipped after each block in source
+	/// \return FALSE, if the maximum number of segments has been reached
+	/// \note The destination cache is not touched (like CDMAChannel::SetupMemCopy2D()).
+	boolean AddMemCopy2D (void *pDestination, const void *pSource,
+			      size_t nBlockLength, unsigned nBlockCount,
+			      size_t nDestStride, size_t nSourceStride = 0);
+
+	/// \brief Append an I/O write transfer
+	/// \param ulIOAddress	I/O address to be written (ARM-side or bus address)
+	/// \param pSource	Pointer to the source buffer
+	/// \param nLength	Number of bytes to be transferred
+	/// \param DREQ		DREQ line for pacing the transfer (see dmacommon.h)
+	/// \return FALSE, if the maximum number of segments has been reached
+	boolean AddIOWrite (uintptr ulIOAddress, const void *pSource, size_t nLength, TDREQ DREQ);
+
+	/// \brief Append an I/O read transfer
+	/// \param pDestination Pointer to the destination buffer
+	/// \param ulIOAddress	I/O address to be read from (ARM-side or bus address)
+	/// \param nLength	Number of bytes to be transferred
+	/// \param DREQ		DREQ line for pacing the transfer (see dmacommon.h)
+	/// \return FALSE, if the maximum number of segments has been reached
+	boolean AddIORead (void *pDestination, uintptr ulIOAddress, size_t nLength, TDREQ DREQ);
+
+	/// \return Number of segments in this request
+	unsigned GetSegmentCount (void) const;
+
+	/// \param pRoutine Completion routine to be called, when the request is finished
+	/// \param pParam   User parameter
+	/// \note Without completion routine use CDMAEngine::Wait().
+	void SetCompletionRoutine (TDMARequestCompletionRoutine *pRoutine, void *pParam = 0);
+
+	/// \return Has the request been completed?
+	boolean IsCompleted (void) const;
+
+	/// \return Has the request been successful? (call after completion)
+	boolean GetStatus (void) const;
+
+private:
+	TDMAControlBlock *NextControlBlock (void);
+
+	void AddDestination (uintptr nAddress, size_t nLength);
+
+	// called by CDMAEngine
+	void Prepare (void);
+	void Complete (boolean bStatus);
+	friend class CDMAEngine;
+
+private:
+	unsigned m_nMaxSegments;
+	unsigned m_nSegments;
+
+	TDMAControlBlock *m_pControlBlock;	// [m_nMaxSegments]
+	u32 *m_pFillPattern;			// [m_nMaxSegments * 4], source of AddMemSet()
+
+	struct TDestination			// to be invalidated after completion
+	{
+		uintptr	nAddress;
+		size_t	nLength;
+	};
+
+	TDestination *m_pDestination;		// [m_nMaxSegments]
+	unsigned m_nDestinations;
+
+	size_t m_nTotalLength;
+
+	TDMARequestCompletionRoutine *m_pCompletionRoutine;
+	void *m_pCompletionParam;
+
+	volatile boolean m_bCompleted;
+	boolean m_bStatus;
+
+	CDMARequest *m_pNext;			// in the queue of CDMAEngine
+};
+
+/// \note Buffers must be in the first GB of memory on the Raspberry Pi 4 (e.g. HEAP_DMA30),
+///	  because the requests are executed by the legacy DMA controller.
+
+class CDMAEngine	/// DMA service with a channel pool and a queue of asynchronous requests
+{
+public:
+	/// \param pInterruptSystem Pointer to the interrupt system object
+	/// \param nChannels Number of DMA channels in the pool (1 .. DMA_ENGINE_MAX_CHANNELS)
+	CDMAEngine (CInterruptSystem *pInterruptSystem, unsigned nChannels = 2);
+
+	~CDMAEngine (void);
+
+	/// \return Operation successful?
+	/// \note Allocates the DMA channels, may get less channels than requested
+	boolean Initialize (void);
+
+	/// \return Number of channels in the pool
+	unsigned GetChannelCount (void) const;
+
+	/// \brief Queue a request for execution on the next free channel
+	/// \param pRequest Request with at least one segment
+	/// \note Requests are started in submission order, but may complete out of order,
+	///	  when more than one channel is available.
+	/// \note Can be called from interrupt context (e.g. from a completion routine).
+	void Submit (CDMARequest *pRequest);
+
+	/// \brief Wait for the completion of a request without completion routine
+	/// \return Has the request been successful?
+	boolean Wait (CDMARequest *pRequest);
+
+	/// \brief Copy memory synchronously
+	/// \return Operation successful?
+	boolean MemCopy (void *pDestination, const void *pSource, size_t nLength);
+
+	/// \brief Copy memory asynchronously
+	/// \param pRoutine Called, when the copy is finished (may be nullptr)
+	/// \param pParam   User parameter
+	/// \return FALSE, if all DMA_ENGINE_ASYNC_REQUESTS are busy (use the CPU then)
+	boolean MemCopyAsync (void *pDestination, const void *pSource, size_t nLength,
+			      TDMAEngineCompletionRoutine *pRoutine, void *pParam = 0);
+
+	/// \brief Fill memory asynchronously
+	/// \param pRoutine Called, when the fill is finished (may be nullptr)
+	/// \param pParam   User parameter
+	/// \return FALSE, if all DMA_ENGINE_ASYNC_REQUESTS are busy (use the CPU then)
+	boolean MemSetAsync (void *pDestination, u8 uchValue, size_t nLength,
+			     TDMAEngineCompletionRoutine *pRoutine, void *pParam = 0);
+
+	/// \return Are all submitted requests completed?
+	boolean IsIdle (void);
+
+	/// \param pStats Receives the statistics since Initialize() or ResetStats()
+	void GetStats (TDMAEngineStats *pStats);
+	void ResetStats (void);
+
+private:
+	CDMARequest *GetAsyncRequest (TDMAEngineCompletionRoutine *pRoutine, void *pParam);
+	static void AsyncCompletionStub (CDMARequest *pRequest, void *pParam);
+
+	// spin lock must be held
+	void StartRequest (unsigned nIndex, CDMARequest *pRequest);
+
+	void InterruptHandler (unsigned nIndex);
+	static void InterruptStub (void *pParam);
+
+private:
+	CInterruptSystem *m_pInterruptSystem;
+	unsigned m_nChannels;
+
+	struct TChannel
+	{
+		CDMAEngine	*pThis;
+		unsigned	 nIndex;
+		unsigned	 nChannel;		// DMA channel number
+		CDMARequest	*pRequest;		// active request or nullptr
+	};
+
+	TChannel m_Channel[DMA_ENGINE_MAX_CHANNELS];
+
+	CDMARequest *m_pQueueHead;		// requests waiting for a free channel
+	CDMARequest *m_pQueueTail;
+	unsigned m_nQueued;
+
+	struct TAsyncRequest
+	{
+		CDMARequest			*pRequest;
+		TDMAEngineCompletionRoutine	*pRoutine;
+		void				*pParam;
+		boolean				 bInUse;
+	};
+
+	TAsyncRequest m_AsyncRequest[DMA_ENGINE_ASYNC_REQUESTS];
+
+	TDMAEngineStats m_Stats;
+
+	CSpinLock m_SpinLock;
+};
+
+#endif
@@ -2,7 +2,7 @@
 // exceptionhandler.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -34,11 +34,29 @@ public:
 #endif
 
 	virtual void Throw (unsigned nException, TAbortFrame *pFrame);
+
+#if AARCH == 64
+	// nAddress is in the demand paged region (MEM_PAGED_START, MEM_PAGED_SIZE),
+	// bAccessFlag is TRUE on an access flag fault, FALSE on a translation fault,
+	// called with IRQs enabled (may sleep), returns TRUE if the fault has been resolved
+	typedef boolean TPageFaultHandler (uintptr nAddress, boolean bAccessFlag, void *pParam);
+
+	void RegisterPageFaultHandler (TPageFaultHandler *pHandler, void *pParam = 0);
+	void UnregisterPageFaultHandler (void);
+
+	// called from the synchronous exception stub, returns TRUE if resolved
+	static boolean ResolveAbort (TAbortFrame *pFrame);
+#endif
 	
 	static CExceptionHandler *Get (void);
 
 private:
 	static const char *s_pExceptionName[];
+
+#if AARCH == 64
+	TPageFaultHandler *m_pPageFaultHandler;
+	void *m_pPageFaultParam;
+#endif
 	
 	static CExceptionHandler *s_pThis;
 };
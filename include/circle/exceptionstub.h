@@ -2,7 +2,7 @@
 // exceptionstub.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -21,6 +21,7 @@
 #define _circle_exceptionstub_h
 
 #include <circle/macros.h>
+#include <circle/memorymap.h>
 #include <circle/types.h>
 
 #ifdef __cplusplus
@@ -113,6 +114,7 @@ struct TAbortFrame
 PACKED;
 
 void ExceptionHandler (u64 nException, TAbortFrame *pFrame);
+int AbortHandler (TAbortFrame *pFrame);		// returns != 0, if resolved
 void InterruptHandler (void);
 
 #if RASPPI >= 4
@@ -149,6 +151,21 @@ extern TFIQData FIQData;
 
 extern uintptr IRQReturnAddress;		// for profiling
 
+#if AARCH == 64
+
+struct TIRQReturnContext			// interrupted context, for profiling
+{
+	u64	pc;
+	u64	fp;				// x29
+	u64	lr;				// x30
+	u64	sp;
+}
+PACKED;
+
+extern TIRQReturnContext IRQReturnContext[CORES];	// one per core
+
+#endif
+
 #ifdef __cplusplus
 }
 #endif
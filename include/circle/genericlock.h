@@ -2,7 +2,7 @@
 // genericlock.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2021-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -56,6 +56,16 @@ public:
 #endif
 	}
 
+	/// \brief Set the name of the lock for the lock statistics (see LOCK_STATISTICS)
+	void SetName (const char *pName)
+	{
+#ifdef NO_BUSY_WAIT
+		m_Mutex.SetName (pName);
+#else
+		m_SpinLock.SetName (pName);
+#endif
+	}
+
 private:
 #ifdef NO_BUSY_WAIT
 	CMutex m_Mutex;
@@ -2,7 +2,7 @@
 // heapallocator.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -21,6 +21,7 @@
 #define _circle_heapallocator_h
 
 #include <circle/spinlock.h>
+#include <circle/metrics.h>
 #include <circle/synchronize.h>
 #include <circle/sysconfig.h>
 #include <circle/macros.h>
@@ -98,6 +99,9 @@ public:
 	void DumpStatus (void);
 #endif
 
+private:
+	static s64 GetFreeSpaceHandler (void *pParam);
+
 private:
 	const char	*m_pHeapName;
 	u8		*m_pNext;
@@ -105,6 +109,7 @@ private:
 	size_t	 	 m_nReserve;
 	THeapBlockBucket m_Bucket[HEAP_BLOCK_MAX_BUCKETS+1];
 	CSpinLock	 m_SpinLock;
+	CMetricGauge	 m_FreeSpaceGauge;
 
 	static u32 s_nBucketSize[];
 };
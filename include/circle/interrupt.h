@@ -2,7 +2,7 @@
 // interrupt.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -22,6 +22,8 @@
 
 #include <circle/bcm2835int.h>
 #include <circle/exceptionstub.h>
+#include <circle/latencyhistogram.h>
+#include <circle/sysconfig.h>
 #include <circle/types.h>
 
 typedef void TIRQHandler (void *pParam);
@@ -68,6 +70,10 @@ private:
 	TIRQHandler	*m_apIRQHandler[IRQ_LINES];
 	void		*m_pParam[IRQ_LINES];
 
+#ifdef LATENCY_HISTOGRAMS
+	CLatencyHistogram *m_pHistogram[IRQ_LINES];	// execution time of the IRQ handlers
+#endif
+
 	static CInterruptSystem *s_pThis;
 };
 
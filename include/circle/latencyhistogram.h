@@ -0,0 +1,114 @@
+//
+// latencyhistogram.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_latencyhistogram_h
+#define _circle_latencyhistogram_h
+
+#include <circle/string.h>
+#include <circle/spinlock.h>
+#include <circle/types.h>
+
+// Each power of two range of values is divided into this number of linear
+// sub-buckets, which gives a maximum relative error of 1/32 (~3%).
+#define LATENCY_HISTOGRAM_SUB_BITS	5
+#define LATENCY_HISTOGRAM_SUB_BUCKETS	(1 << LATENCY_HISTOGRAM_SUB_BITS)
+
+#define LATENCY_HISTOGRAM_MAX_VALUE	0x7FFFFFFFU	// ns (~2.1s), larger values are clamped
+#define LATENCY_HISTOGRAM_BUCKETS	((31 - LATENCY_HISTOGRAM_SUB_BITS + 1) \
+					 * LATENCY_HISTOGRAM_SUB_BUCKETS)
+
+#define LATENCY_HISTOGRAM_NAME_SIZE	24
+
+/// \note All histograms are linked into a global list, which can be dumped with
+///	  CLatencyHistogram::DumpAll() or formatted with CLatencyHistogram::FormatAll().
+/// \note Values are recorded without locking (using atomic operations), so Record() can be
+///	  called from any core and execution level, including FIQ_LEVEL.
+
+class CLatencyHistogram		/// HDR-style histogram of latencies in nanoseconds
+{
+public:
+	/// \param pName Name of the histogram (will be copied)
+	CLatencyHistogram (const char *pName);
+
+	~CLatencyHistogram (void);
+
+	/// \return Name of the histogram
+	const char *GetName (void) const;
+
+	/// \brief Record a latency value
+	/// \param nNanoSeconds Latency in nanoseconds
+	void Record (u32 nNanoSeconds);
+
+	/// \brief Record a latency value, measured with CTracer::GetTimestamp()
+	/// \param nTimestampTicks Latency in ticks of CTracer::GetTimestamp()
+	void RecordTimestampTicks (u64 nTimestampTicks);
+
+	/// \brief Clear all recorded values
+	void Reset (void);
+
+	/// \return Number of recorded values
+	unsigned GetCount (void) const;
+	/// \return Minimum recorded value in nanoseconds (0 if nothing recorded)
+	u32 GetMin (void) const;
+	/// \return Maximum recorded value in nanoseconds
+	u32 GetMax (void) const;
+	/// \return Average of the recorded values in nanoseconds (from the bucket midpoints)
+	u32 GetMean (void) const;
+
+	/// \param nPerMille Requested percentile in 1/1000 (e.g. 500 for p50, 999 for p99.9)
+	/// \return Value in nanoseconds, which is not exceeded by nPerMille of the values
+	u32 GetPercentile (unsigned nPerMille) const;
+
+	/// \brief Write count, min, p50, p99, p99.9 and max to the logger
+	/// \param pSource Source name for the log message
+	void Dump (const char *pSource = "latency") const;
+
+	/// \brief Append count, min, p50, p99, p99.9 and max as one text line
+	/// \param pString String, which receives the line
+	void Format (CString *pString) const;
+
+	/// \brief Write all histograms to the logger
+	static void DumpAll (void);
+
+	/// \brief Append all histograms as a text table
+	/// \param pString String, which receives the table
+	static void FormatAll (CString *pString);
+
+private:
+	static unsigned GetBucket (u32 nValue);
+	static u32 GetBucketLowest (unsigned nBucket);
+	static u32 GetBucketHighest (unsigned nBucket);
+
+	void FormatLine (CString *pLine) const;
+	static void FormatHeader (CString *pString);
+
+private:
+	char m_Name[LATENCY_HISTOGRAM_NAME_SIZE];
+
+	volatile int m_nCount[LATENCY_HISTOGRAM_BUCKETS];
+	volatile int m_nMin;
+	volatile int m_nMax;
+
+	CLatencyHistogram *m_pNext;
+
+	static CLatencyHistogram *s_pFirst;
+	static CSpinLock s_SpinLock;
+};
+
+#endif
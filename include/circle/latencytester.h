@@ -2,7 +2,7 @@
 // latencytester.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2016-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2016-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -22,11 +22,14 @@
 
 #include <circle/interrupt.h>
 #include <circle/spinlock.h>
+#include <circle/latencyhistogram.h>
 #include <circle/types.h>
 
 /// \note CLatencyTester blocks the system timer 1, which is used by the class CUserTimer too.
+/// \note The full distribution of the latencies is recorded in the histograms "irq latency" and
+///	  "fiq latency", which are listed by CLatencyHistogram::DumpAll() too.
 
-class CLatencyTester		/// Measures the IRQ latency of the running code
+class CLatencyTester		/// Measures the IRQ or FIQ latency of the running code
 {
 public:
 	CLatencyTester (CInterruptSystem *pInterruptSystem);
@@ -34,7 +37,9 @@ public:
 
 	/// \brief Start measurement
 	/// \param nSampleRateHZ Sample rate in Hz
-	void Start (unsigned nSampleRateHZ);
+	/// \param bFIQ Measure the FIQ latency instead of the IRQ latency
+	/// \note The FIQ must not be used by someone else, when bFIQ is TRUE.
+	void Start (unsigned nSampleRateHZ, boolean bFIQ = FALSE);
 	/// \brief Stop measurement
 	void Stop (void);
 
@@ -45,6 +50,9 @@ public:
 	/// \return Average IRQ latency in microseconds
 	unsigned GetAvg (void);
 
+	/// \return Histogram of the current (or last) measurement
+	const CLatencyHistogram *GetHistogram (void) const;
+
 	/// \brief Dump results to logger
 	void Dump (void);
 
@@ -56,6 +64,7 @@ private:
 	CInterruptSystem *m_pInterruptSystem;
 
 	boolean m_bRunning;
+	boolean m_bFIQ;
 	unsigned m_nWantedDelay;
 
 	unsigned m_nMinDelay;
@@ -65,6 +74,9 @@ private:
 	unsigned m_nSamples;
 	boolean  m_bOverflow;
 
+	CLatencyHistogram m_IRQHistogram;
+	CLatencyHistogram m_FIQHistogram;
+
 	CSpinLock m_SpinLock;
 };
 
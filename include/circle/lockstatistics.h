@@ -0,0 +1,133 @@
+//
+// lockstatistics.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_lockstatistics_h
+#define _circle_lockstatistics_h
+
+#include <circle/macros.h>
+#include <circle/sysconfig.h>
+#include <circle/types.h>
+
+#define LOCK_STATISTICS_SITES		256		// max. number of lock names and call sites
+#define LOCK_STATISTICS_UNREGISTERED	0xFFFFFFFFU	// lock not acquired yet
+#define LOCK_STATISTICS_OVERFLOW	0xFFFFFFFEU	// table was full on registration
+
+#ifdef ARM_ALLOW_MULTI_CORE
+	#define LOCK_STATISTICS_CORES	CORES
+#else
+	#define LOCK_STATISTICS_CORES	1
+#endif
+
+enum TLockType
+{
+	LockTypeSpinLock,
+	LockTypeMutex,
+	LockTypeUnknown
+};
+
+struct TLockReport
+{
+	const char *pName;		// name of the lock (0 if not set)
+	uintptr nCallSite;		// return address of the (first) Acquire() call
+	TLockType Type;
+	unsigned nAcquires;		// sum of all cores
+	unsigned nContended;		// acquires, which had to wait for the lock
+	u64 nWaitTicks;			// total time spent waiting for the lock
+	u64 nHoldTicks;			// total time the lock was held
+	u64 nMaxHoldTicks;		// maximum time the lock was held once
+};
+
+/// \note The statistics are only recorded, if the system option LOCK_STATISTICS is defined.
+///	  Each lock is registered on its first acquisition. Locks with the same name, or
+///	  without a name, which are first acquired from the same call site, share one
+///	  statistics entry, so that the number of entries does not grow with the number
+///	  of created lock objects. Each core updates its own counters in an entry, without
+///	  locking. No pointers to the lock objects are kept.
+/// \note Times are measured in ticks of CTracer::GetTimestamp() (1 MHz on AArch32). The
+///	  wait time of a CSpinLock is the time spent spinning, of a CMutex the time spent
+///	  blocked.
+/// \note CSpinLock is only instrumented with ARM_ALLOW_MULTI_CORE.
+
+class CLockStatistics	/// Records contention and hold times of CSpinLock and CMutex objects
+{
+public:
+	/// \brief Register a lock (called by the lock, while it is held)
+	/// \param pName Name of the lock (0 if not set, string must remain valid)
+	/// \param nCallSite Return address of the Acquire() call
+	/// \param Type Type of the lock
+	/// \return Site index (LOCK_STATISTICS_OVERFLOW, if the table is full)
+	/// \note Returns the existing entry for this name (or call site, if pName is 0).
+	static unsigned Register (const char *pName, uintptr nCallSite, TLockType Type);
+
+	/// \brief Account an acquisition of a lock (called by the lock, while it is held)
+	/// \param nSite Site index, returned by Register()
+	/// \param bContended Was the lock held by someone else, before it was acquired?
+	/// \param nWaitTicks Time spent waiting for the lock
+	static void Acquired (unsigned nSite, boolean bContended, u64 nWaitTicks);
+
+	/// \brief Account a release of a lock (called by the lock, before it is released)
+	/// \param nSite Site index, returned by Register()
+	/// \param nHoldTicks Time the lock has been held
+	static void Released (unsigned nSite, u64 nHoldTicks);
+
+	/// \brief Clear the counters of all registered locks
+	static void Reset (void);
+
+	/// \brief Get the most contended locks (sorted by wait time, then by acquisitions)
+	/// \param pReport Array, which receives the report entries
+	/// \param nMaxEntries Size of the array
+	/// \return Number of valid entries in pReport
+	static unsigned GetReport (TLockReport *pReport, unsigned nMaxEntries);
+
+	/// \brief Write the most contended locks to the logger
+	/// \param nMaxEntries Maximum number of listed locks
+	static void Dump (unsigned nMaxEntries = 10);
+
+private:
+	static unsigned ThisCore (void);
+
+private:
+	struct TCoreCounters
+	{
+		unsigned nAcquires;
+		unsigned nContended;
+		u64 nWaitTicks;
+		u64 nHoldTicks;
+		u64 nMaxHoldTicks;
+	}
+	ALIGN (64);		// avoid false sharing of cache lines
+
+	struct TSite
+	{
+		volatile boolean bValid;
+		const char *pName;
+		uintptr nCallSite;
+		TLockType Type;
+
+		TCoreCounters Core[LOCK_STATISTICS_CORES];
+	};
+
+	static boolean IsSameSite (const TSite *pSite, const char *pName, uintptr nCallSite,
+				   TLockType Type);
+
+	static TSite s_Site[LOCK_STATISTICS_SITES];
+	static volatile int s_nSites;
+};
+
+#endif
@@ -2,7 +2,7 @@
 /// \file logger.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -33,6 +33,9 @@
 
 #define LOGGER_BUFSIZE		0x4000		///< Size of the text ring buffer
 
+#define LOG_DEFERRED_MAX_ARGS	8		///< Max. number of arguments of a deferred message
+#define LOG_DEFERRED_STRINGS	128		///< Space for source and %s arguments in a record
+
 enum TLogSeverity
 {
 	LogPanic,	///< Halt the system after processing this message
@@ -43,6 +46,8 @@ enum TLogSeverity
 };
 
 struct TLogEvent;
+struct TLogRecord;
+struct TLogRing;
 
 typedef void TLogEventNotificationHandler (void);
 typedef void TLogPanicHandler (void);
@@ -75,8 +80,33 @@ public:
 	void WriteV (const char *pSource, TLogSeverity Severity, const char *pMessage, va_list Args);
 
 	/// \brief Does not allocate memory, for critical (low memory) messages
+	/// \note Is always written immediately, also in deferred mode
 	void WriteNoAlloc (const char *pSource, TLogSeverity Severity, const char *pMessage);
 
+	/// \brief Enable the deferred logging mode
+	/// \param nRecords Number of records in the ring buffer of each core (power of 2)
+	/// \return Operation successful?
+	/// \note In deferred mode Write() and WriteV() only store a binary record (format pointer,\n
+	///	  raw arguments and timestamp) into a ring buffer of the calling core. This path
+	///	  does not allocate memory and does not format the message. Messages are dropped
+	///	  (and counted), when the ring buffer is full.
+	/// \note The messages are formatted and written to the target by Flush(), which has to be
+	///	  called periodically (by CLoggerTask or from the main loop of the application).
+	/// \note Messages with a format string, which is not located in the read-only data of
+	///	  the image (i.e. not a string literal), or with more than LOG_DEFERRED_MAX_ARGS
+	///	  arguments are written immediately. A LogPanic message flushes the pending messages
+	///	  and is written immediately, before the system is halted.
+	/// \note %s arguments are copied into the record and may be truncated.
+	boolean EnableDeferredMode (unsigned nRecords = 64);
+
+	/// \brief Format and write all pending deferred messages to the target
+	/// \return Number of written messages
+	/// \note Does nothing, if the deferred mode is not enabled
+	unsigned Flush (void);
+
+	/// \return Number of messages, which have been dropped in deferred mode
+	unsigned GetDroppedMessages (void) const;
+
 	/// \brief Read log message text from the log text ring buffer
 	/// \param pBuffer Read text is copied to this buffer
 	/// \param nCount  Size of the buffer
@@ -107,7 +137,16 @@ public:
 private:
 	void Write (const char *pString);
 
-	void WriteEvent (const char *pSource, TLogSeverity Severity, const char *pMessage);
+	void WriteMessage (const char *pSource, TLogSeverity Severity, const char *pMessage,
+			   u64 nTimestamp = 0);
+
+	void WriteEvent (const char *pSource, TLogSeverity Severity, const char *pMessage,
+			 u64 nTimestamp = 0);
+
+	boolean WriteDeferred (const char *pSource, TLogSeverity Severity,
+			       const char *pMessage, va_list Args);
+	boolean ReadDeferred (TLogRecord *pRecord);
+	static void FormatRecord (CString *pResult, const TLogRecord *pRecord);
 
 private:
 	unsigned m_nLogLevel;
@@ -126,6 +165,10 @@ private:
 	unsigned m_nEventOutPtr;
 	CSpinLock m_EventSpinLock;
 
+	TLogRing *m_pDeferredRing;			// one ring per core
+	unsigned m_nDeferredRecords;
+	CSpinLock m_DeferredSpinLock;			// serializes readers of the rings
+
 	TLogEventNotificationHandler *m_pEventNotificationHandler;
 	TLogPanicHandler *m_pPanicHandler;
 
@@ -2,7 +2,7 @@
 // memory.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -49,6 +49,10 @@ public:
 
 	size_t GetMemSize (void) const;
 
+#if AARCH == 64
+	CTranslationTable *GetTranslationTable (void) const;	// 0 if MMU is not enabled
+#endif
+
 	static uintptr GetCoherentPage (unsigned nSlot);
 #define COHERENT_SLOT_PROP_MAILBOX	0
 #define COHERENT_SLOT_GPIO_VIRTBUF	1
@@ -62,6 +62,16 @@
 #define MEM_HEAP_START		(MEM_COHERENT_REGION + 4*MEGABYTE)
 #endif
 
+// demand paged region (virtual, 512 MB, not backed by physical memory initially)
+#if RASPPI <= 3
+#define MEM_PAGED_START		0x60000000UL
+#elif RASPPI == 4
+#define MEM_PAGED_START		0x400000000UL
+#else
+#define MEM_PAGED_START		0x800000000UL
+#endif
+#define MEM_PAGED_SIZE		(512 * MEGABYTE)
+
 #if RASPPI >= 4
 // high memory region
 #define MEM_HIGHMEM_START		GIGABYTE
@@ -0,0 +1,156 @@
+//
+// metrics.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_metrics_h
+#define _circle_metrics_h
+
+#include <circle/string.h>
+#include <circle/spinlock.h>
+#include <circle/sysconfig.h>
+#include <circle/macros.h>
+#include <circle/types.h>
+
+#ifdef ARM_ALLOW_MULTI_CORE
+	#define METRICS_CORES	CORES
+#else
+	#define METRICS_CORES	1
+#endif
+
+enum TMetricType
+{
+	MetricTypeCounter,
+	MetricTypeGauge,
+	MetricTypeUnknown
+};
+
+/// \note All metrics are linked into a global registry on construction and are removed from
+///	  it on destruction. CMetric::FormatAll() generates the Prometheus text format of all
+///	  registered metrics (served by CMetricsDaemon).
+/// \note Metrics with the same name (but different label values) are listed as one family.
+/// \note All strings, given to the constructor, must remain valid while the metric exists.
+
+class CMetric		/// Base class of a metric in the global metrics registry
+{
+public:
+	/// \param Type Type of the metric
+	/// \param pName Name of the metric (e.g. "circle_net_rx_frames_total")
+	/// \param pHelp Description of the metric
+	/// \param pLabelName Name of an optional label (e.g. "heap", 0 for none)
+	/// \param pLabelValue Value of the optional label (e.g. "heaplow")
+	CMetric (TMetricType Type, const char *pName, const char *pHelp,
+		 const char *pLabelName = 0, const char *pLabelValue = 0);
+
+	virtual ~CMetric (void);
+
+	TMetricType GetType (void) const	{ return m_Type; }
+	const char *GetName (void) const	{ return m_pName; }
+
+	/// \return Current value of the metric
+	virtual s64 GetValue (void) const = 0;
+
+	/// \brief Append all registered metrics in the Prometheus text format (version 0.0.4)
+	/// \param pString String, which receives the metrics
+	static void FormatAll (CString *pString);
+
+private:
+	void Format (CString *pString, boolean bWithHeader) const;
+
+	static void AppendNumber (CString *pString, s64 nValue);
+
+private:
+	TMetricType m_Type;
+	const char *m_pName;
+	const char *m_pHelp;
+	const char *m_pLabelName;
+	const char *m_pLabelValue;
+
+	CMetric *m_pNext;
+
+	static CMetric *s_pFirst;
+	static CSpinLock s_SpinLock;
+};
+
+/// \note A counter is updated without locking in a separate cache line per core. The values
+///	  of all cores are summed up, when the counter is read.
+
+class CMetricCounter : public CMetric	/// Monotonically increasing counter
+{
+public:
+	CMetricCounter (const char *pName, const char *pHelp,
+			const char *pLabelName = 0, const char *pLabelValue = 0);
+
+	~CMetricCounter (void);
+
+	/// \brief Increment the counter by one (callable from any core and execution level)
+	void Increment (void)			{ Add (1); }
+
+	/// \brief Increment the counter (callable from any core and execution level)
+	/// \param nValue Value to be added
+	void Add (u64 nValue);
+
+	/// \return Sum of the counts of all cores
+	s64 GetValue (void) const override;
+
+private:
+	static unsigned ThisCore (void);
+
+private:
+	struct TCoreCounter
+	{
+		volatile u64 nValue;
+	}
+	ALIGN (64);		// avoid false sharing of cache lines
+
+	TCoreCounter m_Core[METRICS_CORES];
+};
+
+/// \brief Handler, which returns the current value of a gauge
+/// \param pParam User parameter
+typedef s64 TMetricGaugeHandler (void *pParam);
+
+class CMetricGauge : public CMetric	/// Value, which can go up and down
+{
+public:
+	/// \note The value is set with Set() or Add().
+	CMetricGauge (const char *pName, const char *pHelp,
+		      const char *pLabelName = 0, const char *pLabelValue = 0);
+
+	/// \note The value is requested from the handler, when the gauge is read.
+	/// \note The handler is called at TASK_LEVEL with a spin lock held.
+	CMetricGauge (const char *pName, const char *pHelp,
+		      const char *pLabelName, const char *pLabelValue,
+		      TMetricGaugeHandler *pHandler, void *pParam);
+
+	~CMetricGauge (void);
+
+	/// \param nValue New value of the gauge
+	void Set (s64 nValue);
+	/// \param nValue Value to be added to the gauge (may be negative)
+	void Add (s64 nValue);
+
+	s64 GetValue (void) const override;
+
+private:
+	volatile s64 m_nValue;
+
+	TMetricGaugeHandler *m_pHandler;
+	void *m_pParam;
+};
+
+#endif
@@ -0,0 +1,65 @@
+//
+// metricsdaemon.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_net_metricsdaemon_h
+#define _circle_net_metricsdaemon_h
+
+#include <circle/net/httpdaemon.h>
+#include <circle/net/netsubsystem.h>
+#include <circle/net/socket.h>
+#include <circle/types.h>
+
+#define METRICS_PORT			9100
+#define METRICS_MAX_CONTENT_SIZE	32768
+
+/// \note Serves the metrics of the global metrics registry (see CMetric) on path /metrics in
+///	  the Prometheus text format. Create one instance with "new CMetricsDaemon (pNet)".
+
+class CMetricsDaemon : public CHTTPDaemon	/// HTTP server for Prometheus scrapes
+{
+public:
+	/// \param pNetSubSystem Pointer to the network subsystem
+	/// \param nPort TCP port number to listen on
+	/// \param pSocket Is 0 for the first created instance (listener)
+	CMetricsDaemon (CNetSubSystem *pNetSubSystem,
+			u16 nPort = METRICS_PORT,
+			CSocket *pSocket = 0);
+	~CMetricsDaemon (void);
+
+	CHTTPDaemon *CreateWorker (CNetSubSystem *pNetSubSystem, CSocket *pSocket) override;
+
+	THTTPStatus GetContent (const char  *pPath,
+				const char  *pParams,
+				const char  *pFormData,
+				u8	    *pBuffer,
+				unsigned    *pLength,
+				const char **ppContentType) override;
+
+	/// \brief Suppresses the access logging of the scrapes
+	void WriteAccessLog (const CIPAddress	&rRemoteIP,
+			     THTTPRequestMethod	 RequestMethod,
+			     const char		*pRequestURI,
+			     THTTPStatus	 Status,
+			     unsigned		 nContentLength) override;
+
+private:
+	u16 m_nPort;
+};
+
+#endif
@@ -0,0 +1,40 @@
+//
+// loggertask.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_sched_loggertask_h
+#define _circle_sched_loggertask_h
+
+#include <circle/sched/task.h>
+#include <circle/types.h>
+
+class CLoggerTask : public CTask	/// Writes the deferred messages of the system logger
+{
+public:
+	/// \param nIntervalMs Delay between two calls of CLogger::Flush() in milliseconds
+	/// \note CLogger::EnableDeferredMode() has to be called before.
+	CLoggerTask (unsigned nIntervalMs = 10);
+	~CLoggerTask (void);
+
+	void Run (void);
+
+private:
+	unsigned m_nIntervalMs;
+};
+
+#endif
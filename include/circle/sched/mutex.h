@@ -2,7 +2,7 @@
 // mutex.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2021-2025  R. Stange <rsta2@o2online.de>
 //
 // This class was developed by:
 //	Brad Robinson <contact@toptensoftware.com>
@@ -24,6 +24,7 @@
 #define _circle_sched_mutex_h
 
 #include <circle/types.h>
+#include <circle/sysconfig.h>
 #include <circle/sched/synchronizationevent.h>
 
 class CTask;
@@ -41,10 +42,21 @@ public:
 	/// \brief Release the mutex; wake another task, which was waiting for the mutex
 	void Release (void);
 
+	/// \brief Set the name of the mutex for the lock statistics
+	/// \param pName Name of the mutex (string must remain valid)
+	/// \note Has an effect only, if the system option LOCK_STATISTICS is defined.
+	void SetName (const char *pName);
+
 private:
 	CTask* m_pOwningTask;
 	int m_iReentrancyCount;
 	CSynchronizationEvent m_event;
+
+#ifdef LOCK_STATISTICS
+	const char *m_pName;
+	unsigned m_nSite;
+	u64 m_nAcquireTicks;
+#endif
 };
 
 #endif
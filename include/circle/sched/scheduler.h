@@ -2,7 +2,7 @@
 /// \file scheduler.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -21,6 +21,8 @@
 #define _circle_sched_scheduler_h
 
 #include <circle/sched/task.h>
+#include <circle/latencyhistogram.h>
+#include <circle/metrics.h>
 #include <circle/spinlock.h>
 #include <circle/device.h>
 #include <circle/sysconfig.h>
@@ -99,6 +101,10 @@ private:
 	void RemoveTask (CTask *pTask);
 	unsigned GetNextTask (void); // returns index into m_pTask or MAX_TASKS if no task was found
 
+#ifdef LATENCY_HISTOGRAMS
+	static u64 GetWakeTimestamp (unsigned nWakeTicks, unsigned nNowTicks);
+#endif
+
 private:
 	CTask *m_pTask[MAX_TASKS];
 	unsigned m_nTasks;
@@ -113,6 +119,12 @@ private:
 
 	CSpinLock m_SpinLock;
 
+	CMetricGauge m_TaskGauge;
+
+#ifdef LATENCY_HISTOGRAMS
+	CLatencyHistogram m_WakeLatency;	// from waking a task until it runs
+#endif
+
 	static CScheduler *s_pThis;
 };
 
@@ -2,7 +2,7 @@
 // soundbasedevice.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2017-2023  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2017-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -23,6 +23,7 @@
 #include <circle/device.h>
 #include <circle/sound/soundcontroller.h>
 #include <circle/spinlock.h>
+#include <circle/metrics.h>
 #include <circle/types.h>
 #include <assert.h>
 
@@ -52,6 +53,19 @@ enum TSoundFormat			/// All supported formats are interleaved little endian
 
 typedef void TSoundDataCallback (void *pParam);
 
+class CSoundSource		/// Provides the samples for the default GetChunk() (e.g. a mixer)
+{
+public:
+	virtual ~CSoundSource (void) {}
+
+	/// \brief Get the next frames to be sent
+	/// \param nFrames Number of frames requested
+	/// \param pFrames Receives the number of frames returned (1 .. nFrames)
+	/// \return Pointer to the samples (SoundFormatSigned24_32, hardware TX channels)
+	/// \note Called from CSoundBaseDevice::GetChunk() in interrupt context
+	virtual const s32 *GetFrames (unsigned nFrames, unsigned *pFrames) = 0;
+};
+
 /// \note There are two methods to provide the sound samples:\n
 ///	  1. By overloading GetChunk()\n
 ///	  2. By using Write()
@@ -98,6 +112,10 @@ public:
 	/// \note Can be called on any core.
 	unsigned GetHWRXChannels (void) const;
 
+	/// \return Sample rate in Hz
+	/// \note Can be called on any core.
+	unsigned GetSampleRate (void) const;
+
 	/// \return Minium value of one sample
 	/// \note Can be called on any core.
 	virtual int GetRangeMin (void) const;
@@ -136,6 +154,7 @@ public:
 	/// \param Format    Format of sound data used for Write()
 	/// \param nChannels 1 or 2 channels
 	/// \note Not used, if GetChunk() is overloaded.
+	/// \note Selects the sample converter, which is used by Write().
 	void SetWriteFormat (TSoundFormat Format, unsigned nChannels = 2);
 
 	/// \param pBuffer Contains the samples
@@ -164,6 +183,12 @@ public:
 	/// \return TRUE: Have to write right channel first into buffer in GetChunk()
 	boolean AreChannelsSwapped (void) const;
 
+	/// \brief Let the default GetChunk() fetch the samples from a source, instead from Write()
+	/// \param pSource Pointer to the source object (e.g. CSoundMixer, nullptr to detach)
+	/// \note Is called from the constructor and destructor of the source,
+	///	  while the device is not active.
+	void SetSource (CSoundSource *pSource);
+
 	// Input //////////////////////////////////////////////////////////////
 
 	/// \brief Allocate the queue used for Read()
@@ -180,6 +205,7 @@ public:
 	/// \param nChannels 1 or 2 channels
 	/// \param bLeftChannel Return left channel (for nChannels = 1)
 	/// \note Not used, if PutChunk() is overloaded.
+	/// \note Selects the sample converter, which is used by Read().
 	void SetReadFormat (TSoundFormat Format, unsigned nChannels = 2,
 			    boolean bLeftChannel = TRUE);
 
@@ -227,14 +253,27 @@ protected:
 	/// \brief Called from GetChunk() to apply framing on IEC958 samples
 	/// \param nSample 24-bit signed sample value as u32, upper bits don't care
 	/// \param nFrame Number of the IEC958 frame, this sample belongs to (0..191)
+	/// \note Uses a table of the framing bits, which is prepared in Setup().
 	u32 ConvertIEC958Sample (u32 nSample, unsigned nFrame);
 
 private:
+	// converts nSamples samples, which are nFromStep bytes apart in pFrom,
+	// to samples, which are nToStep bytes apart in pTo
+	typedef void TConverter (u8 *pTo, unsigned nToStep,
+				 const u8 *pFrom, unsigned nFromStep,
+				 unsigned nSamples, int nRangeMax);
+
+	static TConverter *GetWriteConverter (TSoundFormat WriteFormat, TSoundFormat HWFormat);
+	static TConverter *GetReadConverter (TSoundFormat HWFormat, TSoundFormat ReadFormat);
+
 	// Output /////////////////////////////////////////////////////////////
 
-	void ConvertSoundFormat (void *pTo, const void *pFrom);
+	void ConvertWriteFrames (u8 *pTo, const u8 *pFrom, unsigned nFrames);
+	void EnqueueWriteFrames (const u8 *pFrom, unsigned nFrames);
 
 	unsigned GetChunkInternal (void *pBuffer, unsigned nChunkSize);
+	void GetSourceChunk (u8 *pBuffer, unsigned nFrames);
+	void ApplyIEC958Framing (u32 *pBuffer, unsigned nChunkSize);
 
 	unsigned GetQueueBytesFree (void);
 	unsigned GetQueueBytesAvail (void);
@@ -243,7 +282,8 @@ private:
 
 	// Input //////////////////////////////////////////////////////////////
 
-	void ConvertReadSoundFormat (void *pTo, const void *pFrom);
+	void ConvertReadFrames (u8 *pTo, const u8 *pFrom, unsigned nFrames);
+	void DequeueReadFrames (u8 *pTo, unsigned nFrames);
 
 	void PutChunkInternal (const void *pBuffer, unsigned nChunkSize);
 
@@ -274,6 +314,11 @@ private:
 	unsigned m_nWriteSampleSize;
 	unsigned m_nWriteFrameSize;
 
+	TConverter *m_pWriteConverter;
+	boolean m_bWriteInterleaved;		// 1:1 channel mapping, convert frames at once
+	unsigned m_nWriteMappedChannels;	// remaining HW channels get null samples
+	unsigned m_WriteChannelMap[SOUND_MAX_CHANNELS];	// write channel per HW channel
+
 	u8 *m_pQueue;			// Ring buffer
 	unsigned m_nInPtr;
 	unsigned m_nOutPtr;
@@ -281,9 +326,18 @@ private:
 	TSoundDataCallback *m_pCallback;
 	void *m_pCallbackParam;
 
+	CSoundSource *m_pSource;
+	TConverter *m_pSourceConverter;		// from SoundFormatSigned24_32
+
+	boolean m_bUnderrun;			// last chunk was not completely filled from queue
+
 	CSpinLock m_SpinLock;
 
 	u8 m_uchIEC958Status[IEC958_STATUS_BYTES];
+	// XOR-ed onto IEC958 subframes with valid parity bit: channel status bit
+	// (inverts parity too) and B frame preamble (4 bits, keeps parity)
+	u32 m_IEC958FrameMask[IEC958_FRAMES_PER_BLOCK];
+	unsigned m_nIEC958MaskedFrames;		// frames with non-zero mask
 
 	// Input //////////////////////////////////////////////////////////////
 
@@ -296,6 +350,12 @@ private:
 	unsigned m_nReadSampleSize;
 	unsigned m_nReadFrameSize;
 
+	TConverter *m_pReadConverter;
+	boolean m_bReadInterleaved;		// 1:1 channel mapping, convert frames at once
+	unsigned m_nReadMappedChannels;		// remaining read channels get null samples
+	unsigned m_ReadChannelMap[SOUND_MAX_CHANNELS];	// HW channel per read channel
+	u8 m_ReadNullSample[SOUND_MAX_SAMPLE_SIZE];
+
 	u8 *m_pReadQueue;		// Ring buffer
 	unsigned m_nReadInPtr;
 	unsigned m_nReadOutPtr;
@@ -304,6 +364,8 @@ private:
 	void *m_pReadCallbackParam;
 
 	CSpinLock m_ReadSpinLock;
+
+	static CMetricCounter s_UnderrunCounter;
 };
 
 #endif
@@ -0,0 +1,145 @@
+//
+// soundengine.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_sound_soundengine_h
+#define _circle_sound_soundengine_h
+
+#include <circle/sound/soundbasedevice.h>
+#include <circle/sysconfig.h>
+#include <circle/spinlock.h>
+#include <circle/types.h>
+
+#define SOUND_ENGINE_MIN_PERIOD_FRAMES	32
+#define SOUND_ENGINE_MAX_PERIOD_FRAMES	4096
+#define SOUND_ENGINE_MAX_PERIODS	4
+
+struct TSoundEngineStats
+{
+	unsigned nPeriodFrames;
+	unsigned nPeriodUsecs;		// duration of one period
+	unsigned nPeriods;		// number of processed periods
+	unsigned nXRuns;		// chunks (partially) filled with silence, because no
+					// period was ready in time (missed deadlines)
+	unsigned nProcessUsecsMin;	// duration of the process callback
+	unsigned nProcessUsecsAvg;
+	unsigned nProcessUsecsMax;
+	unsigned nSlackUsecsMin;	// processed audio, which was still waiting to be sent,
+	unsigned nSlackUsecsAvg;	// when a period was completed (0: deadline missed)
+	unsigned nLoadPercentMax;	// nProcessUsecsMax in percent of nPeriodUsecs
+};
+
+class CSoundEngine : public CSoundSource	/// Callback driven, low-latency sound output
+{
+public:
+	/// \param pBuffer Buffer to be filled with the samples of one period
+	///		   (SoundFormatSigned24_32, hardware TX channels interleaved)
+	/// \param nFrames Number of frames in the period
+	/// \param nChannels Number of channels per frame
+	/// \param pParam User parameter, which was handed over to RegisterProcessCallback()
+	typedef void TProcessCallback (s32 *pBuffer, unsigned nFrames, unsigned nChannels,
+				       void *pParam);
+
+public:
+	/// \param pDevice Sound device, which sends the processed periods
+	/// \param nPeriodFrames Size of one period in frames (32 .. 4096)
+	/// \param nPeriods Number of periods buffered (2: double, 3: triple buffering, max. 4)
+	/// \param nCore 0: process periods from the interrupt handler of the device,\n
+	///		 1..CORES-1: process periods on this core, which must call Run()
+	/// \note The latency is nPeriods periods plus the DMA chunk of the device. Set the
+	///	  chunk size of the device to nPeriodFrames * channels for lowest latency.
+	/// \note The default GetChunk() of the device gets its samples from the engine then.
+	///	  GetChunk() must not be overloaded and Write() must not be used.
+	CSoundEngine (CSoundBaseDevice *pDevice, unsigned nPeriodFrames = 128,
+		      unsigned nPeriods = 2, unsigned nCore = 0);
+
+	~CSoundEngine (void);
+
+	/// \return Operation successful? (memory could be allocated)
+	boolean IsValid (void) const;
+
+	/// \param pCallback Callback, which is called to process one period
+	/// \param pParam User parameter to be handed over to the callback
+	void RegisterProcessCallback (TProcessCallback *pCallback, void *pParam = 0);
+
+	/// \brief Start the device
+	/// \return Operation successful?
+	/// \note The periods are initially filled with silence.
+	boolean Start (void);
+
+	/// \brief Stop the device and let Run() return
+	void Cancel (void);
+
+#ifdef ARM_ALLOW_MULTI_CORE
+	/// \brief Process periods on this core until Cancel() is called
+	/// \note Must be called from CMultiCoreSupport::Run() on the core given to the
+	///	  constructor, the core is dedicated to sound processing then.
+	void Run (void);
+#endif
+
+	/// \param pStats Receives the period timing statistics since Start() or ResetStats()
+	/// \note Can be called on any core.
+	void GetStats (TSoundEngineStats *pStats);
+	/// \note Can be called on any core.
+	void ResetStats (void);
+
+	/// \brief Get the next frames from the current period
+	/// \note Called by CSoundBaseDevice::GetChunk() in interrupt context
+	const s32 *GetFrames (unsigned nFrames, unsigned *pFrames) override;
+
+private:
+	void ProcessPeriod (void);
+
+private:
+	CSoundBaseDevice *m_pDevice;
+	unsigned m_nPeriodFrames;
+	unsigned m_nPeriods;
+	unsigned m_nCore;
+	unsigned m_nChannels;
+	unsigned m_nSampleRate;
+	unsigned m_nPeriodUsecs;
+
+	TProcessCallback *m_pCallback;
+	void *m_pCallbackParam;
+
+	s32 *m_pBuffer;			// [m_nPeriods][m_nPeriodFrames * m_nChannels]
+	s32 *m_pOutput;			// [m_nPeriodFrames * m_nChannels], returned by GetFrames()
+
+	// periods are processed and sent in order (single producer, single consumer)
+	volatile unsigned m_nProduced;	// number of processed periods
+	volatile unsigned m_nConsumed;	// number of completely sent periods
+	volatile unsigned m_nFramesSent; // from processed periods (wraps around)
+	unsigned m_nWritePeriod;	// index of the next period to be processed
+	unsigned m_nReadPeriod;		// index of the period currently sent
+	unsigned m_nReadOffset;		// frames of the current period already sent
+
+	volatile boolean m_bCancel;
+
+	// statistics
+	unsigned m_nStatPeriods;
+	unsigned m_nStatXRuns;
+	unsigned m_nStatProcessMin;
+	unsigned m_nStatProcessMax;
+	u64 m_ullStatProcessSum;
+	unsigned m_nStatSlackMin;
+	u64 m_ullStatSlackSum;
+
+	CSpinLock m_StatsLock;
+};
+
+#endif
@@ -0,0 +1,148 @@
+//
+// soundmixer.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_sound_soundmixer_h
+#define _circle_sound_soundmixer_h
+
+#include <circle/sound/soundbasedevice.h>
+#include <circle/spinlock.h>
+#include <circle/types.h>
+
+#define SOUND_MIXER_MAX_STREAMS		8
+#define SOUND_MIXER_UNITY_GAIN		0x10000		// gain factor 1.0
+
+class CSoundMixerStream		/// A client stream of CSoundMixer
+{
+public:
+	/// \note Use CSoundMixer::AddStream() to create a stream
+	CSoundMixerStream (TSoundFormat Format, unsigned nChannels, unsigned nSampleRate,
+			   unsigned nHWSampleRate, unsigned nQueueFrames);
+
+	~CSoundMixerStream (void);
+
+	/// \param pBuffer Contains the samples
+	/// \param nCount  Size of the buffer in bytes (multiple of frame size)
+	/// \return Number of bytes consumed
+	/// \note Lock-free, can be called on any core, but by one writer at a time only.
+	int Write (const void *pBuffer, size_t nCount);
+
+	/// \return Number of frames, which can be written at the moment
+	unsigned GetQueueFramesFree (void) const;
+	/// \return Number of frames waiting to be mixed
+	unsigned GetQueueFramesAvail (void) const;
+
+	/// \param nGain Gain factor (SOUND_MIXER_UNITY_GAIN is 1.0, max. 4.0)
+	void SetGain (unsigned nGain);
+	/// \return Gain factor (SOUND_MIXER_UNITY_GAIN is 1.0)
+	unsigned GetGain (void) const;
+
+	/// \return Number of mixed frames, for which no samples were available,
+	///	    after the first Write()
+	unsigned GetUnderruns (void) const;
+
+	/// \return Operation successful? (memory could be allocated)
+	boolean IsValid (void) const;
+
+private:
+	// called from CSoundMixer in interrupt context
+	void Mix (s32 *pBuffer, unsigned nFrames, unsigned nHWChannels,
+		  unsigned nLeft, unsigned nRight);
+	friend class CSoundMixer;
+
+	boolean PullFrame (unsigned *pOutPtr, unsigned nInPtr);
+	void SetupResampler (unsigned nSampleRate, unsigned nHWSampleRate);
+
+	static s64 Filter (const s32 *pHistory, const s16 *pCoeffs);
+
+public:
+	static const unsigned Taps = 32;		// of the resampling filter
+	static const unsigned PhaseBits = 9;
+	static const unsigned Phases = 1 << PhaseBits;
+
+private:
+	static const unsigned HistorySize = 1024;	// per channel, > Taps
+
+	TSoundFormat m_Format;
+	unsigned m_nChannels;
+	unsigned m_nSampleSize;
+	unsigned m_nFrameSize;
+
+	s32 *m_pQueue;				// ring buffer of frames (24-bit samples)
+	unsigned m_nQueueSize;			// in frames
+	volatile unsigned m_nInPtr;		// written by Write()
+	volatile unsigned m_nOutPtr;		// written by Mix()
+	volatile boolean m_bStarted;
+
+	volatile unsigned m_nGain;
+	unsigned m_nUnderruns;
+
+	// resampler (only used, if the sample rate differs from the HW sample rate)
+	boolean m_bResample;
+	s16 *m_pCoeffs;				// [Phases][Taps] in Q15
+	u64 m_ullStep;				// input frames per output frame (32.32)
+	u32 m_nPhase;				// fraction of current input position
+	s32 m_History[2][HistorySize];		// input samples per channel (24-bit)
+	unsigned m_nHistoryPos;			// first sample of filter window
+	unsigned m_nHistoryIn;			// next free sample
+};
+
+class CSoundMixer : public CSoundSource	/// Mixes several client streams with different formats and sample rates
+{
+public:
+	/// \param pDevice Sound device, which fetches the mixed samples
+	/// \note The default GetChunk() of the device gets its samples from the mixer then.
+	///	  GetChunk() must not be overloaded and Write() must not be used.
+	CSoundMixer (CSoundBaseDevice *pDevice);
+
+	~CSoundMixer (void);
+
+	/// \param Format      Format of samples given to CSoundMixerStream::Write()
+	/// \param nChannels   1 or 2 channels
+	/// \param nSampleRate Sample rate of this stream in Hz (resampled, if different)
+	/// \param nQueueMsecs Size of the stream queue in milliseconds
+	/// \return Pointer to the new stream, or nullptr on failure
+	CSoundMixerStream *AddStream (TSoundFormat Format, unsigned nChannels = 2,
+				      unsigned nSampleRate = 48000, unsigned nQueueMsecs = 100);
+
+	/// \param pStream Stream to be removed and deleted
+	void RemoveStream (CSoundMixerStream *pStream);
+
+	/// \brief Mix the next frames of all streams
+	/// \param nFrames Number of frames requested
+	/// \param pFrames Receives the number of frames mixed (<= nFrames)
+	/// \return Pointer to the samples (SoundFormatSigned24_32, hardware TX channels)
+	/// \note Called by CSoundBaseDevice::GetChunk() in interrupt context
+	const s32 *GetFrames (unsigned nFrames, unsigned *pFrames) override;
+
+private:
+	CSoundBaseDevice *m_pDevice;
+	unsigned m_nHWChannels;
+	unsigned m_nHWSampleRate;
+	unsigned m_nLeft;			// HW channel index
+	unsigned m_nRight;
+
+	CSoundMixerStream *m_pStream[SOUND_MIXER_MAX_STREAMS];
+
+	static const unsigned BlockFrames = 256;
+	s32 *m_pBuffer;				// [BlockFrames * m_nHWChannels]
+
+	CSpinLock m_SpinLock;
+};
+
+#endif
@@ -2,7 +2,7 @@
 // spinlock.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -39,6 +39,11 @@ public:
 	void Acquire (void);
 	void Release (void);
 
+	/// \brief Set the name of the lock for the lock statistics
+	/// \param pName Name of the lock (string must remain valid)
+	/// \note Has an effect only, if the system option LOCK_STATISTICS is defined.
+	void SetName (const char *pName);
+
 	static void Enable (void);
 
 private:
@@ -46,6 +51,12 @@ private:
 
 	u32 m_nLocked;
 
+#ifdef LOCK_STATISTICS
+	const char *m_pName;
+	unsigned m_nSite;
+	u64 m_nAcquireTicks;
+#endif
+
 	static boolean s_bEnabled;
 };
 
@@ -75,6 +86,10 @@ public:
 		}
 	}
 
+	void SetName (const char *pName)
+	{
+	}
+
 private:
 	unsigned m_nTargetLevel;
 };
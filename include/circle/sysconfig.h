@@ -218,8 +218,10 @@
 // USE_USB_SOF_INTR improves the compatibility with low-/full-speed
 // USB devices. If your application uses such devices, this option
 // should normally be set. Unfortunately this causes a heavily changed
-// system timing, because it triggers up to 8000 IRQs per second. For
-// USB plug-and-play operation this option must be set in any case.
+// system timing, because it triggers up to 8000 IRQs per second, while
+// USB transactions are waiting to be started (the SOF interrupt is
+// disabled otherwise). For USB plug-and-play operation this option
+// must be set in any case.
 // This option has no influence on the Raspberry Pi 4 and 5.
 
 #ifndef NO_USB_SOF_INTR
@@ -255,6 +257,16 @@
 #endif
 #endif
 
+// SCREEN_HW_SCROLL lets the screen device allocate a frame buffer with
+// the double virtual height. The terminal scrolls the whole screen then
+// by moving the visible window in this buffer (virtual offset), instead
+// of copying all pixels. Do not enable this option, if your application
+// accesses the frame buffer of the screen device directly (e.g. with the
+// uGUI or LVGL addon), because the visible window moves with scrolling.
+// The frame buffer needs twice the GPU memory with this option.
+
+//#define SCREEN_HW_SCROLL
+
 // CALIBRATE_DELAY activates the calibration of the delay loop. Because
 // this loop is normally not used any more in Circle, the only use of
 // this option is that the "SpeedFactor" of your system is displayed.
@@ -355,6 +367,10 @@
 #define USB_GADGET_DEVICE_ID_MSD	(USB_GADGET_DEVICE_ID_BASE+2)
 #endif
 
+#ifndef USB_GADGET_DEVICE_ID_NCM
+#define USB_GADGET_DEVICE_ID_NCM	(USB_GADGET_DEVICE_ID_BASE+3)
+#endif
+
 ///////////////////////////////////////////////////////////////////////
 //
 // Other
@@ -382,6 +398,33 @@
 
 //#define USE_LOG_COLORS
 
+// TRACE_SCHEDULER, TRACE_IRQ, TRACE_NET and TRACE_USB enable trace
+// events for task switches, IRQ handlers, sent and received network
+// frames and completed USB requests. These events are recorded, while
+// a CTracer object exists and tracing has been started.
+
+//#define TRACE_SCHEDULER
+//#define TRACE_IRQ
+//#define TRACE_NET
+//#define TRACE_USB
+
+// LOCK_STATISTICS records the number of acquisitions, the wait time and
+// the hold time of CSpinLock (with ARM_ALLOW_MULTI_CORE only), CGenericLock
+// and CMutex objects per lock name or per call site of unnamed locks. The
+// most contended locks can be listed with CLockStatistics::Dump(). This adds
+// overhead to each lock operation. Times have a resolution of 1 microsecond
+// on AArch32, so that short hold and wait times are shown as 0 there.
+
+//#define LOCK_STATISTICS
+
+// LATENCY_HISTOGRAMS records the distribution of the execution time of
+// each IRQ handler, of the latency of the system timer IRQ, of the
+// lateness of kernel timers and of the time from waking a task until it
+// runs. The percentiles can be listed with CLatencyHistogram::DumpAll()
+// or viewed with the webconsole addon (path /latency).
+
+//#define LATENCY_HISTOGRAMS
+
 // SERIAL_GPIO_SELECT selects the TXD GPIO pin used for the serial
 // device (UART0). The RXD pin is (SERIAL_GPIO_SELECT+1). Modifying
 // this setting can be useful for Compute Modules. Select only one
@@ -31,6 +31,11 @@
 
 typedef CDisplay::TColor TTerminalColor;
 
+/// \note The terminal holds the characters on the screen in a cell buffer and renders only
+///	  changed cells into its pixel buffer. If the display memory can hold the pixel buffer
+///	  twice (see CDisplay::GetVirtualHeight()), the whole screen is scrolled by moving the
+///	  virtual offset of the display, instead of updating all pixels.
+
 class CTerminalDevice : public CDevice	/// Terminal support for dot-matrix displays
 {
 public:
@@ -100,26 +105,7 @@ public:
 	/// \note This method allows the direct access to the internal buffer.
 	void SetRawPixel (unsigned nPosX, unsigned nPosY, CDisplay::TRawColor nColor)
 	{
-		switch (m_nDepth)
-		{
-		case 1: {
-				u8 *pBuffer = &m_pBuffer8[(m_nWidth * nPosY + nPosX) / 8];
-				u8 uchMask = 0x80 >> (nPosX & 7);
-				if (nColor)
-				{
-					*pBuffer |= uchMask;
-				}
-				else
-				{
-					*pBuffer &= ~uchMask;
-				}
-			}
-			break;
-
-		case 8:		m_pBuffer8[m_nWidth * nPosY + nPosX] = (u8) nColor;	break;
-		case 16:	m_pBuffer16[m_nWidth * nPosY + nPosX] = (u16) nColor;	break;
-		case 32:	m_pBuffer32[m_nWidth * nPosY + nPosX] = nColor;		break;
-		}
+		SetBufferPixel (nPosX, GetBufferLine (nPosY), nColor);
 	}
 
 	/// \brief Get the raw color value of a pixel
@@ -129,21 +115,7 @@ public:
 	/// \note This method allows the direct access to the internal buffer.
 	CDisplay::TRawColor GetRawPixel (unsigned nPosX, unsigned nPosY)
 	{
-		switch (m_nDepth)
-		{
-		case 1: {
-				u8 *pBuffer = &m_pBuffer8[(m_nWidth * nPosY + nPosX) / 8];
-				u8 uchMask = 0x80 >> (nPosX & 7);
-				return !!(*pBuffer & uchMask);
-			}
-			break;
-
-		case 8:		return m_pBuffer8[m_nWidth * nPosY + nPosX];
-		case 16:	return m_pBuffer16[m_nWidth * nPosY + nPosX];
-		case 32:	return m_pBuffer32[m_nWidth * nPosY + nPosX];
-		}
-
-		return 0;
+		return GetBufferPixel (nPosX, GetBufferLine (nPosY));
 	}
 
 private:
@@ -176,26 +148,99 @@ private:
 
 	void Scroll (void);
 
-	void DisplayChar (char chChar, unsigned nPosX, unsigned nPosY, CDisplay::TRawColor nColor);
+	void SetCell (unsigned nPosX, unsigned nPosY, char chChar,
+		      CDisplay::TRawColor nColor, CDisplay::TRawColor nBackgroundColor);
 	void EraseChar (unsigned nPosX, unsigned nPosY);
+	void EraseRow (unsigned nRow);		// always re-rendered
+	void ClearMargin (unsigned nRow);
 	void InvertCursor (void);
 
+	void Flush (void);			// render and update display
+	void Render (void);			// apply all changes to the pixel buffer
+	void RenderRow (unsigned nRow);
+	void FillLine (unsigned nBufferLine, unsigned nPosX1, unsigned nPosX2,
+		       CDisplay::TRawColor nColor);
+	void UpdateDisplay (void);
+	void UpdateLines (unsigned nBufferLine, unsigned nCount);
+
 private:
-	// We always update entire pixel lines.
-	void SetUpdateArea (unsigned nPosY1, unsigned nPosY2)
+	// The pixel buffer is a ring of m_nHeight lines, which begins with screen line 0
+	// at buffer line m_nPixelOffset. Scrolling the whole screen moves this offset only.
+	unsigned GetBufferLine (unsigned nPosY) const
+	{
+		unsigned nLine = nPosY + m_nPixelOffset;
+
+		return nLine < m_nHeight ? nLine : nLine - m_nHeight;
+	}
+
+	// The cell buffer is a ring of m_nRows rows, which begins with row 0 at m_nFirstRow.
+	unsigned GetBufferRow (unsigned nRow) const
+	{
+		unsigned nBufferRow = nRow + m_nFirstRow;
+
+		return nBufferRow < m_nRows ? nBufferRow : nBufferRow - m_nRows;
+	}
+
+	void SetBufferPixel (unsigned nPosX, unsigned nBufferLine, CDisplay::TRawColor nColor)
 	{
-		if (nPosY1 < m_UpdateArea.y1)
+		switch (m_nDepth)
 		{
-			m_UpdateArea.y1 = nPosY1;
+		case 1: {
+				u8 *pBuffer = &m_pBuffer8[(m_nWidth * nBufferLine + nPosX) / 8];
+				u8 uchMask = 0x80 >> (nPosX & 7);
+				if (nColor)
+				{
+					*pBuffer |= uchMask;
+				}
+				else
+				{
+					*pBuffer &= ~uchMask;
+				}
+			}
+			break;
+
+		case 8:		m_pBuffer8[m_nWidth * nBufferLine + nPosX] = (u8) nColor;	break;
+		case 16:	m_pBuffer16[m_nWidth * nBufferLine + nPosX] = (u16) nColor;	break;
+		case 32:	m_pBuffer32[m_nWidth * nBufferLine + nPosX] = nColor;		break;
 		}
+	}
 
-		if (nPosY2 > m_UpdateArea.y2)
+	CDisplay::TRawColor GetBufferPixel (unsigned nPosX, unsigned nBufferLine)
+	{
+		switch (m_nDepth)
 		{
-			m_UpdateArea.y2 = nPosY2;
+		case 1: {
+				u8 *pBuffer = &m_pBuffer8[(m_nWidth * nBufferLine + nPosX) / 8];
+				u8 uchMask = 0x80 >> (nPosX & 7);
+				return !!(*pBuffer & uchMask);
+			}
+			break;
+
+		case 8:		return m_pBuffer8[m_nWidth * nBufferLine + nPosX];
+		case 16:	return m_pBuffer16[m_nWidth * nBufferLine + nPosX];
+		case 32:	return m_pBuffer32[m_nWidth * nBufferLine + nPosX];
 		}
+
+		return 0;
 	}
 
 private:
+	struct TCell
+	{
+		char		    chChar;		// '\0' for an erased cell
+		boolean		    bOverdrawn;		// by SetPixel()
+		CDisplay::TRawColor nColor;
+		CDisplay::TRawColor nBackgroundColor;
+	};
+
+	struct TRowState
+	{
+		unsigned	    nDirtyFirst;	// columns to be rendered
+		unsigned	    nDirtyLast;		// (clean, if nDirtyFirst > nDirtyLast)
+		boolean		    bClearMargin;	// right margin to be cleared
+		CDisplay::TRawColor nMarginColor;
+	};
+
 	enum TState
 	{
 		StateStart,
@@ -227,7 +272,19 @@ private:
 	unsigned	     m_nUsedWidth;
 	unsigned	     m_nUsedHeight;
 	unsigned	     m_nDepth;
-	CDisplay::TArea	     m_UpdateArea;
+	unsigned	     m_nPixelOffset;	// buffer line of screen line 0
+	u8		    *m_pLineDirty;	// buffer lines to be sent to the display
+	boolean		     m_bHardwareScroll;
+	unsigned	     m_nDisplayOffset;	// current virtual offset of the display
+	TCell		    *m_pCells;		// [m_nRows][m_nColumns]
+	TRowState	    *m_pRowState;	// [m_nRows]
+	unsigned	     m_nRows;
+	unsigned	     m_nColumns;
+	unsigned	     m_nFirstRow;	// buffer row of row 0
+	unsigned	     m_nPendingScroll;	// rows, not yet applied to the pixel buffer
+	boolean		     m_bClearRemainder;	// clear the lines below the last row
+	CDisplay::TRawColor  m_RemainderColor;
+	boolean		     m_bRenderPending;
 	TState	 	     m_State;
 	unsigned	     m_nScrollStart;
 	unsigned	     m_nScrollEnd;
@@ -236,6 +293,8 @@ private:
 	boolean		     m_bCursorOn;
 	boolean		     m_bCursorBlock;
 	boolean		     m_bCursorVisible;
+	unsigned	     m_nCursorPixelX;	// position of the visible cursor
+	unsigned	     m_nCursorPixelY;
 	CDisplay::TRawColor  m_Color;
 	CDisplay::TRawColor  m_BackgroundColor;
 	boolean		     m_bReverseAttribute;
@@ -2,7 +2,7 @@
 /// \file timer.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -25,6 +25,7 @@
 #include <circle/ptrlist.h>
 #include <circle/sysconfig.h>
 #include <circle/spinlock.h>
+#include <circle/latencyhistogram.h>
 #include <circle/types.h>
 
 #define HZ		100			///< ticks per second
@@ -103,6 +104,19 @@ public:
 	/// Current time according to our time zone
 	CString *GetTimeString (void);
 
+	/// \brief Get local time of a past point in time
+	/// \param nClockTicks64 Point in time, as returned by GetClockTicks64() before
+	/// \param pSeconds Seconds will be stored here
+	/// \param pMicroSeconds Microseconds will be stored here (with a resolution of 1/HZ)
+	/// \return FALSE if time is not available (point in time before 1970-01-01 00:00:00)
+	boolean GetLocalTime (u64 nClockTicks64, unsigned *pSeconds, unsigned *pMicroSeconds);
+
+	/// \param nClockTicks64 Point in time, as returned by GetClockTicks64() before
+	/// \return "[MMM dD ]HH:MM:SS.ss" or 0 if Initialize() was not called yet,\n
+	/// resulting CString object must be deleted by caller\n
+	/// Local time of a past point in time (e.g. of a deferred log message)
+	CString *GetTimeString (u64 nClockTicks64);
+
 	/// \brief Starts a kernel timer which elapses after a given delay,\n
 	/// a timer handler gets called then
 	/// \param nDelay	Timer elapses after nDelay/HZ seconds from now
@@ -154,6 +168,8 @@ private:
 
 	void TuneMsDelay (void);
 
+	static CString *FormatTimeString (unsigned nTime, unsigned nTicks);
+
 public:
 	static int IsLeapYear (unsigned nYear);
 	static unsigned GetDaysOfMonth (unsigned nMonth, unsigned nYear);
@@ -184,6 +200,12 @@ private:
 	TPeriodicTimerHandler	*m_pPeriodicHandler[TIMER_MAX_PERIODIC_HANDLERS];
 	volatile unsigned	 m_nPeriodicHandlers;
 
+#ifdef LATENCY_HISTOGRAMS
+	u64			 m_nTickDueTimestamp;		// when the current tick was due
+	CLatencyHistogram	 m_IRQLatency;			// tick due until IRQ handler
+	CLatencyHistogram	 m_KernelTimerLateness;		// timer due until handler called
+#endif
+
 	static CTimer *s_pThis;
 
 	static const unsigned s_nDaysOfMonth[12];
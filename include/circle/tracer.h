@@ -2,8 +2,8 @@
 // tracer.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014  R. Stange <rsta2@o2online.de>
-// 
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
+//
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
 // the Free Software Foundation, either version 3 of the License, or
@@ -20,40 +20,141 @@
 #ifndef _circle_tracer_h
 #define _circle_tracer_h
 
+#include <circle/string.h>
 #include <circle/types.h>
 
+enum TTraceEventType
+{
+	TraceEventInstant,
+	TraceEventBegin,		// begin of a span (on this core)
+	TraceEventEnd,			// end of the last span with the same ID (on this core)
+	TraceEventCounter,		// nParam[0] is the counter value
+	TraceEventUnknown
+};
+
 struct TTraceEntry
 {
-	unsigned nClockTicks;
+	u64 nTimestamp;			// counter ticks (see CTracer::GetTimestampFrequency())
 	unsigned nEventID;
-#define TRACER_EVENT_STOP	0
+#define TRACER_EVENT_STOP		0
+	// system events, enabled with TRACE_* options in include/circle/sysconfig.h
+#define TRACER_EVENT_TASK		0xFFFF0000	// span per task, param: task index
+#define TRACER_EVENT_IRQ		0xFFFF0001	// span per IRQ handler, param: IRQ number
+#define TRACER_EVENT_NET_TX		0xFFFF0002	// param: frame length
+#define TRACER_EVENT_NET_RX		0xFFFF0003	// param: frame length
+#define TRACER_EVENT_USB_REQUEST	0xFFFF0004	// param: status, result length
+	unsigned nType;			// TTraceEventType
 	unsigned nParam[4];
 };
 
-class CTracer
+/// \brief Handler, which writes a chunk of exported trace data (e.g. to a file)
+/// \param pData Pointer to the data
+/// \param nLength Length of the data in bytes
+/// \param pParam User parameter
+/// \return Operation successful?
+typedef boolean TTraceWriteHandler (const void *pData, size_t nLength, void *pParam);
+
+/// \note Each core records its events into an own ring buffer, so that the tracer can be used
+///	  concurrently from all cores and from IRQ and FIQ context without spin locks.
+/// \note The timestamps come from the ARM generic timer in AArch64 mode, which runs
+///	  synchronously on all cores, and from CTimer::GetClockTicks64() (1 MHz) otherwise.
+/// \note ExportChromeTrace() writes the events in the Chrome trace event JSON format, which
+///	  can be loaded into chrome://tracing or https://ui.perfetto.dev. The cores are shown
+///	  as threads there.
+
+class CTracer		/// Collects trace events in per-core ring buffers for debugging
 {
 public:
+	/// \param nDepth Number of entries in the ring buffer of each core
+	/// \param bStopIfFull Stop tracing, when a ring buffer is full (or overwrite oldest entries)
 	CTracer (unsigned nDepth, boolean bStopIfFull);
 	~CTracer (void);
 
+	/// \brief Start (or continue) tracing
 	void Start (void);
+	/// \brief Stop tracing
 	void Stop (void);
 
-	// not reentrant, use spin lock if required
+	/// \brief Record an instant event
+	/// \param nID Event ID (user defined, except TRACER_EVENT_*)
+	/// \param nParam1..4 User defined parameters
 	void Event (unsigned nID, unsigned nParam1 = 0, unsigned nParam2 = 0, unsigned nParam3 = 0, unsigned nParam4 = 0);
 
+	/// \brief Record the begin of a span (e.g. a function call)
+	/// \param nID Event ID of the span
+	/// \param nParam1..2 User defined parameters
+	void Begin (unsigned nID, unsigned nParam1 = 0, unsigned nParam2 = 0);
+	/// \brief Record the end of a span
+	/// \param nID Event ID of the span
+	void End (unsigned nID);
+
+	/// \brief Record the value of a counter
+	/// \param nID Event ID of the counter
+	/// \param nValue Current value of the counter
+	void Counter (unsigned nID, unsigned nValue);
+
+	/// \brief Set the name of an event ID, which is used by ExportChromeTrace()
+	/// \param nID Event ID
+	/// \param pName Name of the event (string must remain valid)
+	/// \return Operation successful? (FALSE if the name table is full)
+	boolean SetEventName (unsigned nID, const char *pName);
+
+	/// \brief Stop tracing and write the recorded events to the logger
 	void Dump (void);
 
+	/// \brief Stop tracing and export the recorded events in Chrome trace event JSON format
+	/// \param pHandler Handler, which writes the exported data in chunks
+	/// \param pParam User parameter, handed over to the handler
+	/// \return Operation successful? (FALSE if the handler returned FALSE)
+	boolean ExportChromeTrace (TTraceWriteHandler *pHandler, void *pParam = 0);
+
+	/// \return Number of events, which could not be recorded, because a ring buffer was full
+	unsigned GetDroppedEvents (void) const;
+
+	/// \return Current timestamp in counter ticks
+	/// \note AArch64 uses the physical counter (19.2 or 54 MHz). AArch32 uses the 1 MHz
+	///	  system timer, so that the resolution is 1 microsecond there and shorter
+	///	  intervals are measured as 0.
+	static u64 GetTimestamp (void);
+	/// \return Frequency of the timestamp counter in Hz
+	static u64 GetTimestampFrequency (void);
+
 	static CTracer *Get (void);
 
 private:
+	void Record (unsigned nType, unsigned nID, unsigned nParam1, unsigned nParam2,
+		     unsigned nParam3, unsigned nParam4);
+
+	const TTraceEntry *GetNextEntry (unsigned *pCore);	// merges the rings by timestamp
+	void Rewind (void);
+
+	const char *GetEventName (unsigned nID, CString *pBuffer) const;
+
+private:
+	struct TRing
+	{
+		TTraceEntry	*pEntry;	// array used as ring buffer
+		unsigned	 nEntries;	// valid entries in ring buffer
+		unsigned	 nCurrent;	// write index into ring buffer
+		unsigned	 nDropped;
+		unsigned	 nRead;		// read count, while exporting
+	};
+
 	unsigned	 m_nDepth;		// size of ring buffer
 	boolean		 m_bStopIfFull;
-	boolean		 m_bActive;
-	unsigned	 m_nStartTicks;
-	TTraceEntry	*m_pEntry;		// array used as ring buffer
-	unsigned	 m_nEntries;		// valid entries in ring buffer
-	unsigned	 m_nCurrent;		// write index into ring buffer
+	volatile boolean m_bActive;
+	u64		 m_nStartTimestamp;
+
+	TRing		*m_pRing;		// one per core
+
+#define TRACER_MAX_EVENT_NAMES	32
+	struct
+	{
+		unsigned	 nID;
+		const char	*pName;
+	}
+	m_EventName[TRACER_MAX_EVENT_NAMES];
+	unsigned	 m_nEventNames;
 
 	static CTracer *s_pThis;
 };
@@ -2,7 +2,7 @@
 // translationtable64.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2016-2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2016-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -37,13 +37,28 @@ public:
 
 	uintptr GetBaseAddress (void) const;
 
+	// Demand paged region (MEM_PAGED_START, MEM_PAGED_SIZE), which is not mapped initially.
+	// Its level 3 table is allocated on the first call of EnablePagedRegion(), which must
+	// have been called, before the methods below are used. Returns FALSE, if out of memory.
+	boolean EnablePagedRegion (void);
+	// Pages are mapped read-only there. Modified entries are invalidated in the TLB.
+	void SetPage (uintptr nVirtualAddress, uintptr nPhysicalAddress);
+	void ClearPage (uintptr nVirtualAddress);
+	// returns previous state of the access flag, an access with AF cleared will fault
+	boolean ClearAccessFlag (uintptr nVirtualAddress);
+	void SetAccessFlag (uintptr nVirtualAddress);
+
 private:
 	TARMV8MMU_LEVEL3_DESCRIPTOR *CreateLevel3Table (uintptr nBaseAddress) NOOPT;
 
+	volatile u64 *GetPagedEntry (uintptr nVirtualAddress);
+	static void InvalidateTLB (uintptr nVirtualAddress);
+
 private:
 	size_t m_nMemSize;
 
 	TARMV8MMU_LEVEL2_DESCRIPTOR *m_pTable;
+	TARMV8MMU_LEVEL3_DESCRIPTOR *m_pPagedTable;
 };
 
 #endif
@@ -2,7 +2,7 @@
 // dwhcidevice.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2022  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -39,6 +39,18 @@
 
 #define DWHCI_WAIT_BLOCKS	DWHCI_MAX_CHANNELS
 
+struct TDWHCIStats
+{
+	unsigned nInterrupts;		// USB interrupts (FIQs with USE_USB_FIQ)
+	unsigned nSOFInterrupts;
+	unsigned nChannelInterrupts;
+	unsigned nCompletions;		// completed URBs
+	unsigned nCompletionIRQs;	// IRQs triggered from FIQ for completions (USE_USB_FIQ)
+	unsigned nSOFIntervalMin;	// between consecutive (micro-)frames in microseconds
+	unsigned nSOFIntervalMax;	// (max-min is the SOF interrupt jitter)
+	unsigned nHandlerTimeMax;	// max. duration of the USB interrupt handler in microseconds
+};
+
 class CDWHCIDevice : public CUSBHostController
 {
 public:
@@ -55,6 +67,11 @@ public:
 
 	void CancelDeviceTransactions (CUSBDevice *pUSBDevice);
 
+	// interrupt rate and timing statistics, to be compared with the IRQ latency
+	// reported by CLatencyTester
+	void GetStats (TDWHCIStats *pStats);
+	void ResetStats (void);
+
 private:
 	boolean DeviceConnected (void);
 	TUSBSpeed GetPortSpeed (void);
@@ -75,6 +92,11 @@ private:
 	void EnableHostInterrupts (void);
 	void EnableChannelInterrupt (unsigned nChannel);
 	void DisableChannelInterrupt (unsigned nChannel);
+#ifdef USE_USB_SOF_INTR
+	// the SOF interrupt is enabled only, while transactions are queued
+	void EnableSOFInterrupt (void);
+	void DisableSOFInterruptIfIdle (void);
+#endif
 
 	void FlushTxFIFO (unsigned nFIFO);
 	void FlushRxFIFO (void);
@@ -95,6 +117,9 @@ private:
 	void StartTransaction (CDWHCITransferStageData *pStageData);
 	void StartChannel (CDWHCITransferStageData *pStageData);
 
+	// calls completion routine or hands the URB over to the IRQ with USE_USB_FIQ
+	void CompleteURB (CUSBRequest *pURB);
+
 	void ChannelInterruptHandler (unsigned nChannel);
 #ifdef USE_USB_SOF_INTR
 	void SOFInterruptHandler (void);
@@ -160,6 +185,12 @@ private:
 #endif
 
 	volatile boolean m_bShutdown;			// USB driver will shutdown
+
+	TDWHCIStats m_Stats;
+#ifdef USE_USB_SOF_INTR
+	u16 m_usLastSOFFrame;
+	unsigned m_nLastSOFTicks;
+#endif
 };
 
 #endif
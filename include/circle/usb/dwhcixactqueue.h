@@ -2,7 +2,7 @@
 // dwhcixactqueue.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2017-2022  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2017-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -49,6 +49,8 @@ public:
 	// dequeue next transaction to be processed at usFrameNumber (or earlier)
 	CDWHCITransferStageData *Dequeue (u16 usFrameNumber);
 
+	boolean IsEmpty (void);
+
 private:
 	CPtrListFIQ m_List;
 
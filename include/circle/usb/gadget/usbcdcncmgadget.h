@@ -0,0 +1,208 @@
+//
+// usbcdcncmgadget.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_usb_gadget_usbcdcncmgadget_h
+#define _circle_usb_gadget_usbcdcncmgadget_h
+
+#include <circle/usb/gadget/dwusbgadget.h>
+#include <circle/usb/gadget/usbcdcncmgadgetendpoint.h>
+#include <circle/usb/usbcdcncm.h>
+#include <circle/usb/usb.h>
+#include <circle/netdevice.h>
+#include <circle/macaddress.h>
+#include <circle/interrupt.h>
+#include <circle/spinlock.h>
+#include <circle/synchronize.h>
+#include <circle/macros.h>
+#include <circle/types.h>
+
+struct TUSBCDCNCMInterfaceDescriptor
+{
+	// header functional descriptor
+	u8	bFunctionLength1;
+	u8	bDescriptorType1;
+	u8	bDescriptorSubtype1;
+	u16	bcdCDC;
+	// union functional descriptor
+	u8	bFunctionLength2;
+	u8	bDescriptorType2;
+	u8	bDescriptorSubtype2;
+	u8	bControlInterface;
+	u8	bSubordinateInterface0;
+	// ethernet networking functional descriptor
+	u8	bFunctionLength3;
+	u8	bDescriptorType3;
+	u8	bDescriptorSubtype3;
+	u8	iMACAddress;
+	u32	bmEthernetStatistics;
+	u16	wMaxSegmentSize;
+	u16	wNumberMCFilters;
+	u8	bNumberPowerFilters;
+	// NCM functional descriptor
+	TNCMFunctionalDescriptor NCM;
+}
+PACKED;
+
+class CUSBCDCNCMGadget : public CDWUSBGadget, public CNetDevice	/// USB CDC-NCM (Ethernet) gadget
+{
+public:
+	/// \param pInterruptSystem Pointer to the interrupt system object
+	CUSBCDCNCMGadget (CInterruptSystem *pInterruptSystem);
+
+	~CUSBCDCNCMGadget (void);
+
+	/// \return Operation successful?
+	/// \param bScanDevices Parameter has no function here
+	/// \note Registers the net device, which can be used, when the USB host has
+	///	  configured the gadget.
+	boolean Initialize (boolean bScanDevices = TRUE) override;
+
+	/// \return Our own MAC address (the host gets another one)
+	const CMACAddress *GetMACAddress (void) const override;
+
+	boolean IsSendFrameAdvisable (void) override;
+
+	/// \note Frames are collected in an NTB, which is sent, when the IN EP is idle
+	///	  and the aggregation timeout has elapsed, or when it is full.
+	boolean SendFrame (const void *pBuffer, unsigned nLength) override;
+
+	/// \note pBuffer must have size FRAME_BUFFER_SIZE
+	boolean ReceiveFrame (void *pBuffer, unsigned *pResultLength) override;
+
+	/// \return TRUE if the USB host has configured the gadget
+	boolean IsLinkUp (void) override;
+
+	/// \param nMicroSeconds Time a frame may be held back in the NTB (default 0)
+	/// \note With 0 the NTB is sent immediately, if the IN EP is idle. Otherwise frames
+	///	  are collected, while the previous NTB is being sent.
+	void SetAggregationTimeout (unsigned nMicroSeconds);
+
+protected:
+	/// \brief Get device-specific descriptor
+	/// \param wValue Parameter from setup packet (descriptor type (MSB) and index (LSB))
+	/// \param wIndex Parameter from setup packet (e.g. language ID for string descriptors)
+	/// \param pLength Pointer to variable, which receives the descriptor size
+	/// \return Pointer to descriptor or nullptr, if not available
+	/// \note May override this to personalize device.
+	const void *GetDescriptor (u16 wValue, u16 wIndex, size_t *pLength) override;
+
+	/// \brief Convert string to UTF-16 string descriptor
+	/// \param pString Pointer to ASCII C-string
+	/// \param pLength Pointer to variable, which receives the descriptor size
+	/// \return Pointer to string descriptor in class-internal buffer
+	const void *ToStringDescriptor (const char *pString, size_t *pLength);
+
+	int OnClassOrVendorRequest (const TSetupData *pSetupData, u8 *pData) override;
+
+private:
+	void AddEndpoints (void) override;
+
+	void CreateDevice (void) override;
+
+	void OnSuspend (void) override;
+
+	// called from CUSBCDCNCMGadgetEndpoint in interrupt context
+	void OnActivate (unsigned nEP);
+	void OnTransferComplete (unsigned nEP, size_t nLength);
+	friend class CUSBCDCNCMGadgetEndpoint;
+
+	// spin lock must be held
+	void StartReceive (void);
+	void SendNTB (void);
+	void UpdateWriter (void);		// after the host changed a parameter
+	void SetupWriter (void);
+	void SendNotification (void);
+
+	void InitMACAddresses (void);
+
+private:
+	enum TEPNumber
+	{
+		EPNotif = 1,
+		EPOut = 2,
+		EPIn  = 3,
+		NumEPs
+	};
+
+	CUSBCDCNCMGadgetEndpoint *m_pEP[NumEPs];
+
+	boolean m_bNetDeviceAdded;
+	volatile boolean m_bActive;		// configured by the host
+
+	CMACAddress m_MACAddress;		// our own address
+	char m_HostMACAddressString[13];	// for the host side (string descriptor)
+
+	// parameters set by the host
+	boolean m_bNTB32;
+	unsigned m_nNTBInSize;
+	unsigned m_nNTBInMaxDatagrams;
+
+	// RX (OUT EP)
+	static const unsigned RxBuffers = 2;
+	u8 *m_pRxBuffer[RxBuffers];
+	volatile unsigned m_nRxLength[RxBuffers];	// 0 if free
+	unsigned m_nRxIn;			// next buffer to receive into
+	unsigned m_nRxOut;			// next buffer to be read
+	volatile boolean m_bRxActive;
+	boolean m_bRxReading;			// m_nRxOut is attached to m_NTBReader
+	CUSBCDCNCMReader m_NTBReader;
+
+	// TX (IN EP)
+	static const unsigned TxBuffers = 2;
+	u8 *m_pTxBuffer[TxBuffers];
+	unsigned m_nTxFill;			// buffer attached to m_NTBWriter
+	volatile boolean m_bTxActive;
+	CUSBCDCNCMWriter m_NTBWriter;
+	boolean m_bWriterUpdate;		// apply new parameters, when the NTB has been sent
+	unsigned m_nWriterNTBSize;		// NTB size, which m_NTBWriter has been set up with
+	unsigned m_nAggregationTimeout;
+	unsigned m_nFirstFrameTicks;		// when the first frame was added to the NTB
+
+	// notifications (interrupt EP)
+	unsigned m_nNotification;		// number of notifications sent
+	DMA_BUFFER (u8, m_NotificationBuffer, 16);
+
+	CSpinLock m_SpinLock;
+
+	u8 m_StringDescriptorBuffer[80];
+
+private:
+	static const TUSBDeviceDescriptor s_DeviceDescriptor;
+
+	struct TUSBCDCNCMGadgetConfigurationDescriptor
+	{
+		TUSBConfigurationDescriptor	Configuration;
+		TUSBInterfaceDescriptor		Interface0;
+		TUSBCDCNCMInterfaceDescriptor	CDCNCMHeader;
+		TUSBEndpointDescriptor		EndpointNotif;
+		TUSBInterfaceDescriptor		Interface1Alt0;
+		TUSBInterfaceDescriptor		Interface1Alt1;
+		TUSBEndpointDescriptor		EndpointOut;
+		TUSBEndpointDescriptor		EndpointIn;
+	}
+	PACKED;
+
+	static const TUSBCDCNCMGadgetConfigurationDescriptor s_ConfigurationDescriptor;
+
+	static const char *const s_StringDescriptor[];
+
+	static const TNCMNTBParameters s_NTBParameters;
+};
+
+#endif
@@ -0,0 +1,50 @@
+//
+// usbcdcncmgadgetendpoint.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_usb_gadget_usbcdcncmgadgetendpoint_h
+#define _circle_usb_gadget_usbcdcncmgadgetendpoint_h
+
+#include <circle/usb/gadget/dwusbgadgetendpoint.h>
+#include <circle/usb/usb.h>
+#include <circle/types.h>
+
+class CUSBCDCNCMGadget;
+
+class CUSBCDCNCMGadgetEndpoint : public CDWUSBGadgetEndpoint	/// Endpoint of the USB CDC-NCM gadget
+{
+public:
+	CUSBCDCNCMGadgetEndpoint (const TUSBEndpointDescriptor *pDesc, CUSBCDCNCMGadget *pGadget);
+	~CUSBCDCNCMGadgetEndpoint (void);
+
+	// the following methods forward to the gadget class, which manages all EPs
+	void OnActivate (void) override;
+
+	void OnTransferComplete (boolean bIn, size_t nLength) override;
+
+private:
+	friend class CUSBCDCNCMGadget;
+
+	// direction depends on the EP, pBuffer must be a DMA buffer
+	void BeginTransfer (void *pBuffer, size_t nLength);
+
+private:
+	CUSBCDCNCMGadget *m_pGadget;
+};
+
+#endif
@@ -4,7 +4,7 @@
 // USB Mass Storage Gadget by Mike Messinides
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2023-2024  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2023-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -198,6 +198,12 @@ private:
 
 	void InitDeviceSize(u64 blocks);
 
+	// ping-pong buffer handling for READ/WRITE (must be called with IRQs disabled)
+	void ResetDataBuffers();
+	void StartDataIn();
+	void StartDataOut();
+	u8 *GetDataBuffer(unsigned nIndex);
+
 private:
 	CDevice *m_pDevice;
 
@@ -234,7 +240,6 @@ private:
 		ReceiveCBW,
 		InvalidCBW,
 		DataIn,
-		DataOut,
 		SentCSW,
 		SendReqSenseReply,
 		DataInRead,
@@ -260,8 +265,20 @@ private:
 	DMA_BUFFER (u8, m_OutBuffer, MaxOutMessageSize);
 	DMA_BUFFER (u8, m_InBuffer, MaxInMessageSize);
 
+	// READ/WRITE data is transferred in chunks of up to MaxBlocksPerTransfer blocks
+	// using two buffers, so that device I/O overlaps with the USB transfer
+	static const unsigned MaxBlocksPerTransfer = 128;	// 64 KByte
+	static const size_t DataBufferSize = MaxBlocksPerTransfer * BLOCK_SIZE;
+	DMA_BUFFER (u8, m_DataBuffer, 2 * DataBufferSize);
+
+	volatile u32 m_nBufferBlocks[2];	// valid blocks in data buffer (0 if free)
+	unsigned m_nDeviceBuffer;		// next buffer for device I/O (task level)
+	unsigned m_nUSBBuffer;			// next buffer for USB transfer
+	volatile boolean m_bUSBActive;		// data transfer on USB is running
+	volatile u32 m_nUSBBlocks;		// blocks still to be transferred on USB
+
 	u32 m_nblock_address;
-	u32 m_nnumber_blocks;
+	volatile u32 m_nnumber_blocks;		// blocks still to be read from/written to device
 	u64 m_nDeviceBlocks=0;
 	u32 m_nbyteCount;
 	boolean m_MSDReady=false;
@@ -2,7 +2,7 @@
 // lan7800.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2018-2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2018-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -26,6 +26,7 @@
 #include <circle/usb/usbrequest.h>
 #include <circle/macaddress.h>
 #include <circle/timer.h>
+#include <circle/spinlock.h>
 #include <circle/types.h>
 
 class CLAN7800Device : public CUSBFunction, CNetDevice
@@ -38,9 +39,14 @@ public:
 
 	const CMACAddress *GetMACAddress (void) const;
 
+	// returns FALSE, if the TX buffers are full
+	boolean IsSendFrameAdvisable (void);
+
+	// frames are batched into one bulk transfer, while the previous transfer is active
 	boolean SendFrame (const void *pBuffer, unsigned nLength);
-	
+
 	// pBuffer must have size FRAME_BUFFER_SIZE
+	// frames are taken from the aggregated bulk transfers in the RX ring
 	boolean ReceiveFrame (void *pBuffer, unsigned *pResultLength);
 
 	// returns TRUE if PHY link is up
@@ -64,11 +70,68 @@ private:
 	boolean WriteReg (u32 nIndex, u32 nValue);
 	boolean ReadReg (u32 nIndex, u32 *pValue);
 
+	struct TRxBuffer;
+	boolean SubmitRxRequests (void);	// m_SpinLock must be held
+	void RxCompletionRoutine (CUSBRequest *pURB, TRxBuffer *pRxBuffer);
+	static void RxCompletionStub (CUSBRequest *pURB, void *pParam, void *pContext);
+
+	boolean StartTxRequest (void);		// m_SpinLock must be held
+	struct TTxBuffer;
+	void TxCompletionRoutine (CUSBRequest *pURB, TTxBuffer *pTxBuffer);
+	static void TxCompletionStub (CUSBRequest *pURB, void *pParam, void *pContext);
+
 private:
 	CUSBEndpoint *m_pEndpointBulkIn;
 	CUSBEndpoint *m_pEndpointBulkOut;
 
 	CMACAddress m_MACAddress;
+
+	// Each RX buffer has an own bulk-in request, which is submitted again, when the buffer
+	// has been read. The requests are submitted in ring order, but only RxMaxActive of them
+	// are passed to the host controller at a time. The DWHCI driver does not serialize
+	// requests on one endpoint, so that concurrent requests would break the data toggle.
+	// The xHCI driver accepts two requests per endpoint.
+	static const unsigned RxBuffers = 4;
+#if RASPPI <= 3
+	static const unsigned RxMaxActive = 1;
+#else
+	static const unsigned RxMaxActive = 2;
+#endif
+	static const unsigned TxBuffers = 2;
+
+	enum TRxBufferState
+	{
+		RxBufferFree,
+		RxBufferActive,			// request has been submitted
+		RxBufferFilled			// request completed, buffer is read by ReceiveFrame()
+	};
+
+	struct TRxBuffer
+	{
+		CUSBRequest	*pURB;
+		u8		*pData;
+		volatile TRxBufferState State;
+		unsigned	 nValid;		// 0 if empty
+		unsigned	 nOffset;		// of the next RX header
+	};
+
+	struct TTxBuffer
+	{
+		u8	 *pData;
+		unsigned nLength;		// 0 if empty
+	};
+
+	TRxBuffer m_RxBuffer[RxBuffers];
+	unsigned m_nRxSubmit;			// buffer which is submitted next
+	unsigned m_nRxOut;			// buffer which is read by ReceiveFrame()
+	volatile unsigned m_nRxActive;		// number of submitted requests
+	volatile boolean m_bShutdown;		// do not submit requests any more
+
+	TTxBuffer m_TxBuffer[TxBuffers];
+	unsigned m_nTxFill;			// buffer which is filled by SendFrame()
+	volatile boolean m_bTxActive;
+
+	CSpinLock m_SpinLock;
 };
 
 #endif
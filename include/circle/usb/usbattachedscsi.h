@@ -0,0 +1,99 @@
+//
+// usbattachedscsi.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_usb_usbattachedscsi_h
+#define _circle_usb_usbattachedscsi_h
+
+#include <circle/usb/usbmassdevice.h>
+#include <circle/usb/usbfunction.h>
+#include <circle/usb/usbendpoint.h>
+#include <circle/types.h>
+
+#define UAS_MAX_COMMANDS	4		// max. number of outstanding tagged commands
+#define UAS_CHUNK_SIZE		0x10000		// max. number of bytes per queued command
+
+/// \note UAS is used on high-speed devices only, which announce it as alternate setting of
+///	  the mass storage interface. On SuperSpeed, UAS requires bulk streams, which are not
+///	  supported by the xHCI driver, so Bulk-Only Transport is used there.
+/// \note Without streams, the device announces with READ READY and WRITE READY IUs on the
+///	  status pipe, which of the outstanding commands transfers its data next.
+/// \note UAS can be disabled with "usbignore=int8-6-62" in the file cmdline.txt.
+
+class CUSBAttachedSCSIDevice : public CUSBBulkOnlyMassStorageDevice	/// USB Attached SCSI driver
+{
+public:
+	CUSBAttachedSCSIDevice (CUSBFunction *pFunction);
+	~CUSBAttachedSCSIDevice (void);
+
+	/// \note Requests are split into chunks of UAS_CHUNK_SIZE, which are queued as tagged
+	///	  commands with up to UAS_MAX_COMMANDS outstanding at a time.
+	int Read (void *pBuffer, size_t nCount);
+	int Write (const void *pBuffer, size_t nCount);
+
+	/// \param pFunction Mass storage interface (Bulk-Only Transport)
+	/// \return Has the interface an UAS alternate setting, which can be used?
+	static boolean IsSupported (CUSBFunction *pFunction);
+
+private:
+	boolean ConfigureEndpoints (void) override;
+
+	int Command (void *pCmdBlk, size_t nCmdBlkLen, void *pBuffer, size_t nBufLen,
+		     boolean bIn) override;
+
+	int Reset (void) override;
+
+	int Transfer (void *pBuffer, size_t nCount, boolean bIn);
+
+	struct TJob;
+	int Execute (TJob *pJob);		// returns number of transferred bytes or < 0
+
+	boolean SendCommandIU (unsigned nTag, const void *pCmdBlk, unsigned nCmdBlkLen);
+	boolean DataTransfer (unsigned nTag);
+
+	void AbortCommands (void);
+
+	boolean ClearHalt (CUSBEndpoint *pEndpoint);
+
+private:
+	boolean m_bInterfaceOK;
+
+	enum TPipe
+	{
+		PipeCommand,
+		PipeStatus,
+		PipeDataIn,
+		PipeDataOut,
+		PipeUnknown
+	};
+
+	CUSBEndpoint *m_pEndpoint[PipeUnknown];
+
+	struct TCommand
+	{
+		boolean	 bActive;
+		boolean	 bIn;
+		boolean	 bDataDone;
+		u8	*pBuffer;
+		size_t	 nLength;
+	};
+
+	TCommand m_Command[UAS_MAX_COMMANDS+1];		// index is tag (0 is not used)
+};
+
+#endif
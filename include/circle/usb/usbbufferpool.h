@@ -0,0 +1,74 @@
+//
+// usbbufferpool.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_usb_usbbufferpool_h
+#define _circle_usb_usbbufferpool_h
+
+#include <circle/spinlock.h>
+#include <circle/types.h>
+
+class CUSBBufferPool	/// Pool of DMA-safe buffers for USB transfers
+{
+public:
+	/// \param nBufferSize Size of each buffer in bytes (rounded up to cache line size)
+	/// \param nBuffers Number of buffers in the pool
+	/// \note Buffers are cache-line aligned and padded and are allocated from
+	///	  HEAP_DMA30, so they can be given to all host controllers without copying.
+	CUSBBufferPool (size_t nBufferSize, unsigned nBuffers);
+
+	~CUSBBufferPool (void);
+
+	/// \return Pool memory successfully allocated?
+	boolean IsValid (void) const;
+
+	/// \return Usable size of each buffer in bytes
+	size_t GetBufferSize (void) const;
+
+	/// \return Pointer to buffer, 0 if the pool is exhausted
+	/// \note Can be called from interrupt context
+	void *Allocate (void);
+
+	/// \param pBuffer Buffer previously returned by Allocate()
+	/// \note Can be called from interrupt context
+	void Free (void *pBuffer);
+
+	/// \return Can the buffer be used for DMA without cache line sharing?
+	static boolean IsDMASafe (const void *pBuffer, size_t nLength);
+
+	/// \return Number of successful allocations since construction
+	unsigned GetAllocations (void) const;
+	/// \return Number of failed allocations (pool exhausted)
+	unsigned GetFailures (void) const;
+
+private:
+	size_t m_nBufferSize;
+	unsigned m_nBuffers;
+
+	u8 *m_pMemory;
+
+	unsigned *m_pFreeStack;		// indices of free buffers
+	unsigned m_nFree;		// number of entries in m_pFreeStack
+
+	unsigned m_nAllocations;
+	unsigned m_nFailures;
+
+	CSpinLock m_SpinLock;
+};
+
+#endif
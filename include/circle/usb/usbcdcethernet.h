@@ -2,7 +2,7 @@
 // usbcdcethernet.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2017-2024  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2017-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -24,10 +24,11 @@
 #include <circle/usb/usbfunction.h>
 #include <circle/usb/usbendpoint.h>
 #include <circle/usb/usbrequest.h>
+#include <circle/usb/usbcdcncm.h>
 #include <circle/macaddress.h>
 #include <circle/types.h>
 
-class CUSBCDCEthernetDevice : public CUSBFunction, CNetDevice
+class CUSBCDCEthernetDevice : public CUSBFunction, CNetDevice	/// CDC-ECM and CDC-NCM driver
 {
 public:
 	CUSBCDCEthernetDevice (CUSBFunction *pFunction);
@@ -37,17 +38,29 @@ public:
 
 	const CMACAddress *GetMACAddress (void) const;
 
+	// with NCM, frames are collected in a NTB, which is sent, when it is full or
+	// when ReceiveFrame() is called and the aggregation timeout has elapsed
 	boolean SendFrame (const void *pBuffer, unsigned nLength);
 
 	// pBuffer must have size FRAME_BUFFER_SIZE
 	boolean ReceiveFrame (void *pBuffer, unsigned *pResultLength);
 
+	// NCM only: time a frame may be held back in the TX NTB (default 0: the NTB is sent
+	// on the next ReceiveFrame(), i.e. once per cycle of the net device layer)
+	void SetAggregationTimeout (unsigned nMicroSeconds);
+
 private:
 	u8 GetMACAddressStringIndex (void);	// returns 0 on error
 
 	boolean InitMACAddress (u8 iMACAddress);
 
+	boolean InitNCM (void);
+	boolean SendNTB (void);
+	boolean ReceiveNTB (void);
+
 private:
+	boolean m_bNCM;
+	u8 m_uchControlInterface;
 	u8 m_iMACAddress;
 	boolean m_bInterfaceOK;
 
@@ -55,6 +68,16 @@ private:
 	CUSBEndpoint *m_pEndpointBulkOut;
 
 	CMACAddress m_MACAddress;
+
+	// NCM only
+	unsigned m_nNTBInSize;
+	unsigned m_nNTBOutSize;
+	u8 *m_pRxNTB;
+	u8 *m_pTxNTB;
+	CUSBCDCNCMReader m_NTBReader;
+	CUSBCDCNCMWriter m_NTBWriter;
+	unsigned m_nAggregationTimeout;
+	unsigned m_nFirstFrameTicks;		// when the first frame was added to the TX NTB
 };
 
 #endif
@@ -0,0 +1,222 @@
+//
+// usbcdcncm.h
+//
+// Definitions and NTB reader/writer for the USB CDC Network Control Model
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _circle_usb_usbcdcncm_h
+#define _circle_usb_usbcdcncm_h
+
+#include <circle/macros.h>
+#include <circle/types.h>
+
+// Class-specific requests
+#define NCM_SET_ETHERNET_PACKET_FILTER	0x43
+#define NCM_GET_NTB_PARAMETERS		0x80
+#define NCM_GET_NTB_FORMAT		0x83
+#define NCM_SET_NTB_FORMAT		0x84
+	#define NCM_NTB_FORMAT_NTB16		0
+	#define NCM_NTB_FORMAT_NTB32		1
+#define NCM_GET_NTB_INPUT_SIZE		0x85
+#define NCM_SET_NTB_INPUT_SIZE		0x86
+
+// Notifications
+#define NCM_NETWORK_CONNECTION		0x00
+#define NCM_CONNECTION_SPEED_CHANGE	0x2A
+
+// Functional descriptors
+#define NCM_FUNCTIONAL_DESCRIPTOR	0x1A
+
+struct TNCMFunctionalDescriptor
+{
+	u8	bFunctionLength;
+	u8	bDescriptorType;
+	u8	bDescriptorSubtype;
+	u16	bcdNcmVersion;
+	u8	bmNetworkCapabilities;
+#define NCM_CAP_NTB_INPUT_SIZE_8	(1 << 5)
+}
+PACKED;
+
+struct TNCMNTBParameters
+{
+	u16	wLength;
+	u16	bmNtbFormatsSupported;
+#define NCM_NTB16_SUPPORTED		(1 << 0)
+#define NCM_NTB32_SUPPORTED		(1 << 1)
+	u32	dwNtbInMaxSize;
+	u16	wNdpInDivisor;
+	u16	wNdpInPayloadRemainder;
+	u16	wNdpInAlignment;
+	u16	wPadding1;
+	u32	dwNtbOutMaxSize;
+	u16	wNdpOutDivisor;
+	u16	wNdpOutPayloadRemainder;
+	u16	wNdpOutAlignment;
+	u16	wNtbOutMaxDatagrams;
+}
+PACKED;
+
+// NCM Transfer Block (NTB) headers
+struct TNCMTransferHeader16
+{
+	u32	dwSignature;
+#define NCM_NTH16_SIGNATURE		0x484D434E	// "NCMH"
+	u16	wHeaderLength;
+	u16	wSequence;
+	u16	wBlockLength;
+	u16	wNdpIndex;
+}
+PACKED;
+
+struct TNCMTransferHeader32
+{
+	u32	dwSignature;
+#define NCM_NTH32_SIGNATURE		0x686D636E	// "ncmh"
+	u16	wHeaderLength;
+	u16	wSequence;
+	u32	dwBlockLength;
+	u32	dwNdpIndex;
+}
+PACKED;
+
+// NCM Datagram Pointer (NDP) tables
+struct TNCMDatagramPointer16
+{
+	u32	dwSignature;
+#define NCM_NDP16_SIGNATURE		0x304D434E	// "NCM0" (without CRC)
+	u16	wLength;
+	u16	wNextNdpIndex;
+	// TNCMDatagramEntry16 follow
+}
+PACKED;
+
+struct TNCMDatagramEntry16
+{
+	u16	wDatagramIndex;
+	u16	wDatagramLength;
+}
+PACKED;
+
+struct TNCMDatagramPointer32
+{
+	u32	dwSignature;
+#define NCM_NDP32_SIGNATURE		0x306D636E	// "ncm0" (without CRC)
+	u16	wLength;
+	u16	wReserved6;
+	u32	dwNextNdpIndex;
+	u32	dwReserved12;
+	// TNCMDatagramEntry32 follow
+}
+PACKED;
+
+struct TNCMDatagramEntry32
+{
+	u32	dwDatagramIndex;
+	u32	dwDatagramLength;
+}
+PACKED;
+
+class CUSBCDCNCMReader		/// Takes the datagrams out of a received NTB16 or NTB32
+{
+public:
+	CUSBCDCNCMReader (void);
+
+	/// \param pNTB Pointer to the received NTB (must be valid, until all datagrams are read)
+	/// \param nLength Number of received bytes
+	/// \return Valid NTB header?
+	boolean SetBlock (const void *pNTB, unsigned nLength);
+
+	/// \param pBuffer The next datagram is copied here
+	/// \param pLength Length of the datagram is returned here
+	/// \param nBufferSize Size of pBuffer, larger datagrams are ignored
+	/// \return Datagram returned (FALSE if the NTB has been completely read)
+	boolean GetDatagram (void *pBuffer, unsigned *pLength, unsigned nBufferSize);
+
+private:
+	boolean NextNDP (void);
+
+private:
+	const u8 *m_pNTB;
+	unsigned m_nLength;		// of the NTB (0 if no block set)
+	boolean m_bNTB32;
+
+	unsigned m_nNDPIndex;		// of the current NDP (0 if none)
+	unsigned m_nNDPLength;
+	unsigned m_nNextNDPIndex;
+	unsigned m_nEntry;		// next entry in the current NDP
+};
+
+class CUSBCDCNCMWriter		/// Collects datagrams into a NTB16 or NTB32 for sending
+{
+public:
+	CUSBCDCNCMWriter (void);
+
+	/// \param pBuffer Buffer for the NTB (32-bit aligned)
+	/// \param nSize Maximum NTB size (dwNtbOutMaxSize, or dwNtbInMaxSize on the device side)
+	/// \param bNTB32 Build a NTB32, instead of a NTB16
+	/// \param nDivisor Datagrams are aligned to (offset % nDivisor == nRemainder)
+	/// \param nRemainder See nDivisor
+	/// \param nAlignment Alignment of the NDP
+	/// \param nMaxDatagrams Maximum number of datagrams per NTB (0 for no limit)
+	void Setup (void *pBuffer, unsigned nSize, boolean bNTB32,
+		    unsigned nDivisor = 4, unsigned nRemainder = 0, unsigned nAlignment = 4,
+		    unsigned nMaxDatagrams = 0);
+
+	/// \return Any datagram added to the current NTB?
+	boolean IsEmpty (void) const		{ return m_nDatagrams == 0; }
+
+	/// \param nLength Length of a datagram
+	/// \return Does a datagram of this length fit into the current NTB?
+	boolean HasRoom (unsigned nLength) const;
+
+	/// \param pData Pointer to the datagram
+	/// \param nLength Length of the datagram
+	/// \return FALSE if the datagram does not fit into the current NTB
+	boolean AddDatagram (const void *pData, unsigned nLength);
+
+	/// \brief Write the NTH and NDP and start a new NTB
+	/// \return Length of the completed NTB (0 if empty)
+	/// \note The NTB must be sent, before the next datagram is added.
+	unsigned Finish (void);
+
+private:
+	unsigned AlignDatagram (unsigned nOffset) const;
+	unsigned GetNDPOffset (void) const;
+	unsigned GetNDPLength (unsigned nDatagrams) const;
+
+private:
+	u8 *m_pBuffer;
+	unsigned m_nSize;
+	boolean m_bNTB32;
+	unsigned m_nDivisor;
+	unsigned m_nRemainder;
+	unsigned m_nAlignment;
+	unsigned m_nMaxDatagrams;
+
+	u16 m_usSequence;
+
+	unsigned m_nOffset;		// next free byte
+	unsigned m_nDatagrams;
+
+	static const unsigned MaxDatagrams = 64;
+	u32 m_DatagramIndex[MaxDatagrams];
+	u32 m_DatagramLength[MaxDatagrams];
+};
+
+#endif
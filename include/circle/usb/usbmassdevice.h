@@ -2,7 +2,7 @@
 // usbmassdevice.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2022  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -22,6 +22,7 @@
 
 #include <circle/usb/usbfunction.h>
 #include <circle/usb/usbendpoint.h>
+#include <circle/usb/usbrequest.h>
 #include <circle/fs/partitionmanager.h>
 #include <circle/numberpool.h>
 #include <circle/types.h>
@@ -30,7 +31,10 @@
 #define UMSD_BLOCK_MASK		(UMSD_BLOCK_SIZE-1)
 #define UMSD_BLOCK_SHIFT	9
 
-#define UMSD_MAX_OFFSET		0x1FFFFFFFFFFULL		// 2TB
+#define UMSD_MAX_OFFSET_10	0x1FFFFFFFFFFULL		// 2TB with 10-byte CDBs
+
+#define UMSD_MAX_TRANSFER_BLOCKS	0xFFFF			// per command
+#define UMSD_MAX_TRANSFER_SIZE		(UMSD_MAX_TRANSFER_BLOCKS << UMSD_BLOCK_SHIFT)
 
 class CUSBBulkOnlyMassStorageDevice : public CUSBFunction
 {
@@ -46,22 +50,50 @@ public:
 	u64 Seek (u64 ullOffset);
 
 	u64 GetSize (void) const;		// in bytes
-	unsigned GetCapacity (void) const;	// in blocks
+	unsigned GetCapacity (void) const;	// in blocks (0xFFFFFFFF if capacity is greater)
+
+	// scatter-gather READ or WRITE at the current offset (Bulk-Only Transport only):
+	// the data stage is done with pURB, which must be set up for GetBulkEndpoint() of the
+	// respective direction and may have multiple segments (see CUSBRequest::AddSegment()),
+	// the length must be a multiple of the block size (no retries on failure),
+	// returns resulting length or < 0 on failure
+	int TransferSegments (CUSBRequest *pURB);
+
+	// returns 0 with USB Attached SCSI
+	CUSBEndpoint *GetBulkEndpoint (boolean bIn) const;
+
+protected:
+	virtual boolean ConfigureEndpoints (void);
+
+	// returns resulting length or < 0 on failure
+	virtual int Command (void *pCmdBlk, size_t nCmdBlkLen, void *pBuffer, size_t nBufLen,
+			     boolean bIn);
+
+	virtual int Reset (void);
+
+	// set-up READ or WRITE command block for nCount bytes at ullOffset (16 bytes max.)
+	// returns the length of the command block or 0 if the request is invalid
+	unsigned SetupReadWriteCommand (void *pCmdBlk, u64 ullOffset, size_t nCount,
+					boolean bWrite) const;
+
+	u64 GetOffset (void) const		{ return m_ullOffset; }
 
 private:
 	int TryRead (void *pBuffer, size_t nCount);
 	int TryWrite (const void *pBuffer, size_t nCount);
 
-	int Command (void *pCmdBlk, size_t nCmdBlkLen, void *pBuffer, size_t nBufLen, boolean bIn);
+	boolean ReadCapacity16 (void);
 
-	int Reset (void);
+	boolean CommandStage (void *pCmdBlk, size_t nCmdBlkLen, size_t nBufLen, boolean bIn);
+	boolean StatusStage (void);
 
 private:
 	CUSBEndpoint *m_pEndpointIn;
 	CUSBEndpoint *m_pEndpointOut;
 
 	unsigned m_nCWBTag;
-	unsigned m_nBlockCount;
+	u64 m_ullBlockCount;
+	boolean m_bUse16ByteCDB;		// READ(16)/WRITE(16) for disks > 2TB
 	u64 m_ullOffset;
 
 	CPartitionManager *m_pPartitionManager;
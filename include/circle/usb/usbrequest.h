@@ -2,7 +2,7 @@
 // usbrequest.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2022  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -23,6 +23,7 @@
 #include <circle/usb/usb.h>
 #include <circle/usb/usbendpoint.h>
 #include <circle/classallocator.h>
+#include <circle/metrics.h>
 #include <circle/types.h>
 
 class CUSBRequest;
@@ -33,6 +34,7 @@ class CUSBRequest		// URB
 {
 public:
 	static const unsigned MaxIsoPackets = 32;
+	static const unsigned MaxSegments = 8;
 
 public:
 	CUSBRequest (CUSBEndpoint *pEndpoint, void *pBuffer, u32 nBufLen, TSetupData *pSetupData = 0);
@@ -60,10 +62,34 @@ public:
 	void SetCompletionRoutine (TURBCompletionRoutine *pRoutine, void *pParam, void *pContext);
 	void CallCompletionRoutine (void);
 
+	// for host controllers, which complete the stages of a control request separately:
+	// an intermediate stage is not counted as completed request, unless it failed
+	void SetIntermediateStage (boolean bIntermediate);
+
 	// do not retry if request cannot be served immediately (for Bulk in only)
 	void SetCompleteOnNAK (void);
 	boolean IsCompleteOnNAK (void) const;
-	
+
+	// scatter-gather transfers (for Bulk and Interrupt only), the buffer given to the
+	// constructor (if any) is the first segment, buffers should be cache-line aligned
+	void AddSegment (void *pBuffer, u32 nLength);
+	unsigned GetNumSegments (void) const;
+	void *GetSegmentBuffer (unsigned nSegment);
+	u32 GetSegmentLength (unsigned nSegment) const;
+
+	// for host controllers without scatter-gather support: copies the segments into
+	// a contiguous DMA buffer, which is returned by GetBuffer() afterwards
+	// (received data is copied back before the completion routine is called,
+	//  the data to be sent is gathered again on each submission of the request)
+	boolean Linearize (void);
+
+	// statistics for benchmarking (buffer allocations and bytes copied for this transfer)
+	unsigned GetBufferAllocations (void) const;
+	u32 GetBytesCopied (void) const;
+
+private:
+	void CopyBackLinearized (void);
+
 private:
 	CUSBEndpoint *m_pEndpoint;
 	
@@ -83,6 +109,18 @@ private:
 	void *m_pCompletionContext;
 
 	boolean m_bCompleteOnNAK;
+	boolean m_bIntermediateStage;
+
+	unsigned    m_nNumSegments;
+	void	   *m_pSegmentBuffer[MaxSegments];
+	u32	    m_nSegmentLength[MaxSegments];
+	u8	   *m_pLinearBuffer;
+
+	unsigned    m_nBufferAllocations;
+	u32	    m_nBytesCopied;
+
+	static CMetricCounter s_RequestCounter;
+	static CMetricCounter s_ErrorCounter;
 
 	DECLARE_CLASS_ALLOCATOR
 };
@@ -2,7 +2,7 @@
 // usbsubsystem.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2023-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -49,6 +49,10 @@ public:
 
 	boolean IsPlugAndPlay (void) const;
 
+	/// \param nDevice 0 or 1
+	/// \return Pointer to xHCI device (e.g. to tune interrupt moderation), 0 if not available
+	CXHCIDevice *GetXHCIDevice (unsigned nDevice);
+
 	static boolean IsActive (void);
 
 	static CUSBSubSystem *Get (void);
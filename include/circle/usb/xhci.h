@@ -334,6 +334,7 @@ PACKED;
 
 // Link TRB
 #define XHCI_LINK_TRB_CONTROL_TC				(1 << 1)
+#define XHCI_LINK_TRB_CONTROL_CH				(1 << 4)
 
 // Event TRB
 #define XHCI_EVENT_TRB_STATUS_COMPLETION_CODE__SHIFT		24
@@ -374,6 +375,7 @@ PACKED;
 #define XHCI_CMD_TRB_SET_TR_DEQUEUE_PTR_CONTROL_SLOTID__SHIFT	24
 
 // Transfer TRB
+#define XHCI_TRANSFER_TRB_STATUS_TRB_LENGTH__MASK		0x1FFFF
 #define XHCI_TRANSFER_TRB_STATUS_TD_SIZE__SHIFT			17
 #define XHCI_TRANSFER_TRB_STATUS_TD_SIZE__MASK			(0x1F << 17)
 #define XHCI_TRANSFER_TRB_STATUS_INTERRUPTER_TARGET__SHIFT	22
@@ -387,6 +389,7 @@ PACKED;
 	#define XHCI_TRANSFER_TRB_CONTROL_TRT_IN			3
 
 #define XHCI_TRANSFER_TRB_CONTROL_ISP				(1 << 2)
+#define XHCI_TRANSFER_TRB_CONTROL_CH				(1 << 4)
 #define XHCI_TRANSFER_TRB_CONTROL_IOC				(1 << 5)
 #define XHCI_TRANSFER_TRB_CONTROL_IDT				(1 << 6)
 #define XHCI_TRANSFER_TRB_CONTROL_DIR_IN			(1 << 16)
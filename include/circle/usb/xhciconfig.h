@@ -2,7 +2,7 @@
 // xhciconfig.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2019-2023  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2019-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -62,7 +62,9 @@
 #define XHCI_CONFIG_CMD_RING_SIZE	64
 #define XHCI_CONFIG_TRANSFER_RING_SIZE	64
 
-#define XHCI_CONFIG_IMODI		500		// defines maximum interrupt rate
+// defaults, can be changed at runtime with CXHCIDevice::SetInterruptModeration()
+// and CXHCIDevice::SetMaxEventsPerInterrupt()
+#define XHCI_CONFIG_IMODI		500		// defines maximum interrupt rate (250ns units)
 
 #define XHCI_CONFIG_MAX_EVENTS_PER_INTR	16		// max. events to be handled per interrupt
 
@@ -2,7 +2,7 @@
 // xhcidevice.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2019-2023  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2019-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -50,6 +50,21 @@ public:
 	boolean SubmitBlockingRequest (CUSBRequest *pURB, unsigned nTimeoutMs = USB_TIMEOUT_NONE);
 	boolean SubmitAsyncRequest (CUSBRequest *pURB, unsigned nTimeoutMs = USB_TIMEOUT_NONE);
 
+	// Interrupt moderation (can be changed at runtime):
+	// A lower interval reduces the latency of transfer completions (e.g. for
+	// isochronous endpoints), a higher interval reduces the interrupt load
+	// with high bulk throughput.
+
+	// nNanoSeconds is the minimum interval between interrupts (max. 16383750,
+	// 250ns resolution, 0 to disable, default XHCI_CONFIG_IMODI * 250ns)
+	void SetInterruptModeration (unsigned nNanoSeconds);
+	// max. number of events handled per interrupt (default XHCI_CONFIG_MAX_EVENTS_PER_INTR)
+	void SetMaxEventsPerInterrupt (unsigned nEvents);
+
+	// event rate and interrupt handler time counters
+	void GetEventStats (TXHCIEventStats *pStats);
+	void ResetEventStats (void);
+
 public:
 	CXHCIMMIOSpace *GetMMIOSpace (void);
 	CXHCISlotManager *GetSlotManager (void);
@@ -2,7 +2,7 @@
 // xhciendpoint.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2019-2024  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2019-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -48,7 +48,7 @@ public:
 	boolean Transfer (CUSBRequest *pURB, unsigned nTimeoutMs);
 	boolean TransferAsync (CUSBRequest *pURB, unsigned nTimeoutMs);
 
-	void TransferEvent (u8 uchCompletionCode, u32 nTransferLength);
+	void TransferEvent (TXHCITRB *pTransferTRB, u8 uchCompletionCode, u32 nTransferLength);
 
 	boolean ResetFromHalted (void);
 
@@ -63,6 +63,14 @@ private:
 	boolean EnqueueTRB (u32 nControl, u32 nStatus = 0,
 			    u32 nParameter1 = 0, u32 nParameter2 = 0);
 
+	// maps the segments of a bulk or interrupt URB to a TD of chained Normal TRBs
+	boolean EnqueueNormalTD (CUSBRequest *pURB);
+	static unsigned GetNormalTRBCount (CUSBRequest *pURB);
+
+	// returns the number of bytes transferred in the TD, -1 if pTransferTRB is not part of it
+	int GetNormalTDResultLength (TXHCITRB *pFirstTRB, TXHCITRB *pLastTRB,
+				     TXHCITRB *pTransferTRB, u32 nTransferLength);
+
 	TXHCIInputContext *GetInputContextSetMaxPacketSize (void);
 	TXHCIInputContext *GetInputContextConfigureEndpoint (void);
 	void FreeInputContext (void);
@@ -87,6 +95,8 @@ private:
 	u8		 m_uchEndpointType;
 
 	CUSBRequest	*m_pURB[2];
+	TXHCITRB	*m_pFirstTRB[2];		// TD of bulk or interrupt URB
+	TXHCITRB	*m_pLastTRB[2];
 	volatile boolean m_bTransferCompleted;
 
 	u8		*m_pInputContextBuffer;
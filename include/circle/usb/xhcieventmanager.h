@@ -2,7 +2,7 @@
 // xhcieventmanager.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2019-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2019-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -27,17 +27,43 @@
 
 class CXHCIDevice;
 
+struct TXHCIEventStats		// counters of an interrupter
+{
+	unsigned nInterrupts;
+	unsigned nEvents;			// all event TRBs
+	unsigned nTransferEvents;
+	unsigned nMaxEventsPerInterrupt;
+	unsigned nBudgetExhausted;		// events left on ring after interrupt
+	unsigned nMaxHandlerTime;		// in microseconds
+	u64	 nTotalHandlerTime;		// in microseconds
+};
+
 class CXHCIEventManager		/// xHC event handling for the xHCI driver
 {
 public:
-	CXHCIEventManager (CXHCIDevice *pXHCIDevice);
+	CXHCIEventManager (CXHCIDevice *pXHCIDevice, unsigned nInterrupter = 0);
 	~CXHCIEventManager (void);
 
 	boolean IsValid (void);
 
+	// called from interrupt handler
+	void AcknowledgeInterrupt (void);
+	// handles up to the max. number of events, called from interrupt handler
+	void ProcessEvents (void);
+
 	// returns next event dequeue TRB or 0 if event ring is empty
 	TXHCITRB *HandleEvents (void);
 
+	// nInterval is in 250ns units (0 to disable interrupt moderation)
+	void SetModerationInterval (unsigned nInterval);
+	unsigned GetModerationInterval (void) const;
+
+	void SetMaxEventsPerInterrupt (unsigned nEvents);
+	unsigned GetMaxEventsPerInterrupt (void) const;
+
+	void GetStats (TXHCIEventStats *pStats) const;
+	void ResetStats (void);
+
 #ifndef NDEBUG
 	void DumpStatus (void);
 #endif
@@ -45,8 +71,14 @@ public:
 private:
 	CXHCIDevice	*m_pXHCIDevice;
 	CXHCIMMIOSpace	*m_pMMIO;
+	unsigned	 m_nInterrupter;
 	CXHCIRing	 m_EventRing;
 	TXHCIERSTEntry	*m_pERST;
+
+	unsigned	 m_nModerationInterval;
+	unsigned	 m_nMaxEventsPerInterrupt;
+
+	TXHCIEventStats	 m_Stats;
 };
 
 #endif
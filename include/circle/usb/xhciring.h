@@ -2,7 +2,7 @@
 // xhciring.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2019-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -50,6 +50,9 @@ public:
 	TXHCITRB *IncrementDequeue (void);	// returns next dequeue TRB
 	void IncrementEnqueue (void);
 
+	// returns TRB following pTRB, skips the Link TRB (transfer and command ring only)
+	TXHCITRB *GetNextTRB (TXHCITRB *pTRB);
+
 	u32 GetCycleState (void) const;
 
 #ifndef NDEBUG
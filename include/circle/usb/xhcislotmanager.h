@@ -2,7 +2,7 @@
 // xhcislotmanager.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2019-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -45,7 +45,7 @@ public:
 #endif
 
 private:
-	void TransferEvent (u8 uchCompletionCode, u32 nTransferLength,
+	void TransferEvent (TXHCITRB *pTransferTRB, u8 uchCompletionCode, u32 nTransferLength,
 			    u8 uchSlotID, u8 uchEndpointID);
 	friend class CXHCIEventManager;
 
@@ -5,7 +5,7 @@
 //	Copyright (C) 2021  Stephane Damo
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -22,11 +22,293 @@
 //
 #include <circle/2dgraphics.h>
 #include <circle/screen.h>
+#include <circle/timer.h>
 #include <circle/util.h>
 #include <assert.h>
 
 #define PTR_ADD(type, ptr, bytes)	((type) ((uintptr) (ptr) + (bytes)))
 
+#define DIRTY_AREA_OVERHEAD	512	// estimated cost of an additional area in pixels
+
+#define AREA_PIXELS(area)	(((area).x2 - (area).x1 + 1) * ((area).y2 - (area).y1 + 1))
+
+#if    (defined (__ARM_NEON) || defined (__ARM_NEON__)) \
+    && STDLIB_SUPPORT >= 1
+	#define GRAPHICS_NEON
+	#include <arm_neon.h>
+#endif
+
+//// Span kernels //////////////////////////////////////////////////////////////
+
+// The pixel type T is u8, u16 or u32 for a depth of 8, 16 or 32 bits.
+
+template <typename T>
+static inline void FillSpan (T *pTo, T Color, unsigned nCount)
+{
+	while (nCount--)
+	{
+		*pTo++ = Color;
+	}
+}
+
+template <>
+inline void FillSpan<u8> (u8 *pTo, u8 Color, unsigned nCount)
+{
+	memset (pTo, Color, nCount);
+}
+
+#ifdef GRAPHICS_NEON
+
+template <>
+inline void FillSpan<u16> (u16 *pTo, u16 Color, unsigned nCount)
+{
+	uint16x8_t vColor = vdupq_n_u16 (Color);
+	for (; nCount >= 16; nCount -= 16, pTo += 16)
+	{
+		vst1q_u16 (pTo, vColor);
+		vst1q_u16 (pTo + 8, vColor);
+	}
+
+	while (nCount--)
+	{
+		*pTo++ = Color;
+	}
+}
+
+template <>
+inline void FillSpan<u32> (u32 *pTo, u32 Color, unsigned nCount)
+{
+	uint32x4_t vColor = vdupq_n_u32 (Color);
+	for (; nCount >= 8; nCount -= 8, pTo += 8)
+	{
+		vst1q_u32 (pTo, vColor);
+		vst1q_u32 (pTo + 4, vColor);
+	}
+
+	while (nCount--)
+	{
+		*pTo++ = Color;
+	}
+}
+
+#endif
+
+template <typename T>
+static inline void CopySpanTransparent (T *pTo, const T *pFrom, unsigned nCount,
+					T TransparentColor)
+{
+	for (; nCount--; pTo++, pFrom++)
+	{
+		if (*pFrom != TransparentColor)
+		{
+			*pTo = *pFrom;
+		}
+	}
+}
+
+#ifdef GRAPHICS_NEON
+
+// the destination is loaded and stored back, where the source is transparent
+
+template <>
+inline void CopySpanTransparent<u8> (u8 *pTo, const u8 *pFrom, unsigned nCount,
+				     u8 TransparentColor)
+{
+	uint8x16_t vTransparent = vdupq_n_u8 (TransparentColor);
+	for (; nCount >= 16; nCount -= 16, pTo += 16, pFrom += 16)
+	{
+		uint8x16_t vFrom = vld1q_u8 (pFrom);
+		uint8x16_t vMask = vceqq_u8 (vFrom, vTransparent);
+		vst1q_u8 (pTo, vbslq_u8 (vMask, vld1q_u8 (pTo), vFrom));
+	}
+
+	for (; nCount--; pTo++, pFrom++)
+	{
+		if (*pFrom != TransparentColor)
+		{
+			*pTo = *pFrom;
+		}
+	}
+}
+
+template <>
+inline void CopySpanTransparent<u16> (u16 *pTo, const u16 *pFrom, unsigned nCount,
+				      u16 TransparentColor)
+{
+	uint16x8_t vTransparent = vdupq_n_u16 (TransparentColor);
+	for (; nCount >= 8; nCount -= 8, pTo += 8, pFrom += 8)
+	{
+		uint16x8_t vFrom = vld1q_u16 (pFrom);
+		uint16x8_t vMask = vceqq_u16 (vFrom, vTransparent);
+		vst1q_u16 (pTo, vbslq_u16 (vMask, vld1q_u16 (pTo), vFrom));
+	}
+
+	for (; nCount--; pTo++, pFrom++)
+	{
+		if (*pFrom != TransparentColor)
+		{
+			*pTo = *pFrom;
+		}
+	}
+}
+
+template <>
+inline void CopySpanTransparent<u32> (u32 *pTo, const u32 *pFrom, unsigned nCount,
+				      u32 TransparentColor)
+{
+	uint32x4_t vTransparent = vdupq_n_u32 (TransparentColor);
+	for (; nCount >= 4; nCount -= 4, pTo += 4, pFrom += 4)
+	{
+		uint32x4_t vFrom = vld1q_u32 (pFrom);
+		uint32x4_t vMask = vceqq_u32 (vFrom, vTransparent);
+		vst1q_u32 (pTo, vbslq_u32 (vMask, vld1q_u32 (pTo), vFrom));
+	}
+
+	for (; nCount--; pTo++, pFrom++)
+	{
+		if (*pFrom != TransparentColor)
+		{
+			*pTo = *pFrom;
+		}
+	}
+}
+
+#endif
+
+// nAlpha is 0..256, each byte is blended: To = (Color * nAlpha + To * (256-nAlpha)) / 256
+static void BlendSpan (u32 *pTo, u32 Color, unsigned nCount, unsigned nAlpha)
+{
+	unsigned nInvAlpha = 256 - nAlpha;
+
+#ifdef GRAPHICS_NEON
+	// two pixels per vector of eight 16-bit lanes
+	uint16x8_t vColor = vmulq_n_u16 (vmovl_u8 (vreinterpret_u8_u32 (vdup_n_u32 (Color))),
+					 nAlpha);
+	for (; nCount >= 4; nCount -= 4, pTo += 4)
+	{
+		uint8x16_t vTo = vld1q_u8 (reinterpret_cast<u8 *> (pTo));
+		uint16x8_t vLow = vmlaq_n_u16 (vColor, vmovl_u8 (vget_low_u8 (vTo)), nInvAlpha);
+		uint16x8_t vHigh = vmlaq_n_u16 (vColor, vmovl_u8 (vget_high_u8 (vTo)), nInvAlpha);
+		vst1q_u8 (reinterpret_cast<u8 *> (pTo),
+			  vcombine_u8 (vshrn_n_u16 (vLow, 8), vshrn_n_u16 (vHigh, 8)));
+	}
+#endif
+
+	// even and odd bytes are blended in parallel in 16-bit fields
+	u32 nColorEven = (Color & 0x00FF00FF) * nAlpha;
+	u32 nColorOdd = (Color >> 8 & 0x00FF00FF) * nAlpha;
+
+	for (; nCount--; pTo++)
+	{
+		u32 nEven = (nColorEven + (*pTo & 0x00FF00FF) * nInvAlpha) >> 8 & 0x00FF00FF;
+		u32 nOdd = (nColorOdd + (*pTo >> 8 & 0x00FF00FF) * nInvAlpha) & 0xFF00FF00;
+
+		*pTo = nEven | nOdd;
+	}
+}
+
+// nAlpha is 0..256, RGB565 fields are blended in parallel with 5 bits alpha
+static void BlendSpan (u16 *pTo, u16 Color, unsigned nCount, unsigned nAlpha,
+		       boolean bBigEndian)
+{
+	const u32 nMask = 0x07E0F81F;		// 0b00000GGG'GGG00000'RRRRR000'000BBBBB
+	nAlpha = (nAlpha + 4) >> 3;
+
+	if (bBigEndian)
+	{
+		Color = bswap16 (Color);
+	}
+
+	u32 nColor = (Color | Color << 16) & nMask;
+
+	for (; nCount--; pTo++)
+	{
+		u32 nTo = bBigEndian ? bswap16 (*pTo) : *pTo;
+		nTo = (nTo | nTo << 16) & nMask;
+
+		nTo = (nTo + ((nColor - nTo) * nAlpha >> 5)) & nMask;
+		nTo |= nTo >> 16;
+
+		*pTo = bBigEndian ? bswap16 ((u16) nTo) : (u16) nTo;
+	}
+}
+
+// 1 bit depth, the MSB of a byte is the left pixel
+static void FillSpan1 (u8 *pRow, unsigned nX, unsigned nCount, boolean bSet)
+{
+	for (; nCount > 0 && (nX & 7); nX++, nCount--)
+	{
+		u8 uchMask = 0x80 >> (nX & 7);
+		pRow[nX / 8] = bSet ? pRow[nX / 8] | uchMask : pRow[nX / 8] & ~uchMask;
+	}
+
+	memset (pRow + nX / 8, bSet ? 0xFF : 0, nCount / 8);
+	nX += nCount & ~7U;
+	nCount &= 7;
+
+	for (; nCount > 0; nX++, nCount--)
+	{
+		u8 uchMask = 0x80 >> (nX & 7);
+		pRow[nX / 8] = bSet ? pRow[nX / 8] | uchMask : pRow[nX / 8] & ~uchMask;
+	}
+}
+
+template <typename T>
+static void FillArea (u8 *pBuffer, unsigned nPitch, unsigned nX, unsigned nY,
+		      unsigned nWidth, unsigned nHeight, T Color)
+{
+	T *pTo = PTR_ADD (T *, pBuffer, nY * nPitch) + nX;
+
+	if (nWidth * sizeof (T) == nPitch)
+	{
+		FillSpan (pTo, Color, nWidth * nHeight);	// whole lines in one go
+
+		return;
+	}
+
+	for (; nHeight--; pTo = PTR_ADD (T *, pTo, nPitch))
+	{
+		FillSpan (pTo, Color, nWidth);
+	}
+}
+
+template <typename T>
+static void CopyArea (u8 *pBuffer, unsigned nPitch, unsigned nX, unsigned nY,
+		      unsigned nWidth, unsigned nHeight, const void *pPixels, unsigned nSourcePitch,
+		      boolean bTransparent, T TransparentColor)
+{
+	T *pTo = PTR_ADD (T *, pBuffer, nY * nPitch) + nX;
+	const T *pFrom = static_cast<const T *> (pPixels);
+
+	for (; nHeight--; pTo = PTR_ADD (T *, pTo, nPitch),
+			  pFrom = PTR_ADD (const T *, pFrom, nSourcePitch))
+	{
+		if (bTransparent)
+		{
+			CopySpanTransparent (pTo, pFrom, nWidth, TransparentColor);
+		}
+		else
+		{
+			memcpy (pTo, pFrom, nWidth * sizeof (T));
+		}
+	}
+}
+
+template <typename T>
+static inline void DrawGlyphLine (T *pRow, int nX, unsigned nScreenWidth,
+				  const CCharGenerator &rFont, CCharGenerator::TPixelLine Line,
+				  T Color)
+{
+	for (unsigned x = 0; x < rFont.GetCharWidth (); x++)
+	{
+		if (   (unsigned) (nX + (int) x) < nScreenWidth
+		    && rFont.GetPixel (x, Line))
+		{
+			pRow[nX + (int) x] = Color;
+		}
+	}
+}
+
 //// C2DImage //////////////////////////////////////////////////////////////////
 
 C2DImage::C2DImage (C2DGraphics *p2DGraphics)
@@ -137,7 +419,12 @@ C2DGraphics::C2DGraphics (CDisplay *pDisplay)
 	m_pFrameBuffer(0),
 	m_bIsFrameBuffer(FALSE),
 	m_pBuffer8(0),
-	m_bVSync(FALSE)
+	m_bVSync(FALSE),
+	m_bDirtyTracking (TRUE),
+	m_nDirtyAreas (0),
+	m_nPreviousDirtyAreas (0),
+	m_pAreaBuffer (nullptr),
+	m_nAreaBufferSize (0)
 {
 }
 
@@ -151,13 +438,19 @@ C2DGraphics::C2DGraphics (unsigned nWidth, unsigned nHeight, boolean bVSync, uns
 	m_bIsFrameBuffer(TRUE),
 	m_pBuffer8(0),
 	m_bVSync(bVSync),
-	m_bBufferSwapped(TRUE)
+	m_bBufferSwapped(TRUE),
+	m_bDirtyTracking (TRUE),
+	m_nDirtyAreas (0),
+	m_nPreviousDirtyAreas (0),
+	m_pAreaBuffer (nullptr),
+	m_nAreaBufferSize (0)
 {
 
 }
 
 C2DGraphics::~C2DGraphics (void)
 {
+	delete [] m_pAreaBuffer;
 	delete [] m_pBuffer8;
 
 	if(m_pFrameBuffer)
@@ -220,6 +513,15 @@ boolean C2DGraphics::Initialize (void)
 		return FALSE;
 	}
 
+	// the display (both buffers with VSync) has to be written completely once
+	CDisplay::TArea Screen {0, m_nWidth-1, 0, m_nHeight-1};
+	m_DirtyArea[0] = Screen;
+	m_nDirtyAreas = 1;
+	m_PreviousDirtyArea[0] = Screen;
+	m_nPreviousDirtyAreas = 1;
+
+	ResetStats ();
+
 	return TRUE;
 }
 
@@ -252,51 +554,103 @@ unsigned C2DGraphics::GetHeight () const
 
 void C2DGraphics::ClearScreen(T2DColor Color)
 {
-	DrawRect(0, 0, m_nWidth, m_nHeight, Color);
+	AddDirtyArea (0, 0, m_nWidth, m_nHeight);
+
+	FillRect (0, 0, m_nWidth, m_nHeight, m_pDisplay->GetColor (Color));
 }
 
 void C2DGraphics::DrawRect (unsigned nX, unsigned nY, unsigned nWidth, unsigned nHeight, T2DColor Color)
 {
-	if(nX + nWidth > m_nWidth || nY + nHeight > m_nHeight)
+	AddDirtyArea (nX, nY, nWidth, nHeight);
+
+	FillRect (nX, nY, nWidth, nHeight, m_pDisplay->GetColor (Color));
+}
+
+void C2DGraphics::DrawRectAlpha (unsigned nX, unsigned nY, unsigned nWidth, unsigned nHeight, T2DColor Color, u8 uchAlpha)
+{
+	int x = nX, y = nY, w = nWidth, h = nHeight;
+	if (!ClipRect (&x, &y, &w, &h))
 	{
 		return;
 	}
 
+	AddDirtyArea (x, y, w, h);
+
 	CDisplay::TRawColor nColor = m_pDisplay->GetColor (Color);
-	
-	for(unsigned i = nY; i < nY + nHeight; i++)
+	unsigned nAlpha = uchAlpha + (uchAlpha >> 7);		// 0..256
+
+	switch (m_nDepth)
 	{
-		for(unsigned j = nX; j < nX + nWidth; j++)
+	case 16: {
+			boolean bBigEndian = m_pDisplay->GetColorModel () == CDisplay::RGB565_BE;
+			for (int i = 0; i < h; i++)
+			{
+				BlendSpan (&m_pBuffer16[m_nWidth * (y + i) + x], (u16) nColor, w,
+					   nAlpha, bBigEndian);
+			}
+		} break;
+
+	case 32:
+		for (int i = 0; i < h; i++)
+		{
+			BlendSpan (&m_pBuffer32[m_nWidth * (y + i) + x], (u32) nColor, w, nAlpha);
+		}
+		break;
+
+	default:
+		// palette indices and black-white pixels cannot be blended
+		if (uchAlpha >= 128)
 		{
-			SetPixel (j, i, nColor);
+			FillRect (x, y, w, h, nColor);
 		}
+		break;
 	}
 }
 
 void C2DGraphics::DrawRectOutline (unsigned nX, unsigned nY, unsigned nWidth, unsigned nHeight, T2DColor Color)
 {
-	if(nX + nWidth > m_nWidth || nY + nHeight > m_nHeight)
+	if (!nWidth || !nHeight)
 	{
 		return;
 	}
-	
-	DrawLine(nX, nY, nX + nWidth, nY, Color);
-	DrawLine(nX + nWidth, nY, nX + nWidth, nY + nHeight, Color);
-	DrawLine(nX, nY + nHeight, nX + nWidth, nY + nHeight, Color);
-	DrawLine(nX, nY, nX, nY + nHeight, Color);
+
+	CDisplay::TRawColor nColor = m_pDisplay->GetColor (Color);
+
+	int x = nX, y = nY, w = nWidth, h = nHeight;
+	AddDirtyArea (x, y, w, h);
+
+	FillRect (x, y, w, 1, nColor);
+	FillRect (x, y + h - 1, w, 1, nColor);
+	FillRect (x, y + 1, 1, h - 2, nColor);
+	FillRect (x + w - 1, y + 1, 1, h - 2, nColor);
 }
 
 void C2DGraphics::DrawLine (unsigned nX1, unsigned nY1, unsigned nX2, unsigned nY2, T2DColor Color)
 {
-	if(nX1 >= m_nWidth || nY1 >= m_nHeight || nX2 >= m_nWidth || nY2 >= m_nHeight)
+	CDisplay::TRawColor nColor = m_pDisplay->GetColor (Color);
+
+	int x1 = nX1, y1 = nY1, x2 = nX2, y2 = nY2;
+
+	AddDirtyArea (x1 < x2 ? x1 : x2, y1 < y2 ? y1 : y2,
+		      (x1 < x2 ? x2 - x1 : x1 - x2) + 1, (y1 < y2 ? y2 - y1 : y1 - y2) + 1);
+
+	// horizontal and vertical lines are drawn as spans
+	if (y1 == y2)
 	{
+		FillRect (x1 < x2 ? x1 : x2, y1, (x1 < x2 ? x2 - x1 : x1 - x2) + 1, 1, nColor);
+
+		return;
+	}
+
+	if (x1 == x2)
+	{
+		FillRect (x1, y1 < y2 ? y1 : y2, 1, (y1 < y2 ? y2 - y1 : y1 - y2) + 1, nColor);
+
 		return;
 	}
-	
-	CDisplay::TRawColor nColor = m_pDisplay->GetColor (Color);
 
-	int dx = nX2 - nX1;
-	int dy = nY2 - nY1;
+	int dx = x2 - x1;
+	int dy = y2 - y1;
 	int dxabs = (dx>0) ? dx : -dx;
 	int dyabs = (dy>0) ? dy : -dy;
 	int sgndx = (dx>0) ? 1 : -1;
@@ -304,7 +658,7 @@ void C2DGraphics::DrawLine (unsigned nX1, unsigned nY1, unsigned nX2, unsigned n
 	int x = dyabs >> 1;
 	int y = dxabs >> 1;
 
-	SetPixel (nX1, nY1, nColor);
+	PutPixel (x1, y1, nColor);
 
 	if(dxabs >= dyabs)
 	{
@@ -314,10 +668,10 @@ void C2DGraphics::DrawLine (unsigned nX1, unsigned nY1, unsigned nX2, unsigned n
 			if(y >= dxabs)
 			{
 				y -= dxabs;
-				nY1 += sgndy;
+				y1 += sgndy;
 			}
-			nX1 += sgndx;
-			SetPixel (nX1, nY1, nColor);
+			x1 += sgndx;
+			PutPixel (x1, y1, nColor);
 		}
 	}
 	else
@@ -328,90 +682,91 @@ void C2DGraphics::DrawLine (unsigned nX1, unsigned nY1, unsigned nX2, unsigned n
 			if(x >= dyabs)
 			{
 				x -= dyabs;
-				nX1 += sgndx;
+				x1 += sgndx;
 			}
-			nY1 += sgndy;
-			SetPixel (nX1, nY1, nColor);
+			y1 += sgndy;
+			PutPixel (x1, y1, nColor);
 		}
 	}
 }
 
 void C2DGraphics::DrawCircle (unsigned nX, unsigned nY, unsigned nRadius, T2DColor Color)
 {
-	if(nX + nRadius >= m_nWidth || nY + nRadius >= m_nHeight || nX - nRadius >= m_nWidth || nY - nRadius >= m_nHeight)
-	{
-		return;
-	}
-	
 	CDisplay::TRawColor nColor = m_pDisplay->GetColor (Color);
 
-	int r2 = nRadius * nRadius;
-	unsigned area = r2 << 2;
-	unsigned rr = nRadius << 1;
+	int x = nX, y = nY, r = nRadius;
+	int r2 = r * r;
+
+	AddDirtyArea (x - r, y - r, 2 * r + 1, 2 * r + 1);
 
-	for (unsigned i = 0; i < area; i++)
+	// one span per line, with all pixels inside the circle (tx * tx + ty * ty < r2)
+	int nHalfWidth = r - 1;
+	for (int ty = 0; ty < r; ty++)
 	{
-		int tx = (int) (i % rr) - nRadius;
-		int ty = (int) (i / rr) - nRadius;
+		while (nHalfWidth * nHalfWidth + ty * ty >= r2)
+		{
+			nHalfWidth--;
+		}
+
+		FillRect (x - nHalfWidth, y + ty, 2 * nHalfWidth + 1, 1, nColor);
 
-		if (tx * tx + ty * ty < r2)
+		if (ty > 0)
 		{
-			SetPixel (nX + tx, nY + ty, nColor);
+			FillRect (x - nHalfWidth, y - ty, 2 * nHalfWidth + 1, 1, nColor);
 		}
 	}
 }
 
 void C2DGraphics::DrawCircleOutline (unsigned nX, unsigned nY, unsigned nRadius, T2DColor Color)
 {
-	if(nX + nRadius >= m_nWidth || nY + nRadius >= m_nHeight || nX - nRadius >= m_nWidth || nY - nRadius >= m_nHeight)
-	{
-		return;
-	}
-
 	CDisplay::TRawColor nColor = m_pDisplay->GetColor (Color);
 
-	SetPixel (nRadius + nX, nY, nColor);
+	int x = nX, y = nY, r = nRadius;
+
+	AddDirtyArea (x - r, y - r, 2 * r + 1, 2 * r + 1);
+
+	PutPixel (x + r, y, nColor);
 
-	if (nRadius > 0)
+	if (r > 0)
 	{
-		SetPixel (nX, -nRadius + nY, nColor);
-		SetPixel (nRadius + nX, nY, nColor);
-		SetPixel (nX, nRadius + nY, nColor);
+		PutPixel (x, y - r, nColor);
+		PutPixel (x - r, y, nColor);
+		PutPixel (x, y + r, nColor);
 	}
       
-	int p = 1 - nRadius;
-	int y = 0;
+	int p = 1 - r;
+	int ty = 0;
 	
-	while ((int) nRadius > y)
+	while (r > ty)
 	{
-		y++;
+		ty++;
 
 		if (p <= 0)
 		{
-			p = p + 2 * y + 1;
+			p = p + 2 * ty + 1;
 		}
 		else
 		{
-			nRadius--;
-			p = p + 2 * y - 2 * nRadius + 1;
+			r--;
+			p = p + 2 * ty - 2 * r + 1;
 		}
 
-		if ((int) nRadius < y)
+		if (r < ty)
 		{
 			break;
 		}
 
-		SetPixel (nRadius + nX, y + nY, nColor);
-		SetPixel (-nRadius + nX, y + nY, nColor);
-		SetPixel (nRadius + nX, -y + nY, nColor);
-		SetPixel (- nRadius + nX, -y + nY, nColor);
+		PutPixel (x + r, y + ty, nColor);
+		PutPixel (x - r, y + ty, nColor);
+		PutPixel (x + r, y - ty, nColor);
+		PutPixel (x - r, y - ty, nColor);
 
-		if ((int) nRadius != y)
+		if (r != ty)
 		{
-			SetPixel (y + nX, nRadius + nY, nColor);
-			SetPixel (-y + nX, nRadius + nY, nColor);
-			SetPixel (y + nX, -nRadius + nY, nColor);
-			SetPixel (-y + nX, -nRadius + nY, nColor);
+			PutPixel (x + ty, y + r, nColor);
+			PutPixel (x - ty, y + r, nColor);
+			PutPixel (x + ty, y - r, nColor);
+			PutPixel (x - ty, y - r, nColor);
 		}
 	}
 }
@@ -428,103 +783,254 @@ void C2DGraphics::DrawImageTransparent (unsigned nX, unsigned nY, unsigned nWidt
 
 void C2DGraphics::DrawImageRect (unsigned nX, unsigned nY, unsigned nWidth, unsigned nHeight, unsigned nSourceX, unsigned nSourceY, const void *PixelBuffer)
 {
-	if(nX + nWidth > m_nWidth || nY + nHeight > m_nHeight)
+	AddDirtyArea (nX, nY, nWidth, nHeight);
+
+	CopyRect (nX, nY, nWidth, nHeight, PixelBuffer, nSourceX, nSourceY, nWidth, FALSE, 0);
+}
+
+void C2DGraphics::DrawImageRectTransparent (unsigned nX, unsigned nY, unsigned nWidth, unsigned nHeight, unsigned nSourceX, unsigned nSourceY, unsigned nSourceWidth, unsigned nSourceHeight, const void *PixelBuffer, T2DColor TransparentColor)
+{
+	if(nSourceX + nWidth > nSourceWidth || nSourceY + nHeight > nSourceHeight)
 	{
 		return;
 	}
-	
-	PixelBuffer = PTR_ADD (const void *, PixelBuffer,
-			       (nSourceY * nWidth + nSourceX) * m_nDepth/8);
 
-	for(unsigned i=0; i<nHeight; i++)
-	{
-		for(unsigned j=0; j<nWidth; j++)
-		{
-			SetPixel (nX + j, nY + i, GetPixel (&PixelBuffer, j));
-		}
-	}
+	AddDirtyArea (nX, nY, nWidth, nHeight);
+
+	CopyRect (nX, nY, nWidth, nHeight, PixelBuffer, nSourceX, nSourceY, nSourceWidth,
+		  TRUE, m_pDisplay->GetColor (TransparentColor));
 }
 
-void C2DGraphics::DrawImageRectTransparent (unsigned nX, unsigned nY, unsigned nWidth, unsigned nHeight, unsigned nSourceX, unsigned nSourceY, unsigned nSourceWidth, unsigned nSourceHeight, const void *PixelBuffer, T2DColor TransparentColor)
+void C2DGraphics::DrawPixel (unsigned nX, unsigned nY, T2DColor Color)
 {
-	if(nX + nWidth > m_nWidth || nY + nHeight > m_nHeight || nSourceX + nWidth > nSourceWidth || nSourceY + nHeight > nSourceHeight)
+	AddDirtyArea (nX, nY, 1, 1);
+
+	PutPixel (nX, nY, m_pDisplay->GetColor (Color));
+}
+
+void C2DGraphics::DrawText (unsigned nX, unsigned nY, T2DColor Color, const char *pText,
+			    TTextAlign Align, const TFont &rFont,
+			    CCharGenerator::TFontFlags FontFlags)
+{
+	CCharGenerator Font (rFont, FontFlags);
+
+	int nCharWidth = Font.GetCharWidth ();
+	int nWidth = strlen (pText) * nCharWidth;
+	int x = nX, y = nY;
+	if (Align == AlignRight)
+	{
+		x -= nWidth;
+	}
+	else if (Align == AlignCenter)
+	{
+		x -= nWidth / 2;
+	}
+
+	int w = nWidth, h = Font.GetUnderline ();
+	unsigned nSkipX, nSkipY;
+	if (!ClipRect (&x, &y, &w, &h, &nSkipX, &nSkipY))
 	{
 		return;
 	}
-	
-	for(unsigned i=0; i<nHeight; i++)
+
+	AddDirtyArea (x, y, w, h);
+
+	// back to the unclipped start of the text
+	x -= nSkipX;
+	y -= nSkipY;
+
+	CDisplay::TRawColor nColor = m_pDisplay->GetColor (Color);
+
+	for (; *pText != '\0'; pText++, x += nCharWidth)
 	{
-		const void *pPixels =
-			PTR_ADD (const void *, PixelBuffer,
-				 ((nSourceY + i) * nSourceWidth + nSourceX) * m_nDepth/8);
+		if (x + nCharWidth <= 0)
+		{
+			continue;
+		}
+
+		if (x >= (int) m_nWidth)
+		{
+			break;
+		}
 
-		for(unsigned j=0; j<nWidth; j++)
+		for (unsigned i = nSkipY; i < nSkipY + h; i++)
 		{
-			CDisplay::TRawColor sourcePixel = GetPixel (&pPixels, j);
-			if(sourcePixel != TransparentColor)
+			CCharGenerator::TPixelLine Line = Font.GetPixelLine (*pText, i);
+			unsigned nLine = m_nWidth * (y + i);
+
+			switch (m_nDepth)
 			{
-				SetPixel (nX + j, nY + i, sourcePixel);
+			case 1:
+				for (int j = 0; j < nCharWidth; j++)
+				{
+					if (Font.GetPixel (j, Line))
+					{
+						PutPixel (x + j, y + i, nColor);
+					}
+				}
+				break;
+
+			case 8:
+				DrawGlyphLine (&m_pBuffer8[nLine], x, m_nWidth, Font, Line, (u8) nColor);
+				break;
+
+			case 16:
+				DrawGlyphLine (&m_pBuffer16[nLine], x, m_nWidth, Font, Line, (u16) nColor);
+				break;
+
+			case 32:
+				DrawGlyphLine (&m_pBuffer32[nLine], x, m_nWidth, Font, Line, (u32) nColor);
+				break;
 			}
 		}
 	}
 }
 
-void C2DGraphics::DrawPixel (unsigned nX, unsigned nY, T2DColor Color)
+boolean C2DGraphics::ClipRect (int *pX, int *pY, int *pWidth, int *pHeight,
+			       unsigned *pSkipX, unsigned *pSkipY) const
 {
-	if(nX >= m_nWidth || nY >= m_nHeight)
+	unsigned nSkipX = 0;
+	if (*pX < 0)
 	{
-		return;
+		nSkipX = -*pX;
+		*pWidth += *pX;
+		*pX = 0;
 	}
 
-	CDisplay::TRawColor nColor = m_pDisplay->GetColor (Color);
+	unsigned nSkipY = 0;
+	if (*pY < 0)
+	{
+		nSkipY = -*pY;
+		*pHeight += *pY;
+		*pY = 0;
+	}
+
+	if (*pWidth > (int) m_nWidth - *pX)
+	{
+		*pWidth = (int) m_nWidth - *pX;
+	}
 
-	SetPixel (nX, nY, nColor);
+	if (*pHeight > (int) m_nHeight - *pY)
+	{
+		*pHeight = (int) m_nHeight - *pY;
+	}
+
+	if (   *pWidth <= 0
+	    || *pHeight <= 0)
+	{
+		return FALSE;
+	}
+
+	if (pSkipX)
+	{
+		*pSkipX = nSkipX;
+	}
+
+	if (pSkipY)
+	{
+		*pSkipY = nSkipY;
+	}
+
+	return TRUE;
 }
 
-void C2DGraphics::DrawText (unsigned nX, unsigned nY, T2DColor Color, const char *pText,
-			    TTextAlign Align, const TFont &rFont,
-			    CCharGenerator::TFontFlags FontFlags)
+void C2DGraphics::FillRect (int nX, int nY, int nWidth, int nHeight, CDisplay::TRawColor nColor)
 {
-	CCharGenerator Font (rFont, FontFlags);
-
-	unsigned nWidth = strlen (pText) * Font.GetCharWidth ();
-	if (Align == AlignRight)
+	if (!ClipRect (&nX, &nY, &nWidth, &nHeight))
 	{
-		nX -= nWidth;
+		return;
 	}
-	else if (Align == AlignCenter)
+
+	switch (m_nDepth)
 	{
-		nX -= nWidth / 2;
+	case 1:
+		for (int i = 0; i < nHeight; i++)
+		{
+			FillSpan1 (&m_pBuffer8[m_nWidth / 8 * (nY + i)], nX, nWidth, !!nColor);
+		}
+		break;
+
+	case 8:
+		FillArea (m_pBuffer8, m_nWidth, nX, nY, nWidth, nHeight, (u8) nColor);
+		break;
+
+	case 16:
+		FillArea (m_pBuffer8, m_nWidth * 2, nX, nY, nWidth, nHeight, (u16) nColor);
+		break;
+
+	case 32:
+		FillArea (m_pBuffer8, m_nWidth * 4, nX, nY, nWidth, nHeight, (u32) nColor);
+		break;
 	}
+}
+
+void C2DGraphics::CopyRect (int nX, int nY, int nWidth, int nHeight,
+			    const void *pPixels, unsigned nSourceX, unsigned nSourceY, unsigned nSourcePitch,
+			    boolean bTransparent, CDisplay::TRawColor nTransparentColor)
+{
+	assert (pPixels);
 
-	if (   nX > m_nWidth
-	    || nX + nWidth > m_nWidth
-	    || nY + Font.GetUnderline () > m_nHeight)
+	unsigned nSkipX, nSkipY;
+	if (!ClipRect (&nX, &nY, &nWidth, &nHeight, &nSkipX, &nSkipY))
 	{
 		return;
 	}
 
-	CDisplay::TRawColor nColor = m_pDisplay->GetColor (Color);
+	nSourceX += nSkipX;
+	nSourceY += nSkipY;
 
-	for (; *pText != '\0'; pText++, nX += Font.GetCharWidth ())
+	if (m_nDepth == 1)
 	{
-		for (unsigned y = 0; y < Font.GetUnderline (); y++)
+		// source lines are padded to full bytes (like in C2DImage)
+		unsigned nSourceBytes = (nSourcePitch + 7) / 8;
+
+		for (int i = 0; i < nHeight; i++)
 		{
-			CCharGenerator::TPixelLine Line = Font.GetPixelLine (*pText, y);
+			const u8 *pFrom = PTR_ADD (const u8 *, pPixels, (nSourceY + i) * nSourceBytes);
 
-			for (unsigned x = 0; x < Font.GetCharWidth (); x++)
+			for (int j = 0; j < nWidth; j++)
 			{
-				if (Font.GetPixel (x, Line))
+				unsigned nBit = nSourceX + j;
+				CDisplay::TRawColor nColor = !!(pFrom[nBit / 8] & (0x80 >> (nBit & 7)));
+
+				if (   !bTransparent
+				    || nColor != nTransparentColor)
 				{
-					SetPixel (nX + x, nY + y, nColor);
+					SetPixel (nX + j, nY + i, nColor);
 				}
 			}
 		}
+
+		return;
+	}
+
+	unsigned nPixelSize = m_nDepth / 8;
+	pPixels = PTR_ADD (const void *, pPixels,
+			   (nSourceY * nSourcePitch + nSourceX) * nPixelSize);
+
+	switch (m_nDepth)
+	{
+	case 8:
+		CopyArea (m_pBuffer8, m_nWidth, nX, nY, nWidth, nHeight, pPixels, nSourcePitch,
+			  bTransparent, (u8) nTransparentColor);
+		break;
+
+	case 16:
+		CopyArea (m_pBuffer8, m_nWidth * 2, nX, nY, nWidth, nHeight, pPixels, nSourcePitch * 2,
+			  bTransparent, (u16) nTransparentColor);
+		break;
+
+	case 32:
+		CopyArea (m_pBuffer8, m_nWidth * 4, nX, nY, nWidth, nHeight, pPixels, nSourcePitch * 4,
+			  bTransparent, (u32) nTransparentColor);
+		break;
 	}
 }
 
 void *C2DGraphics::GetBuffer (void)
 {
+	AddDirtyArea (0, 0, m_nWidth, m_nHeight);
+
 	return m_pBuffer8;
 }
 
@@ -533,31 +1039,262 @@ CDisplay *C2DGraphics::GetDisplay (void)
 	return m_pDisplay;
 }
 
+void C2DGraphics::MarkDirty (unsigned nX, unsigned nY, unsigned nWidth, unsigned nHeight)
+{
+	AddDirtyArea (nX, nY, nWidth, nHeight);
+}
+
+void C2DGraphics::EnableDirtyTracking (boolean bEnable)
+{
+	m_bDirtyTracking = bEnable;
+}
+
 void C2DGraphics::UpdateDisplay (void)
 {
+	if (!m_bDirtyTracking)
+	{
+		m_nDirtyAreas = 0;
+		AddDirtyArea (0, 0, m_nWidth, m_nHeight);
+	}
+
+#if RASPPI <= 4
+	if (m_bVSync)
+	{
+		// the other buffer misses the changes of the previous frame too
+		CDisplay::TArea DirtyArea[C2DGRAPHICS_MAX_DIRTY_AREAS];
+		unsigned nDirtyAreas = m_nDirtyAreas;
+		memcpy (DirtyArea, m_DirtyArea, sizeof DirtyArea);
+
+		for (unsigned i = 0; i < m_nPreviousDirtyAreas; i++)
+		{
+			AddDirtyArea (m_PreviousDirtyArea[i]);
+		}
+
+		memcpy (m_PreviousDirtyArea, DirtyArea, sizeof DirtyArea);
+		m_nPreviousDirtyAreas = nDirtyAreas;
+	}
+#endif
+
+	// send the bounding area only, if it is cheaper
+	if (m_nDirtyAreas > 1)
+	{
+		CDisplay::TArea Bounds = m_DirtyArea[0];
+		unsigned nPixels = AREA_PIXELS (Bounds);
+		for (unsigned i = 1; i < m_nDirtyAreas; i++)
+		{
+			const CDisplay::TArea &rArea = m_DirtyArea[i];
+
+			Bounds.x1 = rArea.x1 < Bounds.x1 ? rArea.x1 : Bounds.x1;
+			Bounds.x2 = rArea.x2 > Bounds.x2 ? rArea.x2 : Bounds.x2;
+			Bounds.y1 = rArea.y1 < Bounds.y1 ? rArea.y1 : Bounds.y1;
+			Bounds.y2 = rArea.y2 > Bounds.y2 ? rArea.y2 : Bounds.y2;
+
+			nPixels += AREA_PIXELS (rArea);
+		}
+
+		if (AREA_PIXELS (Bounds) <= nPixels + (m_nDirtyAreas-1) * DIRTY_AREA_OVERHEAD)
+		{
+			m_DirtyArea[0] = Bounds;
+			m_nDirtyAreas = 1;
+		}
+	}
+
+	unsigned nBaseY = 0;
 #if RASPPI <= 4
 	if(m_bVSync)
 	{
-		unsigned nBaseHeight = m_bBufferSwapped ? m_nHeight : 0;
-		CDisplay::TArea Area {0, m_nWidth-1, nBaseHeight, nBaseHeight + m_nHeight-1};
+		nBaseY = m_bBufferSwapped ? m_nHeight : 0;
 
 		m_pFrameBuffer->WaitForVerticalSync();
-		m_pFrameBuffer->SetArea (Area, m_pBuffer8);
-		m_pFrameBuffer->SetVirtualOffset(0, m_bBufferSwapped ? m_nHeight : 0);
+	}
+#endif
+
+	unsigned nStartTicks = CTimer::GetClockTicks ();
+
+	unsigned nPixels = 0;
+	for (unsigned i = 0; i < m_nDirtyAreas; i++)
+	{
+		SendArea (m_DirtyArea[i], nBaseY);
+
+		nPixels += AREA_PIXELS (m_DirtyArea[i]);
+	}
+
+	unsigned nUsecs = CTimer::GetClockTicks () - nStartTicks;
+
+#if RASPPI <= 4
+	if(m_bVSync)
+	{
+		m_pFrameBuffer->SetVirtualOffset(0, nBaseY);
 		m_bBufferSwapped = !m_bBufferSwapped;
 	}
-	else
 #endif
+
+	m_nStatUpdates++;
+	m_nStatAreas += m_nDirtyAreas;
+	m_ullStatPixels += nPixels;
+	m_nStatUsecsLast = nUsecs;
+	if (nUsecs > m_nStatUsecsMax)
+	{
+		m_nStatUsecsMax = nUsecs;
+	}
+	m_ullStatUsecsSum += nUsecs;
+
+	m_nDirtyAreas = 0;
+}
+
+void C2DGraphics::GetStats (T2DGraphicsStats *pStats) const
+{
+	assert (pStats);
+
+	pStats->nUpdates = m_nStatUpdates;
+	pStats->nAreas = m_nStatAreas;
+	pStats->ullPixels = m_ullStatPixels;
+	pStats->nUpdateUsecsLast = m_nStatUsecsLast;
+	pStats->nUpdateUsecsAvg = m_nStatUpdates ? (unsigned) (m_ullStatUsecsSum / m_nStatUpdates) : 0;
+	pStats->nUpdateUsecsMax = m_nStatUsecsMax;
+}
+
+void C2DGraphics::ResetStats (void)
+{
+	m_nStatUpdates = 0;
+	m_nStatAreas = 0;
+	m_ullStatPixels = 0;
+	m_nStatUsecsLast = 0;
+	m_nStatUsecsMax = 0;
+	m_ullStatUsecsSum = 0;
+}
+
+void C2DGraphics::AddDirtyArea (int nX, int nY, int nWidth, int nHeight)
+{
+	if (!ClipRect (&nX, &nY, &nWidth, &nHeight))
 	{
-		CDisplay::TArea Area {0, m_nWidth-1, 0, m_nHeight-1};
+		return;
+	}
+
+	CDisplay::TArea Area {(unsigned) nX, (unsigned) (nX + nWidth - 1),
+			      (unsigned) nY, (unsigned) (nY + nHeight - 1)};
 
-		if (!m_pDisplay)
+	if (m_nDepth == 1)
+	{
+		// areas must start and end on byte boundaries
+		Area.x1 &= ~7U;
+		Area.x2 |= 7U;
+	}
+
+	AddDirtyArea (Area);
+}
+
+void C2DGraphics::AddDirtyArea (const CDisplay::TArea &rArea)
+{
+	CDisplay::TArea Area = rArea;
+
+	// merge with the dirty areas, where the merged area is not much larger than both
+	unsigned i = 0;
+	while (i < m_nDirtyAreas)
+	{
+		const CDisplay::TArea &rDirty = m_DirtyArea[i];
+
+		CDisplay::TArea Merged {Area.x1 < rDirty.x1 ? Area.x1 : rDirty.x1,
+					Area.x2 > rDirty.x2 ? Area.x2 : rDirty.x2,
+					Area.y1 < rDirty.y1 ? Area.y1 : rDirty.y1,
+					Area.y2 > rDirty.y2 ? Area.y2 : rDirty.y2};
+
+		if (  AREA_PIXELS (Merged)
+		    > AREA_PIXELS (Area) + AREA_PIXELS (rDirty) + DIRTY_AREA_OVERHEAD)
+		{
+			i++;
+
+			continue;
+		}
+
+		Area = Merged;
+		m_DirtyArea[i] = m_DirtyArea[--m_nDirtyAreas];
+
+		i = 0;		// the merged area may be merged with areas checked before
+	}
+
+	if (m_nDirtyAreas == C2DGRAPHICS_MAX_DIRTY_AREAS)
+	{
+		// no free entry, merge with the area, which grows least
+		unsigned nBest = 0;
+		unsigned nBestPixels = (unsigned) -1;
+		for (i = 0; i < m_nDirtyAreas; i++)
+		{
+			const CDisplay::TArea &rDirty = m_DirtyArea[i];
+
+			CDisplay::TArea Merged {Area.x1 < rDirty.x1 ? Area.x1 : rDirty.x1,
+						Area.x2 > rDirty.x2 ? Area.x2 : rDirty.x2,
+						Area.y1 < rDirty.y1 ? Area.y1 : rDirty.y1,
+						Area.y2 > rDirty.y2 ? Area.y2 : rDirty.y2};
+
+			unsigned nPixels = AREA_PIXELS (Merged) - AREA_PIXELS (rDirty);
+			if (nPixels < nBestPixels)
+			{
+				nBest = i;
+				nBestPixels = nPixels;
+			}
+		}
+
+		const CDisplay::TArea &rDirty = m_DirtyArea[nBest];
+		Area.x1 = Area.x1 < rDirty.x1 ? Area.x1 : rDirty.x1;
+		Area.x2 = Area.x2 > rDirty.x2 ? Area.x2 : rDirty.x2;
+		Area.y1 = Area.y1 < rDirty.y1 ? Area.y1 : rDirty.y1;
+		Area.y2 = Area.y2 > rDirty.y2 ? Area.y2 : rDirty.y2;
+
+		m_DirtyArea[nBest] = m_DirtyArea[--m_nDirtyAreas];
+
+		AddDirtyArea (Area);
+
+		return;
+	}
+
+	m_DirtyArea[m_nDirtyAreas++] = Area;
+}
+
+void C2DGraphics::SendArea (const CDisplay::TArea &rArea, unsigned nBaseY)
+{
+	CDisplay::TArea Area = rArea;
+
+	unsigned nPitch = m_nWidth * m_nDepth/8;
+	unsigned nLineSize = (Area.x2 - Area.x1 + 1) * m_nDepth/8;
+	unsigned nLines = Area.y2 - Area.y1 + 1;
+
+	const void *pPixels = m_pBuffer8 + Area.y1 * nPitch + Area.x1 * m_nDepth/8;
+
+	if (nLineSize < nPitch)
+	{
+		// the lines of the area are not contiguous in the buffer, copy them
+		size_t nSize = nLineSize * nLines;
+		if (nSize > m_nAreaBufferSize)
+		{
+			delete [] m_pAreaBuffer;
+			m_pAreaBuffer = new u8[nSize];
+			m_nAreaBufferSize = m_pAreaBuffer ? nSize : 0;
+		}
+
+		if (m_pAreaBuffer)
 		{
-			m_pFrameBuffer->SetArea (Area, m_pBuffer8);
+			u8 *pTo = m_pAreaBuffer;
+			for (unsigned i = 0; i < nLines; i++, pTo += nLineSize)
+			{
+				memcpy (pTo, PTR_ADD (const u8 *, pPixels, i * nPitch), nLineSize);
+			}
+
+			pPixels = m_pAreaBuffer;
 		}
 		else
 		{
-			m_pDisplay->SetArea (Area, m_pBuffer8);
+			// no memory, send whole lines
+			Area.x1 = 0;
+			Area.x2 = m_nWidth-1;
+
+			pPixels = m_pBuffer8 + Area.y1 * nPitch;
 		}
 	}
+
+	Area.y1 += nBaseY;
+	Area.y2 += nBaseY;
+
+	assert (m_pDisplay);
+	m_pDisplay->SetArea (Area, pPixels);
 }
@@ -2,7 +2,7 @@
 // bcmframebuffer.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -173,6 +173,9 @@ boolean CBcmFrameBuffer::Initialize (void)
 		return FALSE;
 	}
 
+	m_nVirtualWidth  = m_InitTags.SetVirtWidthHeight.nWidth;
+	m_nVirtualHeight = m_InitTags.SetVirtWidthHeight.nHeight;
+
 	m_nBufferPtr  = m_InitTags.AllocateBuffer.nBufferBaseAddress & 0x3FFFFFFF;
 	m_nBufferSize = m_InitTags.AllocateBuffer.nBufferSize;
 	m_nPitch      = m_InitTags.GetPitch.nValue;
@@ -2,7 +2,7 @@
 // display.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2024  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2024-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -154,3 +154,13 @@ unsigned CDisplay::GetOffsetY (void) const
 {
 	return 0;
 }
+
+unsigned CDisplay::GetVirtualHeight (void) const
+{
+	return GetHeight ();
+}
+
+boolean CDisplay::SetVirtualOffset (unsigned nOffsetX, unsigned nOffsetY)
+{
+	return FALSE;
+}
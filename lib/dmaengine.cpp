@@ -0,0 +1,842 @@
+//
+// dmaengine.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/dmaengine.h>
+#include <circle/bcm2835.h>
+#include <circle/bcm2835int.h>
+#include <circle/machineinfo.h>
+#include <circle/memio.h>
+#include <circle/timer.h>
+#include <circle/synchronize.h>
+#include <circle/new.h>
+#include <circle/util.h>
+#include <assert.h>
+
+#define DMA_CHANNELS			(DMA_CHANNEL_MAX + 1)
+
+#define MEM_BURST_LENGTH		8	// words, for memory to memory transfers
+
+#define FILL_PATTERN_WORDS		4	// read at once with TI_SRC_WIDTH (128 bits)
+
+CDMARequest::CDMARequest (unsigned nMaxSegments)
+:	m_nMaxSegments (nMaxSegments),
+	m_nSegments (0),
+	m_nDestinations (0),
+	m_nTotalLength (0),
+	m_pCompletionRoutine (0),
+	m_pCompletionParam (0),
+	m_bCompleted (FALSE),
+	m_bStatus (FALSE),
+	m_pNext (0)
+{
+	assert (m_nMaxSegments > 0);
+
+	m_pControlBlock = new (HEAP_DMA30) TDMAControlBlock[m_nMaxSegments];
+	assert (m_pControlBlock != 0);
+
+	m_pFillPattern = new (HEAP_DMA30) u32[m_nMaxSegments * FILL_PATTERN_WORDS];
+	assert (m_pFillPattern != 0);
+
+	m_pDestination = new TDestination[m_nMaxSegments];
+	assert (m_pDestination != 0);
+}
+
+CDMARequest::~CDMARequest (void)
+{
+	m_pCompletionRoutine = 0;
+
+	delete [] m_pDestination;
+	m_pDestination = 0;
+
+	delete [] m_pFillPattern;
+	m_pFillPattern = 0;
+
+	delete [] m_pControlBlock;
+	m_pControlBlock = 0;
+}
+
+void CDMARequest::Reset (void)
+{
+	m_nSegments = 0;
+	m_nDestinations = 0;
+	m_nTotalLength = 0;
+
+	m_bCompleted = FALSE;
+	m_bStatus = FALSE;
+}
+
+boolean CDMARequest::AddMemCopy (void *pDestination, const void *pSource, size_t nLength,
+				 boolean bCached)
+{
+	assert (pDestination != 0);
+	assert (pSource != 0);
+	assert (nLength > 0);
+	assert (nLength <= TXFR_LEN_MAX);
+
+	TDMAControlBlock *pCB = NextControlBlock ();
+	if (pCB == 0)
+	{
+		return FALSE;
+	}
+
+	pCB->nTransferInformation = (MEM_BURST_LENGTH << TI_BURST_LENGTH_SHIFT)
+				  | TI_SRC_WIDTH
+				  | TI_SRC_INC
+				  | TI_DEST_WIDTH
+				  | TI_DEST_INC;
+	pCB->nSourceAddress       = BUS_ADDRESS ((uintptr) pSource);
+	pCB->nDestinationAddress  = BUS_ADDRESS ((uintptr) pDestination);
+	pCB->nTransferLength      = nLength;
+	pCB->n2DModeStride        = 0;
+
+	if (bCached)
+	{
+		CleanAndInvalidateDataCacheRange ((uintptr) pSource, nLength);
+		CleanAndInvalidateDataCacheRange ((uintptr) pDestination, nLength);
+
+		AddDestination ((uintptr) pDestination, nLength);
+	}
+
+	m_nTotalLength += nLength;
+
+	return TRUE;
+}
+
+boolean CDMARequest::AddMemSet (void *pDestination, u8 uchValue, size_t nLength, boolean bCached)
+{
+	assert (pDestination != 0);
+	assert (nLength > 0);
+	assert (nLength <= TXFR_LEN_MAX);
+
+	TDMAControlBlock *pCB = NextControlBlock ();
+	if (pCB == 0)
+	{
+		return FALSE;
+	}
+
+	// the source address is not incremented, the same 16 bytes are read again and again
+	assert (m_pFillPattern != 0);
+	u32 *pPattern = &m_pFillPattern[(m_nSegments-1) * FILL_PATTERN_WORDS];
+	for (unsigned i = 0; i < FILL_PATTERN_WORDS; i++)
+	{
+		pPattern[i] = uchValue * 0x01010101U;
+	}
+
+	pCB->nTransferInformation = (MEM_BURST_LENGTH << TI_BURST_LENGTH_SHIFT)
+				  | TI_SRC_WIDTH
+				  | TI_DEST_WIDTH
+				  | TI_DEST_INC;
+	pCB->nSourceAddress       = BUS_ADDRESS ((uintptr) pPattern);
+	pCB->nDestinationAddress  = BUS_ADDRESS ((uintptr) pDestination);
+	pCB->nTransferLength      = nLength;
+	pCB->n2DModeStride        = 0;
+
+	if (bCached)
+	{
+		CleanAndInvalidateDataCacheRange ((uintptr) pDestination, nLength);
+
+		AddDestination ((uintptr) pDestination, nLength);
+	}
+
+	m_nTotalLength += nLength;
+
+	return TRUE;
+}
+
+boolean CDMARequest::AddMemCopy2D (void *pDestination, const void *pSource,
+				   size_t nBlockLength, unsigned nBlockCount,
+				   size_t nDestStride, size_t nSourceStride)
+{
+	assert (pDestination != 0);
+	assert (pSource != 0);
+	assert (nBlockLength > 0);
+	assert (nBlockLength <= 0xFFFF);
+	assert (nBlockCount > 0);
+	assert (nBlockCount <= 0x3FFF);
+	assert (nDestStride <= 0x7FFF);
+	assert (nSourceStride <= 0x7FFF);
+
+	TDMAControlBlock *pCB = NextControlBlock ();
+	if (pCB == 0)
+	{
+		return FALSE;
+	}
+
+	pCB->nTransferInformation = (MEM_BURST_LENGTH << TI_BURST_LENGTH_SHIFT)
+				  | TI_SRC_WIDTH
+				  | TI_SRC_INC
+				  | TI_DEST_WIDTH
+				  | TI_DEST_INC
+				  | TI_TDMODE;
+	pCB->nSourceAddress       = BUS_ADDRESS ((uintptr) pSource);
+	pCB->nDestinationAddress  = BUS_ADDRESS ((uintptr) pDestination);
+	pCB->nTransferLength      =   ((nBlockCount-1) << TXFR_LEN_YLENGTH_SHIFT)
+				    | (nBlockLength << TXFR_LEN_XLENGTH_SHIFT);
+	pCB->n2DModeStride        =   (nDestStride << STRIDE_DEST_SHIFT)
+				    | (nSourceStride << STRIDE_SRC_SHIFT);
+
+	CleanAndInvalidateDataCacheRange ((uintptr) pSource,
+					  (nBlockLength + nSourceStride) * nBlockCount);
+
+	m_nTotalLength += nBlockLength * nBlockCount;
+
+	return TRUE;
+}
+
+boolean CDMARequest::AddIOWrite (uintptr ulIOAddress, const void *pSource, size_t nLength,
+				 TDREQ DREQ)
+{
+	assert (pSource != 0);
+	assert (nLength > 0);
+	assert (nLength <= TXFR_LEN_MAX);
+
+	ulIOAddress &= 0xFFFFFF;
+	assert (ulIOAddress != 0);
+	ulIOAddress += GPU_IO_BASE;
+
+	TDMAControlBlock *pCB = NextControlBlock ();
+	if (pCB == 0)
+	{
+		return FALSE;
+	}
+
+	pCB->nTransferInformation = (DREQ << TI_PERMAP_SHIFT)
+				  | (DEFAULT_BURST_LENGTH << TI_BURST_LENGTH_SHIFT)
+				  | TI_SRC_WIDTH
+				  | TI_SRC_INC
+				  | TI_DEST_DREQ
+				  | TI_WAIT_RESP;
+	pCB->nSourceAddress       = BUS_ADDRESS ((uintptr) pSource);
+	pCB->nDestinationAddress  = ulIOAddress;
+	pCB->nTransferLength      = nLength;
+	pCB->n2DModeStride        = 0;
+
+	CleanAndInvalidateDataCacheRange ((uintptr) pSource, nLength);
+
+	m_nTotalLength += nLength;
+
+	return TRUE;
+}
+
+boolean CDMARequest::AddIORead (void *pDestination, uintptr ulIOAddress, size_t nLength,
+				TDREQ DREQ)
+{
+	assert (pDestination != 0);
+	assert (nLength > 0);
+	assert (nLength <= TXFR_LEN_MAX);
+
+	ulIOAddress &= 0xFFFFFF;
+	assert (ulIOAddress != 0);
+	ulIOAddress += GPU_IO_BASE;
+
+	TDMAControlBlock *pCB = NextControlBlock ();
+	if (pCB == 0)
+	{
+		return FALSE;
+	}
+
+	pCB->nTransferInformation = (DREQ << TI_PERMAP_SHIFT)
+				  | (DEFAULT_BURST_LENGTH << TI_BURST_LENGTH_SHIFT)
+				  | TI_SRC_DREQ
+				  | TI_DEST_WIDTH
+				  | TI_DEST_INC
+				  | TI_WAIT_RESP;
+	pCB->nSourceAddress       = ulIOAddress;
+	pCB->nDestinationAddress  = BUS_ADDRESS ((uintptr) pDestination);
+	pCB->nTransferLength      = nLength;
+	pCB->n2DModeStride        = 0;
+
+	CleanAndInvalidateDataCacheRange ((uintptr) pDestination, nLength);
+
+	AddDestination ((uintptr) pDestination, nLength);
+
+	m_nTotalLength += nLength;
+
+	return TRUE;
+}
+
+unsigned CDMARequest::GetSegmentCount (void) const
+{
+	return m_nSegments;
+}
+
+void CDMARequest::SetCompletionRoutine (TDMARequestCompletionRoutine *pRoutine, void *pParam)
+{
+	m_pCompletionRoutine = pRoutine;
+	m_pCompletionParam = pParam;
+}
+
+boolean CDMARequest::IsCompleted (void) const
+{
+	return m_bCompleted;
+}
+
+boolean CDMARequest::GetStatus (void) const
+{
+	assert (m_bCompleted);
+
+	return m_bStatus;
+}
+
+TDMAControlBlock *CDMARequest::NextControlBlock (void)
+{
+	if (m_nSegments >= m_nMaxSegments)
+	{
+		return 0;
+	}
+
+	assert (m_pControlBlock != 0);
+	TDMAControlBlock *pCB = &m_pControlBlock[m_nSegments++];
+
+	pCB->nNextControlBlockAddress = 0;
+	pCB->nReserved[0] = 0;
+	pCB->nReserved[1] = 0;
+
+	return pCB;
+}
+
+void CDMARequest::AddDestination (uintptr nAddress, size_t nLength)
+{
+	assert (m_pDestination != 0);
+	assert (m_nDestinations < m_nMaxSegments);
+
+	m_pDestination[m_nDestinations].nAddress = nAddress;
+	m_pDestination[m_nDestinations].nLength = nLength;
+	m_nDestinations++;
+}
+
+void CDMARequest::Prepare (void)
+{
+	assert (m_nSegments > 0);
+	assert (m_pControlBlock != 0);
+
+	// chain the control blocks, interrupt after the last one only
+	for (unsigned i = 0; i < m_nSegments; i++)
+	{
+		TDMAControlBlock *pCB = &m_pControlBlock[i];
+
+		if (i < m_nSegments-1)
+		{
+			pCB->nTransferInformation &= ~TI_INTEN;
+			pCB->nNextControlBlockAddress = BUS_ADDRESS ((uintptr) &m_pControlBlock[i+1]);
+		}
+		else
+		{
+			pCB->nTransferInformation |= TI_INTEN;
+			pCB->nNextControlBlockAddress = 0;
+		}
+	}
+
+	CleanAndInvalidateDataCacheRange ((uintptr) m_pControlBlock,
+					  m_nSegments * sizeof (TDMAControlBlock));
+
+	assert (m_pFillPattern != 0);
+	CleanAndInvalidateDataCacheRange ((uintptr) m_pFillPattern,
+					  m_nSegments * FILL_PATTERN_WORDS * sizeof (u32));
+
+	m_bCompleted = FALSE;
+	m_bStatus = FALSE;
+	m_pNext = 0;
+}
+
+void CDMARequest::Complete (boolean bStatus)
+{
+	for (unsigned i = 0; i < m_nDestinations; i++)
+	{
+		CleanAndInvalidateDataCacheRange (m_pDestination[i].nAddress,
+						  m_pDestination[i].nLength);
+	}
+
+	m_bStatus = bStatus;
+
+	DataMemBarrier ();
+
+	m_bCompleted = TRUE;
+
+	if (m_pCompletionRoutine != 0)
+	{
+		(*m_pCompletionRoutine) (this, m_pCompletionParam);
+	}
+}
+
+CDMAEngine::CDMAEngine (CInterruptSystem *pInterruptSystem, unsigned nChannels)
+:	m_pInterruptSystem (pInterruptSystem),
+	m_nChannels (0),
+	m_pQueueHead (0),
+	m_pQueueTail (0),
+	m_nQueued (0)
+{
+	assert (m_pInterruptSystem != 0);
+	assert (1 <= nChannels && nChannels <= DMA_ENGINE_MAX_CHANNELS);
+
+	for (unsigned i = 0; i < DMA_ENGINE_MAX_CHANNELS; i++)
+	{
+		m_Channel[i].pThis = this;
+		m_Channel[i].nIndex = i;
+		m_Channel[i].nChannel = DMA_CHANNEL_NONE;
+		m_Channel[i].pRequest = 0;
+	}
+
+	m_nChannels = nChannels;
+
+	for (unsigned i = 0; i < DMA_ENGINE_ASYNC_REQUESTS; i++)
+	{
+		m_AsyncRequest[i].pRequest = 0;
+		m_AsyncRequest[i].pRoutine = 0;
+		m_AsyncRequest[i].pParam = 0;
+		m_AsyncRequest[i].bInUse = FALSE;
+	}
+
+	memset (&m_Stats, 0, sizeof m_Stats);
+}
+
+CDMAEngine::~CDMAEngine (void)
+{
+	assert (IsIdle ());
+
+	for (unsigned i = 0; i < DMA_ENGINE_ASYNC_REQUESTS; i++)
+	{
+		delete m_AsyncRequest[i].pRequest;
+		m_AsyncRequest[i].pRequest = 0;
+	}
+
+	for (unsigned i = 0; i < m_nChannels; i++)
+	{
+		unsigned nChannel = m_Channel[i].nChannel;
+		if (nChannel == DMA_CHANNEL_NONE)
+		{
+			continue;
+		}
+
+		assert (nChannel < DMA_CHANNELS);
+
+		PeripheralEntry ();
+
+		write32 (ARM_DMACHAN_CS (nChannel), CS_RESET);
+		while (read32 (ARM_DMACHAN_CS (nChannel)) & CS_RESET)
+		{
+			// do nothing
+		}
+
+		write32 (ARM_DMA_ENABLE, read32 (ARM_DMA_ENABLE) & ~(1 << nChannel));
+
+		PeripheralExit ();
+
+		m_pInterruptSystem->DisconnectIRQ (ARM_IRQ_DMA0+nChannel);
+
+		CMachineInfo::Get ()->FreeDMAChannel (nChannel);
+
+		m_Channel[i].nChannel = DMA_CHANNEL_NONE;
+	}
+
+	m_pInterruptSystem = 0;
+}
+
+boolean CDMAEngine::Initialize (void)
+{
+	unsigned i;
+	for (i = 0; i < m_nChannels; i++)
+	{
+		unsigned nChannel = CMachineInfo::Get ()->AllocateDMAChannel (DMA_CHANNEL_NORMAL);
+		if (nChannel == DMA_CHANNEL_NONE)
+		{
+			break;
+		}
+
+		assert (nChannel < DMA_CHANNELS);
+		assert (nChannel <= 6);			// has its own IRQ
+		m_Channel[i].nChannel = nChannel;
+
+		PeripheralEntry ();
+
+		write32 (ARM_DMA_ENABLE, read32 (ARM_DMA_ENABLE) | (1 << nChannel));
+		CTimer::SimpleusDelay (1000);
+
+		write32 (ARM_DMACHAN_CS (nChannel), CS_RESET);
+		while (read32 (ARM_DMACHAN_CS (nChannel)) & CS_RESET)
+		{
+			// do nothing
+		}
+
+		PeripheralExit ();
+
+		m_pInterruptSystem->ConnectIRQ (ARM_IRQ_DMA0+nChannel, InterruptStub, &m_Channel[i]);
+	}
+
+	m_nChannels = i;
+	if (m_nChannels == 0)
+	{
+		return FALSE;
+	}
+
+	for (i = 0; i < DMA_ENGINE_ASYNC_REQUESTS; i++)
+	{
+		m_AsyncRequest[i].pRequest = new CDMARequest (1);
+		assert (m_AsyncRequest[i].pRequest != 0);
+	}
+
+	return TRUE;
+}
+
+unsigned CDMAEngine::GetChannelCount (void) const
+{
+	return m_nChannels;
+}
+
+void CDMAEngine::Submit (CDMARequest *pRequest)
+{
+	assert (pRequest != 0);
+	pRequest->Prepare ();
+
+	m_SpinLock.Acquire ();
+
+	m_Stats.nSubmitted++;
+
+	unsigned i;
+	for (i = 0; i < m_nChannels; i++)
+	{
+		if (m_Channel[i].pRequest == 0)
+		{
+			break;
+		}
+	}
+
+	if (i < m_nChannels)
+	{
+		assert (m_pQueueHead == 0);
+
+		StartRequest (i, pRequest);
+	}
+	else
+	{
+		if (m_pQueueHead == 0)
+		{
+			m_pQueueHead = pRequest;
+		}
+		else
+		{
+			assert (m_pQueueTail != 0);
+			m_pQueueTail->m_pNext = pRequest;
+		}
+
+		m_pQueueTail = pRequest;
+
+		if (++m_nQueued > m_Stats.nQueuedMax)
+		{
+			m_Stats.nQueuedMax = m_nQueued;
+		}
+	}
+
+	m_SpinLock.Release ();
+}
+
+boolean CDMAEngine::Wait (CDMARequest *pRequest)
+{
+	assert (pRequest != 0);
+	assert (pRequest->m_pCompletionRoutine == 0);
+
+	while (!pRequest->m_bCompleted)
+	{
+		// do nothing
+	}
+
+	DataMemBarrier ();
+
+	return pRequest->m_bStatus;
+}
+
+struct TDMASyncStatus
+{
+	volatile boolean bCompleted;
+	boolean bStatus;
+};
+
+static void SyncCompletionRoutine (boolean bStatus, void *pParam)
+{
+	TDMASyncStatus *pSyncStatus = static_cast<TDMASyncStatus *> (pParam);
+	assert (pSyncStatus != 0);
+
+	pSyncStatus->bStatus = bStatus;
+
+	DataMemBarrier ();
+
+	pSyncStatus->bCompleted = TRUE;
+}
+
+boolean CDMAEngine::MemCopy (void *pDestination, const void *pSource, size_t nLength)
+{
+	TDMASyncStatus SyncStatus = {FALSE, FALSE};
+	if (!MemCopyAsync (pDestination, pSource, nLength, SyncCompletionRoutine, &SyncStatus))
+	{
+		memcpy (pDestination, pSource, nLength);
+
+		return TRUE;
+	}
+
+	while (!SyncStatus.bCompleted)
+	{
+		// do nothing
+	}
+
+	DataMemBarrier ();
+
+	return SyncStatus.bStatus;
+}
+
+boolean CDMAEngine::MemCopyAsync (void *pDestination, const void *pSource, size_t nLength,
+				  TDMAEngineCompletionRoutine *pRoutine, void *pParam)
+{
+	CDMARequest *pRequest = GetAsyncRequest (pRoutine, pParam);
+	if (pRequest == 0)
+	{
+		return FALSE;
+	}
+
+	boolean bOK = pRequest->AddMemCopy (pDestination, pSource, nLength);
+	assert (bOK);
+	(void) bOK;
+
+	Submit (pRequest);
+
+	return TRUE;
+}
+
+boolean CDMAEngine::MemSetAsync (void *pDestination, u8 uchValue, size_t nLength,
+				 TDMAEngineCompletionRoutine *pRoutine, void *pParam)
+{
+	CDMARequest *pRequest = GetAsyncRequest (pRoutine, pParam);
+	if (pRequest == 0)
+	{
+		return FALSE;
+	}
+
+	boolean bOK = pRequest->AddMemSet (pDestination, uchValue, nLength);
+	assert (bOK);
+	(void) bOK;
+
+	Submit (pRequest);
+
+	return TRUE;
+}
+
+boolean CDMAEngine::IsIdle (void)
+{
+	m_SpinLock.Acquire ();
+
+	boolean bIdle = m_pQueueHead == 0;
+	for (unsigned i = 0; bIdle && i < m_nChannels; i++)
+	{
+		if (m_Channel[i].pRequest != 0)
+		{
+			bIdle = FALSE;
+		}
+	}
+
+	m_SpinLock.Release ();
+
+	return bIdle;
+}
+
+void CDMAEngine::GetStats (TDMAEngineStats *pStats)
+{
+	assert (pStats != 0);
+
+	m_SpinLock.Acquire ();
+
+	*pStats = m_Stats;
+
+	m_SpinLock.Release ();
+}
+
+void CDMAEngine::ResetStats (void)
+{
+	m_SpinLock.Acquire ();
+
+	memset (&m_Stats, 0, sizeof m_Stats);
+
+	m_SpinLock.Release ();
+}
+
+CDMARequest *CDMAEngine::GetAsyncRequest (TDMAEngineCompletionRoutine *pRoutine, void *pParam)
+{
+	m_SpinLock.Acquire ();
+
+	for (unsigned i = 0; i < DMA_ENGINE_ASYNC_REQUESTS; i++)
+	{
+		TAsyncRequest *pAsync = &m_AsyncRequest[i];
+		if (   pAsync->pRequest != 0
+		    && !pAsync->bInUse)
+		{
+			pAsync->bInUse = TRUE;
+			pAsync->pRoutine = pRoutine;
+			pAsync->pParam = pParam;
+
+			m_SpinLock.Release ();
+
+			CDMARequest *pRequest = pAsync->pRequest;
+			pRequest->Reset ();
+			pRequest->SetCompletionRoutine (AsyncCompletionStub, this);
+
+			return pRequest;
+		}
+	}
+
+	m_SpinLock.Release ();
+
+	return 0;
+}
+
+void CDMAEngine::AsyncCompletionStub (CDMARequest *pRequest, void *pParam)
+{
+	CDMAEngine *pThis = static_cast<CDMAEngine *> (pParam);
+	assert (pThis != 0);
+	assert (pRequest != 0);
+
+	pThis->m_SpinLock.Acquire ();
+
+	TAsyncRequest *pAsync = 0;
+	for (unsigned i = 0; i < DMA_ENGINE_ASYNC_REQUESTS; i++)
+	{
+		if (pThis->m_AsyncRequest[i].pRequest == pRequest)
+		{
+			pAsync = &pThis->m_AsyncRequest[i];
+
+			break;
+		}
+	}
+
+	assert (pAsync != 0);
+	assert (pAsync->bInUse);
+	TDMAEngineCompletionRoutine *pRoutine = pAsync->pRoutine;
+	void *pRoutineParam = pAsync->pParam;
+	boolean bStatus = pRequest->GetStatus ();
+
+	pAsync->bInUse = FALSE;
+
+	pThis->m_SpinLock.Release ();
+
+	if (pRoutine != 0)
+	{
+		(*pRoutine) (bStatus, pRoutineParam);
+	}
+}
+
+void CDMAEngine::StartRequest (unsigned nIndex, CDMARequest *pRequest)
+{
+	assert (nIndex < m_nChannels);
+	TChannel *pChannel = &m_Channel[nIndex];
+	assert (pChannel->pRequest == 0);
+	pChannel->pRequest = pRequest;
+
+	unsigned nChannel = pChannel->nChannel;
+	assert (nChannel < DMA_CHANNELS);
+
+	assert (pRequest != 0);
+	assert (pRequest->m_pControlBlock != 0);
+
+	PeripheralEntry ();
+
+	assert (!(read32 (ARM_DMACHAN_CS (nChannel)) & (CS_INT | CS_ACTIVE)));
+
+	write32 (ARM_DMACHAN_CONBLK_AD (nChannel),
+		 BUS_ADDRESS ((uintptr) pRequest->m_pControlBlock));
+
+	write32 (ARM_DMACHAN_CS (nChannel),   CS_WAIT_FOR_OUTSTANDING_WRITES
+					    | (DEFAULT_PANIC_PRIORITY << CS_PANIC_PRIORITY_SHIFT)
+					    | (DEFAULT_PRIORITY << CS_PRIORITY_SHIFT)
+					    | CS_ACTIVE);
+
+	PeripheralExit ();
+}
+
+void CDMAEngine::InterruptHandler (unsigned nIndex)
+{
+	assert (nIndex < m_nChannels);
+	TChannel *pChannel = &m_Channel[nIndex];
+
+	unsigned nChannel = pChannel->nChannel;
+	assert (nChannel < DMA_CHANNELS);
+
+	PeripheralEntry ();
+
+	write32 (ARM_DMA_INT_STATUS, 1 << nChannel);
+
+	u32 nCS = read32 (ARM_DMACHAN_CS (nChannel));
+	assert (nCS & CS_INT);
+	write32 (ARM_DMACHAN_CS (nChannel), nCS);	// clear CS_INT and CS_END
+
+	boolean bStatus = nCS & CS_ERROR ? FALSE : TRUE;
+	if (!bStatus)
+	{
+		write32 (ARM_DMACHAN_CS (nChannel), CS_RESET);
+		while (read32 (ARM_DMACHAN_CS (nChannel)) & CS_RESET)
+		{
+			// do nothing
+		}
+	}
+
+	PeripheralExit ();
+
+	m_SpinLock.Acquire ();
+
+	CDMARequest *pRequest = pChannel->pRequest;
+	assert (pRequest != 0);
+	pChannel->pRequest = 0;
+
+	m_Stats.nCompleted++;
+	m_Stats.nSegments += pRequest->m_nSegments;
+	if (bStatus)
+	{
+		m_Stats.ullBytes += pRequest->m_nTotalLength;
+	}
+	else
+	{
+		m_Stats.nErrors++;
+	}
+
+	// start the next waiting request on this channel
+	CDMARequest *pNext = m_pQueueHead;
+	if (pNext != 0)
+	{
+		m_pQueueHead = pNext->m_pNext;
+		if (m_pQueueHead == 0)
+		{
+			m_pQueueTail = 0;
+		}
+
+		assert (m_nQueued > 0);
+		m_nQueued--;
+
+		StartRequest (nIndex, pNext);
+	}
+
+	m_SpinLock.Release ();
+
+	// called without spin lock, so that the completion routine can submit a new request
+	pRequest->Complete (bStatus);
+}
+
+void CDMAEngine::InterruptStub (void *pParam)
+{
+	TChannel *pChannel = static_cast<TChannel *> (pParam);
+	assert (pChannel != 0);
+	assert (pChannel->pThis != 0);
+
+	pChannel->pThis->InterruptHandler (pChannel->nIndex);
+}
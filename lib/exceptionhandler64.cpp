@@ -2,7 +2,7 @@
 // exceptionhandler64.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2018  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -23,9 +23,15 @@
 #include <circle/synchronize.h>
 #include <circle/debug.h>
 #include <circle/sysconfig.h>
+#include <circle/memorymap.h>
 #include <circle/string.h>
 #include <assert.h>
 
+#define ESR_ISS_FNV	(1 << 10)
+
+#define SPSR_I		(1 << 7)
+#define SPSR_F		(1 << 6)
+
 static const char FromExcept[] = "except";
 
 // order must match exception identifiers in circle/exception.h
@@ -39,6 +45,8 @@ const char *CExceptionHandler::s_pExceptionName[] =
 CExceptionHandler *CExceptionHandler::s_pThis = 0;
 
 CExceptionHandler::CExceptionHandler (void)
+:	m_pPageFaultHandler (0),
+	m_pPageFaultParam (0)
 {
 	assert (s_pThis == 0);
 	s_pThis = this;
@@ -79,6 +87,74 @@ void CExceptionHandler::Throw (unsigned nException, TAbortFrame *pFrame)
 		pFrame->elr_el1, nEC, nISS, nFAR, sp, pFrame->x30, pFrame->spsr_el1);
 }
 
+void CExceptionHandler::RegisterPageFaultHandler (TPageFaultHandler *pHandler, void *pParam)
+{
+	assert (m_pPageFaultHandler == 0);
+	m_pPageFaultParam = pParam;
+	m_pPageFaultHandler = pHandler;
+	assert (m_pPageFaultHandler != 0);
+}
+
+void CExceptionHandler::UnregisterPageFaultHandler (void)
+{
+	assert (m_pPageFaultHandler != 0);
+	m_pPageFaultHandler = 0;
+	m_pPageFaultParam = 0;
+}
+
+boolean CExceptionHandler::ResolveAbort (TAbortFrame *pFrame)
+{
+	assert (pFrame != 0);
+
+	if (   s_pThis == 0
+	    || s_pThis->m_pPageFaultHandler == 0)
+	{
+		return FALSE;
+	}
+
+	u64 nEC   = (pFrame->esr_el1 >> 26) & 0x3F;
+	u64 nDFSC = pFrame->esr_el1 & 0x3F;
+	if (   nEC != 0x25				// data abort from EL1?
+	    || (pFrame->esr_el1 & ESR_ISS_FNV))		// FAR not valid?
+	{
+		return FALSE;
+	}
+
+	boolean bAccessFlag;
+	switch (nDFSC & ~3)				// ignore lookup level
+	{
+	case 0x04:	bAccessFlag = FALSE;	break;	// translation fault
+	case 0x08:	bAccessFlag = TRUE;	break;	// access flag fault
+	default:	return FALSE;
+	}
+
+	u64 nFAR = pFrame->far_el1;
+	if (!(MEM_PAGED_START <= nFAR && nFAR < MEM_PAGED_START + MEM_PAGED_SIZE))
+	{
+		return FALSE;
+	}
+
+	// The handler may have to wait for the completion of I/O, which requires IRQs.
+	if (pFrame->spsr_el1 & SPSR_I)
+	{
+		return FALSE;
+	}
+
+	if (!(pFrame->spsr_el1 & SPSR_F))
+	{
+		EnableFIQs ();
+	}
+	EnableIRQs ();
+
+	boolean bResult = (*s_pThis->m_pPageFaultHandler) (nFAR, bAccessFlag,
+							   s_pThis->m_pPageFaultParam);
+
+	DisableIRQs ();
+	DisableFIQs ();
+
+	return bResult;
+}
+
 CExceptionHandler *CExceptionHandler::Get (void)
 {
 	assert (s_pThis != 0);
@@ -93,3 +169,8 @@ void ExceptionHandler (u64 nException, TAbortFrame *pFrame)
 
 	CExceptionHandler::Get ()->Throw (nException, pFrame);
 }
+
+int AbortHandler (TAbortFrame *pFrame)
+{
+	return CExceptionHandler::ResolveAbort (pFrame);
+}
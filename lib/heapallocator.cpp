@@ -2,7 +2,7 @@
 // heapallocator.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -28,8 +28,13 @@ CHeapAllocator::CHeapAllocator (const char *pHeapName)
 :	m_pHeapName (pHeapName),
 	m_pNext (0),
 	m_pLimit (0),
-	m_nReserve (0)
+	m_nReserve (0),
+	m_FreeSpaceGauge ("circle_heap_free_bytes",
+			  "Free space of the heap, which is not allocated by blocks",
+			  "heap", pHeapName, GetFreeSpaceHandler, this)
 {
+	m_SpinLock.SetName (pHeapName);
+
 	memset (m_Bucket, 0, sizeof m_Bucket);
 
 	unsigned nBuckets = sizeof s_nBucketSize / sizeof s_nBucketSize[0];
@@ -60,6 +65,14 @@ size_t CHeapAllocator::GetFreeSpace (void) const
 	return m_pLimit - m_pNext;
 }
 
+s64 CHeapAllocator::GetFreeSpaceHandler (void *pParam)
+{
+	CHeapAllocator *pThis = (CHeapAllocator *) pParam;
+	assert (pThis != 0);
+
+	return pThis->GetFreeSpace ();
+}
+
 void *CHeapAllocator::Allocate (size_t nSize)
 {
 	if (m_pNext == 0)
@@ -2,7 +2,7 @@
 // interrupt.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -23,6 +23,7 @@
 #include <circle/bcm2835.h>
 #include <circle/bcm2836.h>
 #include <circle/memio.h>
+#include <circle/tracer.h>
 #include <circle/sysconfig.h>
 #include <circle/types.h>
 #include <assert.h>
@@ -60,6 +61,9 @@ CInterruptSystem::CInterruptSystem (void)
 	{
 		m_apIRQHandler[nIRQ] = 0;
 		m_pParam[nIRQ] = 0;
+#ifdef LATENCY_HISTOGRAMS
+		m_pHistogram[nIRQ] = 0;
+#endif
 	}
 }
 
@@ -91,6 +95,14 @@ void CInterruptSystem::Destructor (void)
 
 	PeripheralExit ();
 
+#ifdef LATENCY_HISTOGRAMS
+	for (unsigned nIRQ = 0; nIRQ < IRQ_LINES; nIRQ++)
+	{
+		delete m_pHistogram[nIRQ];
+		m_pHistogram[nIRQ] = 0;
+	}
+#endif
+
 	s_pThis = 0;
 }
 
@@ -147,6 +159,17 @@ void CInterruptSystem::ConnectIRQ (unsigned nIRQ, TIRQHandler *pHandler, void *p
 	m_apIRQHandler[nIRQ] = pHandler;
 	m_pParam[nIRQ] = pParam;
 
+#ifdef LATENCY_HISTOGRAMS
+	if (m_pHistogram[nIRQ] == 0)
+	{
+		CString Name;
+		Name.Format ("irq %u handler", nIRQ);
+
+		m_pHistogram[nIRQ] = new CLatencyHistogram (Name);
+		assert (m_pHistogram[nIRQ] != 0);
+	}
+#endif
+
 	EnableIRQ (nIRQ);
 }
 
@@ -220,9 +243,16 @@ void CInterruptSystem::EnableIRQ (unsigned nIRQ)
 	else
 	{
 #if RASPPI >= 2
-		assert (nIRQ == ARM_IRQLOCAL0_CNTPNS);	// the only implemented local IRQ so far
-		write32 (ARM_LOCAL_TIMER_INT_CONTROL0,
-			 read32 (ARM_LOCAL_TIMER_INT_CONTROL0) | (1 << 1));
+		if (nIRQ == ARM_IRQLOCAL0_PMU)
+		{
+			write32 (ARM_LOCAL_PM_ROUTING_SET, 0xF);	// PMU IRQ of each core to its own IRQ
+		}
+		else
+		{
+			assert (nIRQ == ARM_IRQLOCAL0_CNTPNS);
+			write32 (ARM_LOCAL_TIMER_INT_CONTROL0,
+				 read32 (ARM_LOCAL_TIMER_INT_CONTROL0) | (1 << 1));
+		}
 #else
 		assert (0);
 #endif
@@ -244,9 +274,16 @@ void CInterruptSystem::DisableIRQ (unsigned nIRQ)
 	else
 	{
 #if RASPPI >= 2
-		assert (nIRQ == ARM_IRQLOCAL0_CNTPNS);	// the only implemented local IRQ so far
-		write32 (ARM_LOCAL_TIMER_INT_CONTROL0,
-			 read32 (ARM_LOCAL_TIMER_INT_CONTROL0) & ~(1 << 1));
+		if (nIRQ == ARM_IRQLOCAL0_PMU)
+		{
+			write32 (ARM_LOCAL_PM_ROUTING_CLR, 0xF);	// PMU IRQ of each core to its own IRQ
+		}
+		else
+		{
+			assert (nIRQ == ARM_IRQLOCAL0_CNTPNS);
+			write32 (ARM_LOCAL_TIMER_INT_CONTROL0,
+				 read32 (ARM_LOCAL_TIMER_INT_CONTROL0) & ~(1 << 1));
+		}
 #else
 		assert (0);
 #endif
@@ -288,7 +325,31 @@ boolean CInterruptSystem::CallIRQHandler (unsigned nIRQ)
 
 	if (pHandler != 0)
 	{
+#ifdef TRACE_IRQ
+		CTracer *pTracer = CTracer::Get ();
+		if (pTracer != 0)
+		{
+			pTracer->Begin (TRACER_EVENT_IRQ, nIRQ);
+		}
+#endif
+
+#ifdef LATENCY_HISTOGRAMS
+		u64 nStartTicks = CTracer::GetTimestamp ();
+#endif
+
 		(*pHandler) (m_pParam[nIRQ]);
+
+#ifdef LATENCY_HISTOGRAMS
+		assert (m_pHistogram[nIRQ] != 0);
+		m_pHistogram[nIRQ]->RecordTimestampTicks (CTracer::GetTimestamp () - nStartTicks);
+#endif
+
+#ifdef TRACE_IRQ
+		if (pTracer != 0)
+		{
+			pTracer->End (TRACER_EVENT_IRQ);
+		}
+#endif
 		
 		return TRUE;
 	}
@@ -305,9 +366,24 @@ void CInterruptSystem::InterruptHandler (void)
 	assert (s_pThis != 0);
 
 #if RASPPI >= 2
+	if (s_pThis->m_apIRQHandler[ARM_IRQLOCAL0_PMU] != 0)
+	{
+#ifdef ARM_ALLOW_MULTI_CORE
+		unsigned nCore = CMultiCoreSupport::ThisCore ();
+#else
+		unsigned nCore = 0;
+#endif
+		if (read32 (ARM_LOCAL_IRQ_PENDING0 + 4 * nCore) & (1 << 9))
+		{
+			s_pThis->CallIRQHandler (ARM_IRQLOCAL0_PMU);
+
+			return;
+		}
+	}
+
 	u32 nLocalPending = read32 (ARM_LOCAL_IRQ_PENDING0);
-	assert (!(nLocalPending & ~(1 << 1 | 0xF << 4 | 1 << 8)));
-	if (nLocalPending & (1 << 1))		// the only implemented local IRQ so far
+	assert (!(nLocalPending & ~(1 << 1 | 0xF << 4 | 1 << 8 | 1 << 9)));
+	if (nLocalPending & (1 << 1))
 	{
 		s_pThis->CallIRQHandler (ARM_IRQLOCAL0_CNTPNS);
 
@@ -4,7 +4,7 @@
 // Driver for the GIC-400 interrupt controller of the Raspberry Pi 4
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2019-2023  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2019-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -23,8 +23,10 @@
 #include <circle/synchronize.h>
 #include <circle/multicore.h>
 #include <circle/bcm2711.h>
+#include <circle/bcm2836.h>
 #include <circle/memio.h>
 #include <circle/logger.h>
+#include <circle/tracer.h>
 #include <circle/sysconfig.h>
 #include <circle/southbridge.h>
 #include <circle/rp1int.h>
@@ -100,6 +102,9 @@ CInterruptSystem::CInterruptSystem (void)
 	{
 		m_apIRQHandler[nIRQ] = 0;
 		m_pParam[nIRQ] = 0;
+#ifdef LATENCY_HISTOGRAMS
+		m_pHistogram[nIRQ] = 0;
+#endif
 	}
 }
 
@@ -119,6 +124,14 @@ void CInterruptSystem::Destructor (void)
 
 	write32 (GICD_CTLR, GICD_CTLR_DISABLE);
 
+#ifdef LATENCY_HISTOGRAMS
+	for (unsigned nIRQ = 0; nIRQ < IRQ_LINES; nIRQ++)
+	{
+		delete m_pHistogram[nIRQ];
+		m_pHistogram[nIRQ] = 0;
+	}
+#endif
+
 	s_pThis = 0;
 }
 
@@ -221,6 +234,17 @@ void CInterruptSystem::ConnectIRQ (unsigned nIRQ, TIRQHandler *pHandler, void *p
 	m_apIRQHandler[nIRQ] = pHandler;
 	m_pParam[nIRQ] = pParam;
 
+#ifdef LATENCY_HISTOGRAMS
+	if (m_pHistogram[nIRQ] == 0)
+	{
+		CString Name;
+		Name.Format ("irq %u handler", nIRQ);
+
+		m_pHistogram[nIRQ] = new CLatencyHistogram (Name);
+		assert (m_pHistogram[nIRQ] != 0);
+	}
+#endif
+
 	EnableIRQ (nIRQ);
 }
 
@@ -306,6 +330,20 @@ void CInterruptSystem::EnableIRQ (unsigned nIRQ)
 
 	assert (nIRQ < IRQ_LINES);
 
+#if RASPPI == 4
+	// direct the PMU interrupt of a core to this core
+	if (ARM_IRQ_PMU0 <= nIRQ && nIRQ <= ARM_IRQ_PMU3)
+	{
+		unsigned nCore = nIRQ - ARM_IRQ_PMU0;
+		unsigned nShift = (nIRQ % 4) * 8;
+		uintptr nTargetReg = GICD_ITARGETSR0 + 4 * (nIRQ / 4);
+		write32 (nTargetReg,   (read32 (nTargetReg) & ~(0xFF << nShift))
+				     | (GICD_ITARGETSR_CORE0 << nCore) << nShift);
+
+		write32 (ARM_LOCAL_PM_ROUTING_SET, 1 << nCore);
+	}
+#endif
+
 	write32 (GICD_ISENABLER0 + 4 * (nIRQ / 32), 1 << (nIRQ % 32));
 }
 
@@ -376,7 +414,31 @@ boolean CInterruptSystem::CallIRQHandler (unsigned nIRQ)
 
 	if (pHandler != 0)
 	{
+#ifdef TRACE_IRQ
+		CTracer *pTracer = CTracer::Get ();
+		if (pTracer != 0)
+		{
+			pTracer->Begin (TRACER_EVENT_IRQ, nIRQ);
+		}
+#endif
+
+#ifdef LATENCY_HISTOGRAMS
+		u64 nStartTicks = CTracer::GetTimestamp ();
+#endif
+
 		(*pHandler) (m_pParam[nIRQ]);
+
+#ifdef LATENCY_HISTOGRAMS
+		assert (m_pHistogram[nIRQ] != 0);
+		m_pHistogram[nIRQ]->RecordTimestampTicks (CTracer::GetTimestamp () - nStartTicks);
+#endif
+
+#ifdef TRACE_IRQ
+		if (pTracer != 0)
+		{
+			pTracer->End (TRACER_EVENT_IRQ);
+		}
+#endif
 		
 		return TRUE;
 	}
@@ -0,0 +1,304 @@
+//
+// latencyhistogram.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/latencyhistogram.h>
+#include <circle/tracer.h>
+#include <circle/logger.h>
+#include <circle/atomic.h>
+#include <circle/util.h>
+#include <assert.h>
+
+static const char Header[] =
+	"Name                        Count      Min      p50      p99    p99.9      Max (us)";
+
+CLatencyHistogram *CLatencyHistogram::s_pFirst = 0;
+CSpinLock CLatencyHistogram::s_SpinLock (TASK_LEVEL);
+
+CLatencyHistogram::CLatencyHistogram (const char *pName)
+{
+	assert (pName != 0);
+	strncpy (m_Name, pName, sizeof m_Name - 1);
+	m_Name[sizeof m_Name - 1] = '\0';
+
+	Reset ();
+
+	s_SpinLock.Acquire ();
+
+	m_pNext = s_pFirst;
+	s_pFirst = this;
+
+	s_SpinLock.Release ();
+}
+
+CLatencyHistogram::~CLatencyHistogram (void)
+{
+	s_SpinLock.Acquire ();
+
+	CLatencyHistogram **ppPrev = &s_pFirst;
+	while (*ppPrev != this)
+	{
+		assert (*ppPrev != 0);
+		ppPrev = &(*ppPrev)->m_pNext;
+	}
+
+	*ppPrev = m_pNext;
+
+	s_SpinLock.Release ();
+}
+
+const char *CLatencyHistogram::GetName (void) const
+{
+	return m_Name;
+}
+
+void CLatencyHistogram::Record (u32 nNanoSeconds)
+{
+	if (nNanoSeconds > LATENCY_HISTOGRAM_MAX_VALUE)
+	{
+		nNanoSeconds = LATENCY_HISTOGRAM_MAX_VALUE;
+	}
+
+	AtomicIncrement (&m_nCount[GetBucket (nNanoSeconds)]);
+
+	int nValue = (int) nNanoSeconds;
+
+	int nMin;
+	while (   nValue < (nMin = AtomicGet (&m_nMin))
+	       && AtomicCompareExchange (&m_nMin, nMin, nValue) != nMin)
+	{
+		// retry
+	}
+
+	int nMax;
+	while (   nValue > (nMax = AtomicGet (&m_nMax))
+	       && AtomicCompareExchange (&m_nMax, nMax, nValue) != nMax)
+	{
+		// retry
+	}
+}
+
+void CLatencyHistogram::RecordTimestampTicks (u64 nTimestampTicks)
+{
+	u64 nNanoSeconds = nTimestampTicks * 1000000000U / CTracer::GetTimestampFrequency ();
+
+	Record (  nNanoSeconds < LATENCY_HISTOGRAM_MAX_VALUE
+		? (u32) nNanoSeconds : LATENCY_HISTOGRAM_MAX_VALUE);
+}
+
+void CLatencyHistogram::Reset (void)
+{
+	for (unsigned i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++)
+	{
+		AtomicSet (&m_nCount[i], 0);
+	}
+
+	AtomicSet (&m_nMin, LATENCY_HISTOGRAM_MAX_VALUE);
+	AtomicSet (&m_nMax, 0);
+}
+
+unsigned CLatencyHistogram::GetCount (void) const
+{
+	unsigned nCount = 0;
+	for (unsigned i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++)
+	{
+		nCount += (unsigned) AtomicGet (&m_nCount[i]);
+	}
+
+	return nCount;
+}
+
+u32 CLatencyHistogram::GetMin (void) const
+{
+	return GetCount () > 0 ? (u32) AtomicGet (&m_nMin) : 0;
+}
+
+u32 CLatencyHistogram::GetMax (void) const
+{
+	return (u32) AtomicGet (&m_nMax);
+}
+
+u32 CLatencyHistogram::GetMean (void) const
+{
+	u64 nSum = 0;
+	unsigned nCount = 0;
+	for (unsigned i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++)
+	{
+		unsigned nBucketCount = (unsigned) AtomicGet (&m_nCount[i]);
+		if (nBucketCount > 0)
+		{
+			u64 nMidpoint = ((u64) GetBucketLowest (i) + GetBucketHighest (i)) / 2;
+
+			nSum += nMidpoint * nBucketCount;
+			nCount += nBucketCount;
+		}
+	}
+
+	return nCount > 0 ? (u32) (nSum / nCount) : 0;
+}
+
+u32 CLatencyHistogram::GetPercentile (unsigned nPerMille) const
+{
+	assert (nPerMille <= 1000);
+
+	unsigned nCount = GetCount ();
+	if (nCount == 0)
+	{
+		return 0;
+	}
+
+	u64 nRank = ((u64) nCount * nPerMille + 999) / 1000;
+	if (nRank == 0)
+	{
+		nRank = 1;
+	}
+
+	u64 nTotal = 0;
+	for (unsigned i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++)
+	{
+		nTotal += (unsigned) AtomicGet (&m_nCount[i]);
+		if (nTotal >= nRank)
+		{
+			// report the highest value of the bucket, but not more than the max. value
+			u32 nValue = GetBucketHighest (i);
+			u32 nMax = GetMax ();
+
+			return nValue < nMax ? nValue : nMax;
+		}
+	}
+
+	return GetMax ();
+}
+
+void CLatencyHistogram::Dump (const char *pSource) const
+{
+	CString Line;
+	FormatLine (&Line);
+
+	CLogger::Get ()->Write (pSource, LogNotice, "%s", (const char *) Line);
+}
+
+void CLatencyHistogram::Format (CString *pString) const
+{
+	assert (pString != 0);
+
+	CString Line;
+	FormatLine (&Line);
+
+	pString->Append (Line);
+	pString->Append ('\n');
+}
+
+void CLatencyHistogram::DumpAll (void)
+{
+	CLogger::Get ()->Write ("latency", LogNotice, Header);
+
+	s_SpinLock.Acquire ();
+
+	for (const CLatencyHistogram *pHistogram = s_pFirst; pHistogram != 0;
+	     pHistogram = pHistogram->m_pNext)
+	{
+		pHistogram->Dump ();
+	}
+
+	s_SpinLock.Release ();
+}
+
+void CLatencyHistogram::FormatAll (CString *pString)
+{
+	FormatHeader (pString);
+
+	s_SpinLock.Acquire ();
+
+	for (const CLatencyHistogram *pHistogram = s_pFirst; pHistogram != 0;
+	     pHistogram = pHistogram->m_pNext)
+	{
+		pHistogram->Format (pString);
+	}
+
+	s_SpinLock.Release ();
+}
+
+// Values below 2 * LATENCY_HISTOGRAM_SUB_BUCKETS have an own bucket. Above, each
+// power of two range [2^n, 2^(n+1)) is divided into LATENCY_HISTOGRAM_SUB_BUCKETS
+// buckets of equal width.
+unsigned CLatencyHistogram::GetBucket (u32 nValue)
+{
+	if (nValue < 2 * LATENCY_HISTOGRAM_SUB_BUCKETS)
+	{
+		return nValue;
+	}
+
+	unsigned nShift = (31 - __builtin_clz (nValue)) - LATENCY_HISTOGRAM_SUB_BITS;
+	unsigned nBucket = nShift * LATENCY_HISTOGRAM_SUB_BUCKETS + (nValue >> nShift);
+	assert (nBucket < LATENCY_HISTOGRAM_BUCKETS);
+
+	return nBucket;
+}
+
+u32 CLatencyHistogram::GetBucketLowest (unsigned nBucket)
+{
+	assert (nBucket < LATENCY_HISTOGRAM_BUCKETS);
+	if (nBucket < 2 * LATENCY_HISTOGRAM_SUB_BUCKETS)
+	{
+		return nBucket;
+	}
+
+	unsigned nShift = nBucket / LATENCY_HISTOGRAM_SUB_BUCKETS - 1;
+	u32 nSubBucket = nBucket % LATENCY_HISTOGRAM_SUB_BUCKETS + LATENCY_HISTOGRAM_SUB_BUCKETS;
+
+	return nSubBucket << nShift;
+}
+
+u32 CLatencyHistogram::GetBucketHighest (unsigned nBucket)
+{
+	assert (nBucket < LATENCY_HISTOGRAM_BUCKETS);
+	if (nBucket < 2 * LATENCY_HISTOGRAM_SUB_BUCKETS)
+	{
+		return nBucket;
+	}
+
+	unsigned nShift = nBucket / LATENCY_HISTOGRAM_SUB_BUCKETS - 1;
+
+	return GetBucketLowest (nBucket) + ((1U << nShift) - 1);
+}
+
+void CLatencyHistogram::FormatLine (CString *pLine) const
+{
+	assert (pLine != 0);
+
+	u32 nMin = GetMin ();
+	u32 nP50 = GetPercentile (500);
+	u32 nP99 = GetPercentile (990);
+	u32 nP999 = GetPercentile (999);
+	u32 nMax = GetMax ();
+
+	pLine->Format ("%-23s %9u %4u.%03u %4u.%03u %4u.%03u %4u.%03u %4u.%03u",
+		       m_Name, GetCount (),
+		       nMin / 1000, nMin % 1000, nP50 / 1000, nP50 % 1000,
+		       nP99 / 1000, nP99 % 1000, nP999 / 1000, nP999 % 1000,
+		       nMax / 1000, nMax % 1000);
+}
+
+void CLatencyHistogram::FormatHeader (CString *pString)
+{
+	assert (pString != 0);
+
+	pString->Append (Header);
+	pString->Append ('\n');
+}
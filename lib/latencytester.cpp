@@ -2,7 +2,7 @@
 // latencytester.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2016-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2016-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -27,7 +27,11 @@
 
 CLatencyTester::CLatencyTester (CInterruptSystem *pInterruptSystem)
 :	m_pInterruptSystem (pInterruptSystem),
-	m_bRunning (FALSE)
+	m_bRunning (FALSE),
+	m_bFIQ (FALSE),
+	m_IRQHistogram ("irq latency"),
+	m_FIQHistogram ("fiq latency"),
+	m_SpinLock (FIQ_LEVEL)
 {
 }
 
@@ -39,9 +43,10 @@ CLatencyTester::~CLatencyTester (void)
 	}
 }
 
-void CLatencyTester::Start (unsigned nSampleRateHZ)
+void CLatencyTester::Start (unsigned nSampleRateHZ, boolean bFIQ)
 {
 	assert (!m_bRunning);
+	m_bFIQ = bFIQ;
 
 	m_nWantedDelay = (1000000 + nSampleRateHZ/2) / nSampleRateHZ;
 
@@ -51,6 +56,15 @@ void CLatencyTester::Start (unsigned nSampleRateHZ)
 	m_nSamples = 0;
 	m_bOverflow = FALSE;
 
+	if (m_bFIQ)
+	{
+		m_FIQHistogram.Reset ();
+	}
+	else
+	{
+		m_IRQHistogram.Reset ();
+	}
+
 	m_bRunning = TRUE;
 
 	PeripheralEntry ();
@@ -59,14 +73,28 @@ void CLatencyTester::Start (unsigned nSampleRateHZ)
 	
 	PeripheralExit ();
 
-	m_pInterruptSystem->ConnectIRQ (ARM_IRQ_TIMER1, InterruptStub, this);
+	if (m_bFIQ)
+	{
+		m_pInterruptSystem->ConnectFIQ (ARM_FIQ_TIMER1, InterruptStub, this);
+	}
+	else
+	{
+		m_pInterruptSystem->ConnectIRQ (ARM_IRQ_TIMER1, InterruptStub, this);
+	}
 }
 
 void CLatencyTester::Stop (void)
 {
 	assert (m_bRunning);
 
-	m_pInterruptSystem->DisconnectIRQ (ARM_IRQ_TIMER1);
+	if (m_bFIQ)
+	{
+		m_pInterruptSystem->DisconnectFIQ ();
+	}
+	else
+	{
+		m_pInterruptSystem->DisconnectIRQ (ARM_IRQ_TIMER1);
+	}
 
 	m_bRunning = FALSE;
 }
@@ -100,10 +128,21 @@ unsigned CLatencyTester::GetAvg (void)
 	return nSamples > 0 ? nDelayAccu / nSamples : 0;
 }
 
+const CLatencyHistogram *CLatencyTester::GetHistogram (void) const
+{
+	return m_bFIQ ? &m_FIQHistogram : &m_IRQHistogram;
+}
+
 void CLatencyTester::Dump (void)
 {
-	CLogger::Get ()->Write ("latency", LogNotice, "IRQ latency: Min %u Max %u Avg %u (us)",
-				GetMin (), GetMax (), GetAvg ());
+	const CLatencyHistogram *pHistogram = GetHistogram ();
+
+	CLogger::Get ()->Write ("latency", LogNotice,
+				"%s latency: Min %u Max %u Avg %u p50 %u p99 %u p99.9 %u (us)",
+				m_bFIQ ? "FIQ" : "IRQ", GetMin (), GetMax (), GetAvg (),
+				pHistogram->GetPercentile (500) / 1000,
+				pHistogram->GetPercentile (990) / 1000,
+				pHistogram->GetPercentile (999) / 1000);
 }
 
 void CLatencyTester::InterruptHandler (void)
@@ -146,6 +185,15 @@ void CLatencyTester::InterruptHandler (void)
 
 	m_SpinLock.Release ();
 
+	if (m_bFIQ)
+	{
+		m_FIQHistogram.Record (nDelay * 1000);
+	}
+	else
+	{
+		m_IRQHistogram.Record (nDelay * 1000);
+	}
+
 	write32 (ARM_SYSTIMER_C1, read32 (ARM_SYSTIMER_CLO) + m_nWantedDelay);
 	write32 (ARM_SYSTIMER_CS, 1 << 1);
 
@@ -0,0 +1,281 @@
+//
+// lockstatistics.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/lockstatistics.h>
+#include <circle/multicore.h>
+#include <circle/tracer.h>
+#include <circle/logger.h>
+#include <circle/atomic.h>
+#include <circle/string.h>
+#include <circle/util.h>
+#include <assert.h>
+
+static const char FromLockStats[] = "lockstats";
+
+static const char *TypeName[] = {"spin", "mutex", "?"};
+
+CLockStatistics::TSite CLockStatistics::s_Site[LOCK_STATISTICS_SITES];
+volatile int CLockStatistics::s_nSites = 0;
+
+unsigned CLockStatistics::Register (const char *pName, uintptr nCallSite, TLockType Type)
+{
+	int nSites = AtomicGet (&s_nSites);
+	for (int i = 0; i < nSites && i < LOCK_STATISTICS_SITES; i++)
+	{
+		if (IsSameSite (&s_Site[i], pName, nCallSite, Type))
+		{
+			return i;
+		}
+	}
+
+	// another core may add the same site concurrently, GetReport() merges them
+	int nSite = AtomicIncrement (&s_nSites) - 1;
+	if (nSite >= LOCK_STATISTICS_SITES)
+	{
+		AtomicSet (&s_nSites, LOCK_STATISTICS_SITES);
+
+		return LOCK_STATISTICS_OVERFLOW;
+	}
+
+	TSite *pSite = &s_Site[nSite];
+	memset (pSite->Core, 0, sizeof pSite->Core);
+	pSite->pName = pName;
+	pSite->nCallSite = nCallSite;
+	pSite->Type = Type;
+
+	DataMemBarrier ();
+	pSite->bValid = TRUE;			// marks the entry valid
+
+	return nSite;
+}
+
+void CLockStatistics::Acquired (unsigned nSite, boolean bContended, u64 nWaitTicks)
+{
+	if (nSite >= LOCK_STATISTICS_SITES)
+	{
+		return;
+	}
+
+	TCoreCounters *pCounters = &s_Site[nSite].Core[ThisCore ()];
+	pCounters->nAcquires++;
+
+	if (bContended)
+	{
+		pCounters->nContended++;
+		pCounters->nWaitTicks += nWaitTicks;
+	}
+}
+
+void CLockStatistics::Released (unsigned nSite, u64 nHoldTicks)
+{
+	if (nSite >= LOCK_STATISTICS_SITES)
+	{
+		return;
+	}
+
+	TCoreCounters *pCounters = &s_Site[nSite].Core[ThisCore ()];
+	pCounters->nHoldTicks += nHoldTicks;
+
+	if (nHoldTicks > pCounters->nMaxHoldTicks)
+	{
+		pCounters->nMaxHoldTicks = nHoldTicks;
+	}
+}
+
+void CLockStatistics::Reset (void)
+{
+	int nSites = AtomicGet (&s_nSites);
+	for (int i = 0; i < nSites && i < LOCK_STATISTICS_SITES; i++)
+	{
+		memset (s_Site[i].Core, 0, sizeof s_Site[i].Core);
+	}
+}
+
+unsigned CLockStatistics::GetReport (TLockReport *pReport, unsigned nMaxEntries)
+{
+	assert (pReport != 0);
+
+	unsigned nEntries = 0;
+
+	int nSites = AtomicGet (&s_nSites);
+	if (nSites > LOCK_STATISTICS_SITES)
+	{
+		nSites = LOCK_STATISTICS_SITES;
+	}
+
+	for (int i = 0; i < nSites; i++)
+	{
+		const TSite *pSite = &s_Site[i];
+		if (!pSite->bValid)
+		{
+			continue;
+		}
+
+		// a site, which has been added twice, is accounted at its first entry
+		boolean bDuplicate = FALSE;
+		for (int j = 0; j < i && !bDuplicate; j++)
+		{
+			bDuplicate = IsSameSite (&s_Site[j], pSite->pName, pSite->nCallSite,
+						 pSite->Type);
+		}
+
+		if (bDuplicate)
+		{
+			continue;
+		}
+
+		TLockReport Entry;
+		Entry.pName = pSite->pName;
+		Entry.nCallSite = pSite->nCallSite;
+		Entry.Type = pSite->Type;
+		Entry.nAcquires = 0;
+		Entry.nContended = 0;
+		Entry.nWaitTicks = 0;
+		Entry.nHoldTicks = 0;
+		Entry.nMaxHoldTicks = 0;
+
+		for (int j = i; j < nSites; j++)
+		{
+			const TSite *pSameSite = &s_Site[j];
+			if (   j > i
+			    && !IsSameSite (pSameSite, pSite->pName, pSite->nCallSite, pSite->Type))
+			{
+				continue;
+			}
+
+			for (unsigned nCore = 0; nCore < LOCK_STATISTICS_CORES; nCore++)
+			{
+				const TCoreCounters *pCounters = &pSameSite->Core[nCore];
+
+				Entry.nAcquires += pCounters->nAcquires;
+				Entry.nContended += pCounters->nContended;
+				Entry.nWaitTicks += pCounters->nWaitTicks;
+				Entry.nHoldTicks += pCounters->nHoldTicks;
+				if (pCounters->nMaxHoldTicks > Entry.nMaxHoldTicks)
+				{
+					Entry.nMaxHoldTicks = pCounters->nMaxHoldTicks;
+				}
+			}
+		}
+
+		if (Entry.nAcquires == 0)
+		{
+			continue;
+		}
+
+		// insert into the sorted report
+		unsigned nPos = nEntries;
+		while (   nPos > 0
+		       && (   Entry.nWaitTicks > pReport[nPos-1].nWaitTicks
+			   || (   Entry.nWaitTicks == pReport[nPos-1].nWaitTicks
+			       && Entry.nAcquires > pReport[nPos-1].nAcquires)))
+		{
+			if (nPos < nMaxEntries)
+			{
+				pReport[nPos] = pReport[nPos-1];
+			}
+
+			nPos--;
+		}
+
+		if (nPos < nMaxEntries)
+		{
+			pReport[nPos] = Entry;
+
+			if (nEntries < nMaxEntries)
+			{
+				nEntries++;
+			}
+		}
+	}
+
+	return nEntries;
+}
+
+void CLockStatistics::Dump (unsigned nMaxEntries)
+{
+	TLockReport *pReport = new TLockReport[nMaxEntries];
+	if (pReport == 0)
+	{
+		return;
+	}
+
+	unsigned nEntries = GetReport (pReport, nMaxEntries);
+
+	CLogger *pLogger = CLogger::Get ();
+	u64 nFrequency = CTracer::GetTimestampFrequency ();
+
+	pLogger->Write (FromLockStats, LogNotice,
+			"Lock                       Type   Acquires Contended  Wait(us) Hold(us) Max(us)");
+
+	for (unsigned i = 0; i < nEntries; i++)
+	{
+		const TLockReport *pEntry = &pReport[i];
+
+		CString Name;
+		if (pEntry->pName != 0)
+		{
+			Name = pEntry->pName;
+		}
+		else
+		{
+			Name.Format ("@%lX", (unsigned long) pEntry->nCallSite);
+		}
+
+		assert (pEntry->Type <= LockTypeUnknown);
+		pLogger->Write (FromLockStats, LogNotice, "%-26s %-6s %8u %9u %9u %8u %7u",
+				(const char *) Name, TypeName[pEntry->Type],
+				pEntry->nAcquires, pEntry->nContended,
+				(unsigned) (pEntry->nWaitTicks * 1000000 / nFrequency),
+				(unsigned) (pEntry->nHoldTicks * 1000000 / nFrequency),
+				(unsigned) (pEntry->nMaxHoldTicks * 1000000 / nFrequency));
+	}
+
+	delete [] pReport;
+}
+
+boolean CLockStatistics::IsSameSite (const TSite *pSite, const char *pName, uintptr nCallSite,
+				     TLockType Type)
+{
+	assert (pSite != 0);
+
+	if (   !pSite->bValid
+	    || pSite->Type != Type)
+	{
+		return FALSE;
+	}
+
+	if (pName != 0)
+	{
+		return    pSite->pName != 0
+		       && strcmp (pSite->pName, pName) == 0;
+	}
+
+	return    pSite->pName == 0
+	       && pSite->nCallSite == nCallSite;
+}
+
+unsigned CLockStatistics::ThisCore (void)
+{
+#ifdef ARM_ALLOW_MULTI_CORE
+	return CMultiCoreSupport::ThisCore ();
+#else
+	return 0;
+#endif
+}
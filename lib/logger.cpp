@@ -2,7 +2,7 @@
 // logger.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -27,6 +27,7 @@
 #include <circle/machineinfo.h>
 #include <circle/version.h>
 #include <circle/debug.h>
+#include <assert.h>
 
 struct TLogEvent
 {
@@ -38,6 +39,164 @@ struct TLogEvent
 	int		nTimeZone;			// minutes diff to UTC
 };
 
+struct TLogRecord
+{
+	u64		nTimestamp;			// CTimer::GetClockTicks64 ()
+	const char	*pMessage;			// format string (in read-only data)
+	TLogSeverity	Severity;
+	unsigned	nArgs;
+	u64		Arg[LOG_DEFERRED_MAX_ARGS];	// raw arguments or offset into Strings
+	char		Strings[LOG_DEFERRED_STRINGS];	// source at offset 0, %s arguments
+};
+
+struct TLogRing
+{
+	TLogRecord	*pRecord;
+	volatile unsigned nInPtr;			// written by the owning core only
+	volatile unsigned nOutPtr;			// written by the reader only
+	volatile unsigned nDropped;
+	unsigned	nDroppedReported;
+};
+
+#ifdef ARM_ALLOW_MULTI_CORE
+	#define LOG_DEFERRED_RINGS	CORES
+#else
+	#define LOG_DEFERRED_RINGS	1
+#endif
+
+#define LOG_MAX_SPEC		20		// max. length of a conversion spec ("%08lx")
+
+enum TLogArgType
+{
+	LogArgNone,		// "%%" or unknown conversion
+	LogArgInt,
+	LogArgLong,
+	LogArgLongLong,
+	LogArgUnsigned,
+	LogArgUnsignedLong,
+	LogArgUnsignedLongLong,
+	LogArgDouble,
+	LogArgString
+};
+
+// Parses a conversion spec the same way as CString::FormatV().
+// pFormat points behind the '%', returns pointer to the conversion character
+static const char *ParseConversion (const char *pFormat, TLogArgType *pType)
+{
+	if (*pFormat == '%')
+	{
+		*pType = LogArgNone;
+
+		return pFormat;
+	}
+
+	if (*pFormat == '#')
+	{
+		pFormat++;
+	}
+
+	if (*pFormat == '-')
+	{
+		pFormat++;
+	}
+
+	if (*pFormat == '0')
+	{
+		pFormat++;
+	}
+
+	while ('0' <= *pFormat && *pFormat <= '9')
+	{
+		pFormat++;
+	}
+
+	if (*pFormat == '.')
+	{
+		pFormat++;
+
+		while ('0' <= *pFormat && *pFormat <= '9')
+		{
+			pFormat++;
+		}
+	}
+
+	unsigned nLong = 0;
+	if (*pFormat == 'l')
+	{
+		nLong++;
+		pFormat++;
+
+#if STDLIB_SUPPORT >= 1
+		if (*pFormat == 'l')
+		{
+			nLong++;
+			pFormat++;
+		}
+#endif
+	}
+
+	switch (*pFormat)
+	{
+	case 'c':
+		*pType = LogArgInt;
+		break;
+
+	case 'd':
+	case 'i':
+		*pType = nLong == 0 ? LogArgInt : (nLong == 1 ? LogArgLong : LogArgLongLong);
+		break;
+
+	case 'f':
+		*pType = LogArgDouble;
+		break;
+
+	case 's':
+		*pType = LogArgString;
+		break;
+
+	case 'o':
+	case 'u':
+	case 'x':
+	case 'X':
+	case 'p':
+		*pType =   nLong == 0
+			 ? LogArgUnsigned
+			 : (nLong == 1 ? LogArgUnsignedLong : LogArgUnsignedLongLong);
+		break;
+
+	default:
+		*pType = LogArgNone;
+		break;
+	}
+
+	return pFormat;
+}
+
+// Copies a string into the string space of a record, truncates it, if the space is exhausted.
+// Returns offset of the copied string.
+static unsigned StoreString (char *pStrings, unsigned *pUsed, const char *pString)
+{
+	unsigned nStart = *pUsed;
+	unsigned nOffset = nStart;
+
+	while (   *pString != '\0'
+	       && nOffset < LOG_DEFERRED_STRINGS-1)
+	{
+		pStrings[nOffset++] = *pString++;
+	}
+
+	pStrings[nOffset] = '\0';
+
+	if (nOffset < LOG_DEFERRED_STRINGS-1)
+	{
+		nOffset++;
+	}
+
+	*pUsed = nOffset;
+
+	return nStart;
+}
+
 CLogger *CLogger::s_pThis = 0;
 
 CLogger::CLogger (unsigned nLogLevel, CTimer *pTimer, boolean bOverwriteOldest)
@@ -50,9 +209,16 @@ CLogger::CLogger (unsigned nLogLevel, CTimer *pTimer, boolean bOverwriteOldest)
 	m_nOutPtr (0),
 	m_nEventInPtr (0),
 	m_nEventOutPtr (0),
+	m_pDeferredRing (0),
+	m_nDeferredRecords (0),
+	m_DeferredSpinLock (FIQ_LEVEL),
 	m_pEventNotificationHandler (0),
 	m_pPanicHandler (0)
 {
+	m_SpinLock.SetName ("logger");
+	m_EventSpinLock.SetName ("logevents");
+	m_DeferredSpinLock.SetName ("logdeferred");
+
 	m_pBuffer = new char[LOGGER_BUFSIZE];
 
 	s_pThis = this;
@@ -72,6 +238,17 @@ CLogger::~CLogger (void)
 		}
 	}
 
+	if (m_pDeferredRing != 0)
+	{
+		for (unsigned i = 0; i < LOG_DEFERRED_RINGS; i++)
+		{
+			delete [] m_pDeferredRing[i].pRecord;
+		}
+
+		delete [] m_pDeferredRing;
+		m_pDeferredRing = 0;
+	}
+
 	delete [] m_pBuffer;
 	m_pBuffer = 0;
 
@@ -131,65 +308,22 @@ void CLogger::Write (const char *pSource, TLogSeverity Severity, const char *pMe
 
 void CLogger::WriteV (const char *pSource, TLogSeverity Severity, const char *pMessage, va_list Args)
 {
-	CString Message;
-	Message.FormatV (pMessage, Args);
-
-	WriteEvent (pSource, Severity, Message);
-
-	if (Severity > m_nLogLevel)
-	{
-		return;
-	}
-
-	CString Buffer;
-
-#ifdef USE_LOG_COLORS
-	switch (Severity)
-	{
-	case LogPanic:		Buffer = "\x1b[91m";	break;
-	case LogError:		Buffer = "\x1b[95m";	break;
-	case LogWarning:	Buffer = "\x1b[93m";	break;
-	default:		Buffer = "\x1b[97m";	break;
-	}
-#else
-	if (Severity == LogPanic)
-	{
-		Buffer = "\x1b[1m";
-	}
-#endif
-
-	if (m_pTimer != 0)
+	if (m_pDeferredRing != 0)
 	{
-		CString *pTimeString = m_pTimer->GetTimeString ();
-		if (pTimeString != 0)
+		if (Severity == LogPanic)
 		{
-			Buffer.Append (*pTimeString);
-			Buffer.Append (" ");
-
-			delete pTimeString;
+			Flush ();
+		}
+		else if (WriteDeferred (pSource, Severity, pMessage, Args))
+		{
+			return;
 		}
 	}
 
-	Buffer.Append (pSource);
-	Buffer.Append (": ");
-
-	Buffer.Append (Message);
-
-#ifdef USE_LOG_COLORS
-	if (Severity <= LogWarning)
-	{
-		Buffer.Append ("\x1b[97m");
-	}
-#else
-	if (Severity == LogPanic)
-	{
-		Buffer.Append ("\x1b[0m");
-	}
-#endif
-
-	Buffer.Append ("\n");
+	CString Message;
+	Message.FormatV (pMessage, Args);
 
-	Write (Buffer);
+	WriteMessage (pSource, Severity, Message);
 
 	if (Severity == LogPanic)
 	{
@@ -256,6 +390,109 @@ void CLogger::WriteNoAlloc (const char *pSource, TLogSeverity Severity, const ch
 	}
 }
 
+boolean CLogger::EnableDeferredMode (unsigned nRecords)
+{
+	assert (m_pDeferredRing == 0);
+	assert (nRecords >= 2);
+	assert (!(nRecords & (nRecords-1)));
+
+	TLogRing *pRing = new TLogRing[LOG_DEFERRED_RINGS];
+	if (pRing == 0)
+	{
+		return FALSE;
+	}
+
+	for (unsigned i = 0; i < LOG_DEFERRED_RINGS; i++)
+	{
+		pRing[i].pRecord = new TLogRecord[nRecords];
+		if (pRing[i].pRecord == 0)
+		{
+			while (i--)
+			{
+				delete [] pRing[i].pRecord;
+			}
+
+			delete [] pRing;
+
+			return FALSE;
+		}
+
+		pRing[i].nInPtr = 0;
+		pRing[i].nOutPtr = 0;
+		pRing[i].nDropped = 0;
+		pRing[i].nDroppedReported = 0;
+	}
+
+	m_nDeferredRecords = nRecords;
+
+	DataMemBarrier ();
+
+	m_pDeferredRing = pRing;
+
+	return TRUE;
+}
+
+unsigned CLogger::Flush (void)
+{
+	if (m_pDeferredRing == 0)
+	{
+		return 0;
+	}
+
+	unsigned nMessages = 0;
+
+	TLogRecord Record;
+	while (ReadDeferred (&Record))
+	{
+		CString Message;
+		FormatRecord (&Message, &Record);
+
+		WriteMessage (Record.Strings, Record.Severity, Message, Record.nTimestamp);
+
+		nMessages++;
+	}
+
+	for (unsigned i = 0; i < LOG_DEFERRED_RINGS; i++)
+	{
+		TLogRing *pRing = &m_pDeferredRing[i];
+
+		m_DeferredSpinLock.Acquire ();
+
+		unsigned nDropped = pRing->nDropped - pRing->nDroppedReported;
+		pRing->nDroppedReported += nDropped;
+
+		m_DeferredSpinLock.Release ();
+
+		if (nDropped != 0)
+		{
+			CString Message;
+			Message.Format ("%u deferred message(s) dropped on core %u", nDropped, i);
+
+			WriteMessage ("logger", LogWarning, Message);
+
+			nMessages++;
+		}
+	}
+
+	return nMessages;
+}
+
+unsigned CLogger::GetDroppedMessages (void) const
+{
+	if (m_pDeferredRing == 0)
+	{
+		return 0;
+	}
+
+	unsigned nResult = 0;
+	for (unsigned i = 0; i < LOG_DEFERRED_RINGS; i++)
+	{
+		nResult += m_pDeferredRing[i].nDropped;
+	}
+
+	return nResult;
+}
+
 CLogger *CLogger::Get (void)
 {
 	if (s_pThis == 0)
@@ -266,6 +503,69 @@ CLogger *CLogger::Get (void)
 	return s_pThis;
 }
 
+void CLogger::WriteMessage (const char *pSource, TLogSeverity Severity, const char *pMessage,
+			    u64 nTimestamp)
+{
+	WriteEvent (pSource, Severity, pMessage, nTimestamp);
+
+	if (Severity > m_nLogLevel)
+	{
+		return;
+	}
+
+	CString Buffer;
+
+#ifdef USE_LOG_COLORS
+	switch (Severity)
+	{
+	case LogPanic:		Buffer = "\x1b[91m";	break;
+	case LogError:		Buffer = "\x1b[95m";	break;
+	case LogWarning:	Buffer = "\x1b[93m";	break;
+	default:		Buffer = "\x1b[97m";	break;
+	}
+#else
+	if (Severity == LogPanic)
+	{
+		Buffer = "\x1b[1m";
+	}
+#endif
+
+	if (m_pTimer != 0)
+	{
+		CString *pTimeString =   nTimestamp == 0
+				       ? m_pTimer->GetTimeString ()
+				       : m_pTimer->GetTimeString (nTimestamp);
+		if (pTimeString != 0)
+		{
+			Buffer.Append (*pTimeString);
+			Buffer.Append (" ");
+
+			delete pTimeString;
+		}
+	}
+
+	Buffer.Append (pSource);
+	Buffer.Append (": ");
+
+	Buffer.Append (pMessage);
+
+#ifdef USE_LOG_COLORS
+	if (Severity <= LogWarning)
+	{
+		Buffer.Append ("\x1b[97m");
+	}
+#else
+	if (Severity == LogPanic)
+	{
+		Buffer.Append ("\x1b[0m");
+	}
+#endif
+
+	Buffer.Append ("\n");
+
+	Write (Buffer);
+}
+
 void CLogger::Write (const char *pString)
 {
 	unsigned long nLength = strlen (pString);
@@ -346,7 +646,8 @@ int CLogger::Read (void *pBuffer, unsigned nCount, boolean bClear)
 	return nResult;
 }
 
-void CLogger::WriteEvent (const char *pSource, TLogSeverity Severity, const char *pMessage)
+void CLogger::WriteEvent (const char *pSource, TLogSeverity Severity, const char *pMessage,
+			  u64 nTimestamp)
 {
 	TLogEvent *pEvent = new TLogEvent;
 	if (pEvent == 0)
@@ -364,7 +665,9 @@ void CLogger::WriteEvent (const char *pSource, TLogSeverity Severity, const char
 
 	unsigned nSeconds, nMicroSeconds;
 	if (   m_pTimer != 0
-	    && m_pTimer->GetLocalTime (&nSeconds, &nMicroSeconds))
+	    && (  nTimestamp == 0
+		? m_pTimer->GetLocalTime (&nSeconds, &nMicroSeconds)
+		: m_pTimer->GetLocalTime (nTimestamp, &nSeconds, &nMicroSeconds)))
 	{
 		pEvent->Time = nSeconds;
 		pEvent->nHundredthTime = nMicroSeconds / 10000;
@@ -411,6 +714,294 @@ void CLogger::WriteEvent (const char *pSource, TLogSeverity Severity, const char
 	}
 }
 
+boolean CLogger::WriteDeferred (const char *pSource, TLogSeverity Severity,
+				const char *pMessage, va_list Args)
+{
+	// the format string is referenced later, so it must be in read-only data
+	extern u8 __init_start;
+	if ((uintptr) pMessage >= (uintptr) &__init_start)
+	{
+		return FALSE;
+	}
+
+	// count the arguments first, because they cannot be put back to Args
+	unsigned nArgs = 0;
+	for (const char *pFormat = pMessage; *pFormat != '\0'; pFormat++)
+	{
+		if (*pFormat == '%')
+		{
+			TLogArgType Type;
+			pFormat = ParseConversion (pFormat+1, &Type);
+			if (Type != LogArgNone)
+			{
+				nArgs++;
+			}
+
+			if (*pFormat == '\0')
+			{
+				break;
+			}
+		}
+	}
+
+	if (nArgs > LOG_DEFERRED_MAX_ARGS)
+	{
+		return FALSE;
+	}
+
+	u64 nTimestamp = CTimer::GetClockTicks64 ();
+
+#ifdef ARM_ALLOW_MULTI_CORE
+	TLogRing *pRing = &m_pDeferredRing[CMultiCoreSupport::ThisCore ()];
+#else
+	TLogRing *pRing = &m_pDeferredRing[0];
+#endif
+
+	// the ring of this core may be written from task, IRQ and FIQ context
+	EnterCritical (FIQ_LEVEL);
+
+	unsigned nInPtr = pRing->nInPtr;
+	if (nInPtr - pRing->nOutPtr >= m_nDeferredRecords)
+	{
+		pRing->nDropped++;
+
+		LeaveCritical ();
+
+		return TRUE;
+	}
+
+	TLogRecord *pRecord = &pRing->pRecord[nInPtr & (m_nDeferredRecords-1)];
+
+	pRecord->nTimestamp = nTimestamp;
+	pRecord->pMessage = pMessage;
+	pRecord->Severity = Severity;
+	pRecord->nArgs = nArgs;
+
+	unsigned nStringsUsed = 0;
+	StoreString (pRecord->Strings, &nStringsUsed, pSource);
+
+	unsigned nArg = 0;
+	for (const char *pFormat = pMessage; *pFormat != '\0'; pFormat++)
+	{
+		if (*pFormat != '%')
+		{
+			continue;
+		}
+
+		TLogArgType Type;
+		pFormat = ParseConversion (pFormat+1, &Type);
+
+		switch (Type)
+		{
+		case LogArgNone:
+			break;
+
+		case LogArgInt:
+			pRecord->Arg[nArg++] = (u64) va_arg (Args, int);
+			break;
+
+		case LogArgLong:
+			pRecord->Arg[nArg++] = (u64) va_arg (Args, long);
+			break;
+
+		case LogArgLongLong:
+			pRecord->Arg[nArg++] = (u64) va_arg (Args, long long);
+			break;
+
+		case LogArgUnsigned:
+			pRecord->Arg[nArg++] = va_arg (Args, unsigned);
+			break;
+
+		case LogArgUnsignedLong:
+			pRecord->Arg[nArg++] = va_arg (Args, unsigned long);
+			break;
+
+		case LogArgUnsignedLongLong:
+			pRecord->Arg[nArg++] = va_arg (Args, unsigned long long);
+			break;
+
+		case LogArgDouble: {
+			double fArg = va_arg (Args, double);
+			memcpy (&pRecord->Arg[nArg++], &fArg, sizeof fArg);
+			} break;
+
+		case LogArgString:
+			pRecord->Arg[nArg++] = StoreString (pRecord->Strings, &nStringsUsed,
+							    va_arg (Args, const char *));
+			break;
+		}
+
+		if (*pFormat == '\0')
+		{
+			break;
+		}
+	}
+
+	assert (nArg == nArgs);
+
+	DataMemBarrier ();
+
+	pRing->nInPtr = nInPtr + 1;
+
+	LeaveCritical ();
+
+	return TRUE;
+}
+
+// returns the oldest record of all rings
+boolean CLogger::ReadDeferred (TLogRecord *pRecord)
+{
+	assert (m_pDeferredRing != 0);
+
+	m_DeferredSpinLock.Acquire ();
+
+	TLogRing *pOldestRing = 0;
+	TLogRecord *pOldestRecord = 0;
+	for (unsigned i = 0; i < LOG_DEFERRED_RINGS; i++)
+	{
+		TLogRing *pRing = &m_pDeferredRing[i];
+
+		unsigned nOutPtr = pRing->nOutPtr;
+		if (nOutPtr == pRing->nInPtr)
+		{
+			continue;
+		}
+
+		DataMemBarrier ();
+
+		TLogRecord *pRecord = &pRing->pRecord[nOutPtr & (m_nDeferredRecords-1)];
+		if (   pOldestRecord == 0
+		    || pRecord->nTimestamp < pOldestRecord->nTimestamp)
+		{
+			pOldestRing = pRing;
+			pOldestRecord = pRecord;
+		}
+	}
+
+	if (pOldestRecord == 0)
+	{
+		m_DeferredSpinLock.Release ();
+
+		return FALSE;
+	}
+
+	memcpy (pRecord, pOldestRecord, sizeof *pRecord);
+
+	DataMemBarrier ();
+
+	pOldestRing->nOutPtr++;
+
+	m_DeferredSpinLock.Release ();
+
+	return TRUE;
+}
+
+void CLogger::FormatRecord (CString *pResult, const TLogRecord *pRecord)
+{
+	assert (pResult != 0);
+	assert (pRecord != 0);
+
+	char Text[LOG_MAX_SPEC+1];
+	unsigned nText = 0;
+	unsigned nArg = 0;
+
+	const char *pFormat = pRecord->pMessage;
+	while (*pFormat != '\0')
+	{
+		if (*pFormat != '%')
+		{
+			Text[nText++] = *pFormat++;
+			if (nText == LOG_MAX_SPEC)
+			{
+				Text[nText] = '\0';
+				pResult->Append (Text);
+				nText = 0;
+			}
+
+			continue;
+		}
+
+		if (nText > 0)
+		{
+			Text[nText] = '\0';
+			pResult->Append (Text);
+			nText = 0;
+		}
+
+		TLogArgType Type;
+		const char *pEnd = ParseConversion (pFormat+1, &Type);
+		if (*pEnd == '\0')
+		{
+			break;
+		}
+
+		u64 nArgValue = Type != LogArgNone ? pRecord->Arg[nArg++] : 0;
+
+		unsigned nSpecLen = pEnd - pFormat + 1;
+		pFormat = pEnd + 1;
+		if (nSpecLen > LOG_MAX_SPEC)
+		{
+			continue;			// ignore unreasonable width or precision
+		}
+
+		// the conversion spec is formatted with the stored argument by CString::Format()
+		char Spec[LOG_MAX_SPEC+1];
+		memcpy (Spec, pEnd - nSpecLen + 1, nSpecLen);
+		Spec[nSpecLen] = '\0';
+
+		CString Piece;
+		switch (Type)
+		{
+		case LogArgNone:
+			Piece.Format (Spec);
+			break;
+
+		case LogArgInt:
+			Piece.Format (Spec, (int) nArgValue);
+			break;
+
+		case LogArgLong:
+			Piece.Format (Spec, (long) nArgValue);
+			break;
+
+		case LogArgLongLong:
+			Piece.Format (Spec, (long long) nArgValue);
+			break;
+
+		case LogArgUnsigned:
+			Piece.Format (Spec, (unsigned) nArgValue);
+			break;
+
+		case LogArgUnsignedLong:
+			Piece.Format (Spec, (unsigned long) nArgValue);
+			break;
+
+		case LogArgUnsignedLongLong:
+			Piece.Format (Spec, (unsigned long long) nArgValue);
+			break;
+
+		case LogArgDouble: {
+			double fArg;
+			memcpy (&fArg, &nArgValue, sizeof fArg);
+			Piece.Format (Spec, fArg);
+			} break;
+
+		case LogArgString:
+			assert (nArgValue < LOG_DEFERRED_STRINGS);
+			Piece.Format (Spec, pRecord->Strings + nArgValue);
+			break;
+		}
+
+		pResult->Append (Piece);
+	}
+
+	if (nText > 0)
+	{
+		Text[nText] = '\0';
+		pResult->Append (Text);
+	}
+}
+
 boolean CLogger::ReadEvent (TLogSeverity *pSeverity, char *pSource, char *pMessage,
 			    time_t *pTime, unsigned *pHundredthTime, int *pTimeZone)
 {
@@ -2,7 +2,7 @@
 // memory64.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -145,6 +145,12 @@ size_t CMemorySystem::GetMemSize (void) const
 	return s_pThis->m_nMemSize + s_pThis->m_nMemSizeHigh;
 }
 
+CTranslationTable *CMemorySystem::GetTranslationTable (void) const
+{
+	assert (s_pThis != 0);
+	return s_pThis->m_pTranslationTable;
+}
+
 CMemorySystem *CMemorySystem::Get (void)
 {
 	assert (s_pThis != 0);
@@ -0,0 +1,240 @@
+//
+// metrics.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/metrics.h>
+#include <circle/multicore.h>
+#include <circle/util.h>
+#include <assert.h>
+
+static const char *TypeName[] = {"counter", "gauge", "untyped"};
+
+CMetric *CMetric::s_pFirst = 0;
+CSpinLock CMetric::s_SpinLock (TASK_LEVEL);
+
+CMetric::CMetric (TMetricType Type, const char *pName, const char *pHelp,
+		  const char *pLabelName, const char *pLabelValue)
+:	m_Type (Type),
+	m_pName (pName),
+	m_pHelp (pHelp),
+	m_pLabelName (pLabelName),
+	m_pLabelValue (pLabelValue),
+	m_pNext (0)
+{
+	assert (m_pName != 0);
+	assert (m_pHelp != 0);
+	assert (m_pLabelName == 0 || m_pLabelValue != 0);
+
+	s_SpinLock.Acquire ();
+
+	// insert behind the last metric with the same name, otherwise at the end of the list
+	CMetric **ppInsert = 0;
+	CMetric **ppMetric = &s_pFirst;
+	for (; *ppMetric != 0; ppMetric = &(*ppMetric)->m_pNext)
+	{
+		if (strcmp ((*ppMetric)->m_pName, m_pName) == 0)
+		{
+			ppInsert = &(*ppMetric)->m_pNext;
+		}
+	}
+
+	if (ppInsert == 0)
+	{
+		ppInsert = ppMetric;
+	}
+
+	m_pNext = *ppInsert;
+	*ppInsert = this;
+
+	s_SpinLock.Release ();
+}
+
+CMetric::~CMetric (void)
+{
+	s_SpinLock.Acquire ();
+
+	CMetric **ppPrev = &s_pFirst;
+	while (*ppPrev != this)
+	{
+		assert (*ppPrev != 0);
+		ppPrev = &(*ppPrev)->m_pNext;
+	}
+
+	*ppPrev = m_pNext;
+
+	s_SpinLock.Release ();
+}
+
+void CMetric::FormatAll (CString *pString)
+{
+	assert (pString != 0);
+
+	s_SpinLock.Acquire ();
+
+	const char *pPrevName = "";
+	for (const CMetric *pMetric = s_pFirst; pMetric != 0; pMetric = pMetric->m_pNext)
+	{
+		pMetric->Format (pString, strcmp (pMetric->m_pName, pPrevName) != 0);
+
+		pPrevName = pMetric->m_pName;
+	}
+
+	s_SpinLock.Release ();
+}
+
+void CMetric::Format (CString *pString, boolean bWithHeader) const
+{
+	assert (pString != 0);
+
+	if (bWithHeader)
+	{
+		assert (m_Type <= MetricTypeUnknown);
+
+		CString Header;
+		Header.Format ("# HELP %s %s\n# TYPE %s %s\n",
+			       m_pName, m_pHelp, m_pName, TypeName[m_Type]);
+
+		pString->Append (Header);
+	}
+
+	pString->Append (m_pName);
+
+	if (m_pLabelName != 0)
+	{
+		pString->Append ('{');
+		pString->Append (m_pLabelName);
+		pString->Append ("=\"");
+		pString->Append (m_pLabelValue);
+		pString->Append ("\"}");
+	}
+
+	pString->Append (' ');
+	AppendNumber (pString, GetValue ());
+	pString->Append ('\n');
+}
+
+void CMetric::AppendNumber (CString *pString, s64 nValue)
+{
+	assert (pString != 0);
+
+	u64 nRest = (u64) nValue;
+	if (nValue < 0)
+	{
+		pString->Append ('-');
+
+		nRest = -nRest;
+	}
+
+	char Buffer[24];
+	char *p = &Buffer[sizeof Buffer - 1];
+	*p = '\0';
+
+	do
+	{
+		*--p = '0' + nRest % 10;
+		nRest /= 10;
+	}
+	while (nRest != 0);
+
+	pString->Append (p);
+}
+
+CMetricCounter::CMetricCounter (const char *pName, const char *pHelp,
+				const char *pLabelName, const char *pLabelValue)
+:	CMetric (MetricTypeCounter, pName, pHelp, pLabelName, pLabelValue)
+{
+	for (unsigned nCore = 0; nCore < METRICS_CORES; nCore++)
+	{
+		m_Core[nCore].nValue = 0;
+	}
+}
+
+CMetricCounter::~CMetricCounter (void)
+{
+}
+
+void CMetricCounter::Add (u64 nValue)
+{
+	// atomic, because the counter may be incremented from an interrupt on the same core
+	__atomic_add_fetch (&m_Core[ThisCore ()].nValue, nValue, __ATOMIC_RELAXED);
+}
+
+s64 CMetricCounter::GetValue (void) const
+{
+	u64 nSum = 0;
+	for (unsigned nCore = 0; nCore < METRICS_CORES; nCore++)
+	{
+		nSum += __atomic_load_n (&m_Core[nCore].nValue, __ATOMIC_RELAXED);
+	}
+
+	return (s64) nSum;
+}
+
+unsigned CMetricCounter::ThisCore (void)
+{
+#ifdef ARM_ALLOW_MULTI_CORE
+	return CMultiCoreSupport::ThisCore ();
+#else
+	return 0;
+#endif
+}
+
+CMetricGauge::CMetricGauge (const char *pName, const char *pHelp,
+			    const char *pLabelName, const char *pLabelValue)
+:	CMetric (MetricTypeGauge, pName, pHelp, pLabelName, pLabelValue),
+	m_nValue (0),
+	m_pHandler (0),
+	m_pParam (0)
+{
+}
+
+CMetricGauge::CMetricGauge (const char *pName, const char *pHelp,
+			    const char *pLabelName, const char *pLabelValue,
+			    TMetricGaugeHandler *pHandler, void *pParam)
+:	CMetric (MetricTypeGauge, pName, pHelp, pLabelName, pLabelValue),
+	m_nValue (0),
+	m_pHandler (pHandler),
+	m_pParam (pParam)
+{
+	assert (m_pHandler != 0);
+}
+
+CMetricGauge::~CMetricGauge (void)
+{
+	m_pHandler = 0;
+}
+
+void CMetricGauge::Set (s64 nValue)
+{
+	__atomic_store_n (&m_nValue, nValue, __ATOMIC_RELAXED);
+}
+
+void CMetricGauge::Add (s64 nValue)
+{
+	__atomic_add_fetch (&m_nValue, nValue, __ATOMIC_RELAXED);
+}
+
+s64 CMetricGauge::GetValue (void) const
+{
+	if (m_pHandler != 0)
+	{
+		return (*m_pHandler) (m_pParam);
+	}
+
+	return __atomic_load_n (&m_nValue, __ATOMIC_RELAXED);
+}
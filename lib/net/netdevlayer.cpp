@@ -2,7 +2,7 @@
 // netdevlayer.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2024  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -23,6 +23,8 @@
 #include <circle/timer.h>
 #include <circle/synchronize.h>
 #include <circle/macros.h>
+#include <circle/tracer.h>
+#include <circle/sysconfig.h>
 #include <assert.h>
 
 const char FromNetDev[] = "netdev";
@@ -30,7 +32,12 @@ const char FromNetDev[] = "netdev";
 CNetDeviceLayer::CNetDeviceLayer (CNetConfig *pNetConfig, TNetDeviceType DeviceType)
 :	m_DeviceType (DeviceType),
 	m_pNetConfig (pNetConfig),
-	m_pDevice (0)
+	m_pDevice (0),
+	m_TxFrames ("circle_net_tx_frames_total", "Number of frames, sent to the net device"),
+	m_TxBytes ("circle_net_tx_bytes_total", "Number of bytes, sent to the net device"),
+	m_TxDropped ("circle_net_tx_dropped_total", "Number of frames, which could not be sent"),
+	m_RxFrames ("circle_net_rx_frames_total", "Number of frames, received from the net device"),
+	m_RxBytes ("circle_net_rx_bytes_total", "Number of bytes, received from the net device")
 {
 }
 
@@ -115,14 +122,36 @@ void CNetDeviceLayer::Process (void)
 		{
 			CLogger::Get ()->Write (FromNetDev, LogWarning, "Frame dropped");
 
+			m_TxDropped.Increment ();
+
 			break;
 		}
+
+		m_TxFrames.Increment ();
+		m_TxBytes.Add (nLength);
+
+#ifdef TRACE_NET
+		if (CTracer::Get () != 0)
+		{
+			CTracer::Get ()->Event (TRACER_EVENT_NET_TX, nLength);
+		}
+#endif
 	}
 
 	while (m_pDevice->ReceiveFrame (Buffer, &nLength))
 	{
 		assert (nLength > 0);
 		m_RxQueue.Enqueue (Buffer, nLength);
+
+		m_RxFrames.Increment ();
+		m_RxBytes.Add (nLength);
+
+#ifdef TRACE_NET
+		if (CTracer::Get () != 0)
+		{
+			CTracer::Get ()->Event (TRACER_EVENT_NET_RX, nLength);
+		}
+#endif
 	}
 }
 
@@ -2,7 +2,7 @@
 // mutex.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2025  R. Stange <rsta2@o2online.de>
 // 
 // This class was developed by:
 //	Brad Robinson <contact@toptensoftware.com>
@@ -24,12 +24,19 @@
 #include <circle/sched/scheduler.h>
 #include <circle/sched/task.h>
 #include <circle/synchronize.h>
+#include <circle/lockstatistics.h>
+#include <circle/tracer.h>
 #include <circle/sysconfig.h>
 #include <assert.h>
 
 CMutex::CMutex (void)
 :   m_pOwningTask (0),
     m_iReentrancyCount (0)
+#ifdef LOCK_STATISTICS
+    , m_pName (0),
+    m_nSite (LOCK_STATISTICS_UNREGISTERED),
+    m_nAcquireTicks (0)
+#endif
 {
 }
 
@@ -42,12 +49,28 @@ void CMutex::Acquire (void)
 {
     CTask* pTask = CScheduler::Get()->GetCurrentTask();
 
+#ifdef LOCK_STATISTICS
+    boolean bContended = FALSE;
+    u64 nStartTicks = CTracer::GetTimestamp();
+#endif
+
     while (true)
     {
         if (m_pOwningTask == nullptr)
         {
             m_pOwningTask = pTask;
             m_iReentrancyCount = 1;
+
+#ifdef LOCK_STATISTICS
+            m_nAcquireTicks = CTracer::GetTimestamp();
+            if (m_nSite == LOCK_STATISTICS_UNREGISTERED)
+            {
+                m_nSite = CLockStatistics::Register(m_pName,
+                                                    (uintptr) __builtin_return_address(0),
+                                                    LockTypeMutex);
+            }
+            CLockStatistics::Acquired(m_nSite, bContended, m_nAcquireTicks - nStartTicks);
+#endif
             return;
         }
         else if (m_pOwningTask == pTask)
@@ -55,6 +78,9 @@ void CMutex::Acquire (void)
             m_iReentrancyCount++;
             return;
         }
+#ifdef LOCK_STATISTICS
+        bContended = TRUE;
+#endif
         m_event.Wait();
     }
 }
@@ -65,8 +91,19 @@ void CMutex::Release (void)
     m_iReentrancyCount--;
     if (m_iReentrancyCount == 0)
     {
+#ifdef LOCK_STATISTICS
+        CLockStatistics::Released(m_nSite, CTracer::GetTimestamp() - m_nAcquireTicks);
+#endif
         m_pOwningTask = 0;
         m_event.Pulse();
         CScheduler::Get()->Yield();
     }
 }
+
+void CMutex::SetName (const char *pName)
+{
+#ifdef LOCK_STATISTICS
+    m_pName = pName;
+    m_nSite = LOCK_STATISTICS_UNREGISTERED;     // register by name on next Acquire()
+#endif
+}
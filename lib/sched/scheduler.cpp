@@ -2,7 +2,7 @@
 // scheduler.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -22,6 +22,8 @@
 #include <circle/logger.h>
 #include <circle/string.h>
 #include <circle/util.h>
+#include <circle/tracer.h>
+#include <circle/sysconfig.h>
 #include <assert.h>
 
 static const char FromScheduler[] = "sched";
@@ -34,7 +36,11 @@ CScheduler::CScheduler (void)
 	m_nCurrent (0),
 	m_pTaskSwitchHandler (0),
 	m_pTaskTerminationHandler (0),
-	m_iSuspendNewTasks (0)
+	m_iSuspendNewTasks (0),
+	m_TaskGauge ("circle_tasks", "Number of tasks, known to the scheduler")
+#ifdef LATENCY_HISTOGRAMS
+	, m_WakeLatency ("task wake-to-run")
+#endif
 {
 	assert (s_pThis == 0);
 	s_pThis = this;
@@ -62,6 +68,15 @@ void CScheduler::Yield (void)
 	assert (m_nCurrent < MAX_TASKS);
 	CTask *pNext = m_pTask[m_nCurrent];
 	assert (pNext != 0);
+
+#ifdef LATENCY_HISTOGRAMS
+	if (pNext->m_nWakeTimestamp != 0)
+	{
+		m_WakeLatency.RecordTimestampTicks (CTracer::GetTimestamp () - pNext->m_nWakeTimestamp);
+		pNext->m_nWakeTimestamp = 0;
+	}
+#endif
+
 	if (m_pCurrent == pNext)
 	{
 		return;
@@ -76,6 +91,15 @@ void CScheduler::Yield (void)
 		(*m_pTaskSwitchHandler) (m_pCurrent);
 	}
 
+#ifdef TRACE_SCHEDULER
+	CTracer *pTracer = CTracer::Get ();
+	if (pTracer != 0)
+	{
+		pTracer->End (TRACER_EVENT_TASK);
+		pTracer->Begin (TRACER_EVENT_TASK, m_nCurrent);
+	}
+#endif
+
 	assert (pOldRegs != 0);
 	assert (pNewRegs != 0);
 	TaskSwitch (pOldRegs, pNewRegs);
@@ -242,6 +266,7 @@ void CScheduler::AddTask (CTask *pTask)
 		if (m_pTask[i] == 0)
 		{
 			m_pTask[i] = pTask;
+			m_TaskGauge.Add (1);
 
 			return;
 		}
@@ -253,6 +278,7 @@ void CScheduler::AddTask (CTask *pTask)
 	}
 
 	m_pTask[m_nTasks++] = pTask;
+	m_TaskGauge.Add (1);
 }
 
 void CScheduler::RemoveTask (CTask *pTask)
@@ -262,6 +288,7 @@ void CScheduler::RemoveTask (CTask *pTask)
 		if (m_pTask[i] == pTask)
 		{
 			m_pTask[i] = 0;
+			m_TaskGauge.Add (-1);
 
 			if (i == m_nTasks-1)
 			{
@@ -357,6 +384,9 @@ void CScheduler::WakeTasks (CTask **ppWaitListHead)
 #endif
 
 		pTask->SetState (TaskStateReady);
+#ifdef LATENCY_HISTOGRAMS
+		pTask->m_nWakeTimestamp = CTracer::GetTimestamp ();
+#endif
 
 		CTask* pNext = pTask->m_pWaitListNext;
 		pTask->m_pWaitListNext = 0;
@@ -404,6 +434,9 @@ unsigned CScheduler::GetNextTask (void)
 			{
 				continue;
 			}
+#ifdef LATENCY_HISTOGRAMS
+			pTask->m_nWakeTimestamp = GetWakeTimestamp (pTask->GetWakeTicks (), nTicks);
+#endif
 			pTask->SetState (TaskStateReady);
 			pTask->SetWakeTicks(0);		// Use as flag that timeout expired
 			return nTask;
@@ -414,6 +447,9 @@ unsigned CScheduler::GetNextTask (void)
 			{
 				continue;
 			}
+#ifdef LATENCY_HISTOGRAMS
+			pTask->m_nWakeTimestamp = GetWakeTimestamp (pTask->GetWakeTicks (), nTicks);
+#endif
 			pTask->SetState (TaskStateReady);
 			return nTask;
 
@@ -435,6 +471,19 @@ unsigned CScheduler::GetNextTask (void)
 	return MAX_TASKS;
 }
 
+#ifdef LATENCY_HISTOGRAMS
+
+u64 CScheduler::GetWakeTimestamp (unsigned nWakeTicks, unsigned nNowTicks)
+{
+	// the task was due at nWakeTicks (in CLOCKHZ units), which may be in the past
+	u64 nLateTicks = nNowTicks - nWakeTicks;
+
+	return   CTracer::GetTimestamp ()
+	       - nLateTicks * CTracer::GetTimestampFrequency () / CLOCKHZ;
+}
+
+#endif
+
 CScheduler *CScheduler::Get (void)
 {
 	assert (s_pThis != 0);
@@ -2,7 +2,7 @@
 // task.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -28,6 +28,9 @@ CTask::CTask (unsigned nStackSize, boolean bCreateSuspended)
 	m_nStackSize (nStackSize),
 	m_pStack (0),
 	m_pWaitListNext (0)
+#ifdef LATENCY_HISTOGRAMS
+	, m_nWakeTimestamp (0)
+#endif
 {
 	for (unsigned i = 0; i < TASK_USER_DATA_SLOTS; i++)
 	{
@@ -49,8 +49,14 @@ CScreenDevice::~CScreenDevice (void)
 
 boolean CScreenDevice::Initialize (void)
 {
+#ifndef SCREEN_HW_SCROLL
 	m_pFrameBuffer = new CBcmFrameBuffer (m_nInitWidth, m_nInitHeight, DEPTH,
 					      0, 0, m_nDisplay);
+#else
+	// double virtual height for hardware scrolling of the terminal
+	m_pFrameBuffer = new CBcmFrameBuffer (m_nInitWidth, m_nInitHeight, DEPTH,
+					      0, 0, m_nDisplay, TRUE);
+#endif
 	if (!m_pFrameBuffer)
 	{
 		return FALSE;
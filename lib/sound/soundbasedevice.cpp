@@ -2,7 +2,7 @@
 // soundbasedevice.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2017-2023  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2017-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -18,24 +18,434 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 #include <circle/sound/soundbasedevice.h>
+#include <circle/sysconfig.h>
 #include <circle/macros.h>
 #include <circle/util.h>
 #include <assert.h>
 
+// NEON registers may be used here only, if they are saved on IRQ,
+// because Write() may be called from the need data callback
+#if    (defined (__ARM_NEON) || defined (__ARM_NEON__)) \
+    && defined (SAVE_VFP_REGS_ON_IRQ) && STDLIB_SUPPORT >= 1
+	#define SOUND_CONVERT_NEON
+	#include <arm_neon.h>
+#endif
+
+// Sample conversion //////////////////////////////////////////////////
+
+// Samples in the ring buffers may be unaligned, so they are accessed with
+// __builtin_memcpy(), which is inlined (even with -ffreestanding).
+
+static constexpr unsigned SampleSize (TSoundFormat Format)
+{
+	return   Format == SoundFormatUnsigned8 ? sizeof (u8)
+	       : Format == SoundFormatSigned16 ? sizeof (s16)
+	       : Format == SoundFormatSigned24 ? sizeof (u8)*3
+	       : sizeof (u32);
+}
+
+// returns a Write() sample as 32-bit signed value
+template <TSoundFormat Format>
+static inline s32 LoadWriteSample (const u8 *pFrom);
+
+template <>
+inline s32 LoadWriteSample<SoundFormatUnsigned8> (const u8 *pFrom)
+{
+	return (s32) (((u32) *pFrom - 128) << 24);
+}
+
+template <>
+inline s32 LoadWriteSample<SoundFormatSigned16> (const u8 *pFrom)
+{
+	s16 nValue;
+	__builtin_memcpy (&nValue, pFrom, sizeof nValue);
+
+	return (s32) ((u32) nValue << 16);
+}
+
+template <>
+inline s32 LoadWriteSample<SoundFormatSigned24> (const u8 *pFrom)
+{
+	return (s32) (((u32) pFrom[0] | (u32) pFrom[1] << 8 | (u32) pFrom[2] << 16) << 8);
+}
+
+template <>
+inline s32 LoadWriteSample<SoundFormatSigned24_32> (const u8 *pFrom)
+{
+	u32 nValue;
+	__builtin_memcpy (&nValue, pFrom, sizeof nValue);
+
+	return (s32) (nValue << 8);
+}
+
+// stores a 32-bit signed value as hardware sample
+template <TSoundFormat Format>
+static inline void StoreHWSample (u8 *pTo, s32 nValue, int nRangeMax);
+
+template <>
+inline void StoreHWSample<SoundFormatSigned16> (u8 *pTo, s32 nValue, int nRangeMax)
+{
+	s16 nSample = nValue >> 16;
+	__builtin_memcpy (pTo, &nSample, sizeof nSample);
+}
+
+template <>
+inline void StoreHWSample<SoundFormatSigned24> (u8 *pTo, s32 nValue, int nRangeMax)
+{
+	u32 nSample = (u32) (nValue >> 8);
+	pTo[0] = (u8) nSample;
+	pTo[1] = (u8) (nSample >> 8);
+	pTo[2] = (u8) (nSample >> 16);
+}
+
+template <>
+inline void StoreHWSample<SoundFormatSigned24_32> (u8 *pTo, s32 nValue, int nRangeMax)
+{
+	s32 nSample = nValue >> 8;
+	__builtin_memcpy (pTo, &nSample, sizeof nSample);
+}
+
+template <>
+inline void StoreHWSample<SoundFormatUnsigned32> (u8 *pTo, s32 nValue, int nRangeMax)
+{
+	s64 llValue = (s64) nValue;
+	llValue += 1U << 31;
+	llValue *= nRangeMax;
+	llValue >>= 32;
+
+	u32 nSample = (u32) llValue;
+	__builtin_memcpy (pTo, &nSample, sizeof nSample);
+}
+
+template <>
+inline void StoreHWSample<SoundFormatIEC958> (u8 *pTo, s32 nValue, int nRangeMax)
+{
+	nValue >>= 4;
+	nValue &= 0xFFFFFF0;
+	if (parity32 (nValue))
+	{
+		nValue |= 0x80000000;
+	}
+
+	__builtin_memcpy (pTo, &nValue, sizeof nValue);
+}
+
+// returns a hardware sample as 24-bit value (upper bits as delivered by hardware)
+template <TSoundFormat Format>
+static inline u32 LoadHWSample (const u8 *pFrom);
+
+template <>
+inline u32 LoadHWSample<SoundFormatSigned16> (const u8 *pFrom)
+{
+	s16 nValue;
+	__builtin_memcpy (&nValue, pFrom, sizeof nValue);
+
+	return (u32) (s32) nValue << 8;
+}
+
+template <>
+inline u32 LoadHWSample<SoundFormatSigned24> (const u8 *pFrom)
+{
+	return (u32) pFrom[0] | (u32) pFrom[1] << 8 | (u32) pFrom[2] << 16;
+}
+
+template <>
+inline u32 LoadHWSample<SoundFormatSigned24_32> (const u8 *pFrom)
+{
+	u32 nValue;
+	__builtin_memcpy (&nValue, pFrom, sizeof nValue);
+
+	return nValue;
+}
+
+// stores a 24-bit value as Read() sample
+template <TSoundFormat Format>
+static inline void StoreReadSample (u8 *pTo, u32 nValue);
+
+template <>
+inline void StoreReadSample<SoundFormatUnsigned8> (u8 *pTo, u32 nValue)
+{
+	s8 chValue = (s8) (nValue >> 16);
+	*pTo = (u8) (128 + chValue);
+}
+
+template <>
+inline void StoreReadSample<SoundFormatSigned16> (u8 *pTo, u32 nValue)
+{
+	s16 nSample = (s16) (nValue >> 8);
+	__builtin_memcpy (pTo, &nSample, sizeof nSample);
+}
+
+template <>
+inline void StoreReadSample<SoundFormatSigned24> (u8 *pTo, u32 nValue)
+{
+	pTo[0] = (u8) nValue;
+	pTo[1] = (u8) (nValue >> 8);
+	pTo[2] = (u8) (nValue >> 16);
+}
+
+template <>
+inline void StoreReadSample<SoundFormatSigned24_32> (u8 *pTo, u32 nValue)
+{
+	__builtin_memcpy (pTo, &nValue, sizeof nValue);
+}
+
+// Vectorized conversion of contiguous samples. Returns the number of samples,
+// which have been converted. The remaining samples are converted one by one.
+
+template <TSoundFormat From, TSoundFormat To>
+static inline unsigned ConvertWriteVector (u8 *pTo, const u8 *pFrom, unsigned nSamples,
+					   int nRangeMax)
+{
+	return 0;
+}
+
+template <TSoundFormat From, TSoundFormat To>
+static inline unsigned ConvertReadVector (u8 *pTo, const u8 *pFrom, unsigned nSamples)
+{
+	return 0;
+}
+
+#ifdef SOUND_CONVERT_NEON
+
+// 16-bit samples to sign-extended 32-bit samples << 8
+static inline unsigned WidenS16 (u8 *pTo, const u8 *pFrom, unsigned nSamples)
+{
+	unsigned nVectors = nSamples / 8;
+	for (unsigned i = 0; i < nVectors; i++)
+	{
+		int16x8_t vIn = vreinterpretq_s16_u8 (vld1q_u8 (pFrom));
+
+		vst1q_u8 (pTo, vreinterpretq_u8_s32 (vshll_n_s16 (vget_low_s16 (vIn), 8)));
+		vst1q_u8 (pTo + 16, vreinterpretq_u8_s32 (vshll_n_s16 (vget_high_s16 (vIn), 8)));
+
+		pFrom += 16;
+		pTo += 32;
+	}
+
+	return nVectors * 8;
+}
+
+// 32-bit samples >> 8 to 16-bit samples
+static inline unsigned NarrowS24_32 (u8 *pTo, const u8 *pFrom, unsigned nSamples)
+{
+	unsigned nVectors = nSamples / 8;
+	for (unsigned i = 0; i < nVectors; i++)
+	{
+		int32x4_t vLow = vreinterpretq_s32_u8 (vld1q_u8 (pFrom));
+		int32x4_t vHigh = vreinterpretq_s32_u8 (vld1q_u8 (pFrom + 16));
+
+		int16x8_t vOut = vcombine_s16 (vshrn_n_s32 (vLow, 8), vshrn_n_s32 (vHigh, 8));
+		vst1q_u8 (pTo, vreinterpretq_u8_s16 (vOut));
+
+		pFrom += 32;
+		pTo += 16;
+	}
+
+	return nVectors * 8;
+}
+
+// sets bit 31, if the number of set bits in the lower 31 bits is odd
+static inline uint32x4_t IEC958Parity (uint32x4_t vValue)
+{
+	uint8x16_t vBits = vcntq_u8 (vreinterpretq_u8_u32 (vValue));
+	uint32x4_t vCount = vpaddlq_u16 (vpaddlq_u8 (vBits));
+
+	return vorrq_u32 (vValue, vshlq_n_u32 (vCount, 31));
+}
+
+template <>
+inline unsigned ConvertWriteVector<SoundFormatSigned16, SoundFormatSigned24_32> (
+	u8 *pTo, const u8 *pFrom, unsigned nSamples, int nRangeMax)
+{
+	return WidenS16 (pTo, pFrom, nSamples);
+}
+
+template <>
+inline unsigned ConvertWriteVector<SoundFormatSigned24_32, SoundFormatSigned16> (
+	u8 *pTo, const u8 *pFrom, unsigned nSamples, int nRangeMax)
+{
+	return NarrowS24_32 (pTo, pFrom, nSamples);
+}
+
+template <>
+inline unsigned ConvertWriteVector<SoundFormatSigned16, SoundFormatUnsigned32> (
+	u8 *pTo, const u8 *pFrom, unsigned nSamples, int nRangeMax)
+{
+	uint32x2_t vRange = vdup_n_u32 ((u32) nRangeMax);
+	uint32x4_t vOffset = vdupq_n_u32 (0x80000000);
+
+	unsigned nVectors = nSamples / 8;
+	for (unsigned i = 0; i < nVectors; i++)
+	{
+		int16x8_t vIn = vreinterpretq_s16_u8 (vld1q_u8 (pFrom));
+
+		for (unsigned j = 0; j < 2; j++)
+		{
+			// ((s64) (nValue << 16) + 2^31) * nRangeMax >> 32
+			int16x4_t vHalf = j == 0 ? vget_low_s16 (vIn) : vget_high_s16 (vIn);
+			uint32x4_t vValue = vreinterpretq_u32_s32 (vshll_n_s16 (vHalf, 16));
+			vValue = veorq_u32 (vValue, vOffset);
+
+			uint32x4_t vOut = vcombine_u32 (
+				vshrn_n_u64 (vmull_u32 (vget_low_u32 (vValue), vRange), 32),
+				vshrn_n_u64 (vmull_u32 (vget_high_u32 (vValue), vRange), 32));
+
+			vst1q_u8 (pTo, vreinterpretq_u8_u32 (vOut));
+			pTo += 16;
+		}
+
+		pFrom += 16;
+	}
+
+	return nVectors * 8;
+}
+
+template <>
+inline unsigned ConvertWriteVector<SoundFormatSigned16, SoundFormatIEC958> (
+	u8 *pTo, const u8 *pFrom, unsigned nSamples, int nRangeMax)
+{
+	uint32x4_t vMask = vdupq_n_u32 (0xFFFFFF0);
+
+	unsigned nVectors = nSamples / 8;
+	for (unsigned i = 0; i < nVectors; i++)
+	{
+		int16x8_t vIn = vreinterpretq_s16_u8 (vld1q_u8 (pFrom));
+
+		uint32x4_t vLow = vreinterpretq_u32_s32 (vshll_n_s16 (vget_low_s16 (vIn), 12));
+		uint32x4_t vHigh = vreinterpretq_u32_s32 (vshll_n_s16 (vget_high_s16 (vIn), 12));
+
+		vst1q_u8 (pTo, vreinterpretq_u8_u32 (IEC958Parity (vandq_u32 (vLow, vMask))));
+		vst1q_u8 (pTo + 16, vreinterpretq_u8_u32 (IEC958Parity (vandq_u32 (vHigh, vMask))));
+
+		pFrom += 16;
+		pTo += 32;
+	}
+
+	return nVectors * 8;
+}
+
+template <>
+inline unsigned ConvertWriteVector<SoundFormatSigned24_32, SoundFormatIEC958> (
+	u8 *pTo, const u8 *pFrom, unsigned nSamples, int nRangeMax)
+{
+	uint32x4_t vMask = vdupq_n_u32 (0xFFFFFF0);
+
+	unsigned nVectors = nSamples / 4;
+	for (unsigned i = 0; i < nVectors; i++)
+	{
+		uint32x4_t vValue = vshlq_n_u32 (vreinterpretq_u32_u8 (vld1q_u8 (pFrom)), 4);
+
+		vst1q_u8 (pTo, vreinterpretq_u8_u32 (IEC958Parity (vandq_u32 (vValue, vMask))));
+
+		pFrom += 16;
+		pTo += 16;
+	}
+
+	return nVectors * 4;
+}
+
+template <>
+inline unsigned ConvertReadVector<SoundFormatSigned16, SoundFormatSigned24_32> (
+	u8 *pTo, const u8 *pFrom, unsigned nSamples)
+{
+	return WidenS16 (pTo, pFrom, nSamples);
+}
+
+template <>
+inline unsigned ConvertReadVector<SoundFormatSigned24_32, SoundFormatSigned16> (
+	u8 *pTo, const u8 *pFrom, unsigned nSamples)
+{
+	return NarrowS24_32 (pTo, pFrom, nSamples);
+}
+
+#endif
+
+template <TSoundFormat From, TSoundFormat To>
+static void ConvertWrite (u8 *pTo, unsigned nToStep, const u8 *pFrom, unsigned nFromStep,
+			  unsigned nSamples, int nRangeMax)
+{
+	if (   nToStep == SampleSize (To)
+	    && nFromStep == SampleSize (From))
+	{
+		unsigned nDone = ConvertWriteVector<From, To> (pTo, pFrom, nSamples, nRangeMax);
+		pTo += nDone * SampleSize (To);
+		pFrom += nDone * SampleSize (From);
+
+		// constant steps, so that the compiler can unroll or vectorize this loop
+		for (unsigned i = nDone; i < nSamples; i++)
+		{
+			StoreHWSample<To> (pTo, LoadWriteSample<From> (pFrom), nRangeMax);
+
+			pTo += SampleSize (To);
+			pFrom += SampleSize (From);
+		}
+
+		return;
+	}
+
+	for (unsigned i = 0; i < nSamples; i++)
+	{
+		StoreHWSample<To> (pTo, LoadWriteSample<From> (pFrom), nRangeMax);
+
+		pTo += nToStep;
+		pFrom += nFromStep;
+	}
+}
+
+template <TSoundFormat From, TSoundFormat To>
+static void ConvertRead (u8 *pTo, unsigned nToStep, const u8 *pFrom, unsigned nFromStep,
+			 unsigned nSamples, int nRangeMax)
+{
+	if (   nToStep == SampleSize (To)
+	    && nFromStep == SampleSize (From))
+	{
+		unsigned nDone = ConvertReadVector<From, To> (pTo, pFrom, nSamples);
+		pTo += nDone * SampleSize (To);
+		pFrom += nDone * SampleSize (From);
+
+		for (unsigned i = nDone; i < nSamples; i++)
+		{
+			StoreReadSample<To> (pTo, LoadHWSample<From> (pFrom));
+
+			pTo += SampleSize (To);
+			pFrom += SampleSize (From);
+		}
+
+		return;
+	}
+
+	for (unsigned i = 0; i < nSamples; i++)
+	{
+		StoreReadSample<To> (pTo, LoadHWSample<From> (pFrom));
+
+		pTo += nToStep;
+		pFrom += nFromStep;
+	}
+}
+
+CMetricCounter CSoundBaseDevice::s_UnderrunCounter ("circle_sound_underruns_total",
+						    "Number of sound output underruns");
+
 CSoundBaseDevice::CSoundBaseDevice (void)
 :	m_HWFormat (SoundFormatUnknown),
 	m_nQueueSize (0),
 	m_nNeedDataThreshold (0),
 	m_WriteFormat (SoundFormatUnknown),
 	m_nWriteChannels (0),
+	m_pWriteConverter (0),
 	m_pQueue (0),
 	m_nInPtr (0),
 	m_nOutPtr (0),
 	m_pCallback (0),
+	m_pSource (0),
+	m_pSourceConverter (0),
+	m_bUnderrun (TRUE),
 	m_nReadQueueSize (0),
 	m_nHaveDataThreshold (0),
 	m_ReadFormat (SoundFormatUnknown),
 	m_nReadChannels (0),
+	m_pReadConverter (0),
 	m_pReadQueue (0),
 	m_nReadInPtr (0),
 	m_nReadOutPtr (0),
@@ -51,14 +461,19 @@ CSoundBaseDevice::CSoundBaseDevice (TSoundFormat HWFormat, u32 nRange32, unsigne
 	m_nNeedDataThreshold (0),
 	m_WriteFormat (SoundFormatUnknown),
 	m_nWriteChannels (0),
+	m_pWriteConverter (0),
 	m_pQueue (0),
 	m_nInPtr (0),
 	m_nOutPtr (0),
 	m_pCallback (0),
+	m_pSource (0),
+	m_pSourceConverter (0),
+	m_bUnderrun (TRUE),
 	m_nReadQueueSize (0),
 	m_nHaveDataThreshold (0),
 	m_ReadFormat (SoundFormatUnknown),
 	m_nReadChannels (0),
+	m_pReadConverter (0),
 	m_pReadQueue (0),
 	m_nReadInPtr (0),
 	m_nReadOutPtr (0),
@@ -163,6 +578,32 @@ void CSoundBaseDevice::Setup (TSoundFormat HWFormat, u32 nRange32, unsigned nSam
 		m_uchIEC958Status[2] = 0;	// source number, take no account of channel number
 		m_uchIEC958Status[3] = uchFS;	// sampling frequency
 		m_uchIEC958Status[4] = 0b1011 | (uchOrigFS << 4); // 24 bit samples, original freq.
+
+		assert (m_nHWTXChannels == IEC958_HW_CHANNELS);
+
+		m_nIEC958MaskedFrames = 0;
+		for (unsigned i = 0; i < IEC958_FRAMES_PER_BLOCK; i++)
+		{
+			u32 nMask = 0;
+
+			if (   i < IEC958_STATUS_BYTES * 8
+			    && (m_uchIEC958Status[i / 8] & BIT(i % 8)))
+			{
+				nMask |= 0xC0000000;
+			}
+
+			if (i == 0)
+			{
+				nMask |= IEC958_B_FRAME_PREAMBLE;
+			}
+
+			m_IEC958FrameMask[i] = nMask;
+
+			if (nMask != 0)
+			{
+				m_nIEC958MaskedFrames = i+1;
+			}
+		}
 	}
 }
 
@@ -176,6 +617,11 @@ unsigned CSoundBaseDevice::GetHWRXChannels (void) const
 	return m_nHWRXChannels;
 }
 
+unsigned CSoundBaseDevice::GetSampleRate (void) const
+{
+	return m_nSampleRate;
+}
+
 int CSoundBaseDevice::GetRangeMin (void) const
 {
 	return m_nRangeMin;
@@ -258,6 +704,32 @@ void CSoundBaseDevice::SetWriteFormat (TSoundFormat Format, unsigned nChannels)
 	}
 
 	m_nWriteFrameSize = m_nWriteChannels * m_nWriteSampleSize;
+
+	m_pWriteConverter = GetWriteConverter (m_WriteFormat, m_HWFormat);
+	assert (m_pWriteConverter != 0);
+
+	m_bWriteInterleaved = m_nWriteChannels == m_nHWTXChannels && !m_bSwapChannels;
+
+	if (   m_nHWTXChannels == 2
+	    && m_nWriteChannels <= 2)
+	{
+		// swap channels, if requested, and duplicate mono channel
+		m_nWriteMappedChannels = 2;
+		for (unsigned i = 0; i < 2; i++)
+		{
+			unsigned nChannel = m_bSwapChannels ? 1-i : i;
+			m_WriteChannelMap[i] = nChannel < m_nWriteChannels ? nChannel : 0;
+		}
+	}
+	else
+	{
+		m_nWriteMappedChannels =   m_nWriteChannels < m_nHWTXChannels
+					 ? m_nWriteChannels : m_nHWTXChannels;
+		for (unsigned i = 0; i < m_nWriteMappedChannels; i++)
+		{
+			m_WriteChannelMap[i] = i;
+		}
+	}
 }
 
 int CSoundBaseDevice::Write (const void *pBuffer, size_t nCount)
@@ -291,84 +763,20 @@ int CSoundBaseDevice::Write (const void *pBuffer, size_t nCount)
 			nResult = nBytes;
 		}
 	}
-	else if (   m_nHWTXChannels == 2
-		 && m_nWriteChannels <= 2)
-	{
-		while (   nCount >= m_nWriteFrameSize
-		       && GetQueueBytesFree () >= m_nHWTXFrameSize)
-		{
-			u8 Frame[2 * SOUND_MAX_SAMPLE_SIZE];
-
-			if (!m_bSwapChannels)
-			{
-				ConvertSoundFormat (Frame, pBuffer8);
-				pBuffer8 += m_nWriteSampleSize;
-
-				if (m_nWriteChannels == 2)
-				{
-					ConvertSoundFormat (Frame+m_nHWSampleSize, pBuffer8);
-					pBuffer8 += m_nWriteSampleSize;
-				}
-				else
-				{
-					memcpy (Frame+m_nHWSampleSize, Frame, m_nHWSampleSize);
-				}
-			}
-			else
-			{
-				ConvertSoundFormat (Frame+m_nHWSampleSize, pBuffer8);
-				pBuffer8 += m_nWriteSampleSize;
-
-				if (m_nWriteChannels == 2)
-				{
-					ConvertSoundFormat (Frame, pBuffer8);
-					pBuffer8 += m_nWriteSampleSize;
-				}
-				else
-				{
-					memcpy (Frame, Frame+m_nHWSampleSize, m_nHWSampleSize);
-				}
-			}
-
-			Enqueue (Frame, m_nHWTXFrameSize);
-
-			nCount -= m_nWriteFrameSize;
-			nResult += m_nWriteFrameSize;
-		}
-	}
 	else
 	{
-		unsigned nMinChannels = m_nHWTXChannels;
-		unsigned nNullBytes = 0;
-		if (m_nWriteChannels < m_nHWTXChannels)
+		unsigned nFrames = nCount / m_nWriteFrameSize;
+		unsigned nFramesFree = GetQueueBytesFree () / m_nHWTXFrameSize;
+		if (nFrames > nFramesFree)
 		{
-			nMinChannels = m_nWriteChannels;
-			nNullBytes = (m_nHWTXChannels - m_nWriteChannels) * m_nHWSampleSize;
+			nFrames = nFramesFree;
 		}
 
-		while (   nCount >= m_nWriteFrameSize
-		       && GetQueueBytesFree () >= m_nHWTXFrameSize)
+		if (nFrames > 0)
 		{
-			u8 Frame[SOUND_MAX_FRAME_SIZE];
-			u8 *pFrame = Frame;
-
-			for (unsigned i = 0; i < nMinChannels; i++)
-			{
-				ConvertSoundFormat (pFrame, pBuffer8);
-
-				pFrame += m_nHWSampleSize;
-				pBuffer8 += m_nWriteSampleSize;
-			}
-
-			if (nNullBytes != 0)
-			{
-				memcpy (pFrame, m_NullFrame, nNullBytes);
-			}
-
-			Enqueue (Frame, m_nHWTXFrameSize);
+			EnqueueWriteFrames (pBuffer8, nFrames);
 
-			nCount -= m_nWriteFrameSize;
-			nResult += m_nWriteFrameSize;
+			nResult = nFrames * m_nWriteFrameSize;
 		}
 	}
 
@@ -410,6 +818,16 @@ boolean CSoundBaseDevice::AreChannelsSwapped (void) const
 	return m_bSwapChannels;
 }
 
+void CSoundBaseDevice::SetSource (CSoundSource *pSource)
+{
+	assert (pSource == 0 || m_pSource == 0);
+
+	m_pSourceConverter = GetWriteConverter (SoundFormatSigned24_32, m_HWFormat);
+	assert (m_pSourceConverter != 0);
+
+	m_pSource = pSource;
+}
+
 // Input //////////////////////////////////////////////////////////////
 
 boolean CSoundBaseDevice::AllocateReadQueue (unsigned nSizeMsecs)
@@ -484,6 +902,34 @@ void CSoundBaseDevice::SetReadFormat (TSoundFormat Format, unsigned nChannels,
 	}
 
 	m_nReadFrameSize = m_nReadChannels * m_nReadSampleSize;
+
+	m_pReadConverter = GetReadConverter (m_HWFormat, m_ReadFormat);
+	assert (m_pReadConverter != 0);
+
+	m_bReadInterleaved = m_nReadChannels == m_nHWRXChannels;
+
+	if (   m_nHWRXChannels == 2
+	    && m_nReadChannels <= 2)
+	{
+		// select left or right channel for mono
+		m_nReadMappedChannels = m_nReadChannels;
+		for (unsigned i = 0; i < m_nReadChannels; i++)
+		{
+			m_ReadChannelMap[i] = m_nReadChannels == 2 || m_bLeftChannel ? i : 1;
+		}
+	}
+	else
+	{
+		m_nReadMappedChannels =   m_nReadChannels < m_nHWRXChannels
+					? m_nReadChannels : m_nHWRXChannels;
+		for (unsigned i = 0; i < m_nReadMappedChannels; i++)
+		{
+			m_ReadChannelMap[i] = i;
+		}
+	}
+
+	(*m_pReadConverter) (m_ReadNullSample, m_nReadSampleSize,
+			     m_NullFrame, m_nHWSampleSize, 1, m_nRangeMax);
 }
 
 int CSoundBaseDevice::Read (void *pBuffer, size_t nCount)
@@ -516,82 +962,20 @@ int CSoundBaseDevice::Read (void *pBuffer, size_t nCount)
 			nResult = nBytes;
 		}
 	}
-	else if (   m_nHWRXChannels == 2
-		 && m_nReadChannels <= 2)
-	{
-		while (   nCount >= m_nReadFrameSize
-		       && GetReadQueueBytesAvail () >= m_nHWRXFrameSize)
-		{
-			u8 Frame[SOUND_MAX_FRAME_SIZE];
-
-			ReadDequeue (Frame, m_nHWRXFrameSize);
-
-			if (m_nReadChannels == 2)
-			{
-				ConvertReadSoundFormat (pBuffer8, Frame);
-				pBuffer8 += m_nReadSampleSize;
-
-				ConvertReadSoundFormat (pBuffer8, Frame+m_nHWSampleSize);
-				pBuffer8 += m_nReadSampleSize;
-			}
-			else
-			{
-				if (m_bLeftChannel)
-				{
-					ConvertReadSoundFormat (pBuffer8, Frame);
-				}
-				else
-				{
-					ConvertReadSoundFormat (pBuffer8, Frame+m_nHWSampleSize);
-				}
-
-				pBuffer8 += m_nReadSampleSize;
-			}
-
-			nCount -= m_nReadFrameSize;
-			nResult += m_nReadFrameSize;
-		}
-	}
 	else
 	{
-		u8 NullSample[SOUND_MAX_SAMPLE_SIZE];
-
-		unsigned nMinChannels = m_nHWRXChannels;
-		if (m_nReadChannels < m_nHWRXChannels)
-		{
-			nMinChannels = m_nReadChannels;
-		}
-		else
+		unsigned nFrames = nCount / m_nReadFrameSize;
+		unsigned nFramesAvail = GetReadQueueBytesAvail () / m_nHWRXFrameSize;
+		if (nFrames > nFramesAvail)
 		{
-			ConvertReadSoundFormat (NullSample, m_NullFrame);
+			nFrames = nFramesAvail;
 		}
 
-		while (   nCount >= m_nReadFrameSize
-		       && GetReadQueueBytesAvail () >= m_nHWRXFrameSize)
+		if (nFrames > 0)
 		{
-			u8 Frame[SOUND_MAX_FRAME_SIZE];
-			u8 *pFrame = Frame;
-
-			ReadDequeue (Frame, m_nHWRXFrameSize);
+			DequeueReadFrames (pBuffer8, nFrames);
 
-			unsigned i = 0;
-			for (; i < nMinChannels; i++)
-			{
-				ConvertReadSoundFormat (pBuffer8, pFrame);
-
-				pBuffer8 += m_nReadSampleSize;
-				pFrame += m_nHWSampleSize;
-			}
-
-			for (; i < m_nReadChannels; i++)
-			{
-				memcpy (pBuffer8, NullSample, m_nReadSampleSize);
-
-				pBuffer8 += m_nReadSampleSize;
-			}
-
-			nCount -= m_nReadFrameSize;
-			nResult += m_nReadFrameSize;
+			nResult = nFrames * m_nReadFrameSize;
 		}
 	}
 
@@ -655,99 +1039,84 @@ u32 CSoundBaseDevice::ConvertIEC958Sample (u32 nSample, unsigned nFrame)
 	nSample &= 0xFFFFFF;
 	nSample <<= 4;
 
-	if (   nFrame < IEC958_STATUS_BYTES * 8
-	    && (m_uchIEC958Status[nFrame / 8] & BIT(nFrame % 8)))
-	{
-		nSample |= 0x40000000;
-
-	}
-
 	if (parity32 (nSample))
 	{
 		nSample |= 0x80000000;
 	}
 
-	if (nFrame == 0)
-	{
-		nSample |= IEC958_B_FRAME_PREAMBLE;
-	}
-
-	return nSample;
+	return nSample ^ m_IEC958FrameMask[nFrame];
 }
 
-void CSoundBaseDevice::ConvertSoundFormat (void *pTo, const void *pFrom)
+void CSoundBaseDevice::ConvertWriteFrames (u8 *pTo, const u8 *pFrom, unsigned nFrames)
 {
-	s32 nValue = 0;
+	assert (m_pWriteConverter != 0);
 
-	switch (m_WriteFormat)
+	if (m_bWriteInterleaved)
 	{
-	case SoundFormatUnsigned8: {
-		const u8 *pValue = reinterpret_cast<const u8 *> (pFrom);
-		nValue = *pValue;
-		nValue -= 128;
-		nValue <<= 24;
-		} break;
-
-	case SoundFormatSigned16: {
-		const s16 *pValue = reinterpret_cast<const s16 *> (pFrom);
-		nValue = *pValue;
-		nValue <<= 16;
-		} break;
+		(*m_pWriteConverter) (pTo, m_nHWSampleSize, pFrom, m_nWriteSampleSize,
+				      nFrames * m_nHWTXChannels, m_nRangeMax);
 
-	case SoundFormatSigned24:
-	case SoundFormatSigned24_32: {
-		const u32 *pValue = reinterpret_cast<const u32 *> (pFrom);
-		nValue = *pValue & 0xFFFFFF;
-		nValue <<= 8;
-		} break;
-
-	case SoundFormatUnknown:
-		memcpy (pTo, pFrom, m_nWriteSampleSize);
 		return;
+	}
 
-	default:
-		assert (0);
-		break;
+	for (unsigned i = 0; i < m_nWriteMappedChannels; i++)
+	{
+		(*m_pWriteConverter) (pTo + i * m_nHWSampleSize, m_nHWTXFrameSize,
+				      pFrom + m_WriteChannelMap[i] * m_nWriteSampleSize,
+				      m_nWriteFrameSize, nFrames, m_nRangeMax);
 	}
 
-	switch (m_HWFormat)
+	if (m_nWriteMappedChannels < m_nHWTXChannels)
 	{
-	case SoundFormatSigned16: {
-		s16 *pValue = reinterpret_cast<s16 *> (pTo);
-		*pValue = nValue >> 16;
-		} break;
+		unsigned nOffset = m_nWriteMappedChannels * m_nHWSampleSize;
+		unsigned nNullBytes = m_nHWTXFrameSize - nOffset;
 
-	case SoundFormatSigned24:
-	case SoundFormatSigned24_32: {
-		s32 *pValue = reinterpret_cast<s32 *> (pTo);
-		*pValue = nValue >> 8;
-		} break;
+		for (pTo += nOffset; nFrames > 0; nFrames--)
+		{
+			memcpy (pTo, m_NullFrame + nOffset, nNullBytes);
 
-	case SoundFormatUnsigned32: {
-		s64 llValue = (s64) nValue;
-		llValue += 1U << 31;
-		llValue *= m_nRangeMax;
-		llValue >>= 32;
+			pTo += m_nHWTXFrameSize;
+		}
+	}
+}
 
-		u32 *pValue = reinterpret_cast<u32 *> (pTo);
-		*pValue = (u32) llValue;
-		} break;
+void CSoundBaseDevice::EnqueueWriteFrames (const u8 *pFrom, unsigned nFrames)
+{
+	assert (pFrom != 0);
+	assert (m_pQueue != 0);
 
-	case SoundFormatIEC958: {
-		nValue >>= 4;
-		nValue &= 0xFFFFFF0;
-		if (parity32 (nValue))
+	while (nFrames > 0)
+	{
+		// convert the frames, which fit before the end of the ring buffer, in place
+		unsigned nBlockFrames = (m_nQueueSize - m_nInPtr) / m_nHWTXFrameSize;
+		if (nBlockFrames > nFrames)
 		{
-			nValue |= 0x80000000;
+			nBlockFrames = nFrames;
 		}
 
-		s32 *pValue = reinterpret_cast<s32 *> (pTo);
-		*pValue = nValue;
-		} break;
+		if (nBlockFrames > 0)
+		{
+			ConvertWriteFrames (m_pQueue + m_nInPtr, pFrom, nBlockFrames);
 
-	default:
-		assert (0);
-		break;
+			m_nInPtr += nBlockFrames * m_nHWTXFrameSize;
+			if (m_nInPtr == m_nQueueSize)
+			{
+				m_nInPtr = 0;
+			}
+		}
+		else
+		{
+			// frame wraps around at the end of the ring buffer
+			u8 Frame[SOUND_MAX_FRAME_SIZE];
+			ConvertWriteFrames (Frame, pFrom, 1);
+
+			Enqueue (Frame, m_nHWTXFrameSize);
+
+			nBlockFrames = 1;
+		}
+
+		pFrom += nBlockFrames * m_nWriteFrameSize;
+		nFrames -= nBlockFrames;
 	}
 }
 
@@ -760,6 +1129,18 @@ unsigned CSoundBaseDevice::GetChunkInternal (void *pBuffer, unsigned nChunkSize)
 	assert (nChunkSize % m_nHWTXChannels == 0);
 	unsigned nChunkSizeBytes = nChunkSize * m_nHWSampleSize;
 
+	if (m_pSource != 0)
+	{
+		GetSourceChunk (pBuffer8, nChunkSize / m_nHWTXChannels);
+
+		if (m_HWFormat == SoundFormatIEC958)
+		{
+			ApplyIEC958Framing (static_cast<u32 *> (pBuffer), nChunkSize);
+		}
+
+		return nChunkSize;
+	}
+
 	m_SpinLock.Acquire ();
 
 	unsigned nQueueBytesAvail = GetQueueBytesAvail ();
@@ -779,6 +1160,21 @@ unsigned CSoundBaseDevice::GetChunkInternal (void *pBuffer, unsigned nChunkSize)
 
 	m_SpinLock.Release ();
 
+	// count only the beginning of an underrun, an idle device is not counted
+	if (nBytes < nChunkSizeBytes)
+	{
+		if (!m_bUnderrun)
+		{
+			s_UnderrunCounter.Increment ();
+
+			m_bUnderrun = TRUE;
+		}
+	}
+	else
+	{
+		m_bUnderrun = FALSE;
+	}
+
 	while (nBytes < nChunkSizeBytes)
 	{
 		memcpy (pBuffer8, m_NullFrame, m_nHWTXFrameSize);
@@ -787,52 +1183,63 @@ unsigned CSoundBaseDevice::GetChunkInternal (void *pBuffer, unsigned nChunkSize)
 		nBytes += m_nHWTXFrameSize;
 	}
 
-	// insert control channel and parity bits, and preamble into IEC958 block
 	if (m_HWFormat == SoundFormatIEC958)
 	{
-		u32 *pBuffer32 = static_cast<u32 *> (pBuffer);
-
-		unsigned i;
-		for (i = 0; i < nChunkSize; i += IEC958_SUBFRAMES_PER_BLOCK)
-		{
-			unsigned j;
-			for (j = 0; j < IEC958_STATUS_BYTES * 8 * m_nHWTXChannels; j++)
-			{
-				u32 *pSubFrame = &pBuffer32[i + j];
+		ApplyIEC958Framing (static_cast<u32 *> (pBuffer), nChunkSize);
+	}
 
-				unsigned nFrame = j / m_nHWTXChannels;
-				if (m_uchIEC958Status[nFrame / 8] & BIT(nFrame % 8))
-				{
-					u32 nValue = *pSubFrame;
+	if (   m_pCallback != 0
+	    && nQueueBytesAvail < m_nNeedDataThreshold)
+	{
+		(*m_pCallback) (m_pCallbackParam);
+	}
 
-					nValue |= 0x40000000;
+	return nChunkSize;
+}
 
-					nValue &= 0x7FFFFFFF;
-					if (parity32 (nValue))
-					{
-						nValue |= 0x80000000;
-					}
+void CSoundBaseDevice::GetSourceChunk (u8 *pBuffer, unsigned nFrames)
+{
+	assert (m_pSource != 0);
+	assert (m_pSourceConverter != 0);
 
-					*pSubFrame = nValue;
-				}
+	while (nFrames > 0)
+	{
+		unsigned nFramesGot;
+		const s32 *pFrames = m_pSource->GetFrames (nFrames, &nFramesGot);
+		assert (pFrames != 0);
+		assert (0 < nFramesGot && nFramesGot <= nFrames);
 
-				if (nFrame == 0)
-				{
-					*pSubFrame |= IEC958_B_FRAME_PREAMBLE;
-				}
-			}
-		}
+		(*m_pSourceConverter) (pBuffer, m_nHWSampleSize,
+				       reinterpret_cast<const u8 *> (pFrames), sizeof (s32),
+				       nFramesGot * m_nHWTXChannels, m_nRangeMax);
 
-		assert (i == nChunkSize);	// nChunkSize must be a multiple of 384
+		pBuffer += nFramesGot * m_nHWTXFrameSize;
+		nFrames -= nFramesGot;
 	}
+}
 
-	if (   m_pCallback != 0
-	    && nQueueBytesAvail < m_nNeedDataThreshold)
+// insert control channel and parity bits, and preamble into IEC958 block,
+// the samples have a valid parity bit already (see StoreHWSample())
+void CSoundBaseDevice::ApplyIEC958Framing (u32 *pBuffer, unsigned nChunkSize)
+{
+	assert (pBuffer != 0);
+	assert (m_HWFormat == SoundFormatIEC958);
+
+	unsigned i;
+	for (i = 0; i < nChunkSize; i += IEC958_SUBFRAMES_PER_BLOCK)
 	{
-		(*m_pCallback) (m_pCallbackParam);
+		u32 *pSubFrame = &pBuffer[i];
+
+		for (unsigned j = 0; j < m_nIEC958MaskedFrames; j++)
+		{
+			u32 nMask = m_IEC958FrameMask[j];
+
+			*pSubFrame++ ^= nMask;		// left
+			*pSubFrame++ ^= nMask;		// right
+		}
 	}
 
-	return nChunkSize;
+	assert (i == nChunkSize);	// nChunkSize must be a multiple of 384
 }
 
 unsigned CSoundBaseDevice::GetQueueBytesFree (void)
@@ -870,13 +1277,25 @@ void CSoundBaseDevice::Enqueue (const void *pBuffer, unsigned nCount)
 	assert (m_pQueue != 0);
 
 	assert (nCount > 0);
-	while (nCount-- > 0)
+	unsigned nBytes = m_nQueueSize - m_nInPtr;	// until end of ring buffer
+	if (nBytes > nCount)
 	{
-		m_pQueue[m_nInPtr] = *p++;
+		nBytes = nCount;
+	}
 
-		if (++m_nInPtr == m_nQueueSize)
+	memcpy (m_pQueue + m_nInPtr, p, nBytes);
+
+	m_nInPtr += nBytes;
+	if (m_nInPtr == m_nQueueSize)
+	{
+		m_nInPtr = 0;
+
+		nCount -= nBytes;
+		if (nCount > 0)
 		{
-			m_nInPtr = 0;
+			memcpy (m_pQueue, p + nBytes, nCount);
+
+			m_nInPtr = nCount;
 		}
 	}
 }
@@ -888,13 +1307,25 @@ void CSoundBaseDevice::Dequeue (void *pBuffer, unsigned nCount)
 	assert (m_pQueue != 0);
 
 	assert (nCount > 0);
-	while (nCount-- > 0)
+	unsigned nBytes = m_nQueueSize - m_nOutPtr;	// until end of ring buffer
+	if (nBytes > nCount)
+	{
+		nBytes = nCount;
+	}
+
+	memcpy (p, m_pQueue + m_nOutPtr, nBytes);
+
+	m_nOutPtr += nBytes;
+	if (m_nOutPtr == m_nQueueSize)
 	{
-		*p++ = m_pQueue[m_nOutPtr];
+		m_nOutPtr = 0;
 
-		if (++m_nOutPtr == m_nQueueSize)
+		nCount -= nBytes;
+		if (nCount > 0)
 		{
-			m_nOutPtr = 0;
+			memcpy (p + nBytes, m_pQueue, nCount);
+
+			m_nOutPtr = nCount;
 		}
 	}
 }
@@ -950,55 +1381,81 @@ void CSoundBaseDevice::PutChunkInternal (const void *pBuffer, unsigned nChunkSiz
 	}
 }
 
-void CSoundBaseDevice::ConvertReadSoundFormat (void *pTo, const void *pFrom)
+void CSoundBaseDevice::ConvertReadFrames (u8 *pTo, const u8 *pFrom, unsigned nFrames)
 {
-	u32 nValue = 0;
+	assert (m_pReadConverter != 0);
 
-	switch (m_HWFormat)
+	if (m_bReadInterleaved)
 	{
-	case SoundFormatSigned16: {
-		const s16 *pValue = reinterpret_cast<const s16 *> (pFrom);
-		nValue = *pValue;
-		nValue <<= 8;
-		} break;
+		(*m_pReadConverter) (pTo, m_nReadSampleSize, pFrom, m_nHWSampleSize,
+				     nFrames * m_nReadChannels, m_nRangeMax);
 
-	case SoundFormatSigned24: {
-		const u32 *pValue = reinterpret_cast<const u32 *> (pFrom);
-		nValue = *pValue & 0xFFFFFFU;
-		} break;
+		return;
+	}
 
-	case SoundFormatSigned24_32: {
-		const u32 *pValue = reinterpret_cast<const u32 *> (pFrom);
-		nValue = *pValue;
-		} break;
+	for (unsigned i = 0; i < m_nReadMappedChannels; i++)
+	{
+		(*m_pReadConverter) (pTo + i * m_nReadSampleSize, m_nReadFrameSize,
+				     pFrom + m_ReadChannelMap[i] * m_nHWSampleSize,
+				     m_nHWRXFrameSize, nFrames, m_nRangeMax);
+	}
 
-	default:
-		assert (0);
-		break;
+	if (m_nReadMappedChannels < m_nReadChannels)
+	{
+		pTo += m_nReadMappedChannels * m_nReadSampleSize;
+
+		for (; nFrames > 0; nFrames--)
+		{
+			u8 *p = pTo;
+			for (unsigned i = m_nReadMappedChannels; i < m_nReadChannels; i++)
+			{
+				memcpy (p, m_ReadNullSample, m_nReadSampleSize);
+
+				p += m_nReadSampleSize;
+			}
+
+			pTo += m_nReadFrameSize;
+		}
 	}
+}
 
-	switch (m_ReadFormat)
+void CSoundBaseDevice::DequeueReadFrames (u8 *pTo, unsigned nFrames)
+{
+	assert (pTo != 0);
+	assert (m_pReadQueue != 0);
+
+	while (nFrames > 0)
 	{
-	case SoundFormatUnsigned8: {
-		u8 *pValue = reinterpret_cast<u8 *> (pTo);
-		s8 chValue = (s8) (nValue >> 16);
-		*pValue = (u8) (128 + chValue);
-		} break;
+		// convert the frames, which are stored before the end of the ring buffer
+		unsigned nBlockFrames = (m_nReadQueueSize - m_nReadOutPtr) / m_nHWRXFrameSize;
+		if (nBlockFrames > nFrames)
+		{
+			nBlockFrames = nFrames;
+		}
 
-	case SoundFormatSigned16: {
-		s16 *pValue = reinterpret_cast<s16 *> (pTo);
-		*pValue = (s16) (nValue >> 8);
-		} break;
+		if (nBlockFrames > 0)
+		{
+			ConvertReadFrames (pTo, m_pReadQueue + m_nReadOutPtr, nBlockFrames);
 
-	case SoundFormatSigned24:
-	case SoundFormatSigned24_32: {
-		u32 *pValue = reinterpret_cast<u32 *> (pTo);
-		*pValue = nValue;
-		} break;
+			m_nReadOutPtr += nBlockFrames * m_nHWRXFrameSize;
+			if (m_nReadOutPtr == m_nReadQueueSize)
+			{
+				m_nReadOutPtr = 0;
+			}
+		}
+		else
+		{
+			// frame wraps around at the end of the ring buffer
+			u8 Frame[SOUND_MAX_FRAME_SIZE];
+			ReadDequeue (Frame, m_nHWRXFrameSize);
 
-	default:
-		assert (0);
-		break;
+			ConvertReadFrames (pTo, Frame, 1);
+
+			nBlockFrames = 1;
+		}
+
+		pTo += nBlockFrames * m_nReadFrameSize;
+		nFrames -= nBlockFrames;
 	}
 }
 
@@ -1037,13 +1494,25 @@ void CSoundBaseDevice::ReadEnqueue (const void *pBuffer, unsigned nCount)
 	assert (m_pReadQueue != 0);
 
 	assert (nCount > 0);
-	while (nCount-- > 0)
+	unsigned nBytes = m_nReadQueueSize - m_nReadInPtr;	// until end of ring buffer
+	if (nBytes > nCount)
 	{
-		m_pReadQueue[m_nReadInPtr] = *p++;
+		nBytes = nCount;
+	}
+
+	memcpy (m_pReadQueue + m_nReadInPtr, p, nBytes);
+
+	m_nReadInPtr += nBytes;
+	if (m_nReadInPtr == m_nReadQueueSize)
+	{
+		m_nReadInPtr = 0;
 
-		if (++m_nReadInPtr == m_nReadQueueSize)
+		nCount -= nBytes;
+		if (nCount > 0)
 		{
-			m_nReadInPtr = 0;
+			memcpy (m_pReadQueue, p + nBytes, nCount);
+
+			m_nReadInPtr = nCount;
 		}
 	}
 }
@@ -1055,13 +1524,78 @@ void CSoundBaseDevice::ReadDequeue (void *pBuffer, unsigned nCount)
 	assert (m_pReadQueue != 0);
 
 	assert (nCount > 0);
-	while (nCount-- > 0)
+	unsigned nBytes = m_nReadQueueSize - m_nReadOutPtr;	// until end of ring buffer
+	if (nBytes > nCount)
+	{
+		nBytes = nCount;
+	}
+
+	memcpy (p, m_pReadQueue + m_nReadOutPtr, nBytes);
+
+	m_nReadOutPtr += nBytes;
+	if (m_nReadOutPtr == m_nReadQueueSize)
 	{
-		*p++ = m_pReadQueue[m_nReadOutPtr];
+		m_nReadOutPtr = 0;
 
-		if (++m_nReadOutPtr == m_nReadQueueSize)
+		nCount -= nBytes;
+		if (nCount > 0)
 		{
-			m_nReadOutPtr = 0;
+			memcpy (p + nBytes, m_pReadQueue, nCount);
+
+			m_nReadOutPtr = nCount;
 		}
 	}
 }
+
+// Sample conversion //////////////////////////////////////////////////
+
+CSoundBaseDevice::TConverter *CSoundBaseDevice::GetWriteConverter (TSoundFormat WriteFormat,
+								     TSoundFormat HWFormat)
+{
+#define WRITE_CONVERTERS(from)	{ 0, ConvertWrite<from, SoundFormatSigned16>,		\
+				  ConvertWrite<from, SoundFormatSigned24>,		\
+				  ConvertWrite<from, SoundFormatSigned24_32>,		\
+				  ConvertWrite<from, SoundFormatUnsigned32>,		\
+				  ConvertWrite<from, SoundFormatIEC958> }
+
+	static TConverter *const Converters[][SoundFormatUnknown] =
+	{
+		WRITE_CONVERTERS (SoundFormatUnsigned8),
+		WRITE_CONVERTERS (SoundFormatSigned16),
+		WRITE_CONVERTERS (SoundFormatSigned24),
+		WRITE_CONVERTERS (SoundFormatSigned24_32)
+	};
+
+	if (   WriteFormat > SoundFormatSigned24_32
+	    || HWFormat >= SoundFormatUnknown)
+	{
+		return 0;
+	}
+
+	return Converters[WriteFormat][HWFormat];
+}
+
+CSoundBaseDevice::TConverter *CSoundBaseDevice::GetReadConverter (TSoundFormat HWFormat,
+								    TSoundFormat ReadFormat)
+{
+#define READ_CONVERTERS(from)	{ ConvertRead<from, SoundFormatUnsigned8>,		\
+				  ConvertRead<from, SoundFormatSigned16>,		\
+				  ConvertRead<from, SoundFormatSigned24>,		\
+				  ConvertRead<from, SoundFormatSigned24_32> }
+
+	static TConverter *const Converters[][SoundFormatSigned24_32+1] =
+	{
+		{ 0, 0, 0, 0 },		// SoundFormatUnsigned8 (not supported as HW format)
+		READ_CONVERTERS (SoundFormatSigned16),
+		READ_CONVERTERS (SoundFormatSigned24),
+		READ_CONVERTERS (SoundFormatSigned24_32)
+	};
+
+	if (   HWFormat > SoundFormatSigned24_32
+	    || ReadFormat > SoundFormatSigned24_32)
+	{
+		return 0;
+	}
+
+	return Converters[HWFormat][ReadFormat];
+}
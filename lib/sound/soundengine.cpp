@@ -0,0 +1,335 @@
+//
+// soundengine.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/sound/soundengine.h>
+#include <circle/multicore.h>
+#include <circle/synchronize.h>
+#include <circle/timer.h>
+#include <circle/util.h>
+#include <assert.h>
+
+CSoundEngine::CSoundEngine (CSoundBaseDevice *pDevice, unsigned nPeriodFrames,
+			    unsigned nPeriods, unsigned nCore)
+:	m_pDevice (pDevice),
+	m_nPeriodFrames (nPeriodFrames),
+	m_nPeriods (nPeriods),
+	m_nCore (nCore),
+	m_pCallback (0),
+	m_pCallbackParam (0),
+	m_pBuffer (0),
+	m_pOutput (0),
+	m_nProduced (nPeriods),		// all periods initially filled with silence
+	m_nConsumed (0),
+	m_nFramesSent (0),
+	m_nWritePeriod (0),
+	m_nReadPeriod (0),
+	m_nReadOffset (0),
+	m_bCancel (FALSE)
+{
+	assert (m_pDevice != 0);
+	assert (   SOUND_ENGINE_MIN_PERIOD_FRAMES <= m_nPeriodFrames
+		&& m_nPeriodFrames <= SOUND_ENGINE_MAX_PERIOD_FRAMES);
+	assert (2 <= m_nPeriods && m_nPeriods <= SOUND_ENGINE_MAX_PERIODS);
+#ifdef ARM_ALLOW_MULTI_CORE
+	assert (m_nCore < CORES);
+#else
+	assert (m_nCore == 0);
+#endif
+
+	m_nChannels = m_pDevice->GetHWTXChannels ();
+	m_nSampleRate = m_pDevice->GetSampleRate ();
+	assert (m_nChannels > 0);
+	assert (m_nSampleRate > 0);
+
+	m_nPeriodUsecs = (unsigned) ((u64) m_nPeriodFrames * 1000000 / m_nSampleRate);
+
+	unsigned nPeriodSamples = m_nPeriodFrames * m_nChannels;
+
+	m_pBuffer = new s32[m_nPeriods * nPeriodSamples];
+	m_pOutput = new s32[nPeriodSamples];
+	if (   m_pBuffer == 0
+	    || m_pOutput == 0)
+	{
+		return;
+	}
+
+	memset (m_pBuffer, 0, m_nPeriods * nPeriodSamples * sizeof (s32));
+
+	ResetStats ();
+
+	m_pDevice->SetSource (this);
+}
+
+CSoundEngine::~CSoundEngine (void)
+{
+	assert (m_pDevice != 0);
+	assert (!m_pDevice->IsActive ());
+	if (IsValid ())
+	{
+		m_pDevice->SetSource (0);
+	}
+
+	delete [] m_pOutput;
+	m_pOutput = 0;
+
+	delete [] m_pBuffer;
+	m_pBuffer = 0;
+
+	m_pCallback = 0;
+	m_pDevice = 0;
+}
+
+boolean CSoundEngine::IsValid (void) const
+{
+	return m_pBuffer != 0 && m_pOutput != 0;
+}
+
+void CSoundEngine::RegisterProcessCallback (TProcessCallback *pCallback, void *pParam)
+{
+	assert (m_pCallback == 0);
+	m_pCallback = pCallback;
+	assert (m_pCallback != 0);
+
+	m_pCallbackParam = pParam;
+}
+
+boolean CSoundEngine::Start (void)
+{
+	assert (IsValid ());
+	assert (m_pCallback != 0);
+
+	m_bCancel = FALSE;
+
+	ResetStats ();
+
+	assert (m_pDevice != 0);
+	return m_pDevice->Start ();
+}
+
+void CSoundEngine::Cancel (void)
+{
+	assert (m_pDevice != 0);
+	m_pDevice->Cancel ();
+
+	m_bCancel = TRUE;
+
+#ifdef ARM_ALLOW_MULTI_CORE
+	DataSyncBarrier ();
+	SendEvent ();
+#endif
+}
+
+#ifdef ARM_ALLOW_MULTI_CORE
+
+void CSoundEngine::Run (void)
+{
+	assert (m_nCore != 0);
+	assert (CMultiCoreSupport::ThisCore () == m_nCore);
+
+	while (!m_bCancel)
+	{
+		if (m_nProduced - m_nConsumed >= m_nPeriods)
+		{
+			// woken up by SendEvent() in GetFrames(), when a period has been sent,
+			// returns immediately, if the event was sent after the check above
+			WaitForEvent ();
+
+			continue;
+		}
+
+		ProcessPeriod ();
+	}
+}
+
+#endif
+
+void CSoundEngine::GetStats (TSoundEngineStats *pStats)
+{
+	assert (pStats != 0);
+
+	pStats->nPeriodFrames = m_nPeriodFrames;
+	pStats->nPeriodUsecs = m_nPeriodUsecs;
+
+	m_StatsLock.Acquire ();
+
+	unsigned nPeriods = m_nStatPeriods;
+
+	pStats->nPeriods = nPeriods;
+	pStats->nXRuns = m_nStatXRuns;
+
+	if (nPeriods > 0)
+	{
+		pStats->nProcessUsecsMin = m_nStatProcessMin;
+		pStats->nProcessUsecsAvg = (unsigned) (m_ullStatProcessSum / nPeriods);
+		pStats->nProcessUsecsMax = m_nStatProcessMax;
+		pStats->nSlackUsecsMin = m_nStatSlackMin;
+		pStats->nSlackUsecsAvg = (unsigned) (m_ullStatSlackSum / nPeriods);
+	}
+	else
+	{
+		pStats->nProcessUsecsMin = 0;
+		pStats->nProcessUsecsAvg = 0;
+		pStats->nProcessUsecsMax = 0;
+		pStats->nSlackUsecsMin = 0;
+		pStats->nSlackUsecsAvg = 0;
+	}
+
+	m_StatsLock.Release ();
+
+	pStats->nLoadPercentMax = m_nPeriodUsecs > 0
+				? pStats->nProcessUsecsMax * 100 / m_nPeriodUsecs : 0;
+}
+
+void CSoundEngine::ResetStats (void)
+{
+	m_StatsLock.Acquire ();
+
+	m_nStatPeriods = 0;
+	m_nStatXRuns = 0;
+	m_nStatProcessMin = (unsigned) -1;
+	m_nStatProcessMax = 0;
+	m_ullStatProcessSum = 0;
+	m_nStatSlackMin = (unsigned) -1;
+	m_ullStatSlackSum = 0;
+
+	m_StatsLock.Release ();
+}
+
+const s32 *CSoundEngine::GetFrames (unsigned nFrames, unsigned *pFrames)
+{
+	assert (nFrames > 0);
+	assert (pFrames != 0);
+	assert (m_pOutput != 0);
+
+	unsigned nAvail = m_nPeriodFrames - m_nReadOffset;
+	if (nFrames > nAvail)
+	{
+		nFrames = nAvail;
+	}
+
+	*pFrames = nFrames;
+
+	if (m_nProduced == m_nConsumed)
+	{
+		// deadline missed, the current period has not been processed yet
+		memset (m_pOutput, 0, nFrames * m_nChannels * sizeof (s32));
+
+		m_StatsLock.Acquire ();
+		m_nStatXRuns++;
+		m_StatsLock.Release ();
+
+		return m_pOutput;
+	}
+
+	DataMemBarrier ();
+
+	// copy the frames, so that the period can be released before they are converted
+	assert (m_pBuffer != 0);
+	unsigned nPeriodSamples = m_nPeriodFrames * m_nChannels;
+	memcpy (m_pOutput,
+		m_pBuffer + m_nReadPeriod * nPeriodSamples + m_nReadOffset * m_nChannels,
+		nFrames * m_nChannels * sizeof (s32));
+
+	m_nFramesSent += nFrames;
+
+	m_nReadOffset += nFrames;
+	if (m_nReadOffset == m_nPeriodFrames)
+	{
+		m_nReadOffset = 0;
+
+		if (++m_nReadPeriod == m_nPeriods)
+		{
+			m_nReadPeriod = 0;
+		}
+
+		DataMemBarrier ();
+
+		m_nConsumed++;
+
+		if (m_nCore == 0)
+		{
+			ProcessPeriod ();
+		}
+#ifdef ARM_ALLOW_MULTI_CORE
+		else
+		{
+			DataSyncBarrier ();
+			SendEvent ();
+		}
+#endif
+	}
+
+	return m_pOutput;
+}
+
+void CSoundEngine::ProcessPeriod (void)
+{
+	assert (m_pCallback != 0);
+	assert (m_pBuffer != 0);
+
+	unsigned nProduced = m_nProduced;
+	assert (nProduced - m_nConsumed < m_nPeriods);
+
+	DataMemBarrier ();
+
+	s32 *pBuffer = m_pBuffer + m_nWritePeriod * m_nPeriodFrames * m_nChannels;
+	if (++m_nWritePeriod == m_nPeriods)
+	{
+		m_nWritePeriod = 0;
+	}
+
+	unsigned nStartTicks = CTimer::GetClockTicks ();
+
+	(*m_pCallback) (pBuffer, m_nPeriodFrames, m_nChannels, m_pCallbackParam);
+
+	unsigned nProcessUsecs = CTimer::GetClockTicks () - nStartTicks;
+
+	// frames of the previous periods, which are still waiting to be sent
+	// (0, if GetFrames() is already waiting for this period)
+	unsigned nSlackFrames = nProduced * m_nPeriodFrames - m_nFramesSent;
+	assert (nSlackFrames <= m_nPeriods * m_nPeriodFrames);
+
+	unsigned nSlackUsecs = (unsigned) ((u64) nSlackFrames * 1000000 / m_nSampleRate);
+
+	DataMemBarrier ();
+
+	m_nProduced = nProduced + 1;
+
+	m_StatsLock.Acquire ();
+
+	m_nStatPeriods++;
+
+	if (nProcessUsecs < m_nStatProcessMin)
+	{
+		m_nStatProcessMin = nProcessUsecs;
+	}
+	if (nProcessUsecs > m_nStatProcessMax)
+	{
+		m_nStatProcessMax = nProcessUsecs;
+	}
+	m_ullStatProcessSum += nProcessUsecs;
+
+	if (nSlackUsecs < m_nStatSlackMin)
+	{
+		m_nStatSlackMin = nSlackUsecs;
+	}
+	m_ullStatSlackSum += nSlackUsecs;
+
+	m_StatsLock.Release ();
+}
@@ -0,0 +1,577 @@
+//
+// soundmixer.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/sound/soundmixer.h>
+#include <circle/sysconfig.h>
+#include <circle/synchronize.h>
+#include <circle/util.h>
+#include <assert.h>
+
+// NEON registers may be used here only, if they are saved on IRQ,
+// because the streams are mixed from GetChunk() in interrupt context
+#if    (defined (__ARM_NEON) || defined (__ARM_NEON__)) \
+    && defined (SAVE_VFP_REGS_ON_IRQ) && STDLIB_SUPPORT >= 1
+	#define SOUND_MIXER_NEON
+	#include <arm_neon.h>
+#endif
+
+#define MAX_RESAMPLE_RATIO	8	// input / output sample rate
+
+#define PI	3.14159265358979323846
+
+// sine for the filter design, without libm
+static double Sine (double x)
+{
+	while (x > PI)
+	{
+		x -= 2*PI;
+	}
+
+	while (x < -PI)
+	{
+		x += 2*PI;
+	}
+
+	if (x > PI/2)
+	{
+		x = PI - x;
+	}
+	else if (x < -PI/2)
+	{
+		x = -PI - x;
+	}
+
+	// Taylor series, error < 1e-12 for |x| <= PI/2
+	double x2 = x*x;
+	double fTerm = x;
+	double fSum = x;
+	for (unsigned i = 1; i <= 9; i++)
+	{
+		fTerm *= -x2 / ((2*i) * (2*i+1));
+		fSum += fTerm;
+	}
+
+	return fSum;
+}
+
+static double Cosine (double x)
+{
+	return Sine (x + PI/2);
+}
+
+// CSoundMixerStream //////////////////////////////////////////////////
+
+CSoundMixerStream::CSoundMixerStream (TSoundFormat Format, unsigned nChannels,
+				      unsigned nSampleRate, unsigned nHWSampleRate,
+				      unsigned nQueueFrames)
+:	m_Format (Format),
+	m_nChannels (nChannels),
+	m_pQueue (0),
+	m_nQueueSize (nQueueFrames + 1),	// 1 frame remains free
+	m_nInPtr (0),
+	m_nOutPtr (0),
+	m_bStarted (FALSE),
+	m_nGain (SOUND_MIXER_UNITY_GAIN),
+	m_nUnderruns (0),
+	m_bResample (FALSE),
+	m_pCoeffs (0),
+	m_nPhase (0),
+	m_nHistoryPos (0),
+	m_nHistoryIn (0)
+{
+	assert (1 <= m_nChannels && m_nChannels <= 2);
+	assert (nQueueFrames > 0);
+
+	switch (m_Format)
+	{
+	case SoundFormatUnsigned8:	m_nSampleSize = sizeof (u8);	break;
+	case SoundFormatSigned16:	m_nSampleSize = sizeof (s16);	break;
+	case SoundFormatSigned24:	m_nSampleSize = sizeof (u8)*3;	break;
+	case SoundFormatSigned24_32:	m_nSampleSize = sizeof (s32);	break;
+
+	default:
+		assert (0);
+		m_nSampleSize = sizeof (s16);
+		break;
+	}
+
+	m_nFrameSize = m_nChannels * m_nSampleSize;
+
+	m_pQueue = new s32[m_nQueueSize * m_nChannels];
+
+	if (nSampleRate != nHWSampleRate)
+	{
+		SetupResampler (nSampleRate, nHWSampleRate);
+	}
+}
+
+CSoundMixerStream::~CSoundMixerStream (void)
+{
+	delete [] m_pCoeffs;
+	m_pCoeffs = 0;
+
+	delete [] m_pQueue;
+	m_pQueue = 0;
+}
+
+boolean CSoundMixerStream::IsValid (void) const
+{
+	return m_pQueue != 0 && (!m_bResample || m_pCoeffs != 0);
+}
+
+int CSoundMixerStream::Write (const void *pBuffer, size_t nCount)
+{
+	const u8 *pFrom = static_cast<const u8 *> (pBuffer);
+	assert (pFrom != 0);
+	assert (m_pQueue != 0);
+
+	unsigned nFrames = nCount / m_nFrameSize;
+	unsigned nFramesFree = GetQueueFramesFree ();
+	if (nFrames > nFramesFree)
+	{
+		nFrames = nFramesFree;
+	}
+
+	unsigned nInPtr = m_nInPtr;
+	for (unsigned i = 0; i < nFrames; i++)
+	{
+		s32 *pTo = &m_pQueue[nInPtr * m_nChannels];
+
+		// samples are converted to 24 bits, left aligned first and shifted back
+		for (unsigned j = 0; j < m_nChannels; j++)
+		{
+			switch (m_Format)
+			{
+			case SoundFormatUnsigned8:
+				*pTo++ = (s32) (((u32) *pFrom - 128) << 24) >> 8;
+				break;
+
+			case SoundFormatSigned16:
+				*pTo++ = (s32) ((u32) pFrom[0] << 16 | (u32) pFrom[1] << 24) >> 8;
+				break;
+
+			case SoundFormatSigned24:
+			case SoundFormatSigned24_32:
+				*pTo++ = (s32) (  (u32) pFrom[0] << 8 | (u32) pFrom[1] << 16
+						| (u32) pFrom[2] << 24) >> 8;
+				break;
+
+			default:
+				assert (0);
+				break;
+			}
+
+			pFrom += m_nSampleSize;
+		}
+
+		if (++nInPtr == m_nQueueSize)
+		{
+			nInPtr = 0;
+		}
+	}
+
+	DataMemBarrier ();		// samples must be visible, before the pointer is
+
+	m_nInPtr = nInPtr;
+
+	if (nFrames > 0)
+	{
+		m_bStarted = TRUE;
+	}
+
+	return nFrames * m_nFrameSize;
+}
+
+unsigned CSoundMixerStream::GetQueueFramesFree (void) const
+{
+	unsigned nInPtr = m_nInPtr;
+	unsigned nOutPtr = m_nOutPtr;
+
+	if (nOutPtr <= nInPtr)
+	{
+		return m_nQueueSize+nOutPtr-nInPtr-1;
+	}
+
+	return nOutPtr-nInPtr-1;
+}
+
+unsigned CSoundMixerStream::GetQueueFramesAvail (void) const
+{
+	unsigned nInPtr = m_nInPtr;
+	unsigned nOutPtr = m_nOutPtr;
+
+	if (nInPtr < nOutPtr)
+	{
+		return m_nQueueSize+nInPtr-nOutPtr;
+	}
+
+	return nInPtr-nOutPtr;
+}
+
+void CSoundMixerStream::SetGain (unsigned nGain)
+{
+	assert (nGain <= 4*SOUND_MIXER_UNITY_GAIN);
+	m_nGain = nGain;
+}
+
+unsigned CSoundMixerStream::GetGain (void) const
+{
+	return m_nGain;
+}
+
+unsigned CSoundMixerStream::GetUnderruns (void) const
+{
+	return m_nUnderruns;
+}
+
+void CSoundMixerStream::Mix (s32 *pBuffer, unsigned nFrames, unsigned nHWChannels,
+			     unsigned nLeft, unsigned nRight)
+{
+	assert (pBuffer != 0);
+	assert (m_pQueue != 0);
+
+	unsigned nInPtr = m_nInPtr;
+	DataMemBarrier ();		// read samples after the pointer
+	unsigned nOutPtr = m_nOutPtr;
+
+	s64 nGain = m_nGain;
+
+	for (unsigned i = 0; i < nFrames; i++)
+	{
+		s32 nSampleLeft, nSampleRight;	// 24-bit
+
+		if (!m_bResample)
+		{
+			m_nHistoryIn = 0;
+			PullFrame (&nOutPtr, nInPtr);
+
+			nSampleLeft = (s32) ((m_History[0][0] * nGain) >> 16);
+			nSampleRight = (s32) ((m_History[1][0] * nGain) >> 16);
+		}
+		else
+		{
+			// fill the filter window
+			while (m_nHistoryIn < m_nHistoryPos + Taps)
+			{
+				if (m_nHistoryIn == HistorySize)
+				{
+					assert (m_nHistoryPos <= m_nHistoryIn);
+					unsigned nKeep = m_nHistoryIn - m_nHistoryPos;
+
+					for (unsigned j = 0; j < m_nChannels; j++)
+					{
+						memmove (m_History[j], &m_History[j][m_nHistoryPos],
+							 nKeep * sizeof (s32));
+					}
+
+					m_nHistoryPos = 0;
+					m_nHistoryIn = nKeep;
+				}
+
+				PullFrame (&nOutPtr, nInPtr);
+			}
+
+			const s16 *pCoeffs = &m_pCoeffs[(m_nPhase >> (32-PhaseBits)) * Taps];
+
+			// Q15 coefficients, Q16 gain, result has 24 bits
+			nSampleLeft = (s32) ((Filter (&m_History[0][m_nHistoryPos], pCoeffs) * nGain) >> 31);
+			nSampleRight =   m_nChannels == 1 ? nSampleLeft
+				       : (s32) ((Filter (&m_History[1][m_nHistoryPos], pCoeffs) * nGain) >> 31);
+
+			u64 ullPos = m_nPhase + m_ullStep;
+			m_nPhase = (u32) ullPos;
+			m_nHistoryPos += (unsigned) (ullPos >> 32);
+		}
+
+		if (nLeft != nRight)
+		{
+			pBuffer[nLeft] += nSampleLeft;
+			pBuffer[nRight] += nSampleRight;
+		}
+		else
+		{
+			pBuffer[nLeft] += (nSampleLeft + nSampleRight) / 2;	// mono device
+		}
+
+		pBuffer += nHWChannels;
+	}
+
+	DataMemBarrier ();		// samples have been read, before the pointer is updated
+
+	m_nOutPtr = nOutPtr;
+}
+
+boolean CSoundMixerStream::PullFrame (unsigned *pOutPtr, unsigned nInPtr)
+{
+	assert (pOutPtr != 0);
+	assert (m_nHistoryIn < HistorySize);
+
+	if (*pOutPtr == nInPtr)
+	{
+		m_History[0][m_nHistoryIn] = 0;
+		m_History[1][m_nHistoryIn] = 0;
+		m_nHistoryIn++;
+
+		if (m_bStarted)
+		{
+			m_nUnderruns++;
+		}
+
+		return FALSE;
+	}
+
+	const s32 *pFrame = &m_pQueue[*pOutPtr * m_nChannels];
+	m_History[0][m_nHistoryIn] = pFrame[0];
+	m_History[1][m_nHistoryIn] = pFrame[m_nChannels-1];	// mono: duplicate
+	m_nHistoryIn++;
+
+	if (++*pOutPtr == m_nQueueSize)
+	{
+		*pOutPtr = 0;
+	}
+
+	return TRUE;
+}
+
+void CSoundMixerStream::SetupResampler (unsigned nSampleRate, unsigned nHWSampleRate)
+{
+	assert (nSampleRate > 0);
+	assert (nHWSampleRate > 0);
+	assert (nSampleRate <= MAX_RESAMPLE_RATIO * nHWSampleRate);
+
+	m_bResample = TRUE;
+
+	m_pCoeffs = new s16[Phases * Taps];
+	if (m_pCoeffs == 0)
+	{
+		return;
+	}
+
+	m_ullStep = ((u64) nSampleRate << 32) / nHWSampleRate;
+
+	// windowed-sinc (Blackman) lowpass, limited to the output band on downsampling
+	double fCutoff = 0.9;
+	if (nHWSampleRate < nSampleRate)
+	{
+		fCutoff *= (double) nHWSampleRate / nSampleRate;
+	}
+
+	for (unsigned nPhase = 0; nPhase < Phases; nPhase++)
+	{
+		double Coeff[Taps];
+		double fSum = 0.0;
+
+		for (unsigned i = 0; i < Taps; i++)
+		{
+			// distance from the interpolated position
+			double t = (double) i - (Taps/2 - 1) - (double) nPhase / Phases;
+
+			double x = PI * fCutoff * t;
+			double fSinc = x != 0.0 ? Sine (x) / x : 1.0;
+
+			double w = t / (Taps/2);
+			double fWindow = 0.42 + 0.5 * Cosine (PI * w) + 0.08 * Cosine (2*PI * w);
+
+			Coeff[i] = fSinc * fWindow;
+			fSum += Coeff[i];
+		}
+
+		// normalize to DC gain 1.0
+		for (unsigned i = 0; i < Taps; i++)
+		{
+			double fValue = Coeff[i] / fSum * 32767.0;
+
+			m_pCoeffs[nPhase * Taps + i] = (s16) (fValue >= 0.0 ? fValue + 0.5 : fValue - 0.5);
+		}
+	}
+}
+
+s64 CSoundMixerStream::Filter (const s32 *pHistory, const s16 *pCoeffs)
+{
+	assert (pHistory != 0);
+	assert (pCoeffs != 0);
+
+	// 24-bit samples with Q15 coefficients need a 64-bit accumulator
+#ifdef SOUND_MIXER_NEON
+	int64x2_t vAcc = vdupq_n_s64 (0);
+
+	for (unsigned i = 0; i < Taps; i += 4)
+	{
+		int32x4_t vSamples = vld1q_s32 (pHistory + i);
+		int32x4_t vCoeffs = vmovl_s16 (vld1_s16 (pCoeffs + i));
+
+		vAcc = vmlal_s32 (vAcc, vget_low_s32 (vSamples), vget_low_s32 (vCoeffs));
+		vAcc = vmlal_s32 (vAcc, vget_high_s32 (vSamples), vget_high_s32 (vCoeffs));
+	}
+
+	return vgetq_lane_s64 (vAcc, 0) + vgetq_lane_s64 (vAcc, 1);
+#else
+	s64 nAcc = 0;
+
+	for (unsigned i = 0; i < Taps; i++)
+	{
+		nAcc += (s64) pHistory[i] * pCoeffs[i];
+	}
+
+	return nAcc;
+#endif
+}
+
+// CSoundMixer ////////////////////////////////////////////////////////
+
+CSoundMixer::CSoundMixer (CSoundBaseDevice *pDevice)
+:	m_pDevice (pDevice),
+	m_pBuffer (0)
+{
+	assert (m_pDevice != 0);
+
+	m_nHWChannels = m_pDevice->GetHWTXChannels ();
+	m_nHWSampleRate = m_pDevice->GetSampleRate ();
+	assert (m_nHWChannels > 0);
+	assert (m_nHWSampleRate > 0);
+
+	m_nLeft = 0;
+	m_nRight = m_nHWChannels >= 2 ? 1 : 0;
+	if (m_pDevice->AreChannelsSwapped ())
+	{
+		m_nLeft = 1;
+		m_nRight = 0;
+	}
+
+	for (unsigned i = 0; i < SOUND_MIXER_MAX_STREAMS; i++)
+	{
+		m_pStream[i] = 0;
+	}
+
+	m_pBuffer = new s32[BlockFrames * m_nHWChannels];
+	assert (m_pBuffer != 0);
+
+	m_pDevice->SetSource (this);
+}
+
+CSoundMixer::~CSoundMixer (void)
+{
+	m_pDevice->SetSource (0);
+
+	for (unsigned i = 0; i < SOUND_MIXER_MAX_STREAMS; i++)
+	{
+		delete m_pStream[i];
+		m_pStream[i] = 0;
+	}
+
+	delete [] m_pBuffer;
+	m_pBuffer = 0;
+}
+
+CSoundMixerStream *CSoundMixer::AddStream (TSoundFormat Format, unsigned nChannels,
+					   unsigned nSampleRate, unsigned nQueueMsecs)
+{
+	assert (1 <= nQueueMsecs && nQueueMsecs <= 1000);
+	unsigned nQueueFrames = (nSampleRate * nQueueMsecs + 999) / 1000;
+
+	CSoundMixerStream *pStream = new CSoundMixerStream (Format, nChannels, nSampleRate,
+							    m_nHWSampleRate, nQueueFrames);
+	if (   pStream == 0
+	    || !pStream->IsValid ())
+	{
+		delete pStream;
+
+		return 0;
+	}
+
+	m_SpinLock.Acquire ();
+
+	for (unsigned i = 0; i < SOUND_MIXER_MAX_STREAMS; i++)
+	{
+		if (m_pStream[i] == 0)
+		{
+			m_pStream[i] = pStream;
+
+			m_SpinLock.Release ();
+
+			return pStream;
+		}
+	}
+
+	m_SpinLock.Release ();
+
+	delete pStream;
+
+	return 0;
+}
+
+void CSoundMixer::RemoveStream (CSoundMixerStream *pStream)
+{
+	assert (pStream != 0);
+
+	m_SpinLock.Acquire ();
+
+	for (unsigned i = 0; i < SOUND_MIXER_MAX_STREAMS; i++)
+	{
+		if (m_pStream[i] == pStream)
+		{
+			m_pStream[i] = 0;
+
+			break;
+		}
+	}
+
+	m_SpinLock.Release ();
+
+	delete pStream;
+}
+
+const s32 *CSoundMixer::GetFrames (unsigned nFrames, unsigned *pFrames)
+{
+	assert (m_pBuffer != 0);
+	assert (pFrames != 0);
+
+	if (nFrames > BlockFrames)
+	{
+		nFrames = BlockFrames;
+	}
+
+	unsigned nSamples = nFrames * m_nHWChannels;
+	memset (m_pBuffer, 0, nSamples * sizeof (s32));
+
+	m_SpinLock.Acquire ();
+
+	for (unsigned i = 0; i < SOUND_MIXER_MAX_STREAMS; i++)
+	{
+		if (m_pStream[i] != 0)
+		{
+			m_pStream[i]->Mix (m_pBuffer, nFrames, m_nHWChannels, m_nLeft, m_nRight);
+		}
+	}
+
+	m_SpinLock.Release ();
+
+	// clip to 24 bits
+	const s32 nMax = (1 << 23) - 1;
+	for (unsigned i = 0; i < nSamples; i++)
+	{
+		s32 nSample = m_pBuffer[i];
+
+		m_pBuffer[i] = nSample > nMax ? nMax : (nSample < -nMax ? -nMax : nSample);
+	}
+
+	*pFrames = nFrames;
+
+	return m_pBuffer;
+}
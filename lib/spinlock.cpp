@@ -2,7 +2,7 @@
 // spinlock.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2015-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2015-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -22,6 +22,8 @@
 #ifdef ARM_ALLOW_MULTI_CORE
 
 #include <circle/multicore.h>
+#include <circle/lockstatistics.h>
+#include <circle/tracer.h>
 #include <assert.h>
 
 #define SPINLOCK_SAVE_POWER
@@ -31,6 +33,11 @@ boolean CSpinLock::s_bEnabled = FALSE;
 CSpinLock::CSpinLock (unsigned nTargetLevel)
 :	m_nTargetLevel (nTargetLevel),
 	m_nLocked (0)
+#ifdef LOCK_STATISTICS
+	, m_pName (0),
+	m_nSite (LOCK_STATISTICS_UNREGISTERED),
+	m_nAcquireTicks (0)
+#endif
 {
 	assert (nTargetLevel <= FIQ_LEVEL);
 }
@@ -47,6 +54,11 @@ void CSpinLock::Acquire (void)
 		EnterCritical (m_nTargetLevel);
 	}
 
+#ifdef LOCK_STATISTICS
+	boolean bContended = s_bEnabled && *(volatile u32 *) &m_nLocked != 0;
+	u64 nStartTicks = CTracer::GetTimestamp ();
+#endif
+
 	if (s_bEnabled)
 	{
 #if AARCH == 32
@@ -89,10 +101,27 @@ void CSpinLock::Acquire (void)
 		);
 #endif
 	}
+
+#ifdef LOCK_STATISTICS
+	m_nAcquireTicks = CTracer::GetTimestamp ();
+
+	if (m_nSite == LOCK_STATISTICS_UNREGISTERED)
+	{
+		m_nSite = CLockStatistics::Register (m_pName,
+						     (uintptr) __builtin_return_address (0),
+						     LockTypeSpinLock);
+	}
+
+	CLockStatistics::Acquired (m_nSite, bContended, m_nAcquireTicks - nStartTicks);
+#endif
 }
 
 void CSpinLock::Release (void)
 {
+#ifdef LOCK_STATISTICS
+	CLockStatistics::Released (m_nSite, CTracer::GetTimestamp () - m_nAcquireTicks);
+#endif
+
 	if (s_bEnabled)
 	{
 #if AARCH == 32
@@ -128,6 +157,15 @@ void CSpinLock::Release (void)
 	}
 }
 
+void CSpinLock::SetName (const char *pName)
+{
+#ifdef LOCK_STATISTICS
+	m_pName = pName;
+
+	m_nSite = LOCK_STATISTICS_UNREGISTERED;		// register by name on next Acquire()
+#endif
+}
+
 void CSpinLock::Enable (void)
 {
 	assert (!s_bEnabled);
@@ -23,6 +23,7 @@
 #include <circle/sysconfig.h>
 #include <circle/timer.h>
 #include <circle/util.h>
+#include <assert.h>
 
 static const char DevicePrefix[] = "tty";
 
@@ -40,6 +41,19 @@ CTerminalDevice::CTerminalDevice (CDisplay *pDisplay, unsigned nDeviceIndex,
 	m_nUsedWidth (0),
 	m_nUsedHeight (0),
 	m_nDepth (0),
+	m_nPixelOffset (0),
+	m_pLineDirty (nullptr),
+	m_bHardwareScroll (FALSE),
+	m_nDisplayOffset (0),
+	m_pCells (nullptr),
+	m_pRowState (nullptr),
+	m_nRows (0),
+	m_nColumns (0),
+	m_nFirstRow (0),
+	m_nPendingScroll (0),
+	m_bClearRemainder (FALSE),
+	m_RemainderColor (0),
+	m_bRenderPending (FALSE),
 	m_State (StateStart),
 	m_nScrollStart (0),
 	m_nScrollEnd (0),
@@ -48,6 +62,8 @@ CTerminalDevice::CTerminalDevice (CDisplay *pDisplay, unsigned nDeviceIndex,
 	m_bCursorOn (TRUE),
 	m_bCursorBlock (FALSE),
 	m_bCursorVisible (FALSE),
+	m_nCursorPixelX (0),
+	m_nCursorPixelY (0),
 	m_Color (0),
 	m_BackgroundColor (0),
 	m_bReverseAttribute (FALSE),
@@ -70,6 +86,15 @@ CTerminalDevice::~CTerminalDevice (void)
 	delete [] m_pCursorPixels;
 	m_pCursorPixels = nullptr;
 
+	delete [] m_pRowState;
+	m_pRowState = nullptr;
+
+	delete [] m_pCells;
+	m_pCells = nullptr;
+
+	delete [] m_pLineDirty;
+	m_pLineDirty = nullptr;
+
 	m_pDisplay = nullptr;
 }
 
@@ -100,26 +125,48 @@ boolean CTerminalDevice::Initialize (void)
 		return FALSE;
 	}
 
-	m_nUsedWidth = m_nWidth / m_CharGen.GetCharWidth () * m_CharGen.GetCharWidth ();
-	m_nUsedHeight = m_nHeight / m_CharGen.GetCharHeight () * m_CharGen.GetCharHeight ();
+	m_pLineDirty = new u8[m_nHeight];
+	if (!m_pLineDirty)
+	{
+		return FALSE;
+	}
+
+	memset (m_pLineDirty, 0, m_nHeight);
+
+	m_nColumns = m_nWidth / m_CharGen.GetCharWidth ();
+	m_nRows = m_nHeight / m_CharGen.GetCharHeight ();
+
+	m_pCells = new TCell[m_nRows * m_nColumns];
+	m_pRowState = new TRowState[m_nRows];
+	if (   !m_pCells
+	    || !m_pRowState)
+	{
+		return FALSE;
+	}
+
+	m_nUsedWidth = m_nColumns * m_CharGen.GetCharWidth ();
+	m_nUsedHeight = m_nRows * m_CharGen.GetCharHeight ();
 	m_nScrollEnd = m_nUsedHeight;
 
+	// The display memory must hold the pixel buffer twice for hardware scrolling.
+	m_bHardwareScroll =    m_pDisplay->GetVirtualHeight () >= 2*m_nHeight
+			    && m_pDisplay->SetVirtualOffset (0, 0);
+
 	m_Color = m_pDisplay->GetColor (CDisplay::NormalColor);
 	m_BackgroundColor = m_pDisplay->GetColor (CDisplay::Black);
 
 	CursorHome ();
-	ClearDisplayEnd ();
-	InvertCursor ();
 
-	// Initial update
-	m_UpdateArea.x1 = 0;
-	m_UpdateArea.x2 = m_nWidth-1;
-	m_UpdateArea.y1 = 0;
-	m_UpdateArea.y2 = m_nHeight-1;
-	m_pDisplay->SetArea (m_UpdateArea, m_pBuffer8);
+	for (unsigned nRow = 0; nRow < m_nRows; nRow++)
+	{
+		EraseRow (nRow);
+	}
 
-	m_UpdateArea.y1 = m_nHeight;
-	m_UpdateArea.y2 = 0;
+	m_bClearRemainder = TRUE;
+	m_RemainderColor = m_BackgroundColor;
+
+	// Initial update
+	Flush ();
 
 	if (!CDeviceNameService::Get ()->GetDevice (DevicePrefix, m_nDeviceIndex+1, FALSE))
 	{
@@ -166,7 +213,7 @@ int CTerminalDevice::Write (const void *pBuffer, size_t nCount)
 
 	m_SpinLock.Acquire ();
 
-	InvertCursor ();
+	m_bRenderPending = TRUE;	// cursor may be moved
 
 	const char *pChar = (const char *) pBuffer;
 	int nResult = 0;
@@ -178,16 +225,9 @@ int CTerminalDevice::Write (const void *pBuffer, size_t nCount)
 		nResult++;
 	}
 
-	InvertCursor ();
-
-	// Update display
-	if (   !m_bDelayedUpdate
-	    && m_UpdateArea.y1 <= m_UpdateArea.y2)
+	if (!m_bDelayedUpdate)
 	{
-		m_pDisplay->SetArea (m_UpdateArea, m_pBuffer8 + m_UpdateArea.y1 * m_nPitch);
-
-		m_UpdateArea.y1 = m_nHeight;
-		m_UpdateArea.y2 = 0;
+		Flush ();
 	}
 
 	m_SpinLock.Release ();
@@ -203,11 +243,7 @@ void CTerminalDevice::SetPixel (unsigned nPosX, unsigned nPosY, TTerminalColor C
 		return;
 	}
 
-	CDisplay::TRawColor nColor = m_pDisplay->GetColor (Color);
-
-	SetRawPixel (nPosX, nPosY, nColor);
-
-	m_pDisplay->SetPixel (nPosX, nPosY, nColor);
+	SetPixel (nPosX, nPosY, m_pDisplay->GetColor (Color));
 }
 
 void CTerminalDevice::SetPixel (unsigned nPosX, unsigned nPosY, CDisplay::TRawColor nColor)
@@ -218,9 +254,47 @@ void CTerminalDevice::SetPixel (unsigned nPosX, unsigned nPosY, CDisplay::TRawCo
 		return;
 	}
 
-	SetRawPixel (nPosX, nPosY, nColor);
+#ifdef REALTIME
+	// cannot render from IRQ_LEVEL to prevent deadlock, just set the pixel
+	if (CurrentExecutionLevel () <= TASK_LEVEL)
+#endif
+	{
+		m_SpinLock.Acquire ();
+
+		// pending text must not overwrite the pixel later
+		if (m_bRenderPending)
+		{
+			Render ();
 
-	m_pDisplay->SetPixel (nPosX, nPosY, nColor);
+			m_bRenderPending = TRUE;	// cursor and display update
+		}
+
+		// the next write to this cell must not be skipped
+		if (   nPosX < m_nUsedWidth
+		    && nPosY < m_nUsedHeight)
+		{
+			unsigned nColumn = nPosX / m_CharGen.GetCharWidth ();
+			unsigned nBufferRow = GetBufferRow (nPosY / m_CharGen.GetCharHeight ());
+
+			m_pCells[nBufferRow * m_nColumns + nColumn].bOverdrawn = TRUE;
+		}
+
+		m_SpinLock.Release ();
+	}
+
+	unsigned nBufferLine = GetBufferLine (nPosY);
+
+	SetBufferPixel (nPosX, nBufferLine, nColor);
+
+	if (m_bHardwareScroll)
+	{
+		m_pDisplay->SetPixel (nPosX, nBufferLine, nColor);
+		m_pDisplay->SetPixel (nPosX, nBufferLine + m_nHeight, nColor);
+	}
+	else
+	{
+		m_pDisplay->SetPixel (nPosX, nPosY, nColor);
+	}
 }
 
 TTerminalColor CTerminalDevice::GetPixel (unsigned nPosX, unsigned nPosY)
@@ -254,14 +328,11 @@ void CTerminalDevice::Update (unsigned nMillis)
 
 	unsigned nTicks = CTimer::GetClockTicks ();
 
-	if (   m_UpdateArea.y1 <= m_UpdateArea.y2
+	if (   m_bRenderPending
 	    && (   !nMillis
 		|| nTicks - m_nLastUpdateTicks >= nMillis * CLOCKHZ / 1000))
 	{
-		m_pDisplay->SetArea (m_UpdateArea, m_pBuffer8 + m_UpdateArea.y1 * m_nPitch);
-
-		m_UpdateArea.y1 = m_nHeight;
-		m_UpdateArea.y2 = 0;
+		Flush ();
 
 		m_nLastUpdateTicks = nTicks;
 	}
@@ -576,46 +647,18 @@ void CTerminalDevice::ClearDisplayEnd (void)
 {
 	ClearLineEnd ();
 
-	unsigned nPosY = m_nCursorY + m_CharGen.GetCharHeight ();
-	unsigned nOffset = nPosY * m_nWidth;
-
-	switch (m_nDepth)
+	for (unsigned nPosY = m_nCursorY + m_CharGen.GetCharHeight ();
+	     nPosY < m_nUsedHeight; nPosY += m_CharGen.GetCharHeight ())
 	{
-	case 1: {
-			nOffset /= 8;
-			unsigned nSize = m_nSize - nOffset;
-			for (u8 *pBuffer = m_pBuffer8 + nOffset; nSize--;)
-			{
-				*pBuffer++ = m_BackgroundColor ? 0xFF : 0;
-			}
-		} break;
-
-	case 8: {
-			unsigned nSize = m_nSize - nOffset;
-			for (u8 *pBuffer = m_pBuffer8 + nOffset; nSize--;)
-			{
-				*pBuffer++ = (u8) m_BackgroundColor;
-			}
-		} break;
-
-	case 16: {
-			unsigned nSize = m_nSize / 2 - nOffset;
-			for (u16 *pBuffer = m_pBuffer16 + nOffset; nSize--;)
-			{
-				*pBuffer++ = (u16) m_BackgroundColor;
-			}
-		} break;
-
-	case 32: {
-			unsigned nSize = m_nSize / 4 - nOffset;
-			for (u32 *pBuffer = m_pBuffer32 + nOffset; nSize--;)
-			{
-				*pBuffer++ = (u32) m_BackgroundColor;
-			}
-		} break;
+		for (unsigned nPosX = 0; nPosX < m_nUsedWidth; nPosX += m_CharGen.GetCharWidth ())
+		{
+			EraseChar (nPosX, nPosY);
+		}
 	}
 
-	SetUpdateArea (m_nCursorY, m_nHeight-1);
+	m_bClearRemainder = TRUE;
+	m_RemainderColor = m_BackgroundColor;
+	m_bRenderPending = TRUE;
 }
 
 void CTerminalDevice::ClearLineEnd (void)
@@ -625,14 +668,7 @@ void CTerminalDevice::ClearLineEnd (void)
 		EraseChar (nPosX, m_nCursorY);
 	}
 
-	for (unsigned nPosX = m_nUsedWidth; nPosX < m_nWidth; nPosX++)
-	{
-		for (unsigned nPosY = m_nCursorY;
-		     nPosY < m_nCursorY + m_CharGen.GetCharHeight (); nPosY++)
-		{
-			SetRawPixel (nPosX, nPosY, m_BackgroundColor);
-		}
-	}
+	ClearMargin (m_nCursorY / m_CharGen.GetCharHeight ());
 }
 
 void CTerminalDevice::CursorDown (void)
@@ -720,7 +756,7 @@ void CTerminalDevice::DisplayChar (char chChar)
 
 	if (' ' <= (unsigned char) chChar)
 	{
-		DisplayChar (chChar, m_nCursorX, m_nCursorY, GetTextColor ());
+		SetCell (m_nCursorX, m_nCursorY, chChar, GetTextColor (), GetTextBackgroundColor ());
 
 		CursorRight ();
 	}
@@ -947,116 +983,424 @@ void CTerminalDevice::Tabulator (void)
 
 void CTerminalDevice::Scroll (void)
 {
-	unsigned nLines = m_CharGen.GetCharHeight ();
+	if (   m_nScrollStart == 0
+	    && m_nScrollEnd == m_nUsedHeight)
+	{
+		// Whole screen: Rotate the cell ring now and the pixel ring on next Render().
+		if (++m_nFirstRow == m_nRows)
+		{
+			m_nFirstRow = 0;
+		}
 
-	u8 *pTo = m_pBuffer8 + m_nScrollStart * m_nPitch;
-	u8 *pFrom = m_pBuffer8 + (m_nScrollStart + nLines) * m_nPitch;
+		m_nPendingScroll++;
 
-	unsigned nSize = m_nPitch * (m_nScrollEnd - m_nScrollStart - nLines);
-	if (nSize)
-	{
-		memcpy (pTo, pFrom, nSize);
+		EraseRow (m_nRows-1);
 
-		pTo += nSize;
+		return;
 	}
 
-	nSize = m_nWidth * nLines;
-	switch (m_nDepth)
-	{
-	case 1: {
-			nSize /= 8;
-			for (u8 *p = (u8 *) pTo; nSize--;)
-			{
-				*p++ = m_BackgroundColor ? 0xFF : 0;
-			}
-		}
-		break;
+	// Scroll region: Render pending changes first, then move pixels and cells.
+	Render ();
 
-	case 8: {
-			for (u8 *p = (u8 *) pTo; nSize--;)
-			{
-				*p++ = (u8) m_BackgroundColor;
-			}
-		} break;
+	unsigned nCharHeight = m_CharGen.GetCharHeight ();
 
-	case 16: {
-			for (u16 *p = (u16 *) pTo; nSize--;)
-			{
-				*p++ = (u16) m_BackgroundColor;
-			}
-		} break;
+	for (unsigned nPosY = m_nScrollStart; nPosY < m_nScrollEnd - nCharHeight; nPosY++)
+	{
+		memcpy (m_pBuffer8 + GetBufferLine (nPosY) * m_nPitch,
+			m_pBuffer8 + GetBufferLine (nPosY + nCharHeight) * m_nPitch, m_nPitch);
+	}
 
-	case 32: {
-			for (u32 *p = (u32 *) pTo; nSize--;)
-			{
-				*p++ = (u32) m_BackgroundColor;
-			}
-		} break;
+	for (unsigned nPosY = m_nScrollStart; nPosY < m_nScrollEnd; nPosY++)
+	{
+		m_pLineDirty[GetBufferLine (nPosY)] = TRUE;
 	}
 
-	SetUpdateArea (0, m_nHeight-1);
+	unsigned nLastRow = m_nScrollEnd / nCharHeight - 1;
+	for (unsigned nRow = m_nScrollStart / nCharHeight; nRow < nLastRow; nRow++)
+	{
+		memcpy (&m_pCells[GetBufferRow (nRow) * m_nColumns],
+			&m_pCells[GetBufferRow (nRow + 1) * m_nColumns],
+			m_nColumns * sizeof (TCell));
+	}
+
+	EraseRow (nLastRow);
 }
 
-void CTerminalDevice::DisplayChar (char chChar, unsigned nPosX, unsigned nPosY,
-				   CDisplay::TRawColor nColor)
+void CTerminalDevice::SetCell (unsigned nPosX, unsigned nPosY, char chChar,
+			       CDisplay::TRawColor nColor, CDisplay::TRawColor nBackgroundColor)
 {
-	for (unsigned y = 0; y < m_CharGen.GetCharHeight (); y++)
+	unsigned nColumn = nPosX / m_CharGen.GetCharWidth ();
+	unsigned nBufferRow = GetBufferRow (nPosY / m_CharGen.GetCharHeight ());
+	assert (nColumn < m_nColumns);
+
+	TCell *pCell = &m_pCells[nBufferRow * m_nColumns + nColumn];
+
+	// unchanged cells are not rendered again
+	if (   pCell->chChar == chChar
+	    && pCell->nBackgroundColor == nBackgroundColor
+	    && (   !chChar
+		|| pCell->nColor == nColor)
+	    && !pCell->bOverdrawn)
 	{
-		CCharGenerator::TPixelLine Line = m_CharGen.GetPixelLine (chChar, y);
+		return;
+	}
 
-		for (unsigned x = 0; x < m_CharGen.GetCharWidth (); x++)
-		{
-			SetRawPixel (nPosX + x, nPosY + y,   m_CharGen.GetPixel (x, Line)
-							   ? nColor : GetTextBackgroundColor ());
-		}
+	pCell->chChar = chChar;
+	pCell->bOverdrawn = FALSE;
+	pCell->nColor = nColor;
+	pCell->nBackgroundColor = nBackgroundColor;
+
+	TRowState *pRowState = &m_pRowState[nBufferRow];
+	if (nColumn < pRowState->nDirtyFirst)
+	{
+		pRowState->nDirtyFirst = nColumn;
+	}
+
+	if (nColumn > pRowState->nDirtyLast)
+	{
+		pRowState->nDirtyLast = nColumn;
 	}
 
-	SetUpdateArea (nPosY, nPosY + m_CharGen.GetCharHeight ()-1);
+	m_bRenderPending = TRUE;
 }
 
 void CTerminalDevice::EraseChar (unsigned nPosX, unsigned nPosY)
 {
-	for (unsigned y = 0; y < m_CharGen.GetCharHeight (); y++)
+	SetCell (nPosX, nPosY, '\0', m_Color, m_BackgroundColor);
+}
+
+void CTerminalDevice::EraseRow (unsigned nRow)
+{
+	unsigned nBufferRow = GetBufferRow (nRow);
+
+	TCell *pCell = &m_pCells[nBufferRow * m_nColumns];
+	for (unsigned nColumn = 0; nColumn < m_nColumns; nColumn++, pCell++)
 	{
-		for (unsigned x = 0; x < m_CharGen.GetCharWidth (); x++)
-		{
-			SetRawPixel (nPosX + x, nPosY + y, m_BackgroundColor);
-		}
+		pCell->chChar = '\0';
+		pCell->bOverdrawn = FALSE;
+		pCell->nColor = m_Color;
+		pCell->nBackgroundColor = m_BackgroundColor;
 	}
 
-	SetUpdateArea (nPosY, nPosY + m_CharGen.GetCharHeight ()-1);
+	// the pixels of this row are undefined, so render it completely
+	m_pRowState[nBufferRow].nDirtyFirst = 0;
+	m_pRowState[nBufferRow].nDirtyLast = m_nColumns-1;
+
+	ClearMargin (nRow);
+}
+
+void CTerminalDevice::ClearMargin (unsigned nRow)
+{
+	TRowState *pRowState = &m_pRowState[GetBufferRow (nRow)];
+	pRowState->bClearMargin = TRUE;
+	pRowState->nMarginColor = m_BackgroundColor;
+
+	m_bRenderPending = TRUE;
 }
 
 void CTerminalDevice::InvertCursor (void)
 {
-	if (!m_bCursorOn)
+	if (!m_bCursorVisible)
 	{
-		return;
+		if (!m_bCursorOn)
+		{
+			return;
+		}
+
+		m_nCursorPixelX = m_nCursorX;
+		m_nCursorPixelY = m_nCursorY;
 	}
 
 	CDisplay::TRawColor *pPixelData = m_pCursorPixels;
 	unsigned y0 = m_bCursorBlock ? 0 : m_CharGen.GetUnderline ();
 	for (unsigned y = y0; y < m_CharGen.GetCharHeight (); y++)
 	{
+		unsigned nBufferLine = GetBufferLine (m_nCursorPixelY + y);
+
 		for (unsigned x = 0; x < m_CharGen.GetCharWidth (); x++)
 		{
 			if (!m_bCursorVisible)
 			{
 				// Store the old pixel
-				*pPixelData++ = GetRawPixel (m_nCursorX + x, m_nCursorY + y);
+				*pPixelData++ = GetBufferPixel (m_nCursorPixelX + x, nBufferLine);
 
 				// Plot the cursor with the current FG Colour
-				SetRawPixel (m_nCursorX + x, m_nCursorY + y, m_Color);
+				SetBufferPixel (m_nCursorPixelX + x, nBufferLine, m_Color);
 			}
 			else
 			{
 				// Restore the backingstore for the cursor colour
-				SetRawPixel (m_nCursorX + x, m_nCursorY + y, *pPixelData++);
+				SetBufferPixel (m_nCursorPixelX + x, nBufferLine, *pPixelData++);
 			}
 		}
+
+		m_pLineDirty[nBufferLine] = TRUE;
 	}
 
 	m_bCursorVisible = !m_bCursorVisible;
+}
+
+void CTerminalDevice::Flush (void)
+{
+	Render ();
+
+	if (!m_bCursorVisible)
+	{
+		InvertCursor ();
+	}
+
+	UpdateDisplay ();
+}
+
+void CTerminalDevice::Render (void)
+{
+	if (!m_bRenderPending)
+	{
+		return;
+	}
+
+	// the cursor has to be removed, before its pixels are moved or overwritten
+	if (m_bCursorVisible)
+	{
+		InvertCursor ();
+	}
+
+	if (m_nPendingScroll)
+	{
+		// All rows, which came in, are dirty. The other rows move with the pixel ring.
+		unsigned nPendingScroll = m_nPendingScroll < m_nRows ? m_nPendingScroll : m_nRows;
+		unsigned nPixelOffset = m_nPixelOffset + nPendingScroll * m_CharGen.GetCharHeight ();
+		nPixelOffset %= m_nHeight;
+
+		// the lines below the last row do not scroll
+		for (unsigned nPosY = m_nUsedHeight; nPosY < m_nHeight; nPosY++)
+		{
+			unsigned nFromLine = GetBufferLine (nPosY);
+			unsigned nToLine = (nPixelOffset + nPosY) % m_nHeight;
+
+			memcpy (m_pBuffer8 + nToLine * m_nPitch, m_pBuffer8 + nFromLine * m_nPitch,
+				m_nPitch);
+
+			m_pLineDirty[nToLine] = TRUE;
+		}
+
+		m_nPixelOffset = nPixelOffset;
+		m_nPendingScroll = 0;
+
+		if (!m_bHardwareScroll)
+		{
+			memset (m_pLineDirty, TRUE, m_nHeight);
+		}
+	}
+
+	for (unsigned nRow = 0; nRow < m_nRows; nRow++)
+	{
+		RenderRow (nRow);
+	}
+
+	if (m_bClearRemainder)
+	{
+		for (unsigned nPosY = m_nUsedHeight; nPosY < m_nHeight; nPosY++)
+		{
+			unsigned nBufferLine = GetBufferLine (nPosY);
+
+			FillLine (nBufferLine, 0, m_nWidth, m_RemainderColor);
+
+			m_pLineDirty[nBufferLine] = TRUE;
+		}
+
+		m_bClearRemainder = FALSE;
+	}
+
+	m_bRenderPending = FALSE;
+}
+
+void CTerminalDevice::RenderRow (unsigned nRow)
+{
+	unsigned nBufferRow = GetBufferRow (nRow);
+	TRowState *pRowState = &m_pRowState[nBufferRow];
+	if (   pRowState->nDirtyFirst > pRowState->nDirtyLast
+	    && !pRowState->bClearMargin)
+	{
+		return;
+	}
+
+	unsigned nCharWidth = m_CharGen.GetCharWidth ();
+	unsigned nCharHeight = m_CharGen.GetCharHeight ();
+	const TCell *pRowCells = &m_pCells[nBufferRow * m_nColumns];
+
+	// line by line, so that the pixel buffer is written sequentially
+	for (unsigned y = 0; y < nCharHeight; y++)
+	{
+		unsigned nBufferLine = GetBufferLine (nRow * nCharHeight + y);
+
+		for (unsigned nColumn = pRowState->nDirtyFirst;
+		     nColumn <= pRowState->nDirtyLast; nColumn++)
+		{
+			const TCell *pCell = &pRowCells[nColumn];
+			unsigned nPosX = nColumn * nCharWidth;
+
+			CCharGenerator::TPixelLine Line =
+				pCell->chChar ? m_CharGen.GetPixelLine (pCell->chChar, y) : 0;
+			if (!Line)
+			{
+				FillLine (nBufferLine, nPosX, nPosX + nCharWidth,
+					  pCell->nBackgroundColor);
+
+				continue;
+			}
+
+			switch (m_nDepth)
+			{
+			case 8: {
+					u8 *pPixel = m_pBuffer8 + nBufferLine * m_nWidth + nPosX;
+					for (unsigned x = 0; x < nCharWidth; x++)
+					{
+						*pPixel++ = (u8) (  m_CharGen.GetPixel (x, Line)
+								  ? pCell->nColor
+								  : pCell->nBackgroundColor);
+					}
+				} break;
+
+			case 16: {
+					u16 *pPixel = m_pBuffer16 + nBufferLine * m_nWidth + nPosX;
+					for (unsigned x = 0; x < nCharWidth; x++)
+					{
+						*pPixel++ = (u16) (  m_CharGen.GetPixel (x, Line)
+								   ? pCell->nColor
+								   : pCell->nBackgroundColor);
+					}
+				} break;
+
+			case 32: {
+					u32 *pPixel = m_pBuffer32 + nBufferLine * m_nWidth + nPosX;
+					for (unsigned x = 0; x < nCharWidth; x++)
+					{
+						*pPixel++ =   m_CharGen.GetPixel (x, Line)
+							    ? pCell->nColor
+							    : pCell->nBackgroundColor;
+					}
+				} break;
+
+			default:
+				for (unsigned x = 0; x < nCharWidth; x++)
+				{
+					SetBufferPixel (nPosX + x, nBufferLine,
+							  m_CharGen.GetPixel (x, Line)
+							? pCell->nColor : pCell->nBackgroundColor);
+				}
+				break;
+			}
+		}
+
+		if (pRowState->bClearMargin)
+		{
+			FillLine (nBufferLine, m_nUsedWidth, m_nWidth, pRowState->nMarginColor);
+		}
 
-	SetUpdateArea (m_nCursorY + y0, m_nCursorY + m_CharGen.GetCharHeight ()-1);
+		m_pLineDirty[nBufferLine] = TRUE;
+	}
+
+	pRowState->nDirtyFirst = m_nColumns;
+	pRowState->nDirtyLast = 0;
+	pRowState->bClearMargin = FALSE;
+}
+
+void CTerminalDevice::FillLine (unsigned nBufferLine, unsigned nPosX1, unsigned nPosX2,
+				CDisplay::TRawColor nColor)
+{
+	switch (m_nDepth)
+	{
+	case 8:
+		memset (m_pBuffer8 + nBufferLine * m_nWidth + nPosX1, (u8) nColor, nPosX2 - nPosX1);
+		break;
+
+	case 16:
+		for (u16 *pPixel = m_pBuffer16 + nBufferLine * m_nWidth + nPosX1,
+			 *pEnd = pPixel + (nPosX2 - nPosX1); pPixel < pEnd;)
+		{
+			*pPixel++ = (u16) nColor;
+		}
+		break;
+
+	case 32:
+		for (u32 *pPixel = m_pBuffer32 + nBufferLine * m_nWidth + nPosX1,
+			 *pEnd = pPixel + (nPosX2 - nPosX1); pPixel < pEnd;)
+		{
+			*pPixel++ = nColor;
+		}
+		break;
+
+	default:
+		for (unsigned nPosX = nPosX1; nPosX < nPosX2; nPosX++)
+		{
+			SetBufferPixel (nPosX, nBufferLine, nColor);
+		}
+		break;
+	}
+}
+
+void CTerminalDevice::UpdateDisplay (void)
+{
+	// send runs of dirty buffer lines, which are contiguous on the screen too
+	unsigned nLine = 0;
+	while (nLine < m_nHeight)
+	{
+		if (!m_pLineDirty[nLine])
+		{
+			nLine++;
+
+			continue;
+		}
+
+		unsigned nFirstLine = nLine;
+		do
+		{
+			m_pLineDirty[nLine++] = FALSE;
+		}
+		while (   nLine < m_nHeight
+		       && m_pLineDirty[nLine]
+		       && (   m_bHardwareScroll
+			   || nLine != m_nPixelOffset));
+
+		UpdateLines (nFirstLine, nLine - nFirstLine);
+	}
+
+	if (   m_bHardwareScroll
+	    && m_nDisplayOffset != m_nPixelOffset)
+	{
+		m_pDisplay->SetVirtualOffset (0, m_nPixelOffset);
+
+		m_nDisplayOffset = m_nPixelOffset;
+	}
+}
+
+void CTerminalDevice::UpdateLines (unsigned nBufferLine, unsigned nCount)
+{
+	CDisplay::TArea Area;
+	Area.x1 = 0;
+	Area.x2 = m_nWidth-1;
+
+	const u8 *pPixels = m_pBuffer8 + nBufferLine * m_nPitch;
+
+	if (m_bHardwareScroll)
+	{
+		// The pixel buffer is held twice in display memory, so that the visible
+		// window, which starts at m_nPixelOffset, is always contiguous.
+		Area.y1 = nBufferLine;
+		Area.y2 = nBufferLine + nCount-1;
+		m_pDisplay->SetArea (Area, pPixels);
+
+		Area.y1 += m_nHeight;
+		Area.y2 += m_nHeight;
+		m_pDisplay->SetArea (Area, pPixels);
+	}
+	else
+	{
+		Area.y1 =   nBufferLine >= m_nPixelOffset
+			  ? nBufferLine - m_nPixelOffset
+			  : nBufferLine + m_nHeight - m_nPixelOffset;
+		Area.y2 = Area.y1 + nCount-1;
+		m_pDisplay->SetArea (Area, pPixels);
+	}
 }
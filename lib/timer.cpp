@@ -2,7 +2,7 @@
 // timer.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2023  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -23,6 +23,7 @@
 #include <circle/memio.h>
 #include <circle/synchronize.h>
 #include <circle/logger.h>
+#include <circle/tracer.h>
 #include <circle/debug.h>
 #include <assert.h>
 
@@ -60,9 +61,17 @@ CTimer::CTimer (CInterruptSystem *pInterruptSystem)
 	m_nusDelay (m_nMsDelay / 1000),
 	m_pUpdateTimeHandler (0),
 	m_nPeriodicHandlers (0)
+#ifdef LATENCY_HISTOGRAMS
+	, m_nTickDueTimestamp (0),
+	m_IRQLatency ("timer irq"),
+	m_KernelTimerLateness ("kernel timer")
+#endif
 {
 	assert (s_pThis == 0);
 	s_pThis = this;
+
+	m_TimeSpinLock.SetName ("time");
+	m_KernelTimerSpinLock.SetName ("kerneltimers");
 }
 
 CTimer::~CTimer (void)
@@ -362,6 +371,62 @@ CString *CTimer::GetTimeString (void)
 		return 0;
 	}
 
+	return FormatTimeString (nTime, nTicks);
+}
+
+boolean CTimer::GetLocalTime (u64 nClockTicks64, unsigned *pSeconds, unsigned *pMicroSeconds)
+{
+	m_TimeSpinLock.Acquire ();
+
+	unsigned nTime = m_nTime;
+	unsigned nTicks = m_nTicks;
+	u64 nNow = GetClockTicks64 ();
+
+	m_TimeSpinLock.Release ();
+
+	// go back from now in units of 1/HZ seconds
+	u64 nPastTicks = 0;
+	if (nNow > nClockTicks64)
+	{
+		nPastTicks = (nNow - nClockTicks64) / (CLOCKHZ / HZ);
+	}
+
+	u64 nTotalTicks = (u64) nTime * HZ + nTicks % HZ;
+	if (nPastTicks > nTotalTicks)
+	{
+		return FALSE;
+	}
+
+	nTotalTicks -= nPastTicks;
+
+	assert (pSeconds != 0);
+	*pSeconds = (unsigned) (nTotalTicks / HZ);
+
+	assert (pMicroSeconds != 0);
+	*pMicroSeconds = (unsigned) (nTotalTicks % HZ) * (1000000 / HZ);
+
+	return TRUE;
+}
+
+CString *CTimer::GetTimeString (u64 nClockTicks64)
+{
+	if (   m_nTime == 0
+	    && m_nTicks == 0)
+	{
+		return 0;
+	}
+
+	unsigned nSeconds, nMicroSeconds;
+	if (!GetLocalTime (nClockTicks64, &nSeconds, &nMicroSeconds))
+	{
+		return 0;
+	}
+
+	return FormatTimeString (nSeconds, nMicroSeconds / (1000000 / HZ));
+}
+
+CString *CTimer::FormatTimeString (unsigned nTime, unsigned nTicks)
+{
 	unsigned nSecond = nTime % 60;
 	nTime /= 60;
 	unsigned nMinute = nTime % 60;
@@ -513,6 +578,13 @@ void CTimer::PollKernelTimers (void)
 
 		m_KernelTimerSpinLock.Release ();
 
+#ifdef LATENCY_HISTOGRAMS
+		u64 nDueTimestamp =   m_nTickDueTimestamp
+				    -   (u64) (m_nTicks - pTimer->m_nElapsesAt)
+				      * CTracer::GetTimestampFrequency () / HZ;
+		m_KernelTimerLateness.RecordTimestampTicks (CTracer::GetTimestamp () - nDueTimestamp);
+#endif
+
 		TKernelTimerHandler *pHandler = pTimer->m_pHandler;
 		assert (pHandler != 0);
 		(*pHandler) ((TKernelTimerHandle) pTimer, pTimer->m_pParam, pTimer->m_pContext);
@@ -534,6 +606,9 @@ void CTimer::InterruptHandler (void)
 	PeripheralEntry ();
 
 	u32 nCompare = read32 (ARM_SYSTIMER_C3);
+#ifdef LATENCY_HISTOGRAMS
+	u32 nLateTicks = read32 (ARM_SYSTIMER_CLO) - nCompare;
+#endif
 	do
 	{
 		nCompare += CLOCKHZ / HZ;
@@ -545,6 +620,11 @@ void CTimer::InterruptHandler (void)
 	write32 (ARM_SYSTIMER_CS, 1 << 3);
 
 	PeripheralExit ();
+
+#ifdef LATENCY_HISTOGRAMS
+	m_nTickDueTimestamp =   CTracer::GetTimestamp ()
+			      - (u64) nLateTicks * CTracer::GetTimestampFrequency () / CLOCKHZ;
+#endif
 #else
 #if AARCH == 32
 	u32 nCNTP_CVALLow, nCNTP_CVALHigh;
@@ -553,12 +633,24 @@ void CTimer::InterruptHandler (void)
 	u64 nCNTP_CVAL = ((u64) nCNTP_CVALHigh << 32 | nCNTP_CVALLow) + CLOCKHZ / HZ;
 	asm volatile ("mcrr p15, 2, %0, %1, c14" :: "r" (nCNTP_CVAL & 0xFFFFFFFFU),
 						    "r" (nCNTP_CVAL >> 32));
+
+#ifdef LATENCY_HISTOGRAMS
+	m_nTickDueTimestamp = nCNTP_CVAL - CLOCKHZ / HZ;
+#endif
 #else
 	u64 nCNTP_CVAL;
 	asm volatile ("mrs %0, CNTP_CVAL_EL0" : "=r" (nCNTP_CVAL));
 	asm volatile ("msr CNTP_CVAL_EL0, %0" :: "r" (nCNTP_CVAL + m_nClockTicksPerHZTick));
+
+#ifdef LATENCY_HISTOGRAMS
+	m_nTickDueTimestamp = nCNTP_CVAL;
 #endif
 #endif
+#endif
+
+#ifdef LATENCY_HISTOGRAMS
+	m_IRQLatency.RecordTimestampTicks (CTracer::GetTimestamp () - m_nTickDueTimestamp);
+#endif
 
 #ifndef NDEBUG
 	//debug_click ();
@@ -2,8 +2,8 @@
 // tracer.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014  R. Stange <rsta2@o2online.de>
-// 
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
+//
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
 // the Free Software Foundation, either version 3 of the License, or
@@ -20,34 +20,78 @@
 #include <circle/tracer.h>
 #include <circle/timer.h>
 #include <circle/logger.h>
+#include <circle/string.h>
+#include <circle/synchronize.h>
+#include <circle/multicore.h>
+#include <circle/sysconfig.h>
+#include <assert.h>
+
+#ifdef ARM_ALLOW_MULTI_CORE
+	#define TRACER_RINGS	CORES
+#else
+	#define TRACER_RINGS	1
+#endif
 
 static const char FromTracer[] = "trace";
 
+static const char TypeChar[TraceEventUnknown] = {'I', 'B', 'E', 'C'};
+
 CTracer *CTracer::s_pThis = 0;
 
 CTracer::CTracer (unsigned nDepth, boolean bStopIfFull)
 : 	m_nDepth (nDepth),
 	m_bStopIfFull (bStopIfFull),
 	m_bActive (FALSE),
-	m_nStartTicks (0),
-	m_nEntries (0),
-	m_nCurrent (0)
+	m_nStartTimestamp (0),
+	m_nEventNames (0)
 {
+	assert (m_nDepth > 0);
+
 	s_pThis = this;
 
-	m_pEntry = new TTraceEntry[nDepth];
+	m_pRing = new TRing[TRACER_RINGS];
+	assert (m_pRing != 0);
+
+	for (unsigned i = 0; i < TRACER_RINGS; i++)
+	{
+		m_pRing[i].pEntry = new TTraceEntry[nDepth];
+		assert (m_pRing[i].pEntry != 0);
+
+		m_pRing[i].nEntries = 0;
+		m_pRing[i].nCurrent = 0;
+		m_pRing[i].nDropped = 0;
+		m_pRing[i].nRead = 0;
+	}
+
+	SetEventName (TRACER_EVENT_STOP, "stop");
+	SetEventName (TRACER_EVENT_TASK, "task");
+	SetEventName (TRACER_EVENT_IRQ, "irq");
+	SetEventName (TRACER_EVENT_NET_TX, "net tx");
+	SetEventName (TRACER_EVENT_NET_RX, "net rx");
+	SetEventName (TRACER_EVENT_USB_REQUEST, "usb request");
 }
 
 CTracer::~CTracer (void)
 {
-	delete [] m_pEntry;
-
 	s_pThis = 0;
+
+	m_bActive = FALSE;
+
+	for (unsigned i = 0; i < TRACER_RINGS; i++)
+	{
+		delete [] m_pRing[i].pEntry;
+	}
+
+	delete [] m_pRing;
+	m_pRing = 0;
 }
 
 void CTracer::Start (void)
 {
-	m_nStartTicks = CTimer::Get ()->GetClockTicks ();
+	if (m_nStartTimestamp == 0)
+	{
+		m_nStartTimestamp = GetTimestamp ();
+	}
 
 	m_bActive = TRUE;
 }
@@ -57,37 +101,54 @@ void CTracer::Stop (void)
 	Event (TRACER_EVENT_STOP);
 
 	m_bActive = FALSE;
+
+	DataSyncBarrier ();
 }
 
 void CTracer::Event (unsigned nID, unsigned nParam1, unsigned nParam2, unsigned nParam3, unsigned nParam4)
 {
-	if (m_bActive)
-	{
-		if (m_nEntries < m_nDepth)
-		{
-			m_nEntries++;
-		}
-		else if (m_bStopIfFull)
-		{
-			m_bActive = FALSE;
+	Record (TraceEventInstant, nID, nParam1, nParam2, nParam3, nParam4);
+}
 
-			return;
-		}
+void CTracer::Begin (unsigned nID, unsigned nParam1, unsigned nParam2)
+{
+	Record (TraceEventBegin, nID, nParam1, nParam2, 0, 0);
+}
 
-		TTraceEntry *pEntry = m_pEntry + m_nCurrent;
+void CTracer::End (unsigned nID)
+{
+	Record (TraceEventEnd, nID, 0, 0, 0, 0);
+}
+
+void CTracer::Counter (unsigned nID, unsigned nValue)
+{
+	Record (TraceEventCounter, nID, nValue, 0, 0, 0);
+}
 
-		pEntry->nClockTicks = CTimer::Get ()->GetClockTicks () - m_nStartTicks;
-		pEntry->nEventID    = nID;
-		pEntry->nParam[0]   = nParam1;
-		pEntry->nParam[1]   = nParam2;
-		pEntry->nParam[2]   = nParam3;
-		pEntry->nParam[3]   = nParam4;
+boolean CTracer::SetEventName (unsigned nID, const char *pName)
+{
+	assert (pName != 0);
 
-		if (++m_nCurrent == m_nDepth)
+	for (unsigned i = 0; i < m_nEventNames; i++)
+	{
+		if (m_EventName[i].nID == nID)
 		{
-			m_nCurrent = 0;
+			m_EventName[i].pName = pName;
+
+			return TRUE;
 		}
 	}
+
+	if (m_nEventNames >= TRACER_MAX_EVENT_NAMES)
+	{
+		return FALSE;
+	}
+
+	m_EventName[m_nEventNames].nID = nID;
+	m_EventName[m_nEventNames].pName = pName;
+	m_nEventNames++;
+
+	return TRUE;
 }
 
 void CTracer::Dump (void)
@@ -96,28 +157,284 @@ void CTracer::Dump (void)
 	{
 		Stop ();
 	}
-	
+
 	CLogger *pLogger = CLogger::Get ();
 
-	unsigned nEvent = 0;
-	if (m_nEntries == m_nDepth)
+	u64 nFrequency = GetTimestampFrequency ();
+
+	Rewind ();
+
+	unsigned nCore;
+	const TTraceEntry *pEntry;
+	for (unsigned i = 1; (pEntry = GetNextEntry (&nCore)) != 0; i++)
+	{
+		u64 nTime = pEntry->nTimestamp - m_nStartTimestamp;
+		unsigned nSeconds = (unsigned) (nTime / nFrequency);
+		unsigned nMicroSeconds = (unsigned) (nTime % nFrequency * 1000000 / nFrequency);
+
+		CString NameBuffer;
+		pLogger->Write (FromTracer, LogNotice, "%4u: %3u.%06u %u %c %-12s %08X %08X %08X %08X",
+				i, nSeconds, nMicroSeconds, nCore, TypeChar[pEntry->nType],
+				GetEventName (pEntry->nEventID, &NameBuffer),
+				pEntry->nParam[0], pEntry->nParam[1], pEntry->nParam[2], pEntry->nParam[3]);
+	}
+
+	unsigned nDropped = GetDroppedEvents ();
+	if (nDropped > 0)
 	{
-		nEvent = m_nCurrent;
+		pLogger->Write (FromTracer, LogNotice, "%u event(s) dropped", nDropped);
+	}
+}
+
+boolean CTracer::ExportChromeTrace (TTraceWriteHandler *pHandler, void *pParam)
+{
+	assert (pHandler != 0);
+
+	if (m_bActive)
+	{
+		Stop ();
 	}
-	
-	for (unsigned i = 1; i <= m_nEntries; i++)
-	{	
-		TTraceEntry *pEntry = m_pEntry + nEvent;
 
-		pLogger->Write (FromTracer, LogNotice, "%2u: %2u.%06u %2u %08X %08X %08X %08X",
-				i, pEntry->nClockTicks / CLOCKHZ, pEntry->nClockTicks % CLOCKHZ,
-				pEntry->nEventID, pEntry->nParam[0], pEntry->nParam[1], pEntry->nParam[2], pEntry->nParam[3]);
+	CString Chunk;
+	Chunk = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+		"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Circle\"}}";
 
-		nEvent = (nEvent+1) % m_nDepth;
+	for (unsigned i = 0; i < TRACER_RINGS; i++)
+	{
+		CString Thread;
+		Thread.Format (",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+			       "\"args\":{\"name\":\"core %u\"}}", i, i);
+		Chunk.Append (Thread);
 	}
+
+	if (!(*pHandler) ((const char *) Chunk, Chunk.GetLength (), pParam))
+	{
+		return FALSE;
+	}
+
+	u64 nFrequency = GetTimestampFrequency ();
+
+	Rewind ();
+
+	unsigned nCore;
+	const TTraceEntry *pEntry;
+	while ((pEntry = GetNextEntry (&nCore)) != 0)
+	{
+		// timestamp in microseconds with nanoseconds fraction
+		u64 nTime = pEntry->nTimestamp - m_nStartTimestamp;
+		unsigned nSeconds = (unsigned) (nTime / nFrequency);
+		unsigned nNanoSeconds = (unsigned) (nTime % nFrequency * 1000000000 / nFrequency);
+
+		CString Timestamp;
+		if (nSeconds == 0)
+		{
+			Timestamp.Format ("%u.%03u", nNanoSeconds / 1000, nNanoSeconds % 1000);
+		}
+		else
+		{
+			Timestamp.Format ("%u%06u.%03u", nSeconds, nNanoSeconds / 1000,
+					  nNanoSeconds % 1000);
+		}
+
+		CString NameBuffer;
+		const char *pName = GetEventName (pEntry->nEventID, &NameBuffer);
+
+		switch (pEntry->nType)
+		{
+		case TraceEventInstant:
+			Chunk.Format (",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%s,"
+				      "\"pid\":1,\"tid\":%u,\"args\":{\"p1\":%u,\"p2\":%u,\"p3\":%u,\"p4\":%u}}",
+				      pName, (const char *) Timestamp, nCore,
+				      pEntry->nParam[0], pEntry->nParam[1], pEntry->nParam[2], pEntry->nParam[3]);
+			break;
+
+		case TraceEventBegin:
+			Chunk.Format (",\n{\"name\":\"%s\",\"ph\":\"B\",\"ts\":%s,"
+				      "\"pid\":1,\"tid\":%u,\"args\":{\"p1\":%u,\"p2\":%u}}",
+				      pName, (const char *) Timestamp, nCore,
+				      pEntry->nParam[0], pEntry->nParam[1]);
+			break;
+
+		case TraceEventEnd:
+			Chunk.Format (",\n{\"name\":\"%s\",\"ph\":\"E\",\"ts\":%s,\"pid\":1,\"tid\":%u}",
+				      pName, (const char *) Timestamp, nCore);
+			break;
+
+		case TraceEventCounter:
+			Chunk.Format (",\n{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%s,"
+				      "\"pid\":1,\"tid\":%u,\"args\":{\"value\":%u}}",
+				      pName, (const char *) Timestamp, nCore, pEntry->nParam[0]);
+			break;
+
+		default:
+			assert (0);
+			break;
+		}
+
+		if (!(*pHandler) ((const char *) Chunk, Chunk.GetLength (), pParam))
+		{
+			return FALSE;
+		}
+	}
+
+	Chunk = "\n]}\n";
+
+	return (*pHandler) ((const char *) Chunk, Chunk.GetLength (), pParam);
+}
+
+unsigned CTracer::GetDroppedEvents (void) const
+{
+	unsigned nResult = 0;
+	for (unsigned i = 0; i < TRACER_RINGS; i++)
+	{
+		nResult += m_pRing[i].nDropped;
+	}
+
+	return nResult;
+}
+
+u64 CTracer::GetTimestamp (void)
+{
+#if AARCH == 64
+	u64 nCNTPCT;
+	asm volatile ("mrs %0, CNTPCT_EL0" : "=r" (nCNTPCT));
+
+	return nCNTPCT;
+#else
+	// The generic timer is prescaled to 1 MHz on AArch32 too, and the cycle counter
+	// (PMCCNTR) is per core, has 32 bits only and depends on the CPU clock.
+	return CTimer::GetClockTicks64 ();
+#endif
+}
+
+u64 CTracer::GetTimestampFrequency (void)
+{
+#if AARCH == 64
+	u64 nCNTFRQ;
+	asm volatile ("mrs %0, CNTFRQ_EL0" : "=r" (nCNTFRQ));
+
+	return nCNTFRQ;
+#else
+	return CLOCKHZ;
+#endif
 }
 
 CTracer *CTracer::Get (void)
 {
 	return s_pThis;
 }
+
+void CTracer::Record (unsigned nType, unsigned nID, unsigned nParam1, unsigned nParam2,
+		      unsigned nParam3, unsigned nParam4)
+{
+	if (!m_bActive)
+	{
+		return;
+	}
+
+	u64 nTimestamp = GetTimestamp ();
+
+	// the ring of this core may be written from task, IRQ and FIQ context
+	EnterCritical (FIQ_LEVEL);
+
+#ifdef ARM_ALLOW_MULTI_CORE
+	TRing *pRing = &m_pRing[CMultiCoreSupport::ThisCore ()];
+#else
+	TRing *pRing = m_pRing;
+#endif
+
+	if (pRing->nEntries < m_nDepth)
+	{
+		pRing->nEntries++;
+	}
+	else
+	{
+		pRing->nDropped++;
+
+		if (m_bStopIfFull)
+		{
+			m_bActive = FALSE;
+
+			LeaveCritical ();
+
+			return;
+		}
+	}
+
+	TTraceEntry *pEntry = pRing->pEntry + pRing->nCurrent;
+
+	pEntry->nTimestamp = nTimestamp;
+	pEntry->nEventID   = nID;
+	pEntry->nType      = nType;
+	pEntry->nParam[0]  = nParam1;
+	pEntry->nParam[1]  = nParam2;
+	pEntry->nParam[2]  = nParam3;
+	pEntry->nParam[3]  = nParam4;
+
+	if (++pRing->nCurrent == m_nDepth)
+	{
+		pRing->nCurrent = 0;
+	}
+
+	LeaveCritical ();
+}
+
+const TTraceEntry *CTracer::GetNextEntry (unsigned *pCore)
+{
+	const TTraceEntry *pResult = 0;
+
+	for (unsigned i = 0; i < TRACER_RINGS; i++)
+	{
+		TRing *pRing = &m_pRing[i];
+		if (pRing->nRead == pRing->nEntries)
+		{
+			continue;
+		}
+
+		// oldest entry is at the write index, if the ring is full
+		unsigned nIndex = pRing->nRead;
+		if (pRing->nEntries == m_nDepth)
+		{
+			nIndex = (pRing->nCurrent + nIndex) % m_nDepth;
+		}
+
+		const TTraceEntry *pEntry = pRing->pEntry + nIndex;
+		if (   pResult == 0
+		    || pEntry->nTimestamp < pResult->nTimestamp)
+		{
+			pResult = pEntry;
+			*pCore = i;
+		}
+	}
+
+	if (pResult != 0)
+	{
+		m_pRing[*pCore].nRead++;
+	}
+
+	return pResult;
+}
+
+void CTracer::Rewind (void)
+{
+	for (unsigned i = 0; i < TRACER_RINGS; i++)
+	{
+		m_pRing[i].nRead = 0;
+	}
+}
+
+const char *CTracer::GetEventName (unsigned nID, CString *pBuffer) const
+{
+	for (unsigned i = 0; i < m_nEventNames; i++)
+	{
+		if (m_EventName[i].nID == nID)
+		{
+			return m_EventName[i].pName;
+		}
+	}
+
+	assert (pBuffer != 0);
+	pBuffer->Format ("event %u", nID);
+
+	return *pBuffer;
+}
@@ -20,6 +20,7 @@
 #include <circle/translationtable64.h>
 #include <circle/synchronize.h>
 #include <circle/sysconfig.h>
+#include <circle/memorymap.h>
 #include <circle/alloc.h>
 #include <circle/util.h>
 #include <assert.h>
@@ -45,7 +46,8 @@
 
 CTranslationTable::CTranslationTable (size_t nMemSize)
 :	m_nMemSize (nMemSize),
-	m_pTable (0)
+	m_pTable (0),
+	m_pPagedTable (0)
 {
 	m_pTable = (TARMV8MMU_LEVEL2_DESCRIPTOR *) palloc ();
 	assert (m_pTable != 0);
@@ -95,6 +97,12 @@ CTranslationTable::CTranslationTable (size_t nMemSize)
 
 CTranslationTable::~CTranslationTable (void)
 {
+	if (m_pPagedTable != 0)
+	{
+		pfree (m_pPagedTable);
+		m_pPagedTable = 0;
+	}
+
 	pfree (m_pTable);
 	m_pTable = 0;
 }
@@ -105,6 +113,146 @@ uintptr CTranslationTable::GetBaseAddress (void) const
 	return (uintptr) m_pTable;
 }
 
+boolean CTranslationTable::EnablePagedRegion (void)
+{
+	if (m_pPagedTable != 0)
+	{
+		return TRUE;
+	}
+
+	// the demand paged region has an own level 3 table with invalid entries initially
+	TARMV8MMU_LEVEL3_DESCRIPTOR *pPagedTable = (TARMV8MMU_LEVEL3_DESCRIPTOR *) palloc ();
+	if (pPagedTable == 0)
+	{
+		return FALSE;
+	}
+
+	memset (pPagedTable, 0, PAGE_SIZE);
+
+	assert (MEM_PAGED_START % ARMV8MMU_LEVEL2_BLOCK_SIZE == 0);
+	assert (MEM_PAGED_SIZE == ARMV8MMU_LEVEL2_BLOCK_SIZE);
+	unsigned nEntry = MEM_PAGED_START / ARMV8MMU_LEVEL2_BLOCK_SIZE;
+	assert (nEntry < ARMV8MMU_TABLE_ENTRIES);
+	assert (m_pTable[nEntry].Table.Value11 == 0);
+
+	union
+	{
+		TARMV8MMU_LEVEL2_TABLE_DESCRIPTOR Table;
+		u64 Value;
+	}
+	Desc;
+
+	Desc.Value = 0;
+	Desc.Table.Value11	= 3;
+	Desc.Table.TableAddress	= ARMV8MMUL2TABLEADDR ((u64) pPagedTable);
+	Desc.Table.APTable	= AP_TABLE_ALL_ACCESS;
+
+	// the table must be visible to the table walk, before the descriptor becomes valid
+	DataSyncBarrier ();
+
+	// the entry was invalid before, so that no TLB maintenance is required
+	*(volatile u64 *) &m_pTable[nEntry] = Desc.Value;
+	m_pPagedTable = pPagedTable;
+
+	DataSyncBarrier ();
+	InstructionSyncBarrier ();
+
+	return TRUE;
+}
+
+void CTranslationTable::SetPage (uintptr nVirtualAddress, uintptr nPhysicalAddress)
+{
+	assert (nPhysicalAddress % ARMV8MMU_LEVEL3_PAGE_SIZE == 0);
+
+	union
+	{
+		TARMV8MMU_LEVEL3_PAGE_DESCRIPTOR Page;
+		u64 Value;
+	}
+	Desc;
+
+	Desc.Value = 0;
+	Desc.Page.Value11	= 3;
+	Desc.Page.AttrIndx	= ATTRINDX_NORMAL;
+	Desc.Page.AP		= ATTRIB_AP_RO_EL1;
+	Desc.Page.SH		= ATTRIB_SH_INNER_SHAREABLE;
+	Desc.Page.AF		= 1;
+	Desc.Page.OutputAddress	= ARMV8MMUL3PAGEADDR (nPhysicalAddress);
+	Desc.Page.PXN		= 1;
+	Desc.Page.UXN		= 1;
+
+	volatile u64 *pEntry = GetPagedEntry (nVirtualAddress);
+	if (*pEntry != 0)
+	{
+		*pEntry = 0;			// break before make
+
+		InvalidateTLB (nVirtualAddress);
+	}
+
+	*pEntry = Desc.Value;
+
+	DataSyncBarrier ();
+	InstructionSyncBarrier ();
+}
+
+void CTranslationTable::ClearPage (uintptr nVirtualAddress)
+{
+	*GetPagedEntry (nVirtualAddress) = 0;
+
+	InvalidateTLB (nVirtualAddress);
+}
+
+boolean CTranslationTable::ClearAccessFlag (uintptr nVirtualAddress)
+{
+	volatile u64 *pEntry = GetPagedEntry (nVirtualAddress);
+
+	u64 nValue = *pEntry;
+	if (!(nValue & ARMV8MMU_LEVEL3_AF))
+	{
+		return FALSE;
+	}
+
+	*pEntry = nValue & ~ARMV8MMU_LEVEL3_AF;
+
+	InvalidateTLB (nVirtualAddress);
+
+	return TRUE;
+}
+
+void CTranslationTable::SetAccessFlag (uintptr nVirtualAddress)
+{
+	volatile u64 *pEntry = GetPagedEntry (nVirtualAddress);
+	assert (*pEntry != 0);
+
+	*pEntry |= ARMV8MMU_LEVEL3_AF;		// no TLB maintenance required
+
+	DataSyncBarrier ();
+	InstructionSyncBarrier ();
+}
+
+volatile u64 *CTranslationTable::GetPagedEntry (uintptr nVirtualAddress)
+{
+	assert (m_pPagedTable != 0);
+	assert (MEM_PAGED_START <= nVirtualAddress);
+	assert (nVirtualAddress < MEM_PAGED_START + MEM_PAGED_SIZE);
+
+	unsigned nPage = (nVirtualAddress - MEM_PAGED_START) / ARMV8MMU_LEVEL3_PAGE_SIZE;
+
+	return (volatile u64 *) &m_pPagedTable[nPage];
+}
+
+void CTranslationTable::InvalidateTLB (uintptr nVirtualAddress)
+{
+	DataSyncBarrier ();
+
+	// operand is VA[55:12], all ASIDs, on all cores in the inner shareable domain
+	u64 nOperand = (nVirtualAddress & ~(u64) (ARMV8MMU_LEVEL3_PAGE_SIZE-1)) >> 12;
+	asm volatile ("tlbi vaae1is, %0" : : "r" (nOperand) : "memory");
+
+	DataSyncBarrier ();
+	InstructionSyncBarrier ();
+}
+
 TARMV8MMU_LEVEL3_DESCRIPTOR *CTranslationTable::CreateLevel3Table (uintptr nBaseAddress)
 {
 	TARMV8MMU_LEVEL3_DESCRIPTOR *pTable = (TARMV8MMU_LEVEL3_DESCRIPTOR *) palloc ();
@@ -28,6 +28,7 @@
 #include <circle/synchronize.h>
 #include <circle/logger.h>
 #include <circle/koptions.h>
+#include <circle/util.h>
 #include <circle/sysconfig.h>
 #include <circle/atomic.h>
 #include <circle/debug.h>
@@ -86,10 +87,16 @@ CDWHCIDevice::CDWHCIDevice (CInterruptSystem *pInterruptSystem, CTimer *pTimer,
 	m_MPHI (pInterruptSystem),
 #endif
 	m_bShutdown (FALSE)
+#ifdef USE_USB_SOF_INTR
+	, m_usLastSOFFrame (0),
+	m_nLastSOFTicks (0)
+#endif
 {
 	assert (m_pInterruptSystem != 0);
 	assert (m_pTimer != 0);
 
+	ResetStats ();
+
 	for (unsigned nChannel = 0; nChannel < DWHCI_MAX_CHANNELS; nChannel++)
 	{
 		m_pStageData[nChannel] = 0;
@@ -287,6 +294,12 @@ boolean CDWHCIDevice::SubmitBlockingRequest (CUSBRequest *pURB, unsigned nTimeou
 		assert (   pURB->GetEndpoint ()->GetType () == EndpointTypeBulk
 		        || pURB->GetEndpoint ()->GetType () == EndpointTypeInterrupt);
 		assert (pURB->GetBufLen () > 0);
+
+		// no scatter-gather support in hardware
+		if (!pURB->Linearize ())
+		{
+			return FALSE;
+		}
 		
 		if (!TransferStage (pURB, pURB->GetEndpoint ()->IsDirectionIn (), FALSE, nTimeoutMs))
 		{
@@ -313,6 +326,13 @@ boolean CDWHCIDevice::SubmitAsyncRequest (CUSBRequest *pURB, unsigned nTimeoutMs
 	assert (pURB->GetBufLen () > 0);
 	
 	pURB->SetStatus (0);
+
+	if (!pURB->Linearize ())
+	{
+		PeripheralExit ();
+
+		return FALSE;
+	}
 	
 	boolean bOK = TransferStageAsync (pURB, pURB->GetEndpoint ()->IsDirectionIn (),
 					  FALSE, nTimeoutMs);
@@ -677,6 +697,43 @@ void CDWHCIDevice::DisableChannelInterrupt (unsigned nChannel)
 	m_IntMaskSpinLock.Release ();
 }
 
+#ifdef USE_USB_SOF_INTR
+
+void CDWHCIDevice::EnableSOFInterrupt (void)
+{
+	CDWHCIRegister IntMask (DWHCI_CORE_INT_MASK);
+
+	m_IntMaskSpinLock.Acquire ();
+
+	IntMask.Read ();
+	if (!IntMask.IsSet (DWHCI_CORE_INT_MASK_SOF_INTR))
+	{
+		IntMask.Or (DWHCI_CORE_INT_MASK_SOF_INTR);
+		IntMask.Write ();
+	}
+
+	m_IntMaskSpinLock.Release ();
+}
+
+void CDWHCIDevice::DisableSOFInterruptIfIdle (void)
+{
+	CDWHCIRegister IntMask (DWHCI_CORE_INT_MASK);
+
+	m_IntMaskSpinLock.Acquire ();
+
+	// checked with spin lock held, because EnableSOFInterrupt() is called after Enqueue()
+	if (m_TransactionQueue.IsEmpty ())
+	{
+		IntMask.Read ();
+		IntMask.And (~DWHCI_CORE_INT_MASK_SOF_INTR);
+		IntMask.Write ();
+	}
+
+	m_IntMaskSpinLock.Release ();
+}
+
+#endif
+
 void CDWHCIDevice::FlushTxFIFO (unsigned nFIFO)
 {
 	CDWHCIRegister Reset (DWHCI_CORE_RESET, 0);
@@ -719,6 +776,10 @@ boolean CDWHCIDevice::TransferStage (CUSBRequest *pURB, boolean bIn, boolean bSt
 	assert (pURB != 0);
 	pURB->SetCompletionRoutine (CompletionRoutine, (void *) (uintptr) nWaitBlock, this);
 
+	// the request is completed with the status stage of a control transfer
+	pURB->SetIntermediateStage (   pURB->GetEndpoint ()->GetType () == EndpointTypeControl
+				    && !bStatusStage);
+
 	assert (!m_bWaiting[nWaitBlock]);
 	m_bWaiting[nWaitBlock] = TRUE;
 
@@ -820,6 +881,8 @@ void CDWHCIDevice::QueueTransaction (CDWHCITransferStageData *pStageData)
 	}
 
 	m_TransactionQueue.Enqueue (pStageData, usFrameNumber);
+
+	EnableSOFInterrupt ();
 }
 
 void CDWHCIDevice::QueueDelayedTransaction (CDWHCITransferStageData *pStageData)
@@ -859,6 +922,8 @@ void CDWHCIDevice::QueueDelayedTransaction (CDWHCITransferStageData *pStageData)
 	}
 
 	m_TransactionQueue.Enqueue (pStageData, usFrameNumber);
+
+	EnableSOFInterrupt ();
 }
 
 #endif
@@ -1036,11 +1101,7 @@ void CDWHCIDevice::ChannelInterruptHandler (unsigned nChannel)
 
 		FreeChannel (nChannel);
 
-#ifndef USE_USB_FIQ
-		pURB->CallCompletionRoutine ();
-#else
-		m_CompletionQueue.Enqueue (pURB);
-#endif
+		CompleteURB (pURB);
 
 		return;
 	}
@@ -1187,11 +1248,7 @@ void CDWHCIDevice::ChannelInterruptHandler (unsigned nChannel)
 
 		FreeChannel (nChannel);
 
-#ifndef USE_USB_FIQ
-		pURB->CallCompletionRoutine ();
-#else
-		m_CompletionQueue.Enqueue (pURB);
-#endif
+		CompleteURB (pURB);
 		break;
 
 	case StageStateStartSplit:
@@ -1212,11 +1269,7 @@ void CDWHCIDevice::ChannelInterruptHandler (unsigned nChannel)
 
 			FreeChannel (nChannel);
 
-#ifndef USE_USB_FIQ
-			pURB->CallCompletionRoutine ();
-#else
-			m_CompletionQueue.Enqueue (pURB);
-#endif
+			CompleteURB (pURB);
 			break;
 		}
 
@@ -1262,11 +1315,7 @@ void CDWHCIDevice::ChannelInterruptHandler (unsigned nChannel)
 
 			FreeChannel (nChannel);
 
-#ifndef USE_USB_FIQ
-			pURB->CallCompletionRoutine ();
-#else
-			m_CompletionQueue.Enqueue (pURB);
-#endif
+			CompleteURB (pURB);
 			break;
 		}
 		
@@ -1320,11 +1369,7 @@ void CDWHCIDevice::ChannelInterruptHandler (unsigned nChannel)
 
 					FreeChannel (nChannel);
 
-#ifndef USE_USB_FIQ
-					pURB->CallCompletionRoutine ();
-#else
-					m_CompletionQueue.Enqueue (pURB);
-#endif
+					CompleteURB (pURB);
 				}
 				else
 				{
@@ -1359,11 +1404,7 @@ void CDWHCIDevice::ChannelInterruptHandler (unsigned nChannel)
 
 		FreeChannel (nChannel);
 
-#ifndef USE_USB_FIQ
-		pURB->CallCompletionRoutine ();
-#else
-		m_CompletionQueue.Enqueue (pURB);
-#endif
+		CompleteURB (pURB);
 		break;
 
 	default:
@@ -1384,6 +1425,25 @@ void CDWHCIDevice::SOFInterruptHandler (void)
 	CDWHCIRegister FrameNumber (DWHCI_HOST_FRM_NUM);
 	u16 usFrameNumber = DWHCI_HOST_FRM_NUM_NUMBER (FrameNumber.Read ());
 
+	// the SOF interval can be measured only, if the interrupt was enabled before
+	unsigned nTicks = CTimer::GetClockTicks ();
+	if (usFrameNumber == ((m_usLastSOFFrame+1) & DWHCI_MAX_FRAME_NUMBER))
+	{
+		unsigned nInterval = nTicks - m_nLastSOFTicks;
+		if (nInterval < m_Stats.nSOFIntervalMin)
+		{
+			m_Stats.nSOFIntervalMin = nInterval;
+		}
+		if (nInterval > m_Stats.nSOFIntervalMax)
+		{
+			m_Stats.nSOFIntervalMax = nInterval;
+		}
+	}
+	m_usLastSOFFrame = usFrameNumber;
+	m_nLastSOFTicks = nTicks;
+
+	m_Stats.nSOFInterrupts++;
+
 	CDWHCITransferStageData *pStageData;
 	while ((pStageData = m_TransactionQueue.Dequeue (usFrameNumber)) != 0)
 	{
@@ -1418,6 +1478,8 @@ void CDWHCIDevice::SOFInterruptHandler (void)
 
 		StartTransaction (pStageData);
 	}
+
+	DisableSOFInterruptIfIdle ();
 }
 
 #endif
@@ -1426,6 +1488,9 @@ void CDWHCIDevice::InterruptHandler (void)
 {
 	PeripheralEntry ();
 
+	unsigned nStartTicks = CTimer::GetClockTicks ();
+	m_Stats.nInterrupts++;
+
 	CDWHCIRegister IntStatus (DWHCI_CORE_INT_STAT);
 	IntStatus.Read ();
 
@@ -1453,6 +1518,8 @@ void CDWHCIDevice::InterruptHandler (void)
 			{
 				CDWHCIRegister ChanInterruptMask (DWHCI_HOST_CHAN_INT_MASK(nChannel), 0);
 				ChanInterruptMask.Write ();
+
+				m_Stats.nChannelInterrupts++;
 				
 				ChannelInterruptHandler (nChannel);
 			}
@@ -1500,12 +1567,21 @@ void CDWHCIDevice::InterruptHandler (void)
 
 	IntStatus.Write ();
 
+	unsigned nHandlerTime = CTimer::GetClockTicks () - nStartTicks;
+	if (nHandlerTime > m_Stats.nHandlerTimeMax)
+	{
+		m_Stats.nHandlerTimeMax = nHandlerTime;
+	}
+
 	PeripheralExit ();
 
 #ifdef USE_USB_FIQ
+	// the IRQ is triggered only, if there is something to do on IRQ_LEVEL
 	if (   !m_CompletionQueue.IsEmpty ()
 	    || AtomicGet (&m_nPortStatusChanged))
 	{
+		m_Stats.nCompletionIRQs++;
+
 		m_MPHI.TriggerIRQ ();
 	}
 #endif
@@ -1546,7 +1622,7 @@ void CDWHCIDevice::TimerHandler (CDWHCITransferStageData *pStageData)
 
 		PeripheralExit ();
 
-		pURB->CallCompletionRoutine ();
+		CompleteURB (pURB);
 
 		return;
 	}
@@ -1613,6 +1689,45 @@ void CDWHCIDevice::InterruptStub2 (void *pParam)
 
 #endif
 
+void CDWHCIDevice::CompleteURB (CUSBRequest *pURB)
+{
+	assert (pURB != 0);
+
+	m_Stats.nCompletions++;
+
+#ifndef USE_USB_FIQ
+	pURB->CallCompletionRoutine ();
+#else
+	m_CompletionQueue.Enqueue (pURB);
+#endif
+}
+
+void CDWHCIDevice::GetStats (TDWHCIStats *pStats)
+{
+	assert (pStats != 0);
+
+	EnterCritical (MAX_TARGET_LEVEL);
+
+	memcpy (pStats, &m_Stats, sizeof *pStats);
+
+	LeaveCritical ();
+
+	if (pStats->nSOFIntervalMin > pStats->nSOFIntervalMax)
+	{
+		pStats->nSOFIntervalMin = 0;	// not measured yet
+	}
+}
+
+void CDWHCIDevice::ResetStats (void)
+{
+	EnterCritical (MAX_TARGET_LEVEL);
+
+	memset (&m_Stats, 0, sizeof m_Stats);
+	m_Stats.nSOFIntervalMin = (unsigned) -1;
+
+	LeaveCritical ();
+}
+
 unsigned CDWHCIDevice::AllocateChannel (void)
 {
 	m_ChannelSpinLock.Acquire ();
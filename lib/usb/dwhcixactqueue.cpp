@@ -2,7 +2,7 @@
 // dwhcixactqueue.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2017-2022  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2017-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -218,4 +218,15 @@ CDWHCITransferStageData *CDWHCITransactionQueue::Dequeue (u16 usFrameNumber)
 	return pStageData;
 }
 
+boolean CDWHCITransactionQueue::IsEmpty (void)
+{
+	m_SpinLock.Acquire ();
+
+	boolean bResult = m_List.GetFirst () == 0;
+
+	m_SpinLock.Release ();
+
+	return bResult;
+}
+
 #endif
@@ -2,7 +2,7 @@
 // dwusbgadgetendpoint.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2023-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -47,11 +47,12 @@ CDWUSBGadgetEndpoint::CDWUSBGadgetEndpoint (const TUSBEndpointDescriptor *pDesc,
 					    CDWUSBGadget *pGadget)
 :	m_pGadget (pGadget),
 	m_Direction (pDesc->bEndpointAddress & 0x80 ? DirectionIn : DirectionOut),
-	m_Type (TypeBulk),
+	m_Type ((pDesc->bmAttributes & 0x03) == 3 ? TypeInterrupt : TypeBulk),
 	m_nEP (pDesc->bEndpointAddress & 0xF),
 	m_nMaxPacketSize (pDesc->wMaxPacketSize & 0x7FF)
 {
-	assert ((pDesc->bmAttributes & 0x03) == 2);	// Bulk
+	assert (   (pDesc->bmAttributes & 0x03) == 2		// Bulk
+		|| (pDesc->bmAttributes & 0x03) == 3);		// Interrupt
 
 	InitTransfer ();
 
@@ -108,9 +109,11 @@ void CDWUSBGadgetEndpoint::OnUSBReset (void)
 		EPCtrl.And (~DWHCI_DEV_EP_CTRL_MAX_PACKET_SIZ__MASK);
 		EPCtrl.Or (m_nMaxPacketSize << DWHCI_DEV_EP_CTRL_MAX_PACKET_SIZ__SHIFT);
 
-		assert (m_Type == TypeBulk);	// TODO: Bulk only
+		assert (m_Type == TypeBulk || m_Type == TypeInterrupt);
 		EPCtrl.And (~DWHCI_DEV_EP_CTRL_EP_TYPE__MASK);
-		EPCtrl.Or (DWHCI_DEV_EP_CTRL_EP_TYPE_BULK << DWHCI_DEV_EP_CTRL_EP_TYPE__SHIFT);
+		EPCtrl.Or (  (m_Type == TypeBulk ? DWHCI_DEV_EP_CTRL_EP_TYPE_BULK
+						 : DWHCI_DEV_EP_CTRL_EP_TYPE_INTR)
+			   << DWHCI_DEV_EP_CTRL_EP_TYPE__SHIFT);
 		EPCtrl.Or (DWHCI_DEV_EP_CTRL_SETDPID_D0);
 
 		EPCtrl.Or (DWHCI_DEV_EP_CTRL_ACTIVE_EP);
@@ -120,7 +123,12 @@ void CDWUSBGadgetEndpoint::OnUSBReset (void)
 			// Assign dedicated TX FIFO to EP
 			EPCtrl.And (~DWHCI_DEV_IN_EP_CTRL_TX_FIFO_NUM__MASK);
 			EPCtrl.Or (m_nEP << DWHCI_DEV_IN_EP_CTRL_TX_FIFO_NUM__SHIFT);
+		}
 
+		// the next EP sequence is used for non-periodic IN EPs only
+		if (   m_Direction == DirectionIn
+		    && m_Type == TypeBulk)
+		{
 			// Update s_NextEPSeq[]
 			unsigned i;
 			for (i = 0; i <= CDWUSBGadget::NumberOfInEPs; i++)
@@ -212,6 +220,11 @@ void CDWUSBGadgetEndpoint::BeginTransfer (TTransferMode Mode, void *pBuffer, siz
 		CDWHCIRegister InEPXferSize (DWHCI_DEV_IN_EP_XFER_SIZ (m_nEP), 0);
 		InEPXferSize.Or (nPacketCount << DWHCI_DEV_EP_XFER_SIZ_PKT_CNT__SHIFT);
 		InEPXferSize.Or (nLength << DWHCI_DEV_EP_XFER_SIZ_XFER_SIZ__SHIFT);
+		if (m_Type == TypeInterrupt)
+		{
+			// one packet per (micro-)frame
+			InEPXferSize.Or (1 << DWHCI_DEV_EP_XFER_SIZ_MULTI_CNT__SHIFT);
+		}
 		InEPXferSize.Write ();
 
 		CDWHCIRegister InEPDMAAddress (DWHCI_DEV_IN_EP_DMA_ADDR (m_nEP),
@@ -220,8 +233,11 @@ void CDWUSBGadgetEndpoint::BeginTransfer (TTransferMode Mode, void *pBuffer, siz
 
 		CDWHCIRegister InEPCtrl (DWHCI_DEV_IN_EP_CTRL (m_nEP), 0);
 		InEPCtrl.Read ();
-		InEPCtrl.And (~DWHCI_DEV_IN_EP_CTRL_NEXT_EP__MASK);
-		InEPCtrl.Or (s_NextEPSeq[m_nEP] << DWHCI_DEV_IN_EP_CTRL_NEXT_EP__SHIFT);
+		if (m_Type != TypeInterrupt)
+		{
+			InEPCtrl.And (~DWHCI_DEV_IN_EP_CTRL_NEXT_EP__MASK);
+			InEPCtrl.Or (s_NextEPSeq[m_nEP] << DWHCI_DEV_IN_EP_CTRL_NEXT_EP__SHIFT);
+		}
 		InEPCtrl.Or (DWHCI_DEV_EP_CTRL_EP_ENABLE);
 		InEPCtrl.Or (DWHCI_DEV_EP_CTRL_CLEAR_NAK);
 		InEPCtrl.Write ();
@@ -0,0 +1,809 @@
+//
+// usbcdcncmgadget.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/usb/gadget/usbcdcncmgadget.h>
+#include <circle/usb/gadget/usbcdcncmgadgetendpoint.h>
+#include <circle/bcmpropertytags.h>
+#include <circle/sysconfig.h>
+#include <circle/logger.h>
+#include <circle/timer.h>
+#include <circle/util.h>
+#include <assert.h>
+
+// Maximum NTB size in each direction
+#define NTB_MAX_SIZE		16384
+#define NTB_MIN_IN_SIZE		2048		// see NCM specification 6.2.7
+
+#define MAX_PACKET_SIZE		512		// of the bulk EPs
+
+LOGMODULE ("ncmgadget");
+
+const TUSBDeviceDescriptor CUSBCDCNCMGadget::s_DeviceDescriptor =
+{
+	sizeof (TUSBDeviceDescriptor),
+	DESCRIPTOR_DEVICE,
+	0x200,				// bcdUSB
+	2, 0, 0,			// bDeviceClass
+	64,				// wMaxPacketSize0
+	USB_GADGET_VENDOR_ID,
+	USB_GADGET_DEVICE_ID_NCM,
+	0x100,				// bcdDevice
+	1, 2, 0,			// strings
+	1
+};
+
+const CUSBCDCNCMGadget::TUSBCDCNCMGadgetConfigurationDescriptor
+	CUSBCDCNCMGadget::s_ConfigurationDescriptor =
+{
+	{
+		sizeof (TUSBConfigurationDescriptor),
+		DESCRIPTOR_CONFIGURATION,
+		sizeof s_ConfigurationDescriptor,
+		2,			// bNumInterfaces
+		1,
+		0,
+		0x80,			// bmAttributes (bus-powered)
+		500 / 2			// bMaxPower (500mA)
+	},
+	{
+		sizeof (TUSBInterfaceDescriptor),
+		DESCRIPTOR_INTERFACE,
+		0,			// bInterfaceNumber
+		0,			// bAlternateSetting
+		1,			// bNumEndpoints
+		2, 0x0D, 0,		// bInterfaceClass, SubClass (NCM), Protocol
+		0			// iInterface
+	},
+	{
+		5,			// bFunctionLength1
+		DESCRIPTOR_CS_INTERFACE,
+		0x00,			// bDescriptorSubtype1 = header functional descriptor
+		0x110,			// bcdCDC
+
+		5,			// bFunctionLength2
+		DESCRIPTOR_CS_INTERFACE,
+		0x06,			// bDescriptorSubtype2 = union functional descriptor
+		0,			// bControlInterface
+		1,			// bSubordinateInterface0
+
+		13,			// bFunctionLength3
+		DESCRIPTOR_CS_INTERFACE,
+		0x0F,			// bDescriptorSubtype3 = ethernet networking func. desc.
+		3,			// iMACAddress
+		0,			// bmEthernetStatistics
+		1514,			// wMaxSegmentSize
+		0,			// wNumberMCFilters
+		0,			// bNumberPowerFilters
+
+		{
+			sizeof (TNCMFunctionalDescriptor),
+			DESCRIPTOR_CS_INTERFACE,
+			NCM_FUNCTIONAL_DESCRIPTOR,
+			0x100,		// bcdNcmVersion
+			0		// bmNetworkCapabilities
+		}
+	},
+	{
+		sizeof (TUSBEndpointDescriptor),
+		DESCRIPTOR_ENDPOINT,
+		EPNotif | 0x80,
+		3,			// bmAttributes (Interrupt)
+		16,			// wMaxPacketSize
+		9			// bInterval (32ms)
+	},
+	{
+		sizeof (TUSBInterfaceDescriptor),
+		DESCRIPTOR_INTERFACE,
+		1,			// bInterfaceNumber
+		0,			// bAlternateSetting (no traffic)
+		0,			// bNumEndpoints
+		0x0A, 0, 1,		// bInterfaceClass, SubClass, Protocol (NTB)
+		0			// iInterface
+	},
+	{
+		sizeof (TUSBInterfaceDescriptor),
+		DESCRIPTOR_INTERFACE,
+		1,			// bInterfaceNumber
+		1,			// bAlternateSetting (normal operation)
+		2,			// bNumEndpoints
+		0x0A, 0, 1,		// bInterfaceClass, SubClass, Protocol (NTB)
+		0			// iInterface
+	},
+	{
+		sizeof (TUSBEndpointDescriptor),
+		DESCRIPTOR_ENDPOINT,
+		EPOut,
+		2,			// bmAttributes (Bulk)
+		MAX_PACKET_SIZE,	// wMaxPacketSize
+		0			// bInterval
+	},
+	{
+		sizeof (TUSBEndpointDescriptor),
+		DESCRIPTOR_ENDPOINT,
+		EPIn | 0x80,
+		2,			// bmAttributes (Bulk)
+		MAX_PACKET_SIZE,	// wMaxPacketSize
+		0			// bInterval
+	}
+};
+
+const char *const CUSBCDCNCMGadget::s_StringDescriptor[] =
+{
+	"\x04\x03\x09\x04",		// Language ID
+	"Circle",
+	"NCM Gadget"
+	// string 3 is the MAC address of the host
+};
+
+const TNCMNTBParameters CUSBCDCNCMGadget::s_NTBParameters =
+{
+	sizeof (TNCMNTBParameters),
+	NCM_NTB16_SUPPORTED | NCM_NTB32_SUPPORTED,
+	NTB_MAX_SIZE,			// dwNtbInMaxSize
+	4,				// wNdpInDivisor
+	0,				// wNdpInPayloadRemainder
+	4,				// wNdpInAlignment
+	0,
+	NTB_MAX_SIZE,			// dwNtbOutMaxSize
+	4,				// wNdpOutDivisor
+	0,				// wNdpOutPayloadRemainder
+	4,				// wNdpOutAlignment
+	0				// wNtbOutMaxDatagrams (no limit)
+};
+
+CUSBCDCNCMGadget::CUSBCDCNCMGadget (CInterruptSystem *pInterruptSystem)
+:	CDWUSBGadget (pInterruptSystem, HighSpeed),
+	m_pEP {nullptr, nullptr, nullptr, nullptr},
+	m_bNetDeviceAdded (FALSE),
+	m_bActive (FALSE),
+	m_bNTB32 (FALSE),
+	m_nNTBInSize (NTB_MAX_SIZE),
+	m_nNTBInMaxDatagrams (0),
+	m_pRxBuffer {nullptr, nullptr},
+	m_nRxIn (0),
+	m_nRxOut (0),
+	m_bRxActive (FALSE),
+	m_bRxReading (FALSE),
+	m_pTxBuffer {nullptr, nullptr},
+	m_nTxFill (0),
+	m_bTxActive (FALSE),
+	m_bWriterUpdate (FALSE),
+	m_nWriterNTBSize (0),
+	m_nAggregationTimeout (0),
+	m_nFirstFrameTicks (0),
+	m_nNotification (0)
+{
+	for (unsigned i = 0; i < RxBuffers; i++)
+	{
+		m_nRxLength[i] = 0;
+	}
+}
+
+CUSBCDCNCMGadget::~CUSBCDCNCMGadget (void)
+{
+	assert (0);
+}
+
+boolean CUSBCDCNCMGadget::Initialize (boolean bScanDevices)
+{
+	for (unsigned i = 0; i < RxBuffers; i++)
+	{
+		assert (!m_pRxBuffer[i]);
+		m_pRxBuffer[i] = new u8[NTB_MAX_SIZE];
+		assert (m_pRxBuffer[i]);
+	}
+
+	for (unsigned i = 0; i < TxBuffers; i++)
+	{
+		assert (!m_pTxBuffer[i]);
+		m_pTxBuffer[i] = new u8[NTB_MAX_SIZE];
+		assert (m_pTxBuffer[i]);
+	}
+
+	SetupWriter ();
+
+	InitMACAddresses ();
+
+	if (!CDWUSBGadget::Initialize (bScanDevices))
+	{
+		return FALSE;
+	}
+
+	if (!m_bNetDeviceAdded)
+	{
+		AddNetDevice ();
+
+		m_bNetDeviceAdded = TRUE;
+	}
+
+	return TRUE;
+}
+
+const CMACAddress *CUSBCDCNCMGadget::GetMACAddress (void) const
+{
+	return &m_MACAddress;
+}
+
+boolean CUSBCDCNCMGadget::IsSendFrameAdvisable (void)
+{
+	if (!m_bActive)
+	{
+		return FALSE;
+	}
+
+	m_SpinLock.Acquire ();
+
+	boolean bResult = !m_bTxActive || m_NTBWriter.HasRoom (FRAME_BUFFER_SIZE);
+
+	m_SpinLock.Release ();
+
+	return bResult;
+}
+
+boolean CUSBCDCNCMGadget::SendFrame (const void *pBuffer, unsigned nLength)
+{
+	assert (pBuffer);
+	assert (nLength <= FRAME_BUFFER_SIZE);
+
+	if (!m_bActive)
+	{
+		return FALSE;
+	}
+
+	m_SpinLock.Acquire ();
+
+	boolean bFirst = m_NTBWriter.IsEmpty ();
+
+	if (!m_NTBWriter.AddDatagram (pBuffer, nLength))
+	{
+		// NTB is full
+		if (m_bTxActive)
+		{
+			m_SpinLock.Release ();
+
+			return FALSE;
+		}
+
+		SendNTB ();
+
+		if (!m_NTBWriter.AddDatagram (pBuffer, nLength))
+		{
+			m_SpinLock.Release ();
+
+			return FALSE;
+		}
+
+		bFirst = TRUE;
+	}
+
+	if (bFirst)
+	{
+		m_nFirstFrameTicks = CTimer::GetClockTicks ();
+	}
+
+	if (   !m_bTxActive
+	    && !m_nAggregationTimeout)
+	{
+		SendNTB ();
+	}
+
+	m_SpinLock.Release ();
+
+	return TRUE;
+}
+
+boolean CUSBCDCNCMGadget::ReceiveFrame (void *pBuffer, unsigned *pResultLength)
+{
+	assert (pBuffer);
+	assert (pResultLength);
+
+	if (!m_bActive)
+	{
+		return FALSE;
+	}
+
+	m_SpinLock.Acquire ();
+
+	if (   !m_bTxActive
+	    && !m_NTBWriter.IsEmpty ()
+	    && CTimer::GetClockTicks () - m_nFirstFrameTicks >= m_nAggregationTimeout)
+	{
+		SendNTB ();
+	}
+
+	m_SpinLock.Release ();
+
+	// m_NTBReader and the buffer at m_nRxOut are accessed from here only
+	while (1)
+	{
+		if (m_bRxReading)
+		{
+			if (m_NTBReader.GetDatagram (pBuffer, pResultLength, FRAME_BUFFER_SIZE))
+			{
+				return TRUE;
+			}
+
+			m_bRxReading = FALSE;
+
+			m_SpinLock.Acquire ();
+
+			m_nRxLength[m_nRxOut] = 0;
+			m_nRxOut = (m_nRxOut + 1) % RxBuffers;
+
+			StartReceive ();
+
+			m_SpinLock.Release ();
+		}
+
+		unsigned nLength = m_nRxLength[m_nRxOut];
+		if (!nLength)
+		{
+			return FALSE;
+		}
+
+		if (!m_NTBReader.SetBlock (m_pRxBuffer[m_nRxOut], nLength))
+		{
+			LOGWARN ("Invalid NTB received");
+		}
+
+		// an invalid NTB has no datagrams and will be released above
+		m_bRxReading = TRUE;
+	}
+}
+
+boolean CUSBCDCNCMGadget::IsLinkUp (void)
+{
+	return m_bActive;
+}
+
+void CUSBCDCNCMGadget::SetAggregationTimeout (unsigned nMicroSeconds)
+{
+	m_nAggregationTimeout = nMicroSeconds;
+}
+
+const void *CUSBCDCNCMGadget::GetDescriptor (u16 wValue, u16 wIndex, size_t *pLength)
+{
+	assert (pLength);
+
+	u8 uchDescIndex = wValue & 0xFF;
+
+	switch (wValue >> 8)
+	{
+	case DESCRIPTOR_DEVICE:
+		if (!uchDescIndex)
+		{
+			*pLength = sizeof s_DeviceDescriptor;
+			return &s_DeviceDescriptor;
+		}
+		break;
+
+	case DESCRIPTOR_CONFIGURATION:
+		if (!uchDescIndex)
+		{
+			*pLength = sizeof s_ConfigurationDescriptor;
+			return &s_ConfigurationDescriptor;
+		}
+		break;
+
+	case DESCRIPTOR_STRING:
+		if (!uchDescIndex)
+		{
+			*pLength = (u8) s_StringDescriptor[0][0];
+			return s_StringDescriptor[0];
+		}
+		else if (uchDescIndex < sizeof s_StringDescriptor / sizeof s_StringDescriptor[0])
+		{
+			return ToStringDescriptor (s_StringDescriptor[uchDescIndex], pLength);
+		}
+		else if (uchDescIndex == s_ConfigurationDescriptor.CDCNCMHeader.iMACAddress)
+		{
+			return ToStringDescriptor (m_HostMACAddressString, pLength);
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	return nullptr;
+}
+
+int CUSBCDCNCMGadget::OnClassOrVendorRequest (const TSetupData *pSetupData, u8 *pData)
+{
+	assert (pSetupData);
+	assert (pData);
+
+	if (   (pSetupData->bmRequestType & 0x7F) != (REQUEST_CLASS | REQUEST_TO_INTERFACE)
+	    || pSetupData->wIndex != s_ConfigurationDescriptor.Interface0.bInterfaceNumber)
+	{
+		return -1;
+	}
+
+	int nResult = -1;
+
+	if (pSetupData->bmRequestType & REQUEST_IN)
+	{
+		switch (pSetupData->bRequest)
+		{
+		case NCM_GET_NTB_PARAMETERS:
+			memcpy (pData, &s_NTBParameters, sizeof s_NTBParameters);
+			nResult = sizeof s_NTBParameters;
+			break;
+
+		case NCM_GET_NTB_FORMAT:
+			pData[0] = m_bNTB32 ? NCM_NTB_FORMAT_NTB32 : NCM_NTB_FORMAT_NTB16;
+			pData[1] = 0;
+			nResult = 2;
+			break;
+
+		case NCM_GET_NTB_INPUT_SIZE:
+			memcpy (pData, &m_nNTBInSize, sizeof (u32));
+			nResult = sizeof (u32);
+			break;
+
+		default:
+			break;
+		}
+
+		// EP0 does not limit the length
+		if (nResult > pSetupData->wLength)
+		{
+			nResult = pSetupData->wLength;
+		}
+
+		return nResult;
+	}
+
+	// host-to-device requests are handled in the status phase,
+	// they are allowed, while the data interface is inactive only
+	m_SpinLock.Acquire ();
+
+	switch (pSetupData->bRequest)
+	{
+	case NCM_SET_ETHERNET_PACKET_FILTER:
+		nResult = 0;			// all frames are delivered anyway
+		break;
+
+	case NCM_SET_NTB_FORMAT:
+		if (pSetupData->wValue <= NCM_NTB_FORMAT_NTB32)
+		{
+			m_bNTB32 = pSetupData->wValue == NCM_NTB_FORMAT_NTB32;
+
+			UpdateWriter ();
+
+			nResult = 0;
+		}
+		break;
+
+	case NCM_SET_NTB_INPUT_SIZE:
+		if (   pSetupData->wLength == 4
+		    || pSetupData->wLength == 8)
+		{
+			u32 nSize;
+			memcpy (&nSize, pData, sizeof nSize);
+
+			u16 usMaxDatagrams = 0;
+			if (pSetupData->wLength == 8)
+			{
+				memcpy (&usMaxDatagrams, pData + 4, sizeof usMaxDatagrams);
+			}
+
+			if (   NTB_MIN_IN_SIZE <= nSize
+			    && nSize <= NTB_MAX_SIZE)
+			{
+				m_nNTBInSize = nSize;
+				m_nNTBInMaxDatagrams = usMaxDatagrams;
+
+				UpdateWriter ();
+
+				nResult = 0;
+			}
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	m_SpinLock.Release ();
+
+	return nResult;
+}
+
+void CUSBCDCNCMGadget::AddEndpoints (void)
+{
+	assert (!m_pEP[EPNotif]);
+	m_pEP[EPNotif] = new CUSBCDCNCMGadgetEndpoint (
+				reinterpret_cast<const TUSBEndpointDescriptor *> (
+					&s_ConfigurationDescriptor.EndpointNotif), this);
+	assert (m_pEP[EPNotif]);
+
+	assert (!m_pEP[EPOut]);
+	m_pEP[EPOut] = new CUSBCDCNCMGadgetEndpoint (
+				reinterpret_cast<const TUSBEndpointDescriptor *> (
+					&s_ConfigurationDescriptor.EndpointOut), this);
+	assert (m_pEP[EPOut]);
+
+	assert (!m_pEP[EPIn]);
+	m_pEP[EPIn] = new CUSBCDCNCMGadgetEndpoint (
+				reinterpret_cast<const TUSBEndpointDescriptor *> (
+					&s_ConfigurationDescriptor.EndpointIn), this);
+	assert (m_pEP[EPIn]);
+}
+
+void CUSBCDCNCMGadget::CreateDevice (void)
+{
+	// the net device has been registered in Initialize() already
+	LOGNOTE ("Link is up");
+}
+
+void CUSBCDCNCMGadget::OnSuspend (void)
+{
+	m_SpinLock.Acquire ();
+
+	m_bActive = FALSE;
+
+	// discard pending data
+	for (unsigned i = 0; i < RxBuffers; i++)
+	{
+		m_nRxLength[i] = 0;
+	}
+	m_nRxIn = 0;
+	m_nRxOut = 0;
+	m_bRxActive = FALSE;
+	m_bRxReading = FALSE;
+
+	m_nTxFill = 0;
+	m_bTxActive = FALSE;
+	SetupWriter ();
+
+	m_SpinLock.Release ();
+
+	delete m_pEP[EPNotif];
+	m_pEP[EPNotif] = nullptr;
+
+	delete m_pEP[EPOut];
+	m_pEP[EPOut] = nullptr;
+
+	delete m_pEP[EPIn];
+	m_pEP[EPIn] = nullptr;
+}
+
+void CUSBCDCNCMGadget::OnActivate (unsigned nEP)
+{
+	m_SpinLock.Acquire ();
+
+	switch (nEP)
+	{
+	case EPNotif:
+		m_nNotification = 0;
+		SendNotification ();
+		break;
+
+	case EPOut:
+		m_bActive = TRUE;
+		StartReceive ();
+		break;
+
+	default:
+		break;
+	}
+
+	m_SpinLock.Release ();
+}
+
+void CUSBCDCNCMGadget::OnTransferComplete (unsigned nEP, size_t nLength)
+{
+	m_SpinLock.Acquire ();
+
+	switch (nEP)
+	{
+	case EPNotif:
+		SendNotification ();
+		break;
+
+	case EPOut:
+		assert (m_bRxActive);
+		m_bRxActive = FALSE;
+
+		if (nLength)
+		{
+			assert (!m_nRxLength[m_nRxIn]);
+			m_nRxLength[m_nRxIn] = nLength;
+			m_nRxIn = (m_nRxIn + 1) % RxBuffers;
+		}
+
+		StartReceive ();
+		break;
+
+	case EPIn:
+		assert (m_bTxActive);
+		m_bTxActive = FALSE;
+
+		// send the frames, which have been collected in the meantime
+		SendNTB ();
+
+		if (   m_bWriterUpdate
+		    && !m_bTxActive)
+		{
+			SetupWriter ();
+		}
+		break;
+
+	default:
+		assert (0);
+		break;
+	}
+
+	m_SpinLock.Release ();
+}
+
+void CUSBCDCNCMGadget::StartReceive (void)
+{
+	if (   !m_bActive
+	    || m_bRxActive
+	    || m_nRxLength[m_nRxIn])
+	{
+		return;
+	}
+
+	m_bRxActive = TRUE;
+
+	assert (m_pEP[EPOut]);
+	m_pEP[EPOut]->BeginTransfer (m_pRxBuffer[m_nRxIn], NTB_MAX_SIZE);
+}
+
+void CUSBCDCNCMGadget::SendNTB (void)
+{
+	assert (!m_bTxActive);
+
+	unsigned nLength = m_NTBWriter.Finish ();
+	if (!nLength)
+	{
+		return;
+	}
+
+	// a short packet terminates the NTB, pad it instead of sending a zero-length packet
+	u8 *pBuffer = m_pTxBuffer[m_nTxFill];
+	if (   nLength % MAX_PACKET_SIZE == 0
+	    && nLength < m_nWriterNTBSize)
+	{
+		pBuffer[nLength++] = 0;
+	}
+
+	m_bTxActive = TRUE;
+
+	assert (m_pEP[EPIn]);
+	m_pEP[EPIn]->BeginTransfer (pBuffer, nLength);
+
+	// collect the next frames in the other buffer
+	m_nTxFill = (m_nTxFill + 1) % TxBuffers;
+	SetupWriter ();
+}
+
+void CUSBCDCNCMGadget::UpdateWriter (void)
+{
+	// frames, which have been collected already, are sent with the old parameters
+	if (   m_bTxActive
+	    || !m_NTBWriter.IsEmpty ())
+	{
+		m_bWriterUpdate = TRUE;
+
+		return;
+	}
+
+	SetupWriter ();
+}
+
+void CUSBCDCNCMGadget::SetupWriter (void)
+{
+	m_bWriterUpdate = FALSE;
+	m_nWriterNTBSize = m_nNTBInSize;
+
+	m_NTBWriter.Setup (m_pTxBuffer[m_nTxFill], m_nNTBInSize, m_bNTB32,
+			   s_NTBParameters.wNdpInDivisor, s_NTBParameters.wNdpInPayloadRemainder,
+			   s_NTBParameters.wNdpInAlignment, m_nNTBInMaxDatagrams);
+}
+
+void CUSBCDCNCMGadget::SendNotification (void)
+{
+	TSetupData *pHeader = reinterpret_cast<TSetupData *> (m_NotificationBuffer);
+	pHeader->bmRequestType = REQUEST_IN | REQUEST_CLASS | REQUEST_TO_INTERFACE;
+	pHeader->wIndex = s_ConfigurationDescriptor.Interface0.bInterfaceNumber;
+
+	size_t nLength = sizeof (TSetupData);
+
+	switch (m_nNotification++)
+	{
+	case 0: {
+		pHeader->bRequest = NCM_CONNECTION_SPEED_CHANGE;
+		pHeader->wValue = 0;
+		pHeader->wLength = 8;
+
+		u32 BitRate[2] = {480000000, 480000000};	// downstream, upstream
+		memcpy (m_NotificationBuffer + sizeof (TSetupData), BitRate, sizeof BitRate);
+		nLength += sizeof BitRate;
+		} break;
+
+	case 1:
+		pHeader->bRequest = NCM_NETWORK_CONNECTION;
+		pHeader->wValue = 1;		// connected
+		pHeader->wLength = 0;
+		break;
+
+	default:
+		return;
+	}
+
+	assert (m_pEP[EPNotif]);
+	m_pEP[EPNotif]->BeginTransfer (m_NotificationBuffer, nLength);
+}
+
+void CUSBCDCNCMGadget::InitMACAddresses (void)
+{
+	// locally administered addresses, derived from the serial number of the board
+	u8 Address[MAC_ADDRESS_SIZE] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+
+	CBcmPropertyTags Tags;
+	TPropertyTagSerial Serial;
+	if (Tags.GetTag (PROPTAG_GET_BOARD_SERIAL, &Serial, sizeof Serial))
+	{
+		Address[2] = (Serial.Serial[0] >> 24) & 0xFF;
+		Address[3] = (Serial.Serial[0] >> 16) & 0xFF;
+		Address[4] = (Serial.Serial[0] >> 8) & 0xFF;
+		Address[5] = Serial.Serial[0] & 0xFF;
+	}
+
+	m_MACAddress.Set (Address);
+
+	Address[0] = 0x06;		// for the host
+
+	static const char Hex[] = "0123456789ABCDEF";
+	char *p = m_HostMACAddressString;
+	for (unsigned i = 0; i < MAC_ADDRESS_SIZE; i++)
+	{
+		*p++ = Hex[Address[i] >> 4];
+		*p++ = Hex[Address[i] & 0xF];
+	}
+	*p = '\0';
+}
+
+const void *CUSBCDCNCMGadget::ToStringDescriptor (const char *pString, size_t *pLength)
+{
+	assert (pString);
+
+	size_t nLength = 2;
+	for (u8 *p = m_StringDescriptorBuffer+2; *pString; pString++)
+	{
+		assert (nLength < sizeof m_StringDescriptorBuffer-1);
+
+		*p++ = (u8) *pString;		// convert to UTF-16
+		*p++ = '\0';
+
+		nLength += 2;
+	}
+
+	m_StringDescriptorBuffer[0] = (u8) nLength;
+	m_StringDescriptorBuffer[1] = DESCRIPTOR_STRING;
+
+	assert (pLength);
+	*pLength = nLength;
+
+	return m_StringDescriptorBuffer;
+}
@@ -0,0 +1,52 @@
+//
+// usbcdcncmgadgetendpoint.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/usb/gadget/usbcdcncmgadgetendpoint.h>
+#include <circle/usb/gadget/usbcdcncmgadget.h>
+#include <assert.h>
+
+CUSBCDCNCMGadgetEndpoint::CUSBCDCNCMGadgetEndpoint (const TUSBEndpointDescriptor *pDesc,
+						    CUSBCDCNCMGadget *pGadget)
+:	CDWUSBGadgetEndpoint (pDesc, pGadget),
+	m_pGadget (pGadget)
+{
+}
+
+CUSBCDCNCMGadgetEndpoint::~CUSBCDCNCMGadgetEndpoint (void)
+{
+}
+
+void CUSBCDCNCMGadgetEndpoint::OnActivate (void)
+{
+	assert (m_pGadget);
+	m_pGadget->OnActivate (GetEPNumber ());
+}
+
+void CUSBCDCNCMGadgetEndpoint::OnTransferComplete (boolean bIn, size_t nLength)
+{
+	assert (m_pGadget);
+	m_pGadget->OnTransferComplete (GetEPNumber (), nLength);
+}
+
+void CUSBCDCNCMGadgetEndpoint::BeginTransfer (void *pBuffer, size_t nLength)
+{
+	CDWUSBGadgetEndpoint::BeginTransfer (  GetDirection () == DirectionIn
+					     ? TransferDataIn : TransferDataOut,
+					     pBuffer, nLength);
+}
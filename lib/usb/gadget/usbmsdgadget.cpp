@@ -4,7 +4,7 @@
 // USB Mass Storage Gadget by Mike Messinides
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2023-2024  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2023-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -23,6 +23,7 @@
 #include <circle/usb/gadget/usbmsdgadgetendpoint.h>
 #include <circle/logger.h>
 #include <circle/sysconfig.h>
+#include <circle/synchronize.h>
 #include <circle/util.h>
 #include <assert.h>
 
@@ -98,6 +99,7 @@ CUSBMSDGadget::CUSBMSDGadget (CInterruptSystem *pInterruptSystem, CDevice *pDevi
 	m_pDevice (pDevice),
 	m_pEP {nullptr, nullptr, nullptr}
 {
+	ResetDataBuffers();
 	if(pDevice)SetDevice(pDevice);
 }
 
@@ -267,28 +269,26 @@ void CUSBMSDGadget::OnTransferComplete (boolean bIn, size_t nLength)
 				                            m_OutBuffer,SIZE_CBW);
 				break;
 			}
-		case TMSDState::DataIn:
+		case TMSDState::DataIn:     //done sending data to host
 			{
-				if(m_nnumber_blocks>0)
+				SendCSW();
+				break;
+			}
+		case TMSDState::DataInRead:
+			{
+				//buffer has been sent, can be filled again by Update()
+				m_bUSBActive=false;
+				m_nBufferBlocks[m_nUSBBuffer]=0;
+				m_nUSBBuffer^=1;
+				if(m_nUSBBlocks==0)     //done sending data to host (or aborted)
 				{
-					if(m_MSDReady)
-					{
-						m_nState=TMSDState::DataInRead; //see Update function
-					}
-					else
-					{
-						MLOGERR("onXferCmplt DataIn","failed, %s",
-						        m_MSDReady?"ready":"not ready");
-						m_CSW.bmCSWStatus=MSD_CSW_STATUS_FAIL;
-						m_ReqSenseReply.bSenseKey = 2;
-						m_ReqSenseReply.bAddlSenseCode = 1;
-						SendCSW();
-					}
+					SendCSW();
 				}
-				else     //done sending data to host
+				else if(m_nBufferBlocks[m_nUSBBuffer]>0)
 				{
-					SendCSW();
+					StartDataIn();  //next chunk has already been read
 				}
+				//otherwise Update() starts the transfer, when the data is read
 				break;
 			}
 		case TMSDState::SendReqSenseReply:
@@ -332,22 +332,29 @@ void CUSBMSDGadget::OnTransferComplete (boolean bIn, size_t nLength)
 				} // TODO: response for not meaningful CBW
 				break;
 			}
-		case TMSDState::DataOut:
+		case TMSDState::DataOutWrite:
 			{
-				//process block from host
-				assert(m_nnumber_blocks>0);
-				if(m_MSDReady)
+				//chunk from host is available, will be written by Update()
+				m_bUSBActive=false;
+				if(m_nnumber_blocks==0)         //write failed meanwhile
+				{
+					SendCSW();
+					break;
+				}
+				u32 nBlocks=nLength/BLOCK_SIZE;
+				if(nBlocks>m_nUSBBlocks)
 				{
-					m_nState=TMSDState::DataOutWrite; //see Update function
+					nBlocks=m_nUSBBlocks;
 				}
-				else
+				if(nBlocks>0)
 				{
-					MLOGERR("onXferCmplt DataOut","failed, %s",
-					        m_MSDReady?"ready":"not ready");
-					m_CSW.bmCSWStatus=MSD_CSW_STATUS_FAIL;
-					m_ReqSenseReply.bSenseKey = 2;
-					m_ReqSenseReply.bAddlSenseCode = 1;
-					SendCSW();
+					m_nBufferBlocks[m_nUSBBuffer]=nBlocks;
+					m_nUSBBuffer^=1;
+					m_nUSBBlocks-=nBlocks;
+				}
+				if(m_nUSBBlocks>0 && m_nBufferBlocks[m_nUSBBuffer]==0)
+				{
+					StartDataOut(); //receive next chunk, while writing this one
 				}
 				break;
 			}
@@ -378,6 +385,47 @@ void CUSBMSDGadget::SendCSW()
 	m_nState=TMSDState::SentCSW;
 }
 
+void CUSBMSDGadget::ResetDataBuffers()
+{
+	m_nBufferBlocks[0]=0;
+	m_nBufferBlocks[1]=0;
+	m_nDeviceBuffer=0;
+	m_nUSBBuffer=0;
+	m_bUSBActive=false;
+	m_nUSBBlocks=0;
+}
+
+u8 *CUSBMSDGadget::GetDataBuffer(unsigned nIndex)
+{
+	assert(nIndex < 2);
+	return m_DataBuffer + nIndex*DataBufferSize;
+}
+
+void CUSBMSDGadget::StartDataIn()
+{
+	u32 nBlocks=m_nBufferBlocks[m_nUSBBuffer];
+	assert(nBlocks>0);
+	assert(nBlocks<=m_nUSBBlocks);
+	m_nUSBBlocks-=nBlocks;
+	m_bUSBActive=true;
+	m_pEP[EPIn]->BeginTransfer(CUSBMSDGadgetEndpoint::TransferDataIn,
+	                           GetDataBuffer(m_nUSBBuffer),nBlocks*BLOCK_SIZE);
+}
+
+void CUSBMSDGadget::StartDataOut()
+{
+	assert(m_nUSBBlocks>0);
+	assert(m_nBufferBlocks[m_nUSBBuffer]==0);
+	u32 nBlocks=m_nUSBBlocks;
+	if(nBlocks>MaxBlocksPerTransfer)
+	{
+		nBlocks=MaxBlocksPerTransfer;
+	}
+	m_bUSBActive=true;
+	m_pEP[EPOut]->BeginTransfer(CUSBMSDGadgetEndpoint::TransferDataOut,
+	                            GetDataBuffer(m_nUSBBuffer),nBlocks*BLOCK_SIZE);
+}
+
 void CUSBMSDGadget::HandleSCSICommand()
 {
 	switch(m_CBW.CBWCB[0])
@@ -498,6 +546,8 @@ void CUSBMSDGadget::HandleSCSICommand()
 				}
 				MLOGDEBUG("Read(10)","addr = %u len = %u",
 					  m_nblock_address,m_nnumber_blocks);
+				ResetDataBuffers();
+				m_nUSBBlocks=m_nnumber_blocks;
 				m_nState=TMSDState::DataInRead; //see Update() function
 			}
 			else
@@ -521,12 +571,18 @@ void CUSBMSDGadget::HandleSCSICommand()
 				m_nblock_address = (u32)(m_CBW.CBWCB[2] << 24) | (u32)(m_CBW.CBWCB[3] << 16)
 				                   |(u32)(m_CBW.CBWCB[4] << 8) | m_CBW.CBWCB[5];
 				MLOGDEBUG("Write(10)","addr = %u len = %u",m_nblock_address,m_nnumber_blocks);
-				m_pEP[EPOut]->BeginTransfer(CUSBMSDGadgetEndpoint::TransferDataOut,
-				                            m_OutBuffer,512);
-				m_nState=TMSDState::DataOut;
 				m_CSW.bmCSWStatus=MSD_CSW_STATUS_OK;	   //will be updated if write fails
 				m_ReqSenseReply.bSenseKey = 0;
 				m_ReqSenseReply.bAddlSenseCode = 0;
+				if(m_nnumber_blocks==0)
+				{
+					SendCSW();
+					break;
+				}
+				ResetDataBuffers();
+				m_nUSBBlocks=m_nnumber_blocks;
+				m_nState=TMSDState::DataOutWrite; //see Update() function
+				StartDataOut();
 			}
 			else
 			{
@@ -569,96 +625,108 @@ void CUSBMSDGadget::Update()
 	{
 	case TMSDState::DataInRead:
 		{
+			//read next chunk into free buffer, while the other one may be sent
+			if(m_nnumber_blocks==0 || m_nBufferBlocks[m_nDeviceBuffer]>0)
+			{
+				break;
+			}
+			u32 nBlocks=m_nnumber_blocks;
+			if(nBlocks>MaxBlocksPerTransfer)
+			{
+				nBlocks=MaxBlocksPerTransfer;
+			}
 			u64 offset=0;
 			int readCount=0;
 			if(m_MSDReady)
 			{
-				offset=m_pDevice->Seek(BLOCK_SIZE*m_nblock_address);
+				offset=m_pDevice->Seek(BLOCK_SIZE*(u64)m_nblock_address);
 				MLOGDEBUG("UpdateRead","offset = %u ",offset);
 				if(offset!=(u64)(-1))
 				{
-					readCount=m_pDevice->Read(m_InBuffer,BLOCK_SIZE);
-					if(readCount < BLOCK_SIZE)
-					{
-						MLOGERR("UpdateRead","readCount = %u ",readCount);
-						m_CSW.bmCSWStatus=MSD_CSW_STATUS_FAIL;
-						m_ReqSenseReply.bSenseKey = 2;
-						m_ReqSenseReply.bAddlSenseCode = 1;
-						SendCSW();
-						break;
-					}
-					m_pEP[EPIn]->BeginTransfer(CUSBMSDGadgetEndpoint::TransferDataIn,
-					                           m_InBuffer,readCount);
-					m_nnumber_blocks--;
-					m_nblock_address++;
-					m_nbyteCount-=readCount;
-					m_nState=TMSDState::DataIn;
+					readCount=m_pDevice->Read(GetDataBuffer(m_nDeviceBuffer),
+					                          nBlocks*BLOCK_SIZE);
 				}
 			}
-			if(!m_MSDReady || offset==(u64)(-1))
+			EnterCritical(IRQ_LEVEL);
+			if(readCount!=(int)(nBlocks*BLOCK_SIZE))
 			{
-				MLOGERR("UpdateRead","failed, %s, offset=%i",
-				        m_MSDReady?"ready":"not ready",offset);
 				m_CSW.bmCSWStatus=MSD_CSW_STATUS_FAIL;
 				m_ReqSenseReply.bSenseKey = 2;
 				m_ReqSenseReply.bAddlSenseCode = 1;
-				SendCSW();
+				m_nnumber_blocks=0;
+				m_nUSBBlocks=0;
+				if(!m_bUSBActive)
+				{
+					SendCSW();
+				}
+				LeaveCritical();
+				//log outside the critical section
+				MLOGERR("UpdateRead","failed, %s, offset=%i, readCount=%i",
+				        m_MSDReady?"ready":"not ready",offset,readCount);
+				break;
+			}
+			m_nBufferBlocks[m_nDeviceBuffer]=nBlocks;
+			m_nDeviceBuffer^=1;
+			m_nnumber_blocks-=nBlocks;
+			m_nblock_address+=nBlocks;
+			m_nbyteCount-=readCount;
+			if(!m_bUSBActive)
+			{
+				StartDataIn();
 			}
+			LeaveCritical();
 			break;
 		}
 	case TMSDState::DataOutWrite:
 		{
-			//process block from host
-			assert(m_nnumber_blocks>0);
+			//write received chunk, while the next one may be received
+			u32 nBlocks=m_nBufferBlocks[m_nDeviceBuffer];
+			if(m_nnumber_blocks==0 || nBlocks==0)
+			{
+				break;
+			}
 			u64 offset=0;
 			int writeCount=0;
 			if(m_MSDReady)
 			{
-				offset=m_pDevice->Seek(BLOCK_SIZE*m_nblock_address);
+				offset=m_pDevice->Seek(BLOCK_SIZE*(u64)m_nblock_address);
 				if(offset!=(u64)(-1))
 				{
-					writeCount=m_pDevice->Write(m_OutBuffer,BLOCK_SIZE);
-				}
-				if(writeCount>0)
-				{
-					if(writeCount<BLOCK_SIZE)
-					{
-						MLOGERR("UpdateWrite","writeCount = %u ",writeCount);
-						m_CSW.bmCSWStatus=MSD_CSW_STATUS_FAIL;
-						m_ReqSenseReply.bSenseKey = 0x2;
-						m_ReqSenseReply.bAddlSenseCode = 0x1;
-						SendCSW();
-						break;
-					}
-					m_nnumber_blocks--;
-					m_nblock_address++;
-					if(m_nnumber_blocks==0)  //done receiving data from host
-					{
-						SendCSW();
-						break;
-					}
+					writeCount=m_pDevice->Write(GetDataBuffer(m_nDeviceBuffer),
+					                            nBlocks*BLOCK_SIZE);
 				}
 			}
-			if(!m_MSDReady || offset==(u64)(-1) || writeCount<=0)
+			EnterCritical(IRQ_LEVEL);
+			if(writeCount!=(int)(nBlocks*BLOCK_SIZE))
 			{
-				MLOGERR("UpdateWrite","failed, %s, offset=%i, writeCount=%i",
-				        m_MSDReady?"ready":"not ready",offset,writeCount);
 				m_CSW.bmCSWStatus=MSD_CSW_STATUS_FAIL;
 				m_ReqSenseReply.bSenseKey = 2;
 				m_ReqSenseReply.bAddlSenseCode = 1;
-				SendCSW();
+				m_nnumber_blocks=0;
+				m_nUSBBlocks=0;
+				if(!m_bUSBActive)       //otherwise sent on transfer completion
+				{
+					SendCSW();
+				}
+				LeaveCritical();
+				//log outside the critical section
+				MLOGERR("UpdateWrite","failed, %s, offset=%i, writeCount=%i",
+				        m_MSDReady?"ready":"not ready",offset,writeCount);
 				break;
 			}
-			else
+			m_nBufferBlocks[m_nDeviceBuffer]=0;
+			m_nDeviceBuffer^=1;
+			m_nnumber_blocks-=nBlocks;
+			m_nblock_address+=nBlocks;
+			if(m_nnumber_blocks==0)  //done receiving data from host
 			{
-				if(m_nnumber_blocks>0)  //get next block
-				{
-					m_pEP[EPOut]->BeginTransfer(
-						CUSBMSDGadgetEndpoint::TransferDataOut,
-					        m_OutBuffer,512);
-					m_nState=TMSDState::DataOut;
-				}
+				SendCSW();
+			}
+			else if(!m_bUSBActive && m_nUSBBlocks>0)
+			{
+				StartDataOut(); //buffer has been freed
 			}
+			LeaveCritical();
 			break;
 		}
 	default:
@@ -7,7 +7,7 @@
 //	Licensed under GPLv2
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2018-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2018-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -43,6 +43,9 @@
 
 #define MAX_RX_FRAME_SIZE		(2*6 + 2 + 1500 + 4)
 
+#define RX_BUFFER_SIZE			(DEFAULT_BURST_CAP_SIZE + 4096)	// must be > burst cap
+#define TX_BUFFER_SIZE			(8 * 1024)
+
 // USB vendor requests
 #define WRITE_REGISTER			0xA0
 #define READ_REGISTER			0xA1
@@ -232,12 +235,64 @@ static const char FromLAN7800[] = "lan7800";
 CLAN7800Device::CLAN7800Device (CUSBFunction *pFunction)
 :	CUSBFunction (pFunction),
 	m_pEndpointBulkIn (0),
-	m_pEndpointBulkOut (0)
+	m_pEndpointBulkOut (0),
+	m_nRxSubmit (0),
+	m_nRxOut (0),
+	m_nRxActive (0),
+	m_bShutdown (FALSE),
+	m_nTxFill (0),
+	m_bTxActive (FALSE)
 {
+	for (unsigned i = 0; i < RxBuffers; i++)
+	{
+		m_RxBuffer[i].pURB = 0;
+		m_RxBuffer[i].pData = 0;
+		m_RxBuffer[i].State = RxBufferFree;
+		m_RxBuffer[i].nValid = 0;
+		m_RxBuffer[i].nOffset = 0;
+	}
+
+	for (unsigned i = 0; i < TxBuffers; i++)
+	{
+		m_TxBuffer[i].pData = 0;
+		m_TxBuffer[i].nLength = 0;
+	}
 }
 
 CLAN7800Device::~CLAN7800Device (void)
 {
+	// The host controller drivers cannot cancel a request, so wait for the completion of
+	// the active requests. The device answers bulk-in requests immediately.
+	m_bShutdown = TRUE;
+
+	unsigned nStartTicks = CTimer::GetClockTicks ();
+	while (   m_nRxActive > 0
+	       || m_bTxActive)
+	{
+		if (CTimer::GetClockTicks () - nStartTicks >= CLOCKHZ / 10)
+		{
+			// buffers and requests are left allocated, because the HC may still use them
+			CLogger::Get ()->Write (FromLAN7800, LogWarning, "Requests still active");
+
+			return;
+		}
+	}
+
+	for (unsigned i = 0; i < TxBuffers; i++)
+	{
+		delete [] m_TxBuffer[i].pData;
+		m_TxBuffer[i].pData = 0;
+	}
+
+	for (unsigned i = 0; i < RxBuffers; i++)
+	{
+		delete m_RxBuffer[i].pURB;
+		m_RxBuffer[i].pURB = 0;
+
+		delete [] m_RxBuffer[i].pData;
+		m_RxBuffer[i].pData = 0;
+	}
+
 	delete m_pEndpointBulkOut;
 	m_pEndpointBulkOut = 0;
 
@@ -294,6 +349,23 @@ boolean CLAN7800Device::Configure (void)
 		return FALSE;
 	}
 
+	for (unsigned i = 0; i < RxBuffers; i++)
+	{
+		m_RxBuffer[i].pData = new u8[RX_BUFFER_SIZE];
+		assert (m_RxBuffer[i].pData != 0);
+
+		m_RxBuffer[i].pURB = new CUSBRequest (m_pEndpointBulkIn, m_RxBuffer[i].pData,
+						      RX_BUFFER_SIZE);
+		assert (m_RxBuffer[i].pURB != 0);
+		m_RxBuffer[i].pURB->SetCompletionRoutine (RxCompletionStub, &m_RxBuffer[i], this);
+	}
+
+	for (unsigned i = 0; i < TxBuffers; i++)
+	{
+		m_TxBuffer[i].pData = new u8[TX_BUFFER_SIZE];
+		assert (m_TxBuffer[i].pData != 0);
+	}
+
 	if (!CUSBFunction::Configure ())
 	{
 		CLogger::Get ()->Write (FromLAN7800, LogError, "Cannot set interface");
@@ -337,13 +409,14 @@ boolean CLAN7800Device::Configure (void)
 		return FALSE;
 	}
 
-	// enable the LEDs and SEF mode
-	if (!ReadWriteReg (HW_CFG, HW_CFG_LED0_EN | HW_CFG_LED1_EN, ~HW_CFG_MEF))
+	// enable the LEDs and MEF mode (multiple frames per bulk-in transfer)
+	if (!ReadWriteReg (HW_CFG, HW_CFG_LED0_EN | HW_CFG_LED1_EN | HW_CFG_MEF))
 	{
 		return FALSE;
 	}
 
-	// enable burst CAP, disable NAK on RX FIFO empty
+	// enable burst CAP, clear BIR: an empty RX FIFO is answered with a zero-length
+	// packet instead of NAK, so that a bulk-in request completes with length 0
 	if (!ReadWriteReg (USB_CFG0, USB_CFG_BCE, ~USB_CFG_BIR))
 	{
 		return FALSE;
@@ -424,6 +497,18 @@ const CMACAddress *CLAN7800Device::GetMACAddress (void) const
 	return &m_MACAddress;
 }
 
+boolean CLAN7800Device::IsSendFrameAdvisable (void)
+{
+	m_SpinLock.Acquire ();
+
+	unsigned nOffset = (m_TxBuffer[m_nTxFill].nLength + 3) & ~3;
+	boolean bResult = nOffset + TX_HEADER_SIZE + FRAME_BUFFER_SIZE <= TX_BUFFER_SIZE;
+
+	m_SpinLock.Release ();
+
+	return bResult;
+}
+
 boolean CLAN7800Device::SendFrame (const void *pBuffer, unsigned nLength)
 {
 	if (nLength > FRAME_BUFFER_SIZE)
@@ -431,60 +516,136 @@ boolean CLAN7800Device::SendFrame (const void *pBuffer, unsigned nLength)
 		return FALSE;
 	}
 
-	DMA_BUFFER (u8, TxBuffer, FRAME_BUFFER_SIZE+TX_HEADER_SIZE);
 	assert (pBuffer != 0);
-	memcpy (TxBuffer+TX_HEADER_SIZE, pBuffer, nLength);
 
-	u32 *pTxHeader = (u32 *) TxBuffer;
+	m_SpinLock.Acquire ();
+
+	// frames in a batch start 32-bit aligned
+	TTxBuffer *pTxBuffer = &m_TxBuffer[m_nTxFill];
+	unsigned nOffset = (pTxBuffer->nLength + 3) & ~3;
+	if (nOffset + TX_HEADER_SIZE + nLength > TX_BUFFER_SIZE)
+	{
+		m_SpinLock.Release ();
+
+		return FALSE;
+	}
+
+	assert (pTxBuffer->pData != 0);
+	u32 *pTxHeader = (u32 *) (pTxBuffer->pData + nOffset);
 	pTxHeader[0] = (nLength & TX_CMD_A_LEN_MASK) | TX_CMD_A_FCS;
 	pTxHeader[1] = 0;
-	
-	assert (m_pEndpointBulkOut != 0);
-	return GetHost ()->Transfer (m_pEndpointBulkOut, TxBuffer, nLength+TX_HEADER_SIZE) >= 0;
+
+	memcpy (pTxBuffer->pData + nOffset + TX_HEADER_SIZE, pBuffer, nLength);
+
+	pTxBuffer->nLength = nOffset + TX_HEADER_SIZE + nLength;
+
+	// otherwise the batch is sent from the completion routine of the active request
+	boolean bOK = TRUE;
+	if (!m_bTxActive)
+	{
+		bOK = StartTxRequest ();
+	}
+
+	m_SpinLock.Release ();
+
+	return bOK;
 }
 
 boolean CLAN7800Device::ReceiveFrame (void *pBuffer, unsigned *pResultLength)
 {
-	assert (m_pEndpointBulkIn != 0);
 	assert (pBuffer != 0);
-	CUSBRequest URB (m_pEndpointBulkIn, pBuffer, FRAME_BUFFER_SIZE);
+	assert (pResultLength != 0);
 
-	if (!GetHost ()->SubmitBlockingRequest (&URB))
+	while (1)
 	{
-		return FALSE;
-	}
+		TRxBuffer *pRxBuffer = &m_RxBuffer[m_nRxOut];
 
-	u32 nResultLength = URB.GetResultLength ();
-	if (nResultLength < RX_HEADER_SIZE)
-	{
-		return FALSE;
-	}
+		m_SpinLock.Acquire ();
 
-	u32 nRxStatus = *(u32 *) pBuffer;	// RX command A
-	if (nRxStatus & RX_CMD_A_RED)
-	{
-		CLogger::Get ()->Write (FromLAN7800, LogWarning, "RX error (status 0x%X)", nRxStatus);
+		if (pRxBuffer->State != RxBufferFilled)
+		{
+			// restart the requests, if they were stopped, because of empty transfers
+			if (m_nRxActive == 0)
+			{
+				SubmitRxRequests ();
+			}
 
-		return FALSE;
-	}
-	
-	u32 nFrameLength = nRxStatus & RX_CMD_A_LEN_MASK;
-	assert (nFrameLength == nResultLength-RX_HEADER_SIZE);
-	assert (nFrameLength > 4);
-	if (nFrameLength <= 4)
-	{
-		return FALSE;
-	}
-	nFrameLength -= 4;	// ignore FCS
+			m_SpinLock.Release ();
 
-	//CLogger::Get ()->Write (FromLAN7800, LogDebug, "Frame received (status 0x%X)", nRxStatus);
+			return FALSE;
+		}
 
-	memcpy (pBuffer, (u8 *) pBuffer + RX_HEADER_SIZE, nFrameLength); // overwrite RX command A..C
+		m_SpinLock.Release ();
 
-	assert (pResultLength != 0);
-	*pResultLength = nFrameLength;
-	
-	return TRUE;
+		// the buffer is not touched by the completion routine, until it is released
+		assert (pRxBuffer->pData != 0);
+		assert (pRxBuffer->nOffset <= pRxBuffer->nValid);
+		const u8 *pHeader = pRxBuffer->pData + pRxBuffer->nOffset;
+		unsigned nRemaining = pRxBuffer->nValid - pRxBuffer->nOffset;
+
+		u32 nRxStatus = 0;
+		u32 nFrameLength = 0;
+		if (nRemaining >= RX_HEADER_SIZE)
+		{
+			nRxStatus = *(const u32 *) pHeader;	// RX command A
+			nFrameLength = nRxStatus & RX_CMD_A_LEN_MASK;
+		}
+
+		boolean bValid = FALSE;
+		if (nRemaining == 0)
+		{
+			// empty transfer
+		}
+		else if (   nFrameLength <= 4
+		    || RX_HEADER_SIZE + nFrameLength > nRemaining)
+		{
+			CLogger::Get ()->Write (FromLAN7800, LogWarning, "Invalid RX transfer");
+
+			pRxBuffer->nOffset = pRxBuffer->nValid;		// ignore the rest
+		}
+		else
+		{
+			// the next RX header is 32-bit aligned
+			pRxBuffer->nOffset += (RX_HEADER_SIZE + nFrameLength + 3) & ~3;
+
+			if (nRxStatus & RX_CMD_A_RED)
+			{
+				CLogger::Get ()->Write (FromLAN7800, LogWarning,
+							"RX error (status 0x%X)", nRxStatus);
+			}
+			else
+			{
+				//CLogger::Get ()->Write (FromLAN7800, LogDebug, "Frame received (status 0x%X)", nRxStatus);
+
+				*pResultLength = nFrameLength - 4;	// ignore FCS
+				memcpy (pBuffer, pHeader + RX_HEADER_SIZE, *pResultLength);
+
+				bValid = TRUE;
+			}
+		}
+
+		if (pRxBuffer->nOffset >= pRxBuffer->nValid)
+		{
+			m_SpinLock.Acquire ();
+
+			pRxBuffer->State = RxBufferFree;
+
+			if (++m_nRxOut == RxBuffers)
+			{
+				m_nRxOut = 0;
+			}
+
+			// submit the request of this buffer again, if the ring was full
+			SubmitRxRequests ();
+
+			m_SpinLock.Release ();
+		}
+
+		if (bValid)
+		{
+			return TRUE;
+		}
+	}
 }
 
 boolean CLAN7800Device::IsLinkUp (void)
@@ -531,6 +692,149 @@ TNetDeviceSpeed CLAN7800Device::GetLinkSpeed (void)
 	}
 }
 
+boolean CLAN7800Device::SubmitRxRequests (void)
+{
+	while (   m_nRxActive < RxMaxActive
+	       && !m_bShutdown)
+	{
+		TRxBuffer *pRxBuffer = &m_RxBuffer[m_nRxSubmit];
+		if (pRxBuffer->State != RxBufferFree)		// RX ring full?
+		{
+			break;
+		}
+
+		pRxBuffer->nValid = 0;
+		pRxBuffer->nOffset = 0;
+		pRxBuffer->State = RxBufferActive;
+		m_nRxActive++;
+
+		assert (pRxBuffer->pURB != 0);
+		if (!GetHost ()->SubmitAsyncRequest (pRxBuffer->pURB))
+		{
+			pRxBuffer->State = RxBufferFree;
+			m_nRxActive--;
+
+			return FALSE;
+		}
+
+		if (++m_nRxSubmit == RxBuffers)
+		{
+			m_nRxSubmit = 0;
+		}
+	}
+
+	return TRUE;
+}
+
+void CLAN7800Device::RxCompletionRoutine (CUSBRequest *pURB, TRxBuffer *pRxBuffer)
+{
+	assert (pURB != 0);
+	assert (pRxBuffer != 0);
+	assert (pRxBuffer->pURB == pURB);
+
+	m_SpinLock.Acquire ();
+
+	assert (pRxBuffer->State == RxBufferActive);
+	assert (m_nRxActive > 0);
+	m_nRxActive--;
+
+	// requests complete in the order of submission, so that the buffers are filled in
+	// ring order, empty buffers are released by ReceiveFrame()
+	pRxBuffer->nValid = pURB->GetStatus () != 0 ? pURB->GetResultLength () : 0;
+	pRxBuffer->nOffset = 0;
+	pRxBuffer->State = RxBufferFilled;
+
+	// On an empty RX FIFO the LAN7800 returns an empty transfer (USB_CFG_BIR is cleared in
+	// Configure()). In this case (and on errors) the requests are submitted again from
+	// ReceiveFrame() only, otherwise the completion would be continuously reported from here.
+	if (pRxBuffer->nValid > 0)
+	{
+		SubmitRxRequests ();
+	}
+
+	m_SpinLock.Release ();
+}
+
+void CLAN7800Device::RxCompletionStub (CUSBRequest *pURB, void *pParam, void *pContext)
+{
+	CLAN7800Device *pThis = (CLAN7800Device *) pContext;
+	assert (pThis != 0);
+
+	pThis->RxCompletionRoutine (pURB, (TRxBuffer *) pParam);
+}
+
+boolean CLAN7800Device::StartTxRequest (void)
+{
+	assert (!m_bTxActive);
+
+	if (m_bShutdown)
+	{
+		return FALSE;
+	}
+
+	TTxBuffer *pTxBuffer = &m_TxBuffer[m_nTxFill];
+	assert (pTxBuffer->nLength > 0);
+
+	assert (m_pEndpointBulkOut != 0);
+	assert (pTxBuffer->pData != 0);
+	CUSBRequest *pURB = new CUSBRequest (m_pEndpointBulkOut, pTxBuffer->pData, pTxBuffer->nLength);
+	assert (pURB != 0);
+
+	pURB->SetCompletionRoutine (TxCompletionStub, pTxBuffer, this);
+	m_bTxActive = TRUE;
+
+	if (!GetHost ()->SubmitAsyncRequest (pURB))
+	{
+		m_bTxActive = FALSE;
+
+		delete pURB;
+
+		pTxBuffer->nLength = 0;		// drop the batch
+
+		return FALSE;
+	}
+
+	if (++m_nTxFill == TxBuffers)
+	{
+		m_nTxFill = 0;
+	}
+
+	assert (m_TxBuffer[m_nTxFill].nLength == 0);
+
+	return TRUE;
+}
+
+void CLAN7800Device::TxCompletionRoutine (CUSBRequest *pURB, TTxBuffer *pTxBuffer)
+{
+	assert (pURB != 0);
+	assert (pTxBuffer != 0);
+
+	m_SpinLock.Acquire ();
+
+	assert (m_bTxActive);
+	m_bTxActive = FALSE;
+
+	delete pURB;
+
+	pTxBuffer->nLength = 0;
+
+	// send the frames, which have been batched in the meantime
+	if (m_TxBuffer[m_nTxFill].nLength > 0)
+	{
+		StartTxRequest ();
+	}
+
+	m_SpinLock.Release ();
+}
+
+void CLAN7800Device::TxCompletionStub (CUSBRequest *pURB, void *pParam, void *pContext)
+{
+	CLAN7800Device *pThis = (CLAN7800Device *) pContext;
+	assert (pThis != 0);
+
+	pThis->TxCompletionRoutine (pURB, (TTxBuffer *) pParam);
+}
+
 boolean CLAN7800Device::InitMACAddress (void)
 {
 	CBcmPropertyTags Tags;
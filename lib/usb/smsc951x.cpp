@@ -9,7 +9,7 @@
 // See the file lib/usb/README for details!
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -47,6 +47,8 @@
 	#define TX_CFG_ON			0x00000004
 #define HW_CFG				0x14
 	#define HW_CFG_BIR			0x00001000
+	#define HW_CFG_MEF			0x00000020
+	#define HW_CFG_BCE			0x00000002
 #define RX_FIFO_INF			0x18
 #define PM_CTRL				0x20
 #define LED_GPIO_CFG			0x24
@@ -124,17 +126,79 @@
 					 | RX_STS_DB	\
 					 | RX_STS_CRC)
 
+#define HS_USB_PKT_SIZE			512
+#define DEFAULT_BURST_CAP_SIZE		(12 * 1024)
+#define DEFAULT_BULK_IN_DELAY		0x2000
+
+#define RX_HEADER_SIZE			4
+#define TX_HEADER_SIZE			8
+
+#define RX_BUFFER_SIZE			(DEFAULT_BURST_CAP_SIZE + 4096)	// must be > burst cap
+#define TX_BUFFER_SIZE			(8 * 1024)
+
 static const char FromSMSC951x[] = "smsc951x";
 
 CSMSC951xDevice::CSMSC951xDevice (CUSBFunction *pFunction)
 :	CUSBFunction (pFunction),
 	m_pEndpointBulkIn (0),
-	m_pEndpointBulkOut (0)
+	m_pEndpointBulkOut (0),
+	m_nRxSubmit (0),
+	m_nRxOut (0),
+	m_nRxActive (0),
+	m_bShutdown (FALSE),
+	m_nTxFill (0),
+	m_bTxActive (FALSE)
 {
+	for (unsigned i = 0; i < RxBuffers; i++)
+	{
+		m_RxBuffer[i].pURB = 0;
+		m_RxBuffer[i].pData = 0;
+		m_RxBuffer[i].State = RxBufferFree;
+		m_RxBuffer[i].nValid = 0;
+		m_RxBuffer[i].nOffset = 0;
+	}
+
+	for (unsigned i = 0; i < TxBuffers; i++)
+	{
+		m_TxBuffer[i].pData = 0;
+		m_TxBuffer[i].nLength = 0;
+	}
 }
 
 CSMSC951xDevice::~CSMSC951xDevice (void)
 {
+	// The host controller drivers cannot cancel a request, so wait for the completion of
+	// the active requests. They complete with an error, when the device has been removed.
+	m_bShutdown = TRUE;
+
+	unsigned nStartTicks = CTimer::GetClockTicks ();
+	while (   m_nRxActive > 0
+	       || m_bTxActive)
+	{
+		if (CTimer::GetClockTicks () - nStartTicks >= CLOCKHZ / 10)
+		{
+			// buffers and requests are left allocated, because the HC may still use them
+			CLogger::Get ()->Write (FromSMSC951x, LogWarning, "Requests still active");
+
+			return;
+		}
+	}
+
+	for (unsigned i = 0; i < TxBuffers; i++)
+	{
+		delete [] m_TxBuffer[i].pData;
+		m_TxBuffer[i].pData = 0;
+	}
+
+	for (unsigned i = 0; i < RxBuffers; i++)
+	{
+		delete m_RxBuffer[i].pURB;
+		m_RxBuffer[i].pURB = 0;
+
+		delete [] m_RxBuffer[i].pData;
+		m_RxBuffer[i].pData = 0;
+	}
+
 	delete m_pEndpointBulkOut;
 	m_pEndpointBulkOut = 0;
 
@@ -205,6 +269,23 @@ boolean CSMSC951xDevice::Configure (void)
 		return FALSE;
 	}
 
+	for (unsigned i = 0; i < RxBuffers; i++)
+	{
+		m_RxBuffer[i].pData = new u8[RX_BUFFER_SIZE];
+		assert (m_RxBuffer[i].pData != 0);
+
+		m_RxBuffer[i].pURB = new CUSBRequest (m_pEndpointBulkIn, m_RxBuffer[i].pData,
+						      RX_BUFFER_SIZE);
+		assert (m_RxBuffer[i].pURB != 0);
+		m_RxBuffer[i].pURB->SetCompletionRoutine (RxCompletionStub, &m_RxBuffer[i], this);
+	}
+
+	for (unsigned i = 0; i < TxBuffers; i++)
+	{
+		m_TxBuffer[i].pData = new u8[TX_BUFFER_SIZE];
+		assert (m_TxBuffer[i].pData != 0);
+	}
+
 	if (!CUSBFunction::Configure ())
 	{
 		CLogger::Get ()->Write (FromSMSC951x, LogError, "Cannot set interface");
@@ -228,6 +309,18 @@ boolean CSMSC951xDevice::Configure (void)
 		return FALSE;
 	}
 
+	// enable burst CAP and multiple frames per bulk-in transfer, NAK on RX FIFO empty
+	u32 nHWConfig;
+	if (   !WriteReg (BURST_CAP, DEFAULT_BURST_CAP_SIZE / HS_USB_PKT_SIZE)	// for USB high speed
+	    || !WriteReg (BULK_IN_DLY, DEFAULT_BULK_IN_DELAY)
+	    || !ReadReg (HW_CFG, &nHWConfig)
+	    || !WriteReg (HW_CFG, nHWConfig | HW_CFG_MEF | HW_CFG_BCE | HW_CFG_BIR))
+	{
+		CLogger::Get ()->Write (FromSMSC951x, LogError, "Cannot set burst mode");
+
+		return FALSE;
+	}
+
 	if (   !WriteReg (LED_GPIO_CFG,   LED_GPIO_CFG_SPD_LED
 					| LED_GPIO_CFG_LNK_LED
 					| LED_GPIO_CFG_FDX_LED)
@@ -252,6 +345,18 @@ const CMACAddress *CSMSC951xDevice::GetMACAddress (void) const
 	return &m_MACAddress;
 }
 
+boolean CSMSC951xDevice::IsSendFrameAdvisable (void)
+{
+	m_SpinLock.Acquire ();
+
+	unsigned nOffset = (m_TxBuffer[m_nTxFill].nLength + 3) & ~3;
+	boolean bResult = nOffset + TX_HEADER_SIZE + FRAME_BUFFER_SIZE <= TX_BUFFER_SIZE;
+
+	m_SpinLock.Release ();
+
+	return bResult;
+}
+
 boolean CSMSC951xDevice::SendFrame (const void *pBuffer, unsigned nLength)
 {
 	if (nLength > FRAME_BUFFER_SIZE)
@@ -259,60 +364,136 @@ boolean CSMSC951xDevice::SendFrame (const void *pBuffer, unsigned nLength)
 		return FALSE;
 	}
 
-	DMA_BUFFER (u8, TxBuffer, FRAME_BUFFER_SIZE+8);
 	assert (pBuffer != 0);
-	memcpy (TxBuffer+8, pBuffer, nLength);
 
-	u32 *pTxHeader = (u32 *) TxBuffer;
+	m_SpinLock.Acquire ();
+
+	// frames in a batch start 32-bit aligned
+	TTxBuffer *pTxBuffer = &m_TxBuffer[m_nTxFill];
+	unsigned nOffset = (pTxBuffer->nLength + 3) & ~3;
+	if (nOffset + TX_HEADER_SIZE + nLength > TX_BUFFER_SIZE)
+	{
+		m_SpinLock.Release ();
+
+		return FALSE;
+	}
+
+	assert (pTxBuffer->pData != 0);
+	u32 *pTxHeader = (u32 *) (pTxBuffer->pData + nOffset);
 	pTxHeader[0] = TX_CMD_A_FIRST_SEG | TX_CMD_A_LAST_SEG | nLength;
 	pTxHeader[1] = nLength;
-	
-	assert (m_pEndpointBulkOut != 0);
-	return GetHost ()->Transfer (m_pEndpointBulkOut, TxBuffer, nLength+8) >= 0;
+
+	memcpy (pTxBuffer->pData + nOffset + TX_HEADER_SIZE, pBuffer, nLength);
+
+	pTxBuffer->nLength = nOffset + TX_HEADER_SIZE + nLength;
+
+	// otherwise the batch is sent from the completion routine of the active request
+	boolean bOK = TRUE;
+	if (!m_bTxActive)
+	{
+		bOK = StartTxRequest ();
+	}
+
+	m_SpinLock.Release ();
+
+	return bOK;
 }
 
 boolean CSMSC951xDevice::ReceiveFrame (void *pBuffer, unsigned *pResultLength)
 {
-	assert (m_pEndpointBulkIn != 0);
 	assert (pBuffer != 0);
-	CUSBRequest URB (m_pEndpointBulkIn, pBuffer, FRAME_BUFFER_SIZE);
+	assert (pResultLength != 0);
 
-	if (!GetHost ()->SubmitBlockingRequest (&URB))
+	while (1)
 	{
-		return FALSE;
-	}
+		TRxBuffer *pRxBuffer = &m_RxBuffer[m_nRxOut];
 
-	u32 nResultLength = URB.GetResultLength ();
-	if (nResultLength < 4)				// should not happen with HW_CFG_BIR set
-	{
-		return FALSE;
-	}
+		m_SpinLock.Acquire ();
 
-	u32 nRxStatus = *(u32 *) pBuffer;
-	if (nRxStatus & RX_STS_ERROR)
-	{
-		CLogger::Get ()->Write (FromSMSC951x, LogWarning, "RX error (status 0x%X)", nRxStatus);
+		if (pRxBuffer->State != RxBufferFilled)
+		{
+			// restart the requests, if they were stopped, because of empty transfers
+			if (m_nRxActive == 0)
+			{
+				SubmitRxRequests ();
+			}
 
-		return FALSE;
-	}
-	
-	u32 nFrameLength = RX_STS_FRAMELEN (nRxStatus);
-	assert (nFrameLength == nResultLength-4);
-	assert (nFrameLength > 4);
-	if (nFrameLength <= 4)
-	{
-		return FALSE;
-	}
-	nFrameLength -= 4;	// ignore CRC
+			m_SpinLock.Release ();
 
-	//CLogger::Get ()->Write (FromSMSC951x, LogDebug, "Frame received (status 0x%X)", nRxStatus);
+			return FALSE;
+		}
 
-	memcpy (pBuffer, (u8 *) pBuffer + 4, nFrameLength);	// overwrite RX status
+		m_SpinLock.Release ();
 
-	assert (pResultLength != 0);
-	*pResultLength = nFrameLength;
-	
-	return TRUE;
+		// the buffer is not touched by the completion routine, until it is released
+		assert (pRxBuffer->pData != 0);
+		assert (pRxBuffer->nOffset <= pRxBuffer->nValid);
+		const u8 *pHeader = pRxBuffer->pData + pRxBuffer->nOffset;
+		unsigned nRemaining = pRxBuffer->nValid - pRxBuffer->nOffset;
+
+		u32 nRxStatus = 0;
+		u32 nFrameLength = 0;
+		if (nRemaining >= RX_HEADER_SIZE)
+		{
+			nRxStatus = *(const u32 *) pHeader;
+			nFrameLength = RX_STS_FRAMELEN (nRxStatus);
+		}
+
+		boolean bValid = FALSE;
+		if (nRemaining == 0)
+		{
+			// empty transfer
+		}
+		else if (   nFrameLength <= 4
+		    || RX_HEADER_SIZE + nFrameLength > nRemaining)
+		{
+			CLogger::Get ()->Write (FromSMSC951x, LogWarning, "Invalid RX transfer");
+
+			pRxBuffer->nOffset = pRxBuffer->nValid;		// ignore the rest
+		}
+		else
+		{
+			// the next RX status is 32-bit aligned
+			pRxBuffer->nOffset += (RX_HEADER_SIZE + nFrameLength + 3) & ~3;
+
+			if (nRxStatus & RX_STS_ERROR)
+			{
+				CLogger::Get ()->Write (FromSMSC951x, LogWarning,
+							"RX error (status 0x%X)", nRxStatus);
+			}
+			else
+			{
+				//CLogger::Get ()->Write (FromSMSC951x, LogDebug, "Frame received (status 0x%X)", nRxStatus);
+
+				*pResultLength = nFrameLength - 4;	// ignore CRC
+				memcpy (pBuffer, pHeader + RX_HEADER_SIZE, *pResultLength);
+
+				bValid = TRUE;
+			}
+		}
+
+		if (pRxBuffer->nOffset >= pRxBuffer->nValid)
+		{
+			m_SpinLock.Acquire ();
+
+			pRxBuffer->State = RxBufferFree;
+
+			if (++m_nRxOut == RxBuffers)
+			{
+				m_nRxOut = 0;
+			}
+
+			// submit the request of this buffer again, if the ring was full
+			SubmitRxRequests ();
+
+			m_SpinLock.Release ();
+		}
+
+		if (bValid)
+		{
+			return TRUE;
+		}
+	}
 }
 
 boolean CSMSC951xDevice::IsLinkUp (void)
@@ -350,6 +531,149 @@ TNetDeviceSpeed CSMSC951xDevice::GetLinkSpeed (void)
 	}
 }
 
+boolean CSMSC951xDevice::SubmitRxRequests (void)
+{
+	while (   m_nRxActive < RxMaxActive
+	       && !m_bShutdown)
+	{
+		TRxBuffer *pRxBuffer = &m_RxBuffer[m_nRxSubmit];
+		if (pRxBuffer->State != RxBufferFree)		// RX ring full?
+		{
+			break;
+		}
+
+		pRxBuffer->nValid = 0;
+		pRxBuffer->nOffset = 0;
+		pRxBuffer->State = RxBufferActive;
+		m_nRxActive++;
+
+		assert (pRxBuffer->pURB != 0);
+		if (!GetHost ()->SubmitAsyncRequest (pRxBuffer->pURB))
+		{
+			pRxBuffer->State = RxBufferFree;
+			m_nRxActive--;
+
+			return FALSE;
+		}
+
+		if (++m_nRxSubmit == RxBuffers)
+		{
+			m_nRxSubmit = 0;
+		}
+	}
+
+	return TRUE;
+}
+
+void CSMSC951xDevice::RxCompletionRoutine (CUSBRequest *pURB, TRxBuffer *pRxBuffer)
+{
+	assert (pURB != 0);
+	assert (pRxBuffer != 0);
+	assert (pRxBuffer->pURB == pURB);
+
+	m_SpinLock.Acquire ();
+
+	assert (pRxBuffer->State == RxBufferActive);
+	assert (m_nRxActive > 0);
+	m_nRxActive--;
+
+	// requests complete in the order of submission, so that the buffers are filled in
+	// ring order, empty buffers are released by ReceiveFrame()
+	pRxBuffer->nValid = pURB->GetStatus () != 0 ? pURB->GetResultLength () : 0;
+	pRxBuffer->nOffset = 0;
+	pRxBuffer->State = RxBufferFilled;
+
+	// An empty transfer should not happen with HW_CFG_BIR set (NAK on an empty RX FIFO). In
+	// this case (and on errors) the requests are submitted again from ReceiveFrame() only,
+	// otherwise the completion would be continuously reported from here.
+	if (pRxBuffer->nValid > 0)
+	{
+		SubmitRxRequests ();
+	}
+
+	m_SpinLock.Release ();
+}
+
+void CSMSC951xDevice::RxCompletionStub (CUSBRequest *pURB, void *pParam, void *pContext)
+{
+	CSMSC951xDevice *pThis = (CSMSC951xDevice *) pContext;
+	assert (pThis != 0);
+
+	pThis->RxCompletionRoutine (pURB, (TRxBuffer *) pParam);
+}
+
+boolean CSMSC951xDevice::StartTxRequest (void)
+{
+	assert (!m_bTxActive);
+
+	if (m_bShutdown)
+	{
+		return FALSE;
+	}
+
+	TTxBuffer *pTxBuffer = &m_TxBuffer[m_nTxFill];
+	assert (pTxBuffer->nLength > 0);
+
+	assert (m_pEndpointBulkOut != 0);
+	assert (pTxBuffer->pData != 0);
+	CUSBRequest *pURB = new CUSBRequest (m_pEndpointBulkOut, pTxBuffer->pData, pTxBuffer->nLength);
+	assert (pURB != 0);
+
+	pURB->SetCompletionRoutine (TxCompletionStub, pTxBuffer, this);
+	m_bTxActive = TRUE;
+
+	if (!GetHost ()->SubmitAsyncRequest (pURB))
+	{
+		m_bTxActive = FALSE;
+
+		delete pURB;
+
+		pTxBuffer->nLength = 0;		// drop the batch
+
+		return FALSE;
+	}
+
+	if (++m_nTxFill == TxBuffers)
+	{
+		m_nTxFill = 0;
+	}
+
+	assert (m_TxBuffer[m_nTxFill].nLength == 0);
+
+	return TRUE;
+}
+
+void CSMSC951xDevice::TxCompletionRoutine (CUSBRequest *pURB, TTxBuffer *pTxBuffer)
+{
+	assert (pURB != 0);
+	assert (pTxBuffer != 0);
+
+	m_SpinLock.Acquire ();
+
+	assert (m_bTxActive);
+	m_bTxActive = FALSE;
+
+	delete pURB;
+
+	pTxBuffer->nLength = 0;
+
+	// send the frames, which have been batched in the meantime
+	if (m_TxBuffer[m_nTxFill].nLength > 0)
+	{
+		StartTxRequest ();
+	}
+
+	m_SpinLock.Release ();
+}
+
+void CSMSC951xDevice::TxCompletionStub (CUSBRequest *pURB, void *pParam, void *pContext)
+{
+	CSMSC951xDevice *pThis = (CSMSC951xDevice *) pContext;
+	assert (pThis != 0);
+
+	pThis->TxCompletionRoutine (pURB, (TTxBuffer *) pParam);
+}
+
 boolean CSMSC951xDevice::PHYWrite (u8 uchIndex, u16 usValue)
 {
 	assert (uchIndex <= 31);
@@ -0,0 +1,667 @@
+//
+// usbattachedscsi.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/usb/usbattachedscsi.h>
+#include <circle/usb/usbhostcontroller.h>
+#include <circle/usb/usbdevice.h>
+#include <circle/koptions.h>
+#include <circle/logger.h>
+#include <circle/util.h>
+#include <circle/synchronize.h>
+#include <circle/macros.h>
+#include <circle/new.h>
+#include <assert.h>
+
+#define MAX_TRIES	8				// max. read / write attempts
+
+// USB Attached SCSI (UAS-2)
+
+#define UAS_PROTOCOL			0x62
+
+#define DESCRIPTOR_PIPE_USAGE		0x24
+
+struct TUSBPipeUsageDescriptor
+{
+	u8	bLength;
+	u8	bDescriptorType;
+	u8	bPipeID;
+#define UAS_PIPE_ID_COMMAND		1
+#define UAS_PIPE_ID_STATUS		2
+#define UAS_PIPE_ID_DATA_IN		3
+#define UAS_PIPE_ID_DATA_OUT		4
+	u8	Reserved;
+}
+PACKED;
+
+// Information Units
+
+struct TUASIUHeader
+{
+	u8	IUID;
+#define UAS_IU_COMMAND			0x01
+#define UAS_IU_SENSE			0x03
+#define UAS_IU_RESPONSE			0x04
+#define UAS_IU_TASK_MANAGEMENT		0x05
+#define UAS_IU_READ_READY		0x06
+#define UAS_IU_WRITE_READY		0x07
+	u8	Reserved;
+	u16	Tag;					// big endian
+}
+PACKED;
+
+struct TUASCommandIU
+{
+	TUASIUHeader	Header;
+	u8		TaskAttribute;
+#define UAS_TASK_ATTR_SIMPLE		0x00
+	u8		Reserved1;
+	u8		AdditionalCDBLength;		// in dwords (bits 7:2), 0 for 16 bytes CDB
+	u8		Reserved2;
+	u8		LUN[8];
+	u8		CDB[16];
+}
+PACKED;
+
+struct TUASSenseIU
+{
+	TUASIUHeader	Header;
+	u16		StatusQualifier;		// big endian
+	u8		Status;
+#define SCSI_STATUS_GOOD		0x00
+	u8		Reserved[7];
+	u16		SenseLength;			// big endian
+	u8		SenseData[0];
+}
+PACKED;
+
+struct TUASTaskManagementIU
+{
+	TUASIUHeader	Header;
+	u8		Function;
+#define UAS_TMF_LOGICAL_UNIT_RESET	0x08
+	u8		Reserved1;
+	u16		TaskTag;			// big endian
+	u8		LUN[8];
+}
+PACKED;
+
+struct TUASResponseIU
+{
+	TUASIUHeader	Header;
+	u8		AdditionalResponseInfo[3];
+	u8		ResponseCode;
+#define UAS_RC_TMF_COMPLETE		0x00
+#define UAS_RC_TMF_SUCCEEDED		0x08
+}
+PACKED;
+
+#define UAS_TAG_TASK_MANAGEMENT		(UAS_MAX_COMMANDS + 1)
+
+#define UAS_IU_BUFFER_SIZE		512	// max. packet size of high-speed bulk endpoints
+
+struct CUSBAttachedSCSIDevice::TJob
+{
+	u8	*pBuffer;
+	size_t	 nLength;
+	boolean	 bIn;
+
+	boolean	 bBlockIO;			// READ/WRITE in chunks, starting at ullOffset
+	u64	 ullOffset;
+
+	const void *pCmdBlk;			// single command, if !bBlockIO
+	unsigned nCmdBlkLen;
+};
+
+static const char FromUAS[] = "uas";
+
+CUSBAttachedSCSIDevice::CUSBAttachedSCSIDevice (CUSBFunction *pFunction)
+:	CUSBBulkOnlyMassStorageDevice (pFunction),
+	m_bInterfaceOK (SelectInterfaceByClass (8, 6, UAS_PROTOCOL, PipeUnknown))
+{
+	for (unsigned i = 0; i < PipeUnknown; i++)
+	{
+		m_pEndpoint[i] = 0;
+	}
+
+	memset (m_Command, 0, sizeof m_Command);
+}
+
+CUSBAttachedSCSIDevice::~CUSBAttachedSCSIDevice (void)
+{
+	for (unsigned i = 0; i < PipeUnknown; i++)
+	{
+		delete m_pEndpoint[i];
+		m_pEndpoint[i] = 0;
+	}
+}
+
+int CUSBAttachedSCSIDevice::Read (void *pBuffer, size_t nCount)
+{
+	return Transfer (pBuffer, nCount, TRUE);
+}
+
+int CUSBAttachedSCSIDevice::Write (const void *pBuffer, size_t nCount)
+{
+	return Transfer ((void *) pBuffer, nCount, FALSE);
+}
+
+boolean CUSBAttachedSCSIDevice::IsSupported (CUSBFunction *pFunction)
+{
+	assert (pFunction != 0);
+
+	// UAS requires bulk streams on SuperSpeed, which are not supported
+	CUSBDevice *pDevice = pFunction->GetDevice ();
+	assert (pDevice != 0);
+	if (pDevice->GetSpeed () != USBSpeedHigh)
+	{
+		return FALSE;
+	}
+
+	const char *pUSBIgnore = CKernelOptions::Get ()->GetUSBIgnore ();
+	assert (pUSBIgnore != 0);
+	if (strcmp (pUSBIgnore, "int8-6-62") == 0)
+	{
+		return FALSE;
+	}
+
+	// search the alternate settings of the interface on an own configuration parser
+	CUSBFunction Function (pFunction);
+	u8 uchInterfaceNumber = Function.GetInterfaceNumber ();
+
+	const TUSBInterfaceDescriptor *pInterfaceDesc;
+	while (   (pInterfaceDesc = (const TUSBInterfaceDescriptor *)
+					Function.GetDescriptor (DESCRIPTOR_INTERFACE)) != 0
+	       && pInterfaceDesc->bInterfaceNumber == uchInterfaceNumber)
+	{
+		if (   pInterfaceDesc->bInterfaceClass    == 8
+		    && pInterfaceDesc->bInterfaceSubClass == 6
+		    && pInterfaceDesc->bInterfaceProtocol == UAS_PROTOCOL
+		    && pInterfaceDesc->bNumEndpoints      >= PipeUnknown)
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+boolean CUSBAttachedSCSIDevice::ConfigureEndpoints (void)
+{
+	if (!m_bInterfaceOK)
+	{
+		ConfigurationError (FromUAS);
+
+		return FALSE;
+	}
+
+	const TUSBEndpointDescriptor *pEndpointDesc;
+	while ((pEndpointDesc = (TUSBEndpointDescriptor *) GetDescriptor (DESCRIPTOR_ENDPOINT)) != 0)
+	{
+		// each endpoint descriptor is followed by a pipe usage descriptor
+		const TUSBPipeUsageDescriptor *pPipeUsageDesc =
+			(TUSBPipeUsageDescriptor *) GetDescriptor (DESCRIPTOR_PIPE_USAGE);
+		if (   pPipeUsageDesc == 0
+		    || (pEndpointDesc->bmAttributes & 0x3F) != 0x02)		// Bulk
+		{
+			ConfigurationError (FromUAS);
+
+			return FALSE;
+		}
+
+		unsigned nPipe;
+		switch (pPipeUsageDesc->bPipeID)
+		{
+		case UAS_PIPE_ID_COMMAND:	nPipe = PipeCommand;	break;
+		case UAS_PIPE_ID_STATUS:	nPipe = PipeStatus;	break;
+		case UAS_PIPE_ID_DATA_IN:	nPipe = PipeDataIn;	break;
+		case UAS_PIPE_ID_DATA_OUT:	nPipe = PipeDataOut;	break;
+
+		default:
+			ConfigurationError (FromUAS);
+			return FALSE;
+		}
+
+		boolean bIn = (pEndpointDesc->bEndpointAddress & 0x80) == 0x80;
+		if (   m_pEndpoint[nPipe] != 0
+		    || bIn != (nPipe == PipeStatus || nPipe == PipeDataIn))
+		{
+			ConfigurationError (FromUAS);
+
+			return FALSE;
+		}
+
+		m_pEndpoint[nPipe] = new CUSBEndpoint (GetDevice (), pEndpointDesc);
+		assert (m_pEndpoint[nPipe] != 0);
+	}
+
+	for (unsigned i = 0; i < PipeUnknown; i++)
+	{
+		if (m_pEndpoint[i] == 0)
+		{
+			ConfigurationError (FromUAS);
+
+			return FALSE;
+		}
+	}
+
+	CLogger::Get ()->Write (FromUAS, LogNotice, "Using USB Attached SCSI");
+
+	return TRUE;
+}
+
+int CUSBAttachedSCSIDevice::Command (void *pCmdBlk, size_t nCmdBlkLen,
+				     void *pBuffer, size_t nBufLen, boolean bIn)
+{
+	assert (pCmdBlk != 0);
+	assert (6 <= nCmdBlkLen && nCmdBlkLen <= 16);
+	assert (nBufLen == 0 || pBuffer != 0);
+
+	TJob Job;
+	Job.pBuffer = (u8 *) pBuffer;
+	Job.nLength = nBufLen;
+	Job.bIn = bIn;
+	Job.bBlockIO = FALSE;
+	Job.ullOffset = 0;
+	Job.pCmdBlk = pCmdBlk;
+	Job.nCmdBlkLen = nCmdBlkLen;
+
+	return Execute (&Job);
+}
+
+int CUSBAttachedSCSIDevice::Reset (void)
+{
+	AbortCommands ();
+
+	for (unsigned i = 0; i < PipeUnknown; i++)
+	{
+		assert (m_pEndpoint[i] != 0);
+		if (!ClearHalt (m_pEndpoint[i]))
+		{
+			CLogger::Get ()->Write (FromUAS, LogDebug, "Cannot clear halt on pipe %u", i);
+
+			return -1;
+		}
+	}
+
+	CUSBHostController *pHost = GetHost ();
+	assert (pHost != 0);
+
+	DMA_BUFFER (u8, TMBuffer, sizeof (TUASTaskManagementIU));
+	TUASTaskManagementIU *pTMIU = (TUASTaskManagementIU *) TMBuffer;
+	memset (pTMIU, 0, sizeof *pTMIU);
+
+	pTMIU->Header.IUID = UAS_IU_TASK_MANAGEMENT;
+	pTMIU->Header.Tag = le2be16 (UAS_TAG_TASK_MANAGEMENT);
+	pTMIU->Function = UAS_TMF_LOGICAL_UNIT_RESET;
+
+	if (pHost->Transfer (m_pEndpoint[PipeCommand], pTMIU, sizeof *pTMIU) < 0)
+	{
+		CLogger::Get ()->Write (FromUAS, LogDebug, "Cannot send task management IU");
+
+		return -1;
+	}
+
+	// IUs of aborted commands may be received before the response
+	DMA_BUFFER (u8, IUBuffer, UAS_IU_BUFFER_SIZE);
+	for (unsigned nTries = UAS_MAX_COMMANDS * 3 + 1; nTries > 0; nTries--)
+	{
+		int nLength = pHost->Transfer (m_pEndpoint[PipeStatus], IUBuffer, UAS_IU_BUFFER_SIZE);
+		if (nLength < (int) sizeof (TUASIUHeader))
+		{
+			break;
+		}
+
+		TUASResponseIU *pResponseIU = (TUASResponseIU *) IUBuffer;
+		if (   pResponseIU->Header.IUID == UAS_IU_RESPONSE
+		    && le2be16 (pResponseIU->Header.Tag) == UAS_TAG_TASK_MANAGEMENT
+		    && nLength >= (int) sizeof (TUASResponseIU))
+		{
+			if (   pResponseIU->ResponseCode != UAS_RC_TMF_COMPLETE
+			    && pResponseIU->ResponseCode != UAS_RC_TMF_SUCCEEDED)
+			{
+				CLogger::Get ()->Write (FromUAS, LogDebug, "Logical unit reset failed (%u)",
+							(unsigned) pResponseIU->ResponseCode);
+
+				return -1;
+			}
+
+			return 0;
+		}
+	}
+
+	CLogger::Get ()->Write (FromUAS, LogDebug, "No response to logical unit reset");
+
+	return -1;
+}
+
+int CUSBAttachedSCSIDevice::Transfer (void *pBuffer, size_t nCount, boolean bIn)
+{
+	assert (pBuffer != 0);
+
+	TJob Job;
+	Job.pBuffer = (u8 *) pBuffer;
+	Job.nLength = nCount;
+	Job.bIn = bIn;
+	Job.bBlockIO = TRUE;
+	Job.ullOffset = GetOffset ();
+	Job.pCmdBlk = 0;
+	Job.nCmdBlkLen = 0;
+
+	unsigned nTries = MAX_TRIES;
+
+	int nResult;
+
+	do
+	{
+		nResult = Execute (&Job);
+
+		if (nResult != (int) nCount)
+		{
+			CLogger::Get ()->Write (FromUAS, LogError, "%s failed", bIn ? "Read" : "Write");
+
+			int nStatus = Reset ();
+			if (nStatus != 0)
+			{
+				return nStatus;
+			}
+		}
+	}
+	while (   nResult != (int) nCount
+	       && --nTries > 0);
+
+	return nResult;
+}
+
+int CUSBAttachedSCSIDevice::Execute (TJob *pJob)
+{
+	assert (pJob != 0);
+
+	unsigned nChunks = 1;
+	if (pJob->bBlockIO)
+	{
+		if (   pJob->nLength == 0
+		    || (pJob->nLength & UMSD_BLOCK_MASK) != 0)
+		{
+			return -1;
+		}
+
+		nChunks = (pJob->nLength + UAS_CHUNK_SIZE-1) / UAS_CHUNK_SIZE;
+	}
+
+	CUSBHostController *pHost = GetHost ();
+	assert (pHost != 0);
+
+	DMA_BUFFER (u8, IUBuffer, UAS_IU_BUFFER_SIZE);
+
+	unsigned nNextChunk = 0;
+	unsigned nCompleted = 0;
+	boolean bFailed = FALSE;		// a command completed with an error status
+	int nResult = 0;
+
+	while (nCompleted < nNextChunk || (nNextChunk < nChunks && !bFailed))
+	{
+		// queue commands for the following chunks on all free tags
+		for (unsigned nTag = 1; nTag <= UAS_MAX_COMMANDS; nTag++)
+		{
+			if (   nNextChunk >= nChunks
+			    || bFailed)
+			{
+				break;
+			}
+
+			TCommand *pCommand = &m_Command[nTag];
+			if (pCommand->bActive)
+			{
+				continue;
+			}
+
+			u8 CmdBlk[16];
+			const void *pCmdBlk = pJob->pCmdBlk;
+			unsigned nCmdBlkLen = pJob->nCmdBlkLen;
+
+			size_t nOffset = (size_t) nNextChunk * UAS_CHUNK_SIZE;
+			size_t nLength = pJob->nLength;
+			if (pJob->bBlockIO)
+			{
+				nLength -= nOffset;
+				if (nLength > UAS_CHUNK_SIZE)
+				{
+					nLength = UAS_CHUNK_SIZE;
+				}
+
+				nCmdBlkLen = SetupReadWriteCommand (CmdBlk, pJob->ullOffset + nOffset,
+								    nLength, !pJob->bIn);
+				if (nCmdBlkLen == 0)
+				{
+					AbortCommands ();
+
+					return -1;
+				}
+
+				pCmdBlk = CmdBlk;
+			}
+
+			pCommand->bIn = pJob->bIn;
+			pCommand->bDataDone = FALSE;
+			pCommand->pBuffer = pJob->pBuffer + nOffset;
+			pCommand->nLength = nLength;
+
+			if (!SendCommandIU (nTag, pCmdBlk, nCmdBlkLen))
+			{
+				AbortCommands ();
+
+				return -1;
+			}
+
+			pCommand->bActive = TRUE;
+			nNextChunk++;
+		}
+
+		// process the next IU from the status pipe
+		int nLength = pHost->Transfer (m_pEndpoint[PipeStatus], IUBuffer, UAS_IU_BUFFER_SIZE);
+		if (nLength < (int) sizeof (TUASIUHeader))
+		{
+			CLogger::Get ()->Write (FromUAS, LogError, "Status transfer failed");
+
+			AbortCommands ();
+
+			return -1;
+		}
+
+		TUASIUHeader *pHeader = (TUASIUHeader *) IUBuffer;
+		unsigned nTag = le2be16 (pHeader->Tag);
+		if (   nTag == 0
+		    || nTag > UAS_MAX_COMMANDS
+		    || !m_Command[nTag].bActive)
+		{
+			CLogger::Get ()->Write (FromUAS, LogError, "Invalid tag received (%u)", nTag);
+
+			AbortCommands ();
+
+			return -1;
+		}
+
+		TCommand *pCommand = &m_Command[nTag];
+
+		switch (pHeader->IUID)
+		{
+		case UAS_IU_READ_READY:
+		case UAS_IU_WRITE_READY:
+			if (   (pHeader->IUID == UAS_IU_READ_READY) != pCommand->bIn
+			    || pCommand->bDataDone
+			    || !DataTransfer (nTag))
+			{
+				CLogger::Get ()->Write (FromUAS, LogError, "Data transfer failed");
+
+				AbortCommands ();
+
+				return -1;
+			}
+			break;
+
+		case UAS_IU_SENSE: {
+			if (nLength < (int) sizeof (TUASSenseIU))
+			{
+				AbortCommands ();
+
+				return -1;
+			}
+
+			TUASSenseIU *pSenseIU = (TUASSenseIU *) IUBuffer;
+			if (   pSenseIU->Status != SCSI_STATUS_GOOD
+			    || (pCommand->nLength > 0 && !pCommand->bDataDone))
+			{
+				bFailed = TRUE;
+			}
+			else
+			{
+				nResult += pCommand->nLength;
+			}
+
+			pCommand->bActive = FALSE;
+			nCompleted++;
+			} break;
+
+		default:
+			CLogger::Get ()->Write (FromUAS, LogError, "Unexpected IU received (0x%02X)",
+						(unsigned) pHeader->IUID);
+
+			AbortCommands ();
+
+			return -1;
+		}
+	}
+
+	if (bFailed)
+	{
+		return -1;
+	}
+
+	return nResult;
+}
+
+boolean CUSBAttachedSCSIDevice::SendCommandIU (unsigned nTag, const void *pCmdBlk,
+					       unsigned nCmdBlkLen)
+{
+	assert (pCmdBlk != 0);
+	assert (nCmdBlkLen <= 16);
+
+	DMA_BUFFER (u8, IUBuffer, sizeof (TUASCommandIU));
+	TUASCommandIU *pCommandIU = (TUASCommandIU *) IUBuffer;
+	memset (pCommandIU, 0, sizeof *pCommandIU);
+
+	pCommandIU->Header.IUID = UAS_IU_COMMAND;
+	pCommandIU->Header.Tag = le2be16 (nTag);
+	pCommandIU->TaskAttribute = UAS_TASK_ATTR_SIMPLE;
+	memcpy (pCommandIU->CDB, pCmdBlk, nCmdBlkLen);
+
+	CUSBHostController *pHost = GetHost ();
+	assert (pHost != 0);
+
+	if (pHost->Transfer (m_pEndpoint[PipeCommand], pCommandIU, sizeof *pCommandIU) < 0)
+	{
+		CLogger::Get ()->Write (FromUAS, LogError, "Command IU transfer failed");
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+boolean CUSBAttachedSCSIDevice::DataTransfer (unsigned nTag)
+{
+	assert (1 <= nTag && nTag <= UAS_MAX_COMMANDS);
+	TCommand *pCommand = &m_Command[nTag];
+	assert (pCommand->bActive);
+
+	size_t nLength = pCommand->nLength;
+	if (nLength == 0)
+	{
+		return FALSE;
+	}
+
+	u8 *pBuffer = pCommand->pBuffer;
+	assert (pBuffer != 0);
+
+	u8 *pDMABuffer = 0;
+	if (!IS_CACHE_ALIGNED (pBuffer, nLength))
+	{
+		pDMABuffer = new (HEAP_DMA30) u8[nLength];
+		assert (pDMABuffer != 0);
+
+		if (!pCommand->bIn)
+		{
+			memcpy (pDMABuffer, pBuffer, nLength);
+		}
+	}
+
+	CUSBHostController *pHost = GetHost ();
+	assert (pHost != 0);
+
+	int nResult = pHost->Transfer (m_pEndpoint[pCommand->bIn ? PipeDataIn : PipeDataOut],
+				       pDMABuffer != 0 ? pDMABuffer : pBuffer, nLength);
+
+	if (pDMABuffer != 0)
+	{
+		if (   pCommand->bIn
+		    && nResult > 0)
+		{
+			memcpy (pBuffer, pDMABuffer, nResult);
+		}
+
+		delete [] pDMABuffer;
+	}
+
+	if (nResult != (int) nLength)
+	{
+		return FALSE;
+	}
+
+	pCommand->bDataDone = TRUE;
+
+	return TRUE;
+}
+
+void CUSBAttachedSCSIDevice::AbortCommands (void)
+{
+	for (unsigned nTag = 1; nTag <= UAS_MAX_COMMANDS; nTag++)
+	{
+		m_Command[nTag].bActive = FALSE;
+	}
+}
+
+boolean CUSBAttachedSCSIDevice::ClearHalt (CUSBEndpoint *pEndpoint)
+{
+	assert (pEndpoint != 0);
+
+	CUSBHostController *pHost = GetHost ();
+	assert (pHost != 0);
+
+	if (pHost->ControlMessage (GetEndpoint0 (),
+				   REQUEST_TO_ENDPOINT | REQUEST_OUT, CLEAR_FEATURE, ENDPOINT_HALT,
+				   pEndpoint->GetNumber () | (pEndpoint->IsDirectionIn () ? 0x80 : 0),
+				   0, 0) < 0)
+	{
+		return FALSE;
+	}
+
+	pEndpoint->ResetPID ();
+
+	return TRUE;
+}
@@ -0,0 +1,132 @@
+//
+// usbbufferpool.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/usb/usbbufferpool.h>
+#include <circle/synchronize.h>
+#include <circle/new.h>
+#include <assert.h>
+
+CUSBBufferPool::CUSBBufferPool (size_t nBufferSize, unsigned nBuffers)
+:	m_nBufferSize (  (nBufferSize + DATA_CACHE_LINE_LENGTH_MAX-1)
+		       & ~(DATA_CACHE_LINE_LENGTH_MAX-1)),
+	m_nBuffers (nBuffers),
+	m_pMemory (0),
+	m_pFreeStack (0),
+	m_nFree (0),
+	m_nAllocations (0),
+	m_nFailures (0)
+{
+	assert (m_nBufferSize > 0);
+	assert (m_nBuffers > 0);
+
+	// the heap returns cache-line aligned blocks
+	m_pMemory = new (HEAP_DMA30) u8[m_nBufferSize * m_nBuffers];
+	m_pFreeStack = new unsigned[m_nBuffers];
+	if (   !m_pMemory
+	    || !m_pFreeStack)
+	{
+		return;
+	}
+
+	assert (IS_CACHE_ALIGNED (m_pMemory, m_nBufferSize));
+
+	for (unsigned i = 0; i < m_nBuffers; i++)
+	{
+		m_pFreeStack[i] = m_nBuffers-1 - i;
+	}
+
+	m_nFree = m_nBuffers;
+}
+
+CUSBBufferPool::~CUSBBufferPool (void)
+{
+	assert (m_nFree == m_nBuffers);
+
+	delete [] m_pFreeStack;
+	m_pFreeStack = 0;
+
+	delete [] m_pMemory;
+	m_pMemory = 0;
+}
+
+boolean CUSBBufferPool::IsValid (void) const
+{
+	return m_pMemory != 0 && m_pFreeStack != 0;
+}
+
+size_t CUSBBufferPool::GetBufferSize (void) const
+{
+	return m_nBufferSize;
+}
+
+void *CUSBBufferPool::Allocate (void)
+{
+	m_SpinLock.Acquire ();
+
+	if (m_nFree == 0)
+	{
+		m_nFailures++;
+
+		m_SpinLock.Release ();
+
+		return 0;
+	}
+
+	unsigned nIndex = m_pFreeStack[--m_nFree];
+	assert (nIndex < m_nBuffers);
+
+	m_nAllocations++;
+
+	m_SpinLock.Release ();
+
+	return m_pMemory + nIndex * m_nBufferSize;
+}
+
+void CUSBBufferPool::Free (void *pBuffer)
+{
+	assert (pBuffer != 0);
+	assert (m_pMemory != 0);
+
+	uintptr nOffset = (uintptr) pBuffer - (uintptr) m_pMemory;
+	assert (nOffset % m_nBufferSize == 0);
+	unsigned nIndex = nOffset / m_nBufferSize;
+	assert (nIndex < m_nBuffers);
+
+	m_SpinLock.Acquire ();
+
+	assert (m_nFree < m_nBuffers);
+	m_pFreeStack[m_nFree++] = nIndex;
+
+	m_SpinLock.Release ();
+}
+
+boolean CUSBBufferPool::IsDMASafe (const void *pBuffer, size_t nLength)
+{
+	return pBuffer != 0 && IS_CACHE_ALIGNED (pBuffer, nLength);
+}
+
+unsigned CUSBBufferPool::GetAllocations (void) const
+{
+	return m_nAllocations;
+}
+
+unsigned CUSBBufferPool::GetFailures (void) const
+{
+	return m_nFailures;
+}
@@ -2,7 +2,7 @@
 // usbcdcethernet.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2017-2024  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2017-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -21,10 +21,16 @@
 #include <circle/usb/usbhostcontroller.h>
 #include <circle/usb/usbstring.h>
 #include <circle/usb/usb.h>
+#include <circle/synchronize.h>
 #include <circle/logger.h>
+#include <circle/timer.h>
+#include <circle/util.h>
 #include <circle/macros.h>
 #include <assert.h>
 
+// NCM: Maximum NTB size, which will be used in each direction (NTB16 only)
+#define NCM_MAX_NTB_SIZE	16384
+
 struct TEthernetNetworkingFunctionalDescriptor
 {
 	u8	bLength;
@@ -43,15 +49,29 @@ static const char FromCDCEthernet[] = "ucdceth";
 
 CUSBCDCEthernetDevice::CUSBCDCEthernetDevice (CUSBFunction *pFunction)
 :	CUSBFunction (pFunction),
+	m_bNCM (GetInterfaceSubClass () == 13),
+	m_uchControlInterface (GetInterfaceNumber ()),
 	m_iMACAddress (GetMACAddressStringIndex ()),
-	m_bInterfaceOK (SelectInterfaceByClass (10, 0, 0, 2)),
+	m_bInterfaceOK (SelectInterfaceByClass (10, 0, m_bNCM ? 1 : 0, 2)),
 	m_pEndpointBulkIn (0),
-	m_pEndpointBulkOut (0)
+	m_pEndpointBulkOut (0),
+	m_nNTBInSize (0),
+	m_nNTBOutSize (0),
+	m_pRxNTB (0),
+	m_pTxNTB (0),
+	m_nAggregationTimeout (0),
+	m_nFirstFrameTicks (0)
 {
 }
 
 CUSBCDCEthernetDevice::~CUSBCDCEthernetDevice (void)
 {
+	delete [] m_pTxNTB;
+	m_pTxNTB = 0;
+
+	delete [] m_pRxNTB;
+	m_pRxNTB = 0;
+
 	delete m_pEndpointBulkOut;
 	m_pEndpointBulkOut = 0;
 
@@ -120,6 +140,15 @@ boolean CUSBCDCEthernetDevice::Configure (void)
 		return FALSE;
 	}
 
+	// must be done, before the alternate setting of the data interface is selected
+	if (   m_bNCM
+	    && !InitNCM ())
+	{
+		CLogger::Get ()->Write (FromCDCEthernet, LogError, "Cannot init NCM");
+
+		return FALSE;
+	}
+
 	if (!CUSBFunction::Configure ())
 	{
 		CLogger::Get ()->Write (FromCDCEthernet, LogError, "Cannot set interface");
@@ -139,16 +168,61 @@ const CMACAddress *CUSBCDCEthernetDevice::GetMACAddress (void) const
 
 boolean CUSBCDCEthernetDevice::SendFrame (const void *pBuffer, unsigned nLength)
 {
-	assert (m_pEndpointBulkOut != 0);
 	assert (pBuffer != 0);
 	assert (nLength <= FRAME_BUFFER_SIZE);
+
+	if (m_bNCM)
+	{
+		if (m_NTBWriter.IsEmpty ())
+		{
+			m_nFirstFrameTicks = CTimer::GetClockTicks ();
+		}
+
+		if (m_NTBWriter.AddDatagram (pBuffer, nLength))
+		{
+			return TRUE;
+		}
+
+		// NTB is full
+		if (!SendNTB ())
+		{
+			return FALSE;
+		}
+
+		m_nFirstFrameTicks = CTimer::GetClockTicks ();
+
+		return m_NTBWriter.AddDatagram (pBuffer, nLength);
+	}
+
+	assert (m_pEndpointBulkOut != 0);
 	return GetHost ()->Transfer (m_pEndpointBulkOut, (void *) pBuffer, nLength) >= 0;
 }
 
 boolean CUSBCDCEthernetDevice::ReceiveFrame (void *pBuffer, unsigned *pResultLength)
 {
-	assert (m_pEndpointBulkIn != 0);
 	assert (pBuffer != 0);
+	assert (pResultLength != 0);
+
+	if (m_bNCM)
+	{
+		if (   !m_NTBWriter.IsEmpty ()
+		    && CTimer::GetClockTicks () - m_nFirstFrameTicks >= m_nAggregationTimeout)
+		{
+			SendNTB ();
+		}
+
+		while (!m_NTBReader.GetDatagram (pBuffer, pResultLength, FRAME_BUFFER_SIZE))
+		{
+			if (!ReceiveNTB ())
+			{
+				return FALSE;
+			}
+		}
+
+		return TRUE;
+	}
+
+	assert (m_pEndpointBulkIn != 0);
 	CUSBRequest URB (m_pEndpointBulkIn, pBuffer, FRAME_BUFFER_SIZE);
 
 	URB.SetCompleteOnNAK ();
@@ -164,12 +238,16 @@ boolean CUSBCDCEthernetDevice::ReceiveFrame (void *pBuffer, unsigned *pResultLen
 		return FALSE;
 	}
 
-	assert (pResultLength != 0);
 	*pResultLength = nResultLength;
 
 	return TRUE;
 }
 
+void CUSBCDCEthernetDevice::SetAggregationTimeout (unsigned nMicroSeconds)
+{
+	m_nAggregationTimeout = nMicroSeconds;
+}
+
 u8 CUSBCDCEthernetDevice::GetMACAddressStringIndex (void)
 {
 	// find Ethernet Networking Functional Descriptor
@@ -228,3 +306,125 @@ boolean CUSBCDCEthernetDevice::InitMACAddress (u8 iMACAddress)
 
 	return TRUE;
 }
+
+boolean CUSBCDCEthernetDevice::InitNCM (void)
+{
+	DMA_BUFFER (u8, Buffer, sizeof (TNCMNTBParameters));
+	if (GetHost ()->ControlMessage (GetEndpoint0 (),
+					REQUEST_IN | REQUEST_CLASS | REQUEST_TO_INTERFACE,
+					NCM_GET_NTB_PARAMETERS, 0, m_uchControlInterface,
+					Buffer, sizeof (TNCMNTBParameters))
+	    != (int) sizeof (TNCMNTBParameters))
+	{
+		return FALSE;
+	}
+
+	TNCMNTBParameters Params;
+	memcpy (&Params, Buffer, sizeof Params);
+
+	if (!(Params.bmNtbFormatsSupported & NCM_NTB16_SUPPORTED))
+	{
+		return FALSE;
+	}
+
+	m_nNTBInSize = Params.dwNtbInMaxSize;
+	if (m_nNTBInSize > NCM_MAX_NTB_SIZE)
+	{
+		m_nNTBInSize = NCM_MAX_NTB_SIZE;
+	}
+
+	m_nNTBOutSize = Params.dwNtbOutMaxSize;
+	if (m_nNTBOutSize > NCM_MAX_NTB_SIZE)
+	{
+		m_nNTBOutSize = NCM_MAX_NTB_SIZE;
+	}
+
+	if (   m_nNTBInSize < FRAME_BUFFER_SIZE
+	    || m_nNTBOutSize < FRAME_BUFFER_SIZE)
+	{
+		return FALSE;
+	}
+
+	if (m_nNTBInSize != Params.dwNtbInMaxSize)
+	{
+		// The 8-byte form (with wNtbInMaxDatagrams) is required, if announced in the
+		// NCM functional descriptor, which is not evaluated here. Try both forms.
+		DMA_BUFFER (u32, InputSize, 2);
+		InputSize[0] = m_nNTBInSize;
+		InputSize[1] = 0;			// no limit for datagrams
+		if (   GetHost ()->ControlMessage (GetEndpoint0 (),
+						   REQUEST_OUT | REQUEST_CLASS | REQUEST_TO_INTERFACE,
+						   NCM_SET_NTB_INPUT_SIZE, 0, m_uchControlInterface,
+						   InputSize, 4) < 0
+		    && GetHost ()->ControlMessage (GetEndpoint0 (),
+						   REQUEST_OUT | REQUEST_CLASS | REQUEST_TO_INTERFACE,
+						   NCM_SET_NTB_INPUT_SIZE, 0, m_uchControlInterface,
+						   InputSize, 8) < 0)
+		{
+			return FALSE;
+		}
+	}
+
+	m_pRxNTB = new u8[m_nNTBInSize];
+	m_pTxNTB = new u8[m_nNTBOutSize];
+	assert (m_pRxNTB != 0);
+	assert (m_pTxNTB != 0);
+
+	m_NTBWriter.Setup (m_pTxNTB, m_nNTBOutSize, FALSE,
+			   Params.wNdpOutDivisor, Params.wNdpOutPayloadRemainder,
+			   Params.wNdpOutAlignment, Params.wNtbOutMaxDatagrams);
+
+	CLogger::Get ()->Write (FromCDCEthernet, LogDebug, "NCM (NTB16, in %u, out %u bytes)",
+				m_nNTBInSize, m_nNTBOutSize);
+
+	return TRUE;
+}
+
+boolean CUSBCDCEthernetDevice::SendNTB (void)
+{
+	unsigned nLength = m_NTBWriter.Finish ();
+	if (nLength == 0)
+	{
+		return TRUE;
+	}
+
+	// a short packet terminates the NTB, pad it instead of sending a zero-length packet
+	assert (m_pEndpointBulkOut != 0);
+	assert (m_pTxNTB != 0);
+	if (   nLength % m_pEndpointBulkOut->GetMaxPacketSize () == 0
+	    && nLength < m_nNTBOutSize)
+	{
+		m_pTxNTB[nLength++] = 0;
+	}
+
+	return GetHost ()->Transfer (m_pEndpointBulkOut, m_pTxNTB, nLength) >= 0;
+}
+
+boolean CUSBCDCEthernetDevice::ReceiveNTB (void)
+{
+	assert (m_pEndpointBulkIn != 0);
+	assert (m_pRxNTB != 0);
+	CUSBRequest URB (m_pEndpointBulkIn, m_pRxNTB, m_nNTBInSize);
+
+	URB.SetCompleteOnNAK ();
+
+	if (!GetHost ()->SubmitBlockingRequest (&URB))
+	{
+		return FALSE;
+	}
+
+	u32 nResultLength = URB.GetResultLength ();
+	if (nResultLength == 0)
+	{
+		return FALSE;
+	}
+
+	if (!m_NTBReader.SetBlock (m_pRxNTB, nResultLength))
+	{
+		CLogger::Get ()->Write (FromCDCEthernet, LogWarning, "Invalid NTB received");
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
@@ -0,0 +1,405 @@
+//
+// usbcdcncm.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include <circle/usb/usbcdcncm.h>
+#include <circle/util.h>
+#include <assert.h>
+
+CUSBCDCNCMReader::CUSBCDCNCMReader (void)
+:	m_pNTB (0),
+	m_nLength (0),
+	m_bNTB32 (FALSE),
+	m_nNDPIndex (0),
+	m_nNDPLength (0),
+	m_nNextNDPIndex (0),
+	m_nEntry (0)
+{
+}
+
+boolean CUSBCDCNCMReader::SetBlock (const void *pNTB, unsigned nLength)
+{
+	m_pNTB = (const u8 *) pNTB;
+	assert (m_pNTB != 0);
+
+	m_nLength = 0;
+	m_nNDPIndex = 0;
+
+	unsigned nBlockLength;
+	const TNCMTransferHeader16 *pNTH16 = (const TNCMTransferHeader16 *) m_pNTB;
+	const TNCMTransferHeader32 *pNTH32 = (const TNCMTransferHeader32 *) m_pNTB;
+	if (   nLength >= sizeof (TNCMTransferHeader16)
+	    && pNTH16->dwSignature == NCM_NTH16_SIGNATURE
+	    && pNTH16->wHeaderLength == sizeof (TNCMTransferHeader16))
+	{
+		m_bNTB32 = FALSE;
+		nBlockLength = pNTH16->wBlockLength;
+		m_nNextNDPIndex = pNTH16->wNdpIndex;
+	}
+	else if (   nLength >= sizeof (TNCMTransferHeader32)
+		 && pNTH32->dwSignature == NCM_NTH32_SIGNATURE
+		 && pNTH32->wHeaderLength == sizeof (TNCMTransferHeader32))
+	{
+		m_bNTB32 = TRUE;
+		nBlockLength = pNTH32->dwBlockLength;
+		m_nNextNDPIndex = pNTH32->dwNdpIndex;
+	}
+	else
+	{
+		return FALSE;
+	}
+
+	if (nBlockLength == 0)			// terminated by a short packet
+	{
+		nBlockLength = nLength;
+	}
+
+	if (nBlockLength > nLength)
+	{
+		return FALSE;
+	}
+
+	m_nLength = nBlockLength;
+
+	return TRUE;
+}
+
+boolean CUSBCDCNCMReader::GetDatagram (void *pBuffer, unsigned *pLength, unsigned nBufferSize)
+{
+	while (m_nLength != 0)
+	{
+		if (   m_nNDPIndex == 0
+		    && !NextNDP ())
+		{
+			m_nLength = 0;
+
+			break;
+		}
+
+		unsigned nIndex, nDatagramLength;
+		if (!m_bNTB32)
+		{
+			unsigned nEntry =   sizeof (TNCMDatagramPointer16)
+					  + m_nEntry * sizeof (TNCMDatagramEntry16);
+			if (nEntry + sizeof (TNCMDatagramEntry16) > m_nNDPLength)
+			{
+				m_nNDPIndex = 0;
+
+				continue;
+			}
+
+			const TNCMDatagramEntry16 *pEntry =
+				(const TNCMDatagramEntry16 *) (m_pNTB + m_nNDPIndex + nEntry);
+			nIndex = pEntry->wDatagramIndex;
+			nDatagramLength = pEntry->wDatagramLength;
+		}
+		else
+		{
+			unsigned nEntry =   sizeof (TNCMDatagramPointer32)
+					  + m_nEntry * sizeof (TNCMDatagramEntry32);
+			if (nEntry + sizeof (TNCMDatagramEntry32) > m_nNDPLength)
+			{
+				m_nNDPIndex = 0;
+
+				continue;
+			}
+
+			const TNCMDatagramEntry32 *pEntry =
+				(const TNCMDatagramEntry32 *) (m_pNTB + m_nNDPIndex + nEntry);
+			nIndex = pEntry->dwDatagramIndex;
+			nDatagramLength = pEntry->dwDatagramLength;
+		}
+
+		if (   nIndex == 0			// terminating entry
+		    || nDatagramLength == 0)
+		{
+			m_nNDPIndex = 0;
+
+			continue;
+		}
+
+		m_nEntry++;
+
+		if (   nIndex >= m_nLength
+		    || nDatagramLength > m_nLength - nIndex
+		    || nDatagramLength > nBufferSize)
+		{
+			continue;			// ignore invalid datagram
+		}
+
+		assert (pBuffer != 0);
+		memcpy (pBuffer, m_pNTB + nIndex, nDatagramLength);
+
+		assert (pLength != 0);
+		*pLength = nDatagramLength;
+
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+boolean CUSBCDCNCMReader::NextNDP (void)
+{
+	unsigned nIndex = m_nNextNDPIndex;
+	if (   nIndex == 0
+	    || nIndex >= m_nLength)
+	{
+		return FALSE;
+	}
+
+	if (!m_bNTB32)
+	{
+		if (sizeof (TNCMDatagramPointer16) > m_nLength - nIndex)
+		{
+			return FALSE;
+		}
+
+		const TNCMDatagramPointer16 *pNDP16 = (const TNCMDatagramPointer16 *) (m_pNTB + nIndex);
+		if (pNDP16->dwSignature != NCM_NDP16_SIGNATURE)
+		{
+			return FALSE;
+		}
+
+		m_nNDPLength = pNDP16->wLength;
+		m_nNextNDPIndex = pNDP16->wNextNdpIndex;
+	}
+	else
+	{
+		if (sizeof (TNCMDatagramPointer32) > m_nLength - nIndex)
+		{
+			return FALSE;
+		}
+
+		const TNCMDatagramPointer32 *pNDP32 = (const TNCMDatagramPointer32 *) (m_pNTB + nIndex);
+		if (pNDP32->dwSignature != NCM_NDP32_SIGNATURE)
+		{
+			return FALSE;
+		}
+
+		m_nNDPLength = pNDP32->wLength;
+		m_nNextNDPIndex = pNDP32->dwNextNdpIndex;
+	}
+
+	if (m_nNDPLength > m_nLength - nIndex)
+	{
+		return FALSE;
+	}
+
+	// NDPs may be in any order, but a loop has to be prevented
+	if (m_nNextNDPIndex <= nIndex)
+	{
+		m_nNextNDPIndex = 0;
+	}
+
+	m_nNDPIndex = nIndex;
+	m_nEntry = 0;
+
+	return TRUE;
+}
+
+CUSBCDCNCMWriter::CUSBCDCNCMWriter (void)
+:	m_pBuffer (0),
+	m_nSize (0),
+	m_bNTB32 (FALSE),
+	m_nDivisor (4),
+	m_nRemainder (0),
+	m_nAlignment (4),
+	m_nMaxDatagrams (MaxDatagrams),
+	m_usSequence (0),
+	m_nOffset (0),
+	m_nDatagrams (0)
+{
+}
+
+void CUSBCDCNCMWriter::Setup (void *pBuffer, unsigned nSize, boolean bNTB32,
+			      unsigned nDivisor, unsigned nRemainder, unsigned nAlignment,
+			      unsigned nMaxDatagrams)
+{
+	m_pBuffer = (u8 *) pBuffer;
+	assert (m_pBuffer != 0);
+	assert (((uintptr) m_pBuffer & 3) == 0);
+
+	m_bNTB32 = bNTB32;
+
+	m_nSize = nSize;
+	if (   !m_bNTB32
+	    && m_nSize > 0xFFFF)
+	{
+		m_nSize = 0xFFFF;
+	}
+
+	// the device may report invalid values, which are corrected here
+	if (   nDivisor == 0
+	    || (nDivisor & (nDivisor-1)) != 0)
+	{
+		nDivisor = 4;
+	}
+	m_nDivisor = nDivisor;
+	m_nRemainder = nRemainder % nDivisor;
+
+	if (   nAlignment < 4
+	    || (nAlignment & (nAlignment-1)) != 0)
+	{
+		nAlignment = 4;
+	}
+	m_nAlignment = nAlignment;
+
+	if (   nMaxDatagrams == 0
+	    || nMaxDatagrams > MaxDatagrams)
+	{
+		nMaxDatagrams = MaxDatagrams;
+	}
+	m_nMaxDatagrams = nMaxDatagrams;
+
+	m_nOffset = m_bNTB32 ? sizeof (TNCMTransferHeader32) : sizeof (TNCMTransferHeader16);
+	m_nDatagrams = 0;
+}
+
+boolean CUSBCDCNCMWriter::HasRoom (unsigned nLength) const
+{
+	assert (m_pBuffer != 0);
+
+	if (m_nDatagrams >= m_nMaxDatagrams)
+	{
+		return FALSE;
+	}
+
+	unsigned nIndex = AlignDatagram (m_nOffset);
+	unsigned nNDPOffset = (nIndex + nLength + m_nAlignment-1) & ~(m_nAlignment-1);
+
+	return nNDPOffset + GetNDPLength (m_nDatagrams+1) <= m_nSize;
+}
+
+boolean CUSBCDCNCMWriter::AddDatagram (const void *pData, unsigned nLength)
+{
+	if (!HasRoom (nLength))
+	{
+		return FALSE;
+	}
+
+	unsigned nIndex = AlignDatagram (m_nOffset);
+
+	memset (m_pBuffer + m_nOffset, 0, nIndex - m_nOffset);
+
+	assert (pData != 0);
+	memcpy (m_pBuffer + nIndex, pData, nLength);
+
+	m_DatagramIndex[m_nDatagrams] = nIndex;
+	m_DatagramLength[m_nDatagrams] = nLength;
+	m_nDatagrams++;
+
+	m_nOffset = nIndex + nLength;
+
+	return TRUE;
+}
+
+unsigned CUSBCDCNCMWriter::Finish (void)
+{
+	assert (m_pBuffer != 0);
+
+	if (m_nDatagrams == 0)
+	{
+		return 0;
+	}
+
+	// the NDP follows the datagrams, so that its size has not to be known in advance
+	unsigned nNDPOffset = GetNDPOffset ();
+	memset (m_pBuffer + m_nOffset, 0, nNDPOffset - m_nOffset);
+
+	unsigned nNDPLength = GetNDPLength (m_nDatagrams);
+	unsigned nLength = nNDPOffset + nNDPLength;
+	assert (nLength <= m_nSize);
+
+	if (!m_bNTB32)
+	{
+		TNCMDatagramPointer16 *pNDP16 = (TNCMDatagramPointer16 *) (m_pBuffer + nNDPOffset);
+		pNDP16->dwSignature = NCM_NDP16_SIGNATURE;
+		pNDP16->wLength = nNDPLength;
+		pNDP16->wNextNdpIndex = 0;
+
+		TNCMDatagramEntry16 *pEntry = (TNCMDatagramEntry16 *) (pNDP16 + 1);
+		for (unsigned i = 0; i < m_nDatagrams; i++, pEntry++)
+		{
+			pEntry->wDatagramIndex = m_DatagramIndex[i];
+			pEntry->wDatagramLength = m_DatagramLength[i];
+		}
+
+		pEntry->wDatagramIndex = 0;
+		pEntry->wDatagramLength = 0;
+
+		TNCMTransferHeader16 *pNTH16 = (TNCMTransferHeader16 *) m_pBuffer;
+		pNTH16->dwSignature = NCM_NTH16_SIGNATURE;
+		pNTH16->wHeaderLength = sizeof (TNCMTransferHeader16);
+		pNTH16->wSequence = m_usSequence++;
+		pNTH16->wBlockLength = nLength;
+		pNTH16->wNdpIndex = nNDPOffset;
+	}
+	else
+	{
+		TNCMDatagramPointer32 *pNDP32 = (TNCMDatagramPointer32 *) (m_pBuffer + nNDPOffset);
+		pNDP32->dwSignature = NCM_NDP32_SIGNATURE;
+		pNDP32->wLength = nNDPLength;
+		pNDP32->wReserved6 = 0;
+		pNDP32->dwNextNdpIndex = 0;
+		pNDP32->dwReserved12 = 0;
+
+		TNCMDatagramEntry32 *pEntry = (TNCMDatagramEntry32 *) (pNDP32 + 1);
+		for (unsigned i = 0; i < m_nDatagrams; i++, pEntry++)
+		{
+			pEntry->dwDatagramIndex = m_DatagramIndex[i];
+			pEntry->dwDatagramLength = m_DatagramLength[i];
+		}
+
+		pEntry->dwDatagramIndex = 0;
+		pEntry->dwDatagramLength = 0;
+
+		TNCMTransferHeader32 *pNTH32 = (TNCMTransferHeader32 *) m_pBuffer;
+		pNTH32->dwSignature = NCM_NTH32_SIGNATURE;
+		pNTH32->wHeaderLength = sizeof (TNCMTransferHeader32);
+		pNTH32->wSequence = m_usSequence++;
+		pNTH32->dwBlockLength = nLength;
+		pNTH32->dwNdpIndex = nNDPOffset;
+	}
+
+	m_nOffset = m_bNTB32 ? sizeof (TNCMTransferHeader32) : sizeof (TNCMTransferHeader16);
+	m_nDatagrams = 0;
+
+	return nLength;
+}
+
+unsigned CUSBCDCNCMWriter::AlignDatagram (unsigned nOffset) const
+{
+	return nOffset + (m_nDivisor + m_nRemainder - nOffset % m_nDivisor) % m_nDivisor;
+}
+
+unsigned CUSBCDCNCMWriter::GetNDPOffset (void) const
+{
+	return (m_nOffset + m_nAlignment-1) & ~(m_nAlignment-1);
+}
+
+unsigned CUSBCDCNCMWriter::GetNDPLength (unsigned nDatagrams) const
+{
+	// including the terminating entry
+	if (!m_bNTB32)
+	{
+		return sizeof (TNCMDatagramPointer16) + (nDatagrams+1) * sizeof (TNCMDatagramEntry16);
+	}
+
+	return sizeof (TNCMDatagramPointer32) + (nDatagrams+1) * sizeof (TNCMDatagramEntry32);
+}
@@ -2,7 +2,7 @@
 // usbdevicefactory.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -28,6 +28,7 @@
 // for factory
 #include <circle/usb/usbstandardhub.h>
 #include <circle/usb/usbmassdevice.h>
+#include <circle/usb/usbattachedscsi.h>
 #include <circle/usb/usbfloppydevice.h>
 #include <circle/usb/usbkeyboard.h>
 #include <circle/usb/usbmouse.h>
@@ -77,7 +78,14 @@ CUSBFunction *CUSBDeviceFactory::GetDevice (CUSBFunction *pParent, CString *pNam
 #ifndef EXCLUDE_USB_STORAGE
 	else if (pName->Compare ("int8-6-50") == 0)
 	{
-		pResult = new CUSBBulkOnlyMassStorageDevice (pParent);
+		if (CUSBAttachedSCSIDevice::IsSupported (pParent))
+		{
+			pResult = new CUSBAttachedSCSIDevice (pParent);
+		}
+		else
+		{
+			pResult = new CUSBBulkOnlyMassStorageDevice (pParent);
+		}
 	}
 	else if (   pName->Compare ("int8-4-0") == 0
 		 || pName->Compare ("int8-4-1") == 0)
@@ -193,7 +201,8 @@ CUSBFunction *CUSBDeviceFactory::GetDevice (CUSBFunction *pParent, CString *pNam
 #endif
 #endif
 #ifndef EXCLUDE_USB_NET
-	else if (pName->Compare ("int2-6-0") == 0)
+	else if (   pName->Compare ("int2-6-0") == 0		// CDC-ECM
+		 || pName->Compare ("int2-13-0") == 0)		// CDC-NCM
 	{
 		pResult = new CUSBCDCEthernetDevice (pParent);
 	}
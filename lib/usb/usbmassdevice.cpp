@@ -2,7 +2,7 @@
 // usbmassdevice.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2022  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -168,6 +168,31 @@ struct TSCSIReadCapacityResponse
 }
 PACKED;
 
+struct TSCSIReadCapacity16
+{
+	u8		OperationCode;
+#define SCSI_OP_SERVICE_ACTION_IN16	0x9E
+	u8		ServiceAction		: 5,
+#define SCSI_SA_READ_CAPACITY16		0x10
+			Reserved1		: 3;
+	u32		LogicalBlockAddressHigh;		// set to 0
+	u32		LogicalBlockAddressLow;			// set to 0
+	u32		AllocationLength;			// big endian
+	u8		PartialMediumIndicator	: 1,		// set to 0
+			Reserved2		: 7;
+	u8		Control;
+}
+PACKED;
+
+struct TSCSIReadCapacity16Response
+{
+	u32		ReturnedLogicalBlockAddressHigh;	// big endian
+	u32		ReturnedLogicalBlockAddressLow;		// big endian
+	u32		BlockLengthInBytes;			// big endian
+	u8		Reserved[20];
+}
+PACKED;
+
 struct TSCSIRead10
 {
 	u8		OperationCode,
@@ -195,6 +220,32 @@ struct TSCSIWrite10
 }
 PACKED;
 
+struct TSCSIRead16
+{
+	u8		OperationCode,
+#define SCSI_OP_READ16		0x88
+			Flags;
+	u32		LogicalBlockAddressHigh;		// big endian
+	u32		LogicalBlockAddressLow;			// big endian
+	u32		TransferLength;				// block count, big endian
+	u8		GroupNumber;
+	u8		Control;
+}
+PACKED;
+
+struct TSCSIWrite16
+{
+	u8		OperationCode,
+#define SCSI_OP_WRITE16		0x8A
+			Flags;
+	u32		LogicalBlockAddressHigh;		// big endian
+	u32		LogicalBlockAddressLow;			// big endian
+	u32		TransferLength;				// block count, big endian
+	u8		GroupNumber;
+	u8		Control;
+}
+PACKED;
+
 CNumberPool CUSBBulkOnlyMassStorageDevice::s_DeviceNumberPool (1);
 
 static const char FromUmsd[] = "umsd";
@@ -204,7 +255,8 @@ CUSBBulkOnlyMassStorageDevice::CUSBBulkOnlyMassStorageDevice (CUSBFunction *pFun
 	m_pEndpointIn (0),
 	m_pEndpointOut (0),
 	m_nCWBTag (0),
-	m_nBlockCount (0),
+	m_ullBlockCount (0),
+	m_bUse16ByteCDB (FALSE),
 	m_ullOffset (0),
 	m_pPartitionManager (0),
 	m_nDeviceNumber (0)
@@ -234,48 +286,8 @@ CUSBBulkOnlyMassStorageDevice::~CUSBBulkOnlyMassStorageDevice (void)
 
 boolean CUSBBulkOnlyMassStorageDevice::Configure (void)
 {
-	if (GetNumEndpoints () < 2)
-	{
-		ConfigurationError (FromUmsd);
-
-		return FALSE;
-	}
-
-	const TUSBEndpointDescriptor *pEndpointDesc;
-	while ((pEndpointDesc = (TUSBEndpointDescriptor *) GetDescriptor (DESCRIPTOR_ENDPOINT)) != 0)
-	{
-		if ((pEndpointDesc->bmAttributes & 0x3F) == 0x02)		// Bulk
-		{
-			if ((pEndpointDesc->bEndpointAddress & 0x80) == 0x80)	// Input
-			{
-				if (m_pEndpointIn != 0)
-				{
-					ConfigurationError (FromUmsd);
-
-					return FALSE;
-				}
-
-				m_pEndpointIn = new CUSBEndpoint (GetDevice (), pEndpointDesc);
-			}
-			else							// Output
-			{
-				if (m_pEndpointOut != 0)
-				{
-					ConfigurationError (FromUmsd);
-
-					return FALSE;
-				}
-
-				m_pEndpointOut = new CUSBEndpoint (GetDevice (), pEndpointDesc);
-			}
-		}
-	}
-
-	if (   m_pEndpointIn  == 0
-	    || m_pEndpointOut == 0)
+	if (!ConfigureEndpoints ())
 	{
-		ConfigurationError (FromUmsd);
-
 		return FALSE;
 	}
 
@@ -380,17 +392,24 @@ boolean CUSBBulkOnlyMassStorageDevice::Configure (void)
 		return FALSE;
 	}
 
-	m_nBlockCount = le2be32 (SCSIReadCapacityResponse.ReturnedLogicalBlockAddress);
-	if (m_nBlockCount == (u32) -1)
+	u32 nLastBlock = le2be32 (SCSIReadCapacityResponse.ReturnedLogicalBlockAddress);
+	if (nLastBlock == (u32) -1)
 	{
-		CLogger::Get ()->Write (FromUmsd, LogError, "Unsupported disk size > 2TB");
+		// disk is greater than 2TB, READ(16)/WRITE(16) are required
+		if (!ReadCapacity16 ())
+		{
+			CLogger::Get ()->Write (FromUmsd, LogError, "Unsupported disk size > 2TB");
 
-		return FALSE;
+			return FALSE;
+		}
+	}
+	else
+	{
+		m_ullBlockCount = (u64) nLastBlock + 1;
 	}
 
-	m_nBlockCount++;
-
-	CLogger::Get ()->Write (FromUmsd, LogDebug, "Capacity is %u MByte", m_nBlockCount / (0x100000 / UMSD_BLOCK_SIZE));
+	CLogger::Get ()->Write (FromUmsd, LogDebug, "Capacity is %llu MByte",
+				m_ullBlockCount / (0x100000 / UMSD_BLOCK_SIZE));
 
 	unsigned nDeviceNumber = s_DeviceNumberPool.AllocateNumber (FALSE);
 	if (nDeviceNumber == CNumberPool::Invalid)
@@ -422,8 +441,90 @@ boolean CUSBBulkOnlyMassStorageDevice::Configure (void)
 	return TRUE;
 }
 
+boolean CUSBBulkOnlyMassStorageDevice::ConfigureEndpoints (void)
+{
+	if (GetNumEndpoints () < 2)
+	{
+		ConfigurationError (FromUmsd);
+
+		return FALSE;
+	}
+
+	const TUSBEndpointDescriptor *pEndpointDesc;
+	while ((pEndpointDesc = (TUSBEndpointDescriptor *) GetDescriptor (DESCRIPTOR_ENDPOINT)) != 0)
+	{
+		if ((pEndpointDesc->bmAttributes & 0x3F) == 0x02)		// Bulk
+		{
+			if ((pEndpointDesc->bEndpointAddress & 0x80) == 0x80)	// Input
+			{
+				if (m_pEndpointIn != 0)
+				{
+					ConfigurationError (FromUmsd);
+
+					return FALSE;
+				}
+
+				m_pEndpointIn = new CUSBEndpoint (GetDevice (), pEndpointDesc);
+			}
+			else							// Output
+			{
+				if (m_pEndpointOut != 0)
+				{
+					ConfigurationError (FromUmsd);
+
+					return FALSE;
+				}
+
+				m_pEndpointOut = new CUSBEndpoint (GetDevice (), pEndpointDesc);
+			}
+		}
+	}
+
+	if (   m_pEndpointIn  == 0
+	    || m_pEndpointOut == 0)
+	{
+		ConfigurationError (FromUmsd);
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
 int CUSBBulkOnlyMassStorageDevice::Read (void *pBuffer, size_t nCount)
 {
+	// split requests, which exceed the maximum transfer length of a command
+	if (nCount > UMSD_MAX_TRANSFER_SIZE)
+	{
+		u64 ullOffset = m_ullOffset;
+		u8 *pBuffer8 = (u8 *) pBuffer;
+
+		for (size_t nRemaining = nCount; nRemaining > 0;)
+		{
+			size_t nChunk = nRemaining;
+			if (nChunk > UMSD_MAX_TRANSFER_SIZE)
+			{
+				nChunk = UMSD_MAX_TRANSFER_SIZE;
+			}
+
+			int nResult = Read (pBuffer8, nChunk);
+			if (nResult != (int) nChunk)
+			{
+				m_ullOffset = ullOffset;
+
+				return nResult < 0 ? nResult : -1;
+			}
+
+			pBuffer8 += nChunk;
+			m_ullOffset += nChunk;
+			nRemaining -= nChunk;
+		}
+
+		m_ullOffset = ullOffset;
+
+		return nCount;
+	}
+
 	unsigned nTries = MAX_TRIES;
 
 	int nResult;
@@ -449,6 +550,38 @@ int CUSBBulkOnlyMassStorageDevice::Read (void *pBuffer, size_t nCount)
 
 int CUSBBulkOnlyMassStorageDevice::Write (const void *pBuffer, size_t nCount)
 {
+	// split requests, which exceed the maximum transfer length of a command
+	if (nCount > UMSD_MAX_TRANSFER_SIZE)
+	{
+		u64 ullOffset = m_ullOffset;
+		const u8 *pBuffer8 = (const u8 *) pBuffer;
+
+		for (size_t nRemaining = nCount; nRemaining > 0;)
+		{
+			size_t nChunk = nRemaining;
+			if (nChunk > UMSD_MAX_TRANSFER_SIZE)
+			{
+				nChunk = UMSD_MAX_TRANSFER_SIZE;
+			}
+
+			int nResult = Write (pBuffer8, nChunk);
+			if (nResult != (int) nChunk)
+			{
+				m_ullOffset = ullOffset;
+
+				return nResult < 0 ? nResult : -1;
+			}
+
+			pBuffer8 += nChunk;
+			m_ullOffset += nChunk;
+			nRemaining -= nChunk;
+		}
+
+		m_ullOffset = ullOffset;
+
+		return nCount;
+	}
+
 	unsigned nTries = MAX_TRIES;
 
 	int nResult;
@@ -481,45 +614,79 @@ u64 CUSBBulkOnlyMassStorageDevice::Seek (u64 ullOffset)
 
 u64 CUSBBulkOnlyMassStorageDevice::GetSize (void) const
 {
-	assert (m_nBlockCount > 0);
-	assert (m_nBlockCount < (u32) -1);
+	assert (m_ullBlockCount > 0);
 
-	return (u64) m_nBlockCount << UMSD_BLOCK_SHIFT;
+	return m_ullBlockCount << UMSD_BLOCK_SHIFT;
 }
 
 unsigned CUSBBulkOnlyMassStorageDevice::GetCapacity (void) const
 {
-	return m_nBlockCount;
+	if (m_ullBlockCount > (u32) -1)
+	{
+		return (u32) -1;
+	}
+
+	return (unsigned) m_ullBlockCount;
 }
 
-int CUSBBulkOnlyMassStorageDevice::TryRead (void *pBuffer, size_t nCount)
+boolean CUSBBulkOnlyMassStorageDevice::ReadCapacity16 (void)
 {
-	assert (pBuffer != 0);
+	TSCSIReadCapacity16 SCSIReadCapacity;
+	SCSIReadCapacity.OperationCode		 = SCSI_OP_SERVICE_ACTION_IN16;
+	SCSIReadCapacity.ServiceAction		 = SCSI_SA_READ_CAPACITY16;
+	SCSIReadCapacity.Reserved1		 = 0;
+	SCSIReadCapacity.LogicalBlockAddressHigh = 0;
+	SCSIReadCapacity.LogicalBlockAddressLow	 = 0;
+	SCSIReadCapacity.AllocationLength	 = le2be32 (sizeof (TSCSIReadCapacity16Response));
+	SCSIReadCapacity.PartialMediumIndicator	 = 0;
+	SCSIReadCapacity.Reserved2		 = 0;
+	SCSIReadCapacity.Control		 = SCSI_CONTROL;
+
+	TSCSIReadCapacity16Response SCSIReadCapacityResponse;
+	if (Command (&SCSIReadCapacity, sizeof SCSIReadCapacity,
+		     &SCSIReadCapacityResponse, sizeof SCSIReadCapacityResponse,
+		     TRUE) != (int) sizeof SCSIReadCapacityResponse)
+	{
+		CLogger::Get ()->Write (FromUmsd, LogError, "Read capacity (16) failed");
+
+		return FALSE;
+	}
 
-	if (   (m_ullOffset & UMSD_BLOCK_MASK) != 0
-	    || m_ullOffset > UMSD_MAX_OFFSET)
+	unsigned nBlockSize = le2be32 (SCSIReadCapacityResponse.BlockLengthInBytes);
+	if (nBlockSize != UMSD_BLOCK_SIZE)
 	{
-		return -1;
+		CLogger::Get ()->Write (FromUmsd, LogError, "Unsupported block size: %u", nBlockSize);
+
+		return FALSE;
 	}
-	u32 nBlockAddress = (u32) (m_ullOffset >> UMSD_BLOCK_SHIFT);
 
-	if ((nCount & UMSD_BLOCK_MASK) != 0)
+	u64 ullLastBlock =   (u64) le2be32 (SCSIReadCapacityResponse.ReturnedLogicalBlockAddressHigh) << 32
+			   | le2be32 (SCSIReadCapacityResponse.ReturnedLogicalBlockAddressLow);
+	if (ullLastBlock >= (u64) -1 >> UMSD_BLOCK_SHIFT)
 	{
-		return -1;
+		return FALSE;
 	}
-	u16 usTransferLength = (u16) (nCount >> UMSD_BLOCK_SHIFT);
 
-	//CLogger::Get ()->Write (FromUmsd, LogDebug, "TryRead %u/0x%X/%u", nBlockAddress, (unsigned) pBuffer, (unsigned) usTransferLength);
+	m_ullBlockCount = ullLastBlock + 1;
+	m_bUse16ByteCDB = TRUE;
 
-	TSCSIRead10 SCSIRead;
-	SCSIRead.OperationCode		= SCSI_OP_READ;
-	SCSIRead.Reserved1		= 0;
-	SCSIRead.LogicalBlockAddress	= le2be32 (nBlockAddress);
-	SCSIRead.Reserved2		= 0;
-	SCSIRead.TransferLength		= le2be16 (usTransferLength);
-	SCSIRead.Control		= SCSI_CONTROL;
+	return TRUE;
+}
+
+int CUSBBulkOnlyMassStorageDevice::TryRead (void *pBuffer, size_t nCount)
+{
+	assert (pBuffer != 0);
+
+	u8 CmdBlk[16];
+	unsigned nCmdBlkLen = SetupReadWriteCommand (CmdBlk, m_ullOffset, nCount, FALSE);
+	if (nCmdBlkLen == 0)
+	{
+		return -1;
+	}
+
+	//CLogger::Get ()->Write (FromUmsd, LogDebug, "TryRead %llu/0x%lX/%u", m_ullOffset >> UMSD_BLOCK_SHIFT, (unsigned long) pBuffer, (unsigned) (nCount >> UMSD_BLOCK_SHIFT));
 
-	if (Command (&SCSIRead, sizeof SCSIRead, pBuffer, nCount, TRUE) != (int) nCount)
+	if (Command (CmdBlk, nCmdBlkLen, pBuffer, nCount, TRUE) != (int) nCount)
 	{
 		CLogger::Get ()->Write (FromUmsd, LogError, "TryRead failed");
 
@@ -533,30 +700,16 @@ int CUSBBulkOnlyMassStorageDevice::TryWrite (const void *pBuffer, size_t nCount)
 {
 	assert (pBuffer != 0);
 
-	if (   (m_ullOffset & UMSD_BLOCK_MASK) != 0
-	    || m_ullOffset > UMSD_MAX_OFFSET)
+	u8 CmdBlk[16];
+	unsigned nCmdBlkLen = SetupReadWriteCommand (CmdBlk, m_ullOffset, nCount, TRUE);
+	if (nCmdBlkLen == 0)
 	{
 		return -1;
 	}
-	u32 nBlockAddress = (u32) (m_ullOffset >> UMSD_BLOCK_SHIFT);
 
-	if ((nCount & UMSD_BLOCK_MASK) != 0)
-	{
-		return -1;
-	}
-	u16 usTransferLength = (u16) (nCount >> UMSD_BLOCK_SHIFT);
-
-	//CLogger::Get ()->Write (FromUmsd, LogDebug, "TryWrite %u/0x%X/%u", nBlockAddress, (unsigned) pBuffer, (unsigned) usTransferLength);
+	//CLogger::Get ()->Write (FromUmsd, LogDebug, "TryWrite %llu/0x%lX/%u", m_ullOffset >> UMSD_BLOCK_SHIFT, (unsigned long) pBuffer, (unsigned) (nCount >> UMSD_BLOCK_SHIFT));
 
-	TSCSIWrite10 SCSIWrite;
-	SCSIWrite.OperationCode		= SCSI_OP_WRITE;
-	SCSIWrite.Flags			= SCSI_WRITE_FUA;
-	SCSIWrite.LogicalBlockAddress	= le2be32 (nBlockAddress);
-	SCSIWrite.Reserved		= 0;
-	SCSIWrite.TransferLength	= le2be16 (usTransferLength);
-	SCSIWrite.Control		= SCSI_CONTROL;
-
-	if (Command (&SCSIWrite, sizeof SCSIWrite, (void *) pBuffer, nCount, FALSE) < 0)
+	if (Command (CmdBlk, nCmdBlkLen, (void *) pBuffer, nCount, FALSE) < 0)
 	{
 		CLogger::Get ()->Write (FromUmsd, LogError, "TryWrite failed");
 
@@ -566,36 +719,132 @@ int CUSBBulkOnlyMassStorageDevice::TryWrite (const void *pBuffer, size_t nCount)
 	return nCount;
 }
 
-int CUSBBulkOnlyMassStorageDevice::Command (void *pCmdBlk, size_t nCmdBlkLen,
-					    void *pBuffer, size_t nBufLen, boolean bIn)
+unsigned CUSBBulkOnlyMassStorageDevice::SetupReadWriteCommand (void *pCmdBlk, u64 ullOffset,
+							       size_t nCount, boolean bWrite) const
 {
 	assert (pCmdBlk != 0);
-	assert (6 <= nCmdBlkLen && nCmdBlkLen <= 16);
-	assert (nBufLen == 0 || pBuffer != 0);
 
-	DMA_BUFFER (u8, CBWBuffer, sizeof (TCBW));
-	TCBW *pCBW = (TCBW *) CBWBuffer;
-	memset (pCBW, 0, sizeof *pCBW);
+	if (   (ullOffset & UMSD_BLOCK_MASK) != 0
+	    || (!m_bUse16ByteCDB && ullOffset > UMSD_MAX_OFFSET_10))
+	{
+		return 0;
+	}
+	u64 ullBlockAddress = ullOffset >> UMSD_BLOCK_SHIFT;
 
-	pCBW->dCWBSignature	     = CBWSIGNATURE;
-	pCBW->dCWBTag		     = ++m_nCWBTag;
-	pCBW->dCBWDataTransferLength = nBufLen;
-	pCBW->bmCBWFlags	     = bIn ? CBWFLAGS_DATA_IN : 0;
-	pCBW->bCBWLUN		     = CBWLUN;
-	pCBW->bCBWCBLength	     = (u8) nCmdBlkLen;
+	if (   (nCount & UMSD_BLOCK_MASK) != 0
+	    || nCount > UMSD_MAX_TRANSFER_SIZE)
+	{
+		return 0;
+	}
+	u16 usTransferLength = (u16) (nCount >> UMSD_BLOCK_SHIFT);
 
-	memcpy (pCBW->CBWCB, pCmdBlk, nCmdBlkLen);
+	if (!bWrite)
+	{
+		if (!m_bUse16ByteCDB)
+		{
+			TSCSIRead10 *pSCSIRead = (TSCSIRead10 *) pCmdBlk;
+			pSCSIRead->OperationCode	= SCSI_OP_READ;
+			pSCSIRead->Reserved1		= 0;
+			pSCSIRead->LogicalBlockAddress	= le2be32 ((u32) ullBlockAddress);
+			pSCSIRead->Reserved2		= 0;
+			pSCSIRead->TransferLength	= le2be16 (usTransferLength);
+			pSCSIRead->Control		= SCSI_CONTROL;
+
+			return sizeof (TSCSIRead10);
+		}
+
+		TSCSIRead16 *pSCSIRead = (TSCSIRead16 *) pCmdBlk;
+		pSCSIRead->OperationCode	   = SCSI_OP_READ16;
+		pSCSIRead->Flags		   = 0;
+		pSCSIRead->LogicalBlockAddressHigh = le2be32 ((u32) (ullBlockAddress >> 32));
+		pSCSIRead->LogicalBlockAddressLow  = le2be32 ((u32) ullBlockAddress);
+		pSCSIRead->TransferLength	   = le2be32 (usTransferLength);
+		pSCSIRead->GroupNumber		   = 0;
+		pSCSIRead->Control		   = SCSI_CONTROL;
+
+		return sizeof (TSCSIRead16);
+	}
+
+	if (!m_bUse16ByteCDB)
+	{
+		TSCSIWrite10 *pSCSIWrite = (TSCSIWrite10 *) pCmdBlk;
+		pSCSIWrite->OperationCode	= SCSI_OP_WRITE;
+		pSCSIWrite->Flags		= SCSI_WRITE_FUA;
+		pSCSIWrite->LogicalBlockAddress	= le2be32 ((u32) ullBlockAddress);
+		pSCSIWrite->Reserved		= 0;
+		pSCSIWrite->TransferLength	= le2be16 (usTransferLength);
+		pSCSIWrite->Control		= SCSI_CONTROL;
+
+		return sizeof (TSCSIWrite10);
+	}
+
+	TSCSIWrite16 *pSCSIWrite = (TSCSIWrite16 *) pCmdBlk;
+	pSCSIWrite->OperationCode	    = SCSI_OP_WRITE16;
+	pSCSIWrite->Flags		    = SCSI_WRITE_FUA;
+	pSCSIWrite->LogicalBlockAddressHigh = le2be32 ((u32) (ullBlockAddress >> 32));
+	pSCSIWrite->LogicalBlockAddressLow  = le2be32 ((u32) ullBlockAddress);
+	pSCSIWrite->TransferLength	    = le2be32 (usTransferLength);
+	pSCSIWrite->GroupNumber		    = 0;
+	pSCSIWrite->Control		    = SCSI_CONTROL;
+
+	return sizeof (TSCSIWrite16);
+}
+
+int CUSBBulkOnlyMassStorageDevice::TransferSegments (CUSBRequest *pURB)
+{
+	assert (pURB != 0);
+	CUSBEndpoint *pEndpoint = pURB->GetEndpoint ();
+	assert (pEndpoint == m_pEndpointIn || pEndpoint == m_pEndpointOut);
+	boolean bIn = pEndpoint->IsDirectionIn ();
+
+	u8 CmdBlk[16];
+	unsigned nCmdBlkLen = SetupReadWriteCommand (CmdBlk, m_ullOffset, pURB->GetBufLen (), !bIn);
+	if (nCmdBlkLen == 0)
+	{
+		return -1;
+	}
+
+	if (!CommandStage (CmdBlk, nCmdBlkLen, pURB->GetBufLen (), bIn))
+	{
+		return -1;
+	}
 
 	CUSBHostController *pHost = GetHost ();
 	assert (pHost != 0);
 
-	if (pHost->Transfer (m_pEndpointOut, pCBW, sizeof *pCBW) < 0)
+	if (!pHost->SubmitBlockingRequest (pURB))
 	{
-		CLogger::Get ()->Write (FromUmsd, LogError, "CBW transfer failed");
+		CLogger::Get ()->Write (FromUmsd, LogError, "Data transfer failed");
+
+		return -1;
+	}
+
+	if (!StatusStage ())
+	{
+		return -1;
+	}
+
+	return pURB->GetResultLength ();
+}
 
+CUSBEndpoint *CUSBBulkOnlyMassStorageDevice::GetBulkEndpoint (boolean bIn) const
+{
+	return bIn ? m_pEndpointIn : m_pEndpointOut;
+}
+
+int CUSBBulkOnlyMassStorageDevice::Command (void *pCmdBlk, size_t nCmdBlkLen,
+					    void *pBuffer, size_t nBufLen, boolean bIn)
+{
+	assert (nBufLen == 0 || pBuffer != 0);
+
+	if (!CommandStage (pCmdBlk, nCmdBlkLen, nBufLen, bIn))
+	{
 		return -1;
 	}
 
+	CUSBHostController *pHost = GetHost ();
+	assert (pHost != 0);
+
 	int nResult = 0;
 	
 	if (nBufLen > 0)
@@ -636,6 +885,51 @@ int CUSBBulkOnlyMassStorageDevice::Command (void *pCmdBlk, size_t nCmdBlkLen,
 		}
 	}
 
+	if (!StatusStage ())
+	{
+		return -1;
+	}
+
+	return nResult;
+}
+
+boolean CUSBBulkOnlyMassStorageDevice::CommandStage (void *pCmdBlk, size_t nCmdBlkLen,
+						     size_t nBufLen, boolean bIn)
+{
+	assert (pCmdBlk != 0);
+	assert (6 <= nCmdBlkLen && nCmdBlkLen <= 16);
+
+	DMA_BUFFER (u8, CBWBuffer, sizeof (TCBW));
+	TCBW *pCBW = (TCBW *) CBWBuffer;
+	memset (pCBW, 0, sizeof *pCBW);
+
+	pCBW->dCWBSignature	     = CBWSIGNATURE;
+	pCBW->dCWBTag		     = ++m_nCWBTag;
+	pCBW->dCBWDataTransferLength = nBufLen;
+	pCBW->bmCBWFlags	     = bIn ? CBWFLAGS_DATA_IN : 0;
+	pCBW->bCBWLUN		     = CBWLUN;
+	pCBW->bCBWCBLength	     = (u8) nCmdBlkLen;
+
+	memcpy (pCBW->CBWCB, pCmdBlk, nCmdBlkLen);
+
+	CUSBHostController *pHost = GetHost ();
+	assert (pHost != 0);
+
+	if (pHost->Transfer (m_pEndpointOut, pCBW, sizeof *pCBW) < 0)
+	{
+		CLogger::Get ()->Write (FromUmsd, LogError, "CBW transfer failed");
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+boolean CUSBBulkOnlyMassStorageDevice::StatusStage (void)
+{
+	CUSBHostController *pHost = GetHost ();
+	assert (pHost != 0);
+
 	DMA_BUFFER (u8, CSWBuffer, sizeof (TCSW));
 	TCSW *pCSW = (TCSW *) CSWBuffer;
 
@@ -651,7 +945,7 @@ int CUSBBulkOnlyMassStorageDevice::Command (void *pCmdBlk, size_t nCmdBlkLen,
 			CLogger::Get ()->Write (FromUmsd, LogDebug,
 						"Cannot clear halt on endpoint IN");
 
-			return -1;
+			return FALSE;
 		}
 
 		m_pEndpointIn->ResetPID ();
@@ -660,7 +954,7 @@ int CUSBBulkOnlyMassStorageDevice::Command (void *pCmdBlk, size_t nCmdBlkLen,
 		{
 			CLogger::Get ()->Write (FromUmsd, LogError, "CSW transfer failed twice");
 
-			return -1;
+			return FALSE;
 		}
 	}
 
@@ -668,29 +962,29 @@ int CUSBBulkOnlyMassStorageDevice::Command (void *pCmdBlk, size_t nCmdBlkLen,
 	{
 		CLogger::Get ()->Write (FromUmsd, LogError, "CSW signature is wrong");
 
-		return -1;
+		return FALSE;
 	}
 
 	if (pCSW->dCSWTag != m_nCWBTag)
 	{
 		CLogger::Get ()->Write (FromUmsd, LogError, "CSW tag is wrong");
 
-		return -1;
+		return FALSE;
 	}
 
 	if (pCSW->bCSWStatus != CSWSTATUS_PASSED)
 	{
-		return -1;
+		return FALSE;
 	}
 
 	if (pCSW->dCSWDataResidue != 0)
 	{
 		CLogger::Get ()->Write (FromUmsd, LogError, "Data residue is not 0");
 
-		return -1;
+		return FALSE;
 	}
 
-	return nResult;
+	return TRUE;
 }
 
 int CUSBBulkOnlyMassStorageDevice::Reset (void)
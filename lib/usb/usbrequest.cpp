@@ -2,7 +2,7 @@
 // usbrequest.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2022  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -18,8 +18,17 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 #include <circle/usb/usbrequest.h>
+#include <circle/new.h>
+#include <circle/util.h>
+#include <circle/tracer.h>
+#include <circle/sysconfig.h>
 #include <assert.h>
 
+CMetricCounter CUSBRequest::s_RequestCounter ("circle_usb_requests_total",
+					      "Number of completed USB requests");
+CMetricCounter CUSBRequest::s_ErrorCounter ("circle_usb_request_errors_total",
+					    "Number of USB requests, which completed with an error");
+
 CUSBRequest::CUSBRequest (CUSBEndpoint *pEndpoint, void *pBuffer, u32 nBufLen, TSetupData *pSetupData)
 :	m_pEndpoint (pEndpoint),
 	m_pSetupData (pSetupData),
@@ -32,14 +41,29 @@ CUSBRequest::CUSBRequest (CUSBEndpoint *pEndpoint, void *pBuffer, u32 nBufLen, T
 	m_pCompletionRoutine (0),
 	m_pCompletionParam (0),
 	m_pCompletionContext (0),
-	m_bCompleteOnNAK (FALSE)
+	m_bCompleteOnNAK (FALSE),
+	m_bIntermediateStage (FALSE),
+	m_nNumSegments (0),
+	m_pLinearBuffer (0),
+	m_nBufferAllocations (0),
+	m_nBytesCopied (0)
 {
 	assert (m_pEndpoint != 0);
 	assert (m_pBuffer != 0 || m_nBufLen == 0);
+
+	if (m_nBufLen > 0)
+	{
+		m_pSegmentBuffer[0] = m_pBuffer;
+		m_nSegmentLength[0] = m_nBufLen;
+		m_nNumSegments = 1;
+	}
 }
 
 CUSBRequest::~CUSBRequest (void)
 {
+	delete [] m_pLinearBuffer;
+	m_pLinearBuffer = 0;
+
 	m_pEndpoint = 0;
 	m_pSetupData = 0;
 	m_pBuffer = 0;
@@ -142,10 +166,36 @@ void CUSBRequest::SetCompletionRoutine (TURBCompletionRoutine *pRoutine, void *p
 void CUSBRequest::CallCompletionRoutine (void)
 {
 	assert (m_pCompletionRoutine != 0);
-	
+
+	if (m_pLinearBuffer != 0)
+	{
+		CopyBackLinearized ();
+	}
+
+#ifdef TRACE_USB
+	if (CTracer::Get () != 0)
+	{
+		CTracer::Get ()->Event (TRACER_EVENT_USB_REQUEST, m_bStatus, m_nResultLen);
+	}
+#endif
+
+	if (!m_bIntermediateStage || !m_bStatus)
+	{
+		s_RequestCounter.Increment ();
+		if (!m_bStatus)
+		{
+			s_ErrorCounter.Increment ();
+		}
+	}
+
 	(*m_pCompletionRoutine) (this, m_pCompletionParam, m_pCompletionContext);
 }
 
+void CUSBRequest::SetIntermediateStage (boolean bIntermediate)
+{
+	m_bIntermediateStage = bIntermediate;
+}
+
 void CUSBRequest::SetCompleteOnNAK (void)
 {
 	m_bCompleteOnNAK = TRUE;
@@ -156,4 +206,119 @@ boolean CUSBRequest::IsCompleteOnNAK (void) const
 	return m_bCompleteOnNAK;
 }
 
+void CUSBRequest::AddSegment (void *pBuffer, u32 nLength)
+{
+	assert (pBuffer != 0);
+	assert (nLength > 0);
+	assert (m_nNumSegments < MaxSegments);
+	assert (m_pLinearBuffer == 0);
+	assert (   m_pEndpoint->GetType () == EndpointTypeBulk
+		|| m_pEndpoint->GetType () == EndpointTypeInterrupt);
+
+	if (m_nNumSegments == 0)
+	{
+		m_pBuffer = pBuffer;
+	}
+
+	m_pSegmentBuffer[m_nNumSegments] = pBuffer;
+	m_nSegmentLength[m_nNumSegments] = nLength;
+	m_nNumSegments++;
+
+	m_nBufLen += nLength;
+}
+
+unsigned CUSBRequest::GetNumSegments (void) const
+{
+	return m_nNumSegments;
+}
+
+void *CUSBRequest::GetSegmentBuffer (unsigned nSegment)
+{
+	assert (nSegment < m_nNumSegments);
+
+	return m_pSegmentBuffer[nSegment];
+}
+
+u32 CUSBRequest::GetSegmentLength (unsigned nSegment) const
+{
+	assert (nSegment < m_nNumSegments);
+
+	return m_nSegmentLength[nSegment];
+}
+
+boolean CUSBRequest::Linearize (void)
+{
+	if (m_nNumSegments <= 1)
+	{
+		return TRUE;
+	}
+
+	// the buffer is kept for resubmission, but the segments are gathered each time
+	if (m_pLinearBuffer == 0)
+	{
+		m_pLinearBuffer = new (HEAP_DMA30) u8[m_nBufLen];
+		if (m_pLinearBuffer == 0)
+		{
+			return FALSE;
+		}
+
+		m_nBufferAllocations++;
+	}
+
+	if (!m_pEndpoint->IsDirectionIn ())
+	{
+		u8 *p = m_pLinearBuffer;
+		for (unsigned i = 0; i < m_nNumSegments; i++)
+		{
+			memcpy (p, m_pSegmentBuffer[i], m_nSegmentLength[i]);
+			p += m_nSegmentLength[i];
+		}
+
+		m_nBytesCopied += m_nBufLen;
+	}
+
+	m_pBuffer = m_pLinearBuffer;
+
+	return TRUE;
+}
+
+void CUSBRequest::CopyBackLinearized (void)
+{
+	assert (m_pLinearBuffer != 0);
+
+	if (   !m_bStatus
+	    || !m_pEndpoint->IsDirectionIn ())
+	{
+		return;
+	}
+
+	const u8 *p = m_pLinearBuffer;
+	u32 nRemaining = m_nResultLen;
+	for (unsigned i = 0; i < m_nNumSegments && nRemaining > 0; i++)
+	{
+		u32 nLength = m_nSegmentLength[i];
+		if (nLength > nRemaining)
+		{
+			nLength = nRemaining;
+		}
+
+		memcpy (m_pSegmentBuffer[i], p, nLength);
+
+		p += nLength;
+		nRemaining -= nLength;
+	}
+
+	m_nBytesCopied += m_nResultLen;
+}
+
+unsigned CUSBRequest::GetBufferAllocations (void) const
+{
+	return m_nBufferAllocations;
+}
+
+u32 CUSBRequest::GetBytesCopied (void) const
+{
+	return m_nBytesCopied;
+}
+
 IMPLEMENT_CLASS_ALLOCATOR (CUSBRequest)
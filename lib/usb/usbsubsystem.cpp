@@ -2,7 +2,7 @@
 // usbsubsystem.h
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2023  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2023-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -123,6 +123,13 @@ boolean CUSBSubSystem::IsPlugAndPlay (void) const
 	return m_bPlugAndPlay;
 }
 
+CXHCIDevice *CUSBSubSystem::GetXHCIDevice (unsigned nDevice)
+{
+	assert (nDevice < NumDevices);
+
+	return m_pXHCIDevice[nDevice];
+}
+
 boolean CUSBSubSystem::IsActive (void)
 {
 	return !!s_pThis;
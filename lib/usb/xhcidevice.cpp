@@ -373,6 +373,42 @@ void CXHCIDevice::FreeSharedMem (void *pBlock)
 	m_pSharedMemAllocator->Free (pBlock);
 }
 
+void CXHCIDevice::SetInterruptModeration (unsigned nNanoSeconds)
+{
+	unsigned nInterval = (nNanoSeconds + 249) / 250;
+	if (nInterval > XHCI_REG_RT_IR_IMOD_IMODI__MASK)
+	{
+		nInterval = XHCI_REG_RT_IR_IMOD_IMODI__MASK;
+	}
+
+	assert (m_pEventManager != 0);
+	m_pEventManager->SetModerationInterval (nInterval);
+}
+
+void CXHCIDevice::SetMaxEventsPerInterrupt (unsigned nEvents)
+{
+	assert (m_pEventManager != 0);
+	m_pEventManager->SetMaxEventsPerInterrupt (nEvents);
+}
+
+void CXHCIDevice::GetEventStats (TXHCIEventStats *pStats)
+{
+	assert (m_pEventManager != 0);
+
+	EnterCritical (IRQ_LEVEL);
+	m_pEventManager->GetStats (pStats);
+	LeaveCritical ();
+}
+
+void CXHCIDevice::ResetEventStats (void)
+{
+	assert (m_pEventManager != 0);
+
+	EnterCritical (IRQ_LEVEL);
+	m_pEventManager->ResetStats ();
+	LeaveCritical ();
+}
+
 void CXHCIDevice::InterruptHandler (void)
 {
 #ifdef XHCI_DEBUG2
@@ -383,8 +419,8 @@ void CXHCIDevice::InterruptHandler (void)
 	u32 nStatus = m_pMMIO->op_read32 (XHCI_REG_OP_USBSTS);
 	m_pMMIO->op_write32 (XHCI_REG_OP_USBSTS, nStatus | XHCI_REG_OP_USBSTS_EINT);
 
-	m_pMMIO->rt_write32 (0, XHCI_REG_RT_IR_IMAN,   m_pMMIO->rt_read32 (0, XHCI_REG_RT_IR_IMAN)
-						     | XHCI_REG_RT_IR_IMAN_IP);
+	assert (m_pEventManager != 0);
+	m_pEventManager->AcknowledgeInterrupt ();
 
 	if (nStatus & XHCI_REG_OP_USBSTS_HCH)
 	{
@@ -398,28 +434,7 @@ void CXHCIDevice::InterruptHandler (void)
 		return;
 	}
 
-	TXHCITRB *pEventTRB = 0;
-	TXHCITRB *pNextEventTRB;
-	assert (m_pEventManager != 0);
-	unsigned nTries = XHCI_CONFIG_MAX_EVENTS_PER_INTR;
-	while (   nTries-- != 0
-	       && (pNextEventTRB = m_pEventManager->HandleEvents ()) != 0)
-	{
-		pEventTRB = pNextEventTRB;
-	}
-
-	if (pEventTRB != 0)
-	{
-		m_pMMIO->rt_write64 (0, XHCI_REG_RT_IR_ERDP_LO,   XHCI_TO_DMA (pEventTRB)
-								| XHCI_REG_RT_IR_ERDP_LO_EHB);
-	}
-	else
-	{
-		m_pMMIO->rt_write64 (0, XHCI_REG_RT_IR_ERDP_LO,
-				       (  m_pMMIO->rt_read64 (0, XHCI_REG_RT_IR_ERDP_LO)
-				        & XHCI_REG_RT_IR_ERDP__MASK)
-				     | XHCI_REG_RT_IR_ERDP_LO_EHB);
-	}
+	m_pEventManager->ProcessEvents ();
 }
 
 void CXHCIDevice::InterruptStub (void *pParam)
@@ -2,7 +2,7 @@
 // xhciendpoint.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2019-2024  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2019-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -33,6 +33,12 @@
 
 static const char From[] = "xhciep";
 
+// a TD must not occupy more than half of the transfer ring, because two URBs can be active
+static const unsigned MaxTRBsPerTD = (XHCI_CONFIG_TRANSFER_RING_SIZE-1) / 2;
+
+// a data buffer of a TRB must not cross a 64K boundary
+static const uintptr TRBBoundary = 0x10000;
+
 CXHCIEndpoint::CXHCIEndpoint (CXHCIUSBDevice *pDevice, CXHCIDevice *pXHCIDevice)
 :	m_pDevice (pDevice),
 	m_pXHCIDevice (pXHCIDevice),
@@ -42,6 +48,8 @@ CXHCIEndpoint::CXHCIEndpoint (CXHCIUSBDevice *pDevice, CXHCIDevice *pXHCIDevice)
 	m_uchEndpointID (1),
 	m_uchEndpointType (XHCI_EP_CONTEXT_EP_TYPE_CONTROL),
 	m_pURB {0, 0},
+	m_pFirstTRB {0, 0},
+	m_pLastTRB {0, 0},
 	m_bTransferCompleted (TRUE),
 	m_pInputContextBuffer (0)
 {
@@ -68,6 +76,8 @@ CXHCIEndpoint::CXHCIEndpoint (CXHCIUSBDevice *pDevice, const TUSBEndpointDescrip
 	m_uchEndpointID (0),
 	m_uchEndpointType (0),
 	m_pURB {0, 0},
+	m_pFirstTRB {0, 0},
+	m_pLastTRB {0, 0},
 	m_bTransferCompleted (TRUE),
 	m_pInputContextBuffer (0)
 {
@@ -232,6 +242,10 @@ boolean CXHCIEndpoint::Transfer (CUSBRequest *pURB, unsigned nTimeoutMs)
 			m_SpinLock.Acquire ();
 			m_pURB[0] = m_pURB[1];
 			m_pURB[1] = 0;
+			m_pFirstTRB[0] = m_pFirstTRB[1];
+			m_pFirstTRB[1] = 0;
+			m_pLastTRB[0] = m_pLastTRB[1];
+			m_pLastTRB[1] = 0;
 			m_SpinLock.Release ();
 			m_bTransferCompleted = TRUE;
 
@@ -258,35 +272,68 @@ boolean CXHCIEndpoint::TransferAsync (CUSBRequest *pURB, unsigned nTimeoutMs)
 		return FALSE;
 	}
 
+	pURB->SetStatus (0);		// the request may be submitted again
+
 	void *pBuffer = pURB->GetBuffer ();
 	u32 nBufLen = pURB->GetBufLen ();
 
+	boolean bNormalTD =    (m_uchEndpointType & 3) == 2	// bulk EP
+			    || (m_uchEndpointType & 3) == 3;	// interrupt EP
+
+	unsigned nTRBs = 0;
+	if (bNormalTD)
+	{
+		nTRBs = GetNormalTRBCount (pURB);
+		if (   nTRBs == 0
+		    || nTRBs > MaxTRBsPerTD)
+		{
+			CLogger::Get ()->Write (From, LogWarning, "Too many TRBs in TD (%u)", nTRBs);
+
+			return FALSE;
+		}
+	}
+
 	m_SpinLock.Acquire ();
+
+	// the TD boundaries must be known, before the xHC may process it
+	TXHCITRB *pFirstTRB = 0;
+	TXHCITRB *pLastTRB = 0;
+	if (nTRBs > 0)
+	{
+		assert (m_pTransferRing != 0);
+		pFirstTRB = m_pTransferRing->GetEnqueueTRB ();
+		if (pFirstTRB == 0)
+		{
+			m_SpinLock.Release ();
+
+			return FALSE;
+		}
+
+		pLastTRB = pFirstTRB;
+		for (unsigned i = 1; i < nTRBs; i++)
+		{
+			pLastTRB = m_pTransferRing->GetNextTRB (pLastTRB);
+		}
+	}
+
 	if (m_pURB[0] == 0)
 	{
 		m_pURB[0] = pURB;
+		m_pFirstTRB[0] = pFirstTRB;
+		m_pLastTRB[0] = pLastTRB;
 	}
 	else
 	{
 		assert (m_pURB[1] == 0);
 		m_pURB[1] = pURB;
+		m_pFirstTRB[1] = pFirstTRB;
+		m_pLastTRB[1] = pLastTRB;
 	}
 	m_SpinLock.Release ();
 
-	if (   (m_uchEndpointType & 3) == 2		// bulk EP
-	    || (m_uchEndpointType & 3) == 3)		// interrupt EP
+	if (bNormalTD)
 	{
-
-		assert (pBuffer != 0);
-		assert (nBufLen > 0);
-		assert ((uintptr) pBuffer > MEM_KERNEL_END);
-		CleanAndInvalidateDataCacheRange ((uintptr) pBuffer, nBufLen);
-
-		if (!EnqueueTRB (  XHCI_TRB_TYPE_NORMAL << XHCI_TRB_CONTROL_TRB_TYPE__SHIFT
-				 | XHCI_TRANSFER_TRB_CONTROL_IOC,
-		     		 nBufLen | 0 << XHCI_TRANSFER_TRB_STATUS_TD_SIZE__SHIFT,
-				 XHCI_TO_DMA_LO (pBuffer),
-				 XHCI_TO_DMA_HI (pBuffer)))
+		if (!EnqueueNormalTD (pURB))
 		{
 			goto EnqueueError;
 		}
@@ -399,17 +446,22 @@ EnqueueError:
 	if (m_pURB[1] != 0)
 	{
 		m_pURB[1] = 0;
+		m_pFirstTRB[1] = 0;
+		m_pLastTRB[1] = 0;
 	}
 	else
 	{
 		m_pURB[0] = 0;
+		m_pFirstTRB[0] = 0;
+		m_pLastTRB[0] = 0;
 	}
 	m_SpinLock.Release ();
 
 	return FALSE;
 }
 
-void CXHCIEndpoint::TransferEvent (u8 uchCompletionCode, u32 nTransferLength)
+void CXHCIEndpoint::TransferEvent (TXHCITRB *pTransferTRB, u8 uchCompletionCode,
+				   u32 nTransferLength)
 {
 #ifdef XHCI_DEBUG2
 	CLogger::Get ()->Write (From, LogDebug,
@@ -426,19 +478,35 @@ void CXHCIEndpoint::TransferEvent (u8 uchCompletionCode, u32 nTransferLength)
 		return;
 	}
 
+	int nResultLength = -1;
+	if (m_pFirstTRB[0] != 0)
+	{
+		nResultLength = GetNormalTDResultLength (m_pFirstTRB[0], m_pLastTRB[0],
+							 pTransferTRB, nTransferLength);
+		if (nResultLength < 0)
+		{
+			// event does not belong to the current TD (e.g. after short packet)
+			return;
+		}
+	}
+
 	if (   XHCI_TRB_SUCCESS (uchCompletionCode)
 	    || uchCompletionCode == XHCI_TRB_COMPLETION_CODE_SHORT_PACKET)
 	{
-		void *pBuffer = pURB->GetBuffer ();
-		u32 nBufLen = pURB->GetBufLen ();
-		if (pBuffer != 0)
+		for (unsigned i = 0; i < pURB->GetNumSegments (); i++)
 		{
-			assert (nBufLen > 0);
-			CleanAndInvalidateDataCacheRange ((uintptr) pBuffer, nBufLen);
+			CleanAndInvalidateDataCacheRange ((uintptr) pURB->GetSegmentBuffer (i),
+							  pURB->GetSegmentLength (i));
+		}
+
+		if (nResultLength < 0)
+		{
+			u32 nBufLen = pURB->GetBufLen ();
+			assert (nTransferLength <= nBufLen);
+			nResultLength = nBufLen - nTransferLength;
 		}
 
-		assert (nTransferLength <= nBufLen);
-		pURB->SetResultLen (nBufLen - nTransferLength);
+		pURB->SetResultLen (nResultLength);
 
 		pURB->SetStatus (1);
 	}
@@ -457,6 +525,10 @@ void CXHCIEndpoint::TransferEvent (u8 uchCompletionCode, u32 nTransferLength)
 	m_SpinLock.Acquire ();
 	m_pURB[0] = m_pURB[1];
 	m_pURB[1] = 0;
+	m_pFirstTRB[0] = m_pFirstTRB[1];
+	m_pFirstTRB[1] = 0;
+	m_pLastTRB[0] = m_pLastTRB[1];
+	m_pLastTRB[1] = 0;
 	m_SpinLock.Release ();
 
 	pURB->CallCompletionRoutine ();
@@ -519,6 +591,126 @@ void CXHCIEndpoint::CompletionRoutine (CUSBRequest *pURB, void *pParam, void *pC
 	pThis->m_bTransferCompleted = TRUE;
 }
 
+boolean CXHCIEndpoint::EnqueueNormalTD (CUSBRequest *pURB)
+{
+	assert (pURB != 0);
+	u32 nBufLen = pURB->GetBufLen ();
+	assert (nBufLen > 0);
+
+	assert (m_usMaxPacketSize > 0);
+	u32 nTDPackets = (nBufLen + m_usMaxPacketSize-1) / m_usMaxPacketSize;
+	u32 nTransferred = 0;
+
+	u32 nDirFlags = 0;
+	if (m_uchEndpointAddress & 0x80)
+	{
+		nDirFlags = XHCI_TRANSFER_TRB_CONTROL_ISP;
+	}
+
+	unsigned nSegments = pURB->GetNumSegments ();
+	for (unsigned i = 0; i < nSegments; i++)
+	{
+		u8 *pBuffer = (u8 *) pURB->GetSegmentBuffer (i);
+		u32 nLength = pURB->GetSegmentLength (i);
+		assert (pBuffer != 0);
+		assert (nLength > 0);
+		assert ((uintptr) pBuffer > MEM_KERNEL_END);
+		CleanAndInvalidateDataCacheRange ((uintptr) pBuffer, nLength);
+
+		while (nLength > 0)
+		{
+			u32 nTRBLength = TRBBoundary - ((uintptr) pBuffer & (TRBBoundary-1));
+			if (nTRBLength > nLength)
+			{
+				nTRBLength = nLength;
+			}
+
+			nTransferred += nTRBLength;
+
+			u32 nControl = XHCI_TRB_TYPE_NORMAL << XHCI_TRB_CONTROL_TRB_TYPE__SHIFT | nDirFlags;
+			u32 nTDSize = 0;
+			if (nTransferred < nBufLen)
+			{
+				nControl |= XHCI_TRANSFER_TRB_CONTROL_CH;
+
+				// number of packets remaining after this TRB
+				nTDSize = nTDPackets - nTransferred / m_usMaxPacketSize;
+				if (nTDSize > 31)
+				{
+					nTDSize = 31;
+				}
+			}
+			else
+			{
+				nControl |= XHCI_TRANSFER_TRB_CONTROL_IOC;
+			}
+
+			if (!EnqueueTRB (nControl,
+					 nTRBLength | nTDSize << XHCI_TRANSFER_TRB_STATUS_TD_SIZE__SHIFT,
+					 XHCI_TO_DMA_LO (pBuffer),
+					 XHCI_TO_DMA_HI (pBuffer)))
+			{
+				return FALSE;
+			}
+
+			pBuffer += nTRBLength;
+			nLength -= nTRBLength;
+		}
+	}
+
+	assert (nTransferred == nBufLen);
+
+	return TRUE;
+}
+
+unsigned CXHCIEndpoint::GetNormalTRBCount (CUSBRequest *pURB)
+{
+	assert (pURB != 0);
+
+	unsigned nTRBs = 0;
+
+	unsigned nSegments = pURB->GetNumSegments ();
+	for (unsigned i = 0; i < nSegments; i++)
+	{
+		uintptr nStart = (uintptr) pURB->GetSegmentBuffer (i);
+		uintptr nEnd = nStart + pURB->GetSegmentLength (i) - 1;
+
+		nTRBs += (nEnd / TRBBoundary) - (nStart / TRBBoundary) + 1;
+	}
+
+	return nTRBs;
+}
+
+int CXHCIEndpoint::GetNormalTDResultLength (TXHCITRB *pFirstTRB, TXHCITRB *pLastTRB,
+					    TXHCITRB *pTransferTRB, u32 nTransferLength)
+{
+	assert (pFirstTRB != 0);
+	assert (pLastTRB != 0);
+	assert (m_pTransferRing != 0);
+
+	u32 nResultLength = 0;
+
+	for (TXHCITRB *pTRB = pFirstTRB;; pTRB = m_pTransferRing->GetNextTRB (pTRB))
+	{
+		u32 nTRBLength = pTRB->Status & XHCI_TRANSFER_TRB_STATUS_TRB_LENGTH__MASK;
+
+		if (pTRB == pTransferTRB)
+		{
+			// nTransferLength is the residual number of bytes of this TRB
+			assert (nTransferLength <= nTRBLength);
+
+			return nResultLength + nTRBLength - nTransferLength;
+		}
+
+		if (pTRB == pLastTRB)
+		{
+			return -1;
+		}
+
+		nResultLength += nTRBLength;
+	}
+}
+
 boolean CXHCIEndpoint::EnqueueTRB (u32 nControl, u32 nStatus, u32 nParameter1, u32 nParameter2)
 {
 	assert (m_pTransferRing != 0);
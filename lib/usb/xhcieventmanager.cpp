@@ -2,7 +2,7 @@
 // xhcieventmanager.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2019-2022  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2019-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -20,16 +20,23 @@
 #include <circle/usb/xhcieventmanager.h>
 #include <circle/usb/xhcidevice.h>
 #include <circle/logger.h>
+#include <circle/timer.h>
+#include <circle/util.h>
 #include <assert.h>
 
 static const char From[] = "xhcievt";
 
-CXHCIEventManager::CXHCIEventManager (CXHCIDevice *pXHCIDevice)
+CXHCIEventManager::CXHCIEventManager (CXHCIDevice *pXHCIDevice, unsigned nInterrupter)
 :	m_pXHCIDevice (pXHCIDevice),
 	m_pMMIO (pXHCIDevice->GetMMIOSpace ()),
+	m_nInterrupter (nInterrupter),
 	m_EventRing (XHCIRingTypeEvent, XHCI_CONFIG_EVENT_RING_SIZE, pXHCIDevice),
-	m_pERST (0)
+	m_pERST (0),
+	m_nModerationInterval (XHCI_CONFIG_IMODI),
+	m_nMaxEventsPerInterrupt (XHCI_CONFIG_MAX_EVENTS_PER_INTR)
 {
+	ResetStats ();
+
 	if (!m_EventRing.IsValid ())
 	{
 		return;
@@ -47,12 +54,14 @@ CXHCIEventManager::CXHCIEventManager (CXHCIDevice *pXHCIDevice)
 	m_pERST->Reserved = 0;
 
 	assert (m_pMMIO != 0);
-	m_pMMIO->rt_write32 (0, XHCI_REG_RT_IR_ERSTSZ, 1);
-	m_pMMIO->rt_write64 (0, XHCI_REG_RT_IR_ERSTBA_LO, XHCI_TO_DMA (m_pERST));
-	m_pMMIO->rt_write64 (0, XHCI_REG_RT_IR_ERDP_LO, XHCI_TO_DMA (m_EventRing.GetFirstTRB ()));
-	m_pMMIO->rt_write32 (0, XHCI_REG_RT_IR_IMOD, XHCI_CONFIG_IMODI);
-	m_pMMIO->rt_write32 (0, XHCI_REG_RT_IR_IMAN,   m_pMMIO->rt_read32 (0, XHCI_REG_RT_IR_IMAN)
-						     | XHCI_REG_RT_IR_IMAN_IE);
+	m_pMMIO->rt_write32 (m_nInterrupter, XHCI_REG_RT_IR_ERSTSZ, 1);
+	m_pMMIO->rt_write64 (m_nInterrupter, XHCI_REG_RT_IR_ERSTBA_LO, XHCI_TO_DMA (m_pERST));
+	m_pMMIO->rt_write64 (m_nInterrupter, XHCI_REG_RT_IR_ERDP_LO,
+			     XHCI_TO_DMA (m_EventRing.GetFirstTRB ()));
+	m_pMMIO->rt_write32 (m_nInterrupter, XHCI_REG_RT_IR_IMOD, m_nModerationInterval);
+	m_pMMIO->rt_write32 (m_nInterrupter, XHCI_REG_RT_IR_IMAN,
+			       m_pMMIO->rt_read32 (m_nInterrupter, XHCI_REG_RT_IR_IMAN)
+			     | XHCI_REG_RT_IR_IMAN_IE);
 }
 
 CXHCIEventManager::~CXHCIEventManager (void)
@@ -60,8 +69,8 @@ CXHCIEventManager::~CXHCIEventManager (void)
 	if (m_pERST != 0)
 	{
 		assert (m_pMMIO != 0);
-		m_pMMIO->rt_write32 (0, XHCI_REG_RT_IR_IMAN,
-				       m_pMMIO->rt_read32 (0, XHCI_REG_RT_IR_IMAN)
+		m_pMMIO->rt_write32 (m_nInterrupter, XHCI_REG_RT_IR_IMAN,
+				       m_pMMIO->rt_read32 (m_nInterrupter, XHCI_REG_RT_IR_IMAN)
 				     & ~XHCI_REG_RT_IR_IMAN_IE);
 
 		assert (m_pXHCIDevice != 0);
@@ -79,6 +88,65 @@ boolean CXHCIEventManager::IsValid (void)
 	return m_EventRing.IsValid () && m_pERST != 0;
 }
 
+void CXHCIEventManager::AcknowledgeInterrupt (void)
+{
+	assert (m_pMMIO != 0);
+	m_pMMIO->rt_write32 (m_nInterrupter, XHCI_REG_RT_IR_IMAN,
+			       m_pMMIO->rt_read32 (m_nInterrupter, XHCI_REG_RT_IR_IMAN)
+			     | XHCI_REG_RT_IR_IMAN_IP);
+}
+
+void CXHCIEventManager::ProcessEvents (void)
+{
+	assert (m_pMMIO != 0);
+
+	unsigned nStartTicks = CTimer::GetClockTicks ();
+
+	// the dequeue pointer is written only once per interrupt
+	TXHCITRB *pEventTRB = 0;
+	TXHCITRB *pNextEventTRB;
+	unsigned nEvents = 0;
+	while (   nEvents < m_nMaxEventsPerInterrupt
+	       && (pNextEventTRB = HandleEvents ()) != 0)
+	{
+		pEventTRB = pNextEventTRB;
+		nEvents++;
+	}
+
+	if (pEventTRB != 0)
+	{
+		m_pMMIO->rt_write64 (m_nInterrupter, XHCI_REG_RT_IR_ERDP_LO,
+				     XHCI_TO_DMA (pEventTRB) | XHCI_REG_RT_IR_ERDP_LO_EHB);
+	}
+	else
+	{
+		m_pMMIO->rt_write64 (m_nInterrupter, XHCI_REG_RT_IR_ERDP_LO,
+				       (  m_pMMIO->rt_read64 (m_nInterrupter, XHCI_REG_RT_IR_ERDP_LO)
+				        & XHCI_REG_RT_IR_ERDP__MASK)
+				     | XHCI_REG_RT_IR_ERDP_LO_EHB);
+	}
+
+	// remaining events will raise the next interrupt after the moderation interval
+	if (   nEvents == m_nMaxEventsPerInterrupt
+	    && m_EventRing.GetDequeueTRB () != 0)
+	{
+		m_Stats.nBudgetExhausted++;
+	}
+
+	unsigned nHandlerTime = CTimer::GetClockTicks () - nStartTicks;
+
+	m_Stats.nInterrupts++;
+	if (nEvents > m_Stats.nMaxEventsPerInterrupt)
+	{
+		m_Stats.nMaxEventsPerInterrupt = nEvents;
+	}
+	if (nHandlerTime > m_Stats.nMaxHandlerTime)
+	{
+		m_Stats.nMaxHandlerTime = nHandlerTime;
+	}
+	m_Stats.nTotalHandlerTime += nHandlerTime;
+}
+
 TXHCITRB *CXHCIEventManager::HandleEvents (void)
 {
 	assert (m_pXHCIDevice != 0);
@@ -89,12 +157,16 @@ TXHCITRB *CXHCIEventManager::HandleEvents (void)
 		return 0;
 	}
 
+	m_Stats.nEvents++;
+
 	unsigned nTRBType =    (pEventTRB->Control & XHCI_TRB_CONTROL_TRB_TYPE__MASK)
 			    >> XHCI_TRB_CONTROL_TRB_TYPE__SHIFT;
 	switch (nTRBType)
 	{
 	case XHCI_TRB_TYPE_EVENT_TRANSFER:
+		m_Stats.nTransferEvents++;
 		m_pXHCIDevice->GetSlotManager ()->TransferEvent (
+			(TXHCITRB *) XHCI_FROM_DMA (pEventTRB->Parameter),
 			pEventTRB->Status >> XHCI_EVENT_TRB_STATUS_COMPLETION_CODE__SHIFT,
 			pEventTRB->Status & XHCI_TRANSFER_EVENT_TRB_STATUS_TRB_TRANSFER_LENGTH__MASK,
 			pEventTRB->Control >> XHCI_CMD_COMPLETION_EVENT_TRB_CONTROL_SLOTID__SHIFT,
@@ -141,6 +213,44 @@ TXHCITRB *CXHCIEventManager::HandleEvents (void)
 	return pEventTRB;
 }
 
+void CXHCIEventManager::SetModerationInterval (unsigned nInterval)
+{
+	assert (nInterval <= XHCI_REG_RT_IR_IMOD_IMODI__MASK);
+	m_nModerationInterval = nInterval;
+
+	// the counter is reloaded from the interval, when it reaches 0
+	assert (m_pMMIO != 0);
+	m_pMMIO->rt_write32 (m_nInterrupter, XHCI_REG_RT_IR_IMOD, m_nModerationInterval);
+}
+
+unsigned CXHCIEventManager::GetModerationInterval (void) const
+{
+	return m_nModerationInterval;
+}
+
+void CXHCIEventManager::SetMaxEventsPerInterrupt (unsigned nEvents)
+{
+	assert (nEvents > 0);
+	assert (nEvents < XHCI_CONFIG_EVENT_RING_SIZE);
+	m_nMaxEventsPerInterrupt = nEvents;
+}
+
+unsigned CXHCIEventManager::GetMaxEventsPerInterrupt (void) const
+{
+	return m_nMaxEventsPerInterrupt;
+}
+
+void CXHCIEventManager::GetStats (TXHCIEventStats *pStats) const
+{
+	assert (pStats != 0);
+	memcpy (pStats, &m_Stats, sizeof *pStats);
+}
+
+void CXHCIEventManager::ResetStats (void)
+{
+	memset (&m_Stats, 0, sizeof m_Stats);
+}
+
 #ifndef NDEBUG
 
 void CXHCIEventManager::DumpStatus (void)
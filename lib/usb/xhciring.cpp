@@ -2,7 +2,7 @@
 // xhciring.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2019  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2019-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -143,7 +143,15 @@ void CXHCIRing::IncrementEnqueue (void)
 	{
 		TXHCITRB *pLinkTRB = &m_pFirstTRB[m_nEnqueueIndex];
 
-		pLinkTRB->Control ^= XHCI_TRB_CONTROL_C;
+		// the Link TRB must be chained, if it is in the middle of a TD
+		u32 nControl = pLinkTRB->Control & ~XHCI_LINK_TRB_CONTROL_CH;
+		if (   m_Type == XHCIRingTypeTransfer
+		    && (m_pFirstTRB[m_nEnqueueIndex-1].Control & XHCI_TRANSFER_TRB_CONTROL_CH))
+		{
+			nControl |= XHCI_LINK_TRB_CONTROL_CH;
+		}
+
+		pLinkTRB->Control = nControl ^ XHCI_TRB_CONTROL_C;
 
 		if (pLinkTRB->Control & XHCI_LINK_TRB_CONTROL_TC)
 		{
@@ -154,6 +162,21 @@ void CXHCIRing::IncrementEnqueue (void)
 	}
 }
 
+TXHCITRB *CXHCIRing::GetNextTRB (TXHCITRB *pTRB)
+{
+	assert (m_pFirstTRB != 0);
+	assert (m_Type != XHCIRingTypeEvent);
+	assert (pTRB >= m_pFirstTRB);
+	assert (pTRB < &m_pFirstTRB[m_nTRBCount-1]);
+
+	if (++pTRB == &m_pFirstTRB[m_nTRBCount-1])	// last index is used for Link TRB
+	{
+		pTRB = m_pFirstTRB;
+	}
+
+	return pTRB;
+}
+
 u32 CXHCIRing::GetCycleState (void) const
 {
 	assert (m_pFirstTRB != 0);
@@ -2,7 +2,7 @@
 // xhcislotmanager.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2019-2022  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2019-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -99,8 +99,8 @@ void CXHCISlotManager::AssignScratchpadBufferArray (u64 *pScratchpadBufferArray)
 	m_pDCBAA[0] = XHCI_TO_DMA (pScratchpadBufferArray);
 }
 
-void CXHCISlotManager::TransferEvent (u8 uchCompletionCode, u32 nTransferLength,
-				      u8 uchSlotID, u8 uchEndpointID)
+void CXHCISlotManager::TransferEvent (TXHCITRB *pTransferTRB, u8 uchCompletionCode,
+				      u32 nTransferLength, u8 uchSlotID, u8 uchEndpointID)
 {
 	assert (XHCI_IS_SLOTID (uchSlotID));
 	if (m_pUSBDevice[uchSlotID-1] == 0)
@@ -108,7 +108,8 @@ void CXHCISlotManager::TransferEvent (u8 uchCompletionCode, u32 nTransferLength,
 		return;
 	}
 
-	m_pUSBDevice[uchSlotID-1]->TransferEvent (uchCompletionCode, nTransferLength, uchEndpointID);
+	m_pUSBDevice[uchSlotID-1]->TransferEvent (pTransferTRB, uchCompletionCode, nTransferLength,
+						  uchEndpointID);
 }
 
 #ifndef NDEBUG
@@ -2,7 +2,7 @@
 // xhciusbdevice.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2019-2021  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2019-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -183,11 +183,12 @@ void CXHCIUSBDevice::RegisterEndpoint (u8 uchEndpointID, CXHCIEndpoint *pEndpoin
 	m_pEndpoint[uchEndpointID-1] = pEndpoint;
 }
 
-void CXHCIUSBDevice::TransferEvent (u8 uchCompletionCode, u32 nTransferLength, u8 uchEndpointID)
+void CXHCIUSBDevice::TransferEvent (TXHCITRB *pTransferTRB, u8 uchCompletionCode,
+				    u32 nTransferLength, u8 uchEndpointID)
 {
 	assert (XHCI_IS_ENDPOINTID (uchEndpointID));
 	assert (m_pEndpoint[uchEndpointID-1] != 0);
-	m_pEndpoint[uchEndpointID-1]->TransferEvent (uchCompletionCode, nTransferLength);
+	m_pEndpoint[uchEndpointID-1]->TransferEvent (pTransferTRB, uchCompletionCode, nTransferLength);
 }
 
 #ifndef NDEBUG
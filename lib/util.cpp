@@ -2,7 +2,7 @@
 // util.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2024  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
 // 
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -713,15 +713,11 @@ u32 bswap32 (u32 ulValue)
 
 int parity32 (unsigned nValue)
 {
-	int nResult = 0;
+	nValue ^= nValue >> 16;
+	nValue ^= nValue >> 8;
+	nValue ^= nValue >> 4;
 
-	while (nValue != 0)
-	{
-		nResult ^= (nValue & 1);
-		nValue >>= 1;
-	}
-
-	return nResult;
+	return (0x6996 >> (nValue & 0xF)) & 1;		// parity of 4-bit values
 }
 
 #endif
@@ -2,7 +2,7 @@
 // kernel.cpp
 //
 // Circle - A C++ bare metal environment for Raspberry Pi
-// Copyright (C) 2014-2020  R. Stange <rsta2@o2online.de>
+// Copyright (C) 2014-2025  R. Stange <rsta2@o2online.de>
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -121,6 +121,21 @@ TShutdownMode CKernel::Run (void)
 #else
 		m_Latency.Dump ();
 #endif
+
+#if RASPPI <= 3
+		// USB interrupt load of the last second
+		TDWHCIStats Stats;
+		m_USBHCI.GetStats (&Stats);
+		m_USBHCI.ResetStats ();
+
+		m_Logger.Write (FromKernel, LogNotice,
+				"USB: %u ints (%u SOF, %u chan, %u IRQ), %u URBs, "
+				"SOF interval %u-%u us, max. handler %u us",
+				Stats.nInterrupts, Stats.nSOFInterrupts, Stats.nChannelInterrupts,
+				Stats.nCompletionIRQs, Stats.nCompletions,
+				Stats.nSOFIntervalMin, Stats.nSOFIntervalMax,
+				Stats.nHandlerTimeMax);
+#endif
 	}
 
 	return ShutdownHalt;
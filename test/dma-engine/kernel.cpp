@@ -0,0 +1,423 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <circle/synchronize.h>
+#include <circle/new.h>
+#include <circle/util.h>
+#include <assert.h>
+
+#define DMA_CHANNELS		2
+
+#define BUFFER_SIZE		0x100000	// 1 MByte
+#define QUEUE_REQUESTS		32
+#define QUEUE_BLOCK_SIZE	4096
+#define THROUGHPUT_BYTES	0x1000000	// 16 MByte per test
+
+static const char FromKernel[] = "kernel";
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer),
+	m_DMAEngine (&m_Interrupt, DMA_CHANNELS),
+	m_pSource (0),
+	m_pDestination (0),
+	m_nCompleted (0),
+	m_nFailed (0)
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_DMAEngine.Initialize ();
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+	m_Logger.Write (FromKernel, LogNotice, "DMA engine with %u channels",
+			m_DMAEngine.GetChannelCount ());
+
+	// the legacy DMA controller can access the first GB only
+	m_pSource = new (HEAP_DMA30) u8[BUFFER_SIZE];
+	m_pDestination = new (HEAP_DMA30) u8[BUFFER_SIZE];
+	if (   m_pSource == 0
+	    || m_pDestination == 0)
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Cannot allocate buffers");
+	}
+
+	for (unsigned i = 0; i < BUFFER_SIZE; i++)
+	{
+		m_pSource[i] = (u8) (i * 7 + 3);
+	}
+
+	unsigned nFailed = 0;
+
+	if (!TestScatterGather ())
+	{
+		nFailed++;
+	}
+
+	if (!TestQueue ())
+	{
+		nFailed++;
+	}
+
+	if (!TestAsync ())
+	{
+		nFailed++;
+	}
+
+	TestThroughput ();
+
+	TDMAEngineStats Stats;
+	m_DMAEngine.GetStats (&Stats);
+	m_Logger.Write (FromKernel, LogNotice,
+			"%u requests, %u segments, %llu bytes, %u errors, max. %u queued",
+			Stats.nCompleted, Stats.nSegments, Stats.ullBytes, Stats.nErrors,
+			Stats.nQueuedMax);
+
+	if (nFailed == 0)
+	{
+		m_Logger.Write (FromKernel, LogNotice, "All tests passed");
+	}
+	else
+	{
+		m_Logger.Write (FromKernel, LogError, "%u test(s) failed", nFailed);
+	}
+
+	return ShutdownHalt;
+}
+
+boolean CKernel::TestScatterGather (void)
+{
+	memset (m_pDestination, 0xEE, BUFFER_SIZE);
+
+	CDMARequest Request (4);
+	boolean bOK = Request.AddMemCopy (m_pDestination, m_pSource, 1000);
+	bOK = bOK && Request.AddMemSet (m_pDestination + 1000, 0x5A, 3000);
+	bOK = bOK && Request.AddMemCopy (m_pDestination + 4000, m_pSource + 10000, 5001);
+	// 10 lines of 100 bytes, with a pitch of 128 (destination) and 112 bytes (source)
+	bOK = bOK && Request.AddMemCopy2D (m_pDestination + 16384, m_pSource + 20000,
+					   100, 10, 28, 12);
+	assert (bOK);
+	assert (!Request.AddMemSet (m_pDestination, 0, 1));	// no more segments
+
+	// AddMemCopy2D() does not maintain the destination cache
+	CleanAndInvalidateDataCacheRange ((uintptr) (m_pDestination + 16384), 10 * 128);
+
+	m_DMAEngine.Submit (&Request);
+	if (!m_DMAEngine.Wait (&Request))
+	{
+		m_Logger.Write (FromKernel, LogError, "Scatter-gather: DMA error");
+
+		return FALSE;
+	}
+
+	CleanAndInvalidateDataCacheRange ((uintptr) (m_pDestination + 16384), 10 * 128);
+
+	unsigned nErrors = 0;
+	for (unsigned i = 0; i < 20000; i++)
+	{
+		u8 uchExpected = 0xEE;
+		if (i < 1000)
+		{
+			uchExpected = m_pSource[i];
+		}
+		else if (i < 4000)
+		{
+			uchExpected = 0x5A;
+		}
+		else if (i < 9001)
+		{
+			uchExpected = m_pSource[10000 + i - 4000];
+		}
+		else if (   i >= 16384
+			 && (i - 16384) % 128 < 100
+			 && (i - 16384) / 128 < 10)
+		{
+			unsigned nLine = (i - 16384) / 128;
+			uchExpected = m_pSource[20000 + nLine * 112 + (i - 16384) % 128];
+		}
+
+		if (m_pDestination[i] != uchExpected)
+		{
+			if (nErrors++ < 5)
+			{
+				m_Logger.Write (FromKernel, LogError,
+						"Scatter-gather: Offset %u is 0x%02X (0x%02X expected)",
+						i, m_pDestination[i], uchExpected);
+			}
+		}
+	}
+
+	m_Logger.Write (FromKernel, nErrors == 0 ? LogNotice : LogError,
+			"Scatter-gather: %u segments, %u errors", Request.GetSegmentCount (), nErrors);
+
+	return nErrors == 0;
+}
+
+boolean CKernel::TestQueue (void)
+{
+	memset (m_pDestination, 0, BUFFER_SIZE);
+
+	CDMARequest *pRequest[QUEUE_REQUESTS];
+	for (unsigned i = 0; i < QUEUE_REQUESTS; i++)
+	{
+		pRequest[i] = new CDMARequest (1);
+		assert (pRequest[i] != 0);
+
+		boolean bOK = pRequest[i]->AddMemCopy (m_pDestination + i * QUEUE_BLOCK_SIZE,
+						       m_pSource + i * QUEUE_BLOCK_SIZE,
+						       QUEUE_BLOCK_SIZE);
+		assert (bOK);
+		(void) bOK;
+
+		pRequest[i]->SetCompletionRoutine (RequestCompletionRoutine, this);
+	}
+
+	m_nCompleted = 0;
+	m_nFailed = 0;
+
+	for (unsigned i = 0; i < QUEUE_REQUESTS; i++)
+	{
+		m_DMAEngine.Submit (pRequest[i]);
+	}
+
+	unsigned nStartTicks = m_Timer.GetClockTicks ();
+	while (   m_nCompleted < QUEUE_REQUESTS
+	       && m_Timer.GetClockTicks () - nStartTicks < CLOCKHZ)
+	{
+		// just wait
+	}
+
+	unsigned nCompleted = m_nCompleted;
+	boolean bOK =    nCompleted == QUEUE_REQUESTS
+		      && m_nFailed == 0
+		      && memcmp (m_pDestination, m_pSource, QUEUE_REQUESTS * QUEUE_BLOCK_SIZE) == 0;
+
+	m_Logger.Write (FromKernel, bOK ? LogNotice : LogError,
+			"Queue: %u of %u requests completed, %u failed, data %s",
+			nCompleted, QUEUE_REQUESTS, m_nFailed, bOK ? "OK" : "invalid");
+
+	if (nCompleted == QUEUE_REQUESTS)
+	{
+		for (unsigned i = 0; i < QUEUE_REQUESTS; i++)
+		{
+			delete pRequest[i];
+		}
+	}
+
+	return bOK;
+}
+
+boolean CKernel::TestAsync (void)
+{
+	memset (m_pDestination, 0, BUFFER_SIZE);
+
+	m_nCompleted = 0;
+	m_nFailed = 0;
+
+	const unsigned nBlockSize = 0x10000;
+	unsigned nSubmitted = 0;
+	for (unsigned i = 0; i < DMA_ENGINE_ASYNC_REQUESTS; i++)
+	{
+		boolean bOK;
+		if (i & 1)
+		{
+			bOK = m_DMAEngine.MemSetAsync (m_pDestination + i * nBlockSize, (u8) i,
+						       nBlockSize, AsyncCompletionRoutine, this);
+		}
+		else
+		{
+			bOK = m_DMAEngine.MemCopyAsync (m_pDestination + i * nBlockSize,
+							m_pSource + i * nBlockSize,
+							nBlockSize, AsyncCompletionRoutine, this);
+		}
+
+		if (bOK)
+		{
+			nSubmitted++;
+		}
+	}
+
+	unsigned nStartTicks = m_Timer.GetClockTicks ();
+	while (   m_nCompleted < nSubmitted
+	       && m_Timer.GetClockTicks () - nStartTicks < CLOCKHZ)
+	{
+		// just wait
+	}
+
+	unsigned nErrors = 0;
+	for (unsigned i = 0; i < DMA_ENGINE_ASYNC_REQUESTS * nBlockSize; i++)
+	{
+		unsigned nBlock = i / nBlockSize;
+		u8 uchExpected = nBlock & 1 ? (u8) nBlock : m_pSource[i];
+
+		if (m_pDestination[i] != uchExpected)
+		{
+			nErrors++;
+		}
+	}
+
+	boolean bOK =    nSubmitted == DMA_ENGINE_ASYNC_REQUESTS
+		      && m_nCompleted == nSubmitted
+		      && m_nFailed == 0
+		      && nErrors == 0;
+
+	m_Logger.Write (FromKernel, bOK ? LogNotice : LogError,
+			"Async: %u submitted, %u completed, %u failed, %u bytes invalid",
+			nSubmitted, m_nCompleted, m_nFailed, nErrors);
+
+	return bOK;
+}
+
+void CKernel::TestThroughput (void)
+{
+	static const unsigned BlockSize[] = {4096, 65536, BUFFER_SIZE};
+
+	for (unsigned i = 0; i < sizeof BlockSize / sizeof BlockSize[0]; i++)
+	{
+		unsigned nBlockSize = BlockSize[i];
+		unsigned nCount = THROUGHPUT_BYTES / nBlockSize;
+
+		unsigned nStartTicks = m_Timer.GetClockTicks ();
+		for (unsigned j = 0; j < nCount; j++)
+		{
+			memcpy (m_pDestination, m_pSource, nBlockSize);
+		}
+		unsigned nCPUTicks = m_Timer.GetClockTicks () - nStartTicks;
+
+		nStartTicks = m_Timer.GetClockTicks ();
+		for (unsigned j = 0; j < nCount; j++)
+		{
+			m_DMAEngine.MemCopy (m_pDestination, m_pSource, nBlockSize);
+		}
+		unsigned nDMATicks = m_Timer.GetClockTicks () - nStartTicks;
+
+		// bytes per microsecond is MByte per second
+		m_Logger.Write (FromKernel, LogNotice,
+				"Copy %7u bytes: CPU %4u MB/s, DMA %4u MB/s",
+				nBlockSize,
+				THROUGHPUT_BYTES / (nCPUTicks ? nCPUTicks : 1),
+				THROUGHPUT_BYTES / (nDMATicks ? nDMATicks : 1));
+
+		nStartTicks = m_Timer.GetClockTicks ();
+		for (unsigned j = 0; j < nCount; j++)
+		{
+			memset (m_pDestination, j, nBlockSize);
+		}
+		nCPUTicks = m_Timer.GetClockTicks () - nStartTicks;
+
+		m_nCompleted = 0;
+		nStartTicks = m_Timer.GetClockTicks ();
+		for (unsigned j = 0; j < nCount; j++)
+		{
+			while (!m_DMAEngine.MemSetAsync (m_pDestination, j, nBlockSize,
+							 AsyncCompletionRoutine, this))
+			{
+				// wait for a free request
+			}
+		}
+		while (m_nCompleted < nCount)
+		{
+			// just wait
+		}
+		nDMATicks = m_Timer.GetClockTicks () - nStartTicks;
+
+		m_Logger.Write (FromKernel, LogNotice,
+				"Fill %7u bytes: CPU %4u MB/s, DMA %4u MB/s",
+				nBlockSize,
+				THROUGHPUT_BYTES / (nCPUTicks ? nCPUTicks : 1),
+				THROUGHPUT_BYTES / (nDMATicks ? nDMATicks : 1));
+	}
+}
+
+void CKernel::RequestCompletionRoutine (CDMARequest *pRequest, void *pParam)
+{
+	CKernel *pThis = static_cast<CKernel *> (pParam);
+	assert (pThis != 0);
+	assert (pRequest != 0);
+
+	if (!pRequest->GetStatus ())
+	{
+		pThis->m_nFailed++;
+	}
+
+	pThis->m_nCompleted++;
+}
+
+void CKernel::AsyncCompletionRoutine (boolean bStatus, void *pParam)
+{
+	CKernel *pThis = static_cast<CKernel *> (pParam);
+	assert (pThis != 0);
+
+	if (!bStatus)
+	{
+		pThis->m_nFailed++;
+	}
+
+	pThis->m_nCompleted++;
+}
@@ -0,0 +1,458 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <circle/exceptionstub.h>
+#include <circle/memorymap.h>
+#include <circle/util.h>
+#include <assert.h>
+
+#define DRIVE		"SD:"
+#define FILENAME	DRIVE "/mapper.bin"
+
+#define FILE_PAGES	64			// complete pages
+#define FILE_TAIL	1000			// bytes in the last page
+#define FILE_SIZE	(FILE_PAGES * PAGE_SIZE + FILE_TAIL)
+#define MAPPED_PAGES	(FILE_PAGES + 1)
+
+#define CACHE_PAGES	16			// less than MAPPED_PAGES
+
+#define SEED		0x5A5A0000U
+#define SEED_UPDATE	0xA5A50000U
+
+static const char FromKernel[] = "kernel";
+
+static u64 GetDAIF (void)
+{
+	u64 nDAIF;
+	asm volatile ("mrs %0, daif" : "=r" (nDAIF));
+
+	return nDAIF;
+}
+
+static void SetDAIF (u64 nDAIF)
+{
+	asm volatile ("msr daif, %0" : : "r" (nDAIF));
+}
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer),
+	m_EMMC (&m_Interrupt, &m_Timer, &m_ActLED),
+	m_FileMapper (CACHE_PAGES * PAGE_SIZE),
+	m_nLastPageFaults (0),
+	m_nLastEvictions (0)
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_EMMC.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_FileMapper.Initialize ();
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+	FRESULT Result = f_mount (&m_FileSystem, DRIVE, 1);
+	if (Result != FR_OK)
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Cannot mount drive: %s (%d)", DRIVE, (int) Result);
+	}
+
+	if (!WriteFile (0, FILE_SIZE, SEED))
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Cannot create %s", FILENAME);
+	}
+
+	unsigned nTests = 0;
+	unsigned nFailed = 0;
+
+	static const struct
+	{
+		const char *pName;
+		boolean (CKernel::*pCheck) (void);
+	}
+	Checks[] =
+	{
+		{"Demand paging",	&CKernel::CheckDemandPaging},
+		{"Eviction",		&CKernel::CheckEviction},
+		{"File update",		&CKernel::CheckFileUpdate},
+		{"Fault inside FatFs",	&CKernel::CheckFatFsRefusal}
+	};
+
+	for (unsigned i = 0; i < sizeof Checks / sizeof Checks[0]; i++)
+	{
+		m_Logger.Write (FromKernel, LogNotice, "%s", Checks[i].pName);
+
+		nTests++;
+		if (!(this->*Checks[i].pCheck) ())
+		{
+			m_Logger.Write (FromKernel, LogError, "%s failed", Checks[i].pName);
+
+			nFailed++;
+		}
+	}
+
+	m_Logger.Write (FromKernel, LogNotice, "%u page faults, %u evictions",
+			m_FileMapper.GetPageFaults (), m_FileMapper.GetEvictions ());
+
+	f_unlink (FILENAME);
+
+	if (nFailed == 0)
+	{
+		m_Logger.Write (FromKernel, LogNotice, "All %u tests passed", nTests);
+	}
+	else
+	{
+		m_Logger.Write (FromKernel, LogError, "%u of %u tests failed", nFailed, nTests);
+	}
+
+	f_mount (0, DRIVE, 0);
+
+	return ShutdownHalt;
+}
+
+// pages are loaded on first access only, the rest of the last page is zero
+boolean CKernel::CheckDemandPaging (void)
+{
+	CheckCounters (0, 0);
+
+	size_t nSize;
+	const u8 *pMapped = (const u8 *) m_FileMapper.Map (FILENAME, &nSize);
+	if (pMapped == 0)
+	{
+		return FALSE;
+	}
+
+	if (nSize != FILE_SIZE)
+	{
+		m_FileMapper.Unmap (pMapped);
+
+		return FALSE;
+	}
+
+	boolean bOK =    CheckCounters (0, 0)
+		      && CheckData (pMapped, 0, sizeof (u32), SEED)
+		      && CheckCounters (1, 0)
+		      && CheckData (pMapped, 0, PAGE_SIZE, SEED)
+		      && CheckCounters (0, 0)
+		      && CheckData (pMapped, 10 * PAGE_SIZE, PAGE_SIZE, SEED)
+		      && CheckCounters (1, 0)
+		      && CheckData (pMapped, FILE_PAGES * PAGE_SIZE, FILE_TAIL, SEED)
+		      && CheckCounters (1, 0);
+
+	for (size_t i = FILE_SIZE; bOK && i < MAPPED_PAGES * PAGE_SIZE; i++)
+	{
+		if (pMapped[i] != 0)
+		{
+			m_Logger.Write (FromKernel, LogError, "Page is not cleared at offset %lu",
+					(unsigned long) i);
+
+			bOK = FALSE;
+		}
+	}
+
+	m_FileMapper.Unmap (pMapped);
+
+	return bOK;
+}
+
+// more pages than the cache can hold are accessed, evicted pages are loaded again
+boolean CKernel::CheckEviction (void)
+{
+	CheckCounters (0, 0);
+
+	const u8 *pMapped = (const u8 *) m_FileMapper.Map (FILENAME);
+	if (pMapped == 0)
+	{
+		return FALSE;
+	}
+
+	// the first pass fills the free frames, then one page is evicted per fault
+	boolean bOK =    CheckData (pMapped, 0, FILE_SIZE, SEED)
+		      && CheckCounters (MAPPED_PAGES, MAPPED_PAGES - CACHE_PAGES);
+
+	// the last pages of the first pass are evicted, before they are accessed again
+	bOK =    bOK
+	      && CheckData (pMapped, 0, FILE_SIZE, SEED)
+	      && CheckCounters (MAPPED_PAGES, MAPPED_PAGES);
+
+	// backwards the most recently loaded pages are still present
+	for (unsigned i = MAPPED_PAGES; bOK && i-- > MAPPED_PAGES - CACHE_PAGES;)
+	{
+		bOK = CheckData (pMapped, i * PAGE_SIZE, i < FILE_PAGES ? PAGE_SIZE : FILE_TAIL,
+				 SEED);
+	}
+
+	bOK = bOK && CheckCounters (0, 0);
+
+	m_FileMapper.Unmap (pMapped);
+
+	return bOK;
+}
+
+// a file, which has been modified, must not be seen with stale pages after re-mapping
+boolean CKernel::CheckFileUpdate (void)
+{
+	const u8 *pMapped = (const u8 *) m_FileMapper.Map (FILENAME);
+	if (pMapped == 0)
+	{
+		return FALSE;
+	}
+
+	boolean bOK =    CheckData (pMapped, 0, 2 * PAGE_SIZE, SEED)
+		      && CheckData (pMapped, FILE_PAGES * PAGE_SIZE, FILE_TAIL, SEED);
+
+	m_FileMapper.Unmap (pMapped);
+
+	if (   !bOK
+	    || !WriteFile (PAGE_SIZE / 2, PAGE_SIZE, SEED_UPDATE)
+	    || !WriteFile (FILE_PAGES * PAGE_SIZE, FILE_TAIL, SEED_UPDATE))
+	{
+		return FALSE;
+	}
+
+	CheckCounters (0, 0);
+
+	pMapped = (const u8 *) m_FileMapper.Map (FILENAME);
+	if (pMapped == 0)
+	{
+		return FALSE;
+	}
+
+	bOK =    CheckData (pMapped, 0, PAGE_SIZE / 2, SEED)
+	      && CheckData (pMapped, PAGE_SIZE / 2, PAGE_SIZE, SEED_UPDATE)
+	      && CheckData (pMapped, PAGE_SIZE * 3 / 2, PAGE_SIZE / 2, SEED)
+	      && CheckData (pMapped, FILE_PAGES * PAGE_SIZE, FILE_TAIL, SEED_UPDATE)
+	      && CheckCounters (3, 0);
+
+	m_FileMapper.Unmap (pMapped);
+
+	// restore the original contents for the following check
+	bOK = bOK && WriteFile (0, FILE_SIZE, SEED);
+
+	return bOK;
+}
+
+// A page fault, which occurs while FatFs is entered (e.g. mapped memory has been passed to
+// f_write()), must not be resolved, because loading the page would dead-lock. A real fault
+// would halt the system then, so the abort frame is simulated here.
+boolean CKernel::CheckFatFsRefusal (void)
+{
+	CheckCounters (0, 0);
+
+	const u8 *pMapped = (const u8 *) m_FileMapper.Map (FILENAME);
+	if (pMapped == 0)
+	{
+		return FALSE;
+	}
+
+	u64 nDAIF = GetDAIF ();
+
+	TAbortFrame Frame;
+	memset (&Frame, 0, sizeof Frame);
+	Frame.esr_el1 = (u64) 0x25 << 26 | 0x07;	// data abort from EL1, translation fault
+	Frame.spsr_el1 = nDAIF | 0x05;			// EL1h, same interrupt mask
+	Frame.far_el1 = (uintptr) pMapped + 3 * PAGE_SIZE;
+
+	ff_mutex_take (0);				// volume "SD:" is entered
+	boolean bResolved = CExceptionHandler::ResolveAbort (&Frame);
+	ff_mutex_give (0);
+
+	SetDAIF (nDAIF);				// returns with IRQs disabled
+
+	boolean bOK = !bResolved && CheckCounters (0, 0);
+	if (bResolved)
+	{
+		m_Logger.Write (FromKernel, LogError, "Fault inside FatFs has been resolved");
+	}
+
+	// the same fault is resolved outside of FatFs
+	bResolved = CExceptionHandler::ResolveAbort (&Frame);
+
+	SetDAIF (nDAIF);
+
+	if (!bResolved)
+	{
+		m_Logger.Write (FromKernel, LogError, "Fault outside of FatFs has not been resolved");
+
+		bOK = FALSE;
+	}
+
+	bOK =    bOK
+	      && CheckCounters (1, 0)
+	      && CheckData (pMapped, 3 * PAGE_SIZE, PAGE_SIZE, SEED)
+	      && CheckCounters (0, 0);
+
+	m_FileMapper.Unmap (pMapped);
+
+	return bOK;
+}
+
+boolean CKernel::WriteFile (size_t nOffset, size_t nLength, u32 nSeed)
+{
+	assert (nOffset % sizeof (u32) == 0);
+	assert (nLength % sizeof (u32) == 0);
+
+	FIL File;
+	if (f_open (&File, FILENAME, FA_WRITE | (nOffset == 0 ? FA_CREATE_ALWAYS
+							       : FA_OPEN_EXISTING)) != FR_OK)
+	{
+		return FALSE;
+	}
+
+	u32 *pBuffer = new u32[PAGE_SIZE / sizeof (u32)];
+	assert (pBuffer != 0);
+
+	FRESULT Result = f_lseek (&File, nOffset);
+
+	while (   Result == FR_OK
+	       && nLength > 0)
+	{
+		size_t nChunk = nLength < PAGE_SIZE ? nLength : PAGE_SIZE;
+
+		for (unsigned i = 0; i < nChunk / sizeof (u32); i++)
+		{
+			pBuffer[i] = (u32) (nOffset + i * sizeof (u32)) ^ nSeed;
+		}
+
+		UINT nBytesWritten;
+		Result = f_write (&File, pBuffer, nChunk, &nBytesWritten);
+		if (   Result == FR_OK
+		    && nBytesWritten != nChunk)
+		{
+			Result = FR_DENIED;		// disk full
+		}
+
+		nOffset += nChunk;
+		nLength -= nChunk;
+	}
+
+	delete [] pBuffer;
+
+	if (f_close (&File) != FR_OK)
+	{
+		return FALSE;
+	}
+
+	if (Result != FR_OK)
+	{
+		m_Logger.Write (FromKernel, LogError, "Cannot write %s (%d)", FILENAME, (int) Result);
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+boolean CKernel::CheckData (const void *pMapped, size_t nOffset, size_t nLength, u32 nSeed)
+{
+	assert (pMapped != 0);
+	assert (nOffset % sizeof (u32) == 0);
+	assert (nLength % sizeof (u32) == 0);
+
+	const volatile u32 *pData = (const volatile u32 *) ((const u8 *) pMapped + nOffset);
+
+	for (unsigned i = 0; i < nLength / sizeof (u32); i++)
+	{
+		u32 nExpected = (u32) (nOffset + i * sizeof (u32)) ^ nSeed;
+		u32 nValue = pData[i];
+		if (nValue != nExpected)
+		{
+			m_Logger.Write (FromKernel, LogError,
+					"Data mismatch at offset %lu: 0x%08X, expected 0x%08X",
+					(unsigned long) (nOffset + i * sizeof (u32)), nValue, nExpected);
+
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+boolean CKernel::CheckCounters (unsigned nPageFaults, unsigned nMinEvictions)
+{
+	unsigned nNewPageFaults = m_FileMapper.GetPageFaults () - m_nLastPageFaults;
+	unsigned nNewEvictions = m_FileMapper.GetEvictions () - m_nLastEvictions;
+
+	m_nLastPageFaults = m_FileMapper.GetPageFaults ();
+	m_nLastEvictions = m_FileMapper.GetEvictions ();
+
+	if (   nNewPageFaults != nPageFaults
+	    || nNewEvictions < nMinEvictions)
+	{
+		m_Logger.Write (FromKernel, LogError,
+				"%u page faults, %u evictions (expected %u, at least %u)",
+				nNewPageFaults, nNewEvictions, nPageFaults, nMinEvictions);
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
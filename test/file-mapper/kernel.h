@@ -0,0 +1,89 @@
+//
+// kernel.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _kernel_h
+#define _kernel_h
+
+#include <circle/actled.h>
+#include <circle/koptions.h>
+#include <circle/devicenameservice.h>
+#include <circle/screen.h>
+#include <circle/serial.h>
+#include <circle/exceptionhandler.h>
+#include <circle/interrupt.h>
+#include <circle/timer.h>
+#include <circle/logger.h>
+#include <circle/types.h>
+#include <SDCard/emmc.h>
+#include <fatfs/ff.h>
+#include <fatfs/filemapper.h>
+
+enum TShutdownMode
+{
+	ShutdownNone,
+	ShutdownHalt,
+	ShutdownReboot
+};
+
+class CKernel
+{
+public:
+	CKernel (void);
+	~CKernel (void);
+
+	boolean Initialize (void);
+
+	TShutdownMode Run (void);
+
+private:
+	boolean CheckDemandPaging (void);
+	boolean CheckEviction (void);
+	boolean CheckFileUpdate (void);
+	boolean CheckFatFsRefusal (void);
+
+	// writes the pattern for nSeed to the test file (re-created, if nOffset is 0)
+	boolean WriteFile (size_t nOffset, size_t nLength, u32 nSeed);
+
+	// compares the mapped memory with the pattern for nSeed
+	boolean CheckData (const void *pMapped, size_t nOffset, size_t nLength, u32 nSeed);
+
+	// checks the number of page faults and evictions since the last call
+	boolean CheckCounters (unsigned nPageFaults, unsigned nMinEvictions);
+
+private:
+	// do not change this order
+	CActLED			m_ActLED;
+	CKernelOptions		m_Options;
+	CDeviceNameService	m_DeviceNameService;
+	CScreenDevice		m_Screen;
+	CSerialDevice		m_Serial;
+	CExceptionHandler	m_ExceptionHandler;
+	CInterruptSystem	m_Interrupt;
+	CTimer			m_Timer;
+	CLogger			m_Logger;
+	CEMMCDevice		m_EMMC;
+
+	FATFS			m_FileSystem;
+	CFileMapper		m_FileMapper;
+
+	unsigned m_nLastPageFaults;
+	unsigned m_nLastEvictions;
+};
+
+#endif
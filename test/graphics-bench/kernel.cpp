@@ -0,0 +1,236 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include "memorydisplay.h"
+#include <assert.h>
+
+#define WIDTH		1920
+#define HEIGHT		1080
+
+#define SPRITE_SIZE	64
+#define MEASURE_USECS	1000000		// run each operation for about one second
+
+static const char FromKernel[] = "kernel";
+
+static const char Text[] = "The quick brown fox jumps over !";	// 32 characters
+
+static const struct
+{
+	const char *pName;
+	unsigned nPixels;		// per operation
+}
+s_Operation[] =
+{
+	{"ClearScreen",		WIDTH * HEIGHT},
+	{"DrawRect",		SPRITE_SIZE * SPRITE_SIZE},
+	{"DrawRectAlpha",	SPRITE_SIZE * SPRITE_SIZE},
+	{"DrawImage",		SPRITE_SIZE * SPRITE_SIZE},
+	{"DrawImageTransparent", SPRITE_SIZE * SPRITE_SIZE},
+	{"DrawText",		0},	// depends on the font, see Measure()
+	{"DrawLine",		201},
+	{"DrawCircle",		3205}	// pixels inside radius 32
+};
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer)
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+	m_Logger.Write (FromKernel, LogNotice, "Drawing into memory with %ux%u pixels",
+			WIDTH, HEIGHT);
+
+	RunBenchmark (CDisplay::ARGB8888, "ARGB8888");
+	RunBenchmark (CDisplay::RGB565, "RGB565");
+	RunBenchmark (CDisplay::I8, "I8");
+	RunBenchmark (CDisplay::I1, "I1");
+
+	m_Logger.Write (FromKernel, LogNotice, "Benchmark finished");
+
+	return ShutdownHalt;
+}
+
+void CKernel::RunBenchmark (CDisplay::TColorModel ColorModel, const char *pName)
+{
+	CMemoryDisplay Display (WIDTH, HEIGHT, ColorModel);
+
+	C2DGraphics Graphics (&Display);
+	if (!Graphics.Initialize ())
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Cannot initialize 2D graphics");
+	}
+
+	// sprite with a transparent (black) frame and a checker board pattern
+	T2DColor *pSpriteData = new T2DColor[SPRITE_SIZE * SPRITE_SIZE];
+	assert (pSpriteData != 0);
+	for (unsigned y = 0; y < SPRITE_SIZE; y++)
+	{
+		for (unsigned x = 0; x < SPRITE_SIZE; x++)
+		{
+			T2DColor Color = (x / 8 + y / 8) & 1 ? CDisplay::BrightYellow
+							     : CDisplay::BrightBlue;
+			if (   x < 4 || x >= SPRITE_SIZE-4
+			    || y < 4 || y >= SPRITE_SIZE-4)
+			{
+				Color = CDisplay::Black;
+			}
+
+			pSpriteData[y * SPRITE_SIZE + x] = Color;
+		}
+	}
+
+	C2DImage Sprite (&Graphics);
+	Sprite.Set (SPRITE_SIZE, SPRITE_SIZE, pSpriteData);
+	delete [] pSpriteData;
+
+	m_Logger.Write (FromKernel, LogNotice, "Color model %s (%u bits)",
+			pName, Display.GetDepth ());
+
+	for (unsigned i = 0; i < OperationUnknown; i++)
+	{
+		Measure (&Graphics, &Sprite, (TOperation) i);
+	}
+}
+
+void CKernel::Measure (C2DGraphics *pGraphics, C2DImage *pSprite, TOperation Operation)
+{
+	assert (pGraphics != 0);
+	assert (pSprite != 0);
+	assert (Operation < OperationUnknown);
+
+	unsigned nOperations = 0;
+	unsigned nStartTicks = m_Timer.GetClockTicks ();
+	unsigned nTicks;
+
+	do
+	{
+		// positions cover the whole screen, but primitives are not clipped
+		unsigned x = nOperations * 37 % (WIDTH - 300);
+		unsigned y = nOperations * 53 % (HEIGHT - 200);
+		T2DColor Color = nOperations & 1 ? CDisplay::BrightWhite : CDisplay::Red;
+
+		switch (Operation)
+		{
+		case OperationClearScreen:
+			pGraphics->ClearScreen (Color);
+			break;
+
+		case OperationRect:
+			pGraphics->DrawRect (x, y, SPRITE_SIZE, SPRITE_SIZE, Color);
+			break;
+
+		case OperationRectAlpha:
+			pGraphics->DrawRectAlpha (x, y, SPRITE_SIZE, SPRITE_SIZE, Color, 160);
+			break;
+
+		case OperationImage:
+			pGraphics->DrawImage (x, y, SPRITE_SIZE, SPRITE_SIZE, pSprite->GetPixels ());
+			break;
+
+		case OperationImageTransparent:
+			pGraphics->DrawImageTransparent (x, y, SPRITE_SIZE, SPRITE_SIZE,
+							 pSprite->GetPixels (), CDisplay::Black);
+			break;
+
+		case OperationText:
+			pGraphics->DrawText (x, y, Color, Text);
+			break;
+
+		case OperationLine:
+			pGraphics->DrawLine (x, y, x + 200, y + 100, Color);
+			break;
+
+		case OperationCircle:
+			pGraphics->DrawCircle (x + 32, y + 32, 32, Color);
+			break;
+
+		default:
+			assert (0);
+			break;
+		}
+
+		nOperations++;
+
+		nTicks = m_Timer.GetClockTicks () - nStartTicks;
+	}
+	while (nTicks < MEASURE_USECS);
+
+	unsigned nPerSecond = (unsigned) ((u64) nOperations * 1000000 / nTicks);
+
+	// pixels per microsecond is MPixel per second
+	unsigned nPixels = s_Operation[Operation].nPixels;
+	if (Operation == OperationText)
+	{
+		CCharGenerator Font (DEFAULT_FONT);
+		nPixels = (sizeof Text - 1) * Font.GetCharWidth () * Font.GetUnderline ();
+	}
+
+	m_Logger.Write (FromKernel, LogNotice, "%-20s %8u ops/s %6u MPixel/s",
+			s_Operation[Operation].pName, nPerSecond,
+			(unsigned) ((u64) nOperations * nPixels / nTicks));
+}
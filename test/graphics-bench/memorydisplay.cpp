@@ -0,0 +1,68 @@
+//
+// memorydisplay.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "memorydisplay.h"
+#include <assert.h>
+
+CMemoryDisplay::CMemoryDisplay (unsigned nWidth, unsigned nHeight, TColorModel ColorModel)
+:	CDisplay (ColorModel),
+	m_nWidth (nWidth),
+	m_nHeight (nHeight)
+{
+	switch (ColorModel)
+	{
+	case RGB565:
+	case RGB565_BE:	m_nDepth = 16;	break;
+	case ARGB8888:	m_nDepth = 32;	break;
+	case I1:	m_nDepth = 1;	break;
+	case I8:	m_nDepth = 8;	break;
+
+	default:
+		assert (0);
+		break;
+	}
+}
+
+unsigned CMemoryDisplay::GetWidth (void) const
+{
+	return m_nWidth;
+}
+
+unsigned CMemoryDisplay::GetHeight (void) const
+{
+	return m_nHeight;
+}
+
+unsigned CMemoryDisplay::GetDepth (void) const
+{
+	return m_nDepth;
+}
+
+void CMemoryDisplay::SetPixel (unsigned nPosX, unsigned nPosY, TRawColor nColor)
+{
+}
+
+void CMemoryDisplay::SetArea (const TArea &rArea, const void *pPixels,
+			      TAreaCompletionRoutine *pRoutine, void *pParam)
+{
+	if (pRoutine != nullptr)
+	{
+		(*pRoutine) (pParam);
+	}
+}
@@ -0,0 +1,47 @@
+//
+// memorydisplay.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _memorydisplay_h
+#define _memorydisplay_h
+
+#include <circle/display.h>
+#include <circle/types.h>
+
+class CMemoryDisplay : public CDisplay	/// Display without hardware, which discards all output
+{
+public:
+	CMemoryDisplay (unsigned nWidth, unsigned nHeight, TColorModel ColorModel);
+
+	unsigned GetWidth (void) const;
+	unsigned GetHeight (void) const;
+	unsigned GetDepth (void) const;
+
+	void SetPixel (unsigned nPosX, unsigned nPosY, TRawColor nColor);
+
+	void SetArea (const TArea &rArea, const void *pPixels,
+		      TAreaCompletionRoutine *pRoutine = nullptr,
+		      void *pParam = nullptr);
+
+private:
+	unsigned m_nWidth;
+	unsigned m_nHeight;
+	unsigned m_nDepth;
+};
+
+#endif
@@ -0,0 +1,98 @@
+//
+// emulateddisplay.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "emulateddisplay.h"
+#include <circle/timer.h>
+#include <circle/util.h>
+#include <assert.h>
+
+CEmulatedDisplay::CEmulatedDisplay (unsigned nWidth, unsigned nHeight,
+				    unsigned nSPIClockKHz, unsigned nAreaOverheadUsecs)
+:	CDisplay (RGB565),
+	m_nWidth (nWidth),
+	m_nHeight (nHeight),
+	m_nSPIClockKHz (nSPIClockKHz),
+	m_nAreaOverheadUsecs (nAreaOverheadUsecs),
+	m_pPixels (new u16[nWidth * nHeight])
+{
+	assert (m_nSPIClockKHz > 0);
+	assert (m_pPixels != 0);
+	memset (m_pPixels, 0, m_nWidth * m_nHeight * sizeof (u16));
+}
+
+CEmulatedDisplay::~CEmulatedDisplay (void)
+{
+	delete [] m_pPixels;
+	m_pPixels = 0;
+}
+
+unsigned CEmulatedDisplay::GetWidth (void) const
+{
+	return m_nWidth;
+}
+
+unsigned CEmulatedDisplay::GetHeight (void) const
+{
+	return m_nHeight;
+}
+
+unsigned CEmulatedDisplay::GetDepth (void) const
+{
+	return 16;
+}
+
+void CEmulatedDisplay::SetPixel (unsigned nPosX, unsigned nPosY, TRawColor nColor)
+{
+	TArea Area {nPosX, nPosX, nPosY, nPosY};
+	u16 usColor = (u16) nColor;
+
+	SetArea (Area, &usColor);
+}
+
+void CEmulatedDisplay::SetArea (const TArea &rArea, const void *pPixels,
+				TAreaCompletionRoutine *pRoutine, void *pParam)
+{
+	assert (rArea.x1 <= rArea.x2 && rArea.x2 < m_nWidth);
+	assert (rArea.y1 <= rArea.y2 && rArea.y2 < m_nHeight);
+	assert (pPixels != 0);
+
+	unsigned nWidth = rArea.x2 - rArea.x1 + 1;
+	unsigned nHeight = rArea.y2 - rArea.y1 + 1;
+
+	const u16 *pFrom = static_cast<const u16 *> (pPixels);
+	for (unsigned y = rArea.y1; y <= rArea.y2; y++, pFrom += nWidth)
+	{
+		memcpy (&m_pPixels[y * m_nWidth + rArea.x1], pFrom, nWidth * sizeof (u16));
+	}
+
+	// 16 bits per pixel are shifted out
+	unsigned nBits = nWidth * nHeight * 16;
+	CTimer::SimpleusDelay (m_nAreaOverheadUsecs + nBits / m_nSPIClockKHz * 1000
+			       + nBits % m_nSPIClockKHz * 1000 / m_nSPIClockKHz);
+
+	if (pRoutine != nullptr)
+	{
+		(*pRoutine) (pParam);
+	}
+}
+
+const u16 *CEmulatedDisplay::GetPixels (void) const
+{
+	return m_pPixels;
+}
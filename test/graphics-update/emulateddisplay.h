@@ -0,0 +1,58 @@
+//
+// emulateddisplay.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _emulateddisplay_h
+#define _emulateddisplay_h
+
+#include <circle/display.h>
+#include <circle/types.h>
+
+class CEmulatedDisplay : public CDisplay	/// RGB565 display in memory with SPI timing
+{
+public:
+	/// \param nSPIClockKHz Emulated SPI clock
+	/// \param nAreaOverheadUsecs Emulated duration of the commands for each area
+	CEmulatedDisplay (unsigned nWidth, unsigned nHeight,
+			  unsigned nSPIClockKHz, unsigned nAreaOverheadUsecs);
+
+	~CEmulatedDisplay (void);
+
+	unsigned GetWidth (void) const;
+	unsigned GetHeight (void) const;
+	unsigned GetDepth (void) const;
+
+	void SetPixel (unsigned nPosX, unsigned nPosY, TRawColor nColor);
+
+	void SetArea (const TArea &rArea, const void *pPixels,
+		      TAreaCompletionRoutine *pRoutine = nullptr,
+		      void *pParam = nullptr);
+
+	/// \return Pointer to the emulated display memory
+	const u16 *GetPixels (void) const;
+
+private:
+	unsigned m_nWidth;
+	unsigned m_nHeight;
+	unsigned m_nSPIClockKHz;
+	unsigned m_nAreaOverheadUsecs;
+
+	u16 *m_pPixels;
+};
+
+#endif
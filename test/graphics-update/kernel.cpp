@@ -0,0 +1,222 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <circle/string.h>
+#include <circle/util.h>
+#include <assert.h>
+
+#define WIDTH			320
+#define HEIGHT			240
+#define SPI_CLOCK_KHZ		62500
+#define AREA_OVERHEAD_USECS	20
+
+#define FRAMES			300
+
+#define SPRITE_SIZE		32
+#define SPRITE_TOP		40		// the sprite moves between these lines
+#define SPRITE_BOTTOM		200
+
+#define BACKGROUND_COLOR	COLOR2D (0, 0, 64)
+#define BAR_COLOR		COLOR2D (0, 32, 0)
+#define PROGRESS_COLOR		COLOR2D (0, 192, 0)
+
+static const char FromKernel[] = "kernel";
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer),
+	m_Display (WIDTH, HEIGHT, SPI_CLOCK_KHZ, AREA_OVERHEAD_USECS),
+	m_2DGraphics (&m_Display),
+	m_Sprite (&m_2DGraphics),
+	m_nSpriteX (0),
+	m_nSpriteY (SPRITE_TOP),
+	m_nSpriteDX (3),
+	m_nSpriteDY (2)
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_2DGraphics.Initialize ();
+	}
+
+	if (bOK)
+	{
+		// ball with a transparent (black) background
+		T2DColor SpriteData[SPRITE_SIZE * SPRITE_SIZE];
+		for (int y = 0; y < SPRITE_SIZE; y++)
+		{
+			for (int x = 0; x < SPRITE_SIZE; x++)
+			{
+				int dx = x - SPRITE_SIZE/2;
+				int dy = y - SPRITE_SIZE/2;
+
+				SpriteData[y * SPRITE_SIZE + x] =
+					  dx * dx + dy * dy < SPRITE_SIZE/2 * SPRITE_SIZE/2
+					? CDisplay::BrightYellow : CDisplay::Black;
+			}
+		}
+
+		m_Sprite.Set (SPRITE_SIZE, SPRITE_SIZE, SpriteData);
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+	m_Logger.Write (FromKernel, LogNotice, "Emulated display %ux%u, %u kHz SPI clock",
+			WIDTH, HEIGHT, SPI_CLOCK_KHZ);
+
+	DrawBackground ();
+
+	m_2DGraphics.EnableDirtyTracking (FALSE);
+	RunFrames ("Full update");
+
+	m_2DGraphics.EnableDirtyTracking (TRUE);
+	RunFrames ("Dirty areas");
+
+	// compare the emulated display with the drawing buffer
+	const void *pBuffer = m_2DGraphics.GetBuffer ();
+	if (memcmp (m_Display.GetPixels (), pBuffer, WIDTH * HEIGHT * sizeof (u16)) == 0)
+	{
+		m_Logger.Write (FromKernel, LogNotice, "Display content is valid");
+	}
+	else
+	{
+		m_Logger.Write (FromKernel, LogError, "Display content is invalid");
+	}
+
+	return ShutdownHalt;
+}
+
+void CKernel::DrawBackground (void)
+{
+	m_2DGraphics.ClearScreen (BACKGROUND_COLOR);
+	m_2DGraphics.DrawRect (0, 0, WIDTH, 32, CDisplay::Blue);
+	m_2DGraphics.DrawText (WIDTH-10, 8, CDisplay::BrightWhite, "Dashboard",
+			       C2DGraphics::AlignRight);
+	m_2DGraphics.DrawRectOutline (8, 208, WIDTH-16, 16, CDisplay::White);
+
+	m_2DGraphics.UpdateDisplay ();
+}
+
+void CKernel::DrawFrame (unsigned nFrame)
+{
+	// frame counter
+	CString Text;
+	Text.Format ("Frame %05u", nFrame);
+	m_2DGraphics.DrawRect (10, 8, 120, 16, CDisplay::Blue);
+	m_2DGraphics.DrawText (10, 8, CDisplay::BrightWhite, Text);
+
+	// progress bar
+	unsigned nProgress = nFrame % (WIDTH-20);
+	m_2DGraphics.DrawRect (10, 210, WIDTH-20, 12, BAR_COLOR);
+	m_2DGraphics.DrawRect (10, 210, nProgress, 12, PROGRESS_COLOR);
+
+	// moving sprite
+	m_2DGraphics.DrawRect (m_nSpriteX, m_nSpriteY, SPRITE_SIZE, SPRITE_SIZE, BACKGROUND_COLOR);
+
+	m_nSpriteX += m_nSpriteDX;
+	if (m_nSpriteX < 0 || m_nSpriteX > WIDTH - SPRITE_SIZE)
+	{
+		m_nSpriteDX = -m_nSpriteDX;
+		m_nSpriteX += 2 * m_nSpriteDX;
+	}
+
+	m_nSpriteY += m_nSpriteDY;
+	if (m_nSpriteY < SPRITE_TOP || m_nSpriteY > SPRITE_BOTTOM - SPRITE_SIZE)
+	{
+		m_nSpriteDY = -m_nSpriteDY;
+		m_nSpriteY += 2 * m_nSpriteDY;
+	}
+
+	m_2DGraphics.DrawImageTransparent (m_nSpriteX, m_nSpriteY, SPRITE_SIZE, SPRITE_SIZE,
+					   m_Sprite.GetPixels (), CDisplay::Black);
+}
+
+void CKernel::RunFrames (const char *pName)
+{
+	m_2DGraphics.ResetStats ();
+
+	unsigned nStartTicks = m_Timer.GetClockTicks ();
+
+	for (unsigned nFrame = 0; nFrame < FRAMES; nFrame++)
+	{
+		DrawFrame (nFrame);
+
+		m_2DGraphics.UpdateDisplay ();
+	}
+
+	unsigned nTicks = m_Timer.GetClockTicks () - nStartTicks;
+
+	T2DGraphicsStats Stats;
+	m_2DGraphics.GetStats (&Stats);
+	assert (Stats.nUpdates == FRAMES);
+
+	m_Logger.Write (FromKernel, LogNotice,
+			"%s: update %u us avg, %u us max, %u pixels and %u areas per frame, %u fps",
+			pName, Stats.nUpdateUsecsAvg, Stats.nUpdateUsecsMax,
+			(unsigned) (Stats.ullPixels / FRAMES), Stats.nAreas / FRAMES,
+			(unsigned) ((u64) FRAMES * 1000000 / nTicks));
+}
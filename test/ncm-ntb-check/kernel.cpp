@@ -0,0 +1,387 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <circle/usb/usbcdcncm.h>
+#include <circle/netdevice.h>
+#include <circle/util.h>
+#include <assert.h>
+
+#define NTB_BUFFER_SIZE		0x20000		// allows NTB32 above 64K
+#define MIN_DATAGRAM_SIZE	14		// Ethernet header only
+#define MAX_DATAGRAM_SIZE	1514
+#define MAX_DATAGRAMS		64		// per NTB, must be >= CUSBCDCNCMWriter::MaxDatagrams
+#define ROUND_TRIP_NTBS		100		// per parameter set
+#define FUZZ_ITERATIONS		20000
+#define GUARD_BYTE		0xEE		// behind the NTB, removed from inside
+
+LOGMODULE ("kernel");
+
+static u32 s_NTB[NTB_BUFFER_SIZE / sizeof (u32) + 1];	// 32-bit aligned, with guard word
+static u8 s_Datagram[FRAME_BUFFER_SIZE];
+static u8 s_Received[FRAME_BUFFER_SIZE];
+static unsigned s_DatagramLength[MAX_DATAGRAMS];
+
+static u32 s_nRandom = 1;
+
+static unsigned Random (unsigned nRange)
+{
+	// xorshift32
+	s_nRandom ^= s_nRandom << 13;
+	s_nRandom ^= s_nRandom >> 17;
+	s_nRandom ^= s_nRandom << 5;
+
+	return s_nRandom % nRange;
+}
+
+// the contents of a datagram depend on its sequence number and length only
+static void FillDatagram (u8 *pBuffer, unsigned nLength, unsigned nSequence)
+{
+	for (unsigned i = 0; i < nLength; i++)
+	{
+		pBuffer[i] = (u8) (nSequence * 31 + i * 7 + nLength);
+	}
+}
+
+static boolean ContainsByte (const u8 *pBuffer, unsigned nLength, u8 uchByte)
+{
+	for (unsigned i = 0; i < nLength; i++)
+	{
+		if (pBuffer[i] == uchByte)
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer)
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	LOGNOTE ("Compile time: " __DATE__ " " __TIME__);
+
+	unsigned nFailed = 0;
+
+	for (unsigned nFormat = 0; nFormat <= 1; nFormat++)
+	{
+		boolean bNTB32 = nFormat == 1;
+
+		// NTB size, divisor, remainder, NDP alignment, max. datagrams
+		nFailed += !TestRoundTrip (bNTB32, 2048, 4, 0, 4, 0);
+		nFailed += !TestRoundTrip (bNTB32, 16384, 4, 0, 4, 0);
+		nFailed += !TestRoundTrip (bNTB32, 16384, 4, 2, 4, 0);	// IP header aligned
+		nFailed += !TestRoundTrip (bNTB32, 16384, 512, 14, 16, 0);
+		nFailed += !TestRoundTrip (bNTB32, 16384, 4, 0, 4, 5);
+		nFailed += !TestRoundTrip (bNTB32, 16384, 3, 7, 2, 0);	// invalid, corrected
+		nFailed += !TestRoundTrip (bNTB32, 0xFFFF, 4, 0, 4, 0);
+		if (bNTB32)
+		{
+			nFailed += !TestRoundTrip (bNTB32, NTB_BUFFER_SIZE, 4, 0, 4, 0);
+		}
+
+		nFailed += !TestFuzzing (bNTB32);
+	}
+
+	if (nFailed == 0)
+	{
+		LOGNOTE ("All tests passed");
+	}
+	else
+	{
+		LOGERR ("%u test(s) failed", nFailed);
+	}
+
+	return ShutdownHalt;
+}
+
+boolean CKernel::TestRoundTrip (boolean bNTB32, unsigned nSize, unsigned nDivisor,
+				unsigned nRemainder, unsigned nAlignment, unsigned nMaxDatagrams)
+{
+	assert (nSize <= NTB_BUFFER_SIZE);
+
+	CUSBCDCNCMWriter Writer;
+	Writer.Setup (s_NTB, nSize, bNTB32, nDivisor, nRemainder, nAlignment, nMaxDatagrams);
+
+	unsigned nDatagrams = 0;
+	unsigned nSequence = 0;
+	for (unsigned nNTB = 0; nNTB < ROUND_TRIP_NTBS; nNTB++)
+	{
+		// fill the NTB, until the next datagram does not fit any more
+		unsigned nFirstSequence = nSequence;
+		unsigned nCount = 0;
+		while (1)
+		{
+			unsigned nLength =   MIN_DATAGRAM_SIZE
+					   + Random (MAX_DATAGRAM_SIZE - MIN_DATAGRAM_SIZE + 1);
+			FillDatagram (s_Datagram, nLength, nSequence);
+
+			if (!Writer.AddDatagram (s_Datagram, nLength))
+			{
+				break;
+			}
+
+			assert (nCount < MAX_DATAGRAMS);
+			s_DatagramLength[nCount++] = nLength;
+			nSequence++;
+		}
+
+		if (nCount == 0)
+		{
+			LOGERR ("NTB%s (size %u): Empty NTB", bNTB32 ? "32" : "16", nSize);
+
+			return FALSE;
+		}
+
+		if (   nMaxDatagrams != 0
+		    && nCount > nMaxDatagrams)
+		{
+			LOGERR ("NTB%s (size %u): Too many datagrams (%u)",
+				bNTB32 ? "32" : "16", nSize, nCount);
+
+			return FALSE;
+		}
+
+		unsigned nLength = Writer.Finish ();
+		if (   nLength == 0
+		    || nLength > nSize
+		    || (!bNTB32 && nLength > 0xFFFF))
+		{
+			LOGERR ("NTB%s (size %u): Invalid NTB length (%u)",
+				bNTB32 ? "32" : "16", nSize, nLength);
+
+			return FALSE;
+		}
+
+		CUSBCDCNCMReader Reader;
+		if (!Reader.SetBlock (s_NTB, nLength))
+		{
+			LOGERR ("NTB%s (size %u): Invalid NTB header", bNTB32 ? "32" : "16", nSize);
+
+			return FALSE;
+		}
+
+		for (unsigned i = 0; i < nCount; i++)
+		{
+			unsigned nReceived;
+			if (!Reader.GetDatagram (s_Received, &nReceived, sizeof s_Received))
+			{
+				LOGERR ("NTB%s (size %u): Datagram %u of %u missing",
+					bNTB32 ? "32" : "16", nSize, i, nCount);
+
+				return FALSE;
+			}
+
+			FillDatagram (s_Datagram, s_DatagramLength[i], nFirstSequence + i);
+
+			if (   nReceived != s_DatagramLength[i]
+			    || memcmp (s_Received, s_Datagram, nReceived) != 0)
+			{
+				LOGERR ("NTB%s (size %u): Datagram %u differs",
+					bNTB32 ? "32" : "16", nSize, i);
+
+				return FALSE;
+			}
+		}
+
+		unsigned nReceived;
+		if (Reader.GetDatagram (s_Received, &nReceived, sizeof s_Received))
+		{
+			LOGERR ("NTB%s (size %u): Unexpected datagram", bNTB32 ? "32" : "16", nSize);
+
+			return FALSE;
+		}
+
+		nDatagrams += nCount;
+	}
+
+	LOGNOTE ("NTB%s (size %u, divisor %u, remainder %u, alignment %u, max %u): "
+		 "%u datagrams OK", bNTB32 ? "32" : "16", nSize, nDivisor, nRemainder,
+		 nAlignment, nMaxDatagrams, nDatagrams);
+
+	return TRUE;
+}
+
+boolean CKernel::TestFuzzing (boolean bNTB32)
+{
+	const unsigned nSize = 16384;
+	u8 *pNTB = (u8 *) s_NTB;
+
+	CUSBCDCNCMWriter Writer;
+
+	unsigned nAccepted = 0;
+	unsigned nDatagrams = 0;
+	for (unsigned nIteration = 0; nIteration < FUZZ_ITERATIONS; nIteration++)
+	{
+		// build a valid NTB with a random number of datagrams
+		Writer.Setup (s_NTB, nSize, bNTB32, 4, Random (4), 4 << Random (3));
+
+		unsigned nCount = 1 + Random (MAX_DATAGRAMS);
+		for (unsigned i = 0; i < nCount; i++)
+		{
+			unsigned nLength = 1 + Random (MAX_DATAGRAM_SIZE);
+			FillDatagram (s_Datagram, nLength, i);
+
+			if (!Writer.AddDatagram (s_Datagram, nLength))
+			{
+				break;
+			}
+		}
+
+		unsigned nLength = Writer.Finish ();
+		assert (nLength != 0);
+
+		// modify some bytes, with a preference for the headers and the NDP
+		unsigned nModify = 1 + Random (8);
+		for (unsigned i = 0; i < nModify; i++)
+		{
+			unsigned nOffset;
+			switch (Random (3))
+			{
+			case 0:
+				nOffset = Random (32);
+				break;
+
+			case 1:
+				nOffset = nLength - 1 - Random (nLength < 64 ? nLength : 64);
+				break;
+
+			default:
+				nOffset = Random (nLength);
+				break;
+			}
+
+			pNTB[nOffset] = (u8) Random (0x100);
+		}
+
+		// sometimes the NTB is truncated
+		if (Random (4) == 0)
+		{
+			nLength = Random (nLength + 1);
+		}
+
+		// the guard byte may occur in header fields, which is changed here too
+		for (unsigned i = 0; i < nLength; i++)
+		{
+			if (pNTB[i] == GUARD_BYTE)
+			{
+				pNTB[i] = 0xFF;
+			}
+		}
+
+		memset (pNTB + nLength, GUARD_BYTE, sizeof s_NTB - nLength);
+
+		// the reader is given a buffer, which may be too small for some datagrams
+		unsigned nBufferSize = Random (2) ? sizeof s_Received : 1 + Random (sizeof s_Received);
+
+		CUSBCDCNCMReader Reader;
+		if (!Reader.SetBlock (pNTB, nLength))
+		{
+			continue;
+		}
+
+		nAccepted++;
+
+		unsigned nReceived;
+		unsigned nCalls = 0;
+		while (Reader.GetDatagram (s_Received, &nReceived, nBufferSize))
+		{
+			if (++nCalls > nLength)
+			{
+				LOGERR ("NTB%s fuzzing: Reader does not terminate (iteration %u)",
+					bNTB32 ? "32" : "16", nIteration);
+
+				return FALSE;
+			}
+
+			if (   nReceived == 0
+			    || nReceived > nBufferSize)
+			{
+				LOGERR ("NTB%s fuzzing: Invalid datagram length %u (iteration %u)",
+					bNTB32 ? "32" : "16", nReceived, nIteration);
+
+				return FALSE;
+			}
+
+			if (ContainsByte (s_Received, nReceived, GUARD_BYTE))
+			{
+				LOGERR ("NTB%s fuzzing: Datagram exceeds NTB (iteration %u)",
+					bNTB32 ? "32" : "16", nIteration);
+
+				return FALSE;
+			}
+		}
+
+		nDatagrams += nCalls;
+	}
+
+	LOGNOTE ("NTB%s fuzzing: %u iterations (%u NTBs accepted, %u datagrams) OK",
+		 bNTB32 ? "32" : "16", FUZZ_ITERATIONS, nAccepted, nDatagrams);
+
+	return TRUE;
+}
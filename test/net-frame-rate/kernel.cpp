@@ -0,0 +1,213 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <circle/macaddress.h>
+#include <circle/synchronize.h>
+#include <circle/util.h>
+#include <assert.h>
+
+#define MEASURE_SECS	10		// duration of each measurement
+#define TX_FRAME_SIZE	1514		// maximum frame size without FCS
+#define TX_ETHER_TYPE	0x88B5		// local experimental EtherType
+
+LOGMODULE ("kernel");
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer),
+	m_USBHCI (&m_Interrupt, &m_Timer)
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_USBHCI.Initialize ();
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	LOGNOTE ("Compile time: " __DATE__ " " __TIME__);
+
+	CNetDevice *pNetDevice = CNetDevice::GetNetDevice (NetDeviceTypeEthernet);
+	if (pNetDevice == 0)
+	{
+		LOGERR ("Ethernet device not found");
+
+		return ShutdownHalt;
+	}
+
+	LOGNOTE ("Waiting for link");
+
+	while (!pNetDevice->IsLinkUp ())
+	{
+		m_Timer.MsDelay (100);
+	}
+
+	LOGNOTE ("Link is up (%s)", CNetDevice::GetSpeedString (pNetDevice->GetLinkSpeed ()));
+
+	MeasureReceive (pNetDevice);
+	MeasureSend (pNetDevice);
+
+	LOGNOTE ("Test finished");
+
+	return ShutdownHalt;
+}
+
+void CKernel::MeasureReceive (CNetDevice *pNetDevice)
+{
+	assert (pNetDevice != 0);
+
+	LOGNOTE ("Receiving frames for %u seconds", MEASURE_SECS);
+
+	DMA_BUFFER (u8, Buffer, FRAME_BUFFER_SIZE);
+
+	u64 ullTotalFrames = 0;
+	u64 ullTotalBytes = 0;
+
+	for (unsigned nSecond = 0; nSecond < MEASURE_SECS; nSecond++)
+	{
+		unsigned nFrames = 0;
+		unsigned nBytes = 0;
+
+		unsigned nStartTicks = CTimer::GetClockTicks ();
+		while (CTimer::GetClockTicks () - nStartTicks < CLOCKHZ)
+		{
+			unsigned nLength;
+			if (pNetDevice->ReceiveFrame (Buffer, &nLength))
+			{
+				nFrames++;
+				nBytes += nLength;
+			}
+		}
+
+		LOGNOTE ("RX: %u frames/s, %u.%02u Mbit/s", nFrames,
+			 nBytes / 125000, nBytes / 1250 % 100);
+
+		ullTotalFrames += nFrames;
+		ullTotalBytes += nBytes;
+	}
+
+	LOGNOTE ("RX average: %lu frames/s, %lu bytes/frame",
+		 (unsigned long) (ullTotalFrames / MEASURE_SECS),
+		 ullTotalFrames ? (unsigned long) (ullTotalBytes / ullTotalFrames) : 0UL);
+}
+
+void CKernel::MeasureSend (CNetDevice *pNetDevice)
+{
+	assert (pNetDevice != 0);
+
+	LOGNOTE ("Sending broadcast frames for %u seconds", MEASURE_SECS);
+
+	DMA_BUFFER (u8, Frame, FRAME_BUFFER_SIZE);
+	DMA_BUFFER (u8, Buffer, FRAME_BUFFER_SIZE);
+	memset (Frame, 0, TX_FRAME_SIZE);
+
+	CMACAddress Broadcast;
+	Broadcast.SetBroadcast ();
+	Broadcast.CopyTo (Frame);
+
+	const CMACAddress *pMACAddress = pNetDevice->GetMACAddress ();
+	assert (pMACAddress != 0);
+	pMACAddress->CopyTo (Frame + MAC_ADDRESS_SIZE);
+
+	Frame[2*MAC_ADDRESS_SIZE] = TX_ETHER_TYPE >> 8;
+	Frame[2*MAC_ADDRESS_SIZE+1] = TX_ETHER_TYPE & 0xFF;
+
+	u64 ullTotalFrames = 0;
+	unsigned nTotalFailed = 0;
+
+	for (unsigned nSecond = 0; nSecond < MEASURE_SECS; nSecond++)
+	{
+		unsigned nFrames = 0;
+
+		unsigned nStartTicks = CTimer::GetClockTicks ();
+		while (CTimer::GetClockTicks () - nStartTicks < CLOCKHZ)
+		{
+			// discard received frames, so that the RX ring does not block
+			unsigned nLength;
+			pNetDevice->ReceiveFrame (Buffer, &nLength);
+
+			if (!pNetDevice->IsSendFrameAdvisable ())
+			{
+				continue;
+			}
+
+			if (pNetDevice->SendFrame (Frame, TX_FRAME_SIZE))
+			{
+				nFrames++;
+			}
+			else
+			{
+				nTotalFailed++;
+			}
+		}
+
+		LOGNOTE ("TX: %u frames/s, %u Mbit/s", nFrames, nFrames * TX_FRAME_SIZE / 125000);
+
+		ullTotalFrames += nFrames;
+	}
+
+	LOGNOTE ("TX average: %lu frames/s (%u failed)",
+		 (unsigned long) (ullTotalFrames / MEASURE_SECS), nTotalFailed);
+}
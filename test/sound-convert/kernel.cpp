@@ -0,0 +1,937 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <circle/machineinfo.h>
+#include <circle/sysconfig.h>
+#include <circle/util.h>
+#include <assert.h>
+
+#define SAMPLE_RATE	192000
+#define PWM_RANGE	2268		// some value, not a power of 2
+
+#define BLOCK_FRAMES	384		// multiple of IEC958_FRAMES_PER_BLOCK
+#define MAX_CHANNELS	8
+#define ITERATIONS	500
+#define RUNS		3
+#define CHECK_ROUNDS	4		// each round starts at another ring buffer position
+
+static const char FromKernel[] = "kernel";
+
+static const char *s_pFormatName[] = {"U8", "S16", "S24", "S24_32", "U32", "IEC958"};
+
+// the reference conversion may read one 32-bit word from a 24-bit sample at the end
+static u8 s_Samples[BLOCK_FRAMES * MAX_CHANNELS * SOUND_MAX_SAMPLE_SIZE + SOUND_MAX_SAMPLE_SIZE];
+static u32 s_HWBuffer[BLOCK_FRAMES * MAX_CHANNELS + 1];
+static u8 s_ReadBuffer[BLOCK_FRAMES * MAX_CHANNELS * SOUND_MAX_SAMPLE_SIZE];
+static u8 s_RefBuffer[BLOCK_FRAMES * MAX_CHANNELS * SOUND_MAX_SAMPLE_SIZE];
+
+static unsigned SampleSize (TSoundFormat Format)
+{
+	return   Format == SoundFormatUnsigned8 ? 1
+	       : Format == SoundFormatSigned16 ? 2
+	       : Format == SoundFormatSigned24 ? 3 : 4;
+}
+
+// Reference conversion //////////////////////////////////////////////
+//
+// This is the per-sample conversion, which has been used by CSoundBaseDevice
+// before the conversion of blocks of frames. Only packed 24-bit samples are
+// stored with three bytes here. The previous code stored a 32-bit word, which
+// has been overwritten by the next sample, but not with swapped channels.
+
+static void RefConvertSoundFormat (void *pTo, const void *pFrom, TSoundFormat WriteFormat,
+				   TSoundFormat HWFormat, int nRangeMax)
+{
+	s32 nValue = 0;
+
+	switch (WriteFormat)
+	{
+	case SoundFormatUnsigned8: {
+		const u8 *pValue = reinterpret_cast<const u8 *> (pFrom);
+		nValue = *pValue;
+		nValue -= 128;
+		nValue <<= 24;
+		} break;
+
+	case SoundFormatSigned16: {
+		s16 nSample;
+		memcpy (&nSample, pFrom, sizeof nSample);
+		nValue = nSample;
+		nValue <<= 16;
+		} break;
+
+	case SoundFormatSigned24:
+	case SoundFormatSigned24_32: {
+		u32 nSample;
+		memcpy (&nSample, pFrom, sizeof nSample);
+		nValue = nSample & 0xFFFFFF;
+		nValue <<= 8;
+		} break;
+
+	default:
+		assert (0);
+		break;
+	}
+
+	switch (HWFormat)
+	{
+	case SoundFormatSigned16: {
+		s16 nSample = nValue >> 16;
+		memcpy (pTo, &nSample, sizeof nSample);
+		} break;
+
+	case SoundFormatSigned24:
+		nValue >>= 8;
+		memcpy (pTo, &nValue, 3);
+		break;
+
+	case SoundFormatSigned24_32:
+		nValue >>= 8;
+		memcpy (pTo, &nValue, sizeof nValue);
+		break;
+
+	case SoundFormatUnsigned32: {
+		s64 llValue = (s64) nValue;
+		llValue += 1U << 31;
+		llValue *= nRangeMax;
+		llValue >>= 32;
+
+		u32 nSample = (u32) llValue;
+		memcpy (pTo, &nSample, sizeof nSample);
+		} break;
+
+	case SoundFormatIEC958:
+		nValue >>= 4;
+		nValue &= 0xFFFFFF0;
+		if (parity32 (nValue))
+		{
+			nValue |= 0x80000000;
+		}
+
+		memcpy (pTo, &nValue, sizeof nValue);
+		break;
+
+	default:
+		assert (0);
+		break;
+	}
+}
+
+static void RefConvertReadSoundFormat (void *pTo, const void *pFrom, TSoundFormat HWFormat,
+				       TSoundFormat ReadFormat)
+{
+	u32 nValue = 0;
+
+	switch (HWFormat)
+	{
+	case SoundFormatSigned16: {
+		s16 nSample;
+		memcpy (&nSample, pFrom, sizeof nSample);
+		nValue = nSample;
+		nValue <<= 8;
+		} break;
+
+	case SoundFormatSigned24:
+		memcpy (&nValue, pFrom, sizeof nValue);
+		nValue &= 0xFFFFFFU;
+		break;
+
+	case SoundFormatSigned24_32:
+		memcpy (&nValue, pFrom, sizeof nValue);
+		break;
+
+	default:
+		assert (0);
+		break;
+	}
+
+	switch (ReadFormat)
+	{
+	case SoundFormatUnsigned8: {
+		u8 *pValue = reinterpret_cast<u8 *> (pTo);
+		s8 chValue = (s8) (nValue >> 16);
+		*pValue = (u8) (128 + chValue);
+		} break;
+
+	case SoundFormatSigned16: {
+		s16 nSample = (s16) (nValue >> 8);
+		memcpy (pTo, &nSample, sizeof nSample);
+		} break;
+
+	case SoundFormatSigned24:
+		memcpy (pTo, &nValue, 3);
+		break;
+
+	case SoundFormatSigned24_32:
+		memcpy (pTo, &nValue, sizeof nValue);
+		break;
+
+	default:
+		assert (0);
+		break;
+	}
+}
+
+// converts frames like the previous CSoundBaseDevice::Write() did it
+static void RefWriteFrames (u8 *pTo, const u8 *pFrom, unsigned nFrames,
+			    TSoundFormat WriteFormat, unsigned nWriteChannels,
+			    TSoundFormat HWFormat, unsigned nHWChannels, boolean bSwapChannels,
+			    int nRangeMax)
+{
+	unsigned nWriteSampleSize = SampleSize (WriteFormat);
+	unsigned nHWSampleSize = SampleSize (HWFormat);
+	unsigned nHWFrameSize = nHWChannels * nHWSampleSize;
+
+	if (   HWFormat == WriteFormat
+	    && nWriteChannels == nHWChannels
+	    && !bSwapChannels)
+	{
+		memcpy (pTo, pFrom, nFrames * nHWFrameSize);
+
+		return;
+	}
+
+	u8 NullFrame[MAX_CHANNELS * SOUND_MAX_SAMPLE_SIZE];
+	memset (NullFrame, 0, sizeof NullFrame);
+	if (HWFormat == SoundFormatUnsigned32)
+	{
+		for (unsigned i = 0; i < nHWChannels; i++)
+		{
+			u32 nSample = nRangeMax / 2;
+			memcpy (NullFrame + i * nHWSampleSize, &nSample, sizeof nSample);
+		}
+	}
+
+	for (unsigned n = 0; n < nFrames; n++)
+	{
+		u8 Frame[MAX_CHANNELS * SOUND_MAX_SAMPLE_SIZE];
+
+		if (   nHWChannels == 2
+		    && nWriteChannels <= 2)
+		{
+			unsigned nFirst = bSwapChannels ? nHWSampleSize : 0;
+			unsigned nSecond = nHWSampleSize - nFirst;
+
+			RefConvertSoundFormat (Frame + nFirst, pFrom, WriteFormat, HWFormat, nRangeMax);
+			pFrom += nWriteSampleSize;
+
+			if (nWriteChannels == 2)
+			{
+				RefConvertSoundFormat (Frame + nSecond, pFrom, WriteFormat, HWFormat,
+						       nRangeMax);
+				pFrom += nWriteSampleSize;
+			}
+			else
+			{
+				memcpy (Frame + nSecond, Frame + nFirst, nHWSampleSize);
+			}
+		}
+		else
+		{
+			unsigned nMinChannels =   nWriteChannels < nHWChannels
+						? nWriteChannels : nHWChannels;
+
+			for (unsigned i = 0; i < nMinChannels; i++)
+			{
+				RefConvertSoundFormat (Frame + i * nHWSampleSize,
+						       pFrom + i * nWriteSampleSize,
+						       WriteFormat, HWFormat, nRangeMax);
+			}
+
+			if (nMinChannels < nHWChannels)
+			{
+				memcpy (Frame + nMinChannels * nHWSampleSize, NullFrame,
+					(nHWChannels - nMinChannels) * nHWSampleSize);
+			}
+
+			pFrom += nWriteChannels * nWriteSampleSize;
+		}
+
+		memcpy (pTo, Frame, nHWFrameSize);
+		pTo += nHWFrameSize;
+	}
+}
+
+// channel status for 192 kHz sample rate (see CSoundBaseDevice::Setup())
+static const u8 s_IEC958Status[IEC958_STATUS_BYTES] = {0b100, 0, 0, 14, 0b1011 | 1 << 4};
+
+// inserts control channel and parity bits, and preamble into IEC958 blocks,
+// like the previous CSoundBaseDevice::GetChunkInternal() did it
+static void RefIEC958Framing (u32 *pBuffer, unsigned nChunkSize)
+{
+	for (unsigned i = 0; i < nChunkSize; i += IEC958_SUBFRAMES_PER_BLOCK)
+	{
+		for (unsigned j = 0; j < IEC958_STATUS_BYTES * 8 * IEC958_HW_CHANNELS; j++)
+		{
+			u32 *pSubFrame = &pBuffer[i + j];
+
+			unsigned nFrame = j / IEC958_HW_CHANNELS;
+			if (s_IEC958Status[nFrame / 8] & BIT(nFrame % 8))
+			{
+				u32 nValue = *pSubFrame;
+
+				nValue |= 0x40000000;
+
+				nValue &= 0x7FFFFFFF;
+				if (parity32 (nValue))
+				{
+					nValue |= 0x80000000;
+				}
+
+				*pSubFrame = nValue;
+			}
+
+			if (nFrame == 0)
+			{
+				*pSubFrame |= IEC958_B_FRAME_PREAMBLE;
+			}
+		}
+	}
+}
+
+// previous CSoundBaseDevice::ConvertIEC958Sample()
+static u32 RefConvertIEC958Sample (u32 nSample, unsigned nFrame)
+{
+	nSample &= 0xFFFFFF;
+	nSample <<= 4;
+
+	if (   nFrame < IEC958_STATUS_BYTES * 8
+	    && (s_IEC958Status[nFrame / 8] & BIT(nFrame % 8)))
+	{
+		nSample |= 0x40000000;
+	}
+
+	if (parity32 (nSample))
+	{
+		nSample |= 0x80000000;
+	}
+
+	if (nFrame == 0)
+	{
+		nSample |= IEC958_B_FRAME_PREAMBLE;
+	}
+
+	return nSample;
+}
+
+// checks parity (bits 4-31 have even parity), channel status bit and preamble
+// of the subframes in IEC958 blocks, independent from the reference conversion
+static boolean IEC958BlocksValid (const u32 *pBuffer, unsigned nChunkSize)
+{
+	for (unsigned i = 0; i < nChunkSize; i++)
+	{
+		u32 nSubFrame = pBuffer[i];
+		unsigned nFrame = i / IEC958_HW_CHANNELS % IEC958_FRAMES_PER_BLOCK;
+
+		if (parity32 (nSubFrame & ~0xFU))
+		{
+			return FALSE;
+		}
+
+		boolean bStatus =    nFrame < IEC958_STATUS_BYTES * 8
+				  && (s_IEC958Status[nFrame / 8] & BIT(nFrame % 8));
+		if (!!(nSubFrame & 0x40000000) != bStatus)
+		{
+			return FALSE;
+		}
+
+		if ((nSubFrame & 0xF) != (nFrame == 0 ? IEC958_B_FRAME_PREAMBLE : 0))
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+// converts frames like the previous CSoundBaseDevice::Read() did it
+static void RefReadFrames (u8 *pTo, const u8 *pFrom, unsigned nFrames,
+			   TSoundFormat HWFormat, unsigned nHWChannels,
+			   TSoundFormat ReadFormat, unsigned nReadChannels, boolean bLeftChannel)
+{
+	unsigned nReadSampleSize = SampleSize (ReadFormat);
+	unsigned nHWSampleSize = SampleSize (HWFormat);
+	unsigned nHWFrameSize = nHWChannels * nHWSampleSize;
+
+	if (   HWFormat == ReadFormat
+	    && nReadChannels == nHWChannels)
+	{
+		memcpy (pTo, pFrom, nFrames * nHWFrameSize);
+
+		return;
+	}
+
+	u8 NullSample[SOUND_MAX_SAMPLE_SIZE];
+	u8 NullHWSample[SOUND_MAX_SAMPLE_SIZE] = {0};
+	RefConvertReadSoundFormat (NullSample, NullHWSample, HWFormat, ReadFormat);
+
+	for (unsigned n = 0; n < nFrames; n++)
+	{
+		// one more sample, because a 24-bit sample is read as 32-bit word
+		u8 Frame[(MAX_CHANNELS + 1) * SOUND_MAX_SAMPLE_SIZE];
+		memcpy (Frame, pFrom, nHWFrameSize);
+		pFrom += nHWFrameSize;
+
+		if (   nHWChannels == 2
+		    && nReadChannels <= 2)
+		{
+			if (nReadChannels == 2)
+			{
+				RefConvertReadSoundFormat (pTo, Frame, HWFormat, ReadFormat);
+				RefConvertReadSoundFormat (pTo + nReadSampleSize, Frame + nHWSampleSize,
+							   HWFormat, ReadFormat);
+			}
+			else
+			{
+				RefConvertReadSoundFormat (pTo, bLeftChannel ? Frame : Frame + nHWSampleSize,
+							   HWFormat, ReadFormat);
+			}
+		}
+		else
+		{
+			unsigned i = 0;
+			for (; i < nReadChannels && i < nHWChannels; i++)
+			{
+				RefConvertReadSoundFormat (pTo + i * nReadSampleSize,
+							   Frame + i * nHWSampleSize,
+							   HWFormat, ReadFormat);
+			}
+
+			for (; i < nReadChannels; i++)
+			{
+				memcpy (pTo + i * nReadSampleSize, NullSample, nReadSampleSize);
+			}
+		}
+
+		pTo += nReadChannels * nReadSampleSize;
+	}
+}
+
+// Test ///////////////////////////////////////////////////////////////
+
+class CBenchSoundDevice : public CSoundBaseDevice	// queue only, no hardware
+{
+public:
+	CBenchSoundDevice (TSoundFormat HWFormat, unsigned nHWChannels, boolean bSwapChannels)
+	:	m_Format (HWFormat)
+	{
+		Setup (HWFormat, HWFormat == SoundFormatUnsigned32 ? PWM_RANGE : 0, SAMPLE_RATE,
+		       nHWChannels, nHWChannels, bSwapChannels);
+	}
+
+	boolean Start (void) override		{ return TRUE; }
+	void Cancel (void) override		{}
+	boolean IsActive (void) const override	{ return TRUE; }
+
+	// fetch samples from the Write() queue, like a sound driver does it
+	void Fetch (unsigned nSamples)
+	{
+		if (m_Format == SoundFormatSigned16)
+		{
+			GetChunk (reinterpret_cast<s16 *> (s_HWBuffer), nSamples);
+		}
+		else
+		{
+			GetChunk (s_HWBuffer, nSamples);
+		}
+	}
+
+	// put samples into the Read() queue, like a sound driver does it
+	void Deliver (unsigned nSamples)
+	{
+		if (m_Format == SoundFormatSigned16)
+		{
+			PutChunk (reinterpret_cast<const s16 *> (s_HWBuffer), nSamples);
+		}
+		else
+		{
+			PutChunk (s_HWBuffer, nSamples);
+		}
+	}
+
+	u32 FrameIEC958 (u32 nSample, unsigned nFrame)
+	{
+		return ConvertIEC958Sample (nSample, nFrame);
+	}
+
+private:
+	TSoundFormat m_Format;
+};
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer)
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+	m_Logger.Write (FromKernel, LogNotice, "Sound format conversion on %s (%s)",
+			CMachineInfo::Get ()->GetMachineName (),
+#if    (defined (__ARM_NEON) || defined (__ARM_NEON__)) \
+    && defined (SAVE_VFP_REGS_ON_IRQ) && STDLIB_SUPPORT >= 1
+			"NEON enabled"
+#else
+			"NEON disabled"
+#endif
+			);
+
+	u32 nSeed = 1;
+	for (unsigned i = 0; i < sizeof s_Samples; i++)
+	{
+		nSeed = nSeed * 1103515245 + 12345;
+		s_Samples[i] = (u8) (nSeed >> 16);
+	}
+
+	unsigned nTests = 0;
+	unsigned nFailed = 0;
+
+	// channel mappings (HW channels, Write() channels, swapped)
+	static const unsigned WriteMappings[][3] =
+	{
+		{2, 2, 0}, {2, 1, 0}, {2, 2, 1}, {2, 1, 1}, {2, MAX_CHANNELS, 0},
+		{MAX_CHANNELS, MAX_CHANNELS, 0}, {MAX_CHANNELS, 2, 0}, {MAX_CHANNELS, 1, 0}
+	};
+
+	for (unsigned HW = SoundFormatSigned16; HW <= SoundFormatIEC958; HW++)
+	{
+		for (unsigned Write = SoundFormatUnsigned8; Write <= SoundFormatSigned24_32; Write++)
+		{
+			for (unsigned i = 0; i < sizeof WriteMappings / sizeof WriteMappings[0]; i++)
+			{
+				if (   HW == SoundFormatIEC958
+				    && WriteMappings[i][0] != IEC958_HW_CHANNELS)
+				{
+					continue;
+				}
+
+				nTests++;
+				nFailed += !CheckWrite ((TSoundFormat) HW, (TSoundFormat) Write,
+							WriteMappings[i][0], WriteMappings[i][1],
+							WriteMappings[i][2] != 0);
+			}
+		}
+	}
+
+	// channel mappings (HW channels, Read() channels, left channel)
+	static const unsigned ReadMappings[][3] =
+	{
+		{2, 2, 1}, {2, 1, 1}, {2, 1, 0}, {2, MAX_CHANNELS, 1},
+		{MAX_CHANNELS, MAX_CHANNELS, 1}, {MAX_CHANNELS, 2, 1}, {MAX_CHANNELS, 1, 1}
+	};
+
+	for (unsigned HW = SoundFormatSigned16; HW <= SoundFormatSigned24_32; HW++)
+	{
+		for (unsigned Read = SoundFormatUnsigned8; Read <= SoundFormatSigned24_32; Read++)
+		{
+			for (unsigned i = 0; i < sizeof ReadMappings / sizeof ReadMappings[0]; i++)
+			{
+				nTests++;
+				nFailed += !CheckRead ((TSoundFormat) HW, (TSoundFormat) Read,
+						       ReadMappings[i][0], ReadMappings[i][1],
+						       ReadMappings[i][2] != 0);
+			}
+		}
+	}
+
+	nTests++;
+	nFailed += !CheckIEC958 ();
+
+	if (nFailed == 0)
+	{
+		m_Logger.Write (FromKernel, LogNotice, "All %u tests passed", nTests);
+	}
+	else
+	{
+		m_Logger.Write (FromKernel, LogError, "%u of %u tests failed", nFailed, nTests);
+	}
+
+	for (unsigned nRun = 1; nRun <= RUNS; nRun++)
+	{
+		m_Logger.Write (FromKernel, LogNotice, "Run %u (ns per frame)", nRun);
+
+		for (unsigned HW = SoundFormatSigned16; HW <= SoundFormatIEC958; HW++)
+		{
+			for (unsigned Write = SoundFormatUnsigned8; Write <= SoundFormatSigned24_32; Write++)
+			{
+				TSoundFormat HWFormat = (TSoundFormat) HW;
+				TSoundFormat WriteFormat = (TSoundFormat) Write;
+
+				TestWrite (HWFormat, WriteFormat, 2, 2, FALSE);
+				TestWrite (HWFormat, WriteFormat, 2, 1, FALSE);
+				TestWrite (HWFormat, WriteFormat, 2, 2, TRUE);
+
+				if (HWFormat != SoundFormatIEC958)
+				{
+					TestWrite (HWFormat, WriteFormat, MAX_CHANNELS, MAX_CHANNELS, FALSE);
+				}
+			}
+		}
+
+		for (unsigned HW = SoundFormatSigned16; HW <= SoundFormatSigned24_32; HW++)
+		{
+			for (unsigned Read = SoundFormatUnsigned8; Read <= SoundFormatSigned24_32; Read++)
+			{
+				TSoundFormat HWFormat = (TSoundFormat) HW;
+				TSoundFormat ReadFormat = (TSoundFormat) Read;
+
+				TestRead (HWFormat, ReadFormat, 2, 2);
+				TestRead (HWFormat, ReadFormat, 2, 1);
+				TestRead (HWFormat, ReadFormat, MAX_CHANNELS, MAX_CHANNELS);
+			}
+		}
+
+		TestIEC958 ();
+	}
+
+	m_Logger.Write (FromKernel, LogNotice, "Done");
+
+	return ShutdownHalt;
+}
+
+boolean CKernel::CheckWrite (TSoundFormat HWFormat, TSoundFormat WriteFormat,
+			     unsigned nHWChannels, unsigned nWriteChannels, boolean bSwapChannels)
+{
+	CBenchSoundDevice Device (HWFormat, nHWChannels, bSwapChannels);
+
+	if (!Device.AllocateQueueFrames (BLOCK_FRAMES))
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Cannot allocate queue");
+	}
+
+	Device.SetWriteFormat (WriteFormat, nWriteChannels);
+
+	unsigned nWriteFrameSize = nWriteChannels * SampleSize (WriteFormat);
+	unsigned nHWBytes = BLOCK_FRAMES * nHWChannels * SampleSize (HWFormat);
+
+	RefWriteFrames (s_RefBuffer, s_Samples, BLOCK_FRAMES, WriteFormat, nWriteChannels,
+			HWFormat, nHWChannels, bSwapChannels, Device.GetRangeMax ());
+
+	if (HWFormat == SoundFormatIEC958)
+	{
+		RefIEC958Framing (reinterpret_cast<u32 *> (s_RefBuffer), BLOCK_FRAMES * nHWChannels);
+	}
+
+	for (unsigned nRound = 0; nRound < CHECK_ROUNDS; nRound++)
+	{
+		// write pieces of different sizes, which are not a multiple of the vector size
+		unsigned nPiece = 1 + nRound * 29;
+		for (unsigned nFrames = 0; nFrames < BLOCK_FRAMES; )
+		{
+			if (nPiece > BLOCK_FRAMES - nFrames)
+			{
+				nPiece = BLOCK_FRAMES - nFrames;
+			}
+
+			int nBytes = nPiece * nWriteFrameSize;
+			if (Device.Write (s_Samples + nFrames * nWriteFrameSize, nBytes) != nBytes)
+			{
+				m_Logger.Write (FromKernel, LogError, "Write() failed");
+
+				return FALSE;
+			}
+
+			nFrames += nPiece;
+			nPiece = nPiece * 5 % 131 + 1;
+		}
+
+		memset (s_HWBuffer, 0x55, sizeof s_HWBuffer);
+		Device.Fetch (BLOCK_FRAMES * nHWChannels);
+
+		if (   memcmp (s_HWBuffer, s_RefBuffer, nHWBytes) != 0
+		    || (   HWFormat == SoundFormatIEC958
+			&& !IEC958BlocksValid (s_HWBuffer, BLOCK_FRAMES * nHWChannels)))
+		{
+			m_Logger.Write (FromKernel, LogError, "Write %s %uch -> %s %uch%s: mismatch",
+					s_pFormatName[WriteFormat], nWriteChannels,
+					s_pFormatName[HWFormat], nHWChannels,
+					bSwapChannels ? " swapped" : "");
+
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+boolean CKernel::CheckRead (TSoundFormat HWFormat, TSoundFormat ReadFormat,
+			    unsigned nHWChannels, unsigned nReadChannels, boolean bLeftChannel)
+{
+	CBenchSoundDevice Device (HWFormat, nHWChannels, FALSE);
+
+	if (!Device.AllocateReadQueueFrames (BLOCK_FRAMES))
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Cannot allocate queue");
+	}
+
+	Device.SetReadFormat (ReadFormat, nReadChannels, bLeftChannel);
+
+	unsigned nReadFrameSize = nReadChannels * SampleSize (ReadFormat);
+
+	memcpy (s_HWBuffer, s_Samples, sizeof s_HWBuffer);
+
+	RefReadFrames (s_RefBuffer, reinterpret_cast<const u8 *> (s_HWBuffer), BLOCK_FRAMES,
+		       HWFormat, nHWChannels, ReadFormat, nReadChannels, bLeftChannel);
+
+	for (unsigned nRound = 0; nRound < CHECK_ROUNDS; nRound++)
+	{
+		Device.Deliver (BLOCK_FRAMES * nHWChannels);
+
+		memset (s_ReadBuffer, 0x55, sizeof s_ReadBuffer);
+
+		// read pieces of different sizes, which are not a multiple of the vector size
+		unsigned nPiece = 1 + nRound * 29;
+		for (unsigned nFrames = 0; nFrames < BLOCK_FRAMES; )
+		{
+			if (nPiece > BLOCK_FRAMES - nFrames)
+			{
+				nPiece = BLOCK_FRAMES - nFrames;
+			}
+
+			int nBytes = nPiece * nReadFrameSize;
+			if (Device.Read (s_ReadBuffer + nFrames * nReadFrameSize, nBytes) != nBytes)
+			{
+				m_Logger.Write (FromKernel, LogError, "Read() failed");
+
+				return FALSE;
+			}
+
+			nFrames += nPiece;
+			nPiece = nPiece * 5 % 131 + 1;
+		}
+
+		if (memcmp (s_ReadBuffer, s_RefBuffer, BLOCK_FRAMES * nReadFrameSize) != 0)
+		{
+			m_Logger.Write (FromKernel, LogError, "Read %s %uch -> %s %uch%s: mismatch",
+					s_pFormatName[HWFormat], nHWChannels,
+					s_pFormatName[ReadFormat], nReadChannels,
+					nReadChannels == 1 && !bLeftChannel ? " right" : "");
+
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+boolean CKernel::CheckIEC958 (void)
+{
+	CBenchSoundDevice Device (SoundFormatIEC958, IEC958_HW_CHANNELS, FALSE);
+
+	if (!Device.AllocateQueueFrames (BLOCK_FRAMES))
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Cannot allocate queue");
+	}
+
+	// GetChunk() on an empty queue applies the framing on null frames
+	memset (s_RefBuffer, 0, BLOCK_FRAMES * IEC958_HW_CHANNELS * sizeof (u32));
+	RefIEC958Framing (reinterpret_cast<u32 *> (s_RefBuffer), BLOCK_FRAMES * IEC958_HW_CHANNELS);
+
+	memset (s_HWBuffer, 0x55, sizeof s_HWBuffer);
+	Device.Fetch (BLOCK_FRAMES * IEC958_HW_CHANNELS);
+
+	if (   memcmp (s_HWBuffer, s_RefBuffer, BLOCK_FRAMES * IEC958_HW_CHANNELS * sizeof (u32)) != 0
+	    || !IEC958BlocksValid (s_HWBuffer, BLOCK_FRAMES * IEC958_HW_CHANNELS))
+	{
+		m_Logger.Write (FromKernel, LogError, "IEC958 null frames: mismatch");
+
+		return FALSE;
+	}
+
+	// ConvertIEC958Sample() is used by drivers, which overload GetChunk()
+	const u32 *pSamples = reinterpret_cast<const u32 *> (s_Samples);
+	for (unsigned i = 0; i < BLOCK_FRAMES * IEC958_HW_CHANNELS; i++)
+	{
+		unsigned nFrame = i / IEC958_HW_CHANNELS % IEC958_FRAMES_PER_BLOCK;
+
+		s_HWBuffer[i] = Device.FrameIEC958 (pSamples[i], nFrame);
+		if (s_HWBuffer[i] != RefConvertIEC958Sample (pSamples[i], nFrame))
+		{
+			m_Logger.Write (FromKernel, LogError,
+					"ConvertIEC958Sample (%08X, %u): mismatch", pSamples[i], nFrame);
+
+			return FALSE;
+		}
+	}
+
+	if (!IEC958BlocksValid (s_HWBuffer, BLOCK_FRAMES * IEC958_HW_CHANNELS))
+	{
+		m_Logger.Write (FromKernel, LogError, "ConvertIEC958Sample: invalid subframes");
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+void CKernel::TestWrite (TSoundFormat HWFormat, TSoundFormat WriteFormat,
+			 unsigned nHWChannels, unsigned nWriteChannels, boolean bSwapChannels)
+{
+	CBenchSoundDevice Device (HWFormat, nHWChannels, bSwapChannels);
+
+	if (!Device.AllocateQueueFrames (BLOCK_FRAMES))
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Cannot allocate queue");
+	}
+
+	Device.SetWriteFormat (WriteFormat, nWriteChannels);
+
+	unsigned nBytes = BLOCK_FRAMES * nWriteChannels * SampleSize (WriteFormat);
+
+	u64 ullStart = CTimer::GetClockTicks64 ();
+
+	for (unsigned i = 0; i < ITERATIONS; i++)
+	{
+		int nResult = Device.Write (s_Samples, nBytes);
+		assert (nResult == (int) nBytes);
+
+		Device.Fetch (BLOCK_FRAMES * nHWChannels);
+	}
+
+	u64 ullTicks = CTimer::GetClockTicks64 () - ullStart;
+
+	m_Logger.Write (FromKernel, LogNotice, "Write %-6s %uch -> %-6s %uch%s: %4u",
+			s_pFormatName[WriteFormat], nWriteChannels,
+			s_pFormatName[HWFormat], nHWChannels, bSwapChannels ? " swapped" : "",
+			(unsigned) (ullTicks * 1000 / (ITERATIONS * BLOCK_FRAMES)));
+}
+
+void CKernel::TestRead (TSoundFormat HWFormat, TSoundFormat ReadFormat,
+			unsigned nHWChannels, unsigned nReadChannels)
+{
+	CBenchSoundDevice Device (HWFormat, nHWChannels, FALSE);
+
+	if (!Device.AllocateReadQueueFrames (BLOCK_FRAMES))
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Cannot allocate queue");
+	}
+
+	Device.SetReadFormat (ReadFormat, nReadChannels);
+
+	memcpy (s_HWBuffer, s_Samples, sizeof s_HWBuffer);
+
+	unsigned nBytes = BLOCK_FRAMES * nReadChannels * SampleSize (ReadFormat);
+
+	u64 ullStart = CTimer::GetClockTicks64 ();
+
+	for (unsigned i = 0; i < ITERATIONS; i++)
+	{
+		Device.Deliver (BLOCK_FRAMES * nHWChannels);
+
+		int nResult = Device.Read (s_ReadBuffer, nBytes);
+		assert (nResult == (int) nBytes);
+	}
+
+	u64 ullTicks = CTimer::GetClockTicks64 () - ullStart;
+
+	m_Logger.Write (FromKernel, LogNotice, "Read  %-6s %uch -> %-6s %uch: %4u",
+			s_pFormatName[HWFormat], nHWChannels,
+			s_pFormatName[ReadFormat], nReadChannels,
+			(unsigned) (ullTicks * 1000 / (ITERATIONS * BLOCK_FRAMES)));
+}
+
+void CKernel::TestIEC958 (void)
+{
+	CBenchSoundDevice Device (SoundFormatIEC958, IEC958_HW_CHANNELS, FALSE);
+
+	if (!Device.AllocateQueueFrames (BLOCK_FRAMES))
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Cannot allocate queue");
+	}
+
+	// GetChunk() on an empty queue applies the framing on null frames
+	u64 ullStart = CTimer::GetClockTicks64 ();
+
+	for (unsigned i = 0; i < ITERATIONS; i++)
+	{
+		Device.Fetch (BLOCK_FRAMES * IEC958_HW_CHANNELS);
+	}
+
+	u64 ullTicks = CTimer::GetClockTicks64 () - ullStart;
+
+	m_Logger.Write (FromKernel, LogNotice, "GetChunk IEC958 framing: %4u",
+			(unsigned) (ullTicks * 1000 / (ITERATIONS * BLOCK_FRAMES)));
+
+	// ConvertIEC958Sample() is used by drivers, which overload GetChunk()
+	const u32 *pSamples = reinterpret_cast<const u32 *> (s_Samples);
+	u32 nResult = 0;
+
+	ullStart = CTimer::GetClockTicks64 ();
+
+	for (unsigned i = 0; i < ITERATIONS; i++)
+	{
+		for (unsigned j = 0; j < BLOCK_FRAMES * IEC958_HW_CHANNELS; j++)
+		{
+			nResult ^= Device.FrameIEC958 (pSamples[j],
+						       j / IEC958_HW_CHANNELS % IEC958_FRAMES_PER_BLOCK);
+		}
+	}
+
+	ullTicks = CTimer::GetClockTicks64 () - ullStart;
+
+	m_Logger.Write (FromKernel, LogNotice, "ConvertIEC958Sample (2ch):  %4u (%08X)",
+			(unsigned) (ullTicks * 1000 / (ITERATIONS * BLOCK_FRAMES)), nResult);
+}
@@ -0,0 +1,203 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <assert.h>
+
+#define SAMPLE_RATE	48000
+#define PERIOD_FRAMES	64
+#define PERIODS		2		// double buffering
+#define CHUNK_SIZE	(PERIOD_FRAMES * 2)	// samples of the DMA chunk
+
+#ifdef ARM_ALLOW_MULTI_CORE
+	#define SOUND_CORE	1
+#else
+	#define SOUND_CORE	0	// process in interrupt context
+#endif
+
+#define RUN_SECS	30
+#define LOAD_STEP_SECS	5
+
+static const char FromKernel[] = "kernel";
+
+// artificial load in microseconds for each step (period is 1333 us)
+static const unsigned s_LoadUsecs[] = {0, 200, 400, 800, 1200, 1600};
+
+// A major chord (Hz)
+static const unsigned s_Frequency[] = {220, 277, 330, 440};
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer),
+	m_PWMSound (&m_Interrupt, SAMPLE_RATE, CHUNK_SIZE),
+	m_Engine (&m_PWMSound, PERIOD_FRAMES, PERIODS, SOUND_CORE),
+#ifdef ARM_ALLOW_MULTI_CORE
+	m_SoundCore (&m_Engine, SOUND_CORE),
+#endif
+	m_nLoadUsecs (0)
+{
+	m_ActLED.Blink (5);	// show we are alive
+
+	for (unsigned i = 0; i < Voices; i++)
+	{
+		m_nPhase[i] = 0;
+		m_nIncrement[i] = (u32) (((u64) s_Frequency[i] << 32) / SAMPLE_RATE);
+	}
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Engine.IsValid ();
+	}
+
+#ifdef ARM_ALLOW_MULTI_CORE
+	if (bOK)
+	{
+		bOK = m_SoundCore.Initialize ();	// must be initialized at last
+	}
+#endif
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+	m_Logger.Write (FromKernel, LogNotice, "%u frames per period, %u periods, core %u",
+			PERIOD_FRAMES, PERIODS, SOUND_CORE);
+
+	m_Engine.RegisterProcessCallback (ProcessCallback, this);
+
+	if (!m_Engine.Start ())
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Cannot start sound engine");
+	}
+
+	for (unsigned nSecs = 1; nSecs <= RUN_SECS; nSecs++)
+	{
+		m_Timer.MsDelay (1000);
+
+		TSoundEngineStats Stats;
+		m_Engine.GetStats (&Stats);
+
+		m_Logger.Write (FromKernel, LogNotice,
+				"%2us: %u periods, %u xruns, process %u/%u/%u us, "
+				"slack %u/%u us, load %u%%",
+				nSecs, Stats.nPeriods, Stats.nXRuns,
+				Stats.nProcessUsecsMin, Stats.nProcessUsecsAvg, Stats.nProcessUsecsMax,
+				Stats.nSlackUsecsMin, Stats.nSlackUsecsAvg, Stats.nLoadPercentMax);
+
+		if (nSecs % LOAD_STEP_SECS == 0)
+		{
+			unsigned nStep = nSecs / LOAD_STEP_SECS;
+			if (nStep < sizeof s_LoadUsecs / sizeof s_LoadUsecs[0])
+			{
+				m_nLoadUsecs = s_LoadUsecs[nStep];
+
+				m_Logger.Write (FromKernel, LogNotice, "Load is %u us per period",
+						m_nLoadUsecs);
+			}
+
+			m_Engine.ResetStats ();
+		}
+	}
+
+	m_Engine.Cancel ();
+
+	m_Logger.Write (FromKernel, LogNotice, "Done");
+
+	return ShutdownHalt;
+}
+
+void CKernel::ProcessCallback (s32 *pBuffer, unsigned nFrames, unsigned nChannels,
+			       void *pParam)
+{
+	CKernel *pThis = static_cast<CKernel *> (pParam);
+	assert (pThis != 0);
+	assert (pBuffer != 0);
+
+	for (unsigned i = 0; i < nFrames; i++)
+	{
+		s32 nSum = 0;
+		for (unsigned j = 0; j < Voices; j++)
+		{
+			// triangle wave from the phase accumulator, 22 bits amplitude
+			s32 nValue = (s32) (pThis->m_nPhase[j] >> 9);	// 0..(1 << 23)-1
+			if (nValue >= 1 << 22)
+			{
+				nValue = (1 << 23) - 1 - nValue;
+			}
+			nSum += nValue - (1 << 21);
+
+			pThis->m_nPhase[j] += pThis->m_nIncrement[j];
+		}
+
+		s32 nSample = nSum / (s32) Voices;
+		for (unsigned j = 0; j < nChannels; j++)
+		{
+			*pBuffer++ = nSample;
+		}
+	}
+
+	if (pThis->m_nLoadUsecs > 0)
+	{
+		CTimer::SimpleusDelay (pThis->m_nLoadUsecs);
+	}
+}
@@ -0,0 +1,111 @@
+//
+// kernel.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _kernel_h
+#define _kernel_h
+
+#include <circle/actled.h>
+#include <circle/koptions.h>
+#include <circle/devicenameservice.h>
+#include <circle/screen.h>
+#include <circle/serial.h>
+#include <circle/exceptionhandler.h>
+#include <circle/interrupt.h>
+#include <circle/timer.h>
+#include <circle/logger.h>
+#include <circle/multicore.h>
+#include <circle/memory.h>
+#include <circle/sound/pwmsoundbasedevice.h>
+#include <circle/sound/soundengine.h>
+#include <circle/types.h>
+
+enum TShutdownMode
+{
+	ShutdownNone,
+	ShutdownHalt,
+	ShutdownReboot
+};
+
+#ifdef ARM_ALLOW_MULTI_CORE
+
+class CSoundCore : public CMultiCoreSupport	// runs the sound engine on its core
+{
+public:
+	CSoundCore (CSoundEngine *pEngine, unsigned nSoundCore)
+	:	CMultiCoreSupport (CMemorySystem::Get ()),
+		m_pEngine (pEngine),
+		m_nSoundCore (nSoundCore)
+	{
+	}
+
+	void Run (unsigned nCore) override
+	{
+		if (nCore == m_nSoundCore)
+		{
+			m_pEngine->Run ();
+		}
+	}
+
+private:
+	CSoundEngine *m_pEngine;
+	unsigned m_nSoundCore;
+};
+
+#endif
+
+class CKernel
+{
+public:
+	CKernel (void);
+	~CKernel (void);
+
+	boolean Initialize (void);
+
+	TShutdownMode Run (void);
+
+private:
+	static void ProcessCallback (s32 *pBuffer, unsigned nFrames, unsigned nChannels,
+				     void *pParam);
+
+private:
+	// do not change this order
+	CActLED			m_ActLED;
+	CKernelOptions		m_Options;
+	CDeviceNameService	m_DeviceNameService;
+	CScreenDevice		m_Screen;
+	CSerialDevice		m_Serial;
+	CExceptionHandler	m_ExceptionHandler;
+	CInterruptSystem	m_Interrupt;
+	CTimer			m_Timer;
+	CLogger			m_Logger;
+
+	CPWMSoundBaseDevice	m_PWMSound;
+	CSoundEngine		m_Engine;
+#ifdef ARM_ALLOW_MULTI_CORE
+	CSoundCore		m_SoundCore;
+#endif
+
+	static const unsigned Voices = 4;
+	u32 m_nPhase[Voices];
+	u32 m_nIncrement[Voices];
+
+	volatile unsigned m_nLoadUsecs;		// artificial load per period
+};
+
+#endif
@@ -0,0 +1,602 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <circle/util.h>
+#include <assert.h>
+
+#define HW_SAMPLE_RATE	48000
+#define CHUNK_SIZE	(384 * 2)	// samples, 4 ms latency
+#define WRITE_FRAMES	256
+
+#define RUN_SECS	30
+#define REMOVE_SECS	20
+
+#define CHECK_FRAMES	2400		// 50 ms at 48000 Hz
+#define SINE_FREQUENCY	1000
+#define SINE_SAMPLE_RATE 44100
+#define SNR_SKIP_FRAMES	240		// filter settling time
+#define SNR_FRAMES	4800		// multiple of the sine period (48 frames)
+#define SNR_MIN_DB	70		// threshold of the signal to noise ratio
+
+#define SAMPLE_MAX	((1 << 23) - 1)	// clip level of the mixer
+
+#define PI		3.14159265358979323846
+
+static const char FromKernel[] = "kernel";
+
+static u8 s_WriteBuffer[CHECK_FRAMES * 2 * sizeof (s32)];
+static s32 s_Expected[CHECK_FRAMES * 2];
+
+class CCheckSoundDevice : public CSoundBaseDevice	// provides the sample rate for the mixer only
+{
+public:
+	CCheckSoundDevice (void)
+	{
+		Setup (SoundFormatSigned24_32, 0, HW_SAMPLE_RATE, 2, 2, FALSE);
+	}
+
+	boolean Start (void) override		{ return TRUE; }
+	void Cancel (void) override		{}
+	boolean IsActive (void) const override	{ return TRUE; }
+};
+
+static u32 s_nSeed = 1;
+
+static u32 Random (void)
+{
+	s_nSeed = s_nSeed * 1103515245 + 12345;
+
+	return s_nSeed;
+}
+
+static s32 Clip (s64 nValue)
+{
+	return nValue > SAMPLE_MAX ? SAMPLE_MAX : (nValue < -SAMPLE_MAX ? -SAMPLE_MAX : (s32) nValue);
+}
+
+// sine without libm, Taylor series after range reduction to -PI/2..PI/2
+static double Sine (double x)
+{
+	while (x > PI)
+	{
+		x -= 2*PI;
+	}
+
+	while (x < -PI)
+	{
+		x += 2*PI;
+	}
+
+	if (x > PI/2)
+	{
+		x = PI - x;
+	}
+	else if (x < -PI/2)
+	{
+		x = -PI - x;
+	}
+
+	double x2 = x*x;
+	double fTerm = x;
+	double fSum = x;
+	for (unsigned i = 1; i <= 9; i++)
+	{
+		fTerm *= -x2 / ((2*i) * (2*i+1));
+		fSum += fTerm;
+	}
+
+	return fSum;
+}
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer),
+	m_PWMSound (&m_Interrupt, HW_SAMPLE_RATE, CHUNK_SIZE),
+	m_Mixer (&m_PWMSound)
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+	unsigned nTests = 0;
+	unsigned nFailed = 0;
+
+	for (unsigned Format = SoundFormatUnsigned8; Format <= SoundFormatSigned24_32; Format++)
+	{
+		for (unsigned nChannels = 1; nChannels <= 2; nChannels++)
+		{
+			nTests++;
+			nFailed += !CheckPassthrough ((TSoundFormat) Format, nChannels);
+		}
+	}
+
+	nTests++;
+	nFailed += !CheckGain ();
+
+	nTests++;
+	nFailed += !CheckClipping ();
+
+	nTests++;
+	nFailed += !CheckResampling ();
+
+	if (nFailed == 0)
+	{
+		m_Logger.Write (FromKernel, LogNotice, "All %u tests passed", nTests);
+	}
+	else
+	{
+		m_Logger.Write (FromKernel, LogError, "%u of %u tests failed", nFailed, nTests);
+	}
+
+	CSoundMixerStream *pStream1 = m_Mixer.AddStream (SoundFormatSigned16, 2, 44100);
+	CSoundMixerStream *pStream2 = m_Mixer.AddStream (SoundFormatSigned16, 1, 22050);
+	if (   pStream1 == 0
+	    || pStream2 == 0)
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Cannot add stream");
+	}
+
+	CToneGenerator Tone1L (440, 44100);
+	CToneGenerator Tone1R (660, 44100);
+	CToneGenerator Tone2 (880, 22050);
+
+	// pre-fill the queues, before the mixer starts to fetch samples
+	FillStream (pStream1, 2, &Tone1L, &Tone1R);
+	FillStream (pStream2, 1, &Tone2, 0);
+
+	if (!m_PWMSound.Start ())
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Cannot start sound device");
+	}
+
+	unsigned nStartTicks = m_Timer.GetClockTicks ();
+	unsigned nLastSecs = 0;
+	for (unsigned nSecs = 0; nSecs < RUN_SECS;
+	     nSecs = (m_Timer.GetClockTicks () - nStartTicks) / CLOCKHZ)
+	{
+		FillStream (pStream1, 2, &Tone1L, &Tone1R);
+
+		if (pStream2 != 0)
+		{
+			FillStream (pStream2, 1, &Tone2, 0);
+
+			// ramp the gain of stream 2 up and down with a period of 4 seconds
+			unsigned nMsecs =   (m_Timer.GetClockTicks () - nStartTicks)
+					  / (CLOCKHZ / 1000) % 4000;
+			unsigned nGain = nMsecs < 2000 ? nMsecs : 4000 - nMsecs;
+			pStream2->SetGain (SOUND_MIXER_UNITY_GAIN / 2000 * nGain);
+		}
+
+		if (nSecs == nLastSecs)
+		{
+			continue;
+		}
+		nLastSecs = nSecs;
+
+		m_Logger.Write (FromKernel, LogNotice,
+				"%2us: stream 1 %4u frames queued, %u underruns",
+				nSecs, pStream1->GetQueueFramesAvail (), pStream1->GetUnderruns ());
+
+		if (pStream2 != 0)
+		{
+			m_Logger.Write (FromKernel, LogNotice,
+					"     stream 2 %4u frames queued, %u underruns",
+					pStream2->GetQueueFramesAvail (), pStream2->GetUnderruns ());
+
+			if (nSecs >= REMOVE_SECS)
+			{
+				m_Mixer.RemoveStream (pStream2);
+				pStream2 = 0;
+
+				m_Logger.Write (FromKernel, LogNotice, "Stream 2 removed");
+			}
+		}
+	}
+
+	m_PWMSound.Cancel ();
+
+	m_Logger.Write (FromKernel, LogNotice, "Done");
+
+	return ShutdownHalt;
+}
+
+// samples must be mixed unchanged at the HW sample rate and unity gain
+boolean CKernel::CheckPassthrough (TSoundFormat Format, unsigned nChannels)
+{
+	CCheckSoundDevice Device;
+	CSoundMixer Mixer (&Device);
+
+	CSoundMixerStream *pStream = Mixer.AddStream (Format, nChannels, HW_SAMPLE_RATE);
+	if (pStream == 0)
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Cannot add stream");
+	}
+
+	unsigned nSampleSize =   Format == SoundFormatUnsigned8 ? 1
+			       : Format == SoundFormatSigned16 ? 2
+			       : Format == SoundFormatSigned24 ? 3 : 4;
+
+	u8 *pSample = s_WriteBuffer;
+	for (unsigned i = 0; i < CHECK_FRAMES * nChannels; i++)
+	{
+		u32 nRandom = Random ();
+		memcpy (pSample, &nRandom, nSampleSize);
+		pSample += nSampleSize;
+
+		// 24-bit value, the mixer has to deliver
+		s32 nValue;
+		switch (Format)
+		{
+		case SoundFormatUnsigned8:
+			nValue = ((s32) (nRandom & 0xFF) - 128) * (1 << 16);
+			break;
+
+		case SoundFormatSigned16:
+			nValue = (s16) nRandom * (1 << 8);
+			break;
+
+		default:
+			nValue = (s32) (nRandom << 8) >> 8;
+			break;
+		}
+
+		nValue = Clip (nValue);
+
+		if (nChannels == 2)
+		{
+			s_Expected[i] = nValue;
+		}
+		else
+		{
+			s_Expected[i*2] = nValue;
+			s_Expected[i*2 + 1] = nValue;
+		}
+	}
+
+	return    WriteStream (pStream, s_WriteBuffer, CHECK_FRAMES * nChannels * nSampleSize)
+	       && CompareFrames (&Mixer, s_Expected, CHECK_FRAMES, "Passthrough");
+}
+
+// the samples must be multiplied by the gain factor (Q16)
+boolean CKernel::CheckGain (void)
+{
+	static const unsigned Gains[] =
+	{
+		0, SOUND_MIXER_UNITY_GAIN / 4, SOUND_MIXER_UNITY_GAIN / 2, SOUND_MIXER_UNITY_GAIN,
+		SOUND_MIXER_UNITY_GAIN * 3 / 2, SOUND_MIXER_UNITY_GAIN * 4
+	};
+
+	for (unsigned nGain : Gains)
+	{
+		CCheckSoundDevice Device;
+		CSoundMixer Mixer (&Device);
+
+		CSoundMixerStream *pStream = Mixer.AddStream (SoundFormatSigned24_32, 2,
+							      HW_SAMPLE_RATE);
+		if (pStream == 0)
+		{
+			m_Logger.Write (FromKernel, LogPanic, "Cannot add stream");
+		}
+
+		pStream->SetGain (nGain);
+
+		// +/- 2^20, so that a gain up to 4.0 does not clip
+		s32 *pSamples = reinterpret_cast<s32 *> (s_WriteBuffer);
+		for (unsigned i = 0; i < CHECK_FRAMES * 2; i++)
+		{
+			pSamples[i] = (s32) Random () >> 11;
+
+			s_Expected[i] = (s32) (((s64) pSamples[i] * nGain) >> 16);
+		}
+
+		if (   !WriteStream (pStream, pSamples, CHECK_FRAMES * 2 * sizeof (s32))
+		    || !CompareFrames (&Mixer, s_Expected, CHECK_FRAMES, "Gain"))
+		{
+			m_Logger.Write (FromKernel, LogError, "Gain 0x%X failed", nGain);
+
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+// the sum of two streams must saturate at the 24-bit range
+boolean CKernel::CheckClipping (void)
+{
+	CCheckSoundDevice Device;
+	CSoundMixer Mixer (&Device);
+
+	CSoundMixerStream *pStream1 = Mixer.AddStream (SoundFormatSigned24_32, 2, HW_SAMPLE_RATE);
+	CSoundMixerStream *pStream2 = Mixer.AddStream (SoundFormatSigned24_32, 2, HW_SAMPLE_RATE);
+	if (   pStream1 == 0
+	    || pStream2 == 0)
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Cannot add stream");
+	}
+
+	pStream2->SetGain (SOUND_MIXER_UNITY_GAIN * 2);
+
+	// full scale samples, so that about half of the sums are clipped
+	static s32 Samples1[CHECK_FRAMES * 2];
+	static s32 Samples2[CHECK_FRAMES * 2];
+	unsigned nClipped = 0;
+	for (unsigned i = 0; i < CHECK_FRAMES * 2; i++)
+	{
+		Samples1[i] = (s32) Random () >> 8;
+		Samples2[i] = (s32) Random () >> 8;
+
+		// sums just beyond the clip levels first
+		switch (i)
+		{
+		case 0:	Samples1[i] = SAMPLE_MAX - 1;	Samples2[i] = 1;	break;
+		case 1:	Samples1[i] = -SAMPLE_MAX - 1;	Samples2[i] = 0;	break;
+		case 2:	Samples1[i] = SAMPLE_MAX - 2;	Samples2[i] = 1;	break;
+		case 3:	Samples1[i] = -SAMPLE_MAX;	Samples2[i] = 0;	break;
+		}
+
+		s64 nSum = (s64) Samples1[i] + Samples2[i] * 2;
+		s_Expected[i] = Clip (nSum);
+
+		nClipped += s_Expected[i] != nSum;
+	}
+
+	assert (nClipped > 0);
+
+	return    WriteStream (pStream1, Samples1, sizeof Samples1)
+	       && WriteStream (pStream2, Samples2, sizeof Samples2)
+	       && CompareFrames (&Mixer, s_Expected, CHECK_FRAMES, "Clipping");
+}
+
+// a sine wave resampled from 44100 Hz to 48000 Hz must have the given SNR,
+// the noise is the difference to the best fitting sine wave at the output
+boolean CKernel::CheckResampling (void)
+{
+	CCheckSoundDevice Device;
+	CSoundMixer Mixer (&Device);
+
+	CSoundMixerStream *pStream = Mixer.AddStream (SoundFormatSigned24_32, 1, SINE_SAMPLE_RATE);
+	if (pStream == 0)
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Cannot add stream");
+	}
+
+	// -6 dBFS
+	double fAmplitude = (double) (1 << 22);
+	double fInStep = 2*PI * SINE_FREQUENCY / SINE_SAMPLE_RATE;
+	double fOutStep = 2*PI * SINE_FREQUENCY / HW_SAMPLE_RATE;
+
+	unsigned nInFrames = 0;
+	double fSumSin = 0.0, fSumCos = 0.0;
+	double fSumSquare = 0.0;
+
+	for (unsigned nOutFrames = 0; nOutFrames < SNR_SKIP_FRAMES + SNR_FRAMES; )
+	{
+		// keep the stream queue filled
+		unsigned nFrames = pStream->GetQueueFramesFree ();
+		for (unsigned i = 0; i < nFrames; i++)
+		{
+			s32 nSample = (s32) (fAmplitude * Sine (fInStep * (nInFrames++ % SINE_SAMPLE_RATE)));
+
+			int nResult = pStream->Write (&nSample, sizeof nSample);
+			assert (nResult == sizeof nSample);
+		}
+
+		const s32 *pFrames = Mixer.GetFrames (SNR_SKIP_FRAMES + SNR_FRAMES - nOutFrames,
+						      &nFrames);
+		assert (pFrames != 0);
+
+		for (unsigned i = 0; i < nFrames; i++, nOutFrames++)
+		{
+			if (nOutFrames < SNR_SKIP_FRAMES)
+			{
+				continue;
+			}
+
+			double fSample = pFrames[i*2];
+			double fPhase = fOutStep * ((nOutFrames - SNR_SKIP_FRAMES) % HW_SAMPLE_RATE);
+
+			fSumSin += fSample * Sine (fPhase);
+			fSumCos += fSample * Sine (fPhase + PI/2);
+			fSumSquare += fSample * fSample;
+		}
+	}
+
+	if (pStream->GetUnderruns () != 0)
+	{
+		m_Logger.Write (FromKernel, LogError, "Resampling: %u underruns",
+				pStream->GetUnderruns ());
+
+		return FALSE;
+	}
+
+	// the window contains whole periods, so that sine and cosine are orthogonal:
+	// energy of the fitted sine = (a^2 + b^2) * N / 2 with a = 2/N * sum (y * sin)
+	double fSignal = 2.0 * (fSumSin * fSumSin + fSumCos * fSumCos) / SNR_FRAMES;
+	double fNoise = fSumSquare - fSignal;
+	if (fNoise < 1.0)
+	{
+		fNoise = 1.0;
+	}
+
+	// SNR in dB in steps of 1 dB (without libm)
+	unsigned nSNR = 0;
+	for (double fRatio = fSignal / fNoise; fRatio >= 1.2589254 && nSNR < 200; nSNR++)
+	{
+		fRatio /= 1.2589254;			// 10^0.1
+	}
+
+	if (nSNR < SNR_MIN_DB)
+	{
+		m_Logger.Write (FromKernel, LogError, "Resampling: SNR is %u dB (min. %u dB)",
+				nSNR, SNR_MIN_DB);
+
+		return FALSE;
+	}
+
+	m_Logger.Write (FromKernel, LogNotice, "Resampling %u Hz -> %u Hz: SNR is %u dB",
+			SINE_SAMPLE_RATE, HW_SAMPLE_RATE, nSNR);
+
+	return TRUE;
+}
+
+boolean CKernel::WriteStream (CSoundMixerStream *pStream, const void *pBuffer, size_t nCount)
+{
+	assert (pStream != 0);
+
+	if (pStream->Write (pBuffer, nCount) != (int) nCount)
+	{
+		m_Logger.Write (FromKernel, LogError, "Cannot write to stream");
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+boolean CKernel::CompareFrames (CSoundMixer *pMixer, const s32 *pExpected, unsigned nFrames,
+				const char *pTest)
+{
+	assert (pMixer != 0);
+	assert (pExpected != 0);
+
+	for (unsigned nFrame = 0; nFrame < nFrames; )
+	{
+		unsigned nGot;
+		const s32 *pFrames = pMixer->GetFrames (nFrames - nFrame, &nGot);
+		assert (pFrames != 0);
+
+		for (unsigned i = 0; i < nGot * 2; i++)
+		{
+			if (pFrames[i] != pExpected[nFrame*2 + i])
+			{
+				m_Logger.Write (FromKernel, LogError,
+						"%s: frame %u: sample is %d, expected %d", pTest,
+						nFrame + i/2, pFrames[i], pExpected[nFrame*2 + i]);
+
+				return FALSE;
+			}
+		}
+
+		nFrame += nGot;
+	}
+
+	return TRUE;
+}
+
+void CKernel::FillStream (CSoundMixerStream *pStream, unsigned nChannels,
+			  CToneGenerator *pLeft, CToneGenerator *pRight)
+{
+	assert (pStream != 0);
+	assert (nChannels == 1 || nChannels == 2);
+
+	unsigned nFrames;
+	while ((nFrames = pStream->GetQueueFramesFree ()) > 0)
+	{
+		if (nFrames > WRITE_FRAMES)
+		{
+			nFrames = WRITE_FRAMES;
+		}
+
+		s16 Buffer[WRITE_FRAMES * 2];
+		for (unsigned i = 0; i < nFrames; i++)
+		{
+			assert (pLeft != 0);
+			Buffer[i*nChannels] = pLeft->NextSample ();
+
+			if (nChannels == 2)
+			{
+				assert (pRight != 0);
+				Buffer[i*2 + 1] = pRight->NextSample ();
+			}
+		}
+
+		size_t nBytes = nFrames * nChannels * sizeof (s16);
+		int nResult = pStream->Write (Buffer, nBytes);
+		assert (nResult == (int) nBytes);
+	}
+}
+
+CKernel::CToneGenerator::CToneGenerator (unsigned nFrequency, unsigned nSampleRate)
+:	m_nPhase (0),
+	m_nIncrement ((u32) (((u64) nFrequency << 32) / nSampleRate))
+{
+}
+
+s16 CKernel::CToneGenerator::NextSample (void)
+{
+	// triangle wave from the upper bits of the phase, amplitude is -6 dBFS
+	s32 nValue = (s32) (m_nPhase >> 15);		// 0..131071
+	if (nValue >= 65536)
+	{
+		nValue = 131071 - nValue;
+	}
+	nValue -= 32768;				// -32768..32767
+
+	m_nPhase += m_nIncrement;
+
+	return (s16) (nValue / 2);
+}
@@ -0,0 +1,94 @@
+//
+// kernel.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _kernel_h
+#define _kernel_h
+
+#include <circle/actled.h>
+#include <circle/koptions.h>
+#include <circle/devicenameservice.h>
+#include <circle/screen.h>
+#include <circle/serial.h>
+#include <circle/exceptionhandler.h>
+#include <circle/interrupt.h>
+#include <circle/timer.h>
+#include <circle/logger.h>
+#include <circle/sound/pwmsoundbasedevice.h>
+#include <circle/sound/soundmixer.h>
+#include <circle/types.h>
+
+enum TShutdownMode
+{
+	ShutdownNone,
+	ShutdownHalt,
+	ShutdownReboot
+};
+
+class CKernel
+{
+public:
+	CKernel (void);
+	~CKernel (void);
+
+	boolean Initialize (void);
+
+	TShutdownMode Run (void);
+
+private:
+	class CToneGenerator		// triangle wave with phase accumulator
+	{
+	public:
+		CToneGenerator (unsigned nFrequency, unsigned nSampleRate);
+
+		s16 NextSample (void);
+
+	private:
+		u32 m_nPhase;
+		u32 m_nIncrement;
+	};
+
+	boolean CheckPassthrough (TSoundFormat Format, unsigned nChannels);
+	boolean CheckGain (void);
+	boolean CheckClipping (void);
+	boolean CheckResampling (void);
+
+	boolean WriteStream (CSoundMixerStream *pStream, const void *pBuffer, size_t nCount);
+	boolean CompareFrames (CSoundMixer *pMixer, const s32 *pExpected, unsigned nFrames,
+			       const char *pTest);
+
+	static void FillStream (CSoundMixerStream *pStream, unsigned nChannels,
+				CToneGenerator *pLeft, CToneGenerator *pRight);
+
+private:
+	// do not change this order
+	CActLED			m_ActLED;
+	CKernelOptions		m_Options;
+	CDeviceNameService	m_DeviceNameService;
+	CScreenDevice		m_Screen;
+	CSerialDevice		m_Serial;
+	CExceptionHandler	m_ExceptionHandler;
+	CInterruptSystem	m_Interrupt;
+	CTimer			m_Timer;
+	CLogger			m_Logger;
+
+	CPWMSoundBaseDevice	m_PWMSound;
+	CSoundMixer		m_Mixer;
+};
+
+#endif
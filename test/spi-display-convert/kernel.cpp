@@ -0,0 +1,233 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <display/spidisplaypipeline.h>
+#include <circle/util.h>
+#include <assert.h>
+
+#define MAX_WIDTH	320
+#define MAX_HEIGHT	240
+#define ITERATIONS	100
+
+LOGMODULE ("kernel");
+
+static u16 s_Source[MAX_WIDTH * MAX_HEIGHT];
+static u16 s_Result[MAX_WIDTH * MAX_HEIGHT + 1];	// with guard pixel
+static u16 s_Reference[MAX_WIDTH * MAX_HEIGHT];
+
+// the per-pixel conversion, which was used by the display drivers before
+static void ConvertReference (u16 *pTo, const u16 *pFrom, int nWidth, int nHeight,
+			      unsigned nRotation, boolean bSwapBytes)
+{
+	u16 *pStart = pTo;
+
+	switch (nRotation)
+	{
+	case 0:
+		memcpy (pTo, pFrom, nWidth * nHeight * sizeof (u16));
+		break;
+
+	case 90:
+		for (int x = 0; x < nWidth; x++)
+		{
+			for (int y = nHeight-1; y >= 0; y--)
+			{
+				*pTo++ = pFrom[x + y * nWidth];
+			}
+		}
+		break;
+
+	case 180:
+		for (int y = nHeight-1; y >= 0; y--)
+		{
+			for (int x = nWidth-1; x >= 0; x--)
+			{
+				*pTo++ = pFrom[x + y * nWidth];
+			}
+		}
+		break;
+
+	case 270:
+		for (int x = nWidth-1; x >= 0; x--)
+		{
+			for (int y = 0; y < nHeight; y++)
+			{
+				*pTo++ = pFrom[x + y * nWidth];
+			}
+		}
+		break;
+
+	default:
+		assert (0);
+		break;
+	}
+
+	if (bSwapBytes)
+	{
+		for (int i = 0; i < nWidth * nHeight; i++)
+		{
+			pStart[i] = bswap16 (pStart[i]);
+		}
+	}
+}
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer)
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	LOGNOTE ("Compile time: " __DATE__ " " __TIME__);
+
+	u32 nSeed = 1;
+	for (unsigned i = 0; i < MAX_WIDTH * MAX_HEIGHT; i++)
+	{
+		nSeed = nSeed * 1103515245 + 12345;
+		s_Source[i] = (u16) (nSeed >> 16);
+	}
+
+	// width x height, some are not a multiple of the tile size (8) or block size (32)
+	static const unsigned Sizes[][2] =
+	{
+		{1, 1}, {7, 9}, {8, 8}, {16, 8}, {17, 33}, {32, 32}, {33, 31},
+		{64, 40}, {100, 3}, {3, 100}, {240, 320}, {320, 240}
+	};
+
+	unsigned nTests = 0;
+	unsigned nFailed = 0;
+	for (unsigned nSize = 0; nSize < sizeof Sizes / sizeof Sizes[0]; nSize++)
+	{
+		for (unsigned nRotation = 0; nRotation < 360; nRotation += 90)
+		{
+			for (unsigned nSwap = 0; nSwap <= 1; nSwap++)
+			{
+				nTests++;
+				nFailed += !TestConvert (Sizes[nSize][0], Sizes[nSize][1],
+							 nRotation, nSwap == 1);
+			}
+		}
+	}
+
+	if (nFailed == 0)
+	{
+		LOGNOTE ("All %u tests passed", nTests);
+	}
+	else
+	{
+		LOGERR ("%u of %u tests failed", nFailed, nTests);
+	}
+
+	for (unsigned nRotation = 0; nRotation < 360; nRotation += 90)
+	{
+		MeasureConvert (nRotation, FALSE);
+		MeasureConvert (nRotation, TRUE);
+	}
+
+	return ShutdownHalt;
+}
+
+boolean CKernel::TestConvert (unsigned nWidth, unsigned nHeight, unsigned nRotation,
+			      boolean bSwapBytes)
+{
+	assert (nWidth * nHeight <= MAX_WIDTH * MAX_HEIGHT);
+	unsigned nPixels = nWidth * nHeight;
+
+	// the guard pixel behind the result must not be written
+	memset (s_Result, 0, (nPixels + 1) * sizeof (u16));
+	s_Result[nPixels] = 0xA5A5;
+
+	CSPIDisplayPipeline::ConvertPixels (s_Result, s_Source, nWidth, nHeight,
+					    nRotation, bSwapBytes);
+
+	ConvertReference (s_Reference, s_Source, nWidth, nHeight, nRotation, bSwapBytes);
+
+	if (   memcmp (s_Result, s_Reference, nPixels * sizeof (u16)) != 0
+	    || s_Result[nPixels] != 0xA5A5)
+	{
+		LOGERR ("%ux%u, %u degrees%s: Result differs", nWidth, nHeight, nRotation,
+			bSwapBytes ? ", swapped" : "");
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+void CKernel::MeasureConvert (unsigned nRotation, boolean bSwapBytes)
+{
+	unsigned nStartTicks = CTimer::GetClockTicks ();
+
+	for (unsigned i = 0; i < ITERATIONS; i++)
+	{
+		CSPIDisplayPipeline::ConvertPixels (s_Result, s_Source, MAX_WIDTH, MAX_HEIGHT,
+						    nRotation, bSwapBytes);
+	}
+
+	unsigned nTicks = CTimer::GetClockTicks () - nStartTicks;
+
+	LOGNOTE ("%ux%u, %u degrees%s: %u us per area", MAX_WIDTH, MAX_HEIGHT, nRotation,
+		 bSwapBytes ? ", swapped" : "", nTicks / (CLOCKHZ / 1000000) / ITERATIONS);
+}
@@ -0,0 +1,179 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <assert.h>
+
+#define MEASURE_USECS	3000000		// run each test for about three seconds
+#define UPDATE_MSECS	20		// display update interval for TestDelayedUpdate
+
+static const char FromKernel[] = "kernel";
+
+static const char *s_pTestName[] =
+{
+	"Long lines",
+	"Short lines",
+	"Colored lines",
+	"Delayed update"
+};
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer)
+{
+	m_ActLED.Blink (5);	// show we are alive
+}
+
+CKernel::~CKernel (void)
+{
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		// the screen is busy with the benchmark
+		bOK = m_Logger.Initialize (&m_Serial);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+	CBcmFrameBuffer *pFrameBuffer = m_Screen.GetFrameBuffer ();
+	assert (pFrameBuffer != 0);
+
+	m_Logger.Write (FromKernel, LogNotice, "Screen %ux%u pixels, %ux%u characters, %u bits",
+			m_Screen.GetWidth (), m_Screen.GetHeight (),
+			m_Screen.GetColumns (), m_Screen.GetRows (), pFrameBuffer->GetDepth ());
+
+	m_Logger.Write (FromKernel, LogNotice, "Hardware scrolling is %s",
+			  pFrameBuffer->GetVirtHeight () >= 2 * m_Screen.GetHeight ()
+			? "enabled" : "disabled");
+
+	// TestDelayedUpdate must be the last test, because the delayed mode cannot be left
+	for (unsigned i = 0; i < TestUnknown; i++)
+	{
+		Measure ((TTest) i);
+	}
+
+	m_Screen.Write ("\x1b[H\x1b[J", 6);
+	m_Screen.Update ();
+
+	for (unsigned i = 0; i < TestUnknown; i++)
+	{
+		m_Screen.Write (m_Result[i], m_Result[i].GetLength ());
+		m_Screen.Write ("\n", 1);
+	}
+
+	m_Screen.Update ();
+
+	m_Logger.Write (FromKernel, LogNotice, "Benchmark finished");
+
+	return ShutdownHalt;
+}
+
+void CKernel::Measure (TTest Test)
+{
+	assert (Test < TestUnknown);
+
+	// build one line of text, which ends with a newline
+	unsigned nColumns = m_Screen.GetColumns ();
+	unsigned nLength = Test == TestShortLines ? nColumns / 2 : nColumns - 1;
+
+	CString Line;
+	for (unsigned i = 0; i < nLength; i++)
+	{
+		char Char[] = {(char) ('!' + i % 94), '\0'};
+
+		if (   Test == TestColoredLines
+		    && i % 8 == 0)
+		{
+			CString Color;
+			Color.Format ("\x1b[%um", 31 + i / 8 % 7);
+			Line.Append (Color);
+		}
+
+		Line.Append (Char);
+	}
+
+	if (Test == TestColoredLines)
+	{
+		Line.Append ("\x1b[0m");
+	}
+
+	Line.Append ("\n");
+
+	if (Test == TestDelayedUpdate)
+	{
+		m_Screen.Update ();		// enable delayed mode
+	}
+
+	unsigned nLines = 0;
+	unsigned nStartTicks = m_Timer.GetClockTicks ();
+	unsigned nTicks;
+
+	do
+	{
+		m_Screen.Write (Line, Line.GetLength ());
+
+		if (Test == TestDelayedUpdate)
+		{
+			m_Screen.Update (UPDATE_MSECS);
+		}
+
+		nLines++;
+
+		nTicks = m_Timer.GetClockTicks () - nStartTicks;
+	}
+	while (nTicks < MEASURE_USECS);
+
+	unsigned nPerSecond = (unsigned) ((u64) nLines * 1000000 / nTicks);
+
+	m_Result[Test].Format ("%-16s %7u lines/s %9u chars/s", s_pTestName[Test],
+			       nPerSecond, nPerSecond * nLength);
+
+	m_Logger.Write (FromKernel, LogNotice, "%s", (const char *) m_Result[Test]);
+}
@@ -0,0 +1,58 @@
+//
+// worktask.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "worktask.h"
+#include <circle/sched/scheduler.h>
+#include <circle/tracer.h>
+#include <circle/timer.h>
+#include <assert.h>
+
+unsigned CWorkTask::s_nItems = 0;
+
+CWorkTask::CWorkTask (unsigned nTaskNumber)
+:	m_nTaskNumber (nTaskNumber),
+	m_nSeed (nTaskNumber + 1)
+{
+}
+
+CWorkTask::~CWorkTask (void)
+{
+}
+
+void CWorkTask::Run (void)
+{
+	CTracer *pTracer = CTracer::Get ();
+	assert (pTracer != 0);
+
+	while (1)
+	{
+		m_nSeed = m_nSeed * 1103515245 + 12345;
+		unsigned nWorkMicros = 100 + (m_nSeed >> 16) % 2000;
+
+		pTracer->Begin (EVENT_WORK, m_nTaskNumber);
+
+		CTimer::SimpleusDelay (nWorkMicros);		// simulate some work
+
+		pTracer->End (EVENT_WORK);
+
+		pTracer->Counter (EVENT_ITEMS, ++s_nItems);
+
+		CScheduler::Get ()->MsSleep (1 + m_nTaskNumber);
+	}
+}
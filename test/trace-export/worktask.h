@@ -0,0 +1,46 @@
+//
+// worktask.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _worktask_h
+#define _worktask_h
+
+#include <circle/sched/task.h>
+#include <circle/types.h>
+
+#define EVENT_WORK		1		// span, param: task number
+#define EVENT_ITEMS		2		// counter: number of work items
+
+class CWorkTask : public CTask
+{
+public:
+	CWorkTask (unsigned nTaskNumber);
+	~CWorkTask (void);
+
+	void Run (void);
+
+	static unsigned GetItems (void)		{ return s_nItems; }
+
+private:
+	unsigned m_nTaskNumber;
+	u32 m_nSeed;
+
+	static unsigned s_nItems;
+};
+
+#endif
@@ -0,0 +1,472 @@
+//
+// kernel.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "kernel.h"
+#include <circle/new.h>
+#include <circle/util.h>
+#include <assert.h>
+
+#define DEVICE_NAME		"umsd1"
+
+#define SCRATCH_SIZE		0x40000		// at the end of the drive, restored afterwards
+#define AREA_SIZE		0x80000		// for segments, which are not from the pool
+#define AREA_ALIGN		0x10000		// xHCI TRBs must not cross this boundary
+
+#define POOL_BUFFER_SIZE	0x8000
+#define POOL_BUFFERS		CUSBRequest::MaxSegments
+
+static const char FromKernel[] = "kernel";
+
+static const TSegmentLayout s_Single8K =
+	{"single 8K", FALSE, 1, {{0x1000, 0x2000}}};
+static const TSegmentLayout s_Boundary8K =
+	{"single 8K across 64K", FALSE, 1, {{0xF000, 0x2000}}};
+static const TSegmentLayout s_Multi8K =
+	{"3 segments 8K", FALSE, 3, {{0x100, 960}, {0x1000, 3136}, {0x3040, 4096}}};
+static const TSegmentLayout s_Pool8K =
+	{"4 pool buffers 8K", TRUE, 4, {{0, 0x800}, {0, 0x800}, {0, 0x800}, {0, 0x800}}};
+
+static const TSegmentLayout s_Single192K =
+	{"single 192K", FALSE, 1, {{0xFC00, 0x30000}}};
+static const TSegmentLayout s_Multi192K =
+	{"3 segments 192K", FALSE, 3, {{0xF000, 0xA000}, {0x1FC00, 0x14000}, {0x3C000, 0x12000}}};
+static const TSegmentLayout s_Pool192K =
+	{"6 pool buffers 192K", TRUE, 6, {{0, 0x8000}, {0, 0x8000}, {0, 0x8000},
+					  {0, 0x8000}, {0, 0x8000}, {0, 0x8000}}};
+
+static const TSegmentLayout s_Single256K =
+	{"single 256K", FALSE, 1, {{0x1FFC0, 0x40000}}};
+static const TSegmentLayout s_Pool256K =
+	{"8 pool buffers 256K", TRUE, 8, {{0, 0x8000}, {0, 0x8000}, {0, 0x8000}, {0, 0x8000},
+					  {0, 0x8000}, {0, 0x8000}, {0, 0x8000}, {0, 0x8000}}};
+
+static const struct
+{
+	const TSegmentLayout *pWrite;
+	const TSegmentLayout *pRead;
+}
+s_Transfers[] =
+{
+	{&s_Single8K,	&s_Multi8K},
+	{&s_Multi8K,	&s_Pool8K},
+	{&s_Pool8K,	&s_Boundary8K},
+	{&s_Boundary8K,	&s_Single8K},
+	{&s_Single192K,	&s_Multi192K},
+	{&s_Multi192K,	&s_Pool192K},
+	{&s_Pool192K,	&s_Single192K},
+	{&s_Single256K,	&s_Pool256K},
+	{&s_Pool256K,	&s_Single256K}
+};
+
+static u8 Pattern (unsigned nSeed, u32 nPosition)
+{
+	u32 nValue = (nPosition ^ nSeed << 24) * 2654435761U;
+
+	return (u8) (nValue >> 24);
+}
+
+CKernel::CKernel (void)
+:	m_Screen (m_Options.GetWidth (), m_Options.GetHeight ()),
+	m_Timer (&m_Interrupt),
+	m_Logger (m_Options.GetLogLevel (), &m_Timer),
+	m_USBHCI (&m_Interrupt, &m_Timer),
+	m_BufferPool (POOL_BUFFER_SIZE, POOL_BUFFERS),
+	m_pUMSD (0),
+	m_ullScratchOffset (0),
+	m_pAreaMemory (new (HEAP_DMA30) u8[AREA_SIZE + AREA_ALIGN]),
+	m_pArea (0)
+{
+	m_ActLED.Blink (5);	// show we are alive
+
+	if (m_pAreaMemory != 0)
+	{
+		m_pArea = (u8 *) (((uintptr) m_pAreaMemory + AREA_ALIGN-1) & ~(AREA_ALIGN-1));
+	}
+}
+
+CKernel::~CKernel (void)
+{
+	delete [] m_pAreaMemory;
+}
+
+boolean CKernel::Initialize (void)
+{
+	boolean bOK = TRUE;
+
+	if (bOK)
+	{
+		bOK = m_Screen.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Serial.Initialize (115200);
+	}
+
+	if (bOK)
+	{
+		CDevice *pTarget = m_DeviceNameService.GetDevice (m_Options.GetLogDevice (), FALSE);
+		if (pTarget == 0)
+		{
+			pTarget = &m_Screen;
+		}
+
+		bOK = m_Logger.Initialize (pTarget);
+	}
+
+	if (bOK)
+	{
+		bOK = m_Interrupt.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_Timer.Initialize ();
+	}
+
+	if (bOK)
+	{
+		bOK = m_USBHCI.Initialize ();
+	}
+
+	return bOK;
+}
+
+TShutdownMode CKernel::Run (void)
+{
+	m_Logger.Write (FromKernel, LogNotice, "Compile time: " __DATE__ " " __TIME__);
+
+	if (   m_pArea == 0
+	    || !m_BufferPool.IsValid ())
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Not enough memory");
+	}
+
+	m_pUMSD = (CUSBBulkOnlyMassStorageDevice *) m_DeviceNameService.GetDevice (DEVICE_NAME, TRUE);
+	if (m_pUMSD == 0)
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Device not found: %s", DEVICE_NAME);
+	}
+
+	if (m_pUMSD->GetBulkEndpoint (TRUE) == 0)
+	{
+		m_Logger.Write (FromKernel, LogPanic, "UAS is not supported (use usbignore=int8-6-62)");
+	}
+
+	if (m_pUMSD->GetSize () < SCRATCH_SIZE)
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Drive is too small");
+	}
+
+	m_ullScratchOffset = m_pUMSD->GetSize () - SCRATCH_SIZE;
+
+	u8 *pSaved = new u8[SCRATCH_SIZE];
+	assert (pSaved != 0);
+
+	m_pUMSD->Seek (m_ullScratchOffset);
+	if (m_pUMSD->Read (pSaved, SCRATCH_SIZE) != SCRATCH_SIZE)
+	{
+		m_Logger.Write (FromKernel, LogPanic, "Cannot save scratch area");
+	}
+
+	unsigned nTests = 0;
+	unsigned nFailed = 0;
+
+	for (unsigned i = 0; i < sizeof s_Transfers / sizeof s_Transfers[0]; i++)
+	{
+		nTests++;
+		if (!CheckTransfer (s_Transfers[i].pWrite, s_Transfers[i].pRead))
+		{
+			nFailed++;
+		}
+	}
+
+	nTests++;
+	if (!CheckResubmit (&s_Multi8K, &s_Single8K))
+	{
+		nFailed++;
+	}
+
+	nTests++;
+	if (!CheckResubmit (&s_Multi192K, &s_Single192K))
+	{
+		nFailed++;
+	}
+
+	m_pUMSD->Seek (m_ullScratchOffset);
+	if (m_pUMSD->Write (pSaved, SCRATCH_SIZE) != SCRATCH_SIZE)
+	{
+		m_Logger.Write (FromKernel, LogError, "Cannot restore scratch area");
+	}
+
+	delete [] pSaved;
+
+	m_Logger.Write (FromKernel, LogNotice, "Buffer pool: %u allocations, %u failures",
+			m_BufferPool.GetAllocations (), m_BufferPool.GetFailures ());
+
+	if (nFailed == 0)
+	{
+		m_Logger.Write (FromKernel, LogNotice, "All %u tests passed", nTests);
+	}
+	else
+	{
+		m_Logger.Write (FromKernel, LogError, "%u of %u tests failed", nFailed, nTests);
+	}
+
+	return ShutdownHalt;
+}
+
+boolean CKernel::CheckTransfer (const TSegmentLayout *pWrite, const TSegmentLayout *pRead)
+{
+	assert (pWrite != 0);
+	assert (pRead != 0);
+	assert (GetLength (pWrite) == GetLength (pRead));
+
+	static unsigned nSeed = 0;
+	nSeed++;
+
+	m_Logger.Write (FromKernel, LogNotice, "Write %s, read %s", pWrite->pName, pRead->pName);
+
+	CUSBRequest *pURB = CreateRequest (pWrite, FALSE, nSeed);
+	boolean bOK = Transfer (pURB, 1);
+	DeleteRequest (pURB, pWrite);
+
+	if (bOK)
+	{
+		pURB = CreateRequest (pRead, TRUE, nSeed);
+		bOK = Transfer (pURB, 1) && CheckSegments (pURB, nSeed);
+		DeleteRequest (pURB, pRead);
+	}
+
+	if (!bOK)
+	{
+		m_Logger.Write (FromKernel, LogError, "Test failed");
+	}
+
+	return bOK;
+}
+
+// submits the same OUT request twice with different data
+boolean CKernel::CheckResubmit (const TSegmentLayout *pWrite, const TSegmentLayout *pRead)
+{
+	assert (pWrite != 0);
+	assert (pRead != 0);
+	assert (GetLength (pWrite) == GetLength (pRead));
+
+	m_Logger.Write (FromKernel, LogNotice, "Write %s twice, read %s", pWrite->pName, pRead->pName);
+
+	const unsigned nSeed = 100;
+
+	CUSBRequest *pURB = CreateRequest (pWrite, FALSE, nSeed);
+	boolean bOK = Transfer (pURB, 1);
+	if (bOK)
+	{
+		FillSegments (pURB, nSeed+1);
+
+		bOK = Transfer (pURB, 2);
+	}
+	DeleteRequest (pURB, pWrite);
+
+	if (bOK)
+	{
+		pURB = CreateRequest (pRead, TRUE, 0);
+		bOK = Transfer (pURB, 1) && CheckSegments (pURB, nSeed+1);
+		DeleteRequest (pURB, pRead);
+	}
+
+	if (!bOK)
+	{
+		m_Logger.Write (FromKernel, LogError, "Test failed");
+	}
+
+	return bOK;
+}
+
+boolean CKernel::Transfer (CUSBRequest *pURB, unsigned nSubmissions)
+{
+	assert (pURB != 0);
+	assert (m_pUMSD != 0);
+
+	u32 nLength = pURB->GetBufLen ();
+
+	m_pUMSD->Seek (m_ullScratchOffset);
+	int nResult = m_pUMSD->TransferSegments (pURB);
+	if (nResult != (int) nLength)
+	{
+		m_Logger.Write (FromKernel, LogError, "Transfer failed (%d)", nResult);
+
+		return FALSE;
+	}
+
+	unsigned nAllocations = pURB->GetBufferAllocations ();
+	u32 nBytesCopied = pURB->GetBytesCopied ();
+
+	m_Logger.Write (FromKernel, LogNotice, "%s %u bytes in %u segment(s): "
+			"%u buffer allocation(s), %u bytes copied",
+			pURB->GetEndpoint ()->IsDirectionIn () ? "Read" : "Wrote",
+			nLength, pURB->GetNumSegments (), nAllocations, nBytesCopied);
+
+	// only the DWHCI has no scatter-gather support
+	unsigned nExpectedAllocations = 0;
+	u32 nExpectedBytesCopied = 0;
+#if RASPPI <= 3
+	if (pURB->GetNumSegments () > 1)
+	{
+		nExpectedAllocations = 1;
+		nExpectedBytesCopied = nLength * nSubmissions;
+	}
+#endif
+
+	if (   nAllocations != nExpectedAllocations
+	    || nBytesCopied != nExpectedBytesCopied)
+	{
+		m_Logger.Write (FromKernel, LogError, "Expected %u allocation(s), %u bytes copied",
+				nExpectedAllocations, nExpectedBytesCopied);
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+CUSBRequest *CKernel::CreateRequest (const TSegmentLayout *pLayout, boolean bIn, unsigned nSeed)
+{
+	assert (pLayout != 0);
+	assert (pLayout->nSegments > 0);
+	assert (pLayout->nSegments <= CUSBRequest::MaxSegments);
+	assert (m_pUMSD != 0);
+
+	CUSBRequest *pURB = 0;
+
+	for (unsigned i = 0; i < pLayout->nSegments; i++)
+	{
+		u32 nLength = pLayout->Segment[i].nLength;
+
+		u8 *pBuffer;
+		if (pLayout->bFromPool)
+		{
+			assert (nLength <= m_BufferPool.GetBufferSize ());
+			pBuffer = (u8 *) m_BufferPool.Allocate ();
+		}
+		else
+		{
+			assert (pLayout->Segment[i].nOffset + nLength <= AREA_SIZE);
+			pBuffer = m_pArea + pLayout->Segment[i].nOffset;
+		}
+
+		assert (pBuffer != 0);
+		assert (CUSBBufferPool::IsDMASafe (pBuffer, nLength));
+
+		if (i == 0)
+		{
+			pURB = new CUSBRequest (m_pUMSD->GetBulkEndpoint (bIn), pBuffer, nLength);
+			assert (pURB != 0);
+		}
+		else
+		{
+			pURB->AddSegment (pBuffer, nLength);
+		}
+	}
+
+	if (bIn)
+	{
+		for (unsigned i = 0; i < pURB->GetNumSegments (); i++)
+		{
+			memset (pURB->GetSegmentBuffer (i), 0, pURB->GetSegmentLength (i));
+		}
+	}
+	else
+	{
+		FillSegments (pURB, nSeed);
+	}
+
+	return pURB;
+}
+
+void CKernel::FillSegments (CUSBRequest *pURB, unsigned nSeed)
+{
+	assert (pURB != 0);
+
+	u32 nPosition = 0;
+	for (unsigned i = 0; i < pURB->GetNumSegments (); i++)
+	{
+		u8 *pBuffer = (u8 *) pURB->GetSegmentBuffer (i);
+		for (u32 j = 0; j < pURB->GetSegmentLength (i); j++)
+		{
+			pBuffer[j] = Pattern (nSeed, nPosition++);
+		}
+	}
+}
+
+boolean CKernel::CheckSegments (CUSBRequest *pURB, unsigned nSeed)
+{
+	assert (pURB != 0);
+
+	u32 nPosition = 0;
+	for (unsigned i = 0; i < pURB->GetNumSegments (); i++)
+	{
+		const u8 *pBuffer = (const u8 *) pURB->GetSegmentBuffer (i);
+		for (u32 j = 0; j < pURB->GetSegmentLength (i); j++)
+		{
+			u8 uchExpected = Pattern (nSeed, nPosition);
+			if (pBuffer[j] != uchExpected)
+			{
+				m_Logger.Write (FromKernel, LogError,
+						"Data mismatch at %u (segment %u): 0x%02X, expected 0x%02X",
+						nPosition, i, (unsigned) pBuffer[j],
+						(unsigned) uchExpected);
+
+				return FALSE;
+			}
+
+			nPosition++;
+		}
+	}
+
+	return TRUE;
+}
+
+void CKernel::DeleteRequest (CUSBRequest *pURB, const TSegmentLayout *pLayout)
+{
+	assert (pURB != 0);
+	assert (pLayout != 0);
+
+	if (pLayout->bFromPool)
+	{
+		for (unsigned i = 0; i < pURB->GetNumSegments (); i++)
+		{
+			m_BufferPool.Free (pURB->GetSegmentBuffer (i));
+		}
+	}
+
+	delete pURB;
+}
+
+u32 CKernel::GetLength (const TSegmentLayout *pLayout)
+{
+	assert (pLayout != 0);
+
+	u32 nLength = 0;
+	for (unsigned i = 0; i < pLayout->nSegments; i++)
+	{
+		nLength += pLayout->Segment[i].nLength;
+	}
+
+	return nLength;
+}
@@ -0,0 +1,107 @@
+//
+// kernel.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _kernel_h
+#define _kernel_h
+
+#include <circle/actled.h>
+#include <circle/koptions.h>
+#include <circle/devicenameservice.h>
+#include <circle/screen.h>
+#include <circle/serial.h>
+#include <circle/exceptionhandler.h>
+#include <circle/interrupt.h>
+#include <circle/timer.h>
+#include <circle/logger.h>
+#include <circle/usb/usbhcidevice.h>
+#include <circle/usb/usbmassdevice.h>
+#include <circle/usb/usbbufferpool.h>
+#include <circle/usb/usbrequest.h>
+#include <circle/types.h>
+
+enum TShutdownMode
+{
+	ShutdownNone,
+	ShutdownHalt,
+	ShutdownReboot
+};
+
+struct TSegmentLayout
+{
+	const char *pName;
+	boolean bFromPool;		// segments from CUSBBufferPool, offsets are ignored
+	unsigned nSegments;
+	struct
+	{
+		u32 nOffset;		// from a 64K boundary in the test area
+		u32 nLength;
+	}
+	Segment[CUSBRequest::MaxSegments];
+};
+
+class CKernel
+{
+public:
+	CKernel (void);
+	~CKernel (void);
+
+	boolean Initialize (void);
+
+	TShutdownMode Run (void);
+
+private:
+	boolean CheckTransfer (const TSegmentLayout *pWrite, const TSegmentLayout *pRead);
+	boolean CheckResubmit (const TSegmentLayout *pWrite, const TSegmentLayout *pRead);
+
+	// transfers to/from the scratch area, logs and checks the statistics of the request
+	// (nSubmissions: number of times pURB has been submitted, including this one)
+	boolean Transfer (CUSBRequest *pURB, unsigned nSubmissions);
+
+	// creates request for the segments of pLayout, fills them with the pattern for nSeed,
+	// if bIn is FALSE, or clears them otherwise
+	CUSBRequest *CreateRequest (const TSegmentLayout *pLayout, boolean bIn, unsigned nSeed);
+	void FillSegments (CUSBRequest *pURB, unsigned nSeed);
+	boolean CheckSegments (CUSBRequest *pURB, unsigned nSeed);
+	void DeleteRequest (CUSBRequest *pURB, const TSegmentLayout *pLayout);
+
+	static u32 GetLength (const TSegmentLayout *pLayout);
+
+private:
+	// do not change this order
+	CActLED			m_ActLED;
+	CKernelOptions		m_Options;
+	CDeviceNameService	m_DeviceNameService;
+	CScreenDevice		m_Screen;
+	CSerialDevice		m_Serial;
+	CExceptionHandler	m_ExceptionHandler;
+	CInterruptSystem	m_Interrupt;
+	CTimer			m_Timer;
+	CLogger			m_Logger;
+	CUSBHCIDevice		m_USBHCI;
+
+	CUSBBufferPool		m_BufferPool;
+
+	CUSBBulkOnlyMassStorageDevice *m_pUMSD;
+	u64 m_ullScratchOffset;
+
+	u8 *m_pAreaMemory;
+	u8 *m_pArea;			// 64K aligned
+};
+
+#endif
@@ -28,6 +28,7 @@ CKernel::CKernel (void)
 	m_Timer (&m_Interrupt),
 	m_Logger (m_Options.GetLogLevel (), &m_Timer),
 	m_EMMC (&m_Interrupt, &m_Timer, &m_ActLED),
+	m_ThroughputDevice (&m_EMMC),
 	m_MSDGadget (&m_Interrupt)
 {
 	m_ActLED.Blink (5);	// show we are alive
@@ -89,8 +90,10 @@ TShutdownMode CKernel::Run (void)
 {
 	LOGNOTE ("Compile time: " __DATE__ " " __TIME__);
 
-	m_MSDGadget.SetDevice (&m_EMMC);
+	// the throughput of the SD card accesses is logged every 5 seconds
+	m_MSDGadget.SetDevice (&m_ThroughputDevice);
 
+	unsigned nLastReport = m_Timer.GetUptime ();
 	for (unsigned nCount = 0; 1; nCount++)
 	{
 		m_MSDGadget.UpdatePlugAndPlay ();
@@ -98,6 +101,13 @@ TShutdownMode CKernel::Run (void)
 		// must be called from TASK_LEVEL to allow I/O operations
 		m_MSDGadget.Update ();
 
+		if (m_Timer.GetUptime () - nLastReport >= 5)
+		{
+			m_ThroughputDevice.Report ();
+
+			nLastReport = m_Timer.GetUptime ();
+		}
+
 		m_Screen.Rotor (0, nCount);
 	}
 
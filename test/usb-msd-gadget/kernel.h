@@ -31,6 +31,7 @@
 #include <circle/logger.h>
 #include <circle/usb/gadget/usbmsdgadget.h>
 #include <SDCard/emmc.h>
+#include "throughputdevice.h"
 #include <circle/types.h>
 
 enum TShutdownMode
@@ -63,6 +64,7 @@ private:
 	CLogger			m_Logger;
 
 	CEMMCDevice		m_EMMC;
+	CThroughputDevice	m_ThroughputDevice;
 	CUSBMSDGadget		m_MSDGadget;
 };
 
@@ -0,0 +1,104 @@
+//
+// throughputdevice.cpp
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "throughputdevice.h"
+#include <circle/timer.h>
+#include <circle/logger.h>
+#include <assert.h>
+
+LOGMODULE ("throughput");
+
+CThroughputDevice::CThroughputDevice (CDevice *pDevice)
+:	m_pDevice (pDevice),
+	m_ullReadBytes (0),
+	m_ullWriteBytes (0),
+	m_ullDeviceTime (0),
+	m_nLastReportTicks (CTimer::GetClockTicks ())
+{
+	assert (m_pDevice);
+}
+
+CThroughputDevice::~CThroughputDevice (void)
+{
+	m_pDevice = nullptr;
+}
+
+int CThroughputDevice::Read (void *pBuffer, size_t nCount)
+{
+	unsigned nStartTicks = CTimer::GetClockTicks ();
+
+	int nResult = m_pDevice->Read (pBuffer, nCount);
+
+	m_ullDeviceTime += CTimer::GetClockTicks () - nStartTicks;
+
+	if (nResult > 0)
+	{
+		m_ullReadBytes += nResult;
+	}
+
+	return nResult;
+}
+
+int CThroughputDevice::Write (const void *pBuffer, size_t nCount)
+{
+	unsigned nStartTicks = CTimer::GetClockTicks ();
+
+	int nResult = m_pDevice->Write (pBuffer, nCount);
+
+	m_ullDeviceTime += CTimer::GetClockTicks () - nStartTicks;
+
+	if (nResult > 0)
+	{
+		m_ullWriteBytes += nResult;
+	}
+
+	return nResult;
+}
+
+u64 CThroughputDevice::Seek (u64 ullOffset)
+{
+	return m_pDevice->Seek (ullOffset);
+}
+
+u64 CThroughputDevice::GetSize (void) const
+{
+	return m_pDevice->GetSize ();
+}
+
+void CThroughputDevice::Report (void)
+{
+	unsigned nTicks = CTimer::GetClockTicks ();
+	unsigned nElapsed = nTicks - m_nLastReportTicks;
+	m_nLastReportTicks = nTicks;
+
+	if (   !m_ullReadBytes
+	    && !m_ullWriteBytes)
+	{
+		return;
+	}
+
+	assert (nElapsed);
+	LOGNOTE ("Read %llu KB/s, write %llu KB/s, device busy %llu%%",
+		 m_ullReadBytes * 1000 / nElapsed, m_ullWriteBytes * 1000 / nElapsed,
+		 m_ullDeviceTime * 100 / nElapsed);
+
+	m_ullReadBytes = 0;
+	m_ullWriteBytes = 0;
+	m_ullDeviceTime = 0;
+}
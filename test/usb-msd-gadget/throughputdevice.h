@@ -0,0 +1,50 @@
+//
+// throughputdevice.h
+//
+// Circle - A C++ bare metal environment for Raspberry Pi
+// Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _throughputdevice_h
+#define _throughputdevice_h
+
+#include <circle/device.h>
+#include <circle/types.h>
+
+class CThroughputDevice : public CDevice	/// Measures the throughput of a block device
+{
+public:
+	CThroughputDevice (CDevice *pDevice);
+	~CThroughputDevice (void);
+
+	int Read (void *pBuffer, size_t nCount) override;
+	int Write (const void *pBuffer, size_t nCount) override;
+
+	u64 Seek (u64 ullOffset) override;
+	u64 GetSize (void) const override;
+
+	/// \brief Log the throughput since the last call, if there was any I/O
+	void Report (void);
+
+private:
+	CDevice *m_pDevice;
+
+	u64 m_ullReadBytes;
+	u64 m_ullWriteBytes;
+	u64 m_ullDeviceTime;		// microseconds spent in the device
+	unsigned m_nLastReportTicks;
+};
+
+#endif
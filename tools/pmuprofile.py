@@ -0,0 +1,243 @@
+#!/usr/bin/env python3
+#
+# pmuprofile.py - Symbolizes a profile, written by CPMUProfiler (addon/pmuprofile/)
+#
+# Circle - A C++ bare metal environment for Raspberry Pi
+# Copyright (C) 2025  R. Stange <rsta2@o2online.de>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Usage: python3 pmuprofile.py [options] kernel8.elf profile.txt > output
+#
+# The output is written in the folded stack format (default), which can be
+# converted into a flame graph using flamegraph.pl, or in the pprof format.
+
+import argparse
+import gzip
+import subprocess
+import sys
+
+METRICS = ('samples', 'cycles', 'l1d-refills', 'branch-mispredicts')
+
+class Sample:
+	def __init__(self, core, lr, addresses, values):
+		self.core = core
+		self.lr = lr
+		self.addresses = addresses		# PC first, then return addresses
+		self.values = values			# in the order of METRICS
+
+def read_profile(filename):
+	period = 1
+	samples = []
+	with open(filename) as f:
+		for line in f:
+			line = line.strip()
+			if line.startswith('# period '):
+				period = int(line.split()[2])
+			if not line or line.startswith('#'):
+				continue
+
+			fields = line.split()
+			if len(fields) != 5:
+				sys.exit('Invalid line: ' + line)
+
+			addresses = [int(x, 16) for x in fields[2].split(';')]
+			samples.append(Sample(int(fields[0]), int(fields[1], 16), addresses,
+					      [1, period, int(fields[3]), int(fields[4])]))
+
+	return period, samples
+
+class Symbolizer:
+	def __init__(self, elf, prefix):
+		self.elf = elf
+		self.prefix = prefix
+		self.cache = {}
+
+	def resolve(self, addresses):
+		"""Resolve a set of code addresses to (function, file, line) in one go"""
+		missing = sorted(set(addresses) - set(self.cache))
+		if not missing:
+			return
+
+		query = '\n'.join('%x' % address for address in missing) + '\n'
+		try:
+			result = subprocess.run([self.prefix + 'addr2line', '-f', '-C', '-e', self.elf],
+						input=query, stdout=subprocess.PIPE,
+						universal_newlines=True, check=True)
+		except (OSError, subprocess.CalledProcessError) as error:
+			sys.exit('Cannot run %saddr2line: %s' % (self.prefix, error))
+
+		lines = result.stdout.splitlines()
+		if len(lines) != 2 * len(missing):
+			sys.exit('Unexpected output from addr2line')
+
+		for i, address in enumerate(missing):
+			function = lines[2*i]
+			if function == '??':
+				function = '0x%x' % address
+
+			filename, _, lineno = lines[2*i+1].partition(':')
+			lineno = lineno.split()[0] if lineno else '0'
+			self.cache[address] = (function, filename,
+					       int(lineno) if lineno.isdigit() else 0)
+
+	def function(self, address):
+		return self.cache[address][0]
+
+def code_address(addresses, i):
+	"""Return addresses point behind the call instruction"""
+	return addresses[i] if i == 0 else addresses[i] - 4
+
+def unwind(sample, symbolizer):
+	"""Returns the code addresses of a sample, leaf first"""
+	addresses = [code_address(sample.addresses, i) for i in range(len(sample.addresses))]
+
+	# A leaf function without frame record (or a function in its prologue) has its caller
+	# in LR only, which is missing in the frame pointer chain then.
+	if sample.lr != 0:
+		lr = sample.lr - 4
+		function = symbolizer.function(lr)
+		if (    function != symbolizer.function(addresses[0])
+		    and (len(addresses) < 2 or lr != addresses[1])):
+			addresses.insert(1, lr)
+
+	return addresses
+
+def write_folded(samples, symbolizer, metric, per_core, output):
+	index = METRICS.index(metric)
+	stacks = {}
+	for sample in samples:
+		frames = [symbolizer.function(address) for address in unwind(sample, symbolizer)]
+		frames.reverse()
+		if per_core:
+			frames.insert(0, 'core %u' % sample.core)
+
+		stack = ';'.join(frame.replace(';', ':') for frame in frames)
+		stacks[stack] = stacks.get(stack, 0) + sample.values[index]
+
+	for stack in sorted(stacks):
+		if stacks[stack] != 0:
+			output.write('%s %u\n' % (stack, stacks[stack]))
+
+# minimal protocol buffers encoder for the pprof profile.proto format
+
+def varint(value):
+	result = bytearray()
+	while True:
+		byte = value & 0x7F
+		value >>= 7
+		if value:
+			result.append(byte | 0x80)
+		else:
+			result.append(byte)
+			return bytes(result)
+
+def field_varint(number, value):
+	return varint(number << 3) + varint(value)
+
+def field_bytes(number, data):
+	return varint(number << 3 | 2) + varint(len(data)) + data
+
+def field_packed(number, values):
+	return field_bytes(number, b''.join(varint(value) for value in values))
+
+def write_pprof(samples, symbolizer, period, output):
+	strings = ['']
+	string_index = {'': 0}
+	def string(s):
+		if s not in string_index:
+			string_index[s] = len(strings)
+			strings.append(s)
+		return string_index[s]
+
+	profile = b''
+	for metric in METRICS:
+		profile += field_bytes(1, field_varint(1, string(metric)) + field_varint(2, string('count')))
+
+	functions = {}
+	locations = {}
+	for sample in samples:
+		location_ids = []
+		for address in unwind(sample, symbolizer):
+			if address not in locations:
+				name, filename, line = symbolizer.cache[address]
+				if name not in functions:
+					functions[name] = (len(functions) + 1, filename)
+				locations[address] = (len(locations) + 1, functions[name][0], line)
+			location_ids.append(locations[address][0])
+
+		profile += field_bytes(2, field_packed(1, location_ids)
+					  + field_packed(2, sample.values))
+
+	for address, (location_id, function_id, line) in sorted(locations.items(),
+								 key=lambda item: item[1][0]):
+		profile += field_bytes(4,   field_varint(1, location_id)
+					  + field_varint(3, address)
+					  + field_bytes(4,   field_varint(1, function_id)
+							   + field_varint(2, line)))
+
+	for name, (function_id, filename) in sorted(functions.items(), key=lambda item: item[1][0]):
+		profile += field_bytes(5,   field_varint(1, function_id)
+					  + field_varint(2, string(name))
+					  + field_varint(3, string(name))
+					  + field_varint(4, string(filename)))
+
+	period_type = field_bytes(11, field_varint(1, string('cycles')) + field_varint(2, string('count')))
+
+	for s in strings:
+		profile += field_bytes(6, s.encode())
+
+	profile += period_type + field_varint(12, period)
+
+	output.write(gzip.compress(profile))
+
+def main():
+	parser = argparse.ArgumentParser(description='Symbolize a Circle PMU profile')
+	parser.add_argument('elf', help='kernel image in ELF format (e.g. kernel8.elf)')
+	parser.add_argument('profile', help='profile written by CPMUProfiler (e.g. profile.txt)')
+	parser.add_argument('--format', choices=('folded', 'pprof'), default='folded',
+			    help='output format (default: folded)')
+	parser.add_argument('--metric', choices=METRICS, default='samples',
+			    help='weight of the folded stacks (default: samples)')
+	parser.add_argument('--per-core', action='store_true',
+			    help='add the core number as root frame to the folded stacks')
+	parser.add_argument('--prefix', default='aarch64-none-elf-',
+			    help='toolchain prefix (default: aarch64-none-elf-)')
+	parser.add_argument('-o', '--output', help='output file (default: stdout)')
+	args = parser.parse_args()
+
+	period, samples = read_profile(args.profile)
+	if not samples:
+		sys.exit('No samples in ' + args.profile)
+
+	symbolizer = Symbolizer(args.elf, args.prefix)
+	addresses = set()
+	for sample in samples:
+		addresses.update(code_address(sample.addresses, i) for i in range(len(sample.addresses)))
+		if sample.lr != 0:
+			addresses.add(sample.lr - 4)
+	symbolizer.resolve(addresses)
+
+	if args.format == 'pprof':
+		output = open(args.output, 'wb') if args.output else sys.stdout.buffer
+		write_pprof(samples, symbolizer, period, output)
+	else:
+		output = open(args.output, 'w') if args.output else sys.stdout
+		write_folded(samples, symbolizer, args.metric, args.per_core, output)
+
+	if args.output:
+		output.close()
+
+if __name__ == '__main__':
+	main()